@@ -97,11 +97,41 @@ void printSphereFileInfo(SPHFILE *sf, char *mode)
     fflush(stdout);
 }
 
-SPHFILE* openSphereFile(const char* filename, char *mode, SPHFILE *sf)
+/* Reads the header of a SPHERE file opened as fileHandle, and sets sf to
+ * read its audio; closes fileHandle and returns NULL if it fails.
+ */
+static SPHFILE* openSphereHandle(const char* filename, FILE* fileHandle,
+                                 SPHFILE* sf)
 {
-    FILE* fileHandle = NULL;
     char hdr[1024];
     memset(hdr,0,sizeof(hdr));
+    if (fread(hdr,sizeof(hdr[0]),sizeof(hdr),fileHandle) != sizeof(hdr)) {
+        fprintf(stderr,"In openSphereFile('%s'): failed to read SPHERE header.\n",filename);
+        fclose(fileHandle);
+        return NULL;
+    }
+    if (strncmp(hdr,"NIST_1A\n",8) || strncmp(hdr + 8,"   1024\n",8)) {
+        fprintf(stderr,"In openSphereFile('%s'): not in NIST_1A format.\n",filename);
+        fclose(fileHandle);
+        return NULL;
+    }
+    hdr2sf(sf,hdr);
+    sf->numSamplesPerChannel = sf->dataSize / (sf->bitDepth / 8);
+    sf->numSamples = sf->numSamplesPerChannel * sf->numChannels;
+    //printSphereFileInfo(sf,mode);
+    if (sf->audioFormat != 1) {
+        fprintf(stderr,"In openSphereFile('%s'): unsupported audio format %d; only PCM (1) supported.\n",filename,sf->audioFormat);
+        fclose(fileHandle);
+        return NULL;
+    }
+    sf->mode = 'r';
+    sf->fileHandle = fileHandle;
+    return sf;
+}
+
+SPHFILE* openSphereFile(const char* filename, char *mode, SPHFILE *sf)
+{
+    FILE* fileHandle = NULL;
     memset(sf,0,sizeof(*sf));
     
     if (*mode != 'r') {
@@ -110,35 +140,27 @@ SPHFILE* openSphereFile(const char* filename, char *mode, SPHFILE *sf)
     }
     //printf("Openning '%s' for %s.\n",filename,(*mode == 'r') ? "read" : "write");
     
-    if (*mode == 'r') {
-        fileHandle = fopen(filename,"rb");
-        if (fileHandle == NULL) {
-            fprintf(stderr,"In openSphereFile('%s'): failed to open the file for read.\n",filename);
-            return NULL;
-        }
-        if (fread(hdr,sizeof(hdr[0]),sizeof(hdr),fileHandle) != sizeof(hdr)) {
-            fprintf(stderr,"In openSphereFile('%s'): failed to read SPHERE header.\n",filename);
-            fclose(fileHandle);
-            return NULL;
-        }
-        if (strncmp(hdr,"NIST_1A\n",8) || strncmp(hdr + 8,"   1024\n",8)) {
-            fprintf(stderr,"In openSphereFile('%s'): not in NIST_1A format.\n",filename);
-            fclose(fileHandle);
-            return NULL;
-        }
-        hdr2sf(sf,hdr);
-        sf->numSamplesPerChannel = sf->dataSize / (sf->bitDepth / 8);
-        sf->numSamples = sf->numSamplesPerChannel * sf->numChannels;
-        //printSphereFileInfo(sf,mode);
-        if (sf->audioFormat != 1) {
-            fprintf(stderr,"In openSphereFile('%s'): unsupported audio format %d; only PCM (1) supported.\n",filename,sf->audioFormat);
-            fclose(fileHandle);
-            return NULL;
-        }
-        sf->mode = *mode;
-        sf->fileHandle = fileHandle;
+    fileHandle = fopen(filename,"rb");
+    if (fileHandle == NULL) {
+        fprintf(stderr,"In openSphereFile('%s'): failed to open the file for read.\n",filename);
+        return NULL;
     }
-    return sf;
+    return openSphereHandle(filename,fileHandle,sf);
+}
+
+/* Opens the contents of a SPHERE file, already in memory, for read; see
+ * fileload.h. data must remain valid until closeSphereFile() is called.
+ */
+SPHFILE* openSphereBuffer(const char* filename, const void* data, size_t size,
+                          SPHFILE *sf)
+{
+    memset(sf,0,sizeof(*sf));
+    FILE* fileHandle = (size > 0) ? fmemopen((void*) data,size,"rb") : NULL;
+    if (fileHandle == NULL) {
+        fprintf(stderr,"In openSphereBuffer('%s'): failed to open the file contents for read.\n",filename);
+        return NULL;
+    }
+    return openSphereHandle(filename,fileHandle,sf);
 }
 
 SPHFILE* closeSphereFile(SPHFILE* sf) 
@@ -190,17 +212,17 @@ size_t readSphereAudio(SPHFILE* sf, float *fltBuf, size_t numSamples)
                 for (size_t i = 0; i < samplesRead; i++)
                     pcmBuf[i] = __builtin_bswap16(pcmBuf[i]);
             } 
-            pcm2flt(pcmBuf,fltBuf,samplesRead);
+            pcm2flt(pcmBuf,fltBuf + cnt,samplesRead);
         }
         else {
-            samplesRead = readSphereFile(sf,fltBuf,readSize);
+            samplesRead = readSphereFile(sf,fltBuf + cnt,readSize);
             if (sf->endianess == 'b') {
                 for (size_t i = 0; i < samplesRead; i++)
-                    fltBuf[i] = __builtin_bswap32(fltBuf[i]);
+                    fltBuf[cnt + i] = __builtin_bswap32(fltBuf[cnt + i]);
             }
         }
         cnt += samplesRead;
-        if (samplesRead < bufSize)
+        if (samplesRead < readSize)
             break;
     }
     return cnt;
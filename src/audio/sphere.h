@@ -19,6 +19,8 @@ typedef struct sphfile_t {
 } SPHFILE;
 
 SPHFILE* openSphereFile(const char* filename, char *mode, SPHFILE *sf);
+SPHFILE* openSphereBuffer(const char* filename, const void* data, size_t size,
+                          SPHFILE *sf);
 SPHFILE* closeSphereFile(SPHFILE* sf);
 size_t readSphereFile(SPHFILE* sf, void *buffer, size_t numSamples);
 size_t seekSphereFile(SPHFILE* sf, size_t offsetSamples);
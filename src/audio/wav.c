@@ -82,6 +82,38 @@ static void printwf(WAVFILE *wf, char *mode)
     printf("Data Size: %d bytes\n", wf->dataSize);
 }
 
+/* Reads the header of a WAV file opened for read as fileHandle, and sets
+ * wf to read its audio; closes fileHandle and returns NULL if it fails.
+ */
+static WAVFILE* openWavHandle(const char* filename, FILE* fileHandle,
+                              WAVFILE* wf)
+{
+    char hdr[sizeof(WAVHDR)];
+    if (fread(hdr,sizeof(hdr[0]),sizeof(hdr),fileHandle) != sizeof(hdr)) {
+        fprintf(stderr,"In openWavFile('%s'): failed to read WAV header.\n",filename);
+        fclose(fileHandle);
+        return NULL;
+    }
+    if (hdr[0]!='R' || hdr[1]!='I' || hdr[2]!='F' || hdr[3]!='F' ||
+        hdr[8]!='W' || hdr[9]!='A' || hdr[10]!='V' || hdr[11]!='E') {
+        fprintf(stderr,"In openWavFile('%s'): not a WAV file.\n",filename);
+        fclose(fileHandle);
+        return NULL;
+    }
+    hdr2wf(wf,hdr);
+    if (wf->audioFormat != 1 && wf->audioFormat != 3 && wf->audioFormat != 7) {
+        fprintf(stderr,"In openWavFile('%s'): unsupported audio format %d; only PCM (1), float (3) and uLaw (7) supported.\n",filename,wf->audioFormat);
+        fclose(fileHandle);
+        return NULL;
+    }
+    wf->numSamples =  wf->dataSize / (wf->bitDepth / 8);
+    wf->numSamplesPerChannel = wf->numSamples / wf->numChannels;
+    wf->fileHandle = fileHandle;
+    wf->mode = 'r';
+    printwf(wf,"r");
+    return wf;
+}
+
 WAVFILE* openWavFile(const char* filename, char* mode, WAVFILE* wf) 
 {
     FILE* fileHandle = NULL;
@@ -99,28 +131,7 @@ WAVFILE* openWavFile(const char* filename, char* mode, WAVFILE* wf)
             fprintf(stderr,"In openWavFile('%s'): failed to open the file for read.\n",filename);
             return NULL;
         }
-        if (fread(hdr,sizeof(hdr[0]),sizeof(hdr),fileHandle) != sizeof(hdr)) {
-            fprintf(stderr,"In openWavFile('%s'): failed to read WAV header.\n",filename);
-            fclose(fileHandle);
-            return NULL;
-        }
-        if (hdr[0]!='R' || hdr[1]!='I' || hdr[2]!='F' || hdr[3]!='F' ||
-            hdr[8]!='W' || hdr[9]!='A' || hdr[10]!='V' || hdr[11]!='E') {
-            fprintf(stderr,"In openWavFile('%s'): not a WAV file.\n",filename);
-            fclose(fileHandle);
-            return NULL;
-        }
-        hdr2wf(wf,hdr);
-        if (wf->audioFormat != 1 && wf->audioFormat != 3 && wf->audioFormat != 7) {
-            fprintf(stderr,"In openWavFile('%s'): unsupported audio format %d; only PCM (1), float (3) and uLaw (7) supported.\n",filename,wf->audioFormat);
-            fclose(fileHandle);
-            return NULL;
-        }
-        wf->numSamples =  wf->dataSize / (wf->bitDepth / 8);
-        wf->numSamplesPerChannel = wf->numSamples / wf->numChannels;
-        wf->fileHandle = fileHandle;
-        wf->mode = *mode;
-        printwf(wf,mode);
+        return openWavHandle(filename,fileHandle,wf);
     }
     if (*mode == 'w') {
         wf->endianess = 'l'; // always little-endian
@@ -143,6 +154,20 @@ WAVFILE* openWavFile(const char* filename, char* mode, WAVFILE* wf)
     return wf;
 }
 
+/* Opens the contents of a WAV file, already in memory, for read; see
+ * fileload.h. data must remain valid until closeWavFile() is called.
+ */
+WAVFILE* openWavBuffer(const char* filename, const void* data, size_t size,
+                       WAVFILE* wf)
+{
+    FILE* fileHandle = (size > 0) ? fmemopen((void*) data,size,"rb") : NULL;
+    if (fileHandle == NULL) {
+        fprintf(stderr,"In openWavBuffer('%s'): failed to open the file contents for read.\n",filename);
+        return NULL;
+    }
+    return openWavHandle(filename,fileHandle,wf);
+}
+
 WAVFILE* closeWavFile(WAVFILE* wf) 
 {
     int rv = 0;
@@ -13,6 +13,8 @@ typedef struct wavfile_t {
 } WAVFILE;
 
 WAVFILE* openWavFile(const char* filename, char *mode, WAVFILE *wf);
+WAVFILE* openWavBuffer(const char* filename, const void* data, size_t size,
+                       WAVFILE* wf);
 WAVFILE* closeWavFile(WAVFILE* wf);
 size_t readWavFile(WAVFILE* wf, void *buffer, size_t numSamples);
 size_t seekWavFile(WAVFILE* wf, size_t offsetSamples);
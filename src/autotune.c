@@ -0,0 +1,383 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Selection of the fastest kernel variant per shape and host */
+#include <stdio.h>
+#include <stdlib.h>  /* realloc() */
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "mem.h"
+#include "etime.h"
+#include "numatopo.h"
+#include "tasksched.h"
+#include "autotune.h"
+
+#define BLOCK_ROWS      4   /* Rows of x that share a block of y        */
+#define BLOCK_COLS    256   /* Columns of y in a block                  */
+#define TUNE_MIN_REPS   3   /* Runs of each kernel                      */
+#define TUNE_TIME  2000000  /* Nanoseconds each kernel runs, at least   */
+#define TUNE_MARGIN     5   /* Percent faster than naive to be selected */
+#define TUNE_MIN_SIZE 32768 /* Fewer multiply-adds run the naive kernel  */
+
+typedef struct {
+    int N, d, M;                    /* Shape                            */
+    int kernel;                     /* Fastest kernel                   */
+    float ms[NUM_KERNELS];          /* Time each kernel took, in ms     */
+} TUNEENTRY;
+
+static pthread_mutex_t tune_lock = PTHREAD_MUTEX_INITIALIZER;
+static int loaded = 0;
+static int disabled = 0;
+static char cpu_model[128];
+static char cache_file[1024];
+static TUNEENTRY* entries = NULL;
+static int num_entries = 0;
+static int max_entries = 0;
+
+static const char* kernel_name[NUM_KERNELS] = {
+    "naive", "blocked", "threaded"
+};
+
+void matmul_blocked(fArr2D restrict r_, const fArr2D restrict x_,
+                    const fArr2D restrict y_, int N, int d, int M)
+{
+    typedef float (*ArrNM)[M]; ArrNM r = (ArrNM) r_;
+    typedef float (*ArrNd)[d]; const ArrNd x = (const ArrNd) x_;
+    typedef float (*ArrdM)[M]; const ArrdM y = (const ArrdM) y_;
+    fltclr(r,N * M);
+    for (int j0 = 0; j0 < M; j0 += BLOCK_COLS) {
+        int j1 = (j0 + BLOCK_COLS < M) ? j0 + BLOCK_COLS : M;
+        for (int i0 = 0; i0 < N; i0 += BLOCK_ROWS) {
+            int i1 = (i0 + BLOCK_ROWS < N) ? i0 + BLOCK_ROWS : N;
+            for (int k = 0; k < d; k++)
+                for (int i = i0; i < i1; i++) {
+                    float xik = x[i][k];
+                    for (int j = j0; j < j1; j++)
+                        r[i][j] += xik * y[k][j];
+                }
+        }
+    }
+}
+
+typedef struct {
+    float* r;
+    const float* x;
+    const float* y;
+    int d, M;
+} MATMULARG;
+
+static void matmul_rows(void* arg, int lo, int hi)
+{
+    MATMULARG* a = (MATMULARG*) arg;
+    matmul((fArr2D) (a->r + (long) lo * a->M),
+           (fArr2D) (a->x + (long) lo * a->d),
+           (fArr2D) a->y,hi - lo,a->d,a->M);
+}
+
+void matmul_threaded(fArr2D restrict r, const fArr2D restrict x,
+                     const fArr2D restrict y, int N, int d, int M)
+{
+    MATMULARG a = { (float*) r, (const float*) x, (const float*) y, d, M };
+    /* Ranges of at least about 64K multiply-adds */
+    int grain = 1 + 65536 / ((long) d * M + 1);
+    parallel_for(sched_default(),0,N,grain,matmul_rows,&a);
+}
+
+/* Returns the name of kernel k */
+const char* autotune_kernel_name(int k)
+{
+    return (k >= 0 && k < NUM_KERNELS) ? kernel_name[k] : "unknown";
+}
+
+/* Reads the cpu model, and sets the cache file name. Called with tune_lock
+ * locked.
+ */
+static void init_names(void)
+{
+    strcpy(cpu_model,"unknown");
+    FILE* f = fopen("/proc/cpuinfo","r");
+    if (f != NULL) {
+        char line[256];
+        while (fgets(line,sizeof(line),f) != NULL)
+            if (!strncmp(line,"model name",10) && strchr(line,':') != NULL) {
+                const char* p = strchr(line,':') + 1;
+                while (*p == ' ' || *p == '\t')
+                    p++;
+                snprintf(cpu_model,sizeof(cpu_model),"%s",p);
+                cpu_model[strcspn(cpu_model,"\n")] = '\0';
+                break;
+            }
+        fclose(f);
+    }
+    const char* env = getenv("MLINC_TUNE_CACHE");
+    if (env != NULL && env[0] != '\0') {
+        snprintf(cache_file,sizeof(cache_file),"%s",env);
+        return;
+    }
+    /* File name: cpu model, letters and digits only, and number of cpus,
+     * since that decides whether threads help
+     */
+    char key[128];
+    int n = 0;
+    for (const char* p = cpu_model; *p != '\0' && n < 100; p++)
+        if (isalnum((unsigned char) *p))
+            key[n++] = *p;
+        else
+        if (n > 0 && key[n - 1] != '-')
+            key[n++] = '-';
+    key[n] = '\0';
+    const char* home = getenv("HOME");
+    snprintf(cache_file,sizeof(cache_file),"%s/.cache/mlinc/tune-%s%dcpu.txt",
+             (home != NULL) ? home : ".",key,numatopo_get()->num_cpus);
+}
+
+/* Returns a new entry at the end of the cache */
+static TUNEENTRY* add_entry(void)
+{
+    if (num_entries == max_entries) {
+        int new_max = 2 * max_entries + 16;
+        TUNEENTRY* e = realloc(entries,new_max * sizeof(TUNEENTRY));
+        if (e == NULL) {
+            fflush(stdout);
+            fprintf(stderr,"\nIn function '%s': "
+                    "out of memory at file '%s' line %d\n",
+                    __FUNCTION__,__FILE__,__LINE__);
+            exit(-1);
+        }
+        entries = e;
+        max_entries = new_max;
+    }
+    return &entries[num_entries++];
+}
+
+/* Reads the cache file, if it exists and is of this cpu model. Called with
+ * tune_lock locked.
+ */
+static void load_cache(void)
+{
+    loaded = 1;
+    const char* env = getenv("MLINC_TUNE");
+    disabled = (env != NULL && !strcmp(env,"0"));
+    init_names();
+    FILE* f = fopen(cache_file,"r");
+    if (f == NULL)
+        return;
+    char line[256];
+    char header[sizeof(cpu_model) + 8];
+    snprintf(header,sizeof(header),"cpu %s\n",cpu_model);
+    if (fgets(line,sizeof(line),f) == NULL || strcmp(line,header)) {
+        fclose(f); /* Another cpu's decisions */
+        return;
+    }
+    TUNEENTRY e;
+    char kname[32];
+    while (fscanf(f," matmul %d %d %d %31s %f %f %f",&e.N,&e.d,&e.M,kname,
+                  &e.ms[0],&e.ms[1],&e.ms[2]) == 7) {
+        e.kernel = -1;
+        for (int k = 0; k < NUM_KERNELS; k++)
+            if (!strcmp(kname,kernel_name[k]))
+                e.kernel = k;
+        if (e.kernel < 0)
+            continue;
+        *add_entry() = e;
+    }
+    fclose(f);
+}
+
+/* Writes the cache file, creating its directory if needed. Called with
+ * tune_lock locked.
+ */
+static void save_cache(void)
+{
+    char path[1024 + 8];
+    /* Create missing directories of the path */
+    strcpy(path,cache_file);
+    for (char* p = path + 1; *p != '\0'; p++)
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(path,0755);
+            *p = '/';
+        }
+    /* Write a temporary file and rename it, so readers see whole files */
+    snprintf(path,sizeof(path),"%s.%d",cache_file,(int) getpid());
+    FILE* f = fopen(path,"w");
+    if (f == NULL) {
+        static int warned = 0;
+        if (!warned++)
+            printf("In autotune: failed to write cache file '%s'\n",
+                   cache_file);
+        return;
+    }
+    fprintf(f,"cpu %s\n",cpu_model);
+    for (int i = 0; i < num_entries; i++) {
+        const TUNEENTRY* e = &entries[i];
+        fprintf(f,"matmul %d %d %d %s %.4f %.4f %.4f\n",e->N,e->d,e->M,
+                kernel_name[e->kernel],e->ms[0],e->ms[1],e->ms[2]);
+    }
+    int ok = !ferror(f);
+    if (fclose(f) != 0 || !ok || rename(path,cache_file) != 0)
+        remove(path);
+}
+
+/* Returns the cache entry of a shape, or NULL */
+static TUNEENTRY* find_entry(int N, int d, int M)
+{
+    for (int i = 0; i < num_entries; i++)
+        if (entries[i].N == N && entries[i].d == d && entries[i].M == M)
+            return &entries[i];
+    return NULL;
+}
+
+/* Returns the shortest time, in nanoseconds, of runs of kernel k */
+static long long time_kernel(int k, fArr2D r, fArr2D x, fArr2D y,
+                             int N, int d, int M)
+{
+    long long best = -1;
+    long long total = 0;
+    matmul_kernel(k,r,x,y,N,d,M); /* Warm up caches */
+    for (int rep = 0; rep < TUNE_MIN_REPS || total < TUNE_TIME; rep++) {
+        long long t0 = current_time_ns();
+        matmul_kernel(k,r,x,y,N,d,M);
+        long long t = current_time_ns() - t0;
+        total += t;
+        if (best < 0 || t < best)
+            best = t;
+    }
+    return best;
+}
+
+/* Runs the kernels of a shape, and returns its entry. Called with
+ * tune_lock locked.
+ */
+static TUNEENTRY* tune(int N, int d, int M)
+{
+    TUNEENTRY* e = find_entry(N,d,M);
+    if (e == NULL) {
+        e = add_entry();
+        e->N = N;
+        e->d = d;
+        e->M = M;
+    }
+    /* Values do not matter, but are not random numbers, since drawing
+     * them would change the random sequence of the caller
+     */
+    float* r = allocmem(N,M,float);
+    float* x = allocmem(N,d,float);
+    float* y = allocmem(d,M,float);
+    for (long i = 0; i < (long) N * d; i++)
+        x[i] = (i % 17) * 0.125f - 1.0f;
+    for (long i = 0; i < (long) d * M; i++)
+        y[i] = (i % 13) * 0.0625f - 0.4f;
+    /* Another kernel replaces the naive one only if it is faster by more
+     * than the noise of the timing
+     */
+    long long best = -1;
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        long long t = time_kernel(k,(fArr2D) r,(fArr2D) x,(fArr2D) y,N,d,M);
+        e->ms[k] = t / 1e6;
+        if (k != KERNEL_NAIVE)
+            t += t * TUNE_MARGIN / 100;
+        if (best < 0 || t < best) {
+            best = t;
+            e->kernel = k;
+        }
+    }
+    freemem(r);
+    freemem(x);
+    freemem(y);
+    save_cache();
+    return e;
+}
+
+/* Returns the fastest kernel of the product of an Nxd matrix by a dxM
+ * matrix.
+ *
+ * Parameters:
+ *   N, d, M - Shape of the product
+ *
+ * Returns:
+ *   One of KERNEL_ above.
+ *
+ * Notes:
+ *   The decision is taken from the cache if it is there; otherwise the
+ *   kernels are run, and the decision is added to the cache and saved.
+ *   Products of fewer than TUNE_MIN_SIZE multiply-adds are not tuned;
+ *   they run the naive kernel.
+ */
+int autotune_matmul(int N, int d, int M)
+{
+    pthread_mutex_lock(&tune_lock);
+    if (!loaded)
+        load_cache();
+    int kernel = KERNEL_NAIVE;
+    /* Small products take too short a time to tell the kernels apart */
+    if (!disabled && N > 0 && d > 0 && M > 0 &&
+        (long) N * d * M >= TUNE_MIN_SIZE) {
+        TUNEENTRY* e = find_entry(N,d,M);
+        if (e == NULL)
+            e = tune(N,d,M);
+        kernel = e->kernel;
+    }
+    pthread_mutex_unlock(&tune_lock);
+    return kernel;
+}
+
+/* Runs the kernels of the product of an Nxd matrix by a dxM matrix, and
+ * updates the cache, even if the shape is already there. Returns the
+ * fastest kernel.
+ */
+int autotune_matmul_force(int N, int d, int M)
+{
+    pthread_mutex_lock(&tune_lock);
+    if (!loaded)
+        load_cache();
+    int kernel = KERNEL_NAIVE;
+    if (N > 0 && d > 0 && M > 0)
+        kernel = tune(N,d,M)->kernel;
+    pthread_mutex_unlock(&tune_lock);
+    return kernel;
+}
+
+/* Returns the cpu model of this host, as it appears in /proc/cpuinfo */
+const char* autotune_cpu_model(void)
+{
+    pthread_mutex_lock(&tune_lock);
+    if (!loaded)
+        load_cache();
+    pthread_mutex_unlock(&tune_lock);
+    return cpu_model;
+}
+
+/* Returns the name of the cache file */
+const char* autotune_cache_file(void)
+{
+    pthread_mutex_lock(&tune_lock);
+    if (!loaded)
+        load_cache();
+    pthread_mutex_unlock(&tune_lock);
+    return cache_file;
+}
+
+/* Prints the decisions of the cache, with the time each kernel took, to f */
+void autotune_print(FILE* f)
+{
+    pthread_mutex_lock(&tune_lock);
+    if (!loaded)
+        load_cache();
+    fprintf(f,"Cpu: %s\nCache: %s%s\n",cpu_model,cache_file,
+            (disabled) ? " (tuning disabled)" : "");
+    fprintf(f,"%-8s %6s %6s %6s %-9s","op","N","d","M","kernel");
+    for (int k = 0; k < NUM_KERNELS; k++)
+        fprintf(f," %9s",kernel_name[k]);
+    fprintf(f," (ms)\n");
+    for (int i = 0; i < num_entries; i++) {
+        const TUNEENTRY* e = &entries[i];
+        fprintf(f,"%-8s %6d %6d %6d %-9s","matmul",e->N,e->d,e->M,
+                kernel_name[e->kernel]);
+        for (int k = 0; k < NUM_KERNELS; k++)
+            fprintf(f," %9.4f",e->ms[k]);
+        fprintf(f,"\n");
+    }
+    pthread_mutex_unlock(&tune_lock);
+}
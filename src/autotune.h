@@ -0,0 +1,89 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Selection of the fastest kernel variant per shape and host */
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+#include <stdio.h>
+#include "array.h"
+
+/* Several kernels compute the same matrix product; which is fastest
+ * depends on the shape of the matrices and on the host. autotune_matmul()
+ * runs each candidate on a matrix of the given shape, and returns the
+ * fastest. Decisions are kept in a cache file, one per cpu model, so later
+ * runs reuse them without running the candidates again.
+ *
+ * The cache file is set by the environment variable MLINC_TUNE_CACHE, or
+ * is $HOME/.cache/mlinc/tune-<cpu model>.txt. Setting MLINC_TUNE to 0
+ * disables tuning: autotune_matmul() then returns KERNEL_NAIVE. Another
+ * kernel replaces the naive one only if it is faster by a margin larger
+ * than the noise of the timing.
+ *
+ * All kernels add products in the same order, so their results are the
+ * same, up to the rounding of multiply-adds the compiler may contract.
+ */
+#define KERNEL_NAIVE     0  /* Row by row, specialized for constant shapes */
+#define KERNEL_BLOCKED   1  /* Blocks of rows and columns (cache blocked)  */
+#define KERNEL_THREADED  2  /* Rows split across scheduler threads         */
+#define NUM_KERNELS      3
+
+/* Computes r = x @ y, where r is NxM, x is Nxd and y is dxM, in blocks of
+ * rows and columns, so that each block of y is reused by several rows of
+ * x while it is in cache.
+ */
+void matmul_blocked(fArr2D restrict r, const fArr2D restrict x,
+                    const fArr2D restrict y, int N, int d, int M);
+
+/* Computes r = x @ y, where r is NxM, x is Nxd and y is dxM, on the
+ * threads of the default scheduler (see tasksched.h), each computing a
+ * range of rows.
+ */
+void matmul_threaded(fArr2D restrict r, const fArr2D restrict x,
+                     const fArr2D restrict y, int N, int d, int M);
+
+/* Computes r = x @ y with the given kernel, one of KERNEL_ above */
+static inline void matmul_kernel(int kernel, fArr2D restrict r,
+                                 const fArr2D restrict x,
+                                 const fArr2D restrict y, int N, int d, int M)
+{
+    switch (kernel) {
+        case KERNEL_BLOCKED: matmul_blocked(r,x,y,N,d,M); break;
+        case KERNEL_THREADED: matmul_threaded(r,x,y,N,d,M); break;
+        default: matmul(r,x,y,N,d,M); break;
+    }
+}
+
+/* Returns the fastest kernel of the product of an Nxd matrix by a dxM
+ * matrix.
+ *
+ * Parameters:
+ *   N, d, M - Shape of the product
+ *
+ * Returns:
+ *   One of KERNEL_ above.
+ *
+ * Notes:
+ *   The decision is taken from the cache if it is there; otherwise the
+ *   kernels are run, and the decision is added to the cache and saved.
+ *   Small products, which take too short a time to tell the kernels apart,
+ *   are not tuned; they run the naive kernel.
+ */
+int autotune_matmul(int N, int d, int M);
+
+/* Runs the kernels of the product of an Nxd matrix by a dxM matrix, and
+ * updates the cache, even if the shape is already there. Returns the
+ * fastest kernel.
+ */
+int autotune_matmul_force(int N, int d, int M);
+
+/* Returns the name of kernel k */
+const char* autotune_kernel_name(int k);
+
+/* Returns the cpu model of this host, as it appears in /proc/cpuinfo */
+const char* autotune_cpu_model(void);
+
+/* Returns the name of the cache file */
+const char* autotune_cache_file(void);
+
+/* Prints the decisions of the cache, with the time each kernel took, to f */
+void autotune_print(FILE* f);
+
+#endif
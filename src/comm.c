@@ -0,0 +1,329 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Communication between the processes of data parallel training */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "mem.h"
+#include "comm.h"
+
+#define SHM_CHANNEL_SIZE (1L << 20) /* Bytes buffered between two ranks  */
+#define SHM_TIMEOUT       600       /* Seconds without progress          */
+#define CACHE_LINE         64
+
+/* A single producer single consumer byte queue in shared memory. Channel
+ * r is written by rank r-1 and read by rank r.
+ */
+typedef struct {
+    atomic_long head;           /* Number of bytes written                */
+    char pad1[CACHE_LINE - sizeof(atomic_long)];
+    atomic_long tail;           /* Number of bytes read                   */
+    char pad2[CACHE_LINE - sizeof(atomic_long)];
+    char data[SHM_CHANNEL_SIZE];
+} SHMCHANNEL;
+
+typedef struct {
+    atomic_int attached;        /* Number of ranks that opened the memory */
+    char pad[CACHE_LINE - sizeof(atomic_int)];
+    SHMCHANNEL channel[];
+} SHMHEADER;
+
+typedef struct {
+    SHMHEADER* h;
+    long size;                  /* Size of the mapped memory              */
+} SHMCOMM;
+
+/* Writes up to n bytes to a channel; returns the number written */
+static long channel_write(SHMCHANNEL* ch, const char* buf, long n)
+{
+    long head = atomic_load_explicit(&ch->head,memory_order_relaxed);
+    long tail = atomic_load_explicit(&ch->tail,memory_order_acquire);
+    long room = SHM_CHANNEL_SIZE - (head - tail);
+    if (n > room)
+        n = room;
+    long pos = head % SHM_CHANNEL_SIZE;
+    long n1 = (n < SHM_CHANNEL_SIZE - pos) ? n : SHM_CHANNEL_SIZE - pos;
+    memcpy(ch->data + pos,buf,n1);
+    memcpy(ch->data,buf + n1,n - n1);
+    atomic_store_explicit(&ch->head,head + n,memory_order_release);
+    return n;
+}
+
+/* Reads up to n bytes from a channel; returns the number read */
+static long channel_read(SHMCHANNEL* ch, char* buf, long n)
+{
+    long tail = atomic_load_explicit(&ch->tail,memory_order_relaxed);
+    long head = atomic_load_explicit(&ch->head,memory_order_acquire);
+    if (n > head - tail)
+        n = head - tail;
+    long pos = tail % SHM_CHANNEL_SIZE;
+    long n1 = (n < SHM_CHANNEL_SIZE - pos) ? n : SHM_CHANNEL_SIZE - pos;
+    memcpy(buf,ch->data + pos,n1);
+    memcpy(buf + n1,ch->data,n - n1);
+    atomic_store_explicit(&ch->tail,tail + n,memory_order_release);
+    return n;
+}
+
+static int shm_sendrecv(COMM* c, const void* sbuf, long ns, void* rbuf, long nr)
+{
+    SHMCOMM* sc = (SHMCOMM*) c->impl;
+    SHMCHANNEL* out = &sc->h->channel[(c->rank + 1) % c->size];
+    SHMCHANNEL* in = &sc->h->channel[c->rank];
+    long sent = 0, recvd = 0;
+    int idle = 0;
+    time_t start = 0;
+    while (sent < ns || recvd < nr) {
+        long k = 0;
+        if (sent < ns)
+            k += channel_write(out,(const char*) sbuf + sent,ns - sent);
+        sent += k;
+        if (recvd < nr) {
+            long r = channel_read(in,(char*) rbuf + recvd,nr - recvd);
+            recvd += r;
+            k += r;
+        }
+        if (k > 0) {
+            idle = 0;
+            continue;
+        }
+        if (++idle < 1000) /* Neighbors are usually just behind */
+            continue;
+        if (start == 0)
+            start = time(NULL);
+        else
+        if (time(NULL) - start > SHM_TIMEOUT) {
+            fflush(stdout);
+            fprintf(stderr,"shm_sendrecv: rank %d timed out\n",c->rank);
+            return 0;
+        }
+        if (idle < 2000)
+            sched_yield();
+        else {
+            struct timespec ts = { 0, 50000 };
+            nanosleep(&ts,NULL);
+        }
+        if (idle > 1000000)
+            idle = 2000;
+    }
+    return 1;
+}
+
+static void shm_close(COMM* c)
+{
+    SHMCOMM* sc = (SHMCOMM*) c->impl;
+    munmap(sc->h,sc->size);
+    freemem(sc);
+}
+
+/* Creates a communicator whose transport is POSIX shared memory, for
+ * processes on the same host.
+ *
+ * Parameters:
+ *   name - Name of the shared memory object, such as "/mlinc-1234";
+ *          it must be the same in all the processes, and not be used by
+ *          another group of processes
+ *   rank - Rank of the calling process, 0 to size-1
+ *   size - Number of processes
+ *
+ * Returns:
+ *   A pointer to the communicator, or NULL if an error occured.
+ *
+ * Notes:
+ *   Every process must call it. The shared memory object is removed when
+ *   all the processes have opened it.
+ */
+COMM* comm_shm_create(const char* name, int rank, int size)
+{
+    if (size < 1 || rank < 0 || rank >= size) {
+        fflush(stdout);
+        fprintf(stderr,"comm_shm_create: invalid rank %d of %d\n",rank,size);
+        return NULL;
+    }
+    long mem_size = sizeof(SHMHEADER) + size * sizeof(SHMCHANNEL);
+    int fd = shm_open(name,O_CREAT | O_RDWR,0600);
+    if (fd < 0) {
+        fflush(stdout);
+        fprintf(stderr,"comm_shm_create: failed to open %s\n",name);
+        return NULL;
+    }
+    /* Every rank sets the size, so it is mapped only after it is set */
+    if (ftruncate(fd,mem_size) != 0) {
+        fflush(stdout);
+        fprintf(stderr,"comm_shm_create: failed to set size of %s\n",name);
+        close(fd);
+        return NULL;
+    }
+    SHMHEADER* h = mmap(NULL,mem_size,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    close(fd);
+    if (h == MAP_FAILED) {
+        fflush(stdout);
+        fprintf(stderr,"comm_shm_create: failed to map %s\n",name);
+        return NULL;
+    }
+    if (atomic_fetch_add(&h->attached,1) + 1 == size)
+        shm_unlink(name); /* All ranks opened it */
+
+    SHMCOMM* sc = allocmem(1,1,SHMCOMM);
+    sc->h = h;
+    sc->size = mem_size;
+    COMM* c = allocmem(1,1,COMM);
+    c->rank = rank;
+    c->size = size;
+    c->sendrecv = shm_sendrecv;
+    c->close = shm_close;
+    c->impl = sc;
+    return c;
+}
+
+/* Frees a communicator. All ranks must free it together. */
+void comm_free(COMM* c)
+{
+    if (c == NULL)
+        return;
+    comm_barrier(c); /* All ranks are done communicating */
+    c->close(c);
+    freemem(c);
+}
+
+/* Creates size-1 child processes, which continue from the call like the
+ * calling process, and a shared memory communicator between them.
+ *
+ * Parameters:
+ *   size - Number of processes, including the caller
+ *
+ * Returns:
+ *   The communicator. The caller is rank 0, and children are ranks 1 to
+ *   size-1.
+ *
+ * Notes:
+ *   Call it before creating threads: a child process has only the thread
+ *   that called fork(). Children should exit(), after comm_free(), when
+ *   done; rank 0 waits for them with comm_wait_children().
+ */
+COMM* comm_fork(int size)
+{
+    char name[64];
+    snprintf(name,sizeof(name),"/mlinc-%d-%ld",getpid(),(long) time(NULL));
+    fflush(stdout); /* Do not duplicate buffered output */
+    fflush(stderr);
+    int rank = 0;
+    for (int r = 1; r < size; r++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            fprintf(stderr,"comm_fork: failed to create process %d\n",r);
+            exit(-1);
+        }
+        if (pid == 0) {
+            rank = r;
+            break;
+        }
+    }
+    COMM* c = comm_shm_create(name,rank,size);
+    if (c == NULL) {
+        fflush(stdout);
+        fprintf(stderr,"comm_fork: failed to create communicator\n");
+        exit(-1);
+    }
+    return c;
+}
+
+/* Waits for the child processes created by comm_fork().
+ *
+ * Returns:
+ *   The number of children that did not exit with status 0.
+ */
+int comm_wait_children(void)
+{
+    int failed = 0;
+    int status;
+    while (wait(&status) > 0)
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed++;
+    return failed;
+}
+
+/* Returns the offset of chunk i of n elements split into p chunks */
+static inline long chunk_start(long n, int p, int i)
+{
+    return n * i / p;
+}
+
+/* Sums n elements of x over all the ranks, leaving the sum in x of every
+ * rank, using the ring all-reduce algorithm.
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ *
+ * Notes:
+ *   x is split into size chunks. In size-1 steps each rank adds the chunk
+ *   it receives to its own and passes it on (reduce-scatter), so that each
+ *   rank holds one fully summed chunk; in size-1 more steps the summed
+ *   chunks are passed around (all-gather). Each rank sends and receives
+ *   about 2*n elements regardless of the number of ranks, and the result
+ *   is identical, bit for bit, on all ranks.
+ */
+int comm_allreduce(COMM* c, float* x, long n)
+{
+    int P = c->size;
+    int r = c->rank;
+    if (P == 1)
+        return 1;
+    float* tmp = allocmem(1,n / P + 1,float);
+    int ok = 1;
+    for (int s = 0; s < P - 1 && ok; s++) { /* Reduce-scatter */
+        int si = ((r - s) % P + P) % P;
+        int ri = ((r - s - 1) % P + P) % P;
+        long so = chunk_start(n,P,si), sn = chunk_start(n,P,si + 1) - so;
+        long ro = chunk_start(n,P,ri), rn = chunk_start(n,P,ri + 1) - ro;
+        ok = c->sendrecv(c,x + so,sn * sizeof(float),tmp,rn * sizeof(float));
+        for (long i = 0; i < rn; i++)
+            x[ro + i] += tmp[i];
+    }
+    for (int s = 0; s < P - 1 && ok; s++) { /* All-gather */
+        int si = ((r + 1 - s) % P + P) % P;
+        int ri = ((r - s) % P + P) % P;
+        long so = chunk_start(n,P,si), sn = chunk_start(n,P,si + 1) - so;
+        long ro = chunk_start(n,P,ri), rn = chunk_start(n,P,ri + 1) - ro;
+        ok = c->sendrecv(c,x + so,sn * sizeof(float),
+                         x + ro,rn * sizeof(float));
+    }
+    freemem(tmp);
+    return ok;
+}
+
+/* Copies n elements of x of rank root to x of all the other ranks.
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ */
+int comm_broadcast(COMM* c, float* x, long n, int root)
+{
+    int P = c->size;
+    int r = ((c->rank - root) % P + P) % P; /* Distance from root */
+    int ok = 1;
+    /* In step s, rank root+s passes x on to the next rank */
+    for (int s = 0; s < P - 1 && ok; s++)
+        ok = c->sendrecv(c,x,(r == s) ? n * sizeof(float) : 0,
+                         x,(r == s + 1) ? n * sizeof(float) : 0);
+    return ok;
+}
+
+/* Waits until all ranks call comm_barrier() */
+int comm_barrier(COMM* c)
+{
+    /* After step s, a rank knows that the s ranks before it arrived */
+    char token = 0;
+    int ok = 1;
+    for (int s = 0; s < c->size - 1 && ok; s++)
+        ok = c->sendrecv(c,&token,1,&token,1);
+    return ok;
+}
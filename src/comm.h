@@ -0,0 +1,101 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Communication between the processes of data parallel training */
+#ifndef COMM_H
+#define COMM_H
+#include "float.h"
+
+/* A communicator connects size processes, of ranks 0 to size-1, in a ring.
+ * The only operation a transport provides is sendrecv(): send a buffer to
+ * the next rank, (rank+1) % size, while receiving a buffer from the
+ * previous rank, (rank+size-1) % size. Collective operations, such as
+ * comm_allreduce(), are built on it, so a new transport (for example, TCP
+ * sockets between hosts) only implements sendrecv() and close(), and can
+ * be tested locally against the shared memory transport.
+ */
+typedef struct comm_s COMM;
+struct comm_s {
+    int rank;               /* Rank of this process                     */
+    int size;               /* Number of processes                      */
+    /* Sends ns bytes from sbuf to the next rank, and receives nr bytes
+     * from the previous rank into rbuf. Returns 1 if successful, 0
+     * otherwise. It must not wait for the data sent to be received before
+     * receiving, since all the ranks call it at once.
+     */
+    int (*sendrecv)(COMM* c, const void* sbuf, long ns, void* rbuf, long nr);
+    void (*close)(COMM* c); /* Frees the transport's resources          */
+    void* impl;             /* Transport's data                         */
+};
+
+/* Creates a communicator whose transport is POSIX shared memory, for
+ * processes on the same host.
+ *
+ * Parameters:
+ *   name - Name of the shared memory object, such as "/mlinc-1234";
+ *          it must be the same in all the processes, and not be used by
+ *          another group of processes
+ *   rank - Rank of the calling process, 0 to size-1
+ *   size - Number of processes
+ *
+ * Returns:
+ *   A pointer to the communicator, or NULL if an error occured.
+ *
+ * Notes:
+ *   Every process must call it. The shared memory object is removed when
+ *   all the processes have opened it.
+ */
+COMM* comm_shm_create(const char* name, int rank, int size);
+
+/* Frees a communicator. All ranks must free it together. */
+void comm_free(COMM* c);
+
+/* Creates size-1 child processes, which continue from the call like the
+ * calling process, and a shared memory communicator between them.
+ *
+ * Parameters:
+ *   size - Number of processes, including the caller
+ *
+ * Returns:
+ *   The communicator. The caller is rank 0, and children are ranks 1 to
+ *   size-1.
+ *
+ * Notes:
+ *   Call it before creating threads: a child process has only the thread
+ *   that called fork(). Children should exit(), after comm_free(), when
+ *   done; rank 0 waits for them with comm_wait_children().
+ */
+COMM* comm_fork(int size);
+
+/* Waits for the child processes created by comm_fork().
+ *
+ * Returns:
+ *   The number of children that did not exit with status 0.
+ */
+int comm_wait_children(void);
+
+/* Sums n elements of x over all the ranks, leaving the sum in x of every
+ * rank, using the ring all-reduce algorithm.
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ *
+ * Notes:
+ *   x is split into size chunks. In size-1 steps each rank adds the chunk
+ *   it receives to its own and passes it on (reduce-scatter), so that each
+ *   rank holds one fully summed chunk; in size-1 more steps the summed
+ *   chunks are passed around (all-gather). Each rank sends and receives
+ *   about 2*n elements regardless of the number of ranks, and the result
+ *   is identical, bit for bit, on all ranks.
+ */
+int comm_allreduce(COMM* c, float* x, long n);
+
+/* Copies n elements of x of rank root to x of all the other ranks.
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ */
+int comm_broadcast(COMM* c, float* x, long n, int root);
+
+/* Waits until all ranks call comm_barrier() */
+int comm_barrier(COMM* c);
+
+#endif
@@ -33,6 +33,7 @@ ADDNORM* read_addnorm(FILE* fp)
     ADDNORM* l = allocmem(1,1,ADDNORM);
     l->D = D;
     l->B = B;
+    l->Bmax = B;
     l->mean = allocmem(l->B,1,float);
     l->sdev = allocmem(l->B,1,float);
     l->xn = allocmem(l->B,l->D,float);
@@ -63,7 +64,7 @@ ADDNORM* read_addnorm(FILE* fp)
  */
 int write_addnorm(const ADDNORM* l, FILE* fp)
 {
-    int cnt = fprintf(fp,"ADDNORM D %d B %d\n",l->D,l->B);
+    int cnt = fprintf(fp,"ADDNORM D %d B %d\n",l->D,l->Bmax);
     if (cnt <= 0 || cnt == EOF) {
         fprintf(stderr,"In write_addnorm: failed to write the header\n");
         return 0;
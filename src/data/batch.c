@@ -11,49 +11,66 @@
  */
 BATCH* batch_create(const fArr2D x, int D, const fArr2D y, int N, int B,
                     const int* len, int num, int shuffle, int add_bias)
+{
+    if (len != NULL && num == 1) { /* Single sequence of len[0] vectors */
+        num = len[0];
+        len = NULL;
+    }
+    DATASRC* src = datasrc_arrays(x,D,y,N,len,num);
+    BATCH* b = batch_create_source(src,B,shuffle,add_bias);
+    b->own_src = 1;
+    return b;
+}
+
+/* Constructs an iterator that returns batches of input vectors, and 
+ * optionally their expected output vectors, read from a data source.
+ * The data source is not freed by batch_free().
+ */
+BATCH* batch_create_source(DATASRC* src, int B, int shuffle, int add_bias)
 {
     BATCH* b = allocmem(1,1,BATCH);
-    b->x = x;
-    b->y = y;
-    b->D = D;
-    b->N = N;
+    b->src = src;
+    b->own_src = 0;
+    b->D = src->D;
+    b->N = src->N;
     b->B = B;
     b->shuffle = (shuffle) ? 1 : 0;
     b->add_bias = (add_bias) ? 1 : 0;
-    b->num = num;
     b->shufSeq = NULL;
     b->shufLen = NULL;
     b->shufVec = NULL;
     b->curSeq = 0;
     b->curVec = 0;
 
-    if (len != NULL && num > 1) {
-        b->shufSeq = allocmem(1,num,float);
-        b->shufLen = allocmem(1,num,float);
-        /* shufSeq[i] is the index of the begining of sequence 'i' in x; 
+    int num = datasrc_num_sequences(src);
+    if (num > 1) {
+        b->num = num;
+        b->shufSeq = allocmem(1,num,int);
+        b->shufLen = allocmem(1,num,int);
+        /* shufSeq[i] is the index of a sequence in the data source; 
          * the sequence length is in shufLen[i]
-         * Since the sequences are contingous in x, sequence 'i+1'
-         * starts right after sequence 'i' ends
          */  
-        b->shufSeq[0] = 0;
-        b->shufLen[0] = len[0];
-        for (int i = 1; i < num; i++) {
-            b->shufSeq[i] = b->shufSeq[i - 1] + b->shufLen[i - 1];
-            b->shufLen[i] = len[i];
+        for (int i = 0; i < num; i++) {
+            b->shufSeq[i] = i;
+            b->shufLen[i] = datasrc_sequence_length(src,i);
         }
     }
-    else
-    if (shuffle) {
-        /* shufVec[i] is the index of a vector in x */
-        b->shufVec = allocmem(1,num,float);
-        for (int i = 0; i < num; i++)
-            b->shufVec[i] = i;
+    else {
+        b->num = (num == 1) ? datasrc_sequence_length(src,0) : 0;
+        if (shuffle) {
+            /* shufVec[i] is the index of a vector in the sequence */
+            b->shufVec = allocmem(1,b->num,int);
+            for (int i = 0; i < b->num; i++)
+                b->shufVec[i] = i;
+        }
     }
     return b;
 }
 
 void batch_free(BATCH* b)
 {
+    if (b->own_src)
+        datasrc_free(b->src);
     freemem(b->shufSeq);
     freemem(b->shufLen);
     freemem(b->shufVec);
@@ -98,44 +115,31 @@ void batch_shuffle(BATCH* restrict b)
  * not NULL and labels were passed to batch_create.
  * 
  * Returns number of actual samples returned. If number of returned samples
- * is less than batch_size pads the returned data with zeros. Returns 0
- * past end of data.
+ * is less than batch_size the remaining rows of x and y are left unchanged
+ * (the model computes only the returned rows). Returns 0 past end of data,
+ * and -1 if reading the data source failed.
  */
 int batch_copy(BATCH* restrict b, fArr2D restrict x, fArr2D restrict y)
 {
     int D = b->D;
     int Db = D + b->add_bias;
-    int N = b->N;
     int B = b->B;
-    int cnt = 0, ycnt = 0;
+    int cnt = 0;
     typedef float (*ArrBD)[D];           
     typedef float (*ArrBDb)[Db];
     typedef float (*ArrBN)[b->N];           
-    ArrBD xs = (ArrBD) b->x;
-    ArrBDb xd = (ArrBDb) x;
-    ArrBN ys = (ArrBN) b->y; /* Maybe NULL */
-    ArrBN yd = (ArrBN) y;    /* Maybe NULL */
+    ArrBD xs = (ArrBD) x;    /* Rows as read from the source  */
+    ArrBDb xd = (ArrBDb) x;  /* Rows with bias dimension      */
+    ArrBN yd = (b->src->N > 0) ? (ArrBN) y : NULL; /* Maybe NULL */
     
     if (b->shufSeq != NULL) {
         if (b->curSeq < b->num) { /* b->num is number of sequences */
-            int curSeq = b->curSeq;
-            int curVec = b->curVec;
-            int seqLen = b->shufLen[curSeq];
-            for (cnt = 0; cnt < B && b->curSeq < b->num && 
-                                     b->curVec < seqLen; cnt++) {
-                int i = b->shufSeq[b->curSeq] + b->curVec++;
-                for (int j = 0; j < D; j++)
-                    xd[cnt][j] = xs[i][j];
-                if (b->add_bias)
-                    xd[cnt][b->D] = 1.0;
-            }
-            if (ys != NULL && yd != NULL) {
-                for (ycnt = 0; ycnt < cnt; ycnt++) {
-                    int i = b->shufSeq[curSeq] + curVec++;
-                    for (int j = 0; j < N; j++)
-                        yd[ycnt][j] = ys[i][j];
-                }
-            }
+            int seqLen = b->shufLen[b->curSeq];
+            cnt = (seqLen - b->curVec < B) ? seqLen - b->curVec : B;
+            if (datasrc_read(b->src,b->shufSeq[b->curSeq],b->curVec,
+                             cnt,xs,yd) != cnt)
+                return -1;
+            b->curVec += cnt;
             if (b->curVec >= seqLen) {
                 b->curSeq++;
                 b->curVec = 0;
@@ -144,47 +148,24 @@ int batch_copy(BATCH* restrict b, fArr2D restrict x, fArr2D restrict y)
     }
     else
     if (b->shufVec != NULL) {
-        int curVec = b->curVec;
         for (cnt = 0; cnt < B && b->curVec < b->num; cnt++) {
             int i = b->shufVec[b->curVec++];
-            for (int j = 0; j < D; j++)
-                xd[cnt][j] = xs[i][j];
-            if (b->add_bias)
-                xd[cnt][D] = 1.0;
-        }
-        if (ys != NULL && yd != NULL) {
-            for (ycnt = 0; ycnt < cnt; ycnt++) {
-                int i = b->shufVec[curVec++];
-                for (int j = 0; j < N; j++)
-                    yd[ycnt][j] = ys[i][j];
-            }
+            if (datasrc_read(b->src,0,i,1,(fArr2D) xs[cnt],
+                             (yd) ? (fArr2D) yd[cnt] : NULL) != 1)
+                return -1;
         }
     }
     else {
-        int curVec = b->curVec;
-        for (cnt = 0; cnt < B && b->curVec < b->num; cnt++) {
-            int i = b->curVec++;
-            for (int j = 0; j < D; j++)
-                xd[cnt][j] = xs[i][j];
-            if (b->add_bias)
-                xd[cnt][D] = 1.0;
-        }
-        if (ys != NULL && yd != NULL) {
-            for (ycnt = 0; ycnt < cnt; ycnt++) {
-                int i = curVec++;
-                for (int j = 0; j < N; j++)
-                    yd[ycnt][j] = ys[i][j];
-            }
-        }
+        cnt = (b->num - b->curVec < B) ? b->num - b->curVec : B;
+        if (cnt > 0 && datasrc_read(b->src,0,b->curVec,cnt,xs,yd) != cnt)
+            return -1;
+        b->curVec += cnt;
     }
-    if (cnt < B) { /* Pad to batch size */
-        for (int i = cnt; i < B; i++)
-            for (int j = 0; j < Db; j++)
-                xd[i][j] = 1.0;
-        if (ys != NULL && yd != NULL) {
-            for (int i = ycnt; i < B; i++)
-                for (int j = 0; j < N; j++)
-                    yd[i][j] = 0;
+    if (b->add_bias) {
+        /* Spread rows from stride D to stride D + 1, last row first */
+        for (int i = cnt - 1; i >= 0; i--) {
+            fltmove(xd[i],xs[i],D);
+            xd[i][D] = 1.0;
         }
     }
     return cnt;
@@ -204,4 +185,3 @@ int batch_eos(BATCH* restrict b)
      */
     return (b->curVec == 0 && b->curSeq > 0) ? 1 : 0;
 }
-
@@ -3,17 +3,18 @@
 #ifndef BATCH_H
 #define BATCH_H
 #include "array.h"
+#include "datasrc.h"
 
 typedef struct batch_s {
-    fArr2D x;       /* Array of input vectors                       */
-    fArr2D y;       /* Array of output vectors (optional            */
+    DATASRC* src;   /* Source of input and output vectors           */
+    int  own_src;   /* if set, batch_free() frees src               */
     int  D;         /* Dimension of x vectors (may include bias)    */
     int  N;         /* Dimension of y vectors                       */
     int  B;         /* Number of vectors returned by batch_next()   */
     int  shuffle;   /* if set, batch_shuffle() shuffles, else only resets */
     int  add_bias;  /* if set, batch_next() adds bias dimension     */
     int  num;       /* Number of sequences, or number of vectors    */
-    int* shufSeq;   /* Offsets of shuffled training sequences       */
+    int* shufSeq;   /* Indices of shuffled training sequences       */
     int* shufLen;   /* Lengths of shuffled training sequences       */
     int* shufVec;   /* Offsets of shuffled training vectors         */
     int  curSeq;    /* Next vector from this sequence               */
@@ -26,6 +27,17 @@ typedef struct batch_s {
 BATCH* batch_create(const fArr2D x, int D, const fArr2D y, int N, int B,
                     const int* len, int num, int shuffle, int add_bias);
 
+/* Constructs an iterator that returns batches of input vectors, and 
+ * optionally their expected output vectors, read from a data source.
+ * The data source is not freed by batch_free().
+ *
+ * If the source has more than one sequence, batches never cross sequence
+ * boundaries and sequences are shuffled; otherwise, the vectors of the 
+ * single sequence are shuffled. Only the vectors of the current batch
+ * are held in memory.
+ */
+BATCH* batch_create_source(DATASRC* src, int B, int shuffle, int add_bias);
+
 /* Frees mmemory allocated by batch_create() */
 void batch_free(BATCH* b);
 
@@ -40,8 +52,9 @@ void batch_shuffle(BATCH* restrict b);
  * not NULL and labels were passed to batch_create.
  * 
  * Returns number of actual samples returned. If number of returned samples
- * is less than batch_size pads the returned data with zeros. Returns 0
- * past end of data.
+ * is less than batch_size the remaining rows of x and y are left unchanged
+ * (the model computes only the returned rows). Returns 0 past end of data,
+ * and -1 if reading the data source failed.
  */
 int batch_copy(BATCH* restrict b, fArr2D restrict x, fArr2D restrict y);
 
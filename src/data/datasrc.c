@@ -0,0 +1,373 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Data sources that stream training sequences on demand */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "mem.h"
+#include "float.h"
+#include "array.h"
+#include "datasrc.h"
+#include "dsfile.h"
+#include "normalize.h"
+
+#define DATASRC_CHUNK   4096 /* Vectors per read when scanning a source,
+                                * a multiple of MOMENTS_BLOCK */
+
+/* Returns the total number of vectors in all sequences of data source s */
+long datasrc_num_vectors(DATASRC* s)
+{
+    long M = 0;
+    int num = datasrc_num_sequences(s);
+    for (int i = 0; i < num; i++)
+        M += datasrc_sequence_length(s,i);
+    return M;
+}
+
+/* Returns the length of the longest sequence of data source s */
+int datasrc_max_length(DATASRC* s)
+{
+    int maxlen = 0;
+    int num = datasrc_num_sequences(s);
+    for (int i = 0; i < num; i++) {
+        int len = datasrc_sequence_length(s,i);
+        if (maxlen < len)
+            maxlen = len;
+    }
+    return maxlen;
+}
+
+/* Closes data source s and frees the memory allocated for it */
+void datasrc_free(DATASRC* s)
+{
+    if (s == NULL)
+        return;
+    if (s->close != NULL)
+        s->close(s);
+    freemem(s);
+}
+
+/* Arrays in memory: sequence i starts at row off[i] of x and y */
+typedef struct {
+    const float* x;
+    const float* y;
+    int num;
+    long* off;      /* num + 1 row offsets */
+    float* copy_x;  /* Copies owned by the source, or NULL, see       */
+    float* copy_y;  /* datasrc_normalized()                           */
+    int Dn;         /* Number of normalized features, 0 if x is not   */
+    float* mean;    /* Mean and sdev x is normalized with, see        */
+    float* sdev;    /* datasrc_norm_stats()                           */
+} ARRAYSRC;
+
+static int arrays_num_sequences(DATASRC* s)
+{
+    return ((ARRAYSRC*) s->data)->num;
+}
+
+static int arrays_sequence_length(DATASRC* s, int i)
+{
+    ARRAYSRC* a = (ARRAYSRC*) s->data;
+    return (int) (a->off[i + 1] - a->off[i]);
+}
+
+static int arrays_read_sequence(DATASRC* s, int i, int first, int cnt,
+                                fArr2D x, fArr2D y)
+{
+    ARRAYSRC* a = (ARRAYSRC*) s->data;
+    long row = a->off[i] + first;
+    fltcpy(x,a->x + row * s->D,cnt * s->D);
+    if (y != NULL && a->y != NULL)
+        fltcpy(y,a->y + row * s->N,cnt * s->N);
+    return cnt;
+}
+
+static void arrays_close(DATASRC* s)
+{
+    ARRAYSRC* a = (ARRAYSRC*) s->data;
+    freemem(a->off);
+    freemem(a->copy_x);
+    freemem(a->copy_y);
+    freemem(a->mean);
+    freemem(a->sdev);
+    freemem(a);
+}
+
+/* Creates a data source over arrays in memory. The arrays are not copied
+ * and must remain valid until the data source is freed.
+ *
+ * Parameters:
+ *   x   - Array of input vectors of all sequences, one after the other
+ *   D   - Dimension of x vectors
+ *   y   - Array of corresponding output vectors; may be NULL
+ *   N   - Dimension of y vectors (ignored if y is NULL)
+ *   len - Lengths of the sequences; if NULL, x is a single sequence
+ *   num - Number of sequences if len is not NULL; otherwise, the number
+ *         of vectors in x
+ *
+ * Returns:
+ *   A pointer to the new data source.
+ */
+DATASRC* datasrc_arrays(const fArr2D x, int D, const fArr2D y, int N,
+                        const int* len, int num)
+{
+    ARRAYSRC* a = allocmem(1,1,ARRAYSRC);
+    a->x = (const float*) x;
+    a->y = (const float*) y;
+    if (len != NULL) {
+        a->num = num;
+        a->off = allocmem(1,num + 1,long);
+        for (int i = 0; i < num; i++)
+            a->off[i + 1] = a->off[i] + len[i];
+    }
+    else {
+        a->num = 1;
+        a->off = allocmem(1,2,long);
+        a->off[1] = num;
+    }
+    DATASRC* s = allocmem(1,1,DATASRC);
+    s->D = D;
+    s->N = (y != NULL) ? N : 0;
+    s->num_sequences = arrays_num_sequences;
+    s->sequence_length = arrays_sequence_length;
+    s->read_sequence = arrays_read_sequence;
+    s->close = arrays_close;
+    s->data = a;
+    return s;
+}
+
+/* Returns the input array of a data source over arrays in memory (see
+ * datasrc_arrays()), or NULL if s is another kind of data source.
+ */
+const float* datasrc_arrays_x(DATASRC* s)
+{
+    if (s->read_sequence != arrays_read_sequence)
+        return NULL;
+    return ((ARRAYSRC*) s->data)->x;
+}
+
+/* Marks a data source over arrays in memory as normalized with mean and
+ * sdev, of Dn features each; the vectors are copied.
+ */
+static void arrays_mark_normalized(ARRAYSRC* a, int Dn, const float* mean,
+                                   const float* sdev)
+{
+    a->Dn = Dn;
+    a->mean = allocmem(1,Dn,float);
+    a->sdev = allocmem(1,Dn,float);
+    fltcpy(a->mean,mean,Dn);
+    fltcpy(a->sdev,sdev,Dn);
+}
+
+/* Normalizes the input vectors of a dataset in memory in place, by feature
+ * (see normalize()), and returns a data source over them, marked as
+ * normalized. model_fit_source() does not normalize the vectors of such a
+ * source again, and takes the mean and sdev they were normalized with.
+ *
+ * Parameters:
+ *   x, D, y, N, len, num - As for datasrc_arrays(); x is changed
+ *   mean     - Vector of D or D-1 means, or NULL to use the mean and
+ *              standard deviation of the vectors of x
+ *   sdev     - Vector of D or D-1 standard deviations (if mean is not NULL)
+ *   exc_last - If not 0, the last element of the vectors is not normalized
+ *
+ * Returns:
+ *   A pointer to the new data source.
+ *
+ * Notes:
+ *   Validation data is normalized with the mean and sdev of the training
+ *   data, see datasrc_norm_stats().
+ */
+DATASRC* datasrc_arrays_normalize(fArr2D x, int D, const fArr2D y, int N,
+                                  const int* len, int num,
+                                  const float* mean, const float* sdev,
+                                  int exc_last)
+{
+    DATASRC* s = datasrc_arrays(x,D,y,N,len,num);
+    ARRAYSRC* a = (ARRAYSRC*) s->data;
+    int Dn = D - ((exc_last) ? 1 : 0);
+    if (mean != NULL)
+        arrays_mark_normalized(a,Dn,mean,sdev);
+    else {
+        float m[Dn], d[Dn];
+        datasrc_mean_sdev(s,m,d,exc_last); /* Arrays are always read */
+        arrays_mark_normalized(a,Dn,m,d);
+    }
+    for (int i = 0; i < a->num; i++)
+        normalize((fArr2D) ((float*) x + a->off[i] * D),
+                  datasrc_sequence_length(s,i),D,a->mean,a->sdev,exc_last);
+    return s;
+}
+
+/* Returns the number of features the input vectors of data source s were
+ * normalized by, and sets mean and sdev to the vectors they were normalized
+ * with, if s is marked as normalized (see datasrc_arrays_normalize() and
+ * datasrc_normalized()); otherwise, returns 0.
+ */
+int datasrc_norm_stats(DATASRC* s, const float** mean, const float** sdev)
+{
+    if (s->read_sequence != arrays_read_sequence)
+        return 0;
+    ARRAYSRC* a = (ARRAYSRC*) s->data;
+    *mean = a->mean;
+    *sdev = a->sdev;
+    return a->Dn;
+}
+
+/* Stores the contents of a data source in a binary dataset file, that can
+ * be opened with datasrc_mmap() or dsfile_open(). Sequences are copied one
+ * chunk at a time, so the source does not need to fit in memory.
+ *
+ * Parameters:
+ *   s        - Data source
+ *   filename - Name of file to create
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ */
+int datasrc_store(DATASRC* s, const char* filename)
+{
+    int D = s->D;
+    int N = s->N;
+    int num = datasrc_num_sequences(s);
+    int* len = allocmem(1,num,int);
+    for (int i = 0; i < num; i++)
+        len[i] = datasrc_sequence_length(s,i);
+    DSWRITER* w = dsfile_create(filename,D,N,(N > 0) ? DS_FLOAT : DS_NONE,
+                                len,num);
+    if (w == NULL) {
+        freemem(len);
+        return 0;
+    }
+    int C = DATASRC_CHUNK;
+    fArr2D x = allocmem(C,D,float);
+    fArr2D y = (N > 0) ? allocmem(C,N,float) : NULL;
+    int ok = 1;
+    for (int i = 0; ok && i < num; i++) {
+        for (int first = 0; ok && first < len[i]; first += C) {
+            int cnt = (len[i] - first < C) ? len[i] - first : C;
+            ok = datasrc_read(s,i,first,cnt,x,y) == cnt;
+            if (!ok)
+                fprintf(stderr,"In datasrc_store: failed to read "
+                                                    "sequence %d\n",i);
+            else
+                ok = dsfile_append(w,x,y,cnt);
+        }
+    }
+    freemem(x);
+    freemem(y);
+    freemem(len);
+    if (!dsfile_finish(w))
+        ok = 0;
+    if (!ok)
+        fprintf(stderr,"In datasrc_store: failed to write file '%s'\n",
+                                                                     filename);
+    return ok;
+}
+
+/* Calculates the mean and standard deviation of the input vectors of a
+ * data source by feature, reading the data one chunk at a time. Returns
+ * the same values as calculate_mean_sdev() would for the whole dataset.
+ *
+ * Parameters:
+ *   s        - Data source
+ *   mean     - Returns a vector of D or D-1 means
+ *   sdev     - Returns a vector of D or D-1 standard deviations
+ *   exc_last - If not 0, the last element of the vectors is excluded
+ *
+ * Returns:
+ *   1 if successful, 0 if reading the data source failed.
+ */
+int datasrc_mean_sdev(DATASRC* s, fVec mean, fVec sdev, int exc_last)
+{
+    int D = s->D;
+    int Dx = D - ((exc_last) ? 1 : 0);
+    int C = DATASRC_CHUNK; /* A multiple of MOMENTS_BLOCK */
+    int num = datasrc_num_sequences(s);
+    typedef float (*ArrCD)[D];
+    ArrCD x = allocmem(C,D,float);
+    MOMENTS* mo = moments_create(Dx);
+
+    /* Chunks span sequences, so that the blocks whose moments are
+     * calculated are the same as those of calculate_mean_sdev()
+     */
+    int n = 0; /* Vectors in x */
+    int ok = 1;
+    for (int i = 0; ok && i < num; i++) {
+        int len = datasrc_sequence_length(s,i);
+        for (int first = 0; ok && first < len; ) {
+            int cnt = (len - first < C - n) ? len - first : C - n;
+            ok = datasrc_read(s,i,first,cnt,(fArr2D) x[n],NULL) == cnt;
+            if (!ok) {
+                fprintf(stderr,"In datasrc_mean_sdev: failed to read "
+                                                    "sequence %d\n",i);
+                break;
+            }
+            first += cnt;
+            n += cnt;
+            if (n == C) {
+                moments_add(mo,(fArr2D) x,n,D);
+                n = 0;
+            }
+        }
+    }
+    if (ok) {
+        moments_add(mo,(fArr2D) x,n,D);
+        moments_mean_sdev(mo,mean,sdev);
+    }
+    moments_free(mo);
+    freemem(x);
+    return ok;
+}
+
+/* Returns a data source of the input vectors of data source s normalized
+ * by feature (see normalize()), and of its output vectors. Used to
+ * normalize a dataset once, rather than each batch read from it.
+ *
+ * Parameters:
+ *   s        - Data source
+ *   mean     - Vector of D or D-1 means
+ *   sdev     - Vector of D or D-1 standard deviations
+ *   exc_last - If not 0, the last element of the vectors is not normalized
+ *
+ * Returns:
+ *   A new data source over normalized copies of the vectors of s, in
+ *   memory, marked as normalized, or NULL if reading the data source
+ *   failed.
+ *
+ * Notes:
+ *   Free the data source with datasrc_free(), which frees the copies.
+ */
+DATASRC* datasrc_normalized(DATASRC* s, const fVec mean, const fVec sdev,
+                            int exc_last)
+{
+    int D = s->D;
+    int N = s->N;
+    int num = datasrc_num_sequences(s);
+    long M = datasrc_num_vectors(s);
+    float* x = allocmem(M,D,float);
+    float* y = (N > 0) ? allocmem(M,N,float) : NULL;
+    int* len = allocmem(1,num,int);
+    long row = 0;
+    for (int i = 0; i < num; i++) {
+        len[i] = datasrc_sequence_length(s,i);
+        float* xi = x + row * D;
+        if (datasrc_read(s,i,0,len[i],(fArr2D) xi,
+                         (N > 0) ? (fArr2D) (y + row * N) : NULL) != len[i]) {
+            fprintf(stderr,"In datasrc_normalized: failed to read "
+                                                    "sequence %d\n",i);
+            freemem(x);
+            freemem(y);
+            freemem(len);
+            return NULL;
+        }
+        normalize((fArr2D) xi,len[i],D,mean,sdev,exc_last);
+        row += len[i];
+    }
+    DATASRC* c = datasrc_arrays((fArr2D) x,D,(fArr2D) y,N,len,num);
+    ARRAYSRC* a = (ARRAYSRC*) c->data;
+    a->copy_x = x;
+    a->copy_y = y;
+    arrays_mark_normalized(a,D - ((exc_last) ? 1 : 0),mean,sdev);
+    freemem(len);
+    return c;
+}
@@ -0,0 +1,193 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Data sources that stream training sequences on demand */
+#ifndef DATASRC_H
+#define DATASRC_H
+#include "array.h"
+
+/* A data source provides a dataset of one or more sequences of input
+ * vectors, and optionally their corresponding output vectors, without
+ * requiring the entire dataset to be in memory. Sequences are read on
+ * demand, in any order, in whole or in part.
+ *
+ * An implementation sets the dimensions D and N, the function pointers
+ * and its private state, data. Use the datasrc_xxx() wrappers below rather
+ * than calling the function pointers directly.
+ */
+typedef struct datasrc_s DATASRC;
+struct datasrc_s {
+    int D;          /* Dimension of x vectors                           */
+    int N;          /* Dimension of y vectors, 0 if there are no y      */
+    /* Returns the number of sequences */
+    int (*num_sequences)(DATASRC* s);
+    /* Returns the number of vectors in sequence i */
+    int (*sequence_length)(DATASRC* s, int i);
+    /* Copies cnt vectors starting at vector first of sequence i into
+     * x, and their outputs into y (if y is not NULL). Returns the number
+     * of vectors copied, or 0 on error.
+     */
+    int (*read_sequence)(DATASRC* s, int i, int first, int cnt,
+                         fArr2D x, fArr2D y);
+    /* Releases the resources held by data */
+    void (*close)(DATASRC* s);
+    void* data;     /* Implementation state                             */
+};
+
+/* Returns the number of sequences in data source s */
+static inline int datasrc_num_sequences(DATASRC* s)
+{
+    return s->num_sequences(s);
+}
+
+/* Returns the number of vectors in sequence i of data source s */
+static inline int datasrc_sequence_length(DATASRC* s, int i)
+{
+    return s->sequence_length(s,i);
+}
+
+/* Reads vectors of one sequence from data source s.
+ *
+ * Parameters:
+ *   s     - Data source
+ *   i     - Sequence index, 0 <= i < datasrc_num_sequences(s)
+ *   first - Index of first vector to read within the sequence
+ *   cnt   - Number of vectors to read; first + cnt must not exceed
+ *           the sequence length
+ *   x     - Array of cnt rows of D elements, receives input vectors
+ *   y     - Array of cnt rows of N elements, receives output vectors;
+ *           may be NULL
+ *
+ * Returns:
+ *   The number of vectors read (cnt), or 0 if an error occured.
+ */
+static inline int datasrc_read(DATASRC* s, int i, int first, int cnt,
+                               fArr2D x, fArr2D y)
+{
+    return s->read_sequence(s,i,first,cnt,x,y);
+}
+
+/* Returns the total number of vectors in all sequences of data source s */
+long datasrc_num_vectors(DATASRC* s);
+
+/* Returns the length of the longest sequence of data source s */
+int datasrc_max_length(DATASRC* s);
+
+/* Closes data source s and frees the memory allocated for it */
+void datasrc_free(DATASRC* s);
+
+/* Creates a data source over arrays in memory. The arrays are not copied
+ * and must remain valid until the data source is freed.
+ *
+ * Parameters:
+ *   x   - Array of input vectors of all sequences, one after the other
+ *   D   - Dimension of x vectors
+ *   y   - Array of corresponding output vectors; may be NULL
+ *   N   - Dimension of y vectors (ignored if y is NULL)
+ *   len - Lengths of the sequences; if NULL, x is a single sequence
+ *   num - Number of sequences if len is not NULL; otherwise, the number
+ *         of vectors in x
+ *
+ * Returns:
+ *   A pointer to the new data source.
+ */
+DATASRC* datasrc_arrays(const fArr2D x, int D, const fArr2D y, int N,
+                        const int* len, int num);
+
+/* Opens a binary dataset file and maps it into memory. Sequences are paged
+ * in by the operating system as they are read, so the dataset may be
+ * larger than the available memory. Int class labels are returned as
+ * one-hot vectors. Implemented in dsfile.c.
+ *
+ * Parameters:
+ *   filename - Name of a dataset file (see dsfile.h)
+ *
+ * Returns:
+ *   A pointer to the new data source, or NULL if an error occured.
+ */
+DATASRC* datasrc_mmap(const char* filename);
+
+/* Returns the input array of a data source over arrays in memory (see
+ * datasrc_arrays()), or NULL if s is another kind of data source.
+ */
+const float* datasrc_arrays_x(DATASRC* s);
+
+/* Stores the contents of a data source in a binary dataset file, that can
+ * be opened with datasrc_mmap() or dsfile_open(). Sequences are copied one
+ * chunk at a time, so the source does not need to fit in memory.
+ *
+ * Parameters:
+ *   s        - Data source
+ *   filename - Name of file to create
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ */
+int datasrc_store(DATASRC* s, const char* filename);
+
+/* Calculates the mean and standard deviation of the input vectors of a
+ * data source by feature, reading the data one chunk at a time. Returns
+ * the same values as calculate_mean_sdev() would for the whole dataset.
+ *
+ * Parameters:
+ *   s        - Data source
+ *   mean     - Returns a vector of D or D-1 means
+ *   sdev     - Returns a vector of D or D-1 standard deviations
+ *   exc_last - If not 0, the last element of the vectors is excluded
+ *
+ * Returns:
+ *   1 if successful, 0 if reading the data source failed.
+ */
+int datasrc_mean_sdev(DATASRC* s, fVec mean, fVec sdev, int exc_last);
+
+/* Returns a data source of the input vectors of data source s normalized
+ * by feature (see normalize()), and of its output vectors. Used to
+ * normalize a dataset once, rather than each batch read from it.
+ *
+ * Parameters:
+ *   s        - Data source
+ *   mean     - Vector of D or D-1 means
+ *   sdev     - Vector of D or D-1 standard deviations
+ *   exc_last - If not 0, the last element of the vectors is not normalized
+ *
+ * Returns:
+ *   A new data source over normalized copies of the vectors of s, in
+ *   memory, marked as normalized, or NULL if reading the data source
+ *   failed.
+ *
+ * Notes:
+ *   Free the data source with datasrc_free(), which frees the copies.
+ */
+DATASRC* datasrc_normalized(DATASRC* s, const fVec mean, const fVec sdev,
+                            int exc_last);
+
+/* Normalizes the input vectors of a dataset in memory in place, by feature
+ * (see normalize()), and returns a data source over them, marked as
+ * normalized. model_fit_source() does not normalize the vectors of such a
+ * source again, and takes the mean and sdev they were normalized with.
+ *
+ * Parameters:
+ *   x, D, y, N, len, num - As for datasrc_arrays(); x is changed
+ *   mean     - Vector of D or D-1 means, or NULL to use the mean and
+ *              standard deviation of the vectors of x
+ *   sdev     - Vector of D or D-1 standard deviations (if mean is not NULL)
+ *   exc_last - If not 0, the last element of the vectors is not normalized
+ *
+ * Returns:
+ *   A pointer to the new data source.
+ *
+ * Notes:
+ *   Validation data is normalized with the mean and sdev of the training
+ *   data, see datasrc_norm_stats().
+ */
+DATASRC* datasrc_arrays_normalize(fArr2D x, int D, const fArr2D y, int N,
+                                  const int* len, int num,
+                                  const float* mean, const float* sdev,
+                                  int exc_last);
+
+/* Returns the number of features the input vectors of data source s were
+ * normalized by, and sets mean and sdev to the vectors they were normalized
+ * with, if s is marked as normalized (see datasrc_arrays_normalize() and
+ * datasrc_normalized()); otherwise, returns 0.
+ */
+int datasrc_norm_stats(DATASRC* s, const float** mean, const float** sdev);
+
+#endif
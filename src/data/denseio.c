@@ -27,7 +27,7 @@ DENSE* read_dense(FILE* fp)
         fprintf(stderr,"In read_dense: failed to read the header\n");
         return NULL;
     }
-    if (c != 'n' && c != 'r' && c != 's' && c != 'S') {
+    if (c != 'n' && c != 'r' && c != 's' && c != 'g' && c != 'S') {
         fprintf(stderr,"In read_dense: invalid activation code\n");
         return NULL;
     }
@@ -35,8 +35,11 @@ DENSE* read_dense(FILE* fp)
     d->S = S;
     d->D = D;
     d->B = B;
+    d->Bmax = B;
     d->activation = c;
     d->h = allocmem(d->B,d->S,float);
+    if (d->activation == 'g')
+        d->z = allocmem(d->B,d->S,float);
     d->Wx = allocmem(d->D,d->S,float);
     int ok = read_array(d->Wx,d->D,d->S,fp,0);
     if (ok)
@@ -44,6 +47,7 @@ DENSE* read_dense(FILE* fp)
     /* error exit */
     fprintf(stderr,"In read_dense: failed to read weights\n");
     freemem(d->h);
+    freemem(d->z);
     freemem(d->Wx);
     freemem(d);
     return NULL;
@@ -62,7 +66,7 @@ DENSE* read_dense(FILE* fp)
  */
 int write_dense(const DENSE* d, FILE* fp)
 {
-    int cnt = fprintf(fp,"DENSE D %d S %d B %d activation '%c'\n",d->D,d->S,d->B,d->activation);
+    int cnt = fprintf(fp,"DENSE D %d S %d B %d activation '%c'\n",d->D,d->S,d->Bmax,d->activation);
     if (cnt <= 0 || cnt == EOF) {
         fprintf(stderr,"In write_dense: failed to write the header\n");
         return 0;
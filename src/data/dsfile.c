@@ -0,0 +1,393 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Binary dataset files that can be memory mapped */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mem.h"
+#include "float.h"
+#include "array.h"
+#include "dsfile.h"
+
+#define DS_MAGIC   "MLDSFILE"
+#define DS_VERSION 1
+
+/* Dataset file header; offsets are from the beginning of the file */
+typedef struct {
+    char magic[8];      /* DS_MAGIC                                 */
+    int32_t version;    /* DS_VERSION                               */
+    int32_t float_size; /* sizeof(float) of the writer: 4 or 8      */
+    int32_t D;          /* Dimension of x vectors                   */
+    int32_t N;          /* Dimension of y vectors, or class count   */
+    int32_t y_type;     /* DS_NONE DS_FLOAT or DS_INT               */
+    int32_t num;        /* Number of sequences                      */
+    int64_t M;          /* Total number of vectors                  */
+    int64_t len_off;    /* Offset of sequence lengths               */
+    int64_t x_off;      /* Offset of input vectors                  */
+    int64_t y_off;      /* Offset of labels (0 if none)             */
+    int64_t size;       /* File size                                */
+} DSHEADER;
+
+static inline int64_t ds_align(int64_t n)
+{
+    return (n + DS_ALIGN - 1) / DS_ALIGN * DS_ALIGN;
+}
+
+/* Returns the size in bytes of the labels of one vector */
+static inline int64_t ds_label_size(int y_type, int N)
+{
+    return (y_type == DS_FLOAT) ? (int64_t) N * sizeof(float) :
+           (y_type == DS_INT) ? (int64_t) sizeof(int) : 0;
+}
+
+/* Opens a dataset file and maps it into memory (read only).
+ *
+ * Parameters:
+ *   filename - Name of a dataset file
+ *
+ * Returns:
+ *   A pointer to a DSFILE, or NULL if an error occured.
+ */
+DSFILE* dsfile_open(const char* filename)
+{
+    int fd = open(filename,O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr,"In dsfile_open: failed to open file '%s' for read\n",
+                                                                     filename);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd,&st) != 0 || st.st_size < (off_t) sizeof(DSHEADER)) {
+        fprintf(stderr,"In dsfile_open: '%s' is not a dataset file\n",
+                                                                     filename);
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    void* base = mmap(NULL,size,PROT_READ,MAP_SHARED,fd,0);
+    close(fd); /* The mapping remains valid */
+    if (base == MAP_FAILED) {
+        fprintf(stderr,"In dsfile_open: failed to map file '%s'\n",filename);
+        return NULL;
+    }
+    const DSHEADER* h = (const DSHEADER*) base;
+    if (memcmp(h->magic,DS_MAGIC,sizeof(h->magic)) != 0 ||
+        h->version != DS_VERSION) {
+        fprintf(stderr,"In dsfile_open: '%s' is not a dataset file\n",
+                                                                     filename);
+        munmap(base,size);
+        return NULL;
+    }
+    if (h->float_size != sizeof(float)) {
+        fprintf(stderr,"In dsfile_open: '%s' has %d bytes floats, "
+                   "expected %d\n",filename,h->float_size,(int) sizeof(float));
+        munmap(base,size);
+        return NULL;
+    }
+    int64_t lsz = ds_label_size(h->y_type,h->N);
+    if (h->D <= 0 || h->num < 0 || h->M < 0 || h->size != (int64_t) size ||
+        (h->y_type != DS_NONE && h->y_type != DS_FLOAT && h->y_type != DS_INT) ||
+        (h->y_type != DS_NONE && h->N <= 0) ||
+        h->len_off < (int64_t) sizeof(DSHEADER) ||
+        h->len_off + h->num * (int64_t) sizeof(int) > h->x_off ||
+        h->x_off + h->M * h->D * (int64_t) sizeof(float) > h->size ||
+        (lsz > 0 && (h->y_off < h->x_off + h->M * h->D * (int64_t) sizeof(float) ||
+                     h->y_off + h->M * lsz > h->size)) ||
+        h->len_off % DS_ALIGN != 0 || h->x_off % DS_ALIGN != 0 ||
+        h->y_off % DS_ALIGN != 0) {
+        fprintf(stderr,"In dsfile_open: file '%s' is truncated or corrupt\n",
+                                                                     filename);
+        munmap(base,size);
+        return NULL;
+    }
+    DSFILE* ds = allocmem(1,1,DSFILE);
+    ds->D = h->D;
+    ds->N = (h->y_type != DS_NONE) ? h->N : 0;
+    ds->y_type = h->y_type;
+    ds->num = h->num;
+    ds->M = h->M;
+    ds->len = (const int*) ((const char*) base + h->len_off);
+    ds->x = (const float*) ((const char*) base + h->x_off);
+    ds->y = (lsz > 0) ? (const void*) ((const char*) base + h->y_off) : NULL;
+    ds->base = base;
+    ds->size = size;
+    long* off = allocmem(1,h->num + 1,long);
+    int bad = 0; /* Lengths must not be negative, and add up to M */
+    for (int i = 0; i < h->num; i++) {
+        bad |= (ds->len[i] < 0);
+        off[i + 1] = off[i] + ds->len[i];
+    }
+    ds->off = off;
+    if (bad || off[h->num] != h->M) {
+        fprintf(stderr,"In dsfile_open: file '%s' has inconsistent "
+                                                "sequence lengths\n",filename);
+        dsfile_close(ds);
+        return NULL;
+    }
+    return ds;
+}
+
+/* Unmaps a dataset file and frees the memory allocated by dsfile_open() */
+void dsfile_close(DSFILE* ds)
+{
+    if (ds == NULL)
+        return;
+    munmap(ds->base,ds->size);
+    freemem((void*) ds->off);
+    freemem(ds);
+}
+
+/* Data source over a dataset file */
+typedef struct {
+    DSFILE* ds;
+    int own;        /* If set, close ds when the source is freed */
+} DSSRC;
+
+static int dssrc_num_sequences(DATASRC* s)
+{
+    return ((DSSRC*) s->data)->ds->num;
+}
+
+static int dssrc_sequence_length(DATASRC* s, int i)
+{
+    return ((DSSRC*) s->data)->ds->len[i];
+}
+
+static int dssrc_read_sequence(DATASRC* s, int i, int first, int cnt,
+                               fArr2D x, fArr2D y_)
+{
+    DSFILE* ds = ((DSSRC*) s->data)->ds;
+    int D = ds->D;
+    int N = ds->N;
+    long row = ds->off[i] + first;
+    fltcpy(x,ds->x + row * D,cnt * D);
+    if (y_ == NULL)
+        return cnt;
+    if (ds->y_type == DS_FLOAT)
+        fltcpy(y_,(const float*) ds->y + row * N,cnt * N);
+    else
+    if (ds->y_type == DS_INT) {
+        typedef float (*ArrCN)[N];
+        ArrCN y = (ArrCN) y_;
+        const int* yc = (const int*) ds->y + row;
+        fltclr(y,cnt * N);
+        for (int j = 0; j < cnt; j++)
+            if (yc[j] >= 0 && yc[j] < N)
+                y[j][yc[j]] = 1.0;
+    }
+    return cnt;
+}
+
+static void dssrc_close(DATASRC* s)
+{
+    DSSRC* d = (DSSRC*) s->data;
+    if (d->own)
+        dsfile_close(d->ds);
+    freemem(d);
+}
+
+static DATASRC* dssrc_create(DSFILE* ds, int own)
+{
+    DSSRC* d = allocmem(1,1,DSSRC);
+    d->ds = ds;
+    d->own = own;
+    DATASRC* s = allocmem(1,1,DATASRC);
+    s->D = ds->D;
+    s->N = ds->N;
+    s->num_sequences = dssrc_num_sequences;
+    s->sequence_length = dssrc_sequence_length;
+    s->read_sequence = dssrc_read_sequence;
+    s->close = dssrc_close;
+    s->data = d;
+    return s;
+}
+
+/* Creates a data source over an open dataset file. Int class labels
+ * are returned as one-hot vectors of N elements. The dataset file is
+ * not closed when the data source is freed.
+ */
+DATASRC* dsfile_source(DSFILE* ds)
+{
+    return dssrc_create(ds,0);
+}
+
+/* Opens a binary dataset file and maps it into memory. Sequences are paged
+ * in by the operating system as they are read, so the dataset may be
+ * larger than the available memory.
+ *
+ * Parameters:
+ *   filename - Name of a dataset file (see dsfile.h)
+ *
+ * Returns:
+ *   A pointer to the new data source, or NULL if an error occured.
+ */
+DATASRC* datasrc_mmap(const char* filename)
+{
+    DSFILE* ds = dsfile_open(filename);
+    if (ds == NULL)
+        return NULL;
+    return dssrc_create(ds,1);
+}
+
+/* Writes n bytes at offset off of file fp; returns 1 if successful */
+static int ds_write_at(FILE* fp, int64_t off, const void* p, int64_t n)
+{
+    if (fseeko(fp,off,SEEK_SET) != 0)
+        return 0;
+    return n == 0 || fwrite(p,n,1,fp) == 1;
+}
+
+/* Creates a dataset file. Since the sequence lengths are known up front,
+ * vectors can then be appended in any number of dsfile_append() calls, so
+ * the dataset does not need to be in memory all at once.
+ *
+ * Parameters:
+ *   filename - Name of file to create
+ *   D        - Dimension of x vectors
+ *   N        - Dimension of y vectors, or number of classes; ignored if
+ *              y_type is DS_NONE
+ *   y_type   - DS_NONE, DS_FLOAT or DS_INT
+ *   len      - Sequence lengths; if NULL, the dataset is a single
+ *              sequence of num vectors
+ *   num      - Number of sequences if len is not NULL; otherwise the
+ *              number of vectors
+ *
+ * Returns:
+ *   A pointer to a DSWRITER, or NULL if an error occured.
+ */
+DSWRITER* dsfile_create(const char* filename, int D, int N, int y_type,
+                        const int* len, int num)
+{
+    if (y_type == DS_NONE)
+        N = 0;
+    int single = num;   /* Single sequence length, if len is NULL */
+    if (len == NULL) {
+        len = &single;
+        num = 1;
+    }
+    DSHEADER h;
+    memset(&h,0,sizeof(h));
+    memcpy(h.magic,DS_MAGIC,sizeof(h.magic));
+    h.version = DS_VERSION;
+    h.float_size = sizeof(float);
+    h.D = D;
+    h.N = N;
+    h.y_type = y_type;
+    h.num = num;
+    for (int i = 0; i < num; i++)
+        h.M += len[i];
+    h.len_off = ds_align(sizeof(DSHEADER));
+    h.x_off = ds_align(h.len_off + num * (int64_t) sizeof(int));
+    h.y_off = ds_align(h.x_off + h.M * D * (int64_t) sizeof(float));
+    h.size = h.y_off + h.M * ds_label_size(y_type,N);
+    if (y_type == DS_NONE)
+        h.y_off = 0;
+
+    FILE* fp = fopen(filename,"wb");
+    if (fp == NULL) {
+        fprintf(stderr,"In dsfile_create: failed to open file '%s' for "
+                                                         "write\n",filename);
+        return NULL;
+    }
+    if (!ds_write_at(fp,0,&h,sizeof(h)) ||
+        !ds_write_at(fp,h.len_off,len,num * (int64_t) sizeof(int)) ||
+        ftruncate(fileno(fp),h.size) != 0) {
+        fprintf(stderr,"In dsfile_create: failed to write file '%s'\n",
+                                                                     filename);
+        fclose(fp);
+        return NULL;
+    }
+    DSWRITER* w = allocmem(1,1,DSWRITER);
+    w->fp = fp;
+    w->D = D;
+    w->N = N;
+    w->y_type = y_type;
+    w->M = h.M;
+    w->cnt = 0;
+    w->x_off = h.x_off;
+    w->y_off = h.y_off;
+    w->ok = 1;
+    return w;
+}
+
+/* Appends cnt vectors, and their labels, to a dataset file.
+ *
+ * Parameters:
+ *   w   - Writer returned by dsfile_create()
+ *   x   - Array of cnt input vectors of D elements
+ *   y   - Array of cnt output vectors of N elements (DS_FLOAT), or
+ *         of cnt int labels (DS_INT); ignored for DS_NONE
+ *   cnt - Number of vectors
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ */
+int dsfile_append(DSWRITER* w, const fArr2D x, const void* y, int cnt)
+{
+    if (!w->ok)
+        return 0;
+    if (w->cnt + cnt > w->M) {
+        fprintf(stderr,"In dsfile_append: %ld vectors exceed dataset size "
+                                               "%ld\n",w->cnt + cnt,w->M);
+        w->ok = 0;
+        return 0;
+    }
+    int64_t xsz = w->D * (int64_t) sizeof(float);
+    int64_t ysz = ds_label_size(w->y_type,w->N);
+    w->ok = ds_write_at(w->fp,w->x_off + w->cnt * xsz,x,cnt * xsz);
+    if (w->ok && ysz > 0)
+        w->ok = ds_write_at(w->fp,w->y_off + w->cnt * ysz,y,cnt * ysz);
+    if (!w->ok)
+        fprintf(stderr,"In dsfile_append: failed to write vectors\n");
+    w->cnt += cnt;
+    return w->ok;
+}
+
+/* Closes a dataset file created by dsfile_create(), and frees the writer.
+ * Returns 1 if the file is complete and all writes were successful,
+ * 0 otherwise.
+ */
+int dsfile_finish(DSWRITER* w)
+{
+    int ok = w->ok;
+    if (ok && w->cnt != w->M) {
+        fprintf(stderr,"In dsfile_finish: %ld vectors written, "
+                                      "expected %ld\n",w->cnt,w->M);
+        ok = 0;
+    }
+    if (fclose(w->fp) != 0)
+        ok = 0;
+    freemem(w);
+    return ok;
+}
+
+/* Writes a dataset in memory to a dataset file.
+ *
+ * Parameters are the same as for dsfile_create() and dsfile_append().
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ */
+int dsfile_write(const char* filename, const fArr2D x, int D,
+                 const void* y, int N, int y_type, const int* len, int num)
+{
+    DSWRITER* w = dsfile_create(filename,D,N,y_type,len,num);
+    if (w == NULL)
+        return 0;
+    /* Write one sequence at a time to keep the counts within int range */
+    int seqcnt = (len != NULL) ? num : 1;
+    const float* xs = (const float*) x;
+    const char* ys = (const char*) y;
+    int64_t ysz = ds_label_size(w->y_type,w->N);
+    for (int i = 0; i < seqcnt && w->ok; i++) {
+        int cnt = (len != NULL) ? len[i] : num;
+        dsfile_append(w,(fArr2D) xs,ys,cnt);
+        xs += cnt * (long) D;
+        if (ys != NULL)
+            ys += cnt * ysz;
+    }
+    return dsfile_finish(w);
+}
@@ -0,0 +1,148 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Binary dataset files that can be memory mapped */
+#ifndef DSFILE_H
+#define DSFILE_H
+#include <stdio.h>
+#include "array.h"
+#include "datasrc.h"
+
+/* A dataset file holds one or more sequences of input vectors, and
+ * optionally their labels, in binary form that can be mapped into memory
+ * and used directly, without parsing or copying.
+ *
+ * File layout (native byte order); each section starts at a multiple of
+ * DS_ALIGN bytes from the beginning of the file:
+ *   header               see DSHEADER in dsfile.c
+ *   int   len[num]       sequence lengths
+ *   float x[M][D]        input vectors of all sequences, one after another
+ *   float y[M][N]        output vectors (y_type DS_FLOAT), or
+ *   int   y[M]           class labels in the range 0..N-1 (y_type DS_INT)
+ */
+#define DS_ALIGN    64  /* Sections alignment (bytes)       */
+
+#define DS_NONE     0   /* No labels                        */
+#define DS_FLOAT    1   /* float vectors (float or double)  */
+#define DS_INT      2   /* int class labels                 */
+
+typedef struct dsfile_s {
+    int D;          /* Dimension of x vectors                          */
+    int N;          /* Dimension of y vectors, or number of classes    */
+    int y_type;     /* DS_NONE DS_FLOAT or DS_INT                      */
+    int num;        /* Number of sequences                             */
+    long M;         /* Total number of vectors                         */
+    const int* len; /* Sequence lengths [num]                          */
+    const long* off;/* Index of first vector of each sequence [num+1]  */
+    const float* x; /* Input vectors [M][D]                            */
+    const void* y;  /* Labels [M][N] or [M], NULL if y_type is DS_NONE */
+    void* base;     /* Mapped file                                     */
+    long size;      /* Size of mapped file                             */
+} DSFILE;
+
+/* Opens a dataset file and maps it into memory (read only).
+ *
+ * Parameters:
+ *   filename - Name of a dataset file
+ *
+ * Returns:
+ *   A pointer to a DSFILE, or NULL if an error occured.
+ *
+ * Notes:
+ *   The arrays x, y and len can be passed directly to model_fit() when
+ *   y_type is DS_FLOAT (or DS_NONE); with int labels use dsfile_source()
+ *   and model_fit_source(), which expand labels to one-hot vectors.
+ */
+DSFILE* dsfile_open(const char* filename);
+
+/* Unmaps a dataset file and frees the memory allocated by dsfile_open() */
+void dsfile_close(DSFILE* ds);
+
+/* Returns a pointer to the first input vector of sequence i */
+static inline const float* dsfile_x(const DSFILE* ds, int i)
+{
+    return ds->x + ds->off[i] * ds->D;
+}
+
+/* Returns a pointer to the first output vector of sequence i, if labels
+ * are vectors (DS_FLOAT), or to the first class label, if labels are
+ * classes (DS_INT). Returns NULL if there are no labels.
+ */
+static inline const void* dsfile_y(const DSFILE* ds, int i)
+{
+    if (ds->y_type == DS_FLOAT)
+        return (const float*) ds->y + ds->off[i] * ds->N;
+    if (ds->y_type == DS_INT)
+        return (const int*) ds->y + ds->off[i];
+    return NULL;
+}
+
+/* Creates a data source over an open dataset file. Int class labels
+ * are returned as one-hot vectors of N elements. The dataset file is
+ * not closed when the data source is freed.
+ */
+DATASRC* dsfile_source(DSFILE* ds);
+
+/* Dataset file writer */
+typedef struct dswriter_s {
+    FILE* fp;       /* Output file                              */
+    int D;          /* Dimension of x vectors                   */
+    int N;          /* Dimension of y vectors, or class count   */
+    int y_type;     /* DS_NONE DS_FLOAT or DS_INT               */
+    long M;         /* Total number of vectors                  */
+    long cnt;       /* Number of vectors written so far         */
+    long x_off;     /* Offset of x section in file              */
+    long y_off;     /* Offset of y section in file              */
+    int ok;         /* Zero after a write error                 */
+} DSWRITER;
+
+/* Creates a dataset file. Since the sequence lengths are known up front,
+ * vectors can then be appended in any number of dsfile_append() calls, so
+ * the dataset does not need to be in memory all at once.
+ *
+ * Parameters:
+ *   filename - Name of file to create
+ *   D        - Dimension of x vectors
+ *   N        - Dimension of y vectors, or number of classes; ignored if
+ *              y_type is DS_NONE
+ *   y_type   - DS_NONE, DS_FLOAT or DS_INT
+ *   len      - Sequence lengths; if NULL, the dataset is a single
+ *              sequence of num vectors
+ *   num      - Number of sequences if len is not NULL; otherwise the
+ *              number of vectors
+ *
+ * Returns:
+ *   A pointer to a DSWRITER, or NULL if an error occured.
+ */
+DSWRITER* dsfile_create(const char* filename, int D, int N, int y_type,
+                        const int* len, int num);
+
+/* Appends cnt vectors, and their labels, to a dataset file.
+ *
+ * Parameters:
+ *   w   - Writer returned by dsfile_create()
+ *   x   - Array of cnt input vectors of D elements
+ *   y   - Array of cnt output vectors of N elements (DS_FLOAT), or
+ *         of cnt int labels (DS_INT); ignored for DS_NONE
+ *   cnt - Number of vectors
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ */
+int dsfile_append(DSWRITER* w, const fArr2D x, const void* y, int cnt);
+
+/* Closes a dataset file created by dsfile_create(), and frees the writer.
+ * Returns 1 if the file is complete and all writes were successful,
+ * 0 otherwise.
+ */
+int dsfile_finish(DSWRITER* w);
+
+/* Writes a dataset in memory to a dataset file.
+ *
+ * Parameters are the same as for dsfile_create() and dsfile_append().
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ */
+int dsfile_write(const char* filename, const fArr2D x, int D,
+                 const void* y, int N, int y_type, const int* len, int num);
+
+#endif
@@ -0,0 +1,320 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Binary word embedding files that can be memory mapped */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mem.h"
+#include "float.h"
+#include "array.h"
+#include "hash.h"
+#include "embdfile.h"
+
+#define EMBD_MAGIC   "MLEMBDFL"
+#define EMBD_VERSION 1
+
+/* Embedding file header; offsets are from the beginning of the file */
+typedef struct {
+    char magic[8];          /* EMBD_MAGIC                               */
+    int32_t version;        /* EMBD_VERSION                             */
+    int32_t float_size;     /* sizeof(float) of the writer: 4 or 8      */
+    int32_t V;              /* Vocabulary size                          */
+    int32_t E;              /* Embedding dimension                      */
+    int32_t vec_type;       /* EMBD_FLOAT or EMBD_FP16                  */
+    int32_t map_size;       /* Hash map table size                      */
+    int32_t mem_used;       /* Size of vocabulary words memory          */
+    int32_t epochs;         /* Training parameters                      */
+    double learning_rate;
+    double learning_rate_decay;
+    int64_t i2s_off;        /* Offset of hash map index to entry        */
+    int64_t s2i_off;        /* Offset of hash map entry to index        */
+    int64_t map_off;        /* Offset of hash map entry to word         */
+    int64_t mem_off;        /* Offset of vocabulary words               */
+    int64_t vec_off;        /* Offset of embedding vectors              */
+    int64_t size;           /* File size                                */
+} EMBDHEADER;
+
+static inline int64_t embd_align(int64_t n)
+{
+    return (n + EMBD_ALIGN - 1) / EMBD_ALIGN * EMBD_ALIGN;
+}
+
+/* Returns the size in bytes of one vector element */
+static inline int64_t embd_elem_size(int vec_type)
+{
+    return (vec_type == EMBD_FP16) ? (int64_t) sizeof(uint16_t) :
+                                     (int64_t) sizeof(float);
+}
+
+/* Converts a value to IEEE 754 half precision, rounding to nearest even.
+ * Values too large for half precision become infinity.
+ */
+static uint16_t fp16_encode(float v)
+{
+    uint16_t sign = signbit(v) ? 0x8000 : 0;
+    double a = fabs((double) v);
+    if (isnan(a))
+        return sign | 0x7e00;
+    if (a >= 65520.0) /* Rounds to above 65504, largest half */
+        return sign | 0x7c00;
+    if (a < ldexp(1.0,-14)) /* Subnormal; 1024 rounds up to a normal */
+        return sign | (uint16_t) nearbyint(ldexp(a,24));
+    int e;
+    frexp(a,&e); /* a = f * 2^e, 0.5 <= f < 1 */
+    int m = (int) nearbyint(ldexp(a,11 - e)); /* 1024 <= m <= 2048 */
+    if (m == 2048) {
+        m = 1024;
+        e++;
+    }
+    return sign | (uint16_t) ((e + 14) << 10) | (uint16_t) (m - 1024);
+}
+
+/* Converts an IEEE 754 half precision value to float */
+static float fp16_decode(uint16_t h)
+{
+    int e = (h >> 10) & 0x1f;
+    int m = h & 0x3ff;
+    double a;
+    if (e == 0)
+        a = ldexp(m,-24);
+    else
+    if (e == 31)
+        a = (m != 0) ? NAN : INFINITY;
+    else
+        a = ldexp(m + 1024,e - 25);
+    return (h & 0x8000) ? -a : a;
+}
+
+/* Returns 1 if the file is an embedding file, 0 otherwise */
+int embdfile_check(const char* filename)
+{
+    FILE* fp = fopen(filename,"rb");
+    if (fp == NULL)
+        return 0;
+    char magic[8];
+    int ok = fread(magic,sizeof(magic),1,fp) == 1 &&
+             memcmp(magic,EMBD_MAGIC,sizeof(magic)) == 0;
+    fclose(fp);
+    return ok;
+}
+
+/* Opens an embedding file and maps it into memory (read only).
+ *
+ * Parameters:
+ *   filename - Name of an embedding file
+ *
+ * Returns:
+ *   A pointer to an EMBDFILE, or NULL if an error occured.
+ */
+EMBDFILE* embdfile_open(const char* filename)
+{
+    int fd = open(filename,O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr,"In embdfile_open: failed to open file '%s' for "
+                                                          "read\n",filename);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd,&st) != 0 || st.st_size < (off_t) sizeof(EMBDHEADER)) {
+        fprintf(stderr,"In embdfile_open: '%s' is not an embedding file\n",
+                                                                     filename);
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    void* base = mmap(NULL,size,PROT_READ,MAP_SHARED,fd,0);
+    close(fd); /* The mapping remains valid */
+    if (base == MAP_FAILED) {
+        fprintf(stderr,"In embdfile_open: failed to map file '%s'\n",filename);
+        return NULL;
+    }
+    const EMBDHEADER* h = (const EMBDHEADER*) base;
+    if (memcmp(h->magic,EMBD_MAGIC,sizeof(h->magic)) != 0 ||
+        h->version != EMBD_VERSION) {
+        fprintf(stderr,"In embdfile_open: '%s' is not an embedding file\n",
+                                                                     filename);
+        munmap(base,size);
+        return NULL;
+    }
+    if (h->vec_type == EMBD_FLOAT && h->float_size != sizeof(float)) {
+        fprintf(stderr,"In embdfile_open: '%s' has %d bytes floats, "
+                   "expected %d\n",filename,h->float_size,(int) sizeof(float));
+        munmap(base,size);
+        return NULL;
+    }
+    int64_t vsz = (int64_t) h->V * h->E * embd_elem_size(h->vec_type);
+    if (h->V < 0 || h->E <= 0 || h->map_size <= h->V || h->mem_used < 0 ||
+        h->size != (int64_t) size ||
+        (h->vec_type != EMBD_FLOAT && h->vec_type != EMBD_FP16) ||
+        h->i2s_off < (int64_t) sizeof(EMBDHEADER) ||
+        h->i2s_off + h->V * (int64_t) sizeof(int) > h->s2i_off ||
+        h->s2i_off + h->map_size * (int64_t) sizeof(int) > h->map_off ||
+        h->map_off + h->map_size * (int64_t) sizeof(int) > h->mem_off ||
+        h->mem_off + h->mem_used > h->vec_off ||
+        h->vec_off + vsz > h->size ||
+        h->i2s_off % EMBD_ALIGN != 0 || h->s2i_off % EMBD_ALIGN != 0 ||
+        h->map_off % EMBD_ALIGN != 0 || h->mem_off % EMBD_ALIGN != 0 ||
+        h->vec_off % EMBD_ALIGN != 0) {
+        fprintf(stderr,"In embdfile_open: file '%s' is truncated or corrupt\n",
+                                                                     filename);
+        munmap(base,size);
+        return NULL;
+    }
+    char* p = (char*) base;
+    EMBDFILE* ef = allocmem(1,1,EMBDFILE);
+    ef->V = h->V;
+    ef->E = h->E;
+    ef->vec_type = h->vec_type;
+    ef->learning_rate = h->learning_rate;
+    ef->learning_rate_decay = h->learning_rate_decay;
+    ef->epochs = h->epochs;
+    /* The hash map arrays are read only; lookups never modify them */
+    ef->vocab.i2s = (int*) (p + h->i2s_off);
+    ef->vocab.s2i = (int*) (p + h->s2i_off);
+    ef->vocab.map = (int*) (p + h->map_off);
+    ef->vocab.map_size = h->map_size;
+    ef->vocab.map_used = h->V;
+    ef->vocab.mem = p + h->mem_off;
+    ef->vocab.mem_size = h->mem_used;
+    ef->vocab.mem_used = h->mem_used;
+    ef->base = base;
+    ef->size = size;
+    if (h->vec_type == EMBD_FP16) {
+        long n = (long) h->V * h->E;
+        const uint16_t* hv = (const uint16_t*) (p + h->vec_off);
+        ef->mem = allocmem(h->V,h->E,float);
+        for (long i = 0; i < n; i++)
+            ef->mem[i] = fp16_decode(hv[i]);
+        ef->W = ef->mem;
+    }
+    else
+        ef->W = (const float*) (p + h->vec_off);
+    return ef;
+}
+
+/* Unmaps an embedding file and frees the memory allocated by
+ * embdfile_open()
+ */
+void embdfile_close(EMBDFILE* ef)
+{
+    if (ef == NULL)
+        return;
+    munmap(ef->base,ef->size);
+    if (ef->mem != NULL)
+        freemem(ef->mem);
+    freemem(ef);
+}
+
+/* Writes n bytes at offset off of file fp; returns 1 if successful */
+static int embd_write_at(FILE* fp, int64_t off, const void* p, int64_t n)
+{
+    if (fseeko(fp,off,SEEK_SET) != 0)
+        return 0;
+    return n == 0 || fwrite(p,n,1,fp) == 1;
+}
+
+/* Writes a vocabulary and its embedding vectors to an embedding file.
+ *
+ * Parameters:
+ *   filename - Name of file to create
+ *   vocab    - Vocabulary; the words of indices 0 to V-1 are written
+ *   W        - Embedding vectors [V][E]
+ *   V        - Vocabulary size
+ *   E        - Embedding dimension
+ *   vec_type - EMBD_FLOAT or EMBD_FP16
+ *   learning_rate, learning_rate_decay, epochs - Training parameters,
+ *              stored for information
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ */
+int embdfile_write(const char* filename, HASHMAP* vocab,
+                   const fArr2D W, int V, int E, int vec_type,
+                   float learning_rate, float learning_rate_decay, int epochs)
+{
+    /* Build a compact index of the written words */
+    int mem_size = 1;
+    for (int i = 0; i < V; i++)
+        mem_size += strlen(hashmap_inx2str(vocab,i)) + 16;
+    HASHMAP* m = hashmap_create(V * 3 + 1,mem_size);
+    for (int i = 0; i < V; i++) {
+        const char* word = hashmap_inx2str(vocab,i);
+        char unk[16];
+        if (strlen(word) == 0) { /* Padding, or no word for this index */
+            if (i == 0 || hashmap_str2inx(m,"<unk>",0) < 0)
+                word = "<unk>";
+            else {
+                snprintf(unk,sizeof(unk),"<unk%d>",i);
+                word = unk;
+            }
+        }
+        if (hashmap_str2inx(m,word,1) != i) {
+            fprintf(stderr,"In embdfile_write: duplicate word '%s' at index "
+                                                           "%d\n",word,i);
+            hashmap_free(m);
+            return 0;
+        }
+    }
+
+    EMBDHEADER h;
+    memset(&h,0,sizeof(h));
+    memcpy(h.magic,EMBD_MAGIC,sizeof(h.magic));
+    h.version = EMBD_VERSION;
+    h.float_size = sizeof(float);
+    h.V = V;
+    h.E = E;
+    h.vec_type = vec_type;
+    h.map_size = m->map_size;
+    h.mem_used = m->mem_used;
+    h.epochs = epochs;
+    h.learning_rate = learning_rate;
+    h.learning_rate_decay = learning_rate_decay;
+    h.i2s_off = embd_align(sizeof(EMBDHEADER));
+    h.s2i_off = embd_align(h.i2s_off + V * (int64_t) sizeof(int));
+    h.map_off = embd_align(h.s2i_off + m->map_size * (int64_t) sizeof(int));
+    h.mem_off = embd_align(h.map_off + m->map_size * (int64_t) sizeof(int));
+    h.vec_off = embd_align(h.mem_off + m->mem_used);
+    int64_t rsz = E * embd_elem_size(vec_type);
+    h.size = h.vec_off + V * rsz;
+
+    FILE* fp = fopen(filename,"wb");
+    if (fp == NULL) {
+        fprintf(stderr,"In embdfile_write: failed to open file '%s' for "
+                                                         "write\n",filename);
+        hashmap_free(m);
+        return 0;
+    }
+    int ok = embd_write_at(fp,0,&h,sizeof(h)) &&
+             embd_write_at(fp,h.i2s_off,m->i2s,V * (int64_t) sizeof(int)) &&
+             embd_write_at(fp,h.s2i_off,m->s2i,
+                                   m->map_size * (int64_t) sizeof(int)) &&
+             embd_write_at(fp,h.map_off,m->map,
+                                   m->map_size * (int64_t) sizeof(int)) &&
+             embd_write_at(fp,h.mem_off,m->mem,m->mem_used) &&
+             ftruncate(fileno(fp),h.size) == 0;
+    hashmap_free(m);
+    if (ok && vec_type == EMBD_FP16) {
+        typedef float (*ArrVE)[E];
+        ArrVE Wv = (ArrVE) W;
+        uint16_t* row = allocmem(1,E,uint16_t);
+        for (int i = 0; ok && i < V; i++) {
+            for (int j = 0; j < E; j++)
+                row[j] = fp16_encode(Wv[i][j]);
+            ok = embd_write_at(fp,h.vec_off + i * rsz,row,rsz);
+        }
+        freemem(row);
+    }
+    else
+    if (ok)
+        ok = embd_write_at(fp,h.vec_off,W,V * rsz);
+    if (fclose(fp) != 0)
+        ok = 0;
+    if (!ok)
+        fprintf(stderr,"In embdfile_write: failed to write file '%s'\n",
+                                                                     filename);
+    return ok;
+}
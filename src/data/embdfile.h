@@ -0,0 +1,91 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Binary word embedding files that can be memory mapped */
+#ifndef EMBDFILE_H
+#define EMBDFILE_H
+#include "array.h"
+#include "hash.h"
+
+/* An embedding file holds a vocabulary, its hash index and the embedding
+ * vectors of the vocabulary words in binary form, so it can be mapped into
+ * memory and used without parsing or rebuilding the vocabulary index.
+ *
+ * File layout (native byte order); each section starts at a multiple of
+ * EMBD_ALIGN bytes from the beginning of the file:
+ *   header                 see EMBDHEADER in embdfile.c
+ *   int   i2s[V]           hash map index to hash table entry
+ *   int   s2i[map_size]    hash map hash table entry to index
+ *   int   map[map_size]    hash map hash table entry to string offset
+ *   char  mem[mem_used]    vocabulary words, '\0' terminated
+ *   float W[V][E]          embedding vectors (EMBD_FLOAT), or
+ *   short W[V][E]          half precision embedding vectors (EMBD_FP16)
+ */
+#define EMBD_ALIGN  64  /* Sections alignment (bytes)           */
+
+#define EMBD_FLOAT  0   /* float vectors (float or double)      */
+#define EMBD_FP16   1   /* IEEE 754 half precision vectors      */
+
+typedef struct embdfile_s {
+    int V;                      /* Vocabulary size                        */
+    int E;                      /* Embedding dimension                    */
+    int vec_type;               /* EMBD_FLOAT or EMBD_FP16                */
+    float learning_rate;        /* Training parameters, for information   */
+    float learning_rate_decay;
+    int epochs;
+    HASHMAP vocab;              /* Read only vocabulary index             */
+    const float* W;             /* Embedding vectors [V][E]               */
+    float* mem;                 /* Decoded EMBD_FP16 vectors, or NULL     */
+    void* base;                 /* Mapped file                            */
+    long size;                  /* Size of mapped file                    */
+} EMBDFILE;
+
+/* Opens an embedding file and maps it into memory (read only).
+ *
+ * Parameters:
+ *   filename - Name of an embedding file
+ *
+ * Returns:
+ *   A pointer to an EMBDFILE, or NULL if an error occured.
+ *
+ * Notes:
+ *   The vocabulary index, vocab, refers to the mapped file. Use it with
+ *   hashmap_str2inx(), with ins 0, and hashmap_inx2str(); do not insert
+ *   words and do not pass it to hashmap_free().
+ *   EMBD_FLOAT vectors are used directly from the mapped file, and can be
+ *   passed to find_most_similar() and annoy_create(). EMBD_FP16 vectors
+ *   are converted to floats when the file is opened.
+ */
+EMBDFILE* embdfile_open(const char* filename);
+
+/* Unmaps an embedding file and frees the memory allocated by
+ * embdfile_open()
+ */
+void embdfile_close(EMBDFILE* ef);
+
+/* Returns 1 if the file is an embedding file, 0 otherwise */
+int embdfile_check(const char* filename);
+
+/* Writes a vocabulary and its embedding vectors to an embedding file.
+ *
+ * Parameters:
+ *   filename - Name of file to create
+ *   vocab    - Vocabulary; the words of indices 0 to V-1 are written
+ *   W        - Embedding vectors [V][E]
+ *   V        - Vocabulary size
+ *   E        - Embedding dimension
+ *   vec_type - EMBD_FLOAT or EMBD_FP16
+ *   learning_rate, learning_rate_decay, epochs - Training parameters,
+ *              stored for information
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ *
+ * Notes:
+ *   The hash index is rebuilt for the V written words. An empty word
+ *   (padding) is written as "<unk>", as in word2vec text files; further
+ *   empty words are written as "<unk>" followed by their index.
+ */
+int embdfile_write(const char* filename, HASHMAP* vocab,
+                   const fArr2D W, int V, int E, int vec_type,
+                   float learning_rate, float learning_rate_decay, int epochs);
+
+#endif
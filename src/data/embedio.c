@@ -36,6 +36,7 @@ EMBEDDING* read_embedding(FILE* fp)
     e->padinx = pad;
     e->h = allocmem(e->B,e->E,float);
     e->Wx = allocmem(e->D,e->E,float);
+    e->seen = allocmem(e->D,1,int);
     int ok = read_array(e->Wx,e->D,e->E,fp,0);
     if (ok)
         return e;
@@ -43,6 +44,7 @@ EMBEDDING* read_embedding(FILE* fp)
     fprintf(stderr,"In read_embedding: failed to read weights\n");
     freemem(e->h);
     freemem(e->Wx);
+    freemem(e->seen);
     freemem(e);
     return NULL;
 }
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <strings.h>
 #include <ctype.h>
+#include "mem.h"
 #include "float.h"
 #include "delta.h"
 #include "featfile.h"
@@ -217,6 +218,201 @@ int read_feature_files(const char* input_dir, const char* file_list,
     return seqinx;
 }
 
+/* Returns the number of feature vectors in a speech feature file, or -1
+ * if the file is malformed.
+ */
+static int count_feature_frames(FILE* fp)
+{
+    int cnt = 0;
+    char buf[20000];
+    while (fgets(buf,sizeof(buf),fp) != NULL) {
+        int len = strlen(buf);
+        if (len == 0 || buf[len - 1] != '\n')
+            return -1;
+        char* line = buf;
+        while (isspace(*line))
+            line++;
+        if (*line == '\0' || strncmp(line,"phoneme,",8) == 0) /* Header */
+            continue;
+        /* Frame count (nfrm) is the 7th field */
+        for (int commas = 0; commas < 6 && line != NULL; commas++)
+            if ((line = index(line,',')) != NULL)
+                line++;
+        if (line == NULL)
+            return -1;
+        cnt += atoi(line);
+    }
+    return cnt;
+}
+
+/* Speech feature files data source state */
+typedef struct {
+    int num;        /* Number of sequences (files)                   */
+    char** path;    /* Path of each file                             */
+    int* len;       /* Number of vectors in each file                */
+    int cur;        /* Index of sequence in x, yc; -1 if none        */
+    float (*x)[EXPENDED_FEAT_CNT]; /* Vectors of current sequence    */
+    int* yc;        /* Labels of current sequence                    */
+} FEATSRC;
+
+static int featsrc_num_sequences(DATASRC* s)
+{
+    return ((FEATSRC*) s->data)->num;
+}
+
+static int featsrc_sequence_length(DATASRC* s, int i)
+{
+    return ((FEATSRC*) s->data)->len[i];
+}
+
+static int featsrc_read_sequence(DATASRC* s, int i, int first, int cnt,
+                                 fArr2D x_, fArr2D y_)
+{
+    FEATSRC* f = (FEATSRC*) s->data;
+    if (f->cur != i) {
+        f->cur = -1;
+        FILE* fp = fopen(f->path[i],"rb");
+        if (fp == NULL) {
+            fprintf(stderr,"Failed to open file '%s' for read\n",f->path[i]);
+            return 0;
+        }
+        /* One spare row, so a complete file does not hit the limit */
+        int len = read_feature_file(fp,f->len[i] + 1,f->x,f->yc);
+        fclose(fp);
+        if (len != f->len[i]) {
+            fprintf(stderr,"File '%s' has %d vectors, expected %d\n",
+                                                     f->path[i],len,f->len[i]);
+            return 0;
+        }
+        for (int j = 0; j < len; j++) /* Remove end of phoneme markers */
+            if (f->yc[j] >= EOP)
+                f->yc[j] -= EOP;
+        f->cur = i;
+    }
+    typedef float (*ArrCD)[EXPENDED_FEAT_CNT];
+    typedef float (*ArrCN)[REDUCED_PHONEME_CNT];
+    ArrCD x = (ArrCD) x_;
+    ArrCN y = (ArrCN) y_;
+    fltcpy(x,f->x[first],cnt * EXPENDED_FEAT_CNT);
+    if (y != NULL) {
+        fltclr(y,cnt * REDUCED_PHONEME_CNT);
+        for (int j = 0; j < cnt; j++)
+            y[j][f->yc[first + j]] = 1.0;
+    }
+    return cnt;
+}
+
+static void featsrc_close(DATASRC* s)
+{
+    FEATSRC* f = (FEATSRC*) s->data;
+    for (int i = 0; i < f->num; i++)
+        freemem(f->path[i]);
+    freemem(f->path);
+    freemem(f->len);
+    freemem(f->x);
+    freemem(f->yc);
+    freemem(f);
+}
+
+/* Creates a data source over speech feature files. 
+ *
+ * Unlike read_feature_files(), the files are not loaded into memory; each
+ * sequence is read from its file, and its features expanded, when it is
+ * requested. Only the most recently read sequence is held in memory.
+ *
+ * Parameters
+ * - input_dir is a directory containing speech feature files, whose name
+ *   ends with '.feat'.
+ * - file_list is a text file containing the names of the files to be used.
+ * - max_sequences is the maximum number of sequences (files) to use.
+ *
+ * Returns:
+ *   A data source whose input vectors have EXPENDED_FEAT_CNT elements,
+ *   and whose output vectors are one-hot encoded labels of
+ *   REDUCED_PHONEME_CNT elements (without end of phoneme markers).
+ *   Returns NULL if an error occured.
+ */
+DATASRC* featfile_source(const char* input_dir, const char* file_list,
+                         int max_sequences)
+{
+    const int maxpath = 512;
+    char buffer[3 * maxpath];
+    if ((int) strlen(input_dir) >= maxpath) {
+        fprintf(stderr,"Directory name too long: '%s'\n",input_dir);
+        return NULL;
+    }
+    FILE *lfp = fopen(file_list,"rb");
+    if (lfp == NULL) {
+        fprintf(stderr,"Failed to open '%s' for read\n",file_list);
+        return NULL;
+    }
+    FEATSRC* f = allocmem(1,1,FEATSRC);
+    f->path = allocmem(max_sequences,1,char*);
+    f->len = allocmem(max_sequences,1,int);
+    f->cur = -1;
+    int maxlen = 0;
+    int fileno = 0;
+    /* Same file naming as read_feature_files() */
+    while (f->num < max_sequences) {
+        strcpy(buffer,input_dir);
+        int pfxlen = strlen(buffer);
+        if (buffer[pfxlen - 1] != '/')
+            strcat(buffer,"/");
+        char* filepath = buffer + strlen(buffer);
+        filepath = fgets(filepath,maxpath,lfp);
+        if (filepath == NULL || strlen(filepath) == 0)
+            break;      /* End of file list */
+        for (int i = 0; filepath[i] != '\0'; i++)
+            if (filepath[i] == '/')
+                filepath[i] = '_';
+        filepath = buffer;    /* filepath now points to file path */
+        filepath[strlen(filepath) - 1] = '\0'; /* Punch out end of line char */
+        char *ext = rindex(filepath,'.');
+        if (ext != NULL)
+            *ext = '\0'; /* Remove extension if any */
+        strcat(filepath,".FEAT");  
+        fileno++;
+        FILE* fp = fopen(filepath,"rb");
+        if (fp == NULL) {
+            fprintf(stderr,"Failed to open file '%s' (%d) for read - "
+                                            "skipping file\n",filepath,fileno);
+            continue;
+        }
+        int len = count_feature_frames(fp);
+        fclose(fp);
+        if (len <= 0) {
+            fprintf(stderr,"File '%s' (%d) is empty or malformed - "
+                                            "skipping file\n",filepath,fileno);
+            continue;
+        }
+        f->path[f->num] = allocmem(1,strlen(filepath) + 1,char);
+        strcpy(f->path[f->num],filepath);
+        f->len[f->num++] = len;
+        if (maxlen < len)
+            maxlen = len;
+    }
+    fclose(lfp);
+    if (f->num == 0) {
+        fprintf(stderr,"No feature files listed in '%s'\n",file_list);
+        freemem(f->path);
+        freemem(f->len);
+        freemem(f);
+        return NULL;
+    }
+    f->x = allocmem(maxlen + 1,EXPENDED_FEAT_CNT,float);
+    f->yc = allocmem(maxlen + 1,1,int);
+
+    DATASRC* s = allocmem(1,1,DATASRC);
+    s->D = EXPENDED_FEAT_CNT;
+    s->N = REDUCED_PHONEME_CNT;
+    s->num_sequences = featsrc_num_sequences;
+    s->sequence_length = featsrc_sequence_length;
+    s->read_sequence = featsrc_read_sequence;
+    s->close = featsrc_close;
+    s->data = f;
+    return s;
+}
+
 const char* timit_phoneme_names[TIMIT_PHONEME_CNT] = {
     "","aa","ae","ah","ao","aw","ax","axr",
     "ax-h","ay","b","bcl","ch","d","dcl","dh",
@@ -2,6 +2,7 @@
 /* Read speech feature files                 */
 #ifndef FEATFILE_H
 #define FEATFILE_H
+#include "datasrc.h"
 
 #define FEAT_CNT            14
 #define EXPENDED_FEAT_CNT   70
@@ -118,4 +119,29 @@ int read_feature_files(const char* input_dir, const char* file_list,
                        int max_sequences, int *seq_length,
                        int max_samples, float x[][EXPENDED_FEAT_CNT], int yc[]);
 
+/* Creates a data source over speech feature files. 
+ *
+ * Unlike read_feature_files(), the files are not loaded into memory; each
+ * sequence is read from its file, and its features expanded, when it is
+ * requested. Only the most recently read sequence is held in memory.
+ *
+ * Parameters
+ * - input_dir is a directory containing speech feature files, whose name
+ *   ends with '.feat'.
+ * - file_list is a text file containing the names of the files to be used.
+ * - max_sequences is the maximum number of sequences (files) to use.
+ *
+ * Returns:
+ *   A data source whose input vectors have EXPENDED_FEAT_CNT elements,
+ *   and whose output vectors are one-hot encoded labels of
+ *   REDUCED_PHONEME_CNT elements (without end of phoneme markers).
+ *   Returns NULL if an error occured.
+ *
+ * Notes:
+ *   The files are scanned once, when the data source is created, to find
+ *   the sequence lengths. Files that cannot be opened are skipped.
+ */
+DATASRC* featfile_source(const char* input_dir, const char* file_list,
+                         int max_sequences);
+
 #endif
@@ -0,0 +1,171 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Functions to load and store NN gru layer */
+#include <stdio.h>
+#include "mem.h"
+#include "float.h"
+#include "array.h"
+#include "arrayio.h"
+#include "gru.h"
+#include "gruio.h"
+
+/* read_gru - Read a GRU layer from a file
+ *
+ * Reads a GRU layer from the file pointed to by fp.
+ *
+ * Parameters:
+ *   fp - Pointer to a FILE object representing the input file
+ *
+ * Returns:
+ *   Pointer to the read GRU layer if successful, NULL otherwise
+ */
+GRU* read_gru(FILE* fp)
+{
+    int D, S, B, b;
+    int cnt = fscanf(fp," GRU D %d S %d B %d stateful %d\n",&D,&S,&B,&b);
+    if (cnt < 4 || cnt == EOF) {
+        fprintf(stderr,"In read_gru: failed to read header\n");
+        return NULL;
+    }
+    GRU* l = allocmem(1,1,GRU);
+    l->S = S;
+    l->D = D;
+    l->B = B;
+    l->Bmax = B;
+    l->stateful = (b) ? 1 : 0;
+
+    l->z = allocmem(l->B,l->S,float);
+    l->r = allocmem(l->B,l->S,float);
+    l->hc = allocmem(l->B,l->S,float);
+    l->h = allocmem(l->B+1,l->S,float);
+    l->Wz = allocmem(l->D,l->S,float);
+    l->Wr = allocmem(l->D,l->S,float);
+    l->Wh = allocmem(l->D,l->S,float);
+    l->Uz = allocmem(l->S,l->S,float);
+    l->Ur = allocmem(l->S,l->S,float);
+    l->Uh = allocmem(l->S,l->S,float);
+    l->ph = allocmem(1,l->S,float);
+
+    fArr2D Wx[3] = {l->Wz,l->Wr,l->Wh};
+    char* sWx[3] = {"Wz","Wr","Wh"};
+    for (int i = 0; i < 3; i++) {
+        int ok = read_array(Wx[i],l->D,l->S,fp,0);
+        if (!ok) {
+            fprintf(stderr,"In read_gru: failed to read %s weights\n",sWx[i]);
+            goto err;
+        }
+    }
+    fArr2D Ux[3] = {l->Uz,l->Ur,l->Uh};
+    char* sUx[3] = {"Uz","Ur","Uh"};
+    for (int i = 0; i < 3; i++) {
+        int ok = read_array(Ux[i],l->S,l->S,fp,0);
+        if (!ok) {
+            fprintf(stderr,"In read_gru: failed to read %s weights\n",sUx[i]);
+            goto err;
+        }
+    }
+    int ok = read_array((fArr2D) l->ph,1,l->S,fp,0);
+    if (!ok) {
+        fprintf(stderr,"In read_gru: failed to read hidden state\n");
+        goto err;
+    }
+    return l;
+
+err: /* error exit */
+    gru_free(l);
+    return NULL;
+}
+
+/* write_gru - Write a GRU layer to a file
+ *
+ * Writes the GRU layer pointed to by d to the file pointed to by fp.
+ *
+ * Parameters:
+ *   l  - Pointer to the GRU layer to be written
+ *   fp - Pointer to a FILE object representing the output file
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise
+ */
+int write_gru(const GRU* l, FILE* fp)
+{
+    int cnt = fprintf(fp,"GRU D %d S %d B %d stateful %d\n",
+                                     l->D,l->S,l->Bmax,l->stateful);
+    if (cnt <= 0 || cnt == EOF) {
+        fprintf(stderr,"In write_gru: failed to write the header\n");
+        return 0;
+    }
+
+    fArr2D Wx[3] = {l->Wz,l->Wr,l->Wh};
+    char* sWx[3] = {"Wz","Wr","Wh"};
+    for (int i = 0; i < 3; i++) {
+        int ok = write_array(Wx[i],l->D,l->S,fp,NULL,0);
+        if (!ok) {
+            fprintf(stderr,
+                    "In write_gru: failed to write %s weights\n",sWx[i]);
+            return 0;
+        }
+    }
+    fArr2D Ux[3] = {l->Uz,l->Ur,l->Uh};
+    char* sUx[3] = {"Uz","Ur","Uh"};
+    for (int i = 0; i < 3; i++) {
+        int ok = write_array(Ux[i],l->S,l->S,fp,NULL,0);
+        if (!ok) {
+            fprintf(stderr,
+                    "In write_gru: failed to write %s weights\n",sUx[i]);
+            return 0;
+        }
+    }
+    int ok = write_array((fArr2D) l->ph,1,l->S,fp,NULL,0);
+    if (!ok) {
+        fprintf(stderr,"In write_gru: failed to write hidden state\n");
+        return 0;
+    }
+    return 1;
+}
+
+/* load_gru - Load a GRU layer from a file
+ *
+ * Opens the file specified by the filename parameter for reading and
+ * loads a GRU layer from it.
+ *
+ * Parameters:
+ *   filename - Name of the file to load the GRU layer from
+ *
+ * Returns:
+ *   Pointer to the loaded GRU layer if successful, NULL otherwise
+ */
+GRU* load_gru(const char* filename)
+{
+    FILE* fp = fopen(filename,"rb");
+    if (fp == NULL) {
+        fprintf(stderr,"In load_gru: failed to open file '%s' for read\n",filename);
+        return NULL;
+    }
+    GRU* l = read_gru(fp);
+    fclose(fp);
+    return l;
+}
+
+/* store_gru - Store a GRU layer into a file
+ *
+ * Opens the file specified by the filename parameter for writing and
+ * stores the GRU layer pointed to by d into it.
+ *
+ * Parameters:
+ *   l        - Pointer to the GRU layer to be stored
+ *   filename - Name of the file to store the GRU layer in
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise
+ */
+int store_gru(const GRU* l, const char* filename)
+{
+    FILE* fp = fopen(filename,"wb");
+    if (fp == NULL) {
+        fprintf(stderr,"In store_gru: failed to open file '%s' for write\n",filename);
+        return 0;
+    }
+    int ok = write_gru(l,fp);
+    fclose(fp);
+    return ok;
+}
@@ -0,0 +1,60 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Functions to load and store NN GRU layer  */
+#ifndef GRUIO_H
+#define GRUIO_H
+#include <stdio.h>
+#include "gru.h"
+
+/* read_gru - Read a GRU layer from a file
+ * 
+ * Reads a GRU layer from the file pointed to by fp.
+ * 
+ * Parameters:
+ *   fp - Pointer to a FILE object representing the input file
+ * 
+ * Returns:
+ *   Pointer to the read GRU layer if successful, NULL otherwise
+ */
+GRU* read_gru(FILE* fp);
+
+/* write_gru - Write a GRU layer to a file
+ * 
+ * Writes the GRU layer pointed to by d to the file pointed to by fp. 
+ * 
+ * Parameters:
+ *   l  - Pointer to the GRU layer to be written
+ *   fp - Pointer to a FILE object representing the output file
+ * 
+ * Returns:
+ *   1 if successful, 0 otherwise
+ */
+int write_gru(const GRU* l, FILE* fp);
+
+/* load_gru - Load a GRU layer from a file
+ * 
+ * Opens the file specified by the filename parameter for reading and 
+ * loads a GRU layer from it.
+ * 
+ * Parameters:
+ *   filename - Name of the file to load the GRU layer from
+ * 
+ * Returns:
+ *   Pointer to the loaded GRU layer if successful, NULL otherwise
+ */
+GRU* load_gru(const char* filename);
+
+/* store_gru - Store a GRU layer into a file
+ * 
+ * Opens the file specified by the filename parameter for writing and 
+ * stores the GRU layer pointed to by d into it.
+ * 
+ * Parameters:
+ *   l        - Pointer to the GRU layer to be stored
+ *   filename - Name of the file to store the GRU layer in
+ * 
+ * Returns:
+ *   1 if successful, 0 otherwise
+ */
+int store_gru(const GRU* l, const char* filename);
+
+#endif
@@ -0,0 +1,206 @@
+/* Copyright (c) 2023-2024 Gilad Odinak */
+/* Read Human Activity Recordings (HAR) raw data files */
+#include <stdio.h>
+#include <stdlib.h>
+#include "float.h"
+#include "array.h"
+#include "delta.h"
+#include "harfile.h"
+
+const char* har_class_names[HAR_CLASS_CNT] = {
+    "walking","upstairs","downstairs","sitting","standing","laying",
+    "stand2sit","sit2stand","sit2lie","lie2sit","stand2lie","lie2stand"
+};
+
+static const int har2reduced[HAR_CLASS_CNT] = {
+    0,/* 0 walking*/
+    1,/* 1 upstairs*/
+    2,/* 2 downstairs*/
+    3,/* 3 sitting*/
+    4,/* 4 standing*/
+    5,/* 5 laying*/
+    3,/* 6 stand2sit*/
+    4,/* 7 sit2stand*/
+    5,/* 8 sit2lie*/
+    3,/* 9 lie2sit*/
+    5,/*10 stand2lie*/
+    4 /*11 lie2stand*/
+};
+
+/* Reads activity samples from raw HAR data files.
+ * 61 data files contain 3-axis accelometer or gyroscope mesaurments
+ * of 30 subjects pefromming 6 activities.  The file names have this format:
+ * <sgyro|acc>_exp<eid>_user<uid>.txt where eid is a 2 digit experiment
+ * number, and uid is a two digits subjectr number.
+ * A labels.txt file contains meta data about the raw mesaurments. Each
+ * line describe a section of measurments in one of the raw files and has
+ * this format: <eid> <uid> <aid> <start> <end>
+ * eid - experiment id (1 - 61)
+ * uid - subject id (1 - 30)
+ * aid - activity id (1-12) (6 activities, and 6 transitions)
+ * start - sample number in file where activity starts
+ * end   - sample number in file past activity's end
+ * Transitions and unlabeled data are mapped to "unknown" activity.
+ *
+ * Parameters:
+ *
+ *   input_dir     - a directory containing sample files, and labels.txt file
+ *   max_sequences - maximum number of sequences (size of seq_length[])
+ *   seq_length    - pointer to array the receives sequence lengths
+ *   max_samples   - maximum number of samples (number of rows in x, and
+ *                   number of elements in yc)
+ *   x             - pointer to array that receives measurment vectors
+ *                   measurment data is expended to 18 dimensions
+ *   yc            - true labels of input vectors
+ *   sid           - only return data for these subjects
+ *   sid_len       - number of entries in sid array. 
+ *
+ * Returns:   
+ * An array of input vectors in x, and their corresponding labels in yc,
+ * and the length of each sequence of input vectors in seq_length.
+ * 
+ * This function returns the actual number of sequences, which is also the 
+ * actual number of elements in seq_length. It returns 0 if an error occurred.
+ */
+int read_har_files(const char* input_dir,
+                   int max_sequences, int *seq_length,
+                   int max_samples, fArr2D x_/*[][]*/, int* yc/*[]*/,
+                   const int* sid/*[]*/, int sid_len)
+{
+    typedef float (*ArrMN)[HAR_EXPENDED_FEAT_CNT];
+    ArrMN x = (ArrMN) x_;
+    char fnl[256];
+    snprintf(fnl,sizeof(fnl),"%s/labels.txt",input_dir);
+    FILE* fpl = fopen(fnl,"rb");
+    if (fpl == NULL) {
+        fprintf(stderr,"%s: failed to open file for read\n",fnl);
+        return 0;
+    }
+    char fna[256];      /* Accelerator data current file name */
+    char fng[256];      /* Accelerator data current file name */
+    FILE* fpa = NULL;
+    FILE* fpg = NULL;
+    int filesample = 0; /* Current data file(s) sample */
+    int fileline = 1;   /* Current date file(s) line   */
+    int seqcnt = -1; 
+    int lasteid = -1;
+    int samplecnt = 0;  /* Total number of samples */
+    for (int lineno = 1;; lineno++) {
+        char buf[256];
+        char* line = fgets(buf,sizeof(buf),fpl);
+        if (line == NULL) { /* End of data */
+            if (seqcnt >= 0) {  /* Finalize last sequence */
+                int M = seq_length[seqcnt];
+                int a = samplecnt - M;
+                int N = HAR_EXPENDED_FEAT_CNT;
+                calculate_deltas(x[a],M,N,0,6,6,5);  /* deltas       */
+                calculate_deltas(x[a],M,N,6,12,6,5); /* delta-deltas */
+            }
+            seqcnt++; /* Count last sequence */
+            break;
+        }
+        int eid;   /* Experiment ID */
+        int uid;   /* User ID       */
+        int aid;   /* Activity ID   */
+        int start; /* Sample start  */
+        int end;   /* Sample end    */
+        int cnt = sscanf(line," %d %d %d %d %d",&eid,&uid,&aid,&start,&end);
+        if (cnt != 5) {
+            fprintf(stderr,
+                "File %s, at line %d: failed to read 5 values\n",fnl,lineno);
+            break;
+        }
+        aid--; /* File classes are 1-based */
+        aid = har2reduced[aid];
+        /* Check if requested subject */
+        int sid_inx;
+        for (sid_inx = 0; sid_inx < sid_len; sid_inx++)
+            if (sid[sid_inx] == uid)
+                break;
+        if (sid_inx >= sid_len)
+            continue; /* Not one of requested subjects */
+
+        if (eid != lasteid) {   /* New expriment file */
+            if (seqcnt >= 0) {  /* Finalize previous sequence */
+                int M = seq_length[seqcnt];
+                int a = samplecnt - M;
+                int N = HAR_EXPENDED_FEAT_CNT;
+                calculate_deltas(x[a],M,N,0,6,6,5);  /* deltas       */
+                calculate_deltas(x[a],M,N,6,12,6,5); /* delta-deltas */
+                fclose(fpa);
+                fclose(fpg);
+            }
+            seqcnt++; /* New sequence */
+            if (seqcnt >= max_sequences) {
+                fprintf(stderr,
+                    "Reached max number of sequences (%d)\n",max_sequences);
+                break;
+            }
+            seq_length[seqcnt] = 0;
+            snprintf(fna,sizeof(fna),
+                     "%s/acc_exp%02d_user%02d.txt",input_dir,eid,uid);
+            fpa = fopen(fna,"rb");
+            if (fpa == NULL) {
+                fprintf(stderr,"%s: failed to open file for read\n",fna);
+                break;
+            }
+            snprintf(fng,sizeof(fng),
+                     "%s/gyro_exp%02d_user%02d.txt",input_dir,eid,uid);
+            fpg = fopen(fng,"rb");
+            if (fpg == NULL) {
+                fprintf(stderr,"%s: failed to open file for read\n",fng);
+                break;
+            }
+            filesample = 0;
+            fileline = 1;
+            lasteid = eid;
+        }
+        while (filesample < end) {
+            if (samplecnt >= max_samples) {
+                fprintf(stderr,
+                    "Reached max number of samples (%d)\n",max_samples);
+                break;
+            }
+            int i = samplecnt;
+            line = fgets(buf,sizeof(buf),fpa);
+            if (line == NULL) {
+                fprintf(stderr,
+                    "%s: unexpected end of file at line %d\n",fna,fileline);
+                break;
+            }
+            cnt = sscanf(line," "FMTF" "FMTF" "FMTF,&x[i][0],&x[i][1],&x[i][2]);
+            if (cnt != 3) {
+                fprintf(stderr,
+                    "%s, at line %d: failed to read 3 values\n",fna,fileline);
+                break;
+            }
+            line = fgets(buf,sizeof(buf),fpg);
+            if (line == NULL) {
+                fprintf(stderr,
+                    "%s: unexpected end of file at line %d\n",fng,fileline);
+                break;
+            }
+            cnt = sscanf(line," "FMTF" "FMTF" "FMTF,&x[i][3],&x[i][4],&x[i][5]);
+            if (cnt != 3) {
+                fprintf(stderr,
+                    "%s, at line %d: failed to read 3 values\n",fng,fileline);
+                break;
+            }
+            yc[i] = aid;
+            fileline++;
+            filesample++;
+            samplecnt++;  
+            seq_length[seqcnt]++;
+        }
+        if (filesample < end) /* Failed to read data */
+            break;
+    }
+    if (fpl != NULL)
+        fclose(fpl);
+    if (fpa != NULL)
+        fclose(fpa);
+    if (fpg != NULL)
+        fclose(fpg);
+    return seqcnt;
+}
+
@@ -0,0 +1,57 @@
+/* Copyright (c) 2023-2024 Gilad Odinak */
+/* Read Human Activity Recordings (HAR) raw data files */
+#ifndef HARFILE_H
+#define HARFILE_H
+#include "array.h"
+
+#define HAR_FEAT_CNT           6 /* Number of raw sensor signals         */
+#define HAR_EXPENDED_FEAT_CNT 18 /* including additional delta features  */
+#define HAR_CLASS_CNT         12 /* Number of activities and transitions */
+#define HAR_REDUCED_CLASS_CNT  6 /* Number of distinct activities        */
+#define HAR_SUBJECT_CNT       30 /* Number of people sampled             */
+
+extern const char* har_class_names[HAR_CLASS_CNT];
+/* = { "walking","upstairs","downstairs","sitting","standing","laying",
+       "stand2sit","sit2stand","sit2lie","lie2sit","stand2lie","lie2stand" } */
+
+/* Reads activity samples from raw HAR data files.
+ * 61 data files contain 3-axis accelometer or gyroscope mesaurments
+ * of 30 subjects pefromming 6 activities.  The file names have this format:
+ * <sgyro|acc>_exp<eid>_user<uid>.txt where eid is a 2 digit experiment
+ * number, and uid is a two digits subjectr number.
+ * A labels.txt file contains meta data about the raw mesaurments. Each
+ * line describe a section of measurments in one of the raw files and has
+ * this format: <eid> <uid> <aid> <start> <end>
+ * eid - experiment id (1 - 61)
+ * uid - subject id (1 - 30)
+ * aid - activity id (1-12) (6 activities, and 6 transitions)
+ * start - sample number in file where activity starts
+ * end   - sample number in file past activity's end
+ * Transitions and unlabeled data are mapped to "unknown" activity.
+ *
+ * Parameters:
+ *
+ *   input_dir     - a directory containing sample files, and labels.txt file
+ *   max_sequences - maximum number of sequences (size of seq_length[])
+ *   seq_length    - pointer to array the receives sequence lengths
+ *   max_samples   - maximum number of samples (number of rows in x, and
+ *                   number of elements in yc)
+ *   x             - pointer to array that receives measurment vectors
+ *                   measurment data is expended to 18 dimensions
+ *   yc            - true labels of input vectors
+ *   sid           - only return data for these subjects
+ *   sid_len       - number of entries in sid array. 
+ *
+ * Returns:   
+ * An array of input vectors in x, and their corresponding labels in yc,
+ * and the length of each sequence of input vectors in seq_length.
+ * 
+ * This function returns the actual number of sequences, which is also the 
+ * actual number of elements in seq_length. It returns 0 if an error occurred.
+ */
+int read_har_files(const char* input_dir,
+                   int max_sequences, int *seq_length,
+                   int max_samples, fArr2D x_/*[][]*/, int* yc/*[]*/,
+                   const int* sid/*[]*/, int sid_len);
+
+#endif
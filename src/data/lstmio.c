@@ -30,6 +30,7 @@ LSTM* read_lstm(FILE* fp)
     l->S = S;
     l->D = D;
     l->B = B;
+    l->Bmax = B;
     l->stateful = (b) ? 1 : 0;
 
     l->f = allocmem(l->B,l->S,float);
@@ -113,7 +114,7 @@ err: /* error exit */
 int write_lstm(const LSTM* l, FILE* fp)
 {
     int cnt = fprintf(fp,"LSTM D %d S %d B %d stateful %d\n",
-                                     l->D,l->S,l->B,l->stateful);
+                                     l->D,l->S,l->Bmax,l->stateful);
     if (cnt <= 0 || cnt == EOF) {
         fprintf(stderr,"In write_lstm: failed to write the header\n");
         return 0;
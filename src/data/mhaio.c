@@ -1,6 +1,7 @@
 /* Copyright (c) 2026 Gilad Odinak */
 /* Functions to load and store NN MHA (Multi-Head Attention) layer */
 #include <stdio.h>
+#include <string.h>
 #include "mem.h"
 #include "float.h"
 #include "array.h"
@@ -25,18 +26,32 @@
  *     frequency table (theta) is derived and rebuilt via rope_init().
  *   - Backward/gradient buffers are allocated only when the stored
  *     training flag is non-zero.
+ *   - Files without the attention field, written before it was added,
+ *     are read as softmax attention.
  */
 MHA* read_mha(FILE* fp)
 {
     int H, T, D, B, lookahead, training;
     float dropout_rate;
+    char attention[16] = "softmax";
     int cnt = fscanf(fp," MHA H %d T %d D %d B %d lookahead %d"
-                        " training %d dropout %g\n",
-                     &H,&T,&D,&B,&lookahead,&training,&dropout_rate);
+                        " training %d dropout %g attention %15s\n",
+                     &H,&T,&D,&B,&lookahead,&training,&dropout_rate,
+                     attention);
     if (cnt < 7 || cnt == EOF) {
         fprintf(stderr,"In read_mha: failed to read header\n");
         return NULL;
     }
+    char a = 0;
+    if (!strcmp(attention,"softmax"))
+        a = 's';
+    else
+    if (!strcmp(attention,"linear"))
+        a = 'l';
+    else {
+        fprintf(stderr,"In read_mha: invalid attention '%s'\n",attention);
+        return NULL;
+    }
     if (H <= 0 || D % H != 0) {
         fprintf(stderr,"In read_mha: D %d not an integral multiple of H %d\n",
                        D,H);
@@ -46,12 +61,15 @@ MHA* read_mha(FILE* fp)
     MHA* l = allocmem(1,1,MHA);
     l->H = H;
     l->T = T;
+    l->Tmax = T;
     l->D = D;
     l->B = B;
+    l->Bmax = B;
     l->Dh = D / H;
     l->BT = B * T;
     l->BHT = B * H * T;
     l->lookahead = lookahead;
+    l->attention = a;
     l->training = (training) ? 1 : 0;
     l->dropout_rate = dropout_rate;
 
@@ -72,10 +90,13 @@ MHA* read_mha(FILE* fp)
     l->Kh = allocmem(l->BHT,l->Dh,float);
     l->Vh = allocmem(l->BHT,l->Dh,float);
 
-    l->Att = allocmem(l->BHT,l->T,float);
-    l->AttMask = allocmem(l->BHT,l->T,float);
-
-    l->Scores = allocmem(l->T,l->T,float);
+    if (l->attention == 'l')
+        l->Den = allocmem(1,l->BHT,float);
+    else {
+        l->Att = allocmem(l->BHT,l->T,float);
+        l->AttMask = allocmem(l->BHT,l->T,float);
+        l->Scores = allocmem(l->T,l->T,float);
+    }
     l->Oh = allocmem(l->T,l->Dh,float);
 
     l->Out = allocmem(l->BT,l->D,float);
@@ -95,8 +116,10 @@ MHA* read_mha(FILE* fp)
         l->dVh = allocmem(l->T,l->Dh,float);
 
         l->dOh = allocmem(l->T,l->Dh,float);
-        l->dAtt = allocmem(l->T,l->T,float);
-        l->dScores = allocmem(l->T,l->T,float);
+        if (l->attention != 'l') {
+            l->dAtt = allocmem(l->T,l->T,float);
+            l->dScores = allocmem(l->T,l->T,float);
+        }
 
         l->gWq = allocmem(l->D,l->D,float);
         l->gWk = allocmem(l->D,l->D,float);
@@ -137,9 +160,10 @@ int write_mha(const MHA* l, int final, FILE* fp)
     int training = final ? 0 : l->training;
     float dropout_rate = final ? 0.0f : l->dropout_rate;
     int cnt = fprintf(fp,"MHA H %d T %d D %d B %d lookahead %d"
-                         " training %d dropout %.9g\n",
-                      l->H,l->T,l->D,l->B,l->lookahead,
-                      training,dropout_rate);
+                         " training %d dropout %.9g attention %s\n",
+                      l->H,l->Tmax,l->D,l->Bmax,l->lookahead,
+                      training,dropout_rate,
+                      (l->attention == 'l') ? "linear" : "softmax");
     if (cnt <= 0 || cnt == EOF) {
         fprintf(stderr,"In write_mha: failed to write the header\n");
         return 0;
@@ -2,6 +2,7 @@
 /* Functions to load and store multi-layer neural network model */
 #include <stdio.h>
 #include "mem.h"
+#include "trace.h"
 #include "float.h"
 #include "array.h"
 #include "arrayio.h"
@@ -9,6 +10,8 @@
 #include "denseio.h"
 #include "lstm.h"
 #include "lstmio.h"
+#include "gru.h"
+#include "gruio.h"
 #include "transformer.h"
 #include "xfmrio.h"
 #include "negsample.h"
@@ -82,9 +85,18 @@ MODEL* read_model(FILE* fp)
                 l->lstm = read_lstm(fp); 
                 ok = (l->lstm != NULL);
             break;
+            case 'g': 
+                l->gru = read_gru(fp); 
+                ok = (l->gru != NULL);
+            break;
             case 't':
                 l->transformer = read_transformer(fp);
                 ok = (l->transformer != NULL);
+                if (ok) { /* Scratch buffers, see layer_init() */
+                    TRANSFORMER* tr = l->transformer;
+                    l->out = allocmem(tr->BT,tr->D,float);
+                    l->mask = allocmem(tr->BT,1,int);
+                }
             break;
             case 'n':
                 l->negsample = read_negsample(fp);
@@ -116,6 +128,13 @@ MODEL* read_model(FILE* fp)
                         ok = read_array(l->grads[j],rows,l->lstm->S,fp,0);
                     }
                 break;
+                case 'g': /* gru layer gradients  */
+                    for (int j = 0; j < l->num_grads && ok; j++) {
+                        int rows = ((j / 3) % 2) ? l->gru->S : l->gru->D;
+                        l->grads[j] = allocmem(rows,l->gru->S,float);
+                        ok = read_array(l->grads[j],rows,l->gru->S,fp,0);
+                    }
+                break;
                 case 't': /* transformer layer gradients (adamw m/v moments) */
                 {
                     int D = l->transformer->D;
@@ -148,6 +167,7 @@ MODEL* read_model(FILE* fp)
         }
     }
     m->compiled = 1;
+    model_tune(m,0);
     return m;
 err: /* error return */
     fflush(stderr);
@@ -215,6 +235,7 @@ int write_model(const MODEL* m, int final, FILE* fp)
         switch (l->type) {
             case 'd': ok = write_dense(l->dense,fp); break;
             case 'l': ok = write_lstm(l->lstm,fp); break;
+            case 'g': ok = write_gru(l->gru,fp); break;
             case 't': ok = write_transformer(l->transformer,fin,fp); break;
             case 'n': ok = write_negsample(l->negsample,fp); break;
         }
@@ -241,6 +262,12 @@ int write_model(const MODEL* m, int final, FILE* fp)
                         ok = write_array(l->grads[j],rows,l->lstm->S,fp,NULL,0);
                     }
                 break;
+                case 'g': /* gru layer gradients  */
+                    for (int j = 0; j < l->num_grads && ok; j++) {
+                        int rows = ((j / 3) % 2) ? l->gru->S : l->gru->D;
+                        ok = write_array(l->grads[j],rows,l->gru->S,fp,NULL,0);
+                    }
+                break;
                 case 't': /* transformer layer gradients (adamw m/v moments) */
                 {
                     int D = l->transformer->D;
@@ -290,8 +317,10 @@ MODEL* load_model(const char* filename)
         fprintf(stderr,"In load_model: failed to open file '%s' for read\n",filename);
         return NULL;
     }
+    TRACE_BEGIN("load model","io",-1);
     MODEL* m = read_model(fp);
     fclose(fp);
+    TRACE_END();
     return m;
 }
 
@@ -314,8 +343,11 @@ int store_model(const MODEL* m, const char* filename)
         fprintf(stderr,"In store_model: failed to open file '%s' for write\n",filename);
         return 0;
     }
+    TRACE_BEGIN("store model","io",-1);
     int ok = write_model(m,m->final,fp);
-    fclose(fp);
+    if (fclose(fp) != 0)
+        ok = 0;
+    TRACE_END();
     return ok;
 }
 
@@ -38,6 +38,7 @@ NEGSAMPLE* read_negsample(FILE* fp)
     l->K = K;
     l->E = E;
     l->B = B;
+    l->Bmax = B;
     l->n_neg = n_neg;
     l->Wo = allocmem(l->K,l->E,float);
     l->h = allocmem(l->B,l->E,float);
@@ -74,7 +75,7 @@ NEGSAMPLE* read_negsample(FILE* fp)
 int write_negsample(const NEGSAMPLE* l, FILE* fp)
 {
     int cnt = fprintf(fp,"NEGSAMPLE K %d E %d B %d n_neg %d\n",
-                      l->K,l->E,l->B,l->n_neg);
+                      l->K,l->E,l->Bmax,l->n_neg);
     if (cnt <= 0 || cnt == EOF) {
         fprintf(stderr,"In write_negsample: failed to write the header\n");
         return 0;
@@ -10,17 +10,17 @@
 #define ISALPHA(c) isalpha((unsigned char) (c))
 #define TOLOWER(c) tolower((unsigned char) (c))
 
-/* Returns a pointer to the first letter (a-z A-Z) in a string, or NULL */
-static inline char* first_letter(char* s)
+/* Returns a pointer to the first letter (a-z A-Z) before end, or NULL */
+static inline char* first_letter(char* s, const char* end)
 {
-    while (*s != '\0' && !ISALPHA(*s)) s++;
-    return (*s != '\0') ? s : NULL;
+    while (s < end && !ISALPHA(*s)) s++;
+    return (s < end) ? s : NULL;
 }
 
 /* Returns a pointer to the first letter past word end */
-static inline char* word_end(char* s)
+static inline char* word_end(char* s, const char* end)
 {
-    while (ISALPHA(*s) || *s == '\'') s++;
+    while (s < end && (ISALPHA(*s) || *s == '\'')) s++;
     return s;
 }
 
@@ -88,66 +88,79 @@ int process_news_file(const char* file_name,
                 "failed to open data file '%s' for read\n",file_name);
         return -1;
     }
+    long size = (fseek(fp,0,SEEK_END) == 0) ? ftell(fp) : -1;
+    if (size < 0 || fseek(fp,0,SEEK_SET) != 0) {
+        fprintf(stderr,"In process_news_file: "
+                "failed to read data file '%s'\n",file_name);
+        fclose(fp);
+        return -1;
+    }
+    char* text = allocmem(size + 1,1,char);
+    size = fread(text,1,size,fp);
+    fclose(fp);
+    int file_word_cnt = process_news_text(text,size,hmap,add_new,max_vocab,
+                                          word_freq,file_words,max_words);
+    freemem(text);
+    return file_word_cnt;
+}
 
-    char buffer[20000];
+/* Processes the text of a file, already in memory (see fileload.h), as
+ * process_news_file() does.
+ *
+ * Parameters:
+ *   text       - Text of the file, followed by at least one more byte; it
+ *                is modified.
+ *   size       - Size of the text in bytes.
+ *   The rest of the parameters are those of process_news_file().
+ *
+ * Returns:
+ *  - If hmap is not NULL: Returns the number of words that were not skipped.
+ *  - If hmap is NULL: Returns the total number of words.
+ */
+int process_news_text(char* text, long size,
+                      HASHMAP* hmap, int add_new,
+                      int max_vocab, WRDFRQ* word_freq,
+                      int *file_words, int max_words)
+{
+    const char* end = text + size;
     int file_word_cnt = 0;  /* Number of words in the file */
     const int max_word_len = 100;
-    for (int cnt, off = 0;;) {
-        cnt = fread(buffer + off,1,sizeof(buffer) - off - 1,fp) + off;
-        buffer[cnt] = '\0';
-        off = 0;
-        char* w = first_letter(buffer);
-        while (w != NULL) {
-            char* e = word_end(w);
-            int len = e - w;
-            if (e == buffer + cnt) { /* Last char part of a word         */
-                if (!feof(fp)) { /* Word may continue past end of buffer */
-                    if (len <= max_word_len) {
-                        memmove(buffer,w,len); /* Discard processed data */
-                        off = len; /* Will read more data starting here  */
+    char* w = first_letter(text,end);
+    while (w != NULL) {
+        char* e = word_end(w,end);
+        /* w points to a letter, e does not, so w != e (e past w)    */
+        if (*(e - 1) == '\'') e--; /* Exclude trailing apostrophe    */
+        int len = e - w;
+        if (len <= max_word_len) {
+            for (int i = 0; i < len; i++)
+                w[i] = TOLOWER(w[i]);
+            w[len] = '\0'; /* Replace non letter with end of string  */
+            if (hmap != NULL) {
+                int inx = hashmap_str2inx(hmap,w,add_new);
+                if (inx >= 0 && inx < max_vocab) {
+                    if (word_freq != NULL) {
+                        word_freq[inx].inx = inx;
+                        word_freq[inx].cnt++;
                     }
-                    break;
-                }
-            }
-            /* w points to a letter, e does not, so w != e (e past w)    */
-            if (*(e - 1) == '\'') e--; /* Exclude trailing apostrophe    */
-            len = e - w;
-            if (len <= max_word_len) {
-                for (int i = 0; i < len; i++)
-                    w[i] = TOLOWER(w[i]);
-                w[len] = '\0'; /* Replace non letter with end of string  */
-                if (hmap != NULL) {
-                    int inx = hashmap_str2inx(hmap,w,add_new);
-                    if (inx >= 0 && inx < max_vocab) {
-                        if (word_freq != NULL) {
-                            word_freq[inx].inx = inx;
-                            word_freq[inx].cnt++;
+                    if (file_words != NULL) {
+                        if (file_word_cnt < max_words)
+                            file_words[file_word_cnt] = inx;
+                        else {
+                            fprintf(stderr,
+                                "\nFile contains more than %d words\n",
+                                max_words);
+                            return file_word_cnt;
                         }
-                        if (file_words != NULL) {
-                            if (file_word_cnt < max_words)
-                                file_words[file_word_cnt] = inx;
-                            else {
-                                fprintf(stderr,
-                                    "\nFile contains more than %d words\n",
-                                    max_words);
-                                return file_word_cnt;
-                            }
-                        }
-                        /* Count only words that are not skipped */
-                        file_word_cnt++;
                     }
+                    /* Count only words that are not skipped */
+                    file_word_cnt++;
                 }
-                else
-                    file_word_cnt++; /* Count all words */
             }
-            if (e + 1 - buffer >= (int) sizeof(buffer))
-                break;
-            w = first_letter(e + 1); /* Continue past end of prv string */
+            else
+                file_word_cnt++; /* Count all words */
         }
-        if (feof(fp))
-            break;
+        w = first_letter(e + 1,end); /* Continue past end of prv string */
     }
-    fclose(fp);
     return file_word_cnt;
 }
 
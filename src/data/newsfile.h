@@ -47,6 +47,24 @@ int process_news_file(const char* file_name,
                       int max_vocab, WRDFRQ* word_freq,
                       int *file_words, int max_words);
 
+/* Processes the text of a file, already in memory (see fileload.h), as
+ * process_news_file() does.
+ *
+ * Parameters:
+ *   text       - Text of the file, followed by at least one more byte; it
+ *                is modified.
+ *   size       - Size of the text in bytes.
+ *   The rest of the parameters are those of process_news_file().
+ *
+ * Returns:
+ *  - If hmap is not NULL: Returns the number of words that were not skipped.
+ *  - If hmap is NULL: Returns the total number of words.
+ */
+int process_news_text(char* text, long size,
+                      HASHMAP* hmap, int add_new,
+                      int max_vocab, WRDFRQ* word_freq,
+                      int *file_words, int max_words);
+
 /* Reads a list file containing file names (one per line), filters to include
  * only those files that end with the ".txt" extension (case-insensitive),
  * verifies that these files exist under the given data directory, and returns
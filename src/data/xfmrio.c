@@ -49,6 +49,8 @@ TRANSFORMER* read_transformer(FILE* fp)
     TRANSFORMER* l = allocmem(1,1,TRANSFORMER);
     l->B = B;
     l->T = T;
+    l->Bmax = B;
+    l->Tmax = T;
     l->D = D;
     l->Dff = Dff;
     l->BT = B * T;
@@ -82,6 +84,19 @@ TRANSFORMER* read_transformer(FILE* fp)
         goto err;
     }
 
+    /* Inference keeps one chunk of ffn1's output, see transformer_ffn() */
+    l->ffn_rows = transformer_ffn_chunk(l->BT,l->Dff);
+    if (!l->training && l->ffn1->Bmax > l->ffn_rows) {
+        DENSE* d = l->ffn1;
+        freemem(d->h);
+        freemem(d->z);
+        d->B = l->ffn_rows;
+        d->Bmax = l->ffn_rows;
+        d->h = allocmem(d->B,d->S,float);
+        if (d->activation == 'g')
+            d->z = allocmem(d->B,d->S,float);
+    }
+
     /* Transformer's own scratch buffers (mirror transformer_init) */
     l->mha_out = allocmem(l->BT,l->D,float);
     l->norm1_out = allocmem(l->BT,l->D,float);
@@ -137,7 +152,7 @@ int write_transformer(const TRANSFORMER* l, int final, FILE* fp)
     float dropout_rate = final ? 0.0f : l->dropout_rate;
     int cnt = fprintf(fp,"TRANSFORMER B %d T %d D %d Dff %d"
                          " training %d dropout %.9g\n",
-                      l->B,l->T,l->D,l->Dff,training,dropout_rate);
+                      l->Bmax,l->Tmax,l->D,l->Dff,training,dropout_rate);
     if (cnt <= 0 || cnt == EOF) {
         fprintf(stderr,"In write_transformer: failed to write the header\n");
         return 0;
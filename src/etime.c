@@ -13,6 +13,13 @@ float current_time()
     return (float) (curtime.tv_sec + (curtime.tv_nsec / 1000000000.0));
 }
 
+long long current_time_ns()
+{
+    struct timespec curtime;
+    clock_gettime(CLOCK_MONOTONIC, &curtime);
+    return curtime.tv_sec * 1000000000LL + curtime.tv_nsec;
+}
+
 char* date_time(char buffer[20]) 
 {
     time_t now;
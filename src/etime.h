@@ -6,6 +6,11 @@
 
 extern float current_time();
 
+/* Returns a monotonic clock reading in nanoseconds; unlike current_time(),
+ * it measures wall clock time, and is precise enough to time short events.
+ */
+extern long long current_time_ns();
+
 static inline float elapsed_time(float start_time)
 {
     return current_time() - start_time;
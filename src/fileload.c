@@ -0,0 +1,544 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Loading of many small files, with many reads in flight */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "mem.h"
+#include "fileload.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <linux/io_uring.h>
+/* Opening files through the ring needs Linux 5.6, which added this flag */
+#if defined(SYS_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define HAS_URING
+#endif
+#endif
+
+enum { PENDING, OPENING, READING, DONE, TAKEN };
+
+/* Loading state of a file */
+typedef struct {
+    int state;          /* One of the above                             */
+    int fd;             /* File descriptor, -1 if not open              */
+    long off;           /* Number of bytes read                         */
+} FILESTATE;
+
+#ifdef HAS_URING
+/* Submission and completion rings shared with the kernel */
+typedef struct {
+    int fd;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ptr;
+    void* cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+    unsigned pending;   /* Entries queued and not yet submitted         */
+} URING;
+#endif
+
+struct fileload_s {
+    int num;            /* Number of files                              */
+    int depth;          /* Maximum number of files in flight            */
+    LOADEDFILE* files;  /* [num] Files                                  */
+    FILESTATE* state;   /* [num] Loading state of each file             */
+    int* done;          /* [num] Indices of files, in completion order  */
+    int num_done;       /* Number of files completed                    */
+    int done_head;      /* Next entry of done to return                 */
+    int num_returned;   /* Number of files returned                     */
+    int next;           /* Next file to start                           */
+    int in_flight;      /* Files started and not yet released           */
+    int loading;        /* Files started and not yet completed          */
+    int stop;           /* Set by fileload_free()                       */
+    pthread_mutex_t lock;
+    pthread_cond_t completed;
+    pthread_cond_t released;
+    int num_threads;
+    pthread_t* threads;
+#ifdef HAS_URING
+    URING* ring;        /* NULL if files are read by threads            */
+#endif
+};
+
+/* Marks file i as completed, and queues it to be returned; a file that
+ * failed has its contents freed
+ */
+static void complete(FILELOAD* q, int i)
+{
+    LOADEDFILE* f = &q->files[i];
+    FILESTATE* s = &q->state[i];
+    if (s->fd >= 0)
+        close(s->fd);
+    s->fd = -1;
+    if (f->error != 0) {
+        freemem(f->data);
+        f->data = NULL;
+        f->size = 0;
+    }
+    else
+        f->data[f->size] = '\0';
+    s->state = DONE;
+    q->done[q->num_done++] = i;
+    q->loading--;
+}
+
+/* Sets the size of open file i, and allocates memory for its contents.
+ * Returns 0 if successful, -1 otherwise.
+ */
+static int opened(FILELOAD* q, int i)
+{
+    LOADEDFILE* f = &q->files[i];
+    struct stat st;
+    if (fstat(q->state[i].fd,&st) != 0) {
+        f->error = errno;
+        return -1;
+    }
+    f->size = st.st_size;
+    f->data = allocmem(f->size + 1,1,char);
+    return 0;
+}
+
+/* Loads file i with blocking calls */
+static void load_file(FILELOAD* q, int i)
+{
+    LOADEDFILE* f = &q->files[i];
+    FILESTATE* s = &q->state[i];
+    s->fd = open(f->name,O_RDONLY | O_CLOEXEC);
+    if (s->fd < 0) {
+        f->error = errno;
+        return;
+    }
+    if (opened(q,i) != 0)
+        return;
+    while (s->off < f->size) {
+        ssize_t n = pread(s->fd,f->data + s->off,f->size - s->off,s->off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            f->error = errno;
+            return;
+        }
+        if (n == 0) { /* File was truncated */
+            f->size = s->off;
+            break;
+        }
+        s->off += n;
+    }
+}
+
+static void* load_files(void* arg)
+{
+    FILELOAD* q = (FILELOAD*) arg;
+    pthread_mutex_lock(&q->lock);
+    for (;;) {
+        while (!q->stop && q->next < q->num && q->in_flight >= q->depth)
+            pthread_cond_wait(&q->released,&q->lock);
+        if (q->stop || q->next >= q->num)
+            break;
+        int i = q->next++;
+        q->in_flight++;
+        q->loading++;
+        q->state[i].state = READING;
+        pthread_mutex_unlock(&q->lock);
+        load_file(q,i);
+        pthread_mutex_lock(&q->lock);
+        complete(q,i);
+        pthread_cond_broadcast(&q->completed);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+#ifdef HAS_URING
+static void uring_free(URING* r)
+{
+    if (r->sqes != NULL)
+        munmap(r->sqes,r->sqes_size);
+    if (r->cq_ptr != NULL && r->cq_ptr != r->sq_ptr)
+        munmap(r->cq_ptr,r->cq_size);
+    if (r->sq_ptr != NULL)
+        munmap(r->sq_ptr,r->sq_size);
+    close(r->fd);
+    freemem(r);
+}
+
+static void* uring_map(int fd, size_t size, long long offset)
+{
+    void* p = mmap(NULL,size,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,
+                   fd,offset);
+    return (p != MAP_FAILED) ? p : NULL;
+}
+
+/* Creates a ring of at least entries entries. Returns NULL if io_uring is
+ * not available, or the kernel cannot open files through it.
+ */
+static URING* uring_create(unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p,0,sizeof(p));
+    int fd = syscall(SYS_io_uring_setup,entries,&p);
+    if (fd < 0)
+        return NULL;
+    URING* r = allocmem(1,1,URING);
+    r->fd = fd;
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        uring_free(r);
+        return NULL;
+    }
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_size > r->sq_size)
+            r->sq_size = r->cq_size;
+        r->sq_ptr = r->cq_ptr = uring_map(fd,r->sq_size,IORING_OFF_SQ_RING);
+    }
+    else {
+        r->sq_ptr = uring_map(fd,r->sq_size,IORING_OFF_SQ_RING);
+        r->cq_ptr = uring_map(fd,r->cq_size,IORING_OFF_CQ_RING);
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = uring_map(fd,r->sqes_size,IORING_OFF_SQES);
+    if (r->sq_ptr == NULL || r->cq_ptr == NULL || r->sqes == NULL) {
+        uring_free(r);
+        return NULL;
+    }
+    char* sq = (char*) r->sq_ptr;
+    r->sq_tail = (unsigned*) (sq + p.sq_off.tail);
+    r->sq_mask = (unsigned*) (sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*) (sq + p.sq_off.array);
+    char* cq = (char*) r->cq_ptr;
+    r->cq_head = (unsigned*) (cq + p.cq_off.head);
+    r->cq_tail = (unsigned*) (cq + p.cq_off.tail);
+    r->cq_mask = (unsigned*) (cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+    return r;
+}
+
+/* Submits the queued entries, and waits for min_complete completions */
+static void uring_enter(URING* r, unsigned min_complete)
+{
+    for (;;) {
+        int n = syscall(SYS_io_uring_enter,r->fd,r->pending,min_complete,
+                        (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0,
+                        NULL,0);
+        if (n >= 0) {
+            r->pending -= n;
+            return;
+        }
+        if (errno != EINTR) {
+            fflush(stdout);
+            fprintf(stderr,"fileload: io_uring_enter failed (%s)\n",
+                    strerror(errno));
+            exit(-1);
+        }
+    }
+}
+
+/* Queues the next operation of file i: its open, or a read of the rest of
+ * its contents. Each file in flight has one operation queued at a time, so
+ * the ring, of depth entries, does not fill.
+ */
+static void uring_queue(FILELOAD* q, int i)
+{
+    URING* r = q->ring;
+    LOADEDFILE* f = &q->files[i];
+    FILESTATE* s = &q->state[i];
+    unsigned tail = *r->sq_tail;
+    unsigned k = tail & *r->sq_mask;
+    struct io_uring_sqe* e = &r->sqes[k];
+    memset(e,0,sizeof(*e));
+    if (s->state == OPENING) {
+        e->opcode = IORING_OP_OPENAT;
+        e->fd = AT_FDCWD;
+        e->addr = (unsigned long) f->name;
+        e->open_flags = O_RDONLY | O_CLOEXEC;
+    }
+    else {
+        e->opcode = IORING_OP_READ;
+        e->fd = s->fd;
+        e->addr = (unsigned long) (f->data + s->off);
+        e->len = f->size - s->off;
+        e->off = s->off;
+    }
+    e->user_data = i;
+    r->sq_array[k] = k;
+    __atomic_store_n(r->sq_tail,tail + 1,__ATOMIC_RELEASE);
+    r->pending++;
+}
+
+/* Advances file i by the result of its completed operation */
+static void uring_advance(FILELOAD* q, int i, int res)
+{
+    LOADEDFILE* f = &q->files[i];
+    FILESTATE* s = &q->state[i];
+    if ((res == -EINTR || res == -EAGAIN) && !q->stop) {
+        uring_queue(q,i);
+        return;
+    }
+    if (res >= 0 && s->state == OPENING) {
+        s->fd = res;
+        s->state = READING;
+        if (opened(q,i) != 0) {
+            complete(q,i);
+            return;
+        }
+    }
+    else
+    if (res > 0)
+        s->off += res;
+    else
+    if (res == 0) /* File was truncated */
+        f->size = s->off;
+    if (res < 0)
+        f->error = -res;
+    else
+    if (q->stop)
+        f->error = ECANCELED;
+    if (f->error == 0 && s->off < f->size)
+        uring_queue(q,i);
+    else
+        complete(q,i);
+}
+
+/* Starts files while fewer than depth are in flight */
+static void uring_start(FILELOAD* q)
+{
+    while (q->next < q->num && q->in_flight < q->depth) {
+        int i = q->next++;
+        q->in_flight++;
+        q->loading++;
+        q->state[i].state = OPENING;
+        uring_queue(q,i);
+    }
+}
+
+/* Submits queued operations, waits for at least one to complete, and
+ * advances the files of the completed operations
+ */
+static void uring_wait(FILELOAD* q)
+{
+    URING* r = q->ring;
+    uring_start(q);
+    uring_enter(r,1);
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail,__ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        struct io_uring_cqe* e = &r->cqes[head & *r->cq_mask];
+        int i = (int) e->user_data;
+        int res = e->res;
+        __atomic_store_n(r->cq_head,head + 1,__ATOMIC_RELEASE);
+        uring_advance(q,i,res);
+    }
+}
+#endif
+
+/* Waits until a file completes; called with q->lock held */
+static void wait_file(FILELOAD* q)
+{
+    if (q->loading == 0 && q->in_flight >= q->depth) {
+        fflush(stdout);
+        fprintf(stderr,"fileload: all %d files in flight are held; "
+                       "release files before taking more\n",q->depth);
+        exit(-1);
+    }
+#ifdef HAS_URING
+    if (q->ring != NULL) {
+        uring_wait(q);
+        return;
+    }
+#endif
+    pthread_cond_wait(&q->completed,&q->lock);
+}
+
+/* Creates a file loader, and starts loading files.
+ *
+ * Parameters:
+ *   dir   - Directory of the files, prepended to their names (optional)
+ *   names - Names of the files to load
+ *   num   - Number of files
+ *   depth - Maximum number of files loaded and not yet released; if 0 or
+ *           less, FILELOAD_DEPTH
+ *
+ * Returns:
+ *   A pointer to the file loader.
+ *
+ * Notes:
+ *   Files are started in the order of names; names are copied.
+ */
+FILELOAD* fileload_create(const char* dir, char* const* names, int num,
+                          int depth)
+{
+    if (depth <= 0)
+        depth = FILELOAD_DEPTH;
+    FILELOAD* q = allocmem(1,1,FILELOAD);
+    q->num = num;
+    q->depth = depth;
+    q->files = allocmem(num,1,LOADEDFILE);
+    q->state = allocmem(num,1,FILESTATE);
+    q->done = allocmem(num,1,int);
+    int dlen = (dir != NULL) ? strlen(dir) : 0;
+    for (int i = 0; i < num; i++) {
+        int len = dlen + strlen(names[i]) + 2;
+        char* name = allocmem(len,1,char);
+        if (dlen > 0)
+            snprintf(name,len,"%s%s%s",dir,
+                     (dir[dlen - 1] == '/') ? "" : "/",names[i]);
+        else
+            strcpy(name,names[i]);
+        q->files[i].index = i;
+        q->files[i].name = name;
+        q->state[i].fd = -1;
+    }
+    pthread_mutex_init(&q->lock,NULL);
+    pthread_cond_init(&q->completed,NULL);
+    pthread_cond_init(&q->released,NULL);
+#ifdef HAS_URING
+    const char* env = getenv("MLINC_IO_URING");
+    if (num > 0 && (env == NULL || atoi(env) != 0))
+        q->ring = uring_create(depth);
+    if (q->ring != NULL) {
+        uring_start(q);
+        uring_enter(q->ring,0);
+        return q;
+    }
+#endif
+    q->num_threads = (depth < num) ? depth : num;
+    q->threads = allocmem(q->num_threads,1,pthread_t);
+    for (int i = 0; i < q->num_threads; i++)
+        if (pthread_create(&q->threads[i],NULL,load_files,q) != 0) {
+            fflush(stdout);
+            fprintf(stderr,"fileload_create: failed to create thread\n");
+            exit(-1);
+        }
+    return q;
+}
+
+/* Returns file i, marked as taken; called with q->lock held */
+static LOADEDFILE* take(FILELOAD* q, int i)
+{
+    q->state[i].state = TAKEN;
+    q->num_returned++;
+    return &q->files[i];
+}
+
+/* Returns the next file that completed loading, waiting for one if none
+ * has; returns NULL once all files were returned. A file that failed to
+ * load is returned with data NULL and error set.
+ */
+LOADEDFILE* fileload_next(FILELOAD* q)
+{
+    LOADEDFILE* f = NULL;
+    pthread_mutex_lock(&q->lock);
+    while (q->num_returned < q->num) {
+        while (q->done_head < q->num_done &&
+               q->state[q->done[q->done_head]].state == TAKEN)
+            q->done_head++;
+        if (q->done_head < q->num_done) {
+            f = take(q,q->done[q->done_head++]);
+            break;
+        }
+        wait_file(q);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return f;
+}
+
+/* Returns file index, waiting until it completes loading. Callers whose
+ * results depend on the order of the files call it with consecutive
+ * indices, and still have the next files loading in the meantime.
+ *
+ * Notes:
+ *   A file is returned once, either by fileload_next() or by this
+ *   function; do not mix the two with the same loader.
+ */
+LOADEDFILE* fileload_get(FILELOAD* q, int index)
+{
+    if (index < 0 || index >= q->num)
+        return NULL;
+    LOADEDFILE* f = NULL;
+    pthread_mutex_lock(&q->lock);
+    while (q->state[index].state < DONE)
+        wait_file(q);
+    if (q->state[index].state == DONE)
+        f = take(q,index);
+    pthread_mutex_unlock(&q->lock);
+    return f;
+}
+
+/* Frees the contents of a returned file, and lets the loader start
+ * loading another file.
+ */
+void fileload_release(FILELOAD* q, LOADEDFILE* f)
+{
+    freemem(f->data);
+    f->data = NULL;
+    pthread_mutex_lock(&q->lock);
+    q->in_flight--;
+#ifdef HAS_URING
+    if (q->ring != NULL) {
+        uring_start(q);
+        uring_enter(q->ring,0);
+    }
+#endif
+    pthread_cond_signal(&q->released);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* Returns the method the loader reads files with: "io_uring" or "threads" */
+const char* fileload_method(const FILELOAD* q)
+{
+#ifdef HAS_URING
+    if (q->ring != NULL)
+        return "io_uring";
+#endif
+    (void) q;
+    return "threads";
+}
+
+/* Waits for the files in flight, and frees the memory allocated by
+ * fileload_create(), including the contents of files not released.
+ */
+void fileload_free(FILELOAD* q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->stop = 1;
+    pthread_cond_broadcast(&q->released);
+    pthread_mutex_unlock(&q->lock);
+    for (int i = 0; i < q->num_threads; i++)
+        pthread_join(q->threads[i],NULL);
+#ifdef HAS_URING
+    if (q->ring != NULL) {
+        q->next = q->num; /* Start no more files */
+        while (q->loading > 0)
+            uring_wait(q);
+        uring_free(q->ring);
+    }
+#endif
+    for (int i = 0; i < q->num; i++) {
+        freemem(q->files[i].data);
+        freemem((char*) q->files[i].name);
+    }
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->completed);
+    pthread_cond_destroy(&q->released);
+    freemem(q->threads);
+    freemem(q->files);
+    freemem(q->state);
+    freemem(q->done);
+    freemem(q);
+}
@@ -0,0 +1,80 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Loading of many small files, with many reads in flight */
+#ifndef FILELOAD_H
+#define FILELOAD_H
+
+/* Datasets of many small files, such as audio and transcription files, or
+ * text articles, are read one file at a time with blocking calls; when the
+ * files are not in the page cache, most of the time is spent waiting for
+ * each read in turn. A file loader keeps up to depth files in flight: it
+ * opens and reads whole files into memory buffers, and returns them through
+ * a completion queue, in the order they complete. The caller processes each
+ * file as it completes, and releases it, which lets the loader start
+ * reading another one.
+ *
+ * On Linux the loader submits the opens and reads to an io_uring, and
+ * reaps them on the calling thread; elsewhere, or if io_uring is not
+ * available, or the environment variable MLINC_IO_URING is 0, a pool of
+ * depth threads reads the files with blocking calls.
+ */
+typedef struct fileload_s FILELOAD;
+
+#define FILELOAD_DEPTH 32 /* Default number of files in flight */
+
+/* A loaded file */
+typedef struct {
+    int index;          /* Index of the file in the list of names     */
+    const char* name;   /* Path of the file                           */
+    char* data;         /* Contents followed by '\0', NULL if failed  */
+    long size;          /* Size of the contents in bytes              */
+    int error;          /* errno of the failure, 0 if loaded          */
+} LOADEDFILE;
+
+/* Creates a file loader, and starts loading files.
+ *
+ * Parameters:
+ *   dir   - Directory of the files, prepended to their names (optional)
+ *   names - Names of the files to load
+ *   num   - Number of files
+ *   depth - Maximum number of files loaded and not yet released; if 0 or
+ *           less, FILELOAD_DEPTH
+ *
+ * Returns:
+ *   A pointer to the file loader.
+ *
+ * Notes:
+ *   Files are started in the order of names; names are copied.
+ */
+FILELOAD* fileload_create(const char* dir, char* const* names, int num,
+                          int depth);
+
+/* Returns the next file that completed loading, waiting for one if none
+ * has; returns NULL once all files were returned. A file that failed to
+ * load is returned with data NULL and error set.
+ */
+LOADEDFILE* fileload_next(FILELOAD* q);
+
+/* Returns file index, waiting until it completes loading. Callers whose
+ * results depend on the order of the files call it with consecutive
+ * indices, and still have the next files loading in the meantime.
+ *
+ * Notes:
+ *   A file is returned once, either by fileload_next() or by this
+ *   function; do not mix the two with the same loader.
+ */
+LOADEDFILE* fileload_get(FILELOAD* q, int index);
+
+/* Frees the contents of a returned file, and lets the loader start
+ * loading another file.
+ */
+void fileload_release(FILELOAD* q, LOADEDFILE* f);
+
+/* Returns the method the loader reads files with: "io_uring" or "threads" */
+const char* fileload_method(const FILELOAD* q);
+
+/* Waits for the files in flight, and frees the memory allocated by
+ * fileload_create(), including the contents of files not released.
+ */
+void fileload_free(FILELOAD* q);
+
+#endif
@@ -0,0 +1,133 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Products of a few vectors by a packed weights matrix */
+#include <stdio.h>
+#include "shapes.h"
+#include "tasksched.h"
+#include "gemv.h"
+
+/* Packs a dxM matrix in panels.
+ *
+ * Parameters:
+ *   p - Packed matrix, of gemv_packed_size(d,M) floats
+ *   y - Matrix dxM
+ *   d - Number of rows
+ *   M - Number of columns
+ */
+void gemv_pack(float* restrict p, const fArr2D restrict y_, int d, int M)
+{
+    typedef float (*ArrdM)[M]; const ArrdM y = (const ArrdM) y_;
+    for (int j0 = 0; j0 < M; j0 += GEMV_PANEL)
+        for (int k = 0; k < d; k++)
+            for (int j = j0; j < j0 + GEMV_PANEL; j++)
+                *p++ = (j < M) ? y[k][j] : 0.0; /* Last panel is padded */
+}
+
+/* A row of a panel, which the compiler keeps in vector registers. Panels
+ * are not aligned to its size, so it is aligned as a float.
+ */
+typedef float PANELROW __attribute__((vector_size(GEMV_PANEL * sizeof(float)),
+                                      aligned(sizeof(float))));
+
+/* Computes R rows of Q consecutive panels: r = x @ p, or r = r + x @ p if
+ * add is not zero, where r has stride M, and n of its columns are in the
+ * panels; x is Rxd. R and Q are constants, so the sums are kept in
+ * registers; the R * Q sums are independent, so their multiply-adds
+ * overlap.
+ */
+SHAPE_INLINE void gemv_block(float* restrict r, const float* restrict x,
+                             const float* restrict p, int R, int Q,
+                             int d, int M, int n, int add)
+{
+    PANELROW acc[GEMV_ROWS];
+    for (int i = 0; i < R; i++)
+        for (int q = 0; q < Q; q++) {
+            acc[i * Q + q] = (PANELROW) { 0 };
+            if (add)
+                for (int j = q * GEMV_PANEL; j < n && j < (q + 1) * GEMV_PANEL; j++)
+                    acc[i * Q + q][j % GEMV_PANEL] = r[(long) i * M + j];
+        }
+    for (int k = 0; k < d; k++)
+        for (int q = 0; q < Q; q++) {
+            const PANELROW pk = 
+                *(const PANELROW*) (p + ((long) q * d + k) * GEMV_PANEL);
+            for (int i = 0; i < R; i++)
+                acc[i * Q + q] += x[(long) i * d + k] * pk;
+        }
+    for (int i = 0; i < R; i++)
+        for (int j = 0; j < n; j++)
+            r[(long) i * M + j] = acc[i * Q + j / GEMV_PANEL][j % GEMV_PANEL];
+}
+
+typedef struct {
+    float* r;
+    const float* x;
+    const float* p;
+    int N, d, M;
+    int add;
+} GEMVARG;
+
+/* Computes the panels lo to hi - 1 of all the rows */
+static void gemv_panels(void* arg, int lo, int hi)
+{
+    const GEMVARG* a = (const GEMVARG*) arg;
+    const int N = a->N;
+    const int d = a->d;
+    const int M = a->M;
+    const int add = a->add;
+    /* A few rows compute several panels at a time */
+    const int Qmax = (N < GEMV_ROWS) ? GEMV_ROWS / N : 1;
+    for (int q = lo; q < hi; q += Qmax) {
+        const int Q = (hi - q < Qmax) ? hi - q : Qmax;
+        const int j0 = q * GEMV_PANEL;
+        const int n = (M - j0 < Q * GEMV_PANEL) ? M - j0 : Q * GEMV_PANEL;
+        const float* p = a->p + (long) q * d * GEMV_PANEL;
+        for (int i = 0; i < N; i += GEMV_ROWS) {
+            float* r = a->r + (long) i * M + j0;
+            const float* x = a->x + (long) i * d;
+            const int R = (N - i < GEMV_ROWS) ? N - i : GEMV_ROWS;
+            switch (R * GEMV_ROWS + Q) {
+                case 1 * GEMV_ROWS + 4: gemv_block(r,x,p,1,4,d,M,n,add); break;
+                case 1 * GEMV_ROWS + 3: gemv_block(r,x,p,1,3,d,M,n,add); break;
+                case 1 * GEMV_ROWS + 2: gemv_block(r,x,p,1,2,d,M,n,add); break;
+                case 2 * GEMV_ROWS + 2: gemv_block(r,x,p,2,2,d,M,n,add); break;
+                case 1 * GEMV_ROWS + 1: gemv_block(r,x,p,1,1,d,M,n,add); break;
+                case 2 * GEMV_ROWS + 1: gemv_block(r,x,p,2,1,d,M,n,add); break;
+                case 3 * GEMV_ROWS + 1: gemv_block(r,x,p,3,1,d,M,n,add); break;
+                default: gemv_block(r,x,p,GEMV_ROWS,1,d,M,n,add); break;
+            }
+        }
+    }
+}
+
+static void gemv_run(float* r, const float* x, const float* p,
+                     int N, int d, int M, int add)
+{
+    GEMVARG a = { r, x, p, N, d, M, add };
+    const int panels = (M + GEMV_PANEL - 1) / GEMV_PANEL;
+    const long work = (long) N * d * M;
+    if (work < GEMV_THREAD_MIN || sched_num_threads(sched_default()) < 2) {
+        gemv_panels(&a,0,panels);
+        return;
+    }
+    /* Ranges of panels of at least about 64K multiply-adds */
+    int grain = 1 + 65536 / ((long) N * d * GEMV_PANEL);
+    parallel_for(sched_default(),0,panels,grain,gemv_panels,&a);
+}
+
+/* Computes r = x @ y, where r is NxM, x is Nxd, and y is dxM, packed by
+ * gemv_pack().
+ */
+void gemv(fArr2D restrict r, const fArr2D restrict x,
+          const float* restrict p, int N, int d, int M)
+{
+    gemv_run((float*) r,(const float*) x,p,N,d,M,0);
+}
+
+/* Computes r = r + x @ y, where r is NxM, x is Nxd, and y is dxM, packed
+ * by gemv_pack().
+ */
+void addGemv(fArr2D restrict r, const fArr2D restrict x,
+             const float* restrict p, int N, int d, int M)
+{
+    gemv_run((float*) r,(const float*) x,p,N,d,M,1);
+}
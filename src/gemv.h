@@ -0,0 +1,68 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Products of a few vectors by a packed weights matrix */
+#ifndef GEMV_H
+#define GEMV_H
+#include "array.h"
+
+/* Streaming and interactive inference runs one, or a few, input vectors
+ * at a time, so x @ y, where x has a few rows and y is a weights matrix,
+ * is a matrix-vector product: each weight is used once per row of x, and
+ * the time is that of reading y from memory, not of the arithmetic.
+ *
+ * These kernels read y packed in panels of GEMV_PANEL columns; a panel is
+ * stored row after row, so it is read sequentially, while the sums of its
+ * columns, for up to GEMV_ROWS rows of x, are kept in registers. Products
+ * of at least GEMV_THREAD_MIN multiply-adds are split by panels (output
+ * columns) across the threads of the default scheduler (see tasksched.h).
+ *
+ * Sums are added in the same order as matmul() adds them, so results are
+ * the same, up to the rounding of multiply-adds the compiler may contract.
+ *
+ * Layers keep a packed copy of their weights, and use these kernels for
+ * batches of fewer than GEMV_MAX_ROWS rows; see dense_forward() and
+ * lstm_forward(). The limits can be set at build time, for example
+ *   make CFLAGS+='-DGEMV_MAX_ROWS=1'
+ * disables the packed kernels.
+ */
+#define GEMV_PANEL 16 /* Columns of a panel                            */
+#define GEMV_ROWS   4 /* Rows of x whose sums are kept in registers     */
+
+/* Batches of fewer rows use the packed kernels */
+#ifndef GEMV_MAX_ROWS
+#define GEMV_MAX_ROWS 8
+#endif
+
+/* Products of at least this many multiply-adds are split across threads */
+#ifndef GEMV_THREAD_MIN
+#define GEMV_THREAD_MIN 262144
+#endif
+
+/* Returns the number of floats of a packed dxM matrix */
+static inline long gemv_packed_size(int d, int M)
+{
+    return (long) (M + GEMV_PANEL - 1) / GEMV_PANEL * GEMV_PANEL * d;
+}
+
+/* Packs a dxM matrix in panels.
+ *
+ * Parameters:
+ *   p - Packed matrix, of gemv_packed_size(d,M) floats
+ *   y - Matrix dxM
+ *   d - Number of rows
+ *   M - Number of columns
+ */
+void gemv_pack(float* restrict p, const fArr2D restrict y, int d, int M);
+
+/* Computes r = x @ y, where r is NxM, x is Nxd, and y is dxM, packed by
+ * gemv_pack().
+ */
+void gemv(fArr2D restrict r, const fArr2D restrict x,
+          const float* restrict p, int N, int d, int M);
+
+/* Computes r = r + x @ y, where r is NxM, x is Nxd, and y is dxM, packed
+ * by gemv_pack().
+ */
+void addGemv(fArr2D restrict r, const fArr2D restrict x,
+             const float* restrict p, int N, int d, int M);
+
+#endif
@@ -4,6 +4,7 @@
 #include <stdlib.h>  /* calloc() free()             */
 #include <memory.h>  /* memcpy() memmove() memset() */
 #include <strings.h> /* strcmp()                    */
+#include <pthread.h>
 #include "float.h"
 #include "mem.h"
 
@@ -34,3 +35,123 @@ void* allocmem_int(size_t M, size_t N, int S, char* typ,
     return p;
 }
 
+
+/* The scratch arena is a list of blocks (chunks) of memory; memory is
+ * handed out from the current chunk, and when it does not fit, from the
+ * next chunk, which is allocated, twice the size of the current, if
+ * there is none. Released chunks remain in the list, to be used again.
+ */
+#define SCRATCH_ALIGN       64
+#define SCRATCH_MIN_CHUNK   (256 * 1024)
+
+typedef struct scratch_chunk_s {
+    struct scratch_chunk_s* next; /* Next (larger) chunk, or NULL     */
+    size_t size;                  /* Bytes in data                    */
+    size_t used;                  /* Bytes handed out                 */
+    char* data;                   /* Memory, aligned to SCRATCH_ALIGN */
+} SCRATCH_CHUNK;
+
+typedef struct {
+    SCRATCH_CHUNK* first;         /* First chunk of the list          */
+    SCRATCH_CHUNK* cur;           /* Chunk memory is handed out from  */
+    size_t heap_bytes;            /* Bytes allocated from the heap    */
+} SCRATCH;
+
+static __thread SCRATCH scratch;
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+/* Frees the chunks of an exiting thread */
+static void scratch_destroy(void* arg)
+{
+    SCRATCH* a = (SCRATCH*) arg;
+    SCRATCH_CHUNK* c = a->first;
+    while (c != NULL) {
+        SCRATCH_CHUNK* next = c->next;
+        free(c);
+        c = next;
+    }
+    a->first = a->cur = NULL;
+}
+
+static void scratch_key_create(void)
+{
+    pthread_key_create(&scratch_key,scratch_destroy);
+}
+
+static SCRATCH_CHUNK* scratch_chunk(size_t size, const char* func, 
+                                    char* file, int line)
+{
+    SCRATCH_CHUNK* c = malloc(sizeof(SCRATCH_CHUNK) + size + SCRATCH_ALIGN);
+    if (c == NULL) {
+        fflush(stdout);
+        fprintf(stderr,"\nIn function '%s': "
+                "out of memory at file '%s' line %d\n",func,file,line);
+        exit(-1);
+    }
+    c->next = NULL;
+    c->size = size;
+    c->used = 0;
+    size_t p = (size_t) (c + 1);
+    c->data = (char*) ((p + SCRATCH_ALIGN - 1) & ~(size_t) (SCRATCH_ALIGN - 1));
+    scratch.heap_bytes += size;
+    if (scratch.first == NULL) { /* First chunk of this thread */
+        pthread_once(&scratch_once,scratch_key_create);
+        pthread_setspecific(scratch_key,&scratch);
+    }
+    return c;
+}
+
+void* scratchmem_int(size_t M, size_t N, int S,
+                                       const char* func, char* file, int line)
+{
+    size_t n = (M * N * S + SCRATCH_ALIGN - 1) & ~(size_t) (SCRATCH_ALIGN - 1);
+    SCRATCH_CHUNK* c = scratch.cur;
+    if (c == NULL) {
+        if (scratch.first == NULL) {
+            size_t size = (n > SCRATCH_MIN_CHUNK) ? n : SCRATCH_MIN_CHUNK;
+            scratch.first = scratch_chunk(size,func,file,line);
+        }
+        c = scratch.cur = scratch.first;
+    }
+    while (c->used + n > c->size) {
+        if (c->next == NULL) {
+            size_t size = 2 * c->size;
+            while (size < n)
+                size *= 2;
+            c->next = scratch_chunk(size,func,file,line);
+        }
+        c = c->next;
+        c->used = 0;
+    }
+    scratch.cur = c;
+    void* p = c->data + c->used;
+    c->used += n;
+    return p;
+}
+
+SCRATCH_MARK scratch_mark(void)
+{
+    SCRATCH_MARK mark;
+    mark.chunk = scratch.cur;
+    mark.used = (scratch.cur != NULL) ? scratch.cur->used : 0;
+    return mark;
+}
+
+void scratch_release(SCRATCH_MARK mark)
+{
+    SCRATCH_CHUNK* c = (SCRATCH_CHUNK*) mark.chunk;
+    if (c == NULL) { /* Nothing was handed out at the mark */
+        if (scratch.first != NULL)
+            scratch.first->used = 0;
+        scratch.cur = scratch.first;
+        return;
+    }
+    c->used = mark.used;
+    scratch.cur = c;
+}
+
+size_t scratch_heap_bytes(void)
+{
+    return scratch.heap_bytes;
+}
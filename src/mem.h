@@ -45,4 +45,69 @@ void* allocmem_int(size_t M, size_t N, int S, char* typ,
  */
 inline static void freemem(void *p) { if (p != NULL) free(p); }
 
+/* Scratch memory
+ *
+ * Temporary arrays that a function needs only while it runs are taken from
+ * a per-thread scratch arena, rather than from the heap or the stack. The
+ * arena hands out memory by advancing a pointer, and takes all of it back
+ * at once:
+ *
+ *   SCRATCH_MARK mark = scratch_mark();
+ *   float* tmp = scratchmem(N,D,float);
+ *   ...
+ *   scratch_release(mark);
+ *
+ * Memory the arena gets from the heap is kept for later calls, so after
+ * the first calls of a function, its temporary arrays are not allocated
+ * again. Each thread has its own arena, freed when the thread exits.
+ */
+typedef struct {
+    void* chunk;  /* Block of memory of the arena at the mark */
+    size_t used;  /* Bytes used in that block                 */
+} SCRATCH_MARK;
+
+void* scratchmem_int(size_t M, size_t N, int S,
+                                       const char* func, char* file, int line);
+
+/* Returns the position of the calling thread's scratch arena, to be passed
+ * to scratch_release().
+ */
+SCRATCH_MARK scratch_mark(void);
+
+/* Takes back the memory of the calling thread's scratch arena that was
+ * handed out after mark was returned by scratch_mark().
+ *
+ * Parameters:
+ *   mark : Position returned by scratch_mark()
+ *
+ * Notice:
+ *   Marks must be released in the reverse order they were taken.
+ */
+void scratch_release(SCRATCH_MARK mark);
+
+/* Returns scratch memory for an array of MxN elements of type T, aligned
+ * to 64 bytes, from the calling thread's scratch arena.
+ *
+ * Parameters:
+ *   M : Number of rows in the array.
+ *   N : Number of columns in the array.
+ *   T : Type of the elements in the array (e.g., int, float, double, char).
+ *
+ * Returns:
+ *   A pointer to the memory, which is valid until scratch_release() is
+ *   called with a mark taken before this call. If memory allocation fails,
+ *   the function prints an error message and terminates the program.
+ *
+ * Notice:
+ *   Unlike allocmem(), the memory is not initialized.
+ */
+#define scratchmem(M,N,T) \
+                  scratchmem_int(M,N,sizeof(T),__FUNCTION__,__FILE__,__LINE__)
+
+/* Returns the number of bytes the calling thread's scratch arena got from
+ * the heap since the thread started; it does not change once the temporary
+ * arrays of every function the thread runs fit in the arena.
+ */
+size_t scratch_heap_bytes(void);
+
 #endif
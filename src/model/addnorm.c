@@ -24,7 +24,7 @@ ADDNORM* addnorm_create()
  *
  * Parameters:
  *   input_dim  - D, dimension of each input vector
- *   batch_size - B, number of input vectors
+ *   batch_size - B, maximum number of input vectors
  *
  * Note:
  *   Initialises gamma=1, beta=0 (identity transform).
@@ -32,6 +32,7 @@ ADDNORM* addnorm_create()
 void addnorm_init(ADDNORM* l, int input_dim, int batch_size)
 {
     l->B    = batch_size;
+    l->Bmax = batch_size;
     l->D    = input_dim;
     l->mean  = allocmem(batch_size, 1, float);
     l->sdev  = allocmem(batch_size, 1, float);
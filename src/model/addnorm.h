@@ -2,11 +2,14 @@
 /* Layer normalization data structure and functions */
 #ifndef ADDNORM_H
 #define ADDNORM_H
+#include <stdio.h>
+#include <stdlib.h>
 #include "float.h"
 #include "array.h"
 
 typedef struct lnorm_s {
   int B;           /* Number of input vectors   */
+  int Bmax;        /* Maximum value of B        */
   int D;           /* Input vector dimension    */
   fVec mean;       /* Calculated from input [B] */
   fVec sdev;       /* Calculated from input [B] */
@@ -31,13 +34,30 @@ ADDNORM* addnorm_create();
  *
  * Parameters:
  *   input_dim  - D, dimension of each input vector
- *   batch_size - B, number of input vectors
+ *   batch_size - B, maximum number of input vectors
  *
  * Note:
  *   Initialises gamma=1, beta=0 (identity transform).
  */
 void addnorm_init(ADDNORM* l, int input_dim, int batch_size);
 
+/* Sets the number of input vectors processed by the next forward and
+ * backward passes, without reallocating memory.
+ *
+ * Parameters:
+ *   batch_size - B, number of input vectors, between 1 and l->Bmax
+ */
+static inline void addnorm_set_shape(ADDNORM* l, int batch_size)
+{
+    if (batch_size < 1 || batch_size > l->Bmax) {
+        fflush(stdout);
+        fprintf(stderr,"addnorm_set_shape: batch size %d out of range "
+                "1..%d\n",batch_size,l->Bmax);
+        exit(-1);
+    }
+    l->B = batch_size;
+}
+
 /* Frees the memory allocated by addnorm_create() / addnorm_init()
  *
  * Parameters:
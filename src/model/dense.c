@@ -43,7 +43,7 @@ DENSE* dense_create(int units, char* activation)
 /* Initializes a feed forward neural network created by dense_create().
  *
  *   input_dim  - Size of input vectors (must include bias dimension)
- *   batch_size - Number of input vectors processed simultaneously
+ *   batch_size - Maximum number of input vectors processed simultaneously
  *
  * Notes:
  *   - The layer's weights are initialized using glorot normal distribution 
@@ -52,6 +52,7 @@ void dense_init(DENSE* l, int input_dim, int batch_size)
 {
     l->D = input_dim;
     l->B = batch_size;
+    l->Bmax = batch_size;
     l->Wx = allocmem(l->D,l->S,float);
     l->h = allocmem(l->B,l->S,float);
     if (l->activation == 'g')
@@ -72,14 +73,17 @@ void dense_init(DENSE* l, int input_dim, int batch_size)
  *
  * Notes:
  *   If this function is called before dense_init(), it does nothing.
- *   Otherwise, the network's hidden state is resized and re-initialized
+ *   If batch_size does not exceed the batch size the network was 
+ *   initialized with, the existing hidden state buffer is reused. 
+ *   Otherwise, it is resized and re-initialized.
  */
 void dense_set_batch_size(DENSE* l, int batch_size)
 {
     if (l->B == 0)
         return;
-    if (batch_size != l->B) {
+    if (batch_size > l->Bmax) {
         l->B = batch_size;
+        l->Bmax = batch_size;
         freemem(l->h);
         l->h = allocmem(l->B,l->S,float);
         if (l->activation == 'g') {
@@ -87,8 +91,10 @@ void dense_set_batch_size(DENSE* l, int batch_size)
             l->z = allocmem(l->B,l->S,float);
         }
     }
-    else
+    else {
+        l->B = batch_size;
         fltclr(l->h,l->B * l->S);
+    }
 }
 
 /* Frees the memory allocated by dense_create() / dense_init()
@@ -102,6 +108,7 @@ void dense_free(DENSE* l)
     if (l->activation == 'g')
         freemem(l->z);
     freemem(l->Wx);
+    freemem(l->Wp);
     freemem(l);
 }
 
@@ -115,3 +122,22 @@ void dense_reset(DENSE* l)
     (void) l; /* Do nothing */
 }
 
+/* Packs the weights for the small batch kernels (see gemv.h), and marks
+ * them up to date.
+ *
+ * Parameters:
+ *   l - Pointer to the DENSE neural network layer
+ *
+ * Notes:
+ *   dense_forward() calls this function when it runs a small batch and
+ *   l->packed is 0. Code that changes l->Wx must set l->packed to 0;
+ *   layer_update() does.
+ */
+void dense_pack(DENSE* l)
+{
+    if (l->Wp == NULL)
+        l->Wp = allocmem(1,gemv_packed_size(l->D,l->S),float);
+    gemv_pack(l->Wp,l->Wx,l->D,l->S);
+    l->packed = 1;
+}
+
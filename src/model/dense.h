@@ -2,17 +2,26 @@
 /* Dense (feed forward) neural network layer data structures and functions */
 #ifndef DENSE_H
 #define DENSE_H
+#include <stdio.h>
+#include <stdlib.h>
 #include "array.h"
+#include "shapes.h"
+#include "autotune.h"
+#include "gemv.h"
 #include "activation.h"
 
 typedef struct dense_s {
   int D;           /* Input vector dimension (including bias)  */
   int S;           /* Number of units, size of hidden state    */
-  int B;           /* Number of input vectors in a batch       */
+  int B;           /* Number of input vectors in current batch */
+  int Bmax;        /* Maximum number of input vectors in batch */
   char activation; /* n,s,r,g,S (see below)                    */
   fArr2D h;        /* Hidden State matrix [B][S]               */
   fArr2D Wx;       /* Weights matrix [D][S]                    */
   fArr2D z;        /* Pre-activation values of h (gelu only)   */
+  int kernel;      /* Matrix product kernel (see autotune.h)   */
+  float* Wp;       /* Wx packed for small batches (see gemv.h) */
+  int packed;      /* Wp is up to date; 0 after Wx changes     */
 } DENSE;
 
 /* Creates a feed forward neural network.
@@ -36,7 +45,7 @@ DENSE* dense_create(int units, char* activation);
  *
  * Parameters:
  *   input_dim  - Size of input vectors (must include bias dimension)
- *   batch_size - Number of input vectors processed simultaneously
+ *   batch_size - Maximum number of input vectors processed simultaneously
  *
  * Notes:
  *   The network's weights are initialized using glorot normal distribution 
@@ -50,7 +59,9 @@ void dense_init(DENSE* l, int input_dim, int batch_size);
  *
  * Notes:
  *   If this function is called before dense_init(), it does nothing.
- *   Otherwise, the network's hidden state is resized and re-initialized
+ *   If batch_size does not exceed the batch size the network was 
+ *   initialized with, the existing hidden state buffer is reused. 
+ *   Otherwise, it is resized and re-initialized.
  */
 void dense_set_batch_size(DENSE* l, int batch_size);
 
@@ -68,6 +79,58 @@ void dense_free(DENSE* l);
  */
 void dense_reset(DENSE* l);
 
+/* Packs the weights for the small batch kernels (see gemv.h), and marks
+ * them up to date.
+ *
+ * Parameters:
+ *   l - Pointer to the DENSE neural network layer
+ *
+ * Notes:
+ *   dense_forward() calls this function when it runs a small batch and
+ *   l->packed is 0. Code that changes l->Wx must set l->packed to 0;
+ *   layer_update() does.
+ */
+void dense_pack(DENSE* l);
+
+/* Sets the number of input vectors processed by the next forward and
+ * backward passes, without reallocating memory; the passes use the 
+ * first batch_size rows of the buffers allocated by dense_init().
+ *
+ * Parameters:
+ *   batch_size - Number of input vectors, between 1 and l->Bmax
+ */
+static inline void dense_set_shape(DENSE* l, int batch_size)
+{
+    if (batch_size < 1 || batch_size > l->Bmax) {
+        fflush(stdout);
+        fprintf(stderr,"dense_set_shape: batch size %d out of range 1..%d\n",
+                batch_size,l->Bmax);
+        exit(-1);
+    }
+    l->B = batch_size;
+}
+
+/* Computes h = X @ Wx of dense_forward(), below, with input dimension D,
+ * which may be a constant (see shapes.h).
+ */
+SHAPE_INLINE void dense_matmul(DENSE* restrict l, 
+                               const fArr2D restrict X_/*[B][D]*/, int D)
+{
+    const int B = l->B;
+    const int S = l->S;
+    typedef float (*ArrBS)[S];
+    typedef float (*ArrBD)[D];
+    typedef float (*ArrDS)[S];
+    ArrBS h = (ArrBS) l->h;
+    const ArrBD X = (const ArrBD) X_;
+    const ArrDS Wx = (const ArrDS) l->Wx;
+    fltclr(h,B * S);
+    for (int i = 0; i < B; i++)
+        for (int k = 0; k < D; k++)
+            for (int j = 0; j < S; j++)
+                h[i][j] += X[i][k] * Wx[k][j];
+}
+
 /* Performs dense layer training/prediction's forward pass.
  *
  * Parameters:
@@ -80,13 +143,27 @@ void dense_reset(DENSE* l);
  * 
  * Note that in a multi-layered neural network, after the first layer
  * X is the (activated) output of a previous layer.
+ *
+ * The product X @ Wx is computed by the kernel l->kernel, which
+ * model_tune() sets to the fastest for the layer's shape. Batches of fewer
+ * than GEMV_MAX_ROWS vectors use the packed weights l->Wp instead.
  */
 static inline fArr2D dense_forward(DENSE* restrict l, 
                                    const fArr2D restrict X/*[B][D]*/, int lyr)
 {
     (void) lyr;
     /* h = X @ Wx */
-    matmul(l->h,X,l->Wx,l->B,l->D,l->S);
+    const int D = l->D;
+    if (l->B < GEMV_MAX_ROWS) {
+        if (!l->packed)
+            dense_pack(l);
+        gemv(l->h,X,l->Wp,l->B,D,l->S);
+    }
+    else
+    if (l->kernel == KERNEL_NAIVE)
+        SHAPE_SPECIALIZE(DENSE_INPUT_SHAPES,D,dense_matmul(l,X,D));
+    else
+        matmul_kernel(l->kernel,l->h,X,l->Wx,l->B,D,l->S);
     switch (l->activation) {
         case 's' : sigmoid(l->h,l->B,l->S); break;
         case 'r' : relu(l->h,l->B,l->S); break;
@@ -46,6 +46,8 @@ void embedding_init(EMBEDDING* l, int vocab_size, int batch_size)
     l->B = batch_size;
     l->h = allocmem(l->B,l->E,float);
     l->Wx = allocmem(l->D,l->E,float);
+    l->seen = allocmem(l->D,1,int);
+    l->stamp = 0;
     typedef float (*ArrDE)[l->E];
     ArrDE Wx = (ArrDE) l->Wx;
 
@@ -66,6 +68,7 @@ void embedding_free(EMBEDDING* l)
 {
     freemem(l->h);
     freemem(l->Wx);
+    freemem(l->seen);
     freemem(l);
 }
 
@@ -2,6 +2,8 @@
 /* Embedding neural network layer data structures and functions */
 #ifndef EMBEDDING_H
 #define EMBEDDING_H
+#include <string.h>
+#include <limits.h>
 #include "array.h"
 
 typedef struct embedding_s {
@@ -12,8 +14,16 @@ typedef struct embedding_s {
   int padinx;  /* Pad index, -1 if not used  */
   fArr2D h;    /* Hidden State matrix [B][E] */
   fArr2D Wx;   /* Weights matrix [D][E]      */
+  int* seen;   /* Per-row batch stamp [D], for first-touch detection */
+  int stamp;   /* Current batch stamp                                */
 } EMBEDDING;
 
+/* Width, in floats, of the vectors embedding_bag_sum() adds at once */
+#define EMBD_LANES 8
+
+typedef float EMBDVEC __attribute__((vector_size(EMBD_LANES * sizeof(float)),
+                                      aligned(sizeof(float))));
+
 /* Creates an embedding layer.
  *
  * Parameters:
@@ -60,57 +70,116 @@ void embedding_reset(EMBEDDING* l);
 /* Prepares gradients row for update.
  *
  * Parameters:
- *   gWx  - gradient array [M][N]
- *   N    - number of elemens in each gradient row
- *   inx  - index of the row to be updated 0 <= 0 < M
+ *   l    - Pointer to the embedding layer's data
+ *   gWx  - gradient array [D][E]
+ *   inx  - index of the row to be updated 0 <= inx < D
  *   rows - array that stores the indices of the affected rows
  *   cnt  - points to the count of affected rows (updated in place)
- *   cnt  - points to a count of updated rows (output)
  *
- * On first update initializes the row zero, and records its index in rows.
- * On subsequent updates, skips rows that already have bee initialized.
+ * On first update in the current batch (detected via the per-row stamp)
+ * zeroes the row, and records its index in rows. Subsequent updates in the
+ * same batch do nothing, so gradients accumulate correctly.
  */
-static inline void prep_row(fArr2D gWx_, int N, int inx, int* rows, int* cnt)
+static inline void prep_row(EMBEDDING* l, fArr2D gWx_, int inx,
+                            int* rows, int* cnt)
 {
-    for (int r = 0; r < *cnt; r++)
-        if (rows[r] == inx)
-            return;
-    typedef float (*ArrMN)[N];
-    ArrMN gWx = (ArrMN) gWx_;
-    fltclr(gWx[inx],N);
+    if (l->seen[inx] == l->stamp)
+        return;
+    l->seen[inx] = l->stamp;
+    typedef float (*ArrDE)[l->E];
+    ArrDE gWx = (ArrDE) gWx_;
+    fltclr(gWx[inx],l->E);
     rows[(*cnt)++] = inx;
 }
 
+/* Sums the embedding vectors of a context's tokens.
+ *
+ * Parameters:
+ *   Wx     - Weights matrix [D][E]
+ *   E      - Embedding dimension
+ *   x      - Token indices of the context [M]
+ *   M      - Context length
+ *   padinx - Pad index, -1 if not used
+ *   h      - Receives the sum of the vectors [E] (output)
+ *
+ * Pad tokens are skipped. The context's rows are looked up once, then
+ * summed 4 * EMBD_LANES elements at a time in registers, and stored once.
+ */
+static inline void embedding_bag_sum(const float* restrict Wx, int E,
+                                     const int* restrict x, int M, int padinx,
+                                     float* restrict h)
+{
+    const float* rows[M];
+    int n = 0;
+    for (int j = 0; j < M; j++)
+        if (x[j] != padinx)
+            rows[n++] = Wx + (long) x[j] * E;
+    int k = 0;
+    for (; k + 4 * EMBD_LANES <= E; k += 4 * EMBD_LANES) {
+        EMBDVEC a0 = { 0 }, a1 = { 0 }, a2 = { 0 }, a3 = { 0 };
+        for (int r = 0; r < n; r++) {
+            const EMBDVEC* v = (const EMBDVEC*) (rows[r] + k);
+            a0 += v[0];
+            a1 += v[1];
+            a2 += v[2];
+            a3 += v[3];
+        }
+        EMBDVEC* y = (EMBDVEC*) (h + k);
+        y[0] = a0;
+        y[1] = a1;
+        y[2] = a2;
+        y[3] = a3;
+    }
+    for (; k + EMBD_LANES <= E; k += EMBD_LANES) {
+        EMBDVEC a = { 0 };
+        for (int r = 0; r < n; r++)
+            a += *(const EMBDVEC*) (rows[r] + k);
+        *(EMBDVEC*) (h + k) = a;
+    }
+    for (; k < E; k++) {
+        float a = 0;
+        for (int r = 0; r < n; r++)
+            a += rows[r][k];
+        h[k] = a;
+    }
+}
+
+/* Adds vector y [E] to vector g [E] */
+static inline void embedding_row_add(float* restrict g,
+                                     const float* restrict y, int E)
+{
+    int k = 0;
+    for (; k + EMBD_LANES <= E; k += EMBD_LANES)
+        *(EMBDVEC*) (g + k) += *(const EMBDVEC*) (y + k);
+    for (; k < E; k++)
+        g[k] += y[k];
+}
+
 /* Performs embedding layer training/prediction's forward pass.
  *
  * Parameters:
  *   l   - Pointer to the embedding layer's data
- *   X   - An array of input indices representing one hot encoded vectors
+ *   X   - An array of input token indices [B][M]
  *   lyr - The ordinal number of this layer in a model (not used)
  *
  * Returns:
  *   Pointer to the predicted values, h[B][E]
  *
- * Note that in a multi-layered neural network, after the first layer
- * X is the output of a previous layer.
+ * Pad tokens contribute nothing to the output.
  */
 static inline fArr2D embedding_forward(EMBEDDING* restrict l,
-                                       fArr2D restrict X_/*[B][M]*/, int lyr)
+                                       const iArr2D restrict X_/*[B][M]*/,
+                                       int lyr)
 {
     (void) lyr;
-    typedef float (*ArrBM)[l->M];
+    typedef int (*ArrBM)[l->M];
     typedef float (*ArrBE)[l->E];
-    typedef float (*ArrDE)[l->E];
     ArrBM X = (ArrBM) X_;
     ArrBE h = (ArrBE) l->h;
-    ArrDE Wx = (ArrDE) l->Wx;
     /* X[B][M] => x[B][M][D] where x[B][M] is one-hot encoded */
     /* h = x @ Wx  => sum context vectors */
-    fltclr(h,l->B * l->E);
     for (int i = 0; i < l->B; i++)
-        for (int j = 0; j < l->M; j++)
-            for (int k = 0; k <l->E; k++)
-                h[i][k] += Wx[(int)X[i][j]][k];
+        embedding_bag_sum((const float*) l->Wx,l->E,X[i],l->M,l->padinx,h[i]);
     return l->h;
 }
 
@@ -119,7 +188,7 @@ static inline fArr2D embedding_forward(EMBEDDING* restrict l,
  * Parameters:
  *   l     - Pointer to the embedding layer's data
  *   dy    - The output vector gradient of embedding_create's units dimension
- *   X     - An array of input indices representing one hot encoded vectors
+ *   X     - An array of input token indices [B][M]
  *   gWx   - Gradient array (with respect to X)
  *   grows - If not NULL, points to an integer array of size B*M
  *   grcnt - If not NULL, points to an integer count of entries in grows
@@ -131,15 +200,16 @@ static inline fArr2D embedding_forward(EMBEDDING* restrict l,
  * If grows is not NULL, gWx is not fully cleared; instead each context row
  * is zeroed on first use and its index stored in grows[] with the count of
  * such rows returned in *grcnt. The caller then updates only those rows.
+ * First use is tracked with a per-row stamp, so each touch costs O(1).
  */
 static inline void embedding_backward(EMBEDDING* restrict l,
                                   const fArr2D restrict dy_/*[B][E]*/,
-                                  const fArr2D restrict X_/*[B][M]*/,
+                                  const iArr2D restrict X_/*[B][M]*/,
                                   fArr2D restrict gWx_/*[D][E]*/,
                                   int* grows, int* grcnt, int lyr)
 {
     (void) lyr;
-    typedef float (*ArrBM)[l->M];
+    typedef int (*ArrBM)[l->M];
     typedef float (*ArrBE)[l->E];
     typedef float (*ArrDE)[l->E];
     ArrBE dy = (ArrBE) dy_;
@@ -150,18 +220,26 @@ static inline void embedding_backward(EMBEDDING* restrict l,
     /* Gradient with respect to weights: gWx = x.T @ dy                     */
     /* Only context rows receive gradients. If grows != NULL, zero each     */
     /* such row on first use and record it (sparse); else clear all of gWx. */
-    if (grows != NULL && grcnt != NULL)
+    int sparse = (grows != NULL && grcnt != NULL);
+    if (sparse) {
+        /* New batch: bump the stamp so prep_row() re-zeroes rows on first
+         * touch; on wrap around, forget all stamps. */
+        if (l->stamp == INT_MAX) {
+            memset(l->seen,0,l->D * sizeof(int));
+            l->stamp = 0;
+        }
+        l->stamp++;
         *grcnt = 0;
+    }
     else
         fltclr(gWx,l->D * l->E);
     for (int i = 0; i < l->B; i++) {
         for (int j = 0; j < l->M; j++) {
-            int xij = (int) X[i][j];
+            int xij = X[i][j];
             if (xij != l->padinx) {
-                if (grows != NULL && grcnt != NULL)
-                    prep_row(gWx_,l->E,xij,grows,grcnt);
-                for (int k = 0; k < l->E; k++)
-                    gWx[xij][k] += dy[i][k];
+                if (sparse)
+                    prep_row(l,gWx_,xij,grows,grcnt);
+                embedding_row_add(gWx[xij],dy[i],l->E);
             }
         }
     }
@@ -0,0 +1,188 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* GRU (recurrent) neural network functions */
+/* References:
+ * https://en.wikipedia.org/wiki/Gated_recurrent_unit
+ * https://arxiv.org/abs/1406.1078
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "mem.h"
+#include "random.h"
+#include "array.h"
+#include "qr.h"
+#include "gru.h"
+
+/* Creates a gated recurrent unit (GRU) neural network.
+ *
+ * Parameters:
+ *   units      - Number of units (hidden size)
+ *   stateful   - If not zero, maintain state across batches.
+ *
+ * Returns:
+ *   Pointer to a GRU neural network layer.
+ *
+ * Notes:
+ *   - The neural network needs to be further initialized using gru_init()
+ *     before it can be used.
+ */
+GRU* gru_create(int units, int stateful)
+{
+    GRU* l = allocmem(1,1,GRU);
+    l->S = units;
+    l->stateful = stateful ? 1 : 0;
+    return l;
+}
+
+/* Initializes a GRU neural network created by gru_create().
+ *
+ * Parameters:
+ *   input_dim  - Size of input vectors (must include bias dimension)
+ *   batch_size - Maximum number of input vectors processed simultaneously
+ *
+ * Notes:
+ *   - Kernel weights (Wx) are initialized using Glorot normal distribution.
+ *   - Recurrent weights (Ux) are initialized using orthogonal uniform
+ *     distribution.
+ */
+void gru_init(GRU* l, int input_dim, int batch_size)
+{
+    l->D = input_dim;
+    l->B = batch_size;
+    l->Bmax = batch_size;
+    l->z = allocmem(l->B,l->S,float);
+    l->r = allocmem(l->B,l->S,float);
+    l->hc = allocmem(l->B,l->S,float);
+    l->h = allocmem(l->B + 1,l->S,float);
+    l->Wz = allocmem(l->D,l->S,float);
+    l->Wr = allocmem(l->D,l->S,float);
+    l->Wh = allocmem(l->D,l->S,float);
+    l->Uz = allocmem(l->S,l->S,float);
+    l->Ur = allocmem(l->S,l->S,float);
+    l->Uh = allocmem(l->S,l->S,float);
+    l->ph = allocmem(1,l->S,float);
+
+    fArr2D W[3] = { l->Wz, l->Wr, l->Wh };
+    float scale = sqrt(2.0 / (l->D + l->S));
+    for (int n = 0; n < 3; n++) {
+        float* w = (float*) W[n];
+        for (long i = 0; i < (long) l->D * l->S; i++)
+            w[i] = nrand(0.0,scale);
+    }
+    fArr2D U[3] = { l->Uz, l->Ur, l->Uh };
+    scale = sqrt(6.0 / ((float) (l->S * 2)));
+    for (int n = 0; n < 3; n++) {
+        float* u = (float*) U[n];
+        for (long i = 0; i < (long) l->S * l->S; i++)
+            u[i] = urand(-scale,scale);
+        QR(U[n],NULL,NULL,l->S,l->S);
+    }
+}
+
+/* Sets a new batch size.
+ *
+ * Parameters:
+ *   batch_size - Number of input vectors processed simultaneously
+ *
+ * Notes:
+ *   If this function is called before gru_init(), it does nothing.
+ *   If batch_size does not exceed the batch size the network was
+ *   initialized with, the existing state buffers are reused.
+ *   Otherwise, they are resized and re-initialized.
+ */
+void gru_set_batch_size(GRU* l, int batch_size)
+{
+    if (l->B == 0)
+        return;
+    if (batch_size > l->Bmax) {
+        freemem(l->z);
+        freemem(l->r);
+        freemem(l->hc);
+        freemem(l->h);
+        l->B = batch_size;
+        l->Bmax = batch_size;
+        l->z = allocmem(l->B,l->S,float);
+        l->r = allocmem(l->B,l->S,float);
+        l->hc = allocmem(l->B,l->S,float);
+        l->h = allocmem(l->B + 1,l->S,float);
+    }
+    else {
+        l->B = batch_size;
+        fltclr(l->z,l->B * l->S);
+        fltclr(l->r,l->B * l->S);
+        fltclr(l->hc,l->B * l->S);
+        fltclr(l->h,(l->B + 1) * l->S);
+    }
+}
+
+/* Frees the memory allocated by gru_create() / gru_init().
+ *
+ * Parameters:
+ *   l - Pointer to the GRU neural network layer to be freed
+ */
+void gru_free(GRU* l)
+{
+    freemem(l->z);
+    freemem(l->r);
+    freemem(l->hc);
+    freemem(l->h);
+    freemem(l->Wz);
+    freemem(l->Wr);
+    freemem(l->Wh);
+    freemem(l->Uz);
+    freemem(l->Ur);
+    freemem(l->Uh);
+    freemem(l->ph);
+    freemem(l->Wp);
+    freemem(l);
+}
+
+/* Resets the GRU internal state.
+ *
+ * Parameters:
+ *   l - Pointer to the GRU neural network layer to be reset
+ */
+void gru_reset(GRU* l)
+{
+    fltclr(l->ph,l->S);
+}
+
+/* Packs the weights for the small batch kernels (see gemv.h), and marks
+ * them up to date.
+ *
+ * Parameters:
+ *   l - Pointer to the GRU neural network layer
+ *
+ * Notes:
+ *   gru_forward() calls this function when it runs a small batch and
+ *   l->packed is 0. Code that changes the weights must set l->packed to 0;
+ *   layer_update() does.
+ */
+void gru_pack(GRU* l)
+{
+    const int D = l->D;
+    const int S = l->S;
+    const long gates = gemv_packed_size(D + S,2 * S);
+    if (l->Wp == NULL)
+        l->Wp = allocmem(1,gates + gemv_packed_size(D + S,S),float);
+    SCRATCH_MARK mark = scratch_mark();
+    /* [Wz Wr; Uz Ur], (D+S)x2S */
+    typedef float (*ArrX2S)[2 * S];
+    ArrX2S w = (ArrX2S) scratchmem(D + S,2 * S,float);
+    for (int k = 0; k < D; k++) {
+        fltcpy(w[k],(float*) l->Wz + (long) k * S,S);
+        fltcpy(w[k] + S,(float*) l->Wr + (long) k * S,S);
+    }
+    for (int k = 0; k < S; k++) {
+        fltcpy(w[D + k],(float*) l->Uz + (long) k * S,S);
+        fltcpy(w[D + k] + S,(float*) l->Ur + (long) k * S,S);
+    }
+    gemv_pack(l->Wp,w,D + S,2 * S);
+    /* [Wh; Uh], (D+S)xS */
+    float* wh = (float*) w;
+    fltcpy(wh,l->Wh,D * S);
+    fltcpy(wh + (long) D * S,l->Uh,S * S);
+    gemv_pack(l->Wp + gates,(fArr2D) wh,D + S,S);
+    scratch_release(mark);
+    l->packed = 1;
+}
@@ -0,0 +1,397 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* GRU (recurrent) neural network layer data structures and functions */
+#ifndef GRU_H
+#define GRU_H
+#include <stdio.h>
+#include <stdlib.h>
+#include "mem.h"
+#include "array.h"
+#include "shapes.h"
+#include "gemv.h"
+#include "activation.h"
+#include "lstm.h"  /* lstm_gate() */
+
+/* A gated recurrent unit (GRU) layer has three gates and no cell state:
+ *   z[t]  = sigmoid(X[t] @ Wz + h[t-1] @ Uz)              update gate
+ *   r[t]  = sigmoid(X[t] @ Wr + h[t-1] @ Ur)              reset gate
+ *   hc[t] = tanh(X[t] @ Wh + (r[t] * h[t-1]) @ Uh)        candidate
+ *   h[t]  = (1 - z[t]) * h[t-1] + z[t] * hc[t]
+ * so a time step computes three products of the input and of the hidden
+ * state by the weights, where an LSTM computes four, and keeps three
+ * vectors per time step for the backward pass, where an LSTM keeps six.
+ */
+typedef struct gru_s {
+  int D;           /* Input vector dimension (including bias)       */
+  int S;           /* Number of units, size of hidden state         */
+  int B;           /* Number of input vectors in current batch      */
+  int Bmax;        /* Maximum number of input vectors in a batch    */
+  /* Note that B also is the sequence length (number of time steps) */
+  int stateful;    /* 1: maintain state between batches             */
+  /* Stateful mode preserves the final hidden state across forward
+   * passes only. Gradients do NOT propagate across sequences
+   * (i.e., truncated BPTT with truncation at sequence boundaries).
+   */
+  fArr2D Wz;       /* Weights matrix [D][S]                         */
+  fArr2D Wr;       /* Weights matrix [D][S]                         */
+  fArr2D Wh;       /* Weights matrix [D][S]                         */
+  fArr2D Uz;       /* Weights matrix [S][S]                         */
+  fArr2D Ur;       /* Weights matrix [S][S]                         */
+  fArr2D Uh;       /* Weights matrix [S][S]                         */
+  fArr2D z;        /* Update gate matrix [B][S]                     */
+  fArr2D r;        /* Reset gate matrix [B][S]                      */
+  fArr2D hc;       /* Hidden state candidate matrix [B][S]          */
+  fArr2D h;        /* Hidden state matrix [B+1][S]                  */
+  fVec ph;         /* Previous batch last hidden state vector [S]   */
+  float* Wp;       /* [Wz Wr; Uz Ur] then [Wh; Uh] packed (gemv.h)  */
+  int packed;      /* Wp is up to date; 0 after weights change      */
+} GRU;
+
+/* Creates a gated recurrent unit (GRU) neural network.
+ *
+ * Parameters:
+ *   units      - Number of units (hidden size)
+ *   stateful   - If not zero, maintain state across batches.
+ *
+ * Returns:
+ *   Pointer to a GRU neural network layer.
+ *
+ * Notes:
+ *   - The neural network needs to be further initialized using gru_init()
+ *     before it can be used.
+ */
+GRU* gru_create(int units, int stateful);
+
+/* Initializes a GRU neural network created by gru_create().
+ *
+ * Parameters:
+ *   input_dim  - Size of input vectors (must include bias dimension)
+ *   batch_size - Maximum number of input vectors processed simultaneously
+ *
+ * Notes:
+ *   - Kernel weights (Wx) are initialized using Glorot normal distribution.
+ *   - Recurrent weights (Ux) are initialized using orthogonal uniform
+ *     distribution.
+ */
+void gru_init(GRU* l, int input_dim, int batch_size);
+
+/* Sets a new batch size.
+ *
+ * Parameters:
+ *   batch_size - Number of input vectors processed simultaneously
+ *
+ * Notes:
+ *   If this function is called before gru_init(), it does nothing.
+ *   If batch_size does not exceed the batch size the network was
+ *   initialized with, the existing state buffers are reused.
+ *   Otherwise, they are resized and re-initialized.
+ */
+void gru_set_batch_size(GRU* l, int batch_size);
+
+/* Frees the memory allocated by gru_create() / gru_init().
+ *
+ * Parameters:
+ *   l - Pointer to the GRU neural network layer to be freed
+ */
+void gru_free(GRU* l);
+
+/* Resets the GRU internal state.
+ *
+ * Parameters:
+ *   l - Pointer to the GRU neural network layer to be reset
+ */
+void gru_reset(GRU* l);
+
+/* Packs the weights for the small batch kernels (see gemv.h), and marks
+ * them up to date.
+ *
+ * Parameters:
+ *   l - Pointer to the GRU neural network layer
+ *
+ * Notes:
+ *   gru_forward() calls this function when it runs a small batch and
+ *   l->packed is 0. Code that changes the weights must set l->packed to 0;
+ *   layer_update() does.
+ */
+void gru_pack(GRU* l);
+
+/* Sets the number of input vectors (time steps) processed by the next
+ * forward and backward passes, without reallocating memory; the passes
+ * use the first batch_size (+1) rows of the buffers allocated by
+ * gru_init().
+ *
+ * Parameters:
+ *   batch_size - Number of input vectors, between 1 and l->Bmax
+ */
+static inline void gru_set_shape(GRU* l, int batch_size)
+{
+    if (batch_size < 1 || batch_size > l->Bmax) {
+        fflush(stdout);
+        fprintf(stderr,"gru_set_shape: batch size %d out of range 1..%d\n",
+                batch_size,l->Bmax);
+        exit(-1);
+    }
+    l->B = batch_size;
+}
+
+/* Activates the gate vectors z, r of one time step, and sets rh to the
+ * previous hidden state ph reset by r.
+ */
+SHAPE_INLINE void gru_reset_gate(fVec restrict z, fVec restrict r,
+                                 fVec restrict rh, const fVec restrict ph,
+                                 int S)
+{
+    sigmoid((fArr2D) z,1,S);
+    sigmoid((fArr2D) r,1,S);
+    for (int j = 0; j < S; j++)
+        rh[j] = r[j] * ph[j];
+}
+
+/* Activates the candidate hc of one time step, and computes the hidden
+ * state h, given the previous hidden state ph.
+ */
+SHAPE_INLINE void gru_cell(const fVec restrict z, fVec restrict hc,
+                           fVec restrict h, const fVec restrict ph, int S)
+{
+    for (int j = 0; j < S; j++)
+        hc[j] = tanh(hc[j]);
+    /* h[t] = (1 - z[t]) * h[t-1] + z[t] * hc[t] */
+    for (int j = 0; j < S; j++)
+        h[j] = ph[j] + z[j] * (hc[j] - ph[j]);
+}
+
+/* Computes one time step of gru_forward(), below, given the input x, and
+ * the previous hidden state ph; rh is a vector of S floats. Gate vectors
+ * z, r, hc must be zeroed.
+ */
+SHAPE_INLINE void gru_step(GRU* restrict l, const fVec restrict x,
+                           fVec restrict z, fVec restrict r,
+                           fVec restrict hc, fVec restrict rh,
+                           fVec restrict h, const fVec restrict ph,
+                           int D, int S)
+{
+    /* z[t] = sigmoid(X[t] @ Wz + h[t-1] @ Uz) */
+    lstm_gate(z,x,l->Wz,ph,l->Uz,D,S);
+    /* r[t] = sigmoid(X[t] @ Wr + h[t-1] @ Ur) */
+    lstm_gate(r,x,l->Wr,ph,l->Ur,D,S);
+    gru_reset_gate(z,r,rh,ph,S);
+    /* hc[t] = tanh(X[t] @ Wh + (r[t] * h[t-1]) @ Uh) */
+    lstm_gate(hc,x,l->Wh,rh,l->Uh,D,S);
+    gru_cell(z,hc,h,ph,S);
+}
+
+/* Computes one time step of gru_forward(), as gru_step() does, with the
+ * packed weights: both gates in one product of the input and the previous
+ * hidden state, xh [D+S], into g [2][S]; then the candidate in a product
+ * of the input and the reset hidden state, which replaces it in xh.
+ */
+static inline void gru_step_packed(GRU* restrict l, const fVec restrict x,
+                                   fVec restrict xh, fVec restrict g,
+                                   fVec restrict z, fVec restrict r,
+                                   fVec restrict hc, fVec restrict h,
+                                   const fVec restrict ph, int D, int S)
+{
+    /* [z r] = [X[t] h[t-1]] @ [Wz Wr; Uz Ur] */
+    fltcpy(xh,x,D);
+    fltcpy(xh + D,ph,S);
+    gemv((fArr2D) g,(fArr2D) xh,l->Wp,1,D + S,2 * S);
+    fltcpy(z,g,S);
+    fltcpy(r,g + S,S);
+    gru_reset_gate(z,r,xh + D,ph,S);
+    /* hc = [X[t] r[t]*h[t-1]] @ [Wh; Uh] */
+    const float* Hp = l->Wp + gemv_packed_size(D + S,2 * S);
+    gemv((fArr2D) hc,(fArr2D) xh,Hp,1,D + S,S);
+    gru_cell(z,hc,h,ph,S);
+}
+
+/* Performs GRU layer training/prediction's forward pass.
+ *
+ * Parameters:
+ *   l   - Pointer to the GRU layer's data
+ *   X   - Array of input vectors BxD, where B is the number of
+ *         input vectors, and D is the number of features in each vector
+ *   lyr - Ordinal number of this layer in a model (not used)
+ *
+ * Returns:
+ *   Pointer to the predicted values.
+ *
+ * Note:
+ * - In a multi-layered neural network, after the first layer,
+ *   X is the (activated) output of a previous layer.
+ * - Batches of fewer than GEMV_MAX_ROWS time steps, as in streaming, use
+ *   the packed weights l->Wp.
+ */
+static inline fArr2D gru_forward(GRU* restrict l,
+                                 const fArr2D restrict X /*[B][D]*/, int lyr)
+{
+    (void) lyr;
+    const int D = l->D;
+    const int S = l->S;
+    const int B = l->B;
+    typedef float (*ArrTD)[D];
+    ArrTD x = (ArrTD) X;
+    /* Array h has B+1 rows; as in lstm_forward(), the pointer is advanced
+     * by +1 so that h[-1], the state before the first time step, refers
+     * to row 0 of the allocated buffer.
+     */
+    fltclr(l->z,B*S);
+    fltclr(l->r,B*S);
+    fltclr(l->hc,B*S);
+    fltclr(l->h,(B+1)*S);
+    typedef float (*ArrBS)[S];
+    ArrBS z = (ArrBS) l->z;
+    ArrBS r = (ArrBS) l->r;
+    ArrBS hc = (ArrBS) l->hc;
+    typedef float (*ArrB1S)[S];
+    ArrBS h = ((ArrB1S) l->h) + 1;   /* h[-1]  -> l->h[0]  */
+    /* Set state to value from previous batch
+     * ph - Vector 1xS containing the hidden state at the last time step
+     *      of the previous batch of data of this layer
+     */
+    if (l->stateful)
+        fltcpy(h[-1],l->ph,S);
+    else
+        fltclr(h[-1],S);
+
+    SCRATCH_MARK mark = scratch_mark();
+    if (B < GEMV_MAX_ROWS) {
+        if (!l->packed)
+            gru_pack(l);
+        float* xh = scratchmem(1,D + S,float);
+        float* g = scratchmem(2,S,float);
+        for (int t = 0; t < B; t++)
+            gru_step_packed(l,x[t],xh,g,z[t],r[t],hc[t],h[t],h[t-1],D,S);
+    }
+    else {
+        float* rh = scratchmem(1,S,float);
+        SHAPE_SPECIALIZE(LSTM_UNITS_SHAPES,S,
+            for (int t = 0; t < B; t++)
+                gru_step(l,x[t],z[t],r[t],hc[t],rh,h[t],h[t-1],D,S));
+    }
+    scratch_release(mark);
+    /* Save last time step hidden state for next batch of data */
+    fltcpy(l->ph,h[B-1],S);
+    return h;
+}
+
+/* Performs GRU layer training's backward pass.
+ *
+ * Parameters:
+ *   l    - Pointer to the GRU layer's data
+ *   dY   - Output vector gradient of gru_create's units dimension
+ *   X    - Array of input vectors BxD, where B is the number of input
+ *          vectors, and D is the number of features in each vector
+ *   g    - Array of 6 gradient matrices Wz Wr Wh Uz Ur Uh of the same
+ *          dimensions as their corresponding weight matrices
+ *   dX   - Output parameter for the input vector gradient (if not NULL)
+ *   lyr  - Ordinal number of this layer in a model (not used)
+ *
+ * Returns:
+ *   None
+ *
+ * Note:
+ *   - Calculates the weight matrices gradients with respect to the weights
+ *     and stores them in the matrices in g.
+ *   - Calculates the input vector gradient and returns it in dx, if dx is
+ *     not NULL
+ *   - When stateful is enabled, forward state is carried across calls,
+ *     but gradients do not propagate across sequence boundaries.
+ *   - In a multi-layered neural network, except the last layer, dy is the
+ *     gradient of the previous layer's input (dx), thus, the dimension of
+ *     dx (this layer's D) must equal the dimension of the previous layer's
+ *     dy (previous layer's S)
+ */
+static inline void gru_backward(GRU* restrict l,
+                                const fArr2D restrict dY/*[B][S]*/,
+                                const fArr2D restrict X/*[B][D]*/,
+                                fArr2D* g/*Gradient matrices*/,
+                                fArr2D restrict dX/*[B][D]*/,
+                                int lyr)
+{
+    (void) lyr;
+    const int D = l->D;
+    const int S = l->S;
+    const int B = l->B;
+    typedef float (*ArrBD)[D];
+    ArrBD x = (ArrBD) X;
+    ArrBD dx = (ArrBD) dX;
+    typedef float (*ArrBS)[S];
+    ArrBS dy = (ArrBS) dY;
+    /* Layer's state */
+    ArrBS z = (ArrBS) l->z;
+    ArrBS r = (ArrBS) l->r;
+    ArrBS hc = (ArrBS) l->hc;
+    typedef float (*ArrB1S)[S];
+    ArrBS h = ((ArrB1S) l->h) + 1;
+    /* Layer's gradients */
+    typedef float (*ArrDS)[S];
+    ArrDS gWz = (ArrDS) g[0];
+    ArrDS gWr = (ArrDS) g[1];
+    ArrDS gWh = (ArrDS) g[2];
+    for (int i = 0; i < 3; i++)
+        fltclr(g[i],D * S);
+    typedef float (*ArrS2)[S];
+    ArrS2 gUz = (ArrS2) g[3];
+    ArrS2 gUr = (ArrS2) g[4];
+    ArrS2 gUh = (ArrS2) g[5];
+    for (int i = 3; i < 6; i++)
+        fltclr(g[i],S * S);
+    /* Gradients of a time step, in the scratch arena */
+    SCRATCH_MARK mark = scratch_mark();
+    typedef float (*ArrGS)[S];
+    ArrGS grad = (ArrGS) scratchmem(7,S,float);
+    /* Future time step gradient */
+    float* dh_next = grad[0];
+    fltclr(dh_next,S);
+    /* Backward pass loop */
+    for (int t = B - 1; t >= 0; t--) {
+        /* dh = dy[t] + dh_next */
+        float* dh = grad[1];
+        for (int j = 0; j < S; j++)
+            dh[j] = dy[t][j] + dh_next[j];
+
+        /* Candidate gradient; hc[t] already is activated (i.e. tanh
+         * applied) in forward so instead of d_tanh use d_tanh_x
+         * dhc = dh * z[t] * tanh_x_derivative(hc[t])
+         */
+        float* dhc = grad[2];
+        for (int j = 0; j < S; j++)
+            dhc[j] = dh[j] * z[t][j] * d_tanh_x(hc[t][j]);
+        /* The reset hidden state, r[t] * h[t-1], is not kept by forward */
+        float* rh = grad[3];
+        for (int j = 0; j < S; j++)
+            rh[j] = r[t][j] * h[t-1][j];
+        addoutermul(gWh,x[t],dhc,D,S);
+        addoutermul(gUh,rh,dhc,S,S);
+
+        /* Update gate gradient */
+        float* dz = grad[4];
+        for (int j = 0; j < S; j++)
+            dz[j] = dh[j] * (hc[t][j] - h[t-1][j]) * d_sigmoid1(z[t][j]);
+        addoutermul(gWz,x[t],dz,D,S);
+        addoutermul(gUz,h[t-1],dz,S,S);
+
+        /* Reset gate gradient, through the reset hidden state */
+        float* drh = grad[5];
+        fltclr(drh,S);
+        addinnermul(drh,dhc,l->Uh,S,S);
+        float* dr = grad[6];
+        for (int j = 0; j < S; j++)
+            dr[j] = drh[j] * h[t-1][j] * d_sigmoid1(r[t][j]);
+        addoutermul(gWr,x[t],dr,D,S);
+        addoutermul(gUr,h[t-1],dr,S,S);
+
+        /* Compute gradients for the previous time step */
+        for (int j = 0; j < S; j++)
+            dh_next[j] = dh[j] * (1 - z[t][j]) + drh[j] * r[t][j];
+        addinnermul(dh_next,dz,l->Uz,S,S);
+        addinnermul(dh_next,dr,l->Ur,S,S);
+        if (dx != NULL) {
+            fltclr(dx[t],D);
+            addinnermul(dx[t],dz,l->Wz,D,S);
+            addinnermul(dx[t],dr,l->Wr,D,S);
+            addinnermul(dx[t],dhc,l->Wh,D,S);
+        }
+    }
+    scratch_release(mark);
+}
+#endif
@@ -0,0 +1,188 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Paged cache of the attention keys and values of generation sessions */
+#include <stdio.h>
+#include <stdlib.h>  /* realloc() */
+#include "mem.h"
+#include "float.h"
+#include "array.h"
+#include "kvcache.h"
+
+/* Creates a pool of blocks.
+ *
+ * Parameters:
+ *   layers     - Number of attention layers of the model
+ *   D          - Dimension of the layers' keys and values
+ *   num_blocks - Number of blocks of KV_BLOCK tokens
+ *
+ * Returns:
+ *   Pointer to a pool.
+ */
+KVPOOL* kvpool_create(int layers, int D, int num_blocks)
+{
+    KVPOOL* p = allocmem(1,1,KVPOOL);
+    p->layers = layers;
+    p->D = D;
+    p->block = KV_BLOCK;
+    p->num_blocks = num_blocks;
+    p->num_free = num_blocks;
+    p->avail = allocmem(1,num_blocks,int);
+    p->refs = allocmem(1,num_blocks,int);
+    p->mem = allocmem((long) num_blocks * layers * 2 * p->block,D,float);
+    /* Lower blocks are taken first */
+    for (int i = 0; i < num_blocks; i++)
+        p->avail[i] = num_blocks - 1 - i;
+    return p;
+}
+
+/* Frees a pool. Sessions of the pool must be freed first.
+ *
+ * Parameters:
+ *   p - Pointer to a pool, may be NULL
+ */
+void kvpool_free(KVPOOL* p)
+{
+    if (p == NULL)
+        return;
+    freemem(p->avail);
+    freemem(p->refs);
+    freemem(p->mem);
+    freemem(p);
+}
+
+/* Removes a reference to a block, and returns it to the pool when no
+ * session uses it
+ */
+static void release_block(KVPOOL* p, int blk)
+{
+    if (blk < 0)
+        return;
+    if (--p->refs[blk] == 0)
+        p->avail[p->num_free++] = blk;
+}
+
+/* Sets the number of entries a session's table has room for */
+static void grow_table(KVSEQ* s, int max)
+{
+    if (max <= s->max_blocks)
+        return;
+    int* table = realloc(s->table,max * sizeof(int));
+    if (table == NULL) {
+        fflush(stdout);
+        fprintf(stderr,"\nIn function '%s': "
+                "out of memory at file '%s' line %d\n",
+                __FUNCTION__,__FILE__,__LINE__);
+        exit(-1);
+    }
+    s->table = table;
+    s->max_blocks = max;
+}
+
+/* Creates a session with an empty cache.
+ *
+ * Returns:
+ *   Pointer to a session.
+ */
+KVSEQ* kvseq_create()
+{
+    return allocmem(1,1,KVSEQ);
+}
+
+/* Creates a session whose cache is that of another session; the sessions
+ * share the blocks, until one of them writes to a shared block.
+ *
+ * Parameters:
+ *   p - Pointer to the pool of the session
+ *   s - Pointer to the session
+ *
+ * Returns:
+ *   Pointer to a session.
+ */
+KVSEQ* kvseq_fork(KVPOOL* p, const KVSEQ* s)
+{
+    KVSEQ* f = kvseq_create();
+    /* Blocks reserved after the last token are not shared */
+    const int num_blocks = (s->len + p->block - 1) / p->block;
+    grow_table(f,num_blocks);
+    for (int i = 0; i < num_blocks; i++) {
+        f->table[i] = s->table[i];
+        if (s->table[i] >= 0)
+            p->refs[s->table[i]]++;
+    }
+    f->num_blocks = num_blocks;
+    f->len = s->len;
+    return f;
+}
+
+/* Makes room for the keys and values of n more tokens of a session.
+ *
+ * Parameters:
+ *   p - Pointer to the pool of the session
+ *   s - Pointer to the session
+ *   n - Number of tokens
+ *
+ * Returns:
+ *   0 if successful, or -1 if the pool has too few free blocks; then the
+ *   session is not changed.
+ *
+ * Notes:
+ *   Tokens s->len to s->len + n - 1 are then in blocks the session does
+ *   not share. Their keys and values are written by the attention layers
+ *   (see mha_forward_paged()), then s->len is incremented by n.
+ */
+int kvseq_reserve(KVPOOL* p, KVSEQ* s, int n)
+{
+    const int num_blocks = (s->len + n + p->block - 1) / p->block;
+    /* A partly filled last block that is shared is copied */
+    const int last = (s->len % p->block != 0) ? s->len / p->block : -1;
+    const int copy = (last >= 0 && s->table[last] >= 0 &&
+                      p->refs[s->table[last]] > 1);
+    if (num_blocks - s->num_blocks + copy > p->num_free)
+        return -1;
+    if (copy) {
+        const int size = p->layers * 2 * p->block * p->D;
+        int blk = p->avail[--p->num_free];
+        p->refs[blk] = 1;
+        fltcpy(kv_block(p,blk,0),kv_block(p,s->table[last],0),size);
+        release_block(p,s->table[last]);
+        s->table[last] = blk;
+    }
+    grow_table(s,num_blocks);
+    while (s->num_blocks < num_blocks) {
+        int blk = p->avail[--p->num_free];
+        p->refs[blk] = 1;
+        s->table[s->num_blocks++] = blk;
+    }
+    return 0;
+}
+
+/* Releases the blocks of a session whose tokens are all before token t;
+ * their keys and values are no longer used.
+ *
+ * Parameters:
+ *   p - Pointer to the pool of the session
+ *   s - Pointer to the session
+ *   t - Number of the first token to keep
+ */
+void kvseq_drop(KVPOOL* p, KVSEQ* s, int t)
+{
+    for (int i = 0; i < t / p->block && i < s->num_blocks; i++) {
+        release_block(p,s->table[i]);
+        s->table[i] = -1;
+    }
+}
+
+/* Releases the blocks of a session and frees it.
+ *
+ * Parameters:
+ *   p - Pointer to the pool of the session
+ *   s - Pointer to the session, may be NULL
+ */
+void kvseq_free(KVPOOL* p, KVSEQ* s)
+{
+    if (s == NULL)
+        return;
+    for (int i = 0; i < s->num_blocks; i++)
+        release_block(p,s->table[i]);
+    free(s->table);
+    freemem(s);
+}
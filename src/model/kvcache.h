@@ -0,0 +1,136 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Paged cache of the attention keys and values of generation sessions */
+#ifndef KVCACHE_H
+#define KVCACHE_H
+#include "float.h"
+#include "array.h"
+
+/* Generating a sequence one token at a time runs the model on the new
+ * token only; its attention layers read the keys and values of the tokens
+ * before it from a cache, instead of computing them again.
+ *
+ * The caches of all sessions are in one pool of blocks, each holding the
+ * keys and values of KV_BLOCK consecutive tokens of a session, for all
+ * the attention layers of a model. A session lists the blocks of its
+ * tokens in a table, and takes a block from the pool only when its last
+ * block is full, so the memory used is that of the tokens the sessions
+ * have, not of their maximum length.
+ *
+ * Sessions forked from a session share its blocks, e.g. those of a common
+ * prompt; a block has a count of the sessions using it, and a session
+ * copies a shared block before writing to it (copy on write).
+ */
+#ifndef KV_BLOCK
+#define KV_BLOCK 16 /* Tokens of a block */
+#endif
+
+typedef struct {
+    int layers;     /* Number of attention layers                     */
+    int D;          /* Dimension of keys and values                   */
+    int block;      /* Number of tokens of a block                    */
+    int num_blocks; /* Number of blocks of the pool                   */
+    int num_free;   /* Number of blocks not used by any session       */
+    int* avail;     /* Blocks not used by any session [num_blocks]    */
+    int* refs;      /* Number of sessions using each block [num_blocks] */
+    float* mem;     /* Blocks [num_blocks][layers][2][block][D]       */
+} KVPOOL;
+
+typedef struct {
+    int len;        /* Number of tokens in the cache                  */
+    int num_blocks; /* Number of entries of table                     */
+    int max_blocks; /* Number of entries table has room for           */
+    int* table;     /* Block of tokens i * block to (i + 1) * block - 1,
+                       or -1 if released by kvseq_drop()               */
+} KVSEQ;
+
+/* Creates a pool of blocks.
+ *
+ * Parameters:
+ *   layers     - Number of attention layers of the model
+ *   D          - Dimension of the layers' keys and values
+ *   num_blocks - Number of blocks of KV_BLOCK tokens
+ *
+ * Returns:
+ *   Pointer to a pool.
+ */
+KVPOOL* kvpool_create(int layers, int D, int num_blocks);
+
+/* Frees a pool. Sessions of the pool must be freed first.
+ *
+ * Parameters:
+ *   p - Pointer to a pool, may be NULL
+ */
+void kvpool_free(KVPOOL* p);
+
+/* Creates a session with an empty cache.
+ *
+ * Returns:
+ *   Pointer to a session.
+ */
+KVSEQ* kvseq_create();
+
+/* Creates a session whose cache is that of another session; the sessions
+ * share the blocks, until one of them writes to a shared block.
+ *
+ * Parameters:
+ *   p - Pointer to the pool of the session
+ *   s - Pointer to the session
+ *
+ * Returns:
+ *   Pointer to a session.
+ */
+KVSEQ* kvseq_fork(KVPOOL* p, const KVSEQ* s);
+
+/* Makes room for the keys and values of n more tokens of a session.
+ *
+ * Parameters:
+ *   p - Pointer to the pool of the session
+ *   s - Pointer to the session
+ *   n - Number of tokens
+ *
+ * Returns:
+ *   0 if successful, or -1 if the pool has too few free blocks; then the
+ *   session is not changed.
+ *
+ * Notes:
+ *   Tokens s->len to s->len + n - 1 are then in blocks the session does
+ *   not share. Their keys and values are written by the attention layers
+ *   (see mha_forward_paged()), then s->len is incremented by n.
+ */
+int kvseq_reserve(KVPOOL* p, KVSEQ* s, int n);
+
+/* Releases the blocks of a session whose tokens are all before token t;
+ * their keys and values are no longer used.
+ *
+ * Parameters:
+ *   p - Pointer to the pool of the session
+ *   s - Pointer to the session
+ *   t - Number of the first token to keep
+ */
+void kvseq_drop(KVPOOL* p, KVSEQ* s, int t);
+
+/* Releases the blocks of a session and frees it.
+ *
+ * Parameters:
+ *   p - Pointer to the pool of the session
+ *   s - Pointer to the session, may be NULL
+ */
+void kvseq_free(KVPOOL* p, KVSEQ* s);
+
+/* Returns the keys [block][D] of a block of attention layer lyr; its
+ * values [block][D] follow them.
+ */
+static inline float* kv_block(const KVPOOL* p, int blk, int lyr)
+{
+    return p->mem + (((long) blk * p->layers + lyr) * 2 * p->block) * p->D;
+}
+
+/* Returns the key of token t of a session, of attention layer lyr; its
+ * value is block * D floats after it.
+ */
+static inline float* kv_key(const KVPOOL* p, const KVSEQ* s, int lyr, int t)
+{
+    return kv_block(p,s->table[t / p->block],lyr) + (long) (t % p->block) * p->D;
+}
+
+#endif
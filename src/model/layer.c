@@ -10,6 +10,7 @@
 #include "adamw.h"
 #include "dense.h"
 #include "lstm.h"
+#include "gru.h"
 #include "transformer.h"
 #include "negsample.h"
 #include "layer.h"
@@ -42,11 +43,15 @@ int layer_init(LAYER* l, int input_dim, int batch_size)
         case 'l':
             lstm_init(l->lstm,input_dim,batch_size);
             return l->lstm->S;
+        case 'g':
+            gru_init(l->gru,input_dim,batch_size);
+            return l->gru->S;
         case 't': {
-            /* The transformer's model dimension D and sequence length T are
-             * fixed at transformer_create(). input_dim must equal D, and the
-             * model's row count (batch_size) must be B*T for whole sequences
-             * of length T, so the number of sequences is batch_size / T. 
+            /* The transformer's model dimension D and maximum sequence 
+             * length T are fixed at transformer_create(). input_dim must
+             * equal D. The model's row count (batch_size) is split into 
+             * sequences of length T; the buffers are allocated for whole 
+             * sequences, the last of which may be partially used.
              */
             TRANSFORMER* tr = l->transformer;
             if (input_dim != tr->D) {
@@ -55,14 +60,15 @@ int layer_init(LAYER* l, int input_dim, int batch_size)
                         "!= model_dim %d\n",input_dim,tr->D);
                 exit(-1);
             }
-            if (tr->T <= 0 || batch_size % tr->T != 0) {
+            if (tr->T <= 0) {
                 fflush(stdout);
-                fprintf(stderr,"layer_init: batch_size %d not a multiple "
-                        "of transformer T %d\n",batch_size,tr->T);
+                fprintf(stderr,"layer_init: invalid transformer T %d\n",
+                        tr->T);
                 exit(-1);
             }
-            transformer_init(tr,batch_size / tr->T,1,0.0);
+            transformer_init(tr,(batch_size + tr->T - 1) / tr->T,1,0.0);
             l->out = allocmem(tr->BT,tr->D,float);
+            l->mask = allocmem(tr->BT,1,int);
             return tr->D;
         }
         case 'n':
@@ -78,6 +84,7 @@ void layer_reset(LAYER* l)
     switch (l->type) {
         case 'd': dense_reset(l->dense); break;
         case 'l': lstm_reset(l->lstm); break;
+        case 'g': gru_reset(l->gru); break;
         case 't': /* transformer carries no cross-batch state */ break;
         case 'n': negsample_reset(l->negsample); break;
     }
@@ -88,7 +95,12 @@ void layer_free(LAYER* l)
     switch (l->type) {
         case 'd': dense_free(l->dense); break;
         case 'l': lstm_free(l->lstm); break;
-        case 't': transformer_free(l->transformer); freemem(l->out); break;
+        case 'g': gru_free(l->gru); break;
+        case 't': 
+            transformer_free(l->transformer); 
+            freemem(l->out); 
+            freemem(l->mask); 
+        break;
         case 'n': negsample_free(l->negsample); break;
     }
 }
@@ -98,16 +110,74 @@ void layer_set_batch_size(LAYER* l, int batch_size)
     switch (l->type) {
         case 'd': dense_set_batch_size(l->dense,batch_size); break;
         case 'l': lstm_set_batch_size(l->lstm,batch_size); break;
-        case 't':
-            fflush(stdout);
-            fprintf(stderr,
-                "layer_set_batch_size: not supprted by transformer layer\n");
-            exit(-1);
+        case 'g': gru_set_batch_size(l->gru,batch_size); break;
+        case 't': /* Shape is set per pass, see layer_set_shape() */
+            if (batch_size > layer_batch_size(l)) {
+                fflush(stdout);
+                fprintf(stderr,"layer_set_batch_size: batch size %d exceeds "
+                        "transformer layer's %d\n",
+                        batch_size,layer_batch_size(l));
+                exit(-1);
+            }
         break;
         case 'n': negsample_set_batch_size(l->negsample,batch_size); break;
     }
 }
 
+/* Adds a scratch buffer of a layer to a plan, unless it is not allocated.
+ * Buffers a plan already owns are not freed.
+ */
+static void plan_buffer(MEMPLAN* p, int planned, const char* name,
+                        fArr2D* buf, long size, int first, int last)
+{
+    if (*buf == NULL)
+        return;
+    if (!planned)
+        freemem(*buf);
+    memplan_add(p,name,buf,size,first,last);
+}
+
+void layer_plan(LAYER* l, MEMPLAN* p, int forward, int backward)
+{
+    if (l->type != 't')
+        return;
+    TRANSFORMER* tr = l->transformer;
+    MHA* a = tr->mha;
+    const long BT = (long) tr->Bmax * tr->Tmax;
+    const long D = tr->D;
+    const long T = a->Tmax;
+    const long Dh = a->Dh;
+    const int f = forward;
+    const int b = backward;
+    int planned = tr->planned;
+    /* Forward pass: projections, scores of one head, and MHA output */
+    plan_buffer(p,planned,"mha Q",&a->Q,BT * D,f,f);
+    plan_buffer(p,planned,"mha K",&a->K,BT * D,f,f);
+    plan_buffer(p,planned,"mha V",&a->V,BT * D,f,f);
+    plan_buffer(p,planned,"mha Scores",&a->Scores,T * T,f,f);
+    plan_buffer(p,planned,"mha Oh",&a->Oh,T * Dh,f,f);
+    plan_buffer(p,planned,"mha_out",&tr->mha_out,BT * D,f,f);
+    /* Backward pass */
+    plan_buffer(p,planned,"mha dOut",&a->dOut,BT * D,b,b);
+    plan_buffer(p,planned,"mha dQ",&a->dQ,BT * D,b,b);
+    plan_buffer(p,planned,"mha dK",&a->dK,BT * D,b,b);
+    plan_buffer(p,planned,"mha dV",&a->dV,BT * D,b,b);
+    plan_buffer(p,planned,"mha dQh",&a->dQh,T * Dh,b,b);
+    plan_buffer(p,planned,"mha dKh",&a->dKh,T * Dh,b,b);
+    plan_buffer(p,planned,"mha dVh",&a->dVh,T * Dh,b,b);
+    plan_buffer(p,planned,"mha dOh",&a->dOh,T * Dh,b,b);
+    plan_buffer(p,planned,"mha dAtt",&a->dAtt,T * T,b,b);
+    plan_buffer(p,planned,"mha dScores",&a->dScores,T * T,b,b);
+    plan_buffer(p,planned,"d_norm2_in",&tr->d_norm2_in,BT * D,b,b);
+    plan_buffer(p,planned,"d_ffn1_in",&tr->d_ffn1_in,BT * tr->Dff,b,b);
+    plan_buffer(p,planned,"d_norm1_in",&tr->d_norm1_in,BT * D,b,b);
+    plan_buffer(p,planned,"d_mha_out",&tr->d_mha_out,BT * D,b,b);
+    plan_buffer(p,planned,"d_ffn2_in",&tr->d_ffn2_in,BT * D,b,b);
+    plan_buffer(p,planned,"d_mha_masked",&tr->d_mha_masked,BT * D,b,b);
+    tr->planned = 1;
+    a->planned = 1;
+}
+
 void layer_alloc_grads(LAYER* l, char optimizer)
 {
     switch (l->type) {
@@ -142,6 +212,22 @@ void layer_alloc_grads(LAYER* l, char optimizer)
             l->num_grads = ng;
         }
         break;
+        case 'g': {
+            int D = l->gru->D;
+            int S = l->gru->S;
+            int ng = 0; /* Number of gradient related arrays   */
+            /* gW{z,r,h}[D][S] gU{z,r,h}[S][S]                 */
+            switch (optimizer) {
+                case 'l': ng = 6; break;
+                case 'a': ng = 18; break; /* linear + adam m/v */
+            }
+            fArr2D* g = allocmem(1,ng,fArr2D*);
+            for (int j = 0; j < ng; j++)
+                g[j] = allocmem(((j / 3) % 2) ? S : D,S,float);
+            l->grads = g;
+            l->num_grads = ng;
+        }
+        break;
         case 't': {
             /* The transformer owns its 10 weight gradients internally
              * (mha->gW{q,k,v,o}, gWx1, gWx2, dg1/db1, dg2/db2), so the
@@ -188,6 +274,130 @@ void layer_alloc_grads(LAYER* l, char optimizer)
     }
 }
 
+int layer_weights(const LAYER* l, fArr2D* w, long* n)
+{
+    int k = 0;
+    switch (l->type) {
+        case 'd':
+            w[k] = l->dense->Wx; n[k++] = (long) l->dense->D * l->dense->S;
+        break;
+        case 'l': {
+            LSTM* ll = l->lstm;
+            long DS = (long) ll->D * ll->S;
+            long SS = (long) ll->S * ll->S;
+            w[k] = ll->Wf; n[k++] = DS;
+            w[k] = ll->Wi; n[k++] = DS;
+            w[k] = ll->Wc; n[k++] = DS;
+            w[k] = ll->Wo; n[k++] = DS;
+            w[k] = ll->Uf; n[k++] = SS;
+            w[k] = ll->Ui; n[k++] = SS;
+            w[k] = ll->Uc; n[k++] = SS;
+            w[k] = ll->Uo; n[k++] = SS;
+        }
+        break;
+        case 'g': {
+            GRU* lg = l->gru;
+            long DS = (long) lg->D * lg->S;
+            long SS = (long) lg->S * lg->S;
+            w[k] = lg->Wz; n[k++] = DS;
+            w[k] = lg->Wr; n[k++] = DS;
+            w[k] = lg->Wh; n[k++] = DS;
+            w[k] = lg->Uz; n[k++] = SS;
+            w[k] = lg->Ur; n[k++] = SS;
+            w[k] = lg->Uh; n[k++] = SS;
+        }
+        break;
+        case 't': { /* Same order as in layer_update() */
+            TRANSFORMER* tr = l->transformer;
+            MHA* mha = tr->mha;
+            long DD = (long) tr->D * tr->D;
+            w[k] = mha->Wq; n[k++] = DD;
+            w[k] = mha->Wk; n[k++] = DD;
+            w[k] = mha->Wv; n[k++] = DD;
+            w[k] = mha->Wo; n[k++] = DD;
+            w[k] = tr->ffn1->Wx; n[k++] = (long) tr->ffn1->D * tr->ffn1->S;
+            w[k] = tr->ffn2->Wx; n[k++] = (long) tr->ffn2->D * tr->ffn2->S;
+            w[k] = (fArr2D) tr->norm1->gamma; n[k++] = tr->D;
+            w[k] = (fArr2D) tr->norm1->beta;  n[k++] = tr->D;
+            w[k] = (fArr2D) tr->norm2->gamma; n[k++] = tr->D;
+            w[k] = (fArr2D) tr->norm2->beta;  n[k++] = tr->D;
+        }
+        break;
+        case 'n':
+            w[k] = l->negsample->Wo;
+            n[k++] = (long) l->negsample->K * l->negsample->E;
+        break;
+    }
+    return k;
+}
+
+void layer_weights_changed(LAYER* l)
+{
+    switch (l->type) {
+        case 'd': l->dense->packed = 0; break;
+        case 'l': l->lstm->packed = 0; break;
+        case 'g': l->gru->packed = 0; break;
+        case 't':
+            l->transformer->ffn1->packed = 0;
+            l->transformer->ffn2->packed = 0;
+        break;
+    }
+}
+
+int layer_gradients(const LAYER* l, fArr2D* g, long* n)
+{
+    int k = 0;
+    switch (l->type) {
+        case 'd':
+            if (l->grads == NULL)
+                break;
+            g[k] = l->grads[0]; n[k++] = (long) l->dense->D * l->dense->S;
+        break;
+        case 'l': {
+            if (l->grads == NULL)
+                break;
+            LSTM* ll = l->lstm;
+            long DS = (long) ll->D * ll->S;
+            long SS = (long) ll->S * ll->S;
+            for (int j = 0; j < 8; j++) {
+                g[k] = l->grads[j]; n[k++] = (j < 4) ? DS : SS;
+            }
+        }
+        break;
+        case 'g': {
+            if (l->grads == NULL)
+                break;
+            GRU* lg = l->gru;
+            long DS = (long) lg->D * lg->S;
+            long SS = (long) lg->S * lg->S;
+            for (int j = 0; j < 6; j++) {
+                g[k] = l->grads[j]; n[k++] = (j < 3) ? DS : SS;
+            }
+        }
+        break;
+        case 't': { /* Gradients are internal to the transformer */
+            TRANSFORMER* tr = l->transformer;
+            MHA* mha = tr->mha;
+            long DD = (long) tr->D * tr->D;
+            long DF = (long) tr->D * tr->Dff;
+            g[k] = mha->gWq; n[k++] = DD;
+            g[k] = mha->gWk; n[k++] = DD;
+            g[k] = mha->gWv; n[k++] = DD;
+            g[k] = mha->gWo; n[k++] = DD;
+            g[k] = tr->gWx1; n[k++] = DF;
+            g[k] = tr->gWx2; n[k++] = DF;
+            g[k] = (fArr2D) tr->dg1; n[k++] = tr->D;
+            g[k] = (fArr2D) tr->db1; n[k++] = tr->D;
+            g[k] = (fArr2D) tr->dg2; n[k++] = tr->D;
+            g[k] = (fArr2D) tr->db2; n[k++] = tr->D;
+        }
+        break;
+        case 'n': /* Sparse */
+        break;
+    }
+    return k;
+}
+
 void layer_update(LAYER* l, char optimizer,
                   float learning_rate, float weight_decay, int update_cnt)
 {
@@ -238,6 +448,30 @@ void layer_update(LAYER* l, char optimizer,
             }
         }
         break;
+        case 'g': { /* gru */
+            GRU* lg = l->gru;
+            int D = lg->D;
+            int S = lg->S;
+            switch (optimizer) {
+                case 'l': /* linear */
+                    linear_update(lg->Wz,g[0],D,S,lr,wd);
+                    linear_update(lg->Wr,g[1],D,S,lr,wd);
+                    linear_update(lg->Wh,g[2],D,S,lr,wd);
+                    linear_update(lg->Uz,g[3],S,S,lr,wd);
+                    linear_update(lg->Ur,g[4],S,S,lr,wd);
+                    linear_update(lg->Uh,g[5],S,S,lr,wd);
+                break;
+                case 'a': /* adamw */
+                    adamw_update(lg->Wz,g[0],g[0+6],g[0+12],D,S,lr,wd,uc);
+                    adamw_update(lg->Wr,g[1],g[1+6],g[1+12],D,S,lr,wd,uc);
+                    adamw_update(lg->Wh,g[2],g[2+6],g[2+12],D,S,lr,wd,uc);
+                    adamw_update(lg->Uz,g[3],g[3+6],g[3+12],S,S,lr,wd,uc);
+                    adamw_update(lg->Ur,g[4],g[4+6],g[4+12],S,S,lr,wd,uc);
+                    adamw_update(lg->Uh,g[5],g[5+6],g[5+12],S,S,lr,wd,uc);
+                break;
+            }
+        }
+        break;
         case 't': { /* transformer */
             TRANSFORMER* tr = l->transformer;
             MHA* mha = tr->mha;
@@ -282,4 +516,5 @@ void layer_update(LAYER* l, char optimizer,
             negsample_update(l->negsample,g[0],lr,wd);
         break;
     }
+    layer_weights_changed(l);
 }
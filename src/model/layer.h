@@ -5,20 +5,24 @@
 #include "array.h"
 #include "dense.h"
 #include "lstm.h"
+#include "gru.h"
 #include "transformer.h"
 #include "negsample.h"
+#include "memplan.h"
 
 typedef struct layer_s {
-    char type;      /* (d)ense (l)stm (t)ransformer (n)egsample */
+    char type;      /* (d)ense (l)stm (g)ru (t)ransformer (n)egsample */
     union {
         DENSE* dense;
         LSTM* lstm;
+        GRU* gru;
         TRANSFORMER* transformer;
         NEGSAMPLE* negsample;
     };
     fArr2D* grads;  /* Array of gradients and adam momentums    */
     int num_grads;  /* Number of entries in grads[]             */
     fArr2D out;     /* Scratch buffer                           */
+    iVec mask;      /* Padding mask scratch buffer (transformer) */
 } LAYER;
 
 /* Reports use of a not-yet-implemented layer type and aborts. */
@@ -42,6 +46,7 @@ static inline int layer_output_dim(const LAYER* l)
     switch (l->type) {
         case 'd': return l->dense->S;
         case 'l': return l->lstm->S;
+        case 'g': return l->gru->S;
         case 't': return l->transformer->D; /* in == out  */
         case 'n': return l->negsample->E;   /* passthrout */
     }
@@ -49,36 +54,89 @@ static inline int layer_output_dim(const LAYER* l)
     return 0; /* not reached */
 }
 
-/* Returns the layer's batch size (rows in its output). */
+/* Returns the layer's batch size (maximum number of rows in its output,
+ * which is the size its buffers were allocated for).
+ */
 static inline int layer_batch_size(const LAYER* l)
 {
     switch (l->type) {
-        case 'd': return l->dense->B;
-        case 'l': return l->lstm->B;
-        case 't': return l->transformer->BT; /* row count is B*T */
-        case 'n': return l->negsample->B;
+        case 'd': return l->dense->Bmax;
+        case 'l': return l->lstm->Bmax;
+        case 'g': return l->gru->Bmax;
+        case 't': /* row count is B*T */
+            return l->transformer->Bmax * l->transformer->Tmax;
+        case 'n': return l->negsample->Bmax;
     }
     layer_unsupported("layer_batch_size",l->type);
     return 0; /* not reached */
 }
 
+/* Sets the number of rows processed by the layer's next forward and
+ * backward passes, without reallocating memory.
+ *
+ * A transformer layer processes rows as whole sequences of length T
+ * (set at transformer_create()); up to T rows are processed as a single 
+ * shorter sequence. Otherwise, rows are processed as sequences of length 
+ * T, where the last sequence is padded and its padding masked out.
+ *
+ * Returns:
+ *   The number of rows actually computed (rows, or rows rounded up to
+ *   whole transformer sequences).
+ */
+static inline int layer_set_shape(LAYER* l, int rows)
+{
+    switch (l->type) {
+        case 'd': dense_set_shape(l->dense,rows); return rows;
+        case 'l': lstm_set_shape(l->lstm,rows); return rows;
+        case 'g': gru_set_shape(l->gru,rows); return rows;
+        case 't': {
+            TRANSFORMER* tr = l->transformer;
+            const int T = tr->Tmax;
+            if (rows <= T)
+                transformer_set_shape(tr,1,rows);
+            else
+                transformer_set_shape(tr,(rows + T - 1) / T,T);
+            return tr->BT;
+        }
+        case 'n': negsample_set_shape(l->negsample,rows); return rows;
+    }
+    layer_unsupported("layer_set_shape",l->type);
+    return 0; /* not reached */
+}
+
 /* Runs the layer's forward pass.
  *
  * Parameters:
- *   X   - Input array [B][D]
- *   lyr - Ordinal number of this layer in the model
+ *   X    - Input array [B][D]
+ *   rows - Number of valid rows in X (B); at most layer_batch_size()
+ *   lyr  - Ordinal number of this layer in the model
  *
  * Returns:
  *   Pointer to the layer's output array [B][S].
+ *
+ * Notes:
+ *   - Only the first rows rows of X and of the output are used. 
+ *   - A transformer may compute up to T - 1 additional (padding) rows,
+ *     see layer_set_shape(); their contents are ignored.
  */
-static inline fArr2D layer_forward(LAYER* l, const fArr2D X, int lyr)
+static inline fArr2D layer_forward(LAYER* l, const fArr2D X, int rows,
+                                   int lyr)
 {
+    int n = layer_set_shape(l,rows);
     switch (l->type) {
         case 'd': return dense_forward(l->dense,X,lyr);
         case 'l': return lstm_forward(l->lstm,X,lyr);
-        case 't':
-            transformer_forward(l->transformer,X,NULL,l->out,lyr);
+        case 'g': return gru_forward(l->gru,X,lyr);
+        case 't': {
+            iVec mask = NULL;
+            if (n > rows) { /* Mask out padding of last sequence */
+                mask = l->mask;
+                for (int i = 0; i < n; i++)
+                    mask[i] = (i < rows) ? 1 : 0;
+            }
+            transformer_forward(l->transformer,X,mask,l->out,lyr);
             return l->out;
+        }
         case 'n': return negsample_forward(l->negsample,X,lyr);
     }
     layer_unsupported("layer_forward",l->type);
@@ -92,14 +150,25 @@ static inline fArr2D layer_forward(LAYER* l, const fArr2D X, int lyr)
  * gradient into dx.
  *
  * Parameters:
- *   dy  - Output gradient [B][S]
- *   X   - The input that produced this layer's output [B][D]
- *   dx  - Input gradient [B][D] (may be NULL for the first layer)
- *   lyr - Ordinal number of this layer in the model
+ *   dy   - Output gradient [B][S]
+ *   X    - The input that produced this layer's output [B][D]
+ *   dx   - Input gradient [B][D] (may be NULL for the first layer)
+ *   rows - Number of valid rows (B), same as in the preceding forward pass
+ *   lyr  - Ordinal number of this layer in the model
+ *
+ * Notes:
+ *   A transformer clears the rows of dy past rows that belong to 
+ *   padding, so no gradient flows from padding positions.
  */
 static inline void layer_backward(LAYER* l, fArr2D dy, 
-                                  const fArr2D X, fArr2D dx, int lyr)
+                                  const fArr2D X, fArr2D dx, int rows,
+                                  int lyr)
 {
+    int n = layer_set_shape(l,rows);
+    if (n > rows) {
+        int S = layer_output_dim(l);
+        fltclr((float*) dy + rows * S,(n - rows) * S);
+    }
     switch (l->type) {
         case 'd':
             dense_backward(l->dense,dy,X,l->grads[0],dx,lyr);
@@ -107,6 +176,9 @@ static inline void layer_backward(LAYER* l, fArr2D dy,
         case 'l':
             lstm_backward(l->lstm,dy,X,l->grads,dx,lyr);
             return;
+        case 'g':
+            gru_backward(l->gru,dy,X,l->grads,dx,lyr);
+            return;
         case 't':
             transformer_backward(l->transformer,dy,X,dx,lyr);
             return;
@@ -123,15 +195,80 @@ void layer_reset(LAYER* l);
 /* Frees the underlying layer object (not l->grads; see model_free). */
 void layer_free(LAYER* l);
 
-/* Resizes / re-initializes the layer for a new batch size. */
+/* Sets a new batch size. Buffers are reallocated (and re-initialized)
+ * only if batch_size exceeds layer_batch_size(); a transformer layer
+ * cannot grow beyond it.
+ */
 void layer_set_batch_size(LAYER* l, int batch_size);
 
+/* Adds the layer's scratch buffers to a memory plan (see memplan.h), so
+ * that they share memory with buffers of other layers.
+ *
+ * Parameters:
+ *   p        - Memory plan of the model
+ *   forward  - Step of the layer's forward pass
+ *   backward - Step of the layer's backward pass
+ *
+ * Notes:
+ *   Scratch buffers are those used only during one pass of the layer:
+ *   the attention projections and scores, and the gradients of the
+ *   backward pass of a transformer layer. Other layer types have none.
+ *   Their memory is freed, and memplan_assign() sets them to their place
+ *   in the workspace of the plan, which then owns them.
+ */
+void layer_plan(LAYER* l, MEMPLAN* p, int forward, int backward);
+
 /* Allocates the layer's gradient (and optimizer-moment) arrays into
  * l->grads / l->num_grads, sized for the given optimizer
  * ('l' linear, 'a' adamw).
  */
 void layer_alloc_grads(LAYER* l, char optimizer);
 
+/* Maximum number of weight arrays returned by layer_weights() */
+#define LAYER_MAX_WEIGHTS 10
+
+/* Returns the layer's trainable weight arrays.
+ *
+ * Parameters:
+ *   w - Array of LAYER_MAX_WEIGHTS entries; receives pointers to the
+ *       layer's weight arrays
+ *   n - Array of LAYER_MAX_WEIGHTS entries; receives the number of
+ *       elements of each weight array
+ *
+ * Returns:
+ *   The number of weight arrays.
+ *
+ * Notes:
+ *   Two layers of the same type and dimensions return their weights in
+ *   the same order, so weights can be copied from one to the other.
+ */
+int layer_weights(const LAYER* l, fArr2D* w, long* n);
+
+/* Marks the copies of the layer's weights that are derived from them, such
+ * as the packed weights of the small batch kernels (see gemv.h), out of
+ * date. Code that changes the weights calls this function; the copies are
+ * made again by the next forward pass that uses them.
+ */
+void layer_weights_changed(LAYER* l);
+
+/* Returns the gradients of the layer's trainable weights, as computed by
+ * the last backward pass.
+ *
+ * Parameters:
+ *   g - Array of LAYER_MAX_WEIGHTS entries; receives pointers to the
+ *       gradient arrays, in the same order as layer_weights()
+ *   n - Array of LAYER_MAX_WEIGHTS entries; receives the number of
+ *       elements of each gradient array
+ *
+ * Returns:
+ *   The number of gradient arrays, or 0 if gradients are not allocated.
+ *
+ * Notes:
+ *   The negative sampling layer's gradient is sparse (only the rows of
+ *   the sampled words are valid), so it is not returned.
+ */
+int layer_gradients(const LAYER* l, fArr2D* g, long* n);
+
 /* Applies one optimizer step to the layer's weights using l->grads. */
 void layer_update(LAYER* l, char optimizer,
                   float learning_rate, float weight_decay, int update_cnt);
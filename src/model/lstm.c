@@ -39,7 +39,7 @@ LSTM* lstm_create(int units, int stateful)
  *
  * Parameters:
  *   input_dim  - Size of input vectors (must include bias dimension)
- *   batch_size - Number of input vectors processed simultaneously
+ *   batch_size - Maximum number of input vectors processed simultaneously
  *
  * Notes:
  *   - Kernel weights (Wx) are initialized using Glorot normal distribution.
@@ -50,6 +50,7 @@ void lstm_init(LSTM* l, int input_dim, int batch_size)
 {
     l->D = input_dim;
     l->B = batch_size;
+    l->Bmax = batch_size;
     l->f = allocmem(l->B,l->S,float);
     l->i = allocmem(l->B,l->S,float);
     l->o = allocmem(l->B,l->S,float);
@@ -116,14 +117,16 @@ void lstm_init(LSTM* l, int input_dim, int batch_size)
  *   batch_size - Number of input vectors processed simultaneously
  *
  * Notes:
- *   If this function is called before ilstm_init(), it does nothing.
- *   Otherwise, the network's hidden states are resized and re-initialized
+ *   If this function is called before lstm_init(), it does nothing.
+ *   If batch_size does not exceed the batch size the network was 
+ *   initialized with, the existing state buffers are reused. 
+ *   Otherwise, they are resized and re-initialized.
  */
 void lstm_set_batch_size(LSTM* l, int batch_size)
 {
     if (l->B == 0)
         return;
-    if (batch_size != l->B) {
+    if (batch_size > l->Bmax) {
         freemem(l->f);
         freemem(l->i);
         freemem(l->o);
@@ -131,6 +134,7 @@ void lstm_set_batch_size(LSTM* l, int batch_size)
         freemem(l->h);
         freemem(l->c);
         l->B = batch_size;
+        l->Bmax = batch_size;
         l->f = allocmem(l->B,l->S,float);
         l->i = allocmem(l->B,l->S,float);
         l->o = allocmem(l->B,l->S,float);
@@ -139,6 +143,7 @@ void lstm_set_batch_size(LSTM* l, int batch_size)
         l->c = allocmem(l->B + 1,l->S,float);
     }
     else {
+        l->B = batch_size;
         fltclr(l->f,l->B * l->S);
         fltclr(l->i,l->B * l->S);
         fltclr(l->o,l->B * l->S);
@@ -172,6 +177,7 @@ void lstm_free(LSTM* l)
     freemem(l->Uo);
     freemem(l->ph);
     freemem(l->pc);
+    freemem(l->Wp);
     freemem(l);
 }
 
@@ -185,3 +191,38 @@ void lstm_reset(LSTM* l)
     fltclr(l->ph,l->S);
     fltclr(l->pc,l->S);
 }
+
+/* Packs the weights for the small batch kernels (see gemv.h), and marks
+ * them up to date.
+ *
+ * Parameters:
+ *   l - Pointer to the LSTM neural network layer
+ *
+ * Notes:
+ *   lstm_forward() calls this function when it runs a small batch and
+ *   l->packed is 0. Code that changes the weights must set l->packed to 0;
+ *   layer_update() does.
+ */
+void lstm_pack(LSTM* l)
+{
+    const int D = l->D;
+    const int S = l->S;
+    const fArr2D W[8] = { l->Wf, l->Wi, l->Wo, l->Wc,
+                          l->Uf, l->Ui, l->Uo, l->Uc };
+    /* [Wf Wi Wo Wc; Uf Ui Uo Uc], (D+S)x4S */
+    SCRATCH_MARK mark = scratch_mark();
+    typedef float (*ArrX4S)[4 * S];
+    ArrX4S w = (ArrX4S) scratchmem(D + S,4 * S,float);
+    for (int k = 0; k < D + S; k++)
+        for (int n = 0; n < 4; n++) {
+            const float* src = (k < D) ? (const float*) W[n] + (long) k * S
+                                       : (const float*) W[4 + n] +
+                                         (long) (k - D) * S;
+            fltcpy(w[k] + n * S,src,S);
+        }
+    if (l->Wp == NULL)
+        l->Wp = allocmem(1,gemv_packed_size(D + S,4 * S),float);
+    gemv_pack(l->Wp,w,D + S,4 * S);
+    scratch_release(mark);
+    l->packed = 1;
+}
@@ -2,13 +2,19 @@
 /* LSTM (reccurrent) neural network layer data structures and functions */
 #ifndef LSTM_H
 #define LSTM_H
+#include <stdio.h>
+#include <stdlib.h>
+#include "mem.h"
 #include "array.h"
+#include "shapes.h"
+#include "gemv.h"
 #include "activation.h"
 
 typedef struct lstm_s {
   int D;           /* Input vector dimension (including bias)       */
   int S;           /* Number of units, size of hidden state         */
-  int B;           /* Number of input vectors in a batch            */
+  int B;           /* Number of input vectors in current batch      */
+  int Bmax;        /* Maximum number of input vectors in a batch    */
   /* Note that B also is the sequence length (number of time steps) */
   int stateful;    /* 1: maintain state between batches             */
   /* Stateful mode preserves the final hidden and cell state across
@@ -31,6 +37,8 @@ typedef struct lstm_s {
   fArr2D h;        /* Hidden state matrix [B+1][S]                  */
   fVec ph;         /* Previous batch last hidden state vector [S]   */
   fVec pc;         /* Previous batch last cell state vector [S]     */
+  float* Wp;       /* [Wf Wi Wo Wc; Uf Ui Uo Uc] packed (gemv.h)    */
+  int packed;      /* Wp is up to date; 0 after weights change      */
 } LSTM;
 
 /* Creates a long short term memory (LSTM) neural network.
@@ -52,7 +60,7 @@ LSTM* lstm_create(int units, int stateful);
  *
  * Parameters:
  *   input_dim  - Size of input vectors (must include bias dimension)
- *   batch_size - Number of input vectors processed simultaneously
+ *   batch_size - Maximum number of input vectors processed simultaneously
  *
  * Notes:
  *   - Kernel weights (Wx) are initialized using Glorot normal distribution.
@@ -67,8 +75,10 @@ void lstm_init(LSTM* l, int input_dim, int batch_size);
  *   batch_size - Number of input vectors processed simultaneously
  *
  * Notes:
- *   If this function is called before ilstm_init(), it does nothing.
- *   Otherwise, the network's hidden states are resized and re-initialized
+ *   If this function is called before lstm_init(), it does nothing.
+ *   If batch_size does not exceed the batch size the network was 
+ *   initialized with, the existing state buffers are reused. 
+ *   Otherwise, they are resized and re-initialized.
  */
 void lstm_set_batch_size(LSTM* l, int batch_size);
 
@@ -86,11 +96,130 @@ void lstm_free(LSTM* l);
  */
 void lstm_reset(LSTM* l);
 
+/* Packs the weights for the small batch kernels (see gemv.h), and marks
+ * them up to date.
+ *
+ * Parameters:
+ *   l - Pointer to the LSTM neural network layer
+ *
+ * Notes:
+ *   lstm_forward() calls this function when it runs a small batch and
+ *   l->packed is 0. Code that changes the weights must set l->packed to 0;
+ *   layer_update() does.
+ */
+void lstm_pack(LSTM* l);
+
+/* Sets the number of input vectors (time steps) processed by the next 
+ * forward and backward passes, without reallocating memory; the passes
+ * use the first batch_size (+1) rows of the buffers allocated by 
+ * lstm_init().
+ *
+ * Parameters:
+ *   batch_size - Number of input vectors, between 1 and l->Bmax
+ */
+static inline void lstm_set_shape(LSTM* l, int batch_size)
+{
+    if (batch_size < 1 || batch_size > l->Bmax) {
+        fflush(stdout);
+        fprintf(stderr,"lstm_set_shape: batch size %d out of range 1..%d\n",
+                batch_size,l->Bmax);
+        exit(-1);
+    }
+    l->B = batch_size;
+}
+
 static inline void lstm_activate(fVec v, int S)
 {
    sigmoid((fArr2D) v,1,S);
 }
 
+/* Adds x @ W + h @ U to the gate vector g, where x is an input vector of
+ * dimension D, and h is the hidden state of dimension S, which may be a
+ * constant (see shapes.h).
+ */
+SHAPE_INLINE void lstm_gate(fVec restrict g, 
+                            const fVec restrict x, const fArr2D restrict W_,
+                            const fVec restrict h, const fArr2D restrict U_,
+                            int D, int S)
+{
+    typedef float (*ArrDS)[S];
+    typedef float (*ArrSS)[S];
+    const ArrDS W = (const ArrDS) W_;
+    const ArrSS U = (const ArrSS) U_;
+    for (int k = 0; k < D; k++)
+        for (int j = 0; j < S; j++)
+            g[j] += x[k] * W[k][j];
+    for (int k = 0; k < S; k++)
+        for (int j = 0; j < S; j++)
+            g[j] += h[k] * U[k][j];
+}
+
+/* Activates the gate vectors f, i, o, cc of one time step, and computes
+ * the cell and hidden states c and h, given the previous cell state pc.
+ */
+SHAPE_INLINE void lstm_cell(fVec restrict f, fVec restrict i,
+                            fVec restrict o, fVec restrict cc,
+                            fVec restrict c, fVec restrict h,
+                            const fVec restrict pc, int S)
+{
+    lstm_activate(f,S);
+    lstm_activate(i,S);
+    lstm_activate(o,S);
+    for (int j = 0; j < S; j++)
+        cc[j] = tanh(cc[j]);
+    /* c[t] = f[t] * c[t-1] + i[t] * cc[t] */
+    for (int j = 0; j < S; j++)
+        c[j] = f[j] * pc[j] + i[j] * cc[j];
+    /* h[t] = o[t] * tanh(c[t])  */
+    for (int j = 0; j < S; j++)
+        h[j] = o[j] * tanh(c[j]);
+}
+
+/* Computes one time step of lstm_forward(), below, given the input x, and
+ * the previous cell and hidden states pc and ph. Gate vectors f, i, o, cc
+ * must be zeroed.
+ */
+SHAPE_INLINE void lstm_step(LSTM* restrict l, const fVec restrict x,
+                            fVec restrict f, fVec restrict i, 
+                            fVec restrict o, fVec restrict cc,
+                            fVec restrict c, fVec restrict h,
+                            const fVec restrict pc, const fVec restrict ph,
+                            int D, int S)
+{
+    /* f[t] = activate(X[t] @ Wf + h[t-1] * Uf) */
+    lstm_gate(f,x,l->Wf,ph,l->Uf,D,S);
+    /* i[t] = activate(X[t] @ Wi + h[t-1] * Ui) */
+    lstm_gate(i,x,l->Wi,ph,l->Ui,D,S);
+    /* o[t] = activate(X[t] @ Wo + h[t-1] * Uo) */
+    lstm_gate(o,x,l->Wo,ph,l->Uo,D,S);
+    /* cc[t] = tanh(X[t] @ Wc + h[t-1] @ Uc) */
+    lstm_gate(cc,x,l->Wc,ph,l->Uc,D,S);
+    lstm_cell(f,i,o,cc,c,h,pc,S);
+}
+
+/* Computes one time step of lstm_forward(), as lstm_step() does, with the
+ * packed weights: all four gates in one product of the input and the
+ * previous hidden state, xh [D+S], into g [4][S].
+ */
+static inline void lstm_step_packed(LSTM* restrict l, const fVec restrict x,
+                                    fVec restrict xh, fVec restrict g,
+                                    fVec restrict f, fVec restrict i,
+                                    fVec restrict o, fVec restrict cc,
+                                    fVec restrict c, fVec restrict h,
+                                    const fVec restrict pc,
+                                    const fVec restrict ph, int D, int S)
+{
+    /* [f i o cc] = [X[t] h[t-1]] @ [Wf Wi Wo Wc; Uf Ui Uo Uc] */
+    fltcpy(xh,x,D);
+    fltcpy(xh + D,ph,S);
+    gemv((fArr2D) g,(fArr2D) xh,l->Wp,1,D + S,4 * S);
+    fltcpy(f,g,S);
+    fltcpy(i,g + S,S);
+    fltcpy(o,g + 2 * S,S);
+    fltcpy(cc,g + 3 * S,S);
+    lstm_cell(f,i,o,cc,c,h,pc,S);
+}
+
 /* Performs LSTM layer training/prediction's forward pass.
  *
  * Parameters:
@@ -105,6 +234,9 @@ static inline void lstm_activate(fVec v, int S)
  * Note:
  * - In a multi-layered neural network, after the first layer,
  *   X is the (activated) output of a previous layer.
+ * - Each time step is a product of a vector by the weights; batches of
+ *   fewer than GEMV_MAX_ROWS time steps, as in streaming, use the packed
+ *   weights l->Wp.
  */
 static inline fArr2D lstm_forward(LSTM* restrict l,
                                   const fArr2D restrict X /*[B][D]*/, int lyr)
@@ -157,30 +289,22 @@ static inline fArr2D lstm_forward(LSTM* restrict l,
         fltclr(c[-1],S);
     }
 
-    for (int t = 0; t < B; t++) {
-        /* f[t] = activate(X[t] @ Wf + h[t-1] * Uf) */
-        addvecmatmul(f[t],x[t],l->Wf,D,S);
-        addvecmatmul(f[t],h[t-1],l->Uf,S,S);
-        lstm_activate(f[t],S);
-        /* i[t] = activate(X[t] @ Wi + h[t-1] * Ui) */
-        addvecmatmul(i[t],x[t],l->Wi,D,S);
-        addvecmatmul(i[t],h[t-1],l->Ui,S,S);
-        lstm_activate(i[t],S);
-        /* o[t] = activate(X[t] @ Wo + h[t-1] * Uo) */
-        addvecmatmul(o[t],x[t],l->Wo,D,S);
-        addvecmatmul(o[t],h[t-1],l->Uo,S,S);
-        lstm_activate(o[t],S);
-        /* cc[t] = tanh(X[t] @ Wc + h[t-1] @ Uc) */
-        addvecmatmul(cc[t],x[t],l->Wc,D,S);
-        addvecmatmul(cc[t],h[t-1],l->Uc,S,S);
-        for (int j = 0; j < S; j++)
-            cc[t][j] = tanh(cc[t][j]);
-        /* c[t] = f[t] * c[t-1] + i[t] * cc[t] */
-        for (int j = 0; j < S; j++)
-            c[t][j] = f[t][j] * c[t-1][j] + i[t][j] * cc[t][j];
-        /* h[t] = o[t] * tanh(c[t])  */
-        for (int j = 0; j < l->S; j++)
-            h[t][j] = o[t][j] * tanh(c[t][j]);
+    if (B < GEMV_MAX_ROWS) {
+        if (!l->packed)
+            lstm_pack(l);
+        SCRATCH_MARK mark = scratch_mark();
+        float* xh = scratchmem(1,D + S,float);
+        float* g = scratchmem(4,S,float);
+        for (int t = 0; t < B; t++)
+            lstm_step_packed(l,x[t],xh,g,f[t],i[t],o[t],cc[t],c[t],h[t],
+                             c[t-1],h[t-1],D,S);
+        scratch_release(mark);
+    }
+    else {
+        SHAPE_SPECIALIZE(LSTM_UNITS_SHAPES,S,
+            for (int t = 0; t < B; t++)
+                lstm_step(l,x[t],f[t],i[t],o[t],cc[t],c[t],h[t],
+                          c[t-1],h[t-1],D,S));
     }
     /* Save last time step cell and hidden state for next batch of data */
     fltcpy(l->ph,h[B-1],S);
@@ -260,28 +384,34 @@ static inline void lstm_backward(LSTM* restrict l,
     ArrS2 gUo = (ArrS2) g[7];
     for (int i = 4; i < 8; i++)
         fltclr(g[i],S * S);
+    /* Gradients of a time step, in the scratch arena rather than on the
+     * stack, which large S could overflow
+     */
+    SCRATCH_MARK mark = scratch_mark();
+    typedef float (*ArrGS)[S];
+    ArrGS grad = (ArrGS) scratchmem(8,S,float);
     /* Future time step gradient */
-    float dh_next[S];
-    float dc_next[S];
+    float* dh_next = grad[0];
+    float* dc_next = grad[1];
     fltclr(dh_next,S);
     fltclr(dc_next,S);
     /* Backward pass loop */
     for (int t = B - 1; t >= 0; t--) {
         /* Calculate the gradient loss with respect to the hidden state */
         /* dh = dy[t] + dh_next */
-        float dh[S];
+        float* dh = grad[2];
         for (int j = 0; j < S; j++)
             dh[j] = dy[t][j] + dh_next[j];
 
         /* Update output gate gradient */
-        float do_[S]; /* 'do' is a C keyword, use do_ for variable name */
+        float* do_ = grad[3]; /* 'do' is a C keyword, use do_ for variable name */
         for (int j = 0; j < S; j++)
             do_[j] = dh[j] * tanh(c[t][j]) * lstm_d_activate(o[t][j]);
         addoutermul(gWo,x[t],do_,D,S);
         addoutermul(gUo,h[t-1],do_,S,S);
         /* Update cell state gradient */
         /* dc = dh * o[t] * tanh_derivative(c[t]) + dc_next */
-        float dc[S];
+        float* dc = grad[4];
         for (int j = 0; j < S; j++)
             dc[j] = dh[j] * o[t][j] * d_tanh(c[t][j]) + dc_next[j];
 
@@ -289,21 +419,21 @@ static inline void lstm_backward(LSTM* restrict l,
          * in forward so instead of d_tanh use d_tanh_x 
          * dcc = dc * i[t] * tanh_x_derivative(cc[t]) 
          */
-        float dcc[S];
+        float* dcc = grad[5];
         for (int j = 0; j < S; j++)
             dcc[j] = dc[j] * i[t][j] * d_tanh_x(cc[t][j]);
         addoutermul(gWc,x[t],dcc,D,S);
         addoutermul(gUc,h[t-1],dcc,S,S);
 
         /* Update input gate gradient */
-        float di[S];
+        float* di = grad[6];
         for (int j = 0; j < S; j++)
             di[j] = dc[j] * cc[t][j] * lstm_d_activate(i[t][j]);
         addoutermul(gWi,x[t],di,D,S);
         addoutermul(gUi,h[t-1],di,S,S);
 
         /* Update forget gate gradient */
-        float df[S];
+        float* df = grad[7];
         for (int j = 0; j < S; j++)
             df[j] = dc[j] * c[t-1][j] * lstm_d_activate(f[t][j]);
         addoutermul(gWf,x[t],df,D,S);
@@ -325,5 +455,6 @@ static inline void lstm_backward(LSTM* restrict l,
             addinnermul(dx[t],do_,l->Wo,D,S);
         }
     }
+    scratch_release(mark);
 }
 #endif
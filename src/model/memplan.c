@@ -0,0 +1,178 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Memory planner of buffers that share a workspace */
+#include <stdio.h>
+#include <stdlib.h>  /* realloc() qsort() */
+#include "mem.h"
+#include "float.h"
+#include "array.h"
+#include "memplan.h"
+
+#define ALIGN 16 /* Floats in 64 bytes */
+
+/* Creates an empty plan.
+ *
+ * Returns:
+ *   Pointer to a plan.
+ */
+MEMPLAN* memplan_create()
+{
+    return allocmem(1,1,MEMPLAN);
+}
+
+/* Adds a buffer to a plan.
+ *
+ * Parameters:
+ *   p     - Pointer to a plan
+ *   name  - Name of the buffer, for memplan_print(); not copied
+ *   buf   - Address of the pointer to the buffer, which memplan_assign()
+ *           sets
+ *   size  - Number of floats in the buffer
+ *   first - First step the buffer is used
+ *   last  - Last step the buffer is used (at least first)
+ */
+void memplan_add(MEMPLAN* p, const char* name, fArr2D* buf, long size,
+                 int first, int last)
+{
+    if (p->num == p->max) {
+        int max = 2 * p->max + 16;
+        MEMBUF* bufs = realloc(p->bufs,max * sizeof(MEMBUF));
+        if (bufs == NULL) {
+            fflush(stdout);
+            fprintf(stderr,"\nIn function '%s': "
+                    "out of memory at file '%s' line %d\n",
+                    __FUNCTION__,__FILE__,__LINE__);
+            exit(-1);
+        }
+        p->bufs = bufs;
+        p->max = max;
+    }
+    MEMBUF* b = &p->bufs[p->num++];
+    b->name = name;
+    b->buf = buf;
+    b->size = size;
+    b->first = first;
+    b->last = (last > first) ? last : first;
+    b->offset = 0;
+}
+
+/* Orders buffers by descending size, then by first step */
+static int compare_size(const void* a_, const void* b_)
+{
+    const MEMBUF* a = *(const MEMBUF**) a_;
+    const MEMBUF* b = *(const MEMBUF**) b_;
+    if (a->size != b->size)
+        return (a->size > b->size) ? -1 : 1;
+    return a->first - b->first;
+}
+
+/* Orders buffers by ascending offset */
+static int compare_offset(const void* a_, const void* b_)
+{
+    const MEMBUF* a = *(const MEMBUF**) a_;
+    const MEMBUF* b = *(const MEMBUF**) b_;
+    return (a->offset > b->offset) - (a->offset < b->offset);
+}
+
+static inline long aligned(long n)
+{
+    return (n + ALIGN - 1) / ALIGN * ALIGN;
+}
+
+/* Places the buffers of a plan in a workspace, and sets their pointers.
+ *
+ * Parameters:
+ *   p     - Pointer to a plan
+ *   share - If not zero, buffers not used in the same steps may share
+ *           memory; otherwise, each buffer has its own memory
+ *
+ * Returns:
+ *   Number of floats in the workspace.
+ *
+ * Notes:
+ *   Buffers are placed largest first, each at the lowest offset that does
+ *   not overlap a buffer already placed whose steps overlap its own.
+ *   Offsets are aligned to 64 bytes. The workspace is initialized to
+ *   zero, but buffers that share memory are not; each step must write a
+ *   buffer before it reads it.
+ */
+long memplan_assign(MEMPLAN* p, int share)
+{
+    const int n = p->num;
+    MEMBUF** order = allocmem(1,n + 1,MEMBUF*);
+    MEMBUF** live = allocmem(1,n + 1,MEMBUF*);
+    for (int i = 0; i < n; i++)
+        order[i] = &p->bufs[i];
+    qsort(order,n,sizeof(MEMBUF*),compare_size);
+    p->size = 0;
+    p->naive = 0;
+    for (int i = 0; i < n; i++) {
+        MEMBUF* b = order[i];
+        long size = aligned(b->size);
+        p->naive += size;
+        long offset = 0;
+        if (share) {
+            /* Placed buffers used in some of the same steps */
+            int cnt = 0;
+            for (int j = 0; j < i; j++)
+                if (order[j]->first <= b->last && b->first <= order[j]->last)
+                    live[cnt++] = order[j];
+            qsort(live,cnt,sizeof(MEMBUF*),compare_offset);
+            /* Lowest gap between them that is large enough */
+            for (int j = 0; j < cnt; j++) {
+                if (live[j]->offset >= offset + size)
+                    break;
+                long end = live[j]->offset + aligned(live[j]->size);
+                if (end > offset)
+                    offset = end;
+            }
+        }
+        else
+            offset = p->size;
+        b->offset = offset;
+        if (offset + size > p->size)
+            p->size = offset + size;
+    }
+    freemem(order);
+    freemem(live);
+    freemem(p->workspace);
+    p->workspace = allocmem(1,p->size + 1,float);
+    for (int i = 0; i < n; i++)
+        *p->bufs[i].buf = (fArr2D) (p->workspace + p->bufs[i].offset);
+    return p->size;
+}
+
+/* Prints the buffers of a plan, their steps and offsets, and the size of
+ * the workspace compared with the size of separate buffers.
+ *
+ * Parameters:
+ *   p - Pointer to a plan
+ *   f - File to print to
+ */
+void memplan_print(const MEMPLAN* p, FILE* f)
+{
+    fprintf(f,"%-20s %10s %6s %6s %10s\n","buffer","floats","first","last",
+            "offset");
+    for (int i = 0; i < p->num; i++) {
+        const MEMBUF* b = &p->bufs[i];
+        fprintf(f,"%-20s %10ld %6d %6d %10ld\n",b->name,b->size,b->first,
+                b->last,b->offset);
+    }
+    fprintf(f,"Workspace %.1f MB, separate buffers %.1f MB (%.0f%%)\n",
+            p->size * sizeof(float) / 1e6,p->naive * sizeof(float) / 1e6,
+            (p->naive > 0) ? 100.0 * p->size / p->naive : 100.0);
+}
+
+/* Frees a plan and its workspace. Pointers of the buffers are not valid
+ * after this call.
+ *
+ * Parameters:
+ *   p - Pointer to a plan, may be NULL
+ */
+void memplan_free(MEMPLAN* p)
+{
+    if (p == NULL)
+        return;
+    free(p->bufs);
+    freemem(p->workspace);
+    freemem(p);
+}
@@ -0,0 +1,97 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Memory planner of buffers that share a workspace */
+#ifndef MEMPLAN_H
+#define MEMPLAN_H
+#include <stdio.h>
+#include "float.h"
+#include "array.h"
+
+/* Training runs the layers' forward passes, computes the loss, then runs
+ * the layers' backward passes in reverse order: a fixed schedule of steps.
+ * Many buffers are used only during some of those steps, for example,
+ * the gradients of a layer's backward pass, or the input gradient of a
+ * layer, which is written by the backward pass of the next layer and read
+ * by its own. Buffers that are not used during the same steps can be in
+ * the same memory.
+ *
+ * A plan lists buffers with their size and the first and last steps they
+ * are used; memplan_assign() places them at offsets in one workspace, so
+ * that buffers whose steps overlap do not overlap in memory, and sets the
+ * buffers' pointers to their place in the workspace.
+ */
+typedef struct {
+    const char* name; /* Name of buffer, for memplan_print()         */
+    fArr2D* buf;      /* Address of the pointer to the buffer        */
+    long size;        /* Number of floats                            */
+    int first;        /* First step the buffer is used               */
+    int last;         /* Last step the buffer is used                */
+    long offset;      /* Offset in workspace, set by memplan_assign() */
+} MEMBUF;
+
+typedef struct {
+    int num;          /* Number of buffers                           */
+    int max;          /* Number of buffers bufs has room for         */
+    MEMBUF* bufs;     /* Buffers                                     */
+    float* workspace; /* Memory of all the buffers                   */
+    long size;        /* Number of floats in workspace               */
+    long naive;       /* Number of floats in all the buffers         */
+} MEMPLAN;
+
+/* Creates an empty plan.
+ *
+ * Returns:
+ *   Pointer to a plan.
+ */
+MEMPLAN* memplan_create();
+
+/* Adds a buffer to a plan.
+ *
+ * Parameters:
+ *   p     - Pointer to a plan
+ *   name  - Name of the buffer, for memplan_print(); not copied
+ *   buf   - Address of the pointer to the buffer, which memplan_assign()
+ *           sets
+ *   size  - Number of floats in the buffer
+ *   first - First step the buffer is used
+ *   last  - Last step the buffer is used (at least first)
+ */
+void memplan_add(MEMPLAN* p, const char* name, fArr2D* buf, long size,
+                 int first, int last);
+
+/* Places the buffers of a plan in a workspace, and sets their pointers.
+ *
+ * Parameters:
+ *   p     - Pointer to a plan
+ *   share - If not zero, buffers not used in the same steps may share
+ *           memory; otherwise, each buffer has its own memory
+ *
+ * Returns:
+ *   Number of floats in the workspace.
+ *
+ * Notes:
+ *   Buffers are placed largest first, each at the lowest offset that does
+ *   not overlap a buffer already placed whose steps overlap its own.
+ *   Offsets are aligned to 64 bytes. The workspace is initialized to
+ *   zero, but buffers that share memory are not; each step must write a
+ *   buffer before it reads it.
+ */
+long memplan_assign(MEMPLAN* p, int share);
+
+/* Prints the buffers of a plan, their steps and offsets, and the size of
+ * the workspace compared with the size of separate buffers.
+ *
+ * Parameters:
+ *   p - Pointer to a plan
+ *   f - File to print to
+ */
+void memplan_print(const MEMPLAN* p, FILE* f);
+
+/* Frees a plan and its workspace. Pointers of the buffers are not valid
+ * after this call.
+ *
+ * Parameters:
+ *   p - Pointer to a plan, may be NULL
+ */
+void memplan_free(MEMPLAN* p);
+
+#endif
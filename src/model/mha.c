@@ -1,6 +1,7 @@
 /* Copyright (c) 2026 Gilad Odinak */
 /* Multi-Head Attention layer functions */
 #include <stdio.h>
+#include <string.h>
 #include "mem.h"
 #include "random.h"
 #include "rope.h"
@@ -14,23 +15,41 @@
  * Parameters:
  *   heads     - Number of attention heads H. The model dimension passed
  *               to mha_init() must be an integer multiple of heads.
- *   steps     - Sequence length T (number of tokens/frames per sequence).
+ *   steps     - Maximum sequence length T (number of tokens/frames per 
+ *               sequence). Shorter sequences can be processed after
+ *               setting the actual length with mha_set_shape().
  *   lookahead - Causal-masking control, fixed for the life of the layer:
  *                 < 0  no masking, fully bidirectional (encoder)
  *                 = 0  strictly causal, no future context (decoder/streaming)
  *                 = L  causal with L frames of future context (bounded latency)
  *               Position i may attend to position j only when
  *               j <= i + lookahead. Independent of the padding mask.
+ *   attention - "softmax" - scaled dot-product attention, O(T^2) time
+ *               and memory per sequence; or "linear" - kernelized 
+ *               attention (see mha_head_linear()), O(T) time and memory.
  *
  * Returns:
  *   Pointer to a zero-initialised MHA layer. Call mha_init() before use.
  */
-MHA* mha_create(int heads, int steps, int lookahead)
+MHA* mha_create(int heads, int steps, int lookahead, const char* attention)
 {
+    char a = 0;
+    if (!strcmp(attention,"softmax"))
+        a = 's';
+    else
+    if (!strcmp(attention,"linear"))
+        a = 'l';
+    else {
+        fflush(stdout);
+        fprintf(stderr,"mha_create: invalid attention '%s'\n",attention);
+        exit(-1);
+    }
     MHA* l = allocmem(1,1,MHA);
     l->H = heads;
     l->T = steps;
+    l->Tmax = steps;
     l->lookahead = lookahead;
+    l->attention = a;
     return l;
 }
 
@@ -46,7 +65,7 @@ MHA* mha_create(int heads, int steps, int lookahead)
  *   input_dim    - Model dimension D. Must be an integer multiple of the
  *                  head count H; the per-head dimension is Dh = D / H.
  *                  If not divisible, the function prints an error and exits.
- *   batch_size   - Number of sequences processed simultaneously, B.
+ *   batch_size   - Maximum number of sequences processed simultaneously, B.
  *   training     - Non-zero to allocate backward/gradient buffers (required
  *                  before mha_backward()); 0 for inference-only.
  *   dropout_rate - Fraction of attention weights to zero during training
@@ -55,6 +74,7 @@ MHA* mha_create(int heads, int steps, int lookahead)
  * Notes:
  *   Projection weights are drawn from a normal distribution with standard
  *   deviation sqrt(1/D).
+ *   A layer of linear attention does not allocate the [T][T] buffers.
  */
 void mha_init(MHA* l, int input_dim, int batch_size, int training, float dropout_rate)
 {
@@ -67,6 +87,7 @@ void mha_init(MHA* l, int input_dim, int batch_size, int training, float dropout
     l->D = input_dim;
     l->Dh = input_dim / l->H;   
     l->B = batch_size;
+    l->Bmax = batch_size;
     l->BT = l->B * l->T;
     l->BHT = l->B * l->H * l->T;
 
@@ -88,10 +109,13 @@ void mha_init(MHA* l, int input_dim, int batch_size, int training, float dropout
     l->Kh = allocmem(l->BHT,l->Dh,float);
     l->Vh = allocmem(l->BHT,l->Dh,float);
 
-    l->Att = allocmem(l->BHT,l->T,float);
-    l->AttMask = allocmem(l->BHT,l->T,float);
-
-    l->Scores = allocmem(l->T,l->T,float);
+    if (l->attention == 'l')
+        l->Den = allocmem(1,l->BHT,float);
+    else {
+        l->Att = allocmem(l->BHT,l->T,float);
+        l->AttMask = allocmem(l->BHT,l->T,float);
+        l->Scores = allocmem(l->T,l->T,float);
+    }
     l->Oh = allocmem(l->T,l->Dh,float);
     
     l->Out = allocmem(l->BT,l->D,float);
@@ -124,8 +148,10 @@ void mha_init(MHA* l, int input_dim, int batch_size, int training, float dropout
     l->dVh = allocmem(l->T,l->Dh,float);
 
     l->dOh = allocmem(l->T,l->Dh,float);
-    l->dAtt = allocmem(l->T,l->T,float);
-    l->dScores = allocmem(l->T,l->T,float);
+    if (l->attention != 'l') {
+        l->dAtt = allocmem(l->T,l->T,float);
+        l->dScores = allocmem(l->T,l->T,float);
+    }
 
     l->gWq = allocmem(l->D,l->D,float);
     l->gWk = allocmem(l->D,l->D,float);
@@ -137,7 +163,8 @@ void mha_init(MHA* l, int input_dim, int batch_size, int training, float dropout
  *
  * Frees the projection weights, RoPE table, forward scratch buffers, and
  * (when allocated) the backward and parameter-gradient buffers, then frees
- * the layer itself.
+ * the layer itself. Scratch buffers placed in a model's workspace (see
+ * layer_plan()) are not freed.
  *
  * Parameters:
  *   l - Pointer to the MHA layer to free. Must not be used afterwards.
@@ -149,9 +176,23 @@ void mha_free(MHA* l)
     freemem(l->Wv);
     freemem(l->Wo);
 
-    freemem(l->Q);
-    freemem(l->K);
-    freemem(l->V);
+    if (!l->planned) { /* Otherwise, see layer_plan() */
+        freemem(l->Q);
+        freemem(l->K);
+        freemem(l->V);
+        freemem(l->Scores);
+        freemem(l->Oh);
+        freemem(l->dOut);
+        freemem(l->dQ);
+        freemem(l->dK);
+        freemem(l->dV);
+        freemem(l->dQh);
+        freemem(l->dKh);
+        freemem(l->dVh);
+        freemem(l->dOh);
+        freemem(l->dAtt);
+        freemem(l->dScores);
+    }
 
     freemem(l->theta);
 
@@ -161,27 +202,10 @@ void mha_free(MHA* l)
 
     freemem(l->Att);
     freemem(l->AttMask);
+    freemem(l->Den);
 
-    freemem(l->Scores);
-    freemem(l->Oh);
-    
     freemem(l->Out);
 
-    /* backward buffers */
-    freemem(l->dOut);
-
-    freemem(l->dQ);
-    freemem(l->dK);
-    freemem(l->dV);
-
-    freemem(l->dQh);
-    freemem(l->dKh);
-    freemem(l->dVh);
-
-    freemem(l->dOh);
-    freemem(l->dAtt);
-    freemem(l->dScores);
-
     freemem(l->gWq);
     freemem(l->gWk);
     freemem(l->gWv);
@@ -189,3 +213,34 @@ void mha_free(MHA* l)
 
     freemem(l);
 }
+
+/* Creates the state of a session of a layer of linear attention, with no
+ * tokens, see mha_forward_recurrent().
+ *
+ * Parameters:
+ *   l - Pointer to an initialized MHA layer
+ *
+ * Returns:
+ *   Pointer to a session state.
+ */
+MHASTATE* mha_state_create(const MHA* l)
+{
+    MHASTATE* s = allocmem(1,1,MHASTATE);
+    s->S = allocmem(l->H * l->Dh,l->Dh,float);
+    s->z = allocmem(l->H,l->Dh,float);
+    return s;
+}
+
+/* Frees a session state created by mha_state_create().
+ *
+ * Parameters:
+ *   s - Pointer to a session state, may be NULL
+ */
+void mha_state_free(MHASTATE* s)
+{
+    if (s == NULL)
+        return;
+    freemem(s->S);
+    freemem(s->z);
+    freemem(s);
+}
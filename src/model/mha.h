@@ -2,16 +2,23 @@
 /* Multi-Head Attention layer data structures and functions */
 /* References:
  * Attention Is All You Need, 2023. https://arxiv.org/pdf/1706.03762v7 
+ * Transformers are RNNs: Fast Autoregressive Transformers with Linear
+ * Attention, 2020. https://arxiv.org/abs/2006.16236
  * Roformer: Enhanced transformer with Rotary Position Embedding, 2023.
  * https://arxiv.org/pdf/2104.09864
  */
 #ifndef MHA_H
 #define MHA_H
+#include <stdio.h>
+#include <stdlib.h>
 #include "float.h"
 #include "array.h"
 #include "activation.h"
 #include "dropout.h"
 #include "rope.h"
+#include "shapes.h"
+#include "autotune.h"
+#include "kvcache.h"
 
 typedef struct {
     /* dimensions */
@@ -22,10 +29,15 @@ typedef struct {
     int Dh;     /* D / H */
     int BT;     /* B * T */
     int BHT;    /* B * H * T */
+    int Bmax;   /* batch size buffers are allocated for */
+    int Tmax;   /* sequence length buffers are allocated for */
 
     int lookahead;      /* causal masking, set at create time below  */
+    char attention;     /* (s)oftmax or (l)inear, set at create time */
     int training;       /* 1 if training, 0 if inference             */
     float dropout_rate; /* fraction of attention weights to zero out */
+    int kernel;         /* projections' matrix product, see autotune.h */
+    int planned;        /* scratch buffers are in a model's workspace  */
 
     fArr2D Wq;  /* [D][D] */
     fArr2D Wk;  /* [D][D] */
@@ -48,6 +60,7 @@ typedef struct {
 
     fArr2D Att;     /* [BHT][T] row (b*H+h)*T+t */
     fArr2D AttMask; /* [BHT][T] row (b*H+h)*T+t */
+    fVec Den;       /* [BHT]    row (b*H+h)*T+t, linear attention */
 
     fArr2D Scores;  /* [T][T]   scratch, not persisted */
     fArr2D Oh;      /* [T][Dh]  scratch, not persisted */
@@ -68,6 +81,9 @@ typedef struct {
     fArr2D dOh;     /* [T][Dh] */
     fArr2D dAtt;    /* [T][T]  */
     fArr2D dScores; /* [T][T]  */
+    /* Att, AttMask, Scores, dAtt and dScores are allocated for softmax
+     * attention only, Den for linear attention only.
+     */
 
     /* parameter gradients */
     fArr2D gWq;     /* [D][D] */
@@ -77,6 +93,15 @@ typedef struct {
 
 } MHA;
 
+/* State of a session of a layer of linear attention, see
+ * mha_forward_recurrent()
+ */
+typedef struct {
+    int len;    /* Number of tokens of the session                  */
+    float* S;   /* Sums of keys by values of each head [H][Dh][Dh]   */
+    float* z;   /* Sums of keys of each head [H][Dh]                */
+} MHASTATE;
+
 /* Creates a Multi-Head Attention layer.
  *
  * Allocates the MHA container and records its structural parameters.
@@ -85,18 +110,23 @@ typedef struct {
  * Parameters:
  *   heads     - Number of attention heads H. The model dimension passed
  *               to mha_init() must be an integer multiple of heads.
- *   steps     - Sequence length T (number of tokens/frames per sequence).
+ *   steps     - Maximum sequence length T (number of tokens/frames per 
+ *               sequence). Shorter sequences can be processed after
+ *               setting the actual length with mha_set_shape().
  *   lookahead - Causal-masking control, fixed for the life of the layer:
  *                 < 0  no masking, fully bidirectional (encoder)
  *                 = 0  strictly causal, no future context (decoder/streaming)
  *                 = L  causal with L frames of future context (bounded latency)
  *               Position i may attend to position j only when
  *               j <= i + lookahead. Independent of the padding mask.
+ *   attention - "softmax" - scaled dot-product attention, O(T^2) time
+ *               and memory per sequence; or "linear" - kernelized 
+ *               attention (see mha_head_linear()), O(T) time and memory.
  *
  * Returns:
  *   Pointer to a zero-initialised MHA layer. Call mha_init() before use.
  */
-MHA* mha_create(int heads, int steps, int lookahead);
+MHA* mha_create(int heads, int steps, int lookahead, const char* attention);
 
 /* Initialises an MHA layer created by mha_create().
  *
@@ -110,7 +140,7 @@ MHA* mha_create(int heads, int steps, int lookahead);
  *   input_dim    - Model dimension D. Must be an integer multiple of the
  *                  head count H; the per-head dimension is Dh = D / H.
  *                  If not divisible, the function prints an error and exits.
- *   batch_size   - Number of sequences processed simultaneously, B.
+ *   batch_size   - Maximum number of sequences processed simultaneously, B.
  *   training     - Non-zero to allocate backward/gradient buffers (required
  *                  before mha_backward()); 0 for inference-only.
  *   dropout_rate - Fraction of attention weights to zero during training
@@ -133,6 +163,304 @@ void mha_init(MHA* l, int input_dim, int batch_size, int training, float dropout
  */
 void mha_free(MHA* l);
 
+/* Creates the state of a session of a layer of linear attention, with no
+ * tokens, see mha_forward_recurrent().
+ *
+ * Parameters:
+ *   l - Pointer to an initialized MHA layer
+ *
+ * Returns:
+ *   Pointer to a session state.
+ */
+MHASTATE* mha_state_create(const MHA* l);
+
+/* Frees a session state created by mha_state_create().
+ *
+ * Parameters:
+ *   s - Pointer to a session state, may be NULL
+ */
+void mha_state_free(MHASTATE* s);
+
+/* Sets the batch size and sequence length of the next forward and backward
+ * passes, without reallocating memory; the passes use a prefix of the 
+ * buffers allocated by mha_init().
+ *
+ * Parameters:
+ *   l          - Pointer to the MHA layer
+ *   batch_size - Number of sequences B
+ *   steps      - Sequence length T, at most the length set by mha_create()
+ *
+ * Notes:
+ *   B * T must not exceed the number of rows the layer was initialized 
+ *   with, so fewer long sequences, or more short sequences, can be used.
+ */
+static inline void mha_set_shape(MHA* l, int batch_size, int steps)
+{
+    if (steps < 1 || steps > l->Tmax || batch_size < 1 ||
+        batch_size * steps > l->Bmax * l->Tmax) {
+        fflush(stdout);
+        fprintf(stderr,"mha_set_shape: shape %d x %d exceeds %d x %d\n",
+                batch_size,steps,l->Bmax,l->Tmax);
+        exit(-1);
+    }
+    l->B = batch_size;
+    l->T = steps;
+    l->BT = l->B * l->T;
+    l->BHT = l->B * l->H * l->T;
+}
+
+/* Steps 2 to 4 of mha_forward(), below, of batch item b and head h, with
+ * head dimension Dh, which may be a constant (see shapes.h).
+ */
+SHAPE_INLINE void mha_head_forward(MHA* restrict l,
+                                   const iVec restrict pad_mask/*[BT]*/,
+                                   int b, int h, int offset, int Dh)
+{
+    const int T = l->T;
+    const int D = l->D;
+    const int H = l->H;
+    const int lookahead = l->lookahead;
+
+    typedef float (*ArrBTD)[D];
+    typedef float (*ArrBHTDh)[Dh];
+    typedef float (*ArrTDh)[Dh];
+    typedef float (*ArrTT)[T];
+    typedef float (*ArrBHTT)[T];
+
+    ArrBTD Q = (ArrBTD) l->Q;
+    ArrBTD K = (ArrBTD) l->K;
+    ArrBTD V = (ArrBTD) l->V;
+
+    ArrBHTDh Qh = (ArrBHTDh) l->Qh;
+    ArrBHTDh Kh = (ArrBHTDh) l->Kh;
+    ArrBHTDh Vh = (ArrBHTDh) l->Vh;
+
+    ArrTT Scores = (ArrTT) l->Scores;
+    ArrBHTT Att = (ArrBHTT) l->Att;
+    ArrBHTT AttMask = (ArrBHTT) l->AttMask;
+    ArrTDh Oh = (ArrTDh) l->Oh;
+
+    ArrBTD Out = (ArrBTD) l->Out;
+
+    int base = (b * H + h) * T; /* row offset into [BHT][...] buffers */
+
+    /* Step 2 - Split into heads (Sec. 3.2.2):
+     * Qh = Q[b*T:(b+1)*T, h*Dh:(h+1)*Dh]
+     * Kh = K[b*T:(b+1)*T, h*Dh:(h+1)*Dh]
+     * Vh = V[b*T:(b+1)*T, h*Dh:(h+1)*Dh]
+     */
+    for (int t = 0; t < T; t++) {
+        int r = b * T + t;
+        fltcpy(&Qh[base+t][0],&Q[r][h*Dh],Dh);
+        fltcpy(&Kh[base+t][0],&K[r][h*Dh],Dh);
+        fltcpy(&Vh[base+t][0],&V[r][h*Dh],Dh);
+    }
+
+    rope_apply(&Qh[base],l->theta,0,offset,T,Dh);
+    rope_apply(&Kh[base],l->theta,0,offset,T,Dh);
+
+    /* Step 3 - Scaled dot-product attention (in Eq. 1, Sec. 3.2.1):
+     * Scores = Qh @ Kh.T / sqrt(Dh)
+     * Scores[i][j] = -1e9 for j > i + lookahead  (causal/lookahead mask)
+     * Att = softmax(Scores)
+     * Oh  = Att @ Vh
+     */
+    /* The products are written out, rather than calling matmulT() and
+     * matmul(), so that loops over Dh are compiled for a constant Dh */
+    float s = 1.0f / sqrtf((float)Dh);
+    for (int i = 0; i < T; i++) {
+        const float* q = Qh[base + i];
+        for (int j = 0; j < T; j++) {
+            const float* k = Kh[base + j];
+            float dot = 0;
+            for (int d = 0; d < Dh; d++)
+                dot += q[d] * k[d];
+            Scores[i][j] = dot * s;
+        }
+    }
+
+    /* Causal / lookahead masking (Sec. 3.2.3, Fig. 2 generalised).
+     *   lookahead <  0 : skip - fully bidirectional attention
+     *   lookahead == 0 : strictly causal (mask every future frame)
+     *   lookahead == L : allow L future frames, mask beyond that
+     * Position i attends to j only where j <= i + lookahead. */
+    if (lookahead >= 0) {
+        for (int i = 0; i < T; i++)
+            for (int j = i + lookahead + 1; j < T; j++)
+                Scores[i][j] = -1e9f;
+    }
+
+    if (pad_mask != NULL) {
+        for (int i = 0; i < T; i++)
+            if (!pad_mask[b * T + i])
+                for (int j = 0; j < T; j++)
+                    Scores[j][i] = -1e9f;
+    }
+
+    /* Compute attention probabilities - Softmax - in Eq. 1 */
+    softmax(Scores, T, T);
+
+    /* Store this head's attention weights for backward */
+    fltcpy(&Att[base], Scores, T * T);
+
+    if (l->training && l->dropout_rate > 0)
+        dropout(&Att[base],&AttMask[base],T,T,l->dropout_rate);
+
+    /* in Eq. 1: Attention @ V */
+    for (int i = 0; i < T; i++) {
+        float o[Dh];
+        for (int d = 0; d < Dh; d++)
+            o[d] = 0;
+        for (int j = 0; j < T; j++) {
+            float a = Att[base + i][j];
+            const float* v = Vh[base + j];
+            for (int d = 0; d < Dh; d++)
+                o[d] += a * v[d];
+        }
+        fltcpy(Oh[i],o,Dh);
+    }
+
+    /* Step 4 - Concatenate heads and project (Eq. 2, Sec. 3.2.2):
+     * Out = Concat(Oh_0, ..., Oh_{H-1})
+     */
+    for (int t = 0;t < T; t++) {
+        int r= b * T + t;
+        fltcpy(&Out[r][h * Dh], &Oh[t][0], Dh);
+    }
+}
+
+/* The feature map of linear attention, elu(x) + 1, which is positive */
+static inline float mha_feature(float x)
+{
+    return (x > 0) ? x + 1 : expf(x);
+}
+
+/* Returns the derivative of mha_feature() at x, given f = mha_feature(x) */
+static inline float mha_d_feature(float f)
+{
+    return (f > 1) ? 1 : f;
+}
+
+/* Adds R(pos) k v^T to S [Dh][Dh], and w k to z [Dh], where R(pos) is the
+ * RoPE rotation of position pos.
+ */
+SHAPE_INLINE void mha_linear_add(fArr2D restrict S_, fVec restrict z,
+                                 const fVec restrict k, const fVec restrict v,
+                                 float w, const float* theta, int pos,
+                                 int Dh)
+{
+    typedef float (*ArrDhDh)[Dh];
+    ArrDhDh S = (ArrDhDh) S_;
+    float rk[Dh];
+    fltcpy(rk,k,Dh);
+    rope_kernel((fArr2D) rk,theta,0,pos,1,Dh);
+    for (int a = 0; a < Dh; a++)
+        for (int d = 0; d < Dh; d++)
+            S[a][d] += rk[a] * v[d];
+    for (int a = 0; a < Dh; a++)
+        z[a] += w * k[a];
+}
+
+/* Sets o to the linear attention output of query q at position pos, given
+ * the sums S and z of its keys (see mha_linear_add()), and returns the
+ * normalizer q.z; o is zero if it is 0 (no keys).
+ */
+SHAPE_INLINE float mha_linear_out(fVec restrict o, const fArr2D restrict S_,
+                                  const fVec restrict z, const fVec restrict q,
+                                  const float* theta, int pos, int Dh)
+{
+    typedef float (*ArrDhDh)[Dh];
+    const ArrDhDh S = (const ArrDhDh) S_;
+    float rq[Dh];
+    fltcpy(rq,q,Dh);
+    rope_kernel((fArr2D) rq,theta,0,pos,1,Dh);
+    float den = 0;
+    for (int a = 0; a < Dh; a++)
+        den += q[a] * z[a];
+    for (int d = 0; d < Dh; d++)
+        o[d] = 0;
+    for (int a = 0; a < Dh; a++)
+        for (int d = 0; d < Dh; d++)
+            o[d] += rq[a] * S[a][d];
+    float s = (den > 0) ? 1 / den : 0;
+    for (int d = 0; d < Dh; d++)
+        o[d] *= s;
+    return den;
+}
+
+/* Steps 2 to 4 of mha_forward(), below, of batch item b and head h, of a
+ * layer of linear attention, with head dimension Dh, which may be a 
+ * constant (see shapes.h).
+ *
+ * The softmax of scores is replaced by a product of features of queries
+ * and keys, q = phi(Qh), k = phi(Kh), where phi() is mha_feature():
+ *   Oh[i] = sum_j (R(i) q[i]).(R(j) k[j]) Vh[j] / sum_j q[i].k[j]
+ * over the keys j <= i + lookahead, where R(t) is the RoPE rotation of 
+ * position t (Roformer Sec. 3.3, Eq. 19). The sums over j are the
+ * products of q[i] by S = sum_j R(j) k[j] Vh[j]^T [Dh][Dh] and by
+ * z = sum_j k[j] [Dh], which are prefix sums over the keys, so a head
+ * takes O(T Dh^2) time, rather than O(T^2 Dh), and no [T][T] memory.
+ *
+ * Qh and Kh keep the features q and k, not rotated, for backward, and
+ * Den the normalizers q[i].z. Keys of padding are zero, so they are not
+ * added to the sums. Attention weights are not computed, so there is no
+ * dropout.
+ */
+SHAPE_INLINE void mha_head_linear(MHA* restrict l,
+                                  const iVec restrict pad_mask/*[BT]*/,
+                                  int b, int h, int offset, int Dh)
+{
+    const int T = l->T;
+    const int D = l->D;
+    const int H = l->H;
+    const int lookahead = l->lookahead;
+
+    typedef float (*ArrBTD)[D];
+    typedef float (*ArrBHTDh)[Dh];
+
+    ArrBTD Q = (ArrBTD) l->Q;
+    ArrBTD K = (ArrBTD) l->K;
+    ArrBTD V = (ArrBTD) l->V;
+    ArrBHTDh Qh = (ArrBHTDh) l->Qh;
+    ArrBHTDh Kh = (ArrBHTDh) l->Kh;
+    ArrBHTDh Vh = (ArrBHTDh) l->Vh;
+    ArrBTD Out = (ArrBTD) l->Out;
+
+    int base = (b * H + h) * T; /* row offset into [BHT][...] buffers */
+
+    /* Step 2 - Split into heads, features of queries and keys */
+    for (int t = 0; t < T; t++) {
+        int r = b * T + t;
+        int pad = (pad_mask != NULL && !pad_mask[r]);
+        for (int d = 0; d < Dh; d++)
+            Qh[base + t][d] = mha_feature(Q[r][h * Dh + d]);
+        for (int d = 0; d < Dh; d++)
+            Kh[base + t][d] = (pad) ? 0 : mha_feature(K[r][h * Dh + d]);
+        fltcpy(&Vh[base + t][0],&V[r][h * Dh],Dh);
+    }
+
+    /* Step 3 - Linear attention, keys added to the sums as the queries
+     * that attend to them are reached
+     */
+    SCRATCH_MARK mark = scratch_mark();
+    float* S = scratchmem(Dh,Dh,float);
+    float* z = scratchmem(1,Dh,float);
+    fltclr(S,Dh * Dh);
+    fltclr(z,Dh);
+    for (int i = 0, n = 0; i < T; i++) {
+        const int last = (lookahead < 0 || i + lookahead >= T) 
+                       ? T - 1 : i + lookahead;
+        for (; n <= last; n++)
+            mha_linear_add((fArr2D) S,z,Kh[base + n],Vh[base + n],1.0,
+                           l->theta,offset + n,Dh);
+        /* Step 4 - Concatenate heads */
+        l->Den[base + i] = mha_linear_out(&Out[b * T + i][h * Dh],(fArr2D) S,
+                                          z,Qh[base + i],l->theta,
+                                          offset + i,Dh);
+    }
+    scratch_release(mark);
+}
+
 /* mha_forward - forward pass of Multi-Head Attention (MHA) layer
  *
  * This function computes the multi-head attention output for a batch
@@ -185,6 +513,9 @@ void mha_free(MHA* l);
  *       batch, so that mha_backward can read back exactly what forward
  *       computed for each (b,h) without recomputing it.
  *
+ * Note: A layer of linear attention replaces step 3 with
+ *       mha_head_linear().
+ *
  * Reference:
  *   - Vaswani et al., "Attention Is All You Need", 2017
  */
@@ -197,19 +528,13 @@ static inline void mha_forward(MHA* restrict l,
 {
     (void) lyr;
     const int B = l->B;
-    const int T = l->T;
     const int D = l->D;
     const int H = l->H;
     const int Dh = l->Dh;
     const int BT = l->BT;
-    const int lookahead = l->lookahead;
 
     typedef float (*ArrDD)[D];
     typedef float (*ArrBTD)[D];
-    typedef float (*ArrBHTDh)[Dh];
-    typedef float (*ArrTDh)[Dh];
-    typedef float (*ArrTT)[T];
-    typedef float (*ArrBHTT)[T];
 
     ArrDD Wq = (ArrDD) l->Wq;
     ArrDD Wk = (ArrDD) l->Wk;
@@ -219,103 +544,378 @@ static inline void mha_forward(MHA* restrict l,
     ArrBTD Q = (ArrBTD) l->Q;
     ArrBTD K = (ArrBTD) l->K;
     ArrBTD V = (ArrBTD) l->V;
-
-    ArrBHTDh Qh = (ArrBHTDh) l->Qh;
-    ArrBHTDh Kh = (ArrBHTDh) l->Kh;
-    ArrBHTDh Vh = (ArrBHTDh) l->Vh;
-
-    ArrTT Scores = (ArrTT) l->Scores;
-    ArrBHTT Att = (ArrBHTT) l->Att;
-    ArrBHTT AttMask = (ArrBHTT) l->AttMask;
-    ArrTDh Oh = (ArrTDh) l->Oh;
-
     ArrBTD Out = (ArrBTD) l->Out;
 
     /* Step 1 - Linear projections (in Eq. 1, Sec. 3.2.2):
      * Q = X @ Wq,  K = X @ Wk,  V = X @ Wv
      */
-    matmul(Q,X,Wq,BT,D,D);
-    matmul(K,X,Wk,BT,D,D);
-    matmul(V,X,Wv,BT,D,D);
+    matmul_kernel(l->kernel,Q,X,Wq,BT,D,D);
+    matmul_kernel(l->kernel,K,X,Wk,BT,D,D);
+    matmul_kernel(l->kernel,V,X,Wv,BT,D,D);
     fltclr(Out,BT * D);
 
-    for (int b = 0; b < B; b++) {
-        for (int h = 0; h < H; h++) {
+    for (int b = 0; b < B; b++)
+        for (int h = 0; h < H; h++)
+            if (l->attention == 'l')
+                SHAPE_SPECIALIZE(HEAD_DIM_SHAPES,Dh,
+                                 mha_head_linear(l,pad_mask,b,h,offset,Dh));
+            else
+                SHAPE_SPECIALIZE(HEAD_DIM_SHAPES,Dh,
+                                 mha_head_forward(l,pad_mask,b,h,offset,Dh));
+    /* Step 4 continued - output projection (Eq. 2, Sec. 3.2.2):
+     * Y = Out @ Wo
+     */
+    if (Y != NULL)
+        matmul_kernel(l->kernel,Y,Out,Wo,BT,D,D);
+}
 
-            int base = (b * H + h) * T; /* row offset into [BHT][...] buffers */
+/* Steps 2 and 3 of mha_forward_paged(), below, of session b and head h,
+ * with head dimension Dh, which may be a constant (see shapes.h).
+ */
+SHAPE_INLINE void mha_head_paged(MHA* restrict l, const KVPOOL* restrict p,
+                                 const KVSEQ* restrict s,
+                                 int b, int h, int kv_lyr, int Dh)
+{
+    const int T = l->T;
+    const int D = l->D;
+    const int block = p->block;
+    const int pos = s->len;
 
-            /* Step 2 - Split into heads (Sec. 3.2.2):
-             * Qh = Q[b*T:(b+1)*T, h*Dh:(h+1)*Dh]
-             * Kh = K[b*T:(b+1)*T, h*Dh:(h+1)*Dh]
-             * Vh = V[b*T:(b+1)*T, h*Dh:(h+1)*Dh]
-             */
-            for (int t = 0; t < T; t++) {
-                int r = b * T + t;
-                fltcpy(&Qh[base+t][0],&Q[r][h*Dh],Dh);
-                fltcpy(&Kh[base+t][0],&K[r][h*Dh],Dh);
-                fltcpy(&Vh[base+t][0],&V[r][h*Dh],Dh);
-            }
+    typedef float (*ArrBTD)[D];
 
-            rope_apply(&Qh[base],l->theta,0,offset,T,Dh);
-            rope_apply(&Kh[base],l->theta,0,offset,T,Dh);
+    ArrBTD Q = (ArrBTD) l->Q;
+    ArrBTD K = (ArrBTD) l->K;
+    ArrBTD V = (ArrBTD) l->V;
+    ArrBTD Out = (ArrBTD) l->Out;
+    float* scores = (float*) l->Scores; /* Tmax scores of a query */
 
-            /* Step 3 - Scaled dot-product attention (in Eq. 1, Sec. 3.2.1):
-             * Scores = Qh @ Kh.T / sqrt(Dh)
-             * Scores[i][j] = -1e9 for j > i + lookahead  (causal/lookahead mask)
-             * Att = softmax(Scores)
-             * Oh  = Att @ Vh
-             */
-            matmulT(Scores,&Qh[base],&Kh[base],T,Dh,T);
-
-            float s = 1.0f / sqrtf((float)Dh);
-            for(int i = 0; i < T; i++)
-                for(int j = 0; j < T; j++)
-                    Scores[i][j] *= s;
-
-            /* Causal / lookahead masking (Sec. 3.2.3, Fig. 2 generalised).
-             *   lookahead <  0 : skip - fully bidirectional attention
-             *   lookahead == 0 : strictly causal (mask every future frame)
-             *   lookahead == L : allow L future frames, mask beyond that
-             * Position i attends to j only where j <= i + lookahead. */
-            if (lookahead >= 0) {
-                for (int i = 0; i < T; i++)
-                    for (int j = i + lookahead + 1; j < T; j++)
-                        Scores[i][j] = -1e9f;
+    /* Step 2 - Keys and values of the new tokens, of head h, are written
+     * to the cache at their positions, the keys rotated (RoPE)
+     */
+    for (int t = 0; t < T; t++) {
+        int r = b * T + t;
+        float* k = kv_key(p,s,kv_lyr,pos + t) + h * Dh;
+        float* v = k + block * D;
+        fltcpy(k,&K[r][h * Dh],Dh);
+        fltcpy(v,&V[r][h * Dh],Dh);
+        rope_apply((fArr2D) k,l->theta,0,pos + t,1,Dh);
+    }
+
+    /* Step 3 - Scaled dot-product attention of each new token over the
+     * tokens up to it, at most Tmax of them, read block by block
+     */
+    float sc = 1.0f / sqrtf((float)Dh);
+    for (int i = 0; i < T; i++) {
+        int r = b * T + i;
+        const int last = pos + i;
+        const int first = (last - l->Tmax + 1 > 0) ? last - l->Tmax + 1 : 0;
+        float q[Dh];
+        fltcpy(q,&Q[r][h * Dh],Dh);
+        rope_apply((fArr2D) q,l->theta,0,last,1,Dh);
+
+        float m = -1e30f;
+        for (int j = first; j <= last; ) {
+            const float* kb = kv_block(p,s->table[j / block],kv_lyr) + h * Dh;
+            const int end = (last < (j / block + 1) * block - 1)
+                          ? last : (j / block + 1) * block - 1;
+            for (; j <= end; j++) {
+                const float* k = kb + (long) (j % block) * D;
+                float dot = 0;
+                for (int d = 0; d < Dh; d++)
+                    dot += q[d] * k[d];
+                scores[j - first] = dot * sc;
+                if (m < scores[j - first])
+                    m = scores[j - first];
             }
+        }
+        float sum = 0.0;
+        for (int j = 0; j <= last - first; j++) {
+            scores[j] = exp(scores[j] - m);
+            sum += scores[j];
+        }
 
-            if (pad_mask != NULL) {
-                for (int i = 0; i < T; i++)
-                    if (!pad_mask[b * T + i])
-                        for (int j = 0; j < T; j++)
-                            Scores[j][i] = -1e9f;
+        float o[Dh];
+        for (int d = 0; d < Dh; d++)
+            o[d] = 0;
+        for (int j = first; j <= last; ) {
+            const float* vb = kv_block(p,s->table[j / block],kv_lyr) +
+                              (long) block * D + h * Dh;
+            const int end = (last < (j / block + 1) * block - 1)
+                          ? last : (j / block + 1) * block - 1;
+            for (; j <= end; j++) {
+                const float* v = vb + (long) (j % block) * D;
+                float a = scores[j - first] / sum;
+                for (int d = 0; d < Dh; d++)
+                    o[d] += a * v[d];
             }
+        }
+        fltcpy(&Out[r][h * Dh],o,Dh);
+    }
+}
 
-            /* Compute attention probabilities - Softmax - in Eq. 1 */
-            softmax(Scores, T, T);
+/* mha_forward_paged - forward pass of a causal MHA layer over new tokens
+ * of generation sessions, whose earlier tokens' keys and values are in a
+ * paged cache (see kvcache.h).
+ *
+ * Parameters:
+ *   l      : Pointer to the MHA layer; mha_set_shape(l,B,T) sets the
+ *            number of sessions B and of new tokens of each session T.
+ *   p      : Pool of the sessions' caches.
+ *   seqs   : Array of B sessions; kvseq_reserve() must have made room for
+ *            T tokens of each.
+ *   X      : Input [B*T][D], the new tokens of session b at rows b*T to
+ *            b*T+T-1.
+ *   Y      : Output [B*T][D].
+ *   kv_lyr : Number of this attention layer in the pool.
+ *   lyr    : Layer index.
+ *
+ * Computes the same outputs as mha_forward() of each whole session, for
+ * its new tokens: the keys and values of the new tokens are written to
+ * the cache, at positions seqs[b]->len onward, then each new token
+ * attends to itself and to the tokens before it. A token attends to at
+ * most Tmax tokens (the layer's sequence length), the most recent ones,
+ * so tokens before those may be released (see kvseq_drop()). The caller
+ * increments seqs[b]->len by T after all the layers have run.
+ *
+ * Note: Only strictly causal layers (lookahead 0) of softmax attention 
+ *       may use a cache; see mha_forward_recurrent() for linear attention.
+ */
+static inline void mha_forward_paged(MHA* restrict l,
+                                     const KVPOOL* restrict p,
+                                     KVSEQ* const* seqs,
+                                     const fArr2D restrict X/*[BT][D]*/,
+                                     fArr2D Y/*[BT][D]*/,
+                                     int kv_lyr,
+                                     int lyr)
+{
+    (void) lyr;
+    const int B = l->B;
+    const int D = l->D;
+    const int H = l->H;
+    const int Dh = l->Dh;
+    const int BT = l->BT;
 
-            /* Store this head's attention weights for backward */
-            fltcpy(&Att[base], Scores, T * T);
+    if (l->lookahead != 0 || l->attention != 's' || p->D != D || 
+        kv_lyr >= p->layers) {
+        fflush(stdout);
+        fprintf(stderr,"mha_forward_paged: layer of lookahead %d dimension %d"
+                " attention '%c' does not fit cache layer %d of %d dimension"
+                " %d\n",l->lookahead,D,l->attention,kv_lyr,p->layers,p->D);
+        exit(-1);
+    }
 
-            if (l->training && l->dropout_rate > 0)
-                dropout(&Att[base],&AttMask[base],T,T,l->dropout_rate);
+    /* Step 1 - Linear projections (in Eq. 1, Sec. 3.2.2) */
+    matmul_kernel(l->kernel,l->Q,X,l->Wq,BT,D,D);
+    matmul_kernel(l->kernel,l->K,X,l->Wk,BT,D,D);
+    matmul_kernel(l->kernel,l->V,X,l->Wv,BT,D,D);
 
-            /* in Eq. 1: Attention @ V */
-            matmul(Oh,&Att[base],&Vh[base],T,T,Dh);
+    for (int b = 0; b < B; b++)
+        for (int h = 0; h < H; h++)
+            SHAPE_SPECIALIZE(HEAD_DIM_SHAPES,Dh,
+                             mha_head_paged(l,p,seqs[b],b,h,kv_lyr,Dh));
 
-            /* Step 4 - Concatenate heads and project (Eq. 2, Sec. 3.2.2):
-             * Out = Concat(Oh_0, ..., Oh_{H-1})
-             */
-            for (int t = 0;t < T; t++) {
-                int r= b * T + t;
-                fltcpy(&Out[r][h * Dh], &Oh[t][0], Dh);
-            }
+    /* Step 4 - Concatenated heads' output projection (Eq. 2, Sec. 3.2.2) */
+    matmul_kernel(l->kernel,Y,l->Out,l->Wo,BT,D,D);
+}
+
+/* Steps 2 and 3 of mha_forward_recurrent(), below, of session b and head
+ * h, with head dimension Dh, which may be a constant (see shapes.h).
+ */
+SHAPE_INLINE void mha_head_recurrent(MHA* restrict l, MHASTATE* restrict s,
+                                     int b, int h, int Dh)
+{
+    const int T = l->T;
+    const int D = l->D;
+
+    typedef float (*ArrBTD)[D];
+
+    ArrBTD Q = (ArrBTD) l->Q;
+    ArrBTD K = (ArrBTD) l->K;
+    ArrBTD V = (ArrBTD) l->V;
+    ArrBTD Out = (ArrBTD) l->Out;
+    fArr2D S = (fArr2D) (s->S + (long) h * Dh * Dh);
+    float* z = s->z + h * Dh;
+
+    for (int t = 0; t < T; t++) {
+        int r = b * T + t;
+        float q[Dh];
+        float k[Dh];
+        for (int d = 0; d < Dh; d++)
+            q[d] = mha_feature(Q[r][h * Dh + d]);
+        for (int d = 0; d < Dh; d++)
+            k[d] = mha_feature(K[r][h * Dh + d]);
+        mha_linear_add(S,z,k,&V[r][h * Dh],1.0,l->theta,s->len + t,Dh);
+        mha_linear_out(&Out[r][h * Dh],S,z,q,l->theta,s->len + t,Dh);
+    }
+}
+
+/* mha_forward_recurrent - forward pass of a causal layer of linear
+ * attention over new tokens of sessions, given the sums of the keys of
+ * their earlier tokens (see mha_head_linear()).
+ *
+ * Parameters:
+ *   l      : Pointer to the MHA layer; mha_set_shape(l,B,T) sets the
+ *            number of sessions B and of new tokens of each session T.
+ *   states : Array of B session states of this layer, see
+ *            mha_state_create().
+ *   X      : Input [B*T][D], the new tokens of session b at rows b*T to
+ *            b*T+T-1.
+ *   Y      : Output [B*T][D].
+ *   lyr    : Layer index.
+ *
+ * Computes the same outputs as mha_forward() of each whole session, for
+ * its new tokens, and adds them to the sums of its state, then increments
+ * states[b]->len by T. A state has H * (Dh + 1) * Dh floats, however many
+ * tokens a session has; it is not limited to the layer's sequence length.
+ *
+ * Note: Only strictly causal layers (lookahead 0) of linear attention may
+ *       run recurrently.
+ */
+static inline void mha_forward_recurrent(MHA* restrict l,
+                                         MHASTATE* const* states,
+                                         const fArr2D restrict X/*[BT][D]*/,
+                                         fArr2D Y/*[BT][D]*/,
+                                         int lyr)
+{
+    (void) lyr;
+    const int B = l->B;
+    const int T = l->T;
+    const int D = l->D;
+    const int H = l->H;
+    const int Dh = l->Dh;
+    const int BT = l->BT;
+
+    if (l->lookahead != 0 || l->attention != 'l') {
+        fflush(stdout);
+        fprintf(stderr,"mha_forward_recurrent: layer of lookahead %d "
+                "attention '%c' is not causal linear attention\n",
+                l->lookahead,l->attention);
+        exit(-1);
+    }
+
+    /* Step 1 - Linear projections (in Eq. 1, Sec. 3.2.2) */
+    matmul_kernel(l->kernel,l->Q,X,l->Wq,BT,D,D);
+    matmul_kernel(l->kernel,l->K,X,l->Wk,BT,D,D);
+    matmul_kernel(l->kernel,l->V,X,l->Wv,BT,D,D);
+
+    for (int b = 0; b < B; b++)
+        for (int h = 0; h < H; h++)
+            SHAPE_SPECIALIZE(HEAD_DIM_SHAPES,Dh,
+                             mha_head_recurrent(l,states[b],b,h,Dh));
+
+    /* Step 4 - Concatenated heads' output projection (Eq. 2, Sec. 3.2.2) */
+    matmul_kernel(l->kernel,Y,l->Out,l->Wo,BT,D,D);
+    for (int b = 0; b < B; b++)
+        states[b]->len += T;
+}
+
+/* Step 3 backward of mha_backward(), below, of batch item b and head h,
+ * of a layer of linear attention (see mha_head_linear()), with head
+ * dimension Dh, which may be a constant (see shapes.h). Reads this head's
+ * output gradient from dOh, which it overwrites, and writes the gradients
+ * of the head's queries, keys and values to dQh, dKh and dVh.
+ *
+ * Of Oh[i] = num / den, num = S^T R(i) q[i], den = q[i].z, with
+ * g = dOh[i] / den and c = -dOh[i].Oh[i] / den:
+ *   dq[i] = R(i)^T S g + c z
+ *   dk[j] = R(j)^T G Vh[j] + u,  dVh[j] = G^T R(j) k[j]
+ * where G = sum_i R(i) q[i] g[i]^T and u = sum_i c[i] q[i] are sums over
+ * the queries that attend to key j, i >= j - lookahead; S and z are prefix
+ * sums over keys, computed again as in forward, and G and u are suffix 
+ * sums over queries. Then the gradients of the features are multiplied
+ * by the derivative of mha_feature().
+ */
+SHAPE_INLINE void mha_head_linear_backward(MHA* restrict l, int b, int h,
+                                           int Dh)
+{
+    const int T = l->T;
+    const int D = l->D;
+    const int H = l->H;
+    const int lookahead = l->lookahead;
+
+    typedef float (*ArrBTD)[D];
+    typedef float (*ArrBHTDh)[Dh];
+    typedef float (*ArrTDh)[Dh];
+    typedef float (*ArrDhDh)[Dh];
+
+    ArrBHTDh Qh = (ArrBHTDh) l->Qh;
+    ArrBHTDh Kh = (ArrBHTDh) l->Kh;
+    ArrBHTDh Vh = (ArrBHTDh) l->Vh;
+    ArrBTD Out = (ArrBTD) l->Out;
+    ArrTDh dOh = (ArrTDh) l->dOh;
+    ArrTDh dQh = (ArrTDh) l->dQh;
+    ArrTDh dKh = (ArrTDh) l->dKh;
+    ArrTDh dVh = (ArrTDh) l->dVh;
+
+    int base = (b * H + h) * T; /* row offset into [BHT][...] buffers */
+
+    SCRATCH_MARK mark = scratch_mark();
+    ArrDhDh S = (ArrDhDh) scratchmem(Dh,Dh,float);
+    float* z = scratchmem(1,Dh,float);
+    float* c = scratchmem(1,T,float);
+    fltclr(S,Dh * Dh);
+    fltclr(z,Dh);
+    /* Queries, first to last: dOh[i] is replaced by g[i] */
+    for (int i = 0, n = 0; i < T; i++) {
+        const int last = (lookahead < 0 || i + lookahead >= T) 
+                       ? T - 1 : i + lookahead;
+        for (; n <= last; n++)
+            mha_linear_add((fArr2D) S,z,Kh[base + n],Vh[base + n],1.0,
+                           l->theta,n,Dh);
+        const float den = l->Den[base + i];
+        const float* o = &Out[b * T + i][h * Dh];
+        float* g = dOh[i];
+        float dot = 0;
+        for (int d = 0; d < Dh; d++)
+            dot += g[d] * o[d];
+        c[i] = (den > 0) ? -dot / den : 0;
+        for (int d = 0; d < Dh; d++)
+            g[d] = (den > 0) ? g[d] / den : 0;
+        float dq[Dh];
+        for (int a = 0; a < Dh; a++) {
+            float sum = 0;
+            for (int d = 0; d < Dh; d++)
+                sum += S[a][d] * g[d];
+            dq[a] = sum;
         }
+        rope_kernel((fArr2D) dq,l->theta,1,i,1,Dh);
+        for (int a = 0; a < Dh; a++)
+            dQh[i][a] = (dq[a] + c[i] * z[a]) * mha_d_feature(Qh[base + i][a]);
     }
-    /* Step 4 continued - output projection (Eq. 2, Sec. 3.2.2):
-     * Y = Out @ Wo
-     */
-    if (Y != NULL)
-        matmul(Y,Out,Wo,BT,D,D);
+    /* Keys, last to first: S and z are reused for G and u */
+    ArrDhDh G = S;
+    float* u = z;
+    fltclr(G,Dh * Dh);
+    fltclr(u,Dh);
+    for (int j = T - 1, m = T; j >= 0; j--) {
+        const int first = (lookahead < 0 || j - lookahead < 0) 
+                        ? 0 : j - lookahead;
+        while (m > first) {
+            m--;
+            mha_linear_add((fArr2D) G,u,Qh[base + m],dOh[m],c[m],
+                           l->theta,m,Dh);
+        }
+        const float* v = Vh[base + j];
+        float rk[Dh];
+        fltcpy(rk,Kh[base + j],Dh);
+        rope_kernel((fArr2D) rk,l->theta,0,j,1,Dh);
+        float dk[Dh];
+        for (int a = 0; a < Dh; a++) {
+            float sum = 0;
+            for (int d = 0; d < Dh; d++)
+                sum += G[a][d] * v[d];
+            dk[a] = sum;
+        }
+        rope_kernel((fArr2D) dk,l->theta,1,j,1,Dh);
+        for (int a = 0; a < Dh; a++)
+            dKh[j][a] = (dk[a] + u[a]) * mha_d_feature(Kh[base + j][a]);
+        for (int d = 0; d < Dh; d++)
+            dVh[j][d] = 0;
+        for (int a = 0; a < Dh; a++)
+            for (int d = 0; d < Dh; d++)
+                dVh[j][d] += G[a][d] * rk[a];
+    }
+    scratch_release(mark);
 }
 
 /*
@@ -353,6 +953,8 @@ static inline void mha_forward(MHA* restrict l,
  *   Step 1 backward - linear projections (reverse of Q=X@Wq, K=X@Wk, V=X@Wv):
  *     gWq = X.T @ dQ,  gWk = X.T @ dK,  gWv = X.T @ dV
  *     dX  = dQ @ Wq.T + dK @ Wk.T + dV @ Wv.T if dX != NULL
+ *
+ * A layer of linear attention runs mha_head_linear_backward() for step 3.
  */
 static inline void mha_backward(MHA* restrict l,
                                 fArr2D restrict dY /*[BT][D]*/,
@@ -436,39 +1038,45 @@ static inline void mha_backward(MHA* restrict l,
                 fltcpy(&dOh[t][0],&dOut[r][h * Dh],Dh);
             }
 
-            /* Step 3a backward - reverse Oh = Att @ Vh:
-             * dVh  = Att.T @ dOh
-             * dAtt = dOh @ Vh.T
-             */
-            Tmatmul(dVh,&Att[base],dOh,T,T,Dh);
-            matmulT(dAtt,dOh,&Vh[base],T,Dh,T);
+            if (l->attention == 'l') {
+                SHAPE_SPECIALIZE(HEAD_DIM_SHAPES,Dh,
+                                 mha_head_linear_backward(l,b,h,Dh));
+            }
+            else {
+                /* Step 3a backward - reverse Oh = Att @ Vh:
+                 * dVh  = Att.T @ dOh
+                 * dAtt = dOh @ Vh.T
+                 */
+                Tmatmul(dVh,&Att[base],dOh,T,T,Dh);
+                matmulT(dAtt,dOh,&Vh[base],T,Dh,T);
+
+                /* Step 3b backward - reverse Att = softmax(Scores):
+                 * dScores = J_softmax(Att).T @ dAtt   (Jacobian, Sec. 3.2.1)
+                 * dScores /= sqrt(Dh)                  (reverse scaling)
+                 */
+                if (l->training && l->dropout_rate > 0)
+                    for (int i = 0; i < T; i++)
+                        for (int j = 0; j < T; j++)
+                            dAtt[i][j] *= AttMask[base+i][j];
 
-            /* Step 3b backward - reverse Att = softmax(Scores):
-             * dScores = J_softmax(Att).T @ dAtt   (Jacobian, Sec. 3.2.1)
-             * dScores /= sqrt(Dh)                  (reverse scaling)
-             */
-            if (l->training && l->dropout_rate > 0)
-                for (int i = 0; i < T; i++)
-                    for (int j = 0; j < T; j++)
-                        dAtt[i][j] *= AttMask[base+i][j];
-
-            d_softmax(dScores,dAtt,&Att[base],T,T);
-
-            float s = 1.0f / sqrtf((float)Dh);
-            for(int i = 0; i < T; i++)
-              for(int j = 0; j < T; j++)
-                dScores[i][j] *= s;
-
-            /* Step 3c backward - reverse Scores = Qh @ Kh.T:
-             * dQh = dScores @ Kh
-             * dKh = dScores.T @ Qh
-             * then apply inverse RoPE to dQh and dKh
-             */
-            matmul(dQh,dScores,&Kh[base],T,T,Dh);
-            Tmatmul(dKh,dScores,&Qh[base],T,T,Dh);
+                d_softmax(dScores,dAtt,&Att[base],T,T);
 
-            rope_apply(dQh,l->theta,1,0,T,Dh);
-            rope_apply(dKh,l->theta,1,0,T,Dh);
+                float s = 1.0f / sqrtf((float)Dh);
+                for(int i = 0; i < T; i++)
+                  for(int j = 0; j < T; j++)
+                    dScores[i][j] *= s;
+
+                /* Step 3c backward - reverse Scores = Qh @ Kh.T:
+                 * dQh = dScores @ Kh
+                 * dKh = dScores.T @ Qh
+                 * then apply inverse RoPE to dQh and dKh
+                 */
+                matmul(dQh,dScores,&Kh[base],T,T,Dh);
+                Tmatmul(dKh,dScores,&Qh[base],T,T,Dh);
+
+                rope_apply(dQh,l->theta,1,0,T,Dh);
+                rope_apply(dKh,l->theta,1,0,T,Dh);
+            }
 
             /* Step 2 backward - accumulate head gradients into full tensors:
              * dQ[b*T+t][h*Dh+k] += dQh[t][k]
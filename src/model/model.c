@@ -2,30 +2,43 @@
 /* Multi layer neural network model and functions */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <strings.h>
+#include <pthread.h>
 #include "mem.h"
 #include "random.h"
 #include "etime.h"
+#include "trace.h"
+#include "perfctr.h"
+#include "tasksched.h"
 #include "array.h"
 #include "loss.h"
 #include "ctc.h"
 #include "adamw.h"
 #include "dense.h"
 #include "lstm.h"
+#include "gru.h"
 #include "transformer.h"
 #include "negsample.h"
 #include "layer.h"
 #include "activation.h"
 #include "clip.h"
+#include "datasrc.h"
 #include "batch.h"
 #include "normalize.h"
 #include "accuracy.h"
 #include "model.h"
 #include "modelio.h"
 
-static void model_batch_forward(MODEL* m, fArr2D x, fArr2D* yp);
-static void model_batch_backward(MODEL* m, fArr2D x, fArr2D* dy, fArr2D* yp);
+static void model_batch_forward(MODEL* m, fArr2D x, int rows, fArr2D* yp);
+static void model_batch_backward(MODEL* m, fArr2D x, int rows, 
+                                 fArr2D* dy, fArr2D* yp);
 static void model_update(MODEL* m, float learning_rate, float weight_decay);
+static void model_validate(MODEL* m, BATCH* bVd, long MVd, int norm,
+                           fArr2D x, fArr2D yt, fArr2D dy,
+                           float* v_loss, float* v_accuracy,
+                           int verbose, int epoch, int num_epochs, 
+                           float start_time, float loss, float accuracy);
 static void print_status(int epoch, int nepochs, int progress, float etime,
                              float loss, float acc, float v_loss, float v_acc);
 
@@ -33,6 +46,68 @@ static const char* find_kwarg(const char* kwargs, const char* key);
 static void get_kw_int(const char* kwargs, const char* key, int* val);
 static void get_epoch_params(const char* sch, int epoch, float* lr, float* wd);
 
+/* Validation of one epoch on another thread, see model_fit() */
+typedef struct {
+    MODEL* m;           /* Snapshot of the model: own layers and buffers   */
+    BATCH* b;           /* Validation data batches                         */
+    long M;             /* Number of validation vectors                    */
+    fArr2D x;           /* One batch of inputs [B][Db]                     */
+    fArr2D yt;          /* One batch of true outputs [B][Nt]               */
+    pthread_t thread;   /* Validation thread                               */
+    int running;        /* If not zero, thread is running                  */
+    int epoch;          /* Epoch being validated, -1 if none               */
+    float loss;         /* Training loss and accuracy of that epoch        */
+    float accuracy;
+    float v_loss;       /* Validation loss and accuracy of that epoch      */
+    float v_accuracy;
+} ASYNCVAL;
+
+static ASYNCVAL* async_validation_create(MODEL* m, BATCH* bVd, long MVd);
+static void async_validation_start(ASYNCVAL* av, MODEL* m, int epoch,
+                                   float loss, float accuracy);
+static void async_validation_join(ASYNCVAL* av, 
+                                  float* v_losses, float* v_accuracies,
+                                  int verbose, int num_epochs, 
+                                  float start_time);
+static void async_validation_free(ASYNCVAL* av);
+
+static void model_copy_weights(MODEL* dst, const MODEL* src);
+static MODEL* model_snapshot_create(const MODEL* m);
+
+/* Data parallel training across processes, see model_set_comm() */
+typedef struct {
+    COMM* c;            /* Communicator of the training processes          */
+    long n;             /* Number of gradient elements of all layers       */
+    float* buf;         /* Gradients of all layers, then number of samples */
+} DPAR;
+
+static DPAR* dpar_create(MODEL* m);
+static int dpar_reduce(DPAR* dp, MODEL* m, int cnt);
+static void dpar_free(DPAR* dp);
+
+/* Marks a phase of training or prediction, in the timeline (see trace.h)
+ * and in the performance counters (see perfctr.h).
+ */
+#define PHASE_BEGIN(name,cat,arg) \
+    do { TRACE_BEGIN(name,cat,arg); PERF_BEGIN(name,arg); } while (0)
+#define PHASE_END() \
+    do { PERF_END(); TRACE_END(); } while (0)
+
+/* Returns the names of the phases of a layer's passes */
+static const char* layer_event(const LAYER* l, int backward)
+{
+    switch (l->type) {
+        case 'd': return (backward) ? "dense backward" : "dense forward";
+        case 'l': return (backward) ? "lstm backward" : "lstm forward";
+        case 'g': return (backward) ? "gru backward" : "gru forward";
+        case 't': return (backward) ? "transformer backward" 
+                                    : "transformer forward";
+        case 'n': return (backward) ? "negsample backward" 
+                                    : "negsample forward";
+    }
+    return (backward) ? "backward" : "forward";
+}
+
 static inline void reset_state(MODEL* m)
 {
     for (int i = 0; i < m->num_layers; i++)
@@ -81,6 +156,8 @@ void model_free(MODEL* m)
             freemem(m->layer[i].grads);
         }
     }
+    memplan_free(m->plan);
+    freemem(m->dy);
     freemem(m->ctc);
     freemem(m->mean);
     freemem(m->sdev);
@@ -91,7 +168,8 @@ void model_free(MODEL* m)
 /* Adds a layer to a model
  * m points to a model
  * layer points to a neural network (e.g. DENSE) to be added as a layer
- * type is the type of the layer: "dense", "lstm", "transformer" or "negsample"
+ * type is the type of the layer: "dense", "lstm", "gru", "transformer" or
+ * "negsample"
  *
  * The layer is added after all other layers in the model
  */
@@ -114,6 +192,10 @@ void model_add(MODEL* m, void* layer, const char* type)
         m->layer[i].type = 'l';
         m->layer[i].lstm = layer;
     }
+    if (!strcasecmp("gru",type)) {
+        m->layer[i].type = 'g';
+        m->layer[i].gru = layer;
+    }
     if (!strcasecmp("transformer",type)) {
         m->layer[i].type = 't';
         m->layer[i].transformer = layer;
@@ -195,16 +277,43 @@ void model_compile(MODEL* m, const char* loss_func, const char* optimizer)
     /* Allocate gradient arrays */
     for (int i = 0; i < m->num_layers; i++)
         layer_alloc_grads(&m->layer[i],m->optimizer);
+    model_plan(m);
+    model_tune(m,0);
+}
+
+/* Sets the communicator of data parallel training, or NULL to train in
+ * this process only.
+ *
+ * Each process (rank) of the communicator creates the same model, and
+ * calls model_fit() with its own part (shard) of the training data.
+ * model_fit() then copies the weights, and the normalization parameters,
+ * of rank 0 to all ranks, and after each batch averages the gradients
+ * of all ranks, weighted by their number of samples, before updating the
+ * weights; so the models of all ranks stay identical. A rank whose shard
+ * has fewer batches contributes no gradients to the last updates.
+ *
+ * Training loss and accuracy are those of all the shards; validation is
+ * done by each rank on the validation data it is given.
+ *
+ * Negative sampling, whose gradients are sparse, is not supported.
+ */
+void model_set_comm(MODEL* m, COMM* comm)
+{
+    m->comm = comm;
 }
 
 /* Sets a new batch size.
  *
  * This function changes the batch size of an existing, possibly trained,
- * model. Smaller batch size reduces memory requirements and decoding latency
- * but may also reduce accuracy.
+ * model. Smaller batch size reduces decoding latency but may also reduce
+ * accuracy.
  *
  * Parameters:
  *   batch_size - Number of input vectors processed simultaneously
+ *
+ * Notes:
+ *   Layers' memory is reallocated only if batch_size exceeds the batch size
+ *   they were initialized with; otherwise, their buffers are reused.
  */
 void model_set_batch_size(MODEL* m, int batch_size)
 {
@@ -213,9 +322,99 @@ void model_set_batch_size(MODEL* m, int batch_size)
     m->batch_size = batch_size;
     for (int i = 0; i < m->num_layers; i++)
         layer_set_batch_size(&m->layer[i],batch_size);
-    if (m->ctc != NULL) {
+    if (m->ctc != NULL && m->ctc->T < batch_size) {
+        int blank = m->ctc->blank;
         ctc_free(m->ctc);
-        m->ctc = ctc_create(m->batch_size,m->output_dim,0);
+        m->ctc = ctc_create(m->batch_size,m->output_dim,blank);
+    }
+    if (m->plan != NULL)
+        model_plan(m);
+    model_tune(m,0);
+}
+
+/* Plans the memory of the buffers that training uses only in some of its
+ * steps: the gradients of the layers' outputs, and the layers' scratch
+ * buffers (see layer_plan()). Buffers that are not used in the same steps
+ * share memory in one workspace (see memplan.h).
+ *
+ * Notes:
+ *   model_compile() and model_set_batch_size() call this function, and
+ *   model_fit() calls it if the model was not planned, e.g. if it was read
+ *   from a file. Setting the environment variable MLINC_MEMPLAN to 0 gives
+ *   each buffer its own memory in the workspace.
+ */
+void model_plan(MODEL* m)
+{
+    const int L = m->num_layers;
+    const char* env = getenv("MLINC_MEMPLAN");
+    int share = (env == NULL || strcmp(env,"0") != 0);
+    memplan_free(m->plan);
+    m->plan = memplan_create();
+    if (m->dy == NULL)
+        m->dy = allocmem(1,L,fArr2D);
+    /* Steps: forward pass of layer j is step j, the loss is step L, and 
+     * the backward pass of layer j is step 2L - j
+     */
+    for (int j = 0; j < L; j++) {
+        LAYER* l = &m->layer[j];
+        layer_plan(l,m->plan,j,2 * L - j);
+        /* Gradient of the layer's output: written by the loss, or by the
+         * backward pass of the next layer, and read by its own
+         */
+        long size = (long) layer_batch_size(l) * layer_output_dim(l);
+        int first = (j == L - 1) ? L : 2 * L - j - 1;
+        memplan_add(m->plan,"dy",&m->dy[j],size,first,2 * L - j);
+    }
+    memplan_assign(m->plan,share);
+}
+
+/* Prints the planned buffers of a model, and the size of its workspace
+ * compared with the size of separate buffers.
+ */
+void model_print_plan(const MODEL* m, FILE* f)
+{
+    if (m->plan == NULL)
+        fprintf(f,"Model memory is not planned\n");
+    else
+        memplan_print(m->plan,f);
+}
+
+/* Selects the matrix product kernel of each dense and attention layer.
+ *
+ * For each layer, the fastest kernel of the layer's shape at its current
+ * batch size is selected, see autotune.h. Decisions are kept in a cache
+ * file of this host, so only shapes not yet in it run the kernels.
+ *
+ * Parameters:
+ *   force - If not zero, the kernels of every shape are run again, and
+ *           the cache is updated
+ *
+ * Notes:
+ *   model_compile(), model_set_batch_size() and read_model() call this
+ *   function; call it again after a layer's batch size is changed directly.
+ */
+void model_tune(MODEL* m, int force)
+{
+    int (*tune)(int,int,int) = (force) ? autotune_matmul_force
+                                       : autotune_matmul;
+    for (int i = 0; i < m->num_layers; i++) {
+        LAYER* l = &m->layer[i];
+        switch (l->type) {
+            case 'd': {
+                DENSE* d = l->dense;
+                d->kernel = tune(d->B,d->D,d->S);
+            }
+            break;
+            case 't': {
+                TRANSFORMER* tr = l->transformer;
+                tr->mha->kernel = tune(tr->BT,tr->D,tr->D);
+                /* The FFN runs in chunks of rows, see transformer_ffn() */
+                int rows = (tr->BT < tr->ffn_rows) ? tr->BT : tr->ffn_rows;
+                tr->ffn1->kernel = tune(rows,tr->D,tr->Dff);
+                tr->ffn2->kernel = tune(rows,tr->Dff,tr->D);
+            }
+            break;
+        }
     }
 }
 
@@ -289,6 +488,22 @@ void model_set_batch_size(MODEL* m, int batch_size)
  * each epoch's loss and accuracy on a separate line.
  * Default value is 0.
  *
+ * If async_validation is not zero, each epoch's validation runs on another
+ * thread, on a copy of the model weights taken at the end of the epoch,
+ * while the next epoch trains. The results are the same as those of
+ * validation on the training thread. It does not apply to negative 
+ * sampling, or when the validation and training data are the same
+ * data source. Default value is 0.
+ *
+ * If prenormalize is not zero, and the model normalizes its inputs, the
+ * training and validation data are normalized once, before the first
+ * epoch, into copies of the data in memory, rather than each batch in
+ * every epoch. Only arrays in memory are normalized once; data read from
+ * other sources, such as files, is normalized each batch, and is never
+ * copied. Default value is 0. To normalize arrays in place, once for
+ * several calls, pass model_fit_source() the data sources returned by
+ * datasrc_arrays_normalize().
+ *
  * Schedule specified a training schedule with variable learning rate 
  * and  * weight decay. The format of this parameter is <e>:<l>:<w>,...
  * where <e> is number of epochs, <l> and <w> are the learning rate and 
@@ -301,6 +516,44 @@ void model_fit(MODEL* m,
     float* losses, float* accuracies, 
     float* v_losses, float* v_accuracies,
     const char* kwargs)
+{
+    int D = m->input_dim;
+    int Nt = m->target_dim;
+    if (lenTr != NULL && numTr == 1) { /* Single sequence */
+        numTr = lenTr[0];
+        lenTr = NULL;
+    }
+    if (lenVd != NULL && numVd == 1) {
+        numVd = lenVd[0];
+        lenVd = NULL;
+    }
+    DATASRC* sTr = datasrc_arrays(xTr,D,yTr,Nt,lenTr,numTr);
+    DATASRC* sVd = NULL;
+    if (numVd > 0)
+        sVd = datasrc_arrays(xVd,D,yVd,Nt,lenVd,numVd);
+    model_fit_source(m,sTr,sVd,num_epochs,learning_rate,weight_decay,
+                     losses,accuracies,v_losses,v_accuracies,kwargs);
+    datasrc_free(sTr);
+    datasrc_free(sVd);
+}
+
+/* Trains model on data read from data source sTr, and optionally validates
+ * it on data read from data source sVd (may be NULL). Only one batch of
+ * data is held in memory at a time, so the dataset may be larger than
+ * the available memory.
+ *
+ * The input dimension of the sources is the model input dimension, and
+ * their output dimension is the model output dimension (1 for negative
+ * sampling). Sources marked as normalized (see datasrc_arrays_normalize())
+ * are not normalized again.
+ *
+ * The other parameters are the same as for model_fit().
+ */
+void model_fit_source(MODEL* m, DATASRC* sTr, DATASRC* sVd,
+    int num_epochs, float learning_rate, float weight_decay,
+    float* losses, float* accuracies, 
+    float* v_losses, float* v_accuracies,
+    const char* kwargs)
 {
     if (m->final) {
         fflush(stdout);
@@ -311,6 +564,8 @@ void model_fit(MODEL* m,
     int verbose = 0; get_kw_int(kwargs,"verbose",&verbose);
     int shuffle = 1; get_kw_int(kwargs,"shuffle",&shuffle);
     int final = 0;   get_kw_int(kwargs,"final",&final);
+    int async = 0;   get_kw_int(kwargs,"async_validation",&async);
+    int prenorm = 0; get_kw_int(kwargs,"prenormalize",&prenorm);
     const char* sch = find_kwarg(kwargs,"schedule");
     int L = m->num_layers;
     int N = m->output_dim;          /* Dimension of model output vectors */
@@ -320,37 +575,90 @@ void model_fit(MODEL* m,
     int Dx = D - (1 - m->add_bias); /* Input dimension excluding bias    */
     int Db = D + m->add_bias;       /* Input dimension including bias    */
     
-    int MTr = 0;           /* Total number of training samples        */
-    if (lenTr != NULL) {
-    for (int i = 0; i < numTr; i++)
-        MTr += lenTr[i];
-    }
-    else
-        MTr = numTr;
-         
-    int MVd = 0;           /* Total number of validation samples      */
-    if (lenVd != NULL) {
-        for (int i = 0; i < numVd; i++)
-            MVd += lenVd[i];
+    if (sTr->D != D || (sTr->N != Nt) || 
+        (sVd != NULL && (sVd->D != D || sVd->N != Nt))) {
+        fflush(stdout);
+        fprintf(stderr,"model_fit: data dimensions do not match model\n");
+        exit(-1);
     }
-    else
-        MVd = numVd; 
+    long MTr = datasrc_num_vectors(sTr); /* Number of training samples   */
+    long MVd = (sVd != NULL) ? datasrc_num_vectors(sVd) : 0; /* validation */
 
     typedef float (*VecDx);
     VecDx mean = (VecDx) m->mean;
     VecDx sdev = (VecDx) m->sdev;
-    if (m->normalize)
-        calculate_mean_sdev(xTr,MTr,D,mean,sdev,D - Dx);
+    /* Sources marked as normalized (see datasrc_norm_stats()) are not
+     * normalized again; the model takes the mean and sdev the training
+     * data was normalized with. Of other sources, only arrays in memory
+     * are normalized once.
+     */
+    const float* axTr = datasrc_arrays_x(sTr);
+    const float* axVd = (sVd != NULL) ? datasrc_arrays_x(sVd) : NULL;
+    const float *tmean, *tsdev, *vmean, *vsdev;
+    int nfTr = datasrc_norm_stats(sTr,&tmean,&tsdev);
+    int nfVd = (sVd != NULL) ? datasrc_norm_stats(sVd,&vmean,&vsdev) : 0;
+    int doneTr = m->normalize && nfTr > 0;
+    int doneVd = m->normalize && nfVd > 0;
+    if ((doneTr && nfTr != Dx) || (doneVd && (!doneTr || nfVd != Dx ||
+        memcmp(vmean,tmean,Dx * sizeof(float)) != 0 ||
+        memcmp(vsdev,tsdev,Dx * sizeof(float)) != 0))) {
+        fflush(stdout);
+        fprintf(stderr,"model_fit: data was normalized with the mean and "
+                       "sdev of other data\n");
+        exit(-1);
+    }
+    if (doneTr) {
+        fltcpy(mean,tmean,Dx);
+        fltcpy(sdev,tsdev,Dx);
+    }
+    if (m->normalize && !doneTr && !datasrc_mean_sdev(sTr,mean,sdev,D - Dx)) {
+        fflush(stdout);
+        fprintf(stderr,"model_fit: failed to read training data\n");
+        exit(-1);
+    }
+    DPAR* dp = NULL; /* Data parallel training; starts with rank 0's model */
+    if (m->comm != NULL && m->comm->size > 1)
+        dp = dpar_create(m);
+    /* Normalize the data once, with rank 0's mean and sdev, or each batch */
+    DATASRC* nTr = sTr;
+    DATASRC* nVd = sVd;
+    int onceTr = doneTr || (prenorm && axTr != NULL);
+    int onceVd = doneVd || (prenorm && axVd != NULL);
+    if (m->normalize && prenorm) {
+        if (onceTr && !doneTr)
+            nTr = datasrc_normalized(sTr,mean,sdev,D - Dx);
+        if (sVd == sTr)
+            nVd = nTr;
+        else
+        if (onceVd && !doneVd)
+            nVd = datasrc_normalized(sVd,mean,sdev,D - Dx);
+        if (nTr == NULL || (sVd != NULL && nVd == NULL)) {
+            fflush(stdout);
+            fprintf(stderr,"model_fit: failed to read %s data\n",
+                           (nTr == NULL) ? "training" : "validation");
+            exit(-1);
+        }
+    }
+    int norm = m->normalize && !onceTr; /* Normalize each training batch */
+    int vnorm = (sVd == sTr) ? norm : (m->normalize && !onceVd);
 
-    BATCH* bTr = batch_create(xTr,D,yTr,Nt,B,lenTr,numTr,shuffle,m->add_bias);
+    BATCH* bTr = batch_create_source(nTr,B,shuffle,m->add_bias);
     BATCH* bVd = NULL;
     if (MVd > 0) /* Notice validation data not shuffled */
-        bVd = batch_create(xVd,D,yVd,Nt,B,lenVd,numVd,0,m->add_bias);
+        bVd = batch_create_source(nVd,B,0,m->add_bias);
+    /* Negative sampling validation draws random samples, so it must run
+     * in order with training. The validation source is read concurrently
+     * with the training source, so they must be different sources.
+     */
+    ASYNCVAL* av = NULL;
+    if (async && MVd > 0 && m->loss_func != 'N' && sVd != sTr)
+        av = async_validation_create(m,bVd,MVd);
+    if (av != NULL) /* The snapshot reads the same batches */
+        av->m->normalize = vnorm;
         
-    fArr2D dy[L];  /* Gradients with respect to the inputs          */
-    for (int i = 0; i < L; i++)
-        dy[i] = allocmem(layer_batch_size(&m->layer[i]),
-                         layer_output_dim(&m->layer[i]),float);
+    if (m->plan == NULL)
+        model_plan(m);
+    fArr2D* dy = m->dy; /* Gradients with respect to the inputs       */
     
     /* Allocate memory for one batch */
     typedef float (*ArrBDb)[Db];
@@ -367,8 +675,6 @@ void model_fit(MODEL* m,
     /* Track validation loss, accuracy */
     float v_loss = 0;
     float v_accuracy = 0;
-    float v_match_cnt;
-    int v_sample_cnt;
 
     if (verbose)
         printf("\n");
@@ -376,6 +682,8 @@ void model_fit(MODEL* m,
     float start_time = current_time();
     int epoch;
     for (epoch = 0; epoch < num_epochs; epoch++) {
+        TRACE_BEGIN("epoch","train",epoch);
+        PERF_BEGIN("epoch",-1); /* Counted over all epochs */
         loss = 0;
         match_cnt = 0;
         sample_cnt = 0;
@@ -387,19 +695,33 @@ void model_fit(MODEL* m,
         reset_state(m);
         for (;;) {
             fArr2D yp[L]; /* Pointers to layers' prediction arrays */
+            PHASE_BEGIN("prepare batch","data",-1);
             int cnt = batch_copy(bTr,x,yt);
-            if (cnt == 0)
+            if (cnt < 0) {
+                fflush(stdout);
+                fprintf(stderr,"model_fit: failed to read training data\n");
+                exit(-1);
+            }
+            if (cnt > 0 && norm)
+                normalize(x,cnt,Db,mean,sdev,1);
+            PHASE_END();
+            if (cnt == 0 && dp == NULL)
                 break;
-            if (m->normalize)
-                normalize(x,B,Db,mean,sdev,1);
-            model_batch_forward(m,x,yp);
+            if (cnt == 0) { /* Other ranks may have more batches */
+                if (dpar_reduce(dp,m,0) == 0)
+                    break;
+                model_update(m,learning_rate,weight_decay);
+                continue;
+            }
+            model_batch_forward(m,x,cnt,yp);
             sample_cnt += cnt;
 
             /* Note that gradient calculation below is additive.
              * If the actual number of samples in the last batch 
              * is less than batch size (cnt < B), only that number
-             * of samples is used to calculate the gradients.
+             * of samples is computed and used to calculate the gradients.
              */
+            PHASE_BEGIN("loss","train",-1);
             switch(m->loss_func) {
                 case 'm':
                     loss += mean_square_error(yp[L - 1],yt,cnt,N) * 100;
@@ -432,17 +754,27 @@ void model_fit(MODEL* m,
                 }
                 break;
             }
-            model_batch_backward(m,x,dy,yp);
+            PHASE_END();
+            model_batch_backward(m,x,cnt,dy,yp);
             if (verbose) {
                 print_status(epoch + 1,num_epochs,
-                            (B < MTr) ? sample_cnt * 100 / MTr : -1,
+                            (B < MTr) ? (int) (sample_cnt * 100L / MTr) : -1,
                             elapsed_time(start_time),
                             loss / sample_cnt, match_cnt / sample_cnt,-1,-1);
             }
+            if (dp != NULL) /* Average the gradients of all ranks */
+                dpar_reduce(dp,m,cnt);
             model_update(m,learning_rate,weight_decay); /* Update weights */
             if (batch_eos(bTr))
                 reset_state(m);
         }
+        if (dp != NULL) { /* Loss and accuracy of all shards */
+            float sums[3] = { loss, match_cnt, sample_cnt };
+            comm_allreduce(dp->c,sums,3);
+            loss = sums[0];
+            match_cnt = sums[1];
+            sample_cnt = sums[2];
+        }
         loss /= sample_cnt;
         accuracy = match_cnt / sample_cnt;
         if (verbose) {
@@ -455,62 +787,15 @@ void model_fit(MODEL* m,
             losses[epoch] = loss;
         if (accuracies != NULL) 
             accuracies[epoch] = accuracy;
+        if (MVd > 0 && av != NULL) { /* Validate on another thread */
+            async_validation_join(av,v_losses,v_accuracies,
+                                  verbose,num_epochs,start_time);
+            async_validation_start(av,m,epoch,loss,accuracy);
+        }
+        else
         if (MVd > 0) { /* Validation data present */
-            v_loss = 0;
-            v_match_cnt = 0;
-            v_sample_cnt = 0;
-            
-            batch_shuffle(bVd); /* Only resets, doesn't actually shuffle */
-            reset_state(m);
-            for (;;) {
-                fArr2D yp[L]; /* Pointers to layers' prediction arrays */
-                int cnt = batch_copy(bVd,x,yt);  
-                if (cnt == 0)
-                    break;
-                if (m->normalize)
-                    normalize(x,B,Db,mean,sdev,1); 
-                model_batch_forward(m,x,yp);
-                v_sample_cnt += cnt;
-
-                switch(m->loss_func) {
-                    case 'm':
-                        v_loss += mean_square_error(yp[L - 1],yt,cnt,N) * 100;
-                        v_match_cnt += R2_sum(yp[L - 1],yt,cnt,N);
-                    break;
-                    case 'c':
-                        v_loss += cross_entropy_loss(yp[L - 1],yt,cnt,N);
-                        v_match_cnt += match_sum(yp[L - 1],yt,cnt,N);
-                    break;
-                    case 'C':
-                        v_loss += ctc_loss(m->ctc,yp[L - 1],yt,cnt,N);
-                        v_match_cnt += ctc_accuracy(m->ctc,yp[L - 1],yt,cnt,N);
-                    break;
-                    case 'N': {
-                        /* Eval only: compute loss/accuracy. The grad buffers
-                         * (dy[L-1], head grads) are written but never applied,
-                         * since no model_update runs during validation.
-                         */
-                        NEGSAMPLE* head = m->layer[L - 1].negsample;
-                        int correct = 0;
-                        v_loss += negsample_loss(head,yp[L - 1],yt,
-                                                 m->layer[L - 1].grads[0],
-                                                 dy[L - 1],cnt,&correct);
-                        v_match_cnt += correct;
-                    }
-                    break;
-                }
-                if (verbose) {
-                    print_status(epoch + 1,num_epochs,
-                            (B < MVd) ? v_sample_cnt * 100 / MVd : -1,
-                            elapsed_time(start_time),
-                            loss,accuracy,
-                            v_loss / v_sample_cnt, v_match_cnt / v_sample_cnt);
-                }
-                if (batch_eos(bVd))
-                    reset_state(m);
-            }
-            v_loss /= v_sample_cnt;
-            v_accuracy = v_match_cnt / v_sample_cnt;
+            model_validate(m,bVd,MVd,vnorm,x,yt,dy[L - 1],&v_loss,&v_accuracy,
+                           verbose,epoch,num_epochs,start_time,loss,accuracy);
             if (verbose) {
                 print_status(epoch + 1,num_epochs,
                              (B < MVd)? 100 : -1,
@@ -522,17 +807,25 @@ void model_fit(MODEL* m,
             if (v_accuracies != NULL) 
                 v_accuracies[epoch] = v_accuracy;
         }
-        if (verbose > 1)
+        if (verbose > 1 && av == NULL)
             printf("\n");
+        PHASE_END();
     }
-    for (int i = 0; i < L; i++) {
-        freemem(dy[i]);
+    if (av != NULL) {
+        async_validation_join(av,v_losses,v_accuracies,
+                              verbose,num_epochs,start_time);
+        async_validation_free(av);
     }
+    dpar_free(dp);
     freemem(x);
     freemem(yt);
     batch_free(bTr);
     if (bVd != NULL)
         batch_free(bVd);
+    if (nTr != sTr)
+        datasrc_free(nTr);
+    if (nVd != sVd && nVd != nTr)
+        datasrc_free(nVd);
     if (final) {
         m->final = 1;
         for (int i = 0; i < m->num_layers; i++) {
@@ -554,6 +847,9 @@ void model_fit(MODEL* m,
  * x is an array of input samples.
  * y is an array to be updated with output predictions.
  * len is number of smaples.
+ *
+ * Samples are processed in batches of up to batch_size samples; a last
+ * partial batch is computed only on its actual samples (not padded).
  */
 void model_predict(MODEL* m, const fArr2D x_, fArr2D y_, int len)
 {
@@ -576,20 +872,28 @@ void model_predict(MODEL* m, const fArr2D x_, fArr2D y_, int len)
     typedef float (*VecDx);
     VecDx mean = (VecDx) m->mean;
     VecDx sdev = (VecDx) m->sdev;
-    /* Allocate memory for one batch */
+    /* One batch, in the scratch arena, so that predicting does not
+     * allocate memory once the arena is large enough
+     */
+    SCRATCH_MARK mark = scratch_mark();
     typedef float (*ArrBDb)[Db];
-    ArrBDb xb = (ArrBDb) allocmem(B,Db,float); /* Array of samples      */
+    ArrBDb xb = (ArrBDb) scratchmem(B,Db,float); /* Array of samples    */
 
-    BATCH* b = batch_create(x,D,NULL,0,B,NULL,len,0,m->add_bias);
+    PHASE_BEGIN("predict","predict",-1);
     reset_state(m);
-    for (;;) {
+    for (int r = 0; r < len; r += B) {
         fArr2D yp[L]; /* Pointers to layers' prediction arrays */
-        int cnt = batch_copy(b,xb,NULL);
-        if (cnt == 0)
-            break;
+        PHASE_BEGIN("prepare batch","data",-1);
+        int cnt = (len - r < B) ? len - r : B;
+        for (int i = 0; i < cnt; i++) {
+            fltcpy(xb[i],x[r + i],D);
+            if (m->add_bias)
+                xb[i][D] = 1.0;
+        }
         if (m->normalize)
-            normalize(xb,B,Db,mean,sdev,1); 
-        model_batch_forward(m,xb,yp);
+            normalize(xb,cnt,Db,mean,sdev,1); 
+        PHASE_END();
+        model_batch_forward(m,xb,cnt,yp); /* Only cnt rows are computed */
         if (m->loss_func == 'N') {
             /* Full-vocabulary pass, then normalize to a distribution. */
             negsample_logits(m->layer[L - 1].negsample,yp[L - 1],
@@ -600,33 +904,626 @@ void model_predict(MODEL* m, const fArr2D x_, fArr2D y_, int len)
             fltcpy((fArr2D) y,yp[L - 1],cnt * No);
         y += cnt;
     }
-    freemem(xb);
-    batch_free(b);
+    PHASE_END();
+    scratch_release(mark);
+}
+
+/* Sequences predicted in parallel, see model_predict_sequences() */
+typedef struct {
+    MODEL* m;           /* Model whose predictions are computed            */
+    int num;            /* Number of sequences                             */
+    MODEL** local;      /* [threads] Model of each thread, by thread id    */
+    int* busy;          /* [threads] If not zero, local model is in use    */
+    MODEL** free;       /* [num] Other models not in use by any range      */
+    int num_free;       /* Number of entries of free                       */
+    pthread_mutex_t lock;
+    const float* x;     /* Input samples of all the sequences              */
+    float* y;           /* Output predictions of all the sequences         */
+    const int* lens;    /* [num] Sequence lengths                          */
+    const long* offs;   /* [num] Offsets of the sequences' first samples   */
+} PREDSEQS;
+
+/* Creates a replica of model m, with its own buffers and the same weights */
+static MODEL* model_replica(MODEL* m)
+{
+    MODEL* r = model_snapshot_create(m);
+    if (r == NULL) {
+        fflush(stdout);
+        fprintf(stderr,"model_predict_sequences: failed to replicate "
+                       "the model\n");
+        exit(-1);
+    }
+    model_set_batch_size(r,m->batch_size);
+    model_copy_weights(r,m);
+    /* Same kernels as m, which may have been set other than by tuning */
+    for (int i = 0; i < m->num_layers; i++) {
+        const LAYER* l = &m->layer[i];
+        switch (l->type) {
+            case 'd':
+                r->layer[i].dense->kernel = l->dense->kernel;
+            break;
+            case 't': {
+                const TRANSFORMER* tr = l->transformer;
+                TRANSFORMER* rt = r->layer[i].transformer;
+                rt->mha->kernel = tr->mha->kernel;
+                rt->ffn1->kernel = tr->ffn1->kernel;
+                rt->ffn2->kernel = tr->ffn2->kernel;
+            }
+            break;
+        }
+    }
+    return r;
+}
+
+/* Creates the replica of worker id, on the worker, so that its buffers
+ * and weights are placed on the worker's node. The thread that calls
+ * model_predict_sequences() uses the model itself, and workers with ids
+ * of num or more create one only if they run a range.
+ */
+static void create_local_replica(void* arg, int id)
+{
+    PREDSEQS* a = (PREDSEQS*) arg;
+    if (id > 0 && id < a->num && a->local[id] == NULL)
+        a->local[id] = model_replica(a->m);
+}
+
+/* Predicts sequences lo to hi - 1 with a model that no other range uses:
+ * the calling thread's own model, unless it is in use. A thread that waits
+ * for nested tasks of model_predict() (threaded kernels) may run another
+ * range before this one is done; that range takes a model from a free
+ * list, or creates one if none is free.
+ */
+static void predict_sequences(void* arg, int lo, int hi)
+{
+    PREDSEQS* a = (PREDSEQS*) arg;
+    int id = sched_thread_id();
+    MODEL* m = NULL;
+    if (!a->busy[id]) { /* Only this thread uses its entries */
+        if (a->local[id] == NULL)
+            a->local[id] = model_replica(a->m);
+        a->busy[id] = 1;
+        m = a->local[id];
+    }
+    else {
+        pthread_mutex_lock(&a->lock);
+        if (a->num_free > 0)
+            m = a->free[--a->num_free];
+        pthread_mutex_unlock(&a->lock);
+        if (m == NULL)
+            m = model_replica(a->m);
+    }
+    int D = m->input_dim;
+    int No = (m->loss_func == 'N') ? 
+                   m->layer[m->num_layers - 1].negsample->K : m->output_dim;
+    for (int i = lo; i < hi; i++)
+        model_predict(m,(fArr2D) (a->x + a->offs[i] * D),
+                        (fArr2D) (a->y + a->offs[i] * No),a->lens[i]);
+    if (m == a->local[id]) {
+        a->busy[id] = 0;
+        return;
+    }
+    pthread_mutex_lock(&a->lock);
+    a->free[a->num_free++] = m;
+    pthread_mutex_unlock(&a->lock);
+}
+
+/* Predicts the outputs of num sequences of input samples, in parallel, and
+ * returns them in y.
+ *
+ * x is an array of the input samples of all the sequences, one after the
+ *   other.
+ * y is an array to be updated with output predictions.
+ * lens is an array of the sequences' numbers of samples.
+ * num is number of sequences.
+ *
+ * Each sequence is predicted as by model_predict(). Sequences are divided
+ * among the threads of the default scheduler (see tasksched.h); each range
+ * of sequences is predicted with m, or with a replica of m that no other
+ * range uses at the same time, so the predictions are those of predicting
+ * the sequences one by one. Each worker thread creates its own replica,
+ * so that its memory is placed on the thread's node.
+ */
+void model_predict_sequences(MODEL* m, const fArr2D x, fArr2D y,
+                             const int* lens, int num)
+{
+    SCHED* s = sched_default();
+    int threads = sched_num_threads(s);
+    if (num < 2 || threads < 2) {
+        int D = m->input_dim;
+        int No = (m->loss_func == 'N') ? 
+                   m->layer[m->num_layers - 1].negsample->K : m->output_dim;
+        for (long i = 0, off = 0; i < num; off += lens[i++])
+            model_predict(m,(fArr2D) ((const float*) x + off * D),
+                            (fArr2D) ((float*) y + off * No),lens[i]);
+        return;
+    }
+    /* m and a replica for each worker; more are created if ranges nest */
+    PREDSEQS a = { m, num, allocmem(threads,1,MODEL*),
+                   allocmem(threads,1,int), allocmem(num,1,MODEL*), 0,
+                   PTHREAD_MUTEX_INITIALIZER, (const float*) x, (float*) y,
+                   lens, NULL };
+    a.local[sched_thread_id()] = m;
+    sched_run_on_all(s,create_local_replica,&a);
+    long* offs = allocmem(1,num,long);
+    for (int i = 1; i < num; i++)
+        offs[i] = offs[i - 1] + lens[i - 1];
+    a.offs = offs;
+    parallel_for(s,0,num,1,predict_sequences,&a);
+    for (int i = 0; i < threads; i++)
+        if (a.local[i] != NULL && a.local[i] != m)
+            model_free(a.local[i]);
+    for (int i = 0; i < a.num_free; i++)
+        model_free(a.free[i]);
+    pthread_mutex_destroy(&a.lock);
+    freemem(a.local);
+    freemem(a.busy);
+    freemem(a.free);
+    freemem(offs);
 }
 
-static void model_batch_forward(MODEL* m, fArr2D x, fArr2D* yp)
+/* Creates a pool of paged caches of attention keys and values, for the
+ * transformer layers of a model; see kvcache.h.
+ *
+ * num_blocks is the number of blocks of the pool, each holding the keys
+ * and values of KV_BLOCK tokens of all the transformer layers.
+ *
+ * Free it with kvpool_free(), after the sessions created for it.
+ */
+KVPOOL* model_kvpool(MODEL* m, int num_blocks)
+{
+    int layers = 0;
+    int D = 0;
+    for (int j = 0; j < m->num_layers; j++)
+        if (m->layer[j].type == 't') {
+            if (layers > 0 && m->layer[j].transformer->D != D) {
+                fflush(stdout);
+                fprintf(stderr,"model_kvpool: transformer layers of "
+                        "dimensions %d and %d\n",D,m->layer[j].transformer->D);
+                exit(-1);
+            }
+            D = m->layer[j].transformer->D;
+            layers++;
+        }
+    if (layers == 0) {
+        fflush(stdout);
+        fprintf(stderr,"model_kvpool: model has no transformer layers\n");
+        exit(-1);
+    }
+    return kvpool_create(layers,D,num_blocks);
+}
+
+/* Predicts the outputs of new tokens of generation sessions, whose
+ * earlier tokens' attention keys and values are in a paged cache. Used
+ * to generate the tokens of several sessions together, one (or a few)
+ * at a time, computing each token's keys and values only once.
+ *
+ * p is the pool of the sessions' caches, from model_kvpool().
+ * seqs is an array of num sessions, from kvseq_create() or kvseq_fork().
+ * steps is the number of new tokens of each session.
+ * x is an array of num * steps input samples, the new tokens of session
+ * i at rows i * steps to (i + 1) * steps - 1.
+ * y is an array to be updated with their output predictions.
+ *
+ * num * steps is at most the batch size, and steps is at most the
+ * sequence length of the transformer layers; the layers of the model
+ * must be dense or strictly causal (lookahead 0) transformer layers.
+ *
+ * Returns 0, and adds steps to the number of tokens of each session; or
+ * -1 if the pool has too few free blocks for the new tokens, and then
+ * the sessions' tokens are not changed.
+ */
+int model_predict_paged(MODEL* m, KVPOOL* p, KVSEQ* const* seqs, int num,
+                        int steps, const fArr2D x_, fArr2D y)
+{
+    const int L = m->num_layers;
+    const int rows = num * steps;
+    const int D = m->input_dim;
+    const int Db = D + m->add_bias;
+    if (rows < 1 || rows > m->batch_size) {
+        fflush(stdout);
+        fprintf(stderr,"model_predict_paged: %d sessions of %d tokens "
+                "exceed batch size %d\n",num,steps,m->batch_size);
+        exit(-1);
+    }
+    for (int i = 0; i < num; i++)
+        if (kvseq_reserve(p,seqs[i],steps) < 0)
+            return -1;
+
+    typedef float (*ArrMD)[D];
+    typedef float (*ArrBDb)[Db];
+    const ArrMD x = (const ArrMD) x_;
+    SCRATCH_MARK mark = scratch_mark();
+    ArrBDb xb = (ArrBDb) scratchmem(rows,Db,float);
+    for (int i = 0; i < rows; i++) {
+        fltcpy(xb[i],x[i],D);
+        if (m->add_bias)
+            xb[i][D] = 1.0;
+    }
+    if (m->normalize)
+        normalize(xb,rows,Db,m->mean,m->sdev,1);
+
+    PHASE_BEGIN("predict","predict",-1);
+    fArr2D X = (fArr2D) xb;
+    for (int j = 0, kv_lyr = 0; j < L; j++) {
+        LAYER* l = &m->layer[j];
+        PHASE_BEGIN(layer_event(l,0),"forward",j);
+        switch (l->type) {
+            case 'd':
+                dense_set_shape(l->dense,rows);
+                X = dense_forward(l->dense,X,j);
+                break;
+            case 't':
+                transformer_set_shape(l->transformer,num,steps);
+                transformer_forward_paged(l->transformer,p,seqs,X,l->out,
+                                          kv_lyr++,j);
+                X = l->out;
+                break;
+            default:
+                layer_unsupported("model_predict_paged",l->type);
+        }
+        PHASE_END();
+    }
+    PHASE_END();
+    fltcpy(y,X,rows * m->output_dim);
+    for (int i = 0; i < num; i++)
+        seqs[i]->len += steps;
+    scratch_release(mark);
+    return 0;
+}
+
+/* Runs the forward pass of all layers on the first rows rows of x.
+ * rows is at most the batch size; layers use a prefix of their buffers.
+ */
+static void model_batch_forward(MODEL* m, fArr2D x, int rows, fArr2D* yp)
 {
     int L = m->num_layers;
-    yp[0] = layer_forward(&m->layer[0],x,0);
-    for (int j = 1; j < L; j++)
-        yp[j] = layer_forward(&m->layer[j],yp[j - 1],j);
+    for (int j = 0; j < L; j++) {
+        PHASE_BEGIN(layer_event(&m->layer[j],0),"forward",j);
+        yp[j] = layer_forward(&m->layer[j],(j > 0) ? yp[j - 1] : x,rows,j);
+        PHASE_END();
+    }
 }
 
-static void model_batch_backward(MODEL* m, fArr2D x, fArr2D* dy, fArr2D* yp)
+/* Runs the backward pass of all layers, on the same rows as the preceding
+ * model_batch_forward().
+ */
+static void model_batch_backward(MODEL* m, fArr2D x, int rows, 
+                                 fArr2D* dy, fArr2D* yp)
 {
     int L = m->num_layers;
-    for (int j = L - 1; j > 0; j--)
-        layer_backward(&m->layer[j],dy[j],yp[j - 1],dy[j - 1],j);
-    layer_backward(&m->layer[0],dy[0],x,NULL,0);
+    for (int j = L - 1; j >= 0; j--) {
+        PHASE_BEGIN(layer_event(&m->layer[j],1),"backward",j);
+        if (j > 0)
+            layer_backward(&m->layer[j],dy[j],yp[j - 1],dy[j - 1],rows,j);
+        else
+            layer_backward(&m->layer[0],dy[0],x,NULL,rows,0);
+        PHASE_END();
+    }
 }
 
 /* Updates model weights */
 static void model_update(MODEL* m, float learning_rate, float weight_decay)
 {
     int uc = ++m->update_cnt;
+    PHASE_BEGIN("update","train",-1);
     for (int j = 0; j < m->num_layers; j++)
         layer_update(&m->layer[j],m->optimizer,
                      learning_rate,weight_decay,uc);
+    PHASE_END();
+}
+
+/* Computes the loss and accuracy of model m on validation data.
+ *
+ * Parameters:
+ *   m          - Model
+ *   bVd        - Validation data batches (not shuffled)
+ *   MVd        - Number of validation vectors
+ *   norm       - If not zero, normalizes each batch (see model_fit())
+ *   x, yt      - Buffers of one batch of inputs and true outputs
+ *   dy         - Scratch buffer for the last layer's output gradient
+ *                (negative sampling only)
+ *   v_loss     - Returns the validation loss
+ *   v_accuracy - Returns the validation accuracy
+ *   verbose    - If not zero, prints progress, along with the epoch,
+ *                num_epochs, start_time, loss and accuracy of training
+ */
+static void model_validate(MODEL* m, BATCH* bVd, long MVd, int norm,
+                           fArr2D x, fArr2D yt, fArr2D dy,
+                           float* v_loss_, float* v_accuracy_,
+                           int verbose, int epoch, int num_epochs, 
+                           float start_time, float loss, float accuracy)
+{
+    int L = m->num_layers;
+    int N = m->output_dim;
+    int B = m->batch_size;
+    int Db = m->input_dim + m->add_bias;
+    float v_loss = 0;
+    float v_match_cnt = 0;
+    int v_sample_cnt = 0;
+    
+    TRACE_BEGIN("validation","validate",epoch);
+    PERF_BEGIN("validation",-1);
+    batch_shuffle(bVd); /* Only resets, doesn't actually shuffle */
+    reset_state(m);
+    for (;;) {
+        fArr2D yp[L]; /* Pointers to layers' prediction arrays */
+        int cnt = batch_copy(bVd,x,yt);  
+        if (cnt < 0) {
+            fflush(stdout);
+            fprintf(stderr,"model_fit: failed to read validation data\n");
+            exit(-1);
+        }
+        if (cnt == 0)
+            break;
+        if (norm)
+            normalize(x,cnt,Db,m->mean,m->sdev,1); 
+        model_batch_forward(m,x,cnt,yp);
+        v_sample_cnt += cnt;
+
+        switch(m->loss_func) {
+            case 'm':
+                v_loss += mean_square_error(yp[L - 1],yt,cnt,N) * 100;
+                v_match_cnt += R2_sum(yp[L - 1],yt,cnt,N);
+            break;
+            case 'c':
+                v_loss += cross_entropy_loss(yp[L - 1],yt,cnt,N);
+                v_match_cnt += match_sum(yp[L - 1],yt,cnt,N);
+            break;
+            case 'C':
+                v_loss += ctc_loss(m->ctc,yp[L - 1],yt,cnt,N);
+                v_match_cnt += ctc_accuracy(m->ctc,yp[L - 1],yt,cnt,N);
+            break;
+            case 'N': {
+                /* Eval only: compute loss/accuracy. The grad buffers
+                 * (dy, head grads) are written but never applied,
+                 * since no model_update runs during validation.
+                 */
+                NEGSAMPLE* head = m->layer[L - 1].negsample;
+                int correct = 0;
+                v_loss += negsample_loss(head,yp[L - 1],yt,
+                                         m->layer[L - 1].grads[0],
+                                         dy,cnt,&correct);
+                v_match_cnt += correct;
+            }
+            break;
+        }
+        if (verbose) {
+            print_status(epoch + 1,num_epochs,
+                    (B < MVd) ? (int) (v_sample_cnt * 100L / MVd) : -1,
+                    elapsed_time(start_time),
+                    loss,accuracy,
+                    v_loss / v_sample_cnt, v_match_cnt / v_sample_cnt);
+        }
+        if (batch_eos(bVd))
+            reset_state(m);
+    }
+    *v_loss_ = v_loss / v_sample_cnt;
+    *v_accuracy_ = v_match_cnt / v_sample_cnt;
+    PHASE_END();
+}
+
+/* Copies the weights, and normalization parameters, of model src into
+ * model dst, which has the same layers.
+ */
+static void model_copy_weights(MODEL* dst, const MODEL* src)
+{
+    for (int i = 0; i < src->num_layers; i++) {
+        fArr2D ws[LAYER_MAX_WEIGHTS], wd[LAYER_MAX_WEIGHTS];
+        long ns[LAYER_MAX_WEIGHTS], nd[LAYER_MAX_WEIGHTS];
+        int k = layer_weights(&src->layer[i],ws,ns);
+        if (layer_weights(&dst->layer[i],wd,nd) != k) {
+            fflush(stdout);
+            fprintf(stderr,"model_copy_weights: layer %d mismatch\n",i);
+            exit(-1);
+        }
+        for (int j = 0; j < k; j++)
+            memcpy(wd[j],ws[j],ns[j] * sizeof(float));
+        layer_weights_changed(&dst->layer[i]);
+    }
+    if (src->normalize) {
+        int Dx = src->input_dim - (1 - src->add_bias);
+        fltcpy(dst->mean,src->mean,Dx);
+        fltcpy(dst->sdev,src->sdev,Dx);
+    }
+}
+
+/* Creates a model with the same layers as model m, and its own buffers,
+ * using the model file format in memory. Returns NULL if it fails.
+ */
+static MODEL* model_snapshot_create(const MODEL* m)
+{
+    char* buf = NULL;
+    size_t size = 0;
+    MODEL* s = NULL;
+    FILE* fp = open_memstream(&buf,&size);
+    if (fp == NULL)
+        return NULL;
+    PHASE_BEGIN("snapshot","io",-1);
+    int ok = write_model(m,1,fp);
+    if (fclose(fp) == 0 && ok && (fp = fmemopen(buf,size,"r")) != NULL) {
+        s = read_model(fp);
+        fclose(fp);
+    }
+    PHASE_END();
+    free(buf);
+    return s;
+}
+
+static void* async_validation_run(void* arg)
+{
+    ASYNCVAL* av = (ASYNCVAL*) arg;
+    trace_thread_name("validation");
+    model_validate(av->m,av->b,av->M,av->m->normalize,av->x,av->yt,NULL,
+                   &av->v_loss,&av->v_accuracy,0,av->epoch,0,0,0,0);
+    return NULL;
+}
+
+/* Creates the context of validation on another thread, with a snapshot of
+ * model m. Returns NULL if it fails; validation then runs synchronously.
+ */
+static ASYNCVAL* async_validation_create(MODEL* m, BATCH* bVd, long MVd)
+{
+    MODEL* s = model_snapshot_create(m);
+    if (s == NULL)
+        return NULL;
+    int B = m->batch_size;
+    ASYNCVAL* av = allocmem(1,1,ASYNCVAL);
+    av->m = s;
+    av->b = bVd;
+    av->M = MVd;
+    av->x = allocmem(B,m->input_dim + m->add_bias,float);
+    av->yt = allocmem(B,m->target_dim,float);
+    av->epoch = -1;
+    return av;
+}
+
+/* Copies the weights of model m to the snapshot, and starts validating
+ * it on another thread. If a thread cannot be started, validates here.
+ */
+static void async_validation_start(ASYNCVAL* av, MODEL* m, int epoch,
+                                   float loss, float accuracy)
+{
+    PHASE_BEGIN("copy weights","validate",epoch);
+    model_copy_weights(av->m,m);
+    PHASE_END();
+    av->epoch = epoch;
+    av->loss = loss;
+    av->accuracy = accuracy;
+    av->running = 
+        pthread_create(&av->thread,NULL,async_validation_run,av) == 0;
+    if (!av->running)
+        async_validation_run(av);
+}
+
+/* Waits for the validation started by async_validation_start() to finish,
+ * and reports its results.
+ */
+static void async_validation_join(ASYNCVAL* av, 
+                                  float* v_losses, float* v_accuracies,
+                                  int verbose, int num_epochs, 
+                                  float start_time)
+{
+    if (av->running)
+        pthread_join(av->thread,NULL);
+    av->running = 0;
+    if (av->epoch < 0)
+        return;
+    if (verbose) {
+        print_status(av->epoch + 1,num_epochs,
+                     (av->m->batch_size < av->M) ? 100 : -1,
+                     elapsed_time(start_time),
+                     av->loss,av->accuracy,av->v_loss,av->v_accuracy);
+        if (verbose > 1)
+            printf("\n");
+    }
+    if (v_losses != NULL) 
+        v_losses[av->epoch] = av->v_loss;
+    if (v_accuracies != NULL) 
+        v_accuracies[av->epoch] = av->v_accuracy;
+    av->epoch = -1;
+}
+
+static void async_validation_free(ASYNCVAL* av)
+{
+    model_free(av->m);
+    freemem(av->x);
+    freemem(av->yt);
+    freemem(av);
+}
+
+/* Creates the data parallel training state of model m, and copies the
+ * weights and normalization parameters of rank 0 to all ranks.
+ */
+static DPAR* dpar_create(MODEL* m)
+{
+    if (m->loss_func == 'N') {
+        fflush(stdout);
+        fprintf(stderr,"model_fit: negative sampling cannot be trained "
+                       "data parallel\n");
+        exit(-1);
+    }
+    DPAR* dp = allocmem(1,1,DPAR);
+    dp->c = m->comm;
+    int ok = 1;
+    for (int i = 0; i < m->num_layers; i++) {
+        fArr2D w[LAYER_MAX_WEIGHTS];
+        long n[LAYER_MAX_WEIGHTS];
+        int k = layer_weights(&m->layer[i],w,n);
+        for (int j = 0; j < k; j++)
+            ok = ok && comm_broadcast(dp->c,(float*) w[j],n[j],0);
+        layer_weights_changed(&m->layer[i]);
+        k = layer_gradients(&m->layer[i],w,n);
+        for (int j = 0; j < k; j++)
+            dp->n += n[j];
+    }
+    if (m->normalize) {
+        int Dx = m->input_dim - (1 - m->add_bias);
+        ok = ok && comm_broadcast(dp->c,m->mean,Dx,0);
+        ok = ok && comm_broadcast(dp->c,m->sdev,Dx,0);
+    }
+    if (!ok) {
+        fflush(stdout);
+        fprintf(stderr,"model_fit: failed to copy weights of rank 0\n");
+        exit(-1);
+    }
+    dp->buf = allocmem(1,dp->n + 1,float);
+    return dp;
+}
+
+/* Replaces the gradients of model m, computed on cnt samples, with the
+ * average gradients of all ranks, weighted by their number of samples.
+ *
+ * Returns:
+ *   The total number of samples of all ranks; if it is 0 the gradients
+ *   are not changed.
+ */
+static int dpar_reduce(DPAR* dp, MODEL* m, int cnt)
+{
+    float* p = dp->buf;
+    for (int i = 0; i < m->num_layers; i++) {
+        fArr2D g[LAYER_MAX_WEIGHTS];
+        long n[LAYER_MAX_WEIGHTS];
+        int k = layer_gradients(&m->layer[i],g,n);
+        for (int j = 0; j < k; j++) {
+            const float* gj = (const float*) g[j];
+            for (long e = 0; e < n[j]; e++)
+                p[e] = (cnt > 0) ? gj[e] * cnt : 0.0;
+            p += n[j];
+        }
+    }
+    *p = cnt;
+    PHASE_BEGIN("allreduce","comm",-1);
+    if (!comm_allreduce(dp->c,dp->buf,dp->n + 1)) {
+        fflush(stdout);
+        fprintf(stderr,"model_fit: failed to reduce gradients\n");
+        exit(-1);
+    }
+    PHASE_END();
+    int total = (int) *p;
+    if (total == 0)
+        return 0;
+    float scale = 1.0 / total;
+    p = dp->buf;
+    for (int i = 0; i < m->num_layers; i++) {
+        fArr2D g[LAYER_MAX_WEIGHTS];
+        long n[LAYER_MAX_WEIGHTS];
+        int k = layer_gradients(&m->layer[i],g,n);
+        for (int j = 0; j < k; j++) {
+            float* gj = (float*) g[j];
+            for (long e = 0; e < n[j]; e++)
+                gj[e] = p[e] * scale;
+            p += n[j];
+        }
+    }
+    return total;
+}
+
+static void dpar_free(DPAR* dp)
+{
+    if (dp == NULL)
+        return;
+    freemem(dp->buf);
+    freemem(dp);
 }
 
 /* Prints a text line with model training progress information. 
@@ -8,6 +8,9 @@
 #include "ctc.h"
 #include "adamw.h"
 #include "layer.h"
+#include "kvcache.h"
+#include "datasrc.h"
+#include "comm.h"
 
 typedef struct model_s {
     int num_layers; /* Number of layers                           */
@@ -26,6 +29,9 @@ typedef struct model_s {
     fVec sdev;      /* For input normalization                    */
     int compiled;   /* If not zero, it is already compiled        */
     int final;      /* If zero, can be further trained            */
+    COMM* comm;     /* Data parallel training processes, or NULL  */
+    fArr2D* dy;     /* Gradients of layers' outputs (in plan)     */
+    MEMPLAN* plan;  /* Workspace of layers' scratch buffers       */
 } MODEL;
 
 /* Creates a container for multi layer neural network.
@@ -53,7 +59,7 @@ void model_free(MODEL* m);
 /* Adds a layer to a model
  * m points to a model
  * layer points to a neural network (e.g. DENSE) to be added as a layer
- * type is the type of the layer: "dense", "lstm" or "transformer"
+ * type is the type of the layer: "dense", "lstm", "gru" or "transformer"
  * 
  * The layer is added after all other layers in the model
  */
@@ -81,6 +87,58 @@ void model_compile(MODEL* m, const char* loss_func, const char* optimizer);
  */
 void model_set_batch_size(MODEL* m, int batch_size);
 
+/* Selects the matrix product kernel of each dense and attention layer.
+ *
+ * For each layer, the fastest kernel of the layer's shape at its current
+ * batch size is selected, see autotune.h. Decisions are kept in a cache
+ * file of this host, so only shapes not yet in it run the kernels.
+ *
+ * Parameters:
+ *   force - If not zero, the kernels of every shape are run again, and
+ *           the cache is updated
+ *
+ * Notes:
+ *   model_compile(), model_set_batch_size() and read_model() call this
+ *   function; call it again after a layer's batch size is changed directly.
+ */
+void model_tune(MODEL* m, int force);
+
+/* Plans the memory of the buffers that training uses only in some of its
+ * steps: the gradients of the layers' outputs, and the layers' scratch
+ * buffers (see layer_plan()). Buffers that are not used in the same steps
+ * share memory in one workspace (see memplan.h).
+ *
+ * Notes:
+ *   model_compile() and model_set_batch_size() call this function, and
+ *   model_fit() calls it if the model was not planned, e.g. if it was read
+ *   from a file. Setting the environment variable MLINC_MEMPLAN to 0 gives
+ *   each buffer its own memory in the workspace.
+ */
+void model_plan(MODEL* m);
+
+/* Prints the planned buffers of a model, and the size of its workspace
+ * compared with the size of separate buffers.
+ */
+void model_print_plan(const MODEL* m, FILE* f);
+
+/* Sets the communicator of data parallel training, or NULL to train in
+ * this process only.
+ *
+ * Each process (rank) of the communicator creates the same model, and
+ * calls model_fit() with its own part (shard) of the training data.
+ * model_fit() then copies the weights, and the normalization parameters,
+ * of rank 0 to all ranks, and after each batch averages the gradients
+ * of all ranks, weighted by their number of samples, before updating the
+ * weights; so the models of all ranks stay identical. A rank whose shard
+ * has fewer batches contributes no gradients to the last updates.
+ *
+ * Training loss and accuracy are those of all the shards; validation is
+ * done by each rank on the validation data it is given.
+ *
+ * Negative sampling, whose gradients are sparse, is not supported.
+ */
+void model_set_comm(MODEL* m, COMM* comm);
+
 /* Trains model on data xTr and true outputs yTr. The data is organized as
  * a list of data sample sequences of varying lengths and corresponding
  * true outputs. The dimension of the vectors in x sequences is
@@ -151,6 +209,22 @@ void model_set_batch_size(MODEL* m, int batch_size);
  * each epoch's loss and accuracy on a separate line.
  * Default value is 0.
  *
+ * If async_validation is not zero, each epoch's validation runs on another
+ * thread, on a copy of the model weights taken at the end of the epoch,
+ * while the next epoch trains. The results are the same as those of
+ * validation on the training thread. It does not apply to negative 
+ * sampling, or when the validation and training data are the same
+ * data source. Default value is 0.
+ *
+ * If prenormalize is not zero, and the model normalizes its inputs, the
+ * training and validation data are normalized once, before the first
+ * epoch, into copies of the data in memory, rather than each batch in
+ * every epoch. Only arrays in memory are normalized once; data read from
+ * other sources, such as files, is normalized each batch, and is never
+ * copied. Default value is 0. To normalize arrays in place, once for
+ * several calls, pass model_fit_source() the data sources returned by
+ * datasrc_arrays_normalize().
+ *
  * Schedule specified a training schedule with variable learning rate 
  * and  * weight decay. The format of this parameter is <e>:<l>:<w>,...
  * where <e> is number of epochs, <l> and <w> are the learning rate and 
@@ -163,13 +237,88 @@ void model_fit(MODEL* m,
     float* losses, float* accuracies, 
     float* v_losses, float* v_accuracies,
     const char* kwargs);
+
+/* Trains model on data read from data source sTr, and optionally validates
+ * it on data read from data source sVd (may be NULL). Only one batch of
+ * data is held in memory at a time, so the dataset may be larger than
+ * the available memory; see datasrc.h.
+ *
+ * The input dimension of the sources is the model input dimension, and
+ * their output dimension is the model output dimension (1 for negative
+ * sampling). Input normalization statistics are computed by reading the
+ * training data source once before training, unless it is marked as
+ * normalized (see datasrc_arrays_normalize()).
+ *
+ * The other parameters are the same as for model_fit(), which is
+ * equivalent to calling this function with datasrc_arrays() sources.
+ */
+void model_fit_source(MODEL* m, DATASRC* sTr, DATASRC* sVd,
+    int num_epochs, float learning_rate, float weight_decay,
+    float* losses, float* accuracies, 
+    float* v_losses, float* v_accuracies,
+    const char* kwargs);
     
 /* Predicts the outputs of the inputs samples in x, and returns them in y.
  *
  * x is an array of input samples.
  * y is an array to be updated with output predictions.
  * len is number of smaples.
+ *
+ * Samples are processed in batches of up to batch_size samples; a last
+ * partial batch is computed only on its actual samples (not padded).
  */
 void model_predict(MODEL* m, const fArr2D x, fArr2D y, int len);
 
+/* Predicts the outputs of num sequences of input samples, in parallel, and
+ * returns them in y.
+ *
+ * x is an array of the input samples of all the sequences, one after the
+ *   other.
+ * y is an array to be updated with output predictions.
+ * lens is an array of the sequences' numbers of samples.
+ * num is number of sequences.
+ *
+ * Each sequence is predicted as by model_predict(). Sequences are divided
+ * among the threads of the default scheduler (see tasksched.h); each range
+ * of sequences is predicted with m, or with a replica of m that no other
+ * range uses at the same time, so the predictions are those of predicting
+ * the sequences one by one. Each worker thread creates its own replica,
+ * so that its memory is placed on the thread's node.
+ */
+void model_predict_sequences(MODEL* m, const fArr2D x, fArr2D y,
+                             const int* lens, int num);
+
+/* Creates a pool of paged caches of attention keys and values, for the
+ * transformer layers of a model; see kvcache.h.
+ *
+ * num_blocks is the number of blocks of the pool, each holding the keys
+ * and values of KV_BLOCK tokens of all the transformer layers.
+ *
+ * Free it with kvpool_free(), after the sessions created for it.
+ */
+KVPOOL* model_kvpool(MODEL* m, int num_blocks);
+
+/* Predicts the outputs of new tokens of generation sessions, whose
+ * earlier tokens' attention keys and values are in a paged cache. Used
+ * to generate the tokens of several sessions together, one (or a few)
+ * at a time, computing each token's keys and values only once.
+ *
+ * p is the pool of the sessions' caches, from model_kvpool().
+ * seqs is an array of num sessions, from kvseq_create() or kvseq_fork().
+ * steps is the number of new tokens of each session.
+ * x is an array of num * steps input samples, the new tokens of session
+ * i at rows i * steps to (i + 1) * steps - 1.
+ * y is an array to be updated with their output predictions.
+ *
+ * num * steps is at most the batch size, and steps is at most the
+ * sequence length of the transformer layers; the layers of the model
+ * must be dense or strictly causal (lookahead 0) transformer layers.
+ *
+ * Returns 0, and adds steps to the number of tokens of each session; or
+ * -1 if the pool has too few free blocks for the new tokens, and then
+ * the sessions' tokens are not changed.
+ */
+int model_predict_paged(MODEL* m, KVPOOL* p, KVSEQ* const* seqs, int num,
+                        int steps, const fArr2D x, fArr2D y);
+
 #endif
@@ -59,7 +59,7 @@ NEGSAMPLE* negsample_create(int vocab_size, int num_negatives)
  *
  * Parameters:
  *   input_dim  - Size of input vectors (E)
- *   batch_size - Number of input vectors processed simultaneously
+ *   batch_size - Maximum number of input vectors processed simultaneously
  *
  * Notes:
  *   The output weights are initialized using a normal distribution
@@ -69,6 +69,7 @@ void negsample_init(NEGSAMPLE* l, int input_dim, int batch_size)
 {
     l->E = input_dim;
     l->B = batch_size;
+    l->Bmax = batch_size;
     l->Wo = allocmem(l->K,l->E,float);
     l->h = allocmem(l->B,l->E,float);
     l->touched = allocmem(l->B * (l->n_neg + 1),1,int);
@@ -102,21 +103,25 @@ void negsample_set_dist(NEGSAMPLE* l, int* dist_table, int dist_table_size)
  *
  * Notes:
  *   If this function is called before negsample_init(), it does nothing.
- *   Otherwise, the passthrough and touched buffers are resized.
+ *   The passthrough and touched buffers are resized only if batch_size
+ *   exceeds the batch size the layer was initialized with.
  */
 void negsample_set_batch_size(NEGSAMPLE* l, int batch_size)
 {
     if (l->B == 0)
         return;
-    if (batch_size != l->B) {
+    if (batch_size > l->Bmax) {
         l->B = batch_size;
+        l->Bmax = batch_size;
         freemem(l->h);
         l->h = allocmem(l->B,l->E,float);
         freemem(l->touched);
         l->touched = allocmem(l->B * (l->n_neg + 1),1,int);
     }
-    else
+    else {
+        l->B = batch_size;
         fltclr(l->h,l->B * l->E);
+    }
     l->ntouched = 0;
 }
 
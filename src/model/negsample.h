@@ -2,6 +2,8 @@
 /* Negative-sampling layer data structure and functions */
 #ifndef NEGSAMPLE_H
 #define NEGSAMPLE_H
+#include <stdio.h>
+#include <stdlib.h>
 #include "array.h"
 
 /* This layer replaces a dense(K,"Softmax") + cross-entropy output when the
@@ -26,7 +28,8 @@
 typedef struct negsample_s {
   int E;         /* Input vector dimension (= output dimension, identity) */
   int K;         /* Vocabulary size (number of words)                     */
-  int B;         /* Number of input vectors in a batch                    */
+  int B;         /* Number of input vectors in current batch              */
+  int Bmax;      /* Maximum number of input vectors in a batch            */
   int n_neg;     /* Number of negative samples drawn per position         */
   fArr2D Wo;     /* Output weight matrix [K][E]                           */
   fArr2D h;      /* Identity output passthrough [B][E]                    */
@@ -57,7 +60,7 @@ NEGSAMPLE* negsample_create(int vocab_size, int num_negatives);
  *
  * Parameters:
  *   input_dim  - Size of input vectors (E)
- *   batch_size - Number of input vectors processed simultaneously
+ *   batch_size - Maximum number of input vectors processed simultaneously
  *
  * Notes:
  *   The output weights are initialized using a normal distribution
@@ -75,10 +78,28 @@ void negsample_set_dist(NEGSAMPLE* l, int* dist_table, int dist_table_size);
  *
  * Notes:
  *   If this function is called before negsample_init(), it does nothing.
- *   Otherwise, the passthrough and touched buffers are resized.
+ *   The passthrough and touched buffers are resized only if batch_size
+ *   exceeds the batch size the layer was initialized with.
  */
 void negsample_set_batch_size(NEGSAMPLE* l, int batch_size);
 
+/* Sets the number of input vectors processed by the next forward and
+ * backward passes, without reallocating memory.
+ *
+ * Parameters:
+ *   batch_size - Number of input vectors, between 1 and l->Bmax
+ */
+static inline void negsample_set_shape(NEGSAMPLE* l, int batch_size)
+{
+    if (batch_size < 1 || batch_size > l->Bmax) {
+        fflush(stdout);
+        fprintf(stderr,"negsample_set_shape: batch size %d out of range "
+                "1..%d\n",batch_size,l->Bmax);
+        exit(-1);
+    }
+    l->B = batch_size;
+}
+
 /* Frees the memory allocated by negsample_create() / negsample_init().
  * The sampling table passed to negsample_set_dist() is not freed.
  *
@@ -15,7 +15,7 @@
  *
  * Parameters:
  *   heads     - number of attention heads
- *   steps     - sequence length T
+ *   steps     - maximum sequence length T
  *   model_dim - D
  *   ffn_dim   - FFN hidden dimension Dff (typically 4 * model_dim)
  *   lookahead - causal masking for self-attention (fixed for the layer):
@@ -31,9 +31,10 @@ TRANSFORMER* transformer_create(int heads, int steps,
 {
     TRANSFORMER* l = allocmem(1, 1, TRANSFORMER);
     l->T = steps;
+    l->Tmax = steps;
     l->D = model_dim;
     l->Dff = ffn_dim;
-    l->mha = mha_create(heads, steps, lookahead);
+    l->mha = mha_create(heads, steps, lookahead, "softmax");
     l->ffn1 = dense_create(ffn_dim,"gelu");
     l->ffn2 = dense_create(model_dim,"none");
     l->norm1 = addnorm_create();
@@ -47,7 +48,7 @@ TRANSFORMER* transformer_create(int heads, int steps,
  *
  * Parameters:
  *   l            - pointer to the TRANSFORMER
- *   batch_size   - B
+ *   batch_size   - B, maximum number of sequences
  *   training     - non-zero if the backward pass will be used
  *   dropout_rate - fraction of sub-layer outputs to zero (0 = no dropout)
  */
@@ -60,14 +61,17 @@ void transformer_init(TRANSFORMER* l, int batch_size, int training, float dropou
     const int BT = B * T;
 
     l->B = B;
+    l->Bmax = B;
     l->BT = BT;
     l->dropout_rate = dropout_rate;
     l->training = training;
+    l->ffn_rows = transformer_ffn_chunk(BT,Dff);
 
     mha_init(l->mha,D,B,training,0);
     addnorm_init(l->norm1,D,BT);
     addnorm_init(l->norm2,D,BT);
-    dense_init(l->ffn1,D,BT);
+    /* Inference keeps one chunk of ffn1's output, see transformer_ffn() */
+    dense_init(l->ffn1,D,(training) ? BT : l->ffn_rows);
     dense_init(l->ffn2,Dff,BT);
 
     l->mha_out = allocmem(BT,D,float);
@@ -105,14 +109,16 @@ void transformer_free(TRANSFORMER* l)
     addnorm_free(l->norm1);
     addnorm_free(l->norm2);
     mha_free(l->mha);
-    freemem(l->mha_out);
     freemem(l->norm1_out);
-    freemem(l->d_norm2_in);
-    freemem(l->d_ffn1_in);
-    freemem(l->d_norm1_in);
-    freemem(l->d_mha_out);
-    freemem(l->d_ffn2_in);
-    freemem(l->d_mha_masked);
+    if (!l->planned) { /* Otherwise, see layer_plan() */
+        freemem(l->mha_out);
+        freemem(l->d_norm2_in);
+        freemem(l->d_ffn1_in);
+        freemem(l->d_norm1_in);
+        freemem(l->d_mha_out);
+        freemem(l->d_ffn2_in);
+        freemem(l->d_mha_masked);
+    }
     freemem(l->gWx1);
     freemem(l->gWx2);
     freemem(l->dg1);
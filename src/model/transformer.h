@@ -9,6 +9,14 @@
 #include "mha.h"
 #include "addnorm.h"
 #include "dense.h"
+#include "autotune.h"
+
+/* Floats of the FFN intermediate output of a chunk of rows, [rows][Dff]:
+ * 256 KB, which stays in L2 cache between ffn1 and ffn2
+ */
+#ifndef FFN_CHUNK_FLOATS
+#define FFN_CHUNK_FLOATS 65536
+#endif
 
 /* Decoder-only transformer layer.
  *
@@ -28,6 +36,11 @@
  * preceded by token and positional embeddings and followed by a linear
  * projection to vocabulary logits.
  *
+ * The FFN runs in chunks of rows, ffn1 then ffn2 on each chunk, so that the
+ * [rows][Dff] output of ffn1, 4 times wider than the layer's output, is
+ * read by ffn2 while it is in cache. Training keeps all the rows of ffn1's
+ * output for the backward pass; inference keeps only one chunk.
+ *
  * Note: The original paper uses ReLU. This implementation uses GELU instead.
  */
 typedef struct {
@@ -36,7 +49,10 @@ typedef struct {
     int D;              /* Model dimension                               */
     int Dff;            /* FFN hidden dimension (typically 4*D)          */
     int BT;             /* B * T                                         */
+    int Bmax;           /* Batch size buffers are allocated for          */
+    int Tmax;           /* Sequence length buffers are allocated for     */
     int training;       /* 1 if training, 0 if inference                 */
+    int ffn_rows;       /* Rows of each chunk of the FFN                 */
     float dropout_rate; /* Sub-layer output dropout rate                 */
     MHA* mha;           /* Masked self-attention [BT][D]  -> [BT][D]     */
     DENSE* ffn1;        /* FFN first  layer      [BT][D]  -> [BT][Dff]   */
@@ -53,6 +69,7 @@ typedef struct {
     fArr2D d_mha_out;   /* Grad w.r.t. mha output                [BT][D] */
     fArr2D d_ffn2_in;   /* Masked grad into FFN branch (post-drop2) [BT][D] */
     fArr2D d_mha_masked;/* Masked grad into MHA branch (post-drop1) [BT][D] */
+    int planned;        /* Scratch buffers are in a model's workspace    */
     fArr2D gWx1;        /* Gradient of ffn1->Wx  [D][Dff]                */
     fArr2D gWx2;        /* Gradient of ffn2->Wx  [Dff][D]                */
     fVec dg1;           /* Gradient of norm1->gamma  [D]                 */
@@ -65,7 +82,7 @@ typedef struct {
  *
  * Parameters:
  *   heads     - number of attention heads
- *   steps     - sequence length T
+ *   steps     - maximum sequence length T
  *   model_dim - D, the model dimension
  *   ffn_dim   - FFN hidden dimension Dff (typically 4 * model_dim)
  *   lookahead - self-attention masking: <0 bidirectional, 0 causal,
@@ -78,19 +95,105 @@ TRANSFORMER* transformer_create(int heads, int steps,
                                 int model_dim, int ffn_dim,
                                 int lookahead);
 
+/* transformer_ffn_chunk - returns the number of rows of the chunks of the
+ * FFN of a layer of BT rows and FFN hidden dimension Dff, see
+ * FFN_CHUNK_FLOATS.
+ */
+static inline int transformer_ffn_chunk(int BT, int Dff)
+{
+    int rows = FFN_CHUNK_FLOATS / Dff;
+    if (rows < 1)
+        rows = 1;
+    return (rows < BT) ? rows : BT;
+}
+
 /* transformer_init - initialises weights and allocates scratch buffers.
  *
  * Parameters:
  *   l            - pointer to TRANSFORMER returned by transformer_create()
- *   batch_size   - B
+ *   batch_size   - B, maximum number of sequences
  *   training     - non-zero if backward pass will be used
  *   dropout_rate - fraction of sub-layer outputs to zero (0 = no dropout)
  */
 void transformer_init(TRANSFORMER* l, int batch_size, int training, float dropout_rate);
 
+/* transformer_set_shape - sets the batch size and sequence length of the 
+ * next forward and backward passes, without reallocating memory.
+ *
+ * Parameters:
+ *   l          - pointer to the TRANSFORMER
+ *   batch_size - B, number of sequences
+ *   steps      - T, at most the length set by transformer_create()
+ *
+ * Notes:
+ *   B * T must not exceed the number of rows the layer was initialized 
+ *   with. See mha_set_shape().
+ */
+static inline void transformer_set_shape(TRANSFORMER* l, 
+                                         int batch_size, int steps)
+{
+    mha_set_shape(l->mha,batch_size,steps);
+    l->B = batch_size;
+    l->T = steps;
+    l->BT = l->B * l->T;
+    addnorm_set_shape(l->norm1,l->BT);
+    addnorm_set_shape(l->norm2,l->BT);
+    if (l->training || l->BT <= l->ffn_rows)
+        dense_set_shape(l->ffn1,l->BT);
+    else
+        dense_set_shape(l->ffn1,l->ffn_rows); /* See transformer_ffn() */
+    dense_set_shape(l->ffn2,l->BT);
+}
+
 /* transformer_free - releases all memory owned by the layer. */
 void transformer_free(TRANSFORMER* l);
 
+/* transformer_ffn - Step 3 of transformer_forward(), the position-wise
+ * feed-forward network, in chunks of l->ffn_rows rows.
+ *
+ * Parameters:
+ *   l   - pointer to the TRANSFORMER layer
+ *   X   - input [B*T][D]
+ *   lyr - layer index (informational)
+ *
+ * Returns:
+ *   ffn2's output [B*T][D].
+ *
+ * Notes:
+ *   Each chunk computes gelu(X @ Wx1) @ Wx2 of its rows, with the kernels
+ *   of ffn1 and ffn2 (see model_tune()). In training, the output of ffn1
+ *   and its pre-activation values are written to all the rows of ffn1's
+ *   buffers, for the backward pass; in inference, ffn1's buffers hold one
+ *   chunk, which is overwritten by the next.
+ */
+static inline fArr2D transformer_ffn(TRANSFORMER* restrict l,
+                                     const fArr2D restrict X /*[BT][D]*/,
+                                     int lyr)
+{
+    const int BT = l->BT;
+    const int D = l->D;
+    const int Dff = l->Dff;
+    DENSE* ffn1 = l->ffn1;
+    DENSE* ffn2 = l->ffn2;
+    if (BT <= l->ffn_rows) {
+        fArr2D ffn1_out = dense_forward(ffn1,X,lyr);
+        return dense_forward(ffn2,ffn1_out,lyr);
+    }
+    for (int i = 0; i < BT; i += l->ffn_rows) {
+        const int n = (BT - i < l->ffn_rows) ? BT - i : l->ffn_rows;
+        const long k = (l->training) ? (long) i * Dff : 0;
+        float* h = (float*) ffn1->h + k;
+        matmul_kernel(ffn1->kernel,(fArr2D) h,
+                      (fArr2D) ((float*) X + (long) i * D),ffn1->Wx,n,D,Dff);
+        if (l->training)
+            fltcpy((float*) ffn1->z + k,h,n * Dff);
+        gelu((fArr2D) h,n,Dff);
+        matmul_kernel(ffn2->kernel,(fArr2D) ((float*) ffn2->h + (long) i * D),
+                      (fArr2D) h,ffn2->Wx,n,Dff,D);
+    }
+    return ffn2->h;
+}
+
 /* transformer_forward - forward pass of a decoder-only transformer layer.
  *
  * Implements the decoder sub-layer stack from Vaswani et al. (2017),
@@ -114,7 +217,8 @@ void transformer_free(TRANSFORMER* l);
  *   Step 2 - First residual add + layer norm (Eq. after Sec. 3.1):
  *     norm1_out = LayerNorm(X + mha_out)
  *
- *   Step 3 - Position-wise feed-forward network (Sec. 3.3):
+ *   Step 3 - Position-wise feed-forward network (Sec. 3.3), in chunks of
+ *   rows (see transformer_ffn()):
  *     ffn1_out = gelu(norm1_out @ Wx1)
  *     ffn2_out = ffn1_out @ Wx2
  *     ffn2_out = dropout(ffn2_out)             (Sec. 5.4)
@@ -156,8 +260,7 @@ static inline void transformer_forward(TRANSFORMER* restrict l,
      * ffn2_out = ffn1_out @ Wx2
      * ffn2_out = dropout(ffn2_out)
      */
-    fArr2D ffn1_out = dense_forward(l->ffn1,norm1_out,lyr);
-    fArr2D ffn2_out = dense_forward(l->ffn2,ffn1_out,lyr);
+    fArr2D ffn2_out = transformer_ffn(l,norm1_out,lyr);
 
     if (l->training && l->dropout_rate > 0)
         dropout(ffn2_out,drop_mask2,BT,D,l->dropout_rate);
@@ -168,6 +271,39 @@ static inline void transformer_forward(TRANSFORMER* restrict l,
     addnorm_forward(l->norm2,norm1_out,ffn2_out,Y);
 }
 
+/* transformer_forward_paged - forward pass of a decoder-only transformer
+ * layer over new tokens of generation sessions, whose earlier tokens'
+ * attention keys and values are in a paged cache (see kvcache.h).
+ *
+ * Parameters:
+ *   l      - pointer to the TRANSFORMER layer; transformer_set_shape(l,B,T)
+ *            sets the number of sessions B and of new tokens of each
+ *            session T
+ *   p      - pool of the sessions' caches
+ *   seqs   - array of B sessions, see mha_forward_paged()
+ *   X      - input [B*T][D], the new tokens of session b at rows b*T to
+ *            b*T+T-1
+ *   Y      - output [B*T][D]
+ *   kv_lyr - number of this layer's attention in the pool
+ *   lyr    - layer index (informational)
+ *
+ * Computes the outputs of transformer_forward() of an inference layer,
+ * with Step 1 run by mha_forward_paged().
+ */
+static inline void transformer_forward_paged(TRANSFORMER* restrict l,
+                                             const KVPOOL* restrict p,
+                                             KVSEQ* const* seqs,
+                                             const fArr2D restrict X /*[BT][D]*/,
+                                             fArr2D Y /*[BT][D]*/,
+                                             int kv_lyr,
+                                             int lyr)
+{
+    mha_forward_paged(l->mha,p,seqs,X,l->mha_out,kv_lyr,lyr);
+    addnorm_forward(l->norm1,X,l->mha_out,l->norm1_out);
+    fArr2D ffn2_out = transformer_ffn(l,l->norm1_out,lyr);
+    addnorm_forward(l->norm2,l->norm1_out,ffn2_out,Y);
+}
+
 /* transformer_backward - backward pass of a decoder-only transformer layer.
  *
  * Computes gradients of the loss with respect to weights and inputs,
@@ -0,0 +1,194 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* NUMA topology detection and thread pinning */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "mem.h"
+#include "numatopo.h"
+
+#define NODE_DIR "/sys/devices/system/node"
+#define MAX_NODES 1024
+
+static NUMATOPO topo = { 0, 0, NULL, NULL, 0 };
+static pthread_mutex_t topo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Returns the cpus the process may run on, in increasing order */
+static int allowed_cpus(int** cpus)
+{
+    cpu_set_t set;
+    int n = 0;
+    if (sched_getaffinity(0,sizeof(set),&set) == 0) {
+        *cpus = allocmem(1,CPU_COUNT(&set) + 1,int);
+        for (int c = 0; c < CPU_SETSIZE; c++)
+            if (CPU_ISSET(c,&set))
+                (*cpus)[n++] = c;
+    }
+    if (n == 0) { /* Affinity not supported; assume cpu 0 */
+        freemem(*cpus);
+        *cpus = allocmem(1,1,int);
+        n = 1;
+    }
+    return n;
+}
+
+/* Reads the node of each cpu from the node's cpu list, such as "0-3,8-11" */
+static int read_cpu_nodes(int* cpu_node, int size)
+{
+    int num_nodes = 0;
+    for (int nd = 0; nd < MAX_NODES; nd++) {
+        char filename[64];
+        snprintf(filename,sizeof(filename),NODE_DIR "/node%d/cpulist",nd);
+        FILE* f = fopen(filename,"r");
+        if (f == NULL)
+            continue;
+        num_nodes = nd + 1;
+        int lo, hi;
+        while (fscanf(f,"%d",&lo) == 1) {
+            hi = lo;
+            int c = fgetc(f);
+            if (c == '-') {
+                if (fscanf(f,"%d",&hi) != 1)
+                    break;
+                c = fgetc(f);
+            }
+            for (int cpu = lo; cpu <= hi && cpu < size; cpu++)
+                cpu_node[cpu] = nd;
+            if (c != ',')
+                break;
+        }
+        fclose(f);
+    }
+    return (num_nodes > 0) ? num_nodes : 1;
+}
+
+/* Sets the topology; called with topo_lock held */
+static void set_topology(int num_nodes, int cpus_per_node)
+{
+    freemem(topo.cpu);
+    freemem(topo.node);
+    int* cpus = NULL;
+    int n = allowed_cpus(&cpus);
+    if (num_nodes > 0 && cpus_per_node > 0) { /* Simulated */
+        topo.num_nodes = num_nodes;
+        topo.num_cpus = num_nodes * cpus_per_node;
+        topo.cpu = allocmem(1,topo.num_cpus,int);
+        topo.node = allocmem(1,topo.num_cpus,int);
+        for (int i = 0; i < topo.num_cpus; i++) {
+            topo.cpu[i] = cpus[i % n];
+            topo.node[i] = i / cpus_per_node;
+        }
+        topo.simulated = 1;
+    }
+    else {
+        int size = cpus[n - 1] + 1;
+        int* cpu_node = allocmem(1,size,int);
+        topo.num_nodes = read_cpu_nodes(cpu_node,size);
+        topo.num_cpus = n;
+        topo.cpu = allocmem(1,n,int);
+        topo.node = allocmem(1,n,int);
+        int k = 0;
+        for (int nd = 0; nd < topo.num_nodes; nd++) /* Order by node */
+            for (int i = 0; i < n; i++)
+                if (cpu_node[cpus[i]] == nd) {
+                    topo.cpu[k] = cpus[i];
+                    topo.node[k] = nd;
+                    k++;
+                }
+        topo.simulated = 0;
+        freemem(cpu_node);
+    }
+    freemem(cpus);
+}
+
+/* Returns the topology. It is detected on first use, from the process's
+ * cpu affinity and /sys/devices/system/node, unless the environment
+ * variable MLINC_NUMA specifies a simulated topology as NxC, N nodes of C
+ * cpus each.
+ */
+const NUMATOPO* numatopo_get(void)
+{
+    pthread_mutex_lock(&topo_lock);
+    if (topo.num_cpus == 0) {
+        int num_nodes = 0, cpus_per_node = 0;
+        const char* env = getenv("MLINC_NUMA");
+        if (env != NULL &&
+            sscanf(env,"%dx%d",&num_nodes,&cpus_per_node) != 2) {
+            fflush(stdout);
+            fprintf(stderr,"numatopo_get: invalid MLINC_NUMA '%s'\n",env);
+            num_nodes = 0;
+        }
+        set_topology(num_nodes,cpus_per_node);
+    }
+    pthread_mutex_unlock(&topo_lock);
+    return &topo;
+}
+
+/* Replaces the topology by a simulated one, of num_nodes nodes with
+ * cpus_per_node cpus each. If num_nodes is 0, the topology is detected
+ * again. Schedulers created before the call keep their placement.
+ */
+void numatopo_simulate(int num_nodes, int cpus_per_node)
+{
+    pthread_mutex_lock(&topo_lock);
+    set_topology(num_nodes,cpus_per_node);
+    pthread_mutex_unlock(&topo_lock);
+}
+
+/* Pins the calling thread to the cpu of a slot (modulo num_cpus).
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ */
+int numatopo_pin(int slot)
+{
+    const NUMATOPO* t = numatopo_get();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(t->cpu[slot % t->num_cpus],&set);
+    return pthread_setaffinity_np(pthread_self(),sizeof(set),&set) == 0;
+}
+
+/* Returns the node of the memory page that contains address p, or -1 if
+ * it is not known (the page was not touched yet, or the system does not
+ * support NUMA). This is the real node, even if the topology is simulated.
+ */
+int numatopo_page_node(const void* p)
+{
+#ifdef SYS_move_pages
+    long page_size = sysconf(_SC_PAGESIZE);
+    void* page = (void*) ((unsigned long) p & ~(page_size - 1));
+    int status = -1;
+    /* Without target nodes, move_pages() only reports the pages' nodes */
+    if (syscall(SYS_move_pages,0,1L,&page,NULL,&status,0) == 0 && status >= 0)
+        return status;
+#else
+    (void) p;
+#endif
+    return -1;
+}
+
+/* Prints the topology to f */
+void numatopo_print(FILE* f)
+{
+    const NUMATOPO* t = numatopo_get();
+    fprintf(f,"Topology: %d node%s, %d cpu%s%s\n",
+            t->num_nodes,(t->num_nodes == 1) ? "" : "s",
+            t->num_cpus,(t->num_cpus == 1) ? "" : "s",
+            (t->simulated) ? " (simulated)" : "");
+    for (int nd = 0; nd < t->num_nodes; nd++) {
+        fprintf(f,"  node %d: cpus",nd);
+        for (int i = 0; i < t->num_cpus; i++)
+            if (t->node[i] == nd) {
+                if (t->simulated) /* Slot and the cpu it is mapped to */
+                    fprintf(f," %d(%d)",i,t->cpu[i]);
+                else
+                    fprintf(f," %d",t->cpu[i]);
+            }
+        fprintf(f,"\n");
+    }
+}
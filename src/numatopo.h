@@ -0,0 +1,53 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* NUMA topology detection and thread pinning */
+#ifndef NUMATOPO_H
+#define NUMATOPO_H
+#include <stdio.h>
+
+/* The topology lists the processors (cpus) the process may run on, ordered
+ * by NUMA node, so that consecutive cpu slots share a node. Threads are
+ * pinned to slots; memory a thread touches first is then placed on the
+ * node of its slot by the operating system (first touch policy).
+ *
+ * A topology can be simulated, to test NUMA placement on a single node
+ * machine: the simulated slots are assigned to nodes as specified, and are
+ * mapped onto the available cpus round robin.
+ */
+typedef struct numatopo_s {
+    int num_nodes;          /* Number of nodes                          */
+    int num_cpus;           /* Number of cpu slots                      */
+    int* cpu;               /* [num_cpus] Operating system cpu number   */
+    int* node;              /* [num_cpus] Node of each slot             */
+    int simulated;          /* 1 if the topology is simulated           */
+} NUMATOPO;
+
+/* Returns the topology. It is detected on first use, from the process's
+ * cpu affinity and /sys/devices/system/node, unless the environment
+ * variable MLINC_NUMA specifies a simulated topology as NxC, N nodes of C
+ * cpus each.
+ */
+const NUMATOPO* numatopo_get(void);
+
+/* Replaces the topology by a simulated one, of num_nodes nodes with
+ * cpus_per_node cpus each. If num_nodes is 0, the topology is detected
+ * again. Schedulers created before the call keep their placement.
+ */
+void numatopo_simulate(int num_nodes, int cpus_per_node);
+
+/* Pins the calling thread to the cpu of a slot (modulo num_cpus).
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ */
+int numatopo_pin(int slot);
+
+/* Returns the node of the memory page that contains address p, or -1 if
+ * it is not known (the page was not touched yet, or the system does not
+ * support NUMA). This is the real node, even if the topology is simulated.
+ */
+int numatopo_page_node(const void* p);
+
+/* Prints the topology to f */
+void numatopo_print(FILE* f);
+
+#endif
@@ -4,6 +4,8 @@
  * 1. A General Method Applicable to the Search for Similarities in the 
  *    Amino Acid Sequence of Two Proteins J. Mol. Bwl. (1970) 48, 443-453 
  * 2. https://en.wikipedia.org/wiki/Needleman%E2%80%93Wunsch_algorithm
+ * 3. A Linear Space Algorithm for Computing Maximal Common Subsequences,
+ *    D. S. Hirschberg, Communications of the ACM (1975) 18, 341-343
  */
 #include <string.h>
 #include "mem.h"
@@ -43,11 +45,16 @@ static inline void reverse(int* s, int len)
  * Note:
  *   If the aligned sequences are shorter than rlen, they are terminated
  *   with a 'blank'.
+ *   Sequences with more than ALIGNSEQ_MAX_CELLS scoring cells are aligned
+ *   by alignseq_linear(), which gives the same results.
  */ 
 int alignseq(const int* p, int plen, 
              const int* t, int tlen,
              int* rp, int* rt, int rlen, int blank)
 {
+    if ((long) (plen + 1) * (tlen + 1) > ALIGNSEQ_MAX_CELLS)
+        return alignseq_linear(p,plen,t,tlen,rp,rt,rlen,blank);
+
     int useheap = ((plen + 1) * (tlen + 1) > 10000) ? 1 : 0;
 
     /* F is the scoring matrix */
@@ -63,8 +70,8 @@ int alignseq(const int* p, int plen,
         F[0][j] = -j;
 
     /* D is the traceback direction matrix */
-    typedef int (*cArrPT)[tlen + 1];
-    int D_[useheap ? 1 : plen + 1][useheap ? 1 : tlen + 1];
+    typedef char (*cArrPT)[tlen + 1];
+    char D_[useheap ? 1 : plen + 1][useheap ? 1 : tlen + 1];
     cArrPT D = (cArrPT) (useheap ? allocmem(plen + 1,tlen + 1,char) : D_);
 
     /* Initialize the traceback matrix */
@@ -140,3 +147,241 @@ int alignseq(const int* p, int plen,
     }
     return dist;
 }
+
+/* Largest sub matrix alignseq_linear() aligns with a traceback table */
+#define ALIGNSEQ_BASE_CELLS 4096
+
+typedef struct alignctx_s {
+  const int* p;    /* First sequence                                      */
+  const int* t;    /* Second sequence                                     */
+  int* rp;         /* Aligned first sequence, reversed (output)           */
+  int* rt;         /* Aligned second sequence, reversed (output)          */
+  int rlen;        /* Size of rp, rt                                      */
+  int blank;       /* Gap value                                           */
+  int rinx;        /* Number of entries in rp, rt                         */
+  int dist;        /* Edit distance                                       */
+  int done;        /* Traceback ended                                     */
+  int* top;        /* Scores of the top row of a sub matrix, by column    */
+  int* left;       /* Scores of the left column of a sub matrix, by row   */
+  int* f[2];       /* Scores of the previous and current rows             */
+  int* o[2];       /* Middle row columns where the previous and current   */
+                   /* rows' traceback paths reach it                      */
+  int* fmid;       /* Scores of the middle row                            */
+  int* bf;         /* Scoring sub matrix                                  */
+  char* bd;        /* Traceback direction sub matrix                      */
+} ALIGNCTX;
+
+/* Scores a cell from the scores of the cells to its upper left (diag),
+ * above it (up) and to its left (left), breaking ties as alignseq() does.
+ * Stores the score in f, and returns the traceback direction.
+ */
+static inline int score(int diag, int up, int left, int same, int* f)
+{
+    int match = diag + ((same) ? 1 : -1); /* (mis)match */
+    int pgap = up - 1;   /* Insert gap in p */
+    int tgap = left - 1; /* Insert gap in t */
+    if (match >= pgap && match >= tgap) {
+        *f = match;
+        return 'D';
+    }
+    if (pgap > match && pgap >= tgap) {
+        *f = pgap;
+        return 'U';
+    }
+    *f = tgap;
+    return 'L';
+}
+
+/* Adds the traceback step s from cell (i,j) to the aligned sequences.
+ * Like alignseq(), stops at the top row or left column of the matrix,
+ * or when the output buffers are full.
+ */
+static inline void emit(ALIGNCTX* c, int s, int i, int j)
+{
+    if (c->done)
+        return;
+    if (i == 0 || j == 0) {
+        c->done = 1;
+        return;
+    }
+    if (c->rinx >= c->rlen) { /* output buffers too small */
+        c->dist = -1;
+        c->done = 1;
+        return;
+    }
+    int r = c->rinx++;
+    if (s == 'D') {
+        c->rp[r] = c->p[i - 1];
+        c->rt[r] = c->t[j - 1];
+        if (c->rp[r] != c->rt[r])
+            c->dist++; /* Mismatch is a substitution */
+    }
+    else
+    if (s == 'U') {
+        c->rp[r] = c->p[i - 1];
+        c->rt[r] = c->blank;
+        c->dist++; /* Gap in t (extra token in p)    */
+    }
+    else { /* (s == 'L') */
+        c->rp[r] = c->blank;
+        c->rt[r] = c->t[j - 1];
+        c->dist++; /* Gap in p (missing token in p)  */
+    }
+}
+
+/* Traces back the path from cell (r1,c1) to cell (r0,c0) of a small sub
+ * matrix, whose top row and left column scores are in c->top, c->left.
+ */
+static void align_table(ALIGNCTX* c, int r0, int c0, int r1, int c1)
+{
+    const int h = r1 - r0;
+    const int w = c1 - c0;
+    typedef int (*iArrHW)[w + 1];
+    typedef char (*cArrHW)[w + 1];
+    iArrHW F = (iArrHW) c->bf;
+    cArrHW D = (cArrHW) c->bd;
+    memcpy(F[0],c->top + c0,(w + 1) * sizeof(int));
+    for (int i = 1; i <= h; i++) {
+        F[i][0] = c->left[r0 + i];
+        int pi = c->p[r0 + i - 1];
+        for (int j = 1; j <= w; j++)
+            D[i][j] = score(F[i - 1][j - 1],F[i - 1][j],F[i][j - 1],
+                            pi == c->t[c0 + j - 1],&F[i][j]);
+    }
+    int i = h, j = w;
+    while (i > 0 && j > 0) {
+        int s = D[i][j];
+        emit(c,s,r0 + i,c0 + j);
+        if (s != 'L')
+            i--;
+        if (s != 'U')
+            j--;
+    }
+    /* The path goes through (r0,c0), so it continues along the edge */
+    for (; i > 0; i--)
+        emit(c,'U',r0 + i,c0);
+    for (; j > 0; j--)
+        emit(c,'L',r0,c0 + j);
+}
+
+/* Traces back the path from cell (r1,c1) to cell (r0,c0) of the scoring
+ * matrix, whose top row and left column scores are in c->top, c->left.
+ *
+ * Scores the sub matrix row by row, tracking for each cell below the middle
+ * row the column where its traceback path reaches the middle row. The path
+ * from (r1,c1) reaches it at (mid,ca). Then traces back the path from
+ * (r1,c1) to (mid,ca), and from (mid,ca) to (r0,c0).
+ *
+ * The lower part needs the scores of row mid, and of column ca below it,
+ * which are written to c->top and c->left over scores that the upper part
+ * does not need, except the ones at (r0,ca) and (mid,c0), which are
+ * restored.
+ */
+static void align_linear(ALIGNCTX* c, int r0, int c0, int r1, int c1)
+{
+    if (c->done)
+        return;
+    const int h = r1 - r0;
+    const int w = c1 - c0;
+    if (h < 2 || w == 0 || (long) (h + 1) * (w + 1) <= ALIGNSEQ_BASE_CELLS) {
+        align_table(c,r0,c0,r1,c1);
+        return;
+    }
+    const int mid = r0 + h / 2;
+    int *f0 = c->f[0], *f1 = c->f[1], *o0 = c->o[0], *o1 = c->o[1], *tmp;
+    memcpy(f0,c->top + c0,(w + 1) * sizeof(int));
+    for (int i = r0 + 1; i <= r1; i++) {
+        f1[0] = c->left[i];
+        o1[0] = c0; /* The left column goes up to (mid,c0) */
+        int pi = c->p[i - 1];
+        for (int j = 1; j <= w; j++) {
+            int s = score(f0[j - 1],f0[j],f1[j - 1],pi == c->t[c0 + j - 1],&f1[j]);
+            if (i > mid)
+                o1[j] = (s == 'D') ? o0[j - 1] : (s == 'U') ? o0[j] : o1[j - 1];
+        }
+        if (i == mid) {
+            memcpy(c->fmid,f1,(w + 1) * sizeof(int));
+            for (int j = 0; j <= w; j++)
+                o1[j] = c0 + j;
+        }
+        tmp = f0; f0 = f1; f1 = tmp;
+        tmp = o0; o0 = o1; o1 = tmp;
+    }
+    const int ca = o0[w];
+    const int wa = ca - c0;
+
+    /* Scores of column ca below the middle row */
+    memcpy(f0,c->fmid,(wa + 1) * sizeof(int));
+    for (int i = mid + 1; i <= r1; i++) {
+        f1[0] = c->left[i];
+        int pi = c->p[i - 1];
+        for (int j = 1; j <= wa; j++)
+            score(f0[j - 1],f0[j],f1[j - 1],pi == c->t[c0 + j - 1],&f1[j]);
+        c->left[i] = f1[wa];
+        tmp = f0; f0 = f1; f1 = tmp;
+    }
+    int top_ca = c->top[ca];
+    int left_mid = c->left[mid];
+    memcpy(c->top + ca,c->fmid + wa,(w - wa + 1) * sizeof(int));
+    c->left[mid] = c->fmid[wa];
+    align_linear(c,mid,ca,r1,c1);
+    c->top[ca] = top_ca;
+    c->left[mid] = left_mid;
+    align_linear(c,r0,c0,mid,ca);
+}
+
+/* Aligns two sequences like alignseq(), using memory proportional to
+ * plen + tlen rather than to plen * tlen.
+ *
+ * The scoring matrix is divided and conquered, as in Hirschberg's
+ * algorithm: a forward pass finds where the traceback path crosses the
+ * middle row, then the two parts of the path are aligned recursively.
+ * Ties are broken as alignseq() breaks them, so the aligned sequences
+ * and the edit distance are identical; it takes about three times as long.
+ *
+ * Parameters and return value are those of alignseq().
+ */
+int alignseq_linear(const int* p, int plen,
+                    const int* t, int tlen,
+                    int* rp, int* rt, int rlen, int blank)
+{
+    long cells = ALIGNSEQ_BASE_CELLS;
+    if (cells < 2L * (tlen + 1))
+        cells = 2L * (tlen + 1);
+    if (cells < plen + 1)
+        cells = plen + 1;
+    ALIGNCTX c = {
+        .p = p, .t = t, .rp = rp, .rt = rt, .rlen = rlen, .blank = blank,
+        .top = allocmem(1,tlen + 1,int),
+        .left = allocmem(1,plen + 1,int),
+        .f = { allocmem(1,tlen + 1,int), allocmem(1,tlen + 1,int) },
+        .o = { allocmem(1,tlen + 1,int), allocmem(1,tlen + 1,int) },
+        .fmid = allocmem(1,tlen + 1,int),
+        .bf = allocmem(1,cells,int),
+        .bd = allocmem(1,cells,char)
+    };
+    for (int j = 0; j <= tlen; j++)
+        c.top[j] = -j;
+    for (int i = 0; i <= plen; i++)
+        c.left[i] = -i;
+
+    align_linear(&c,0,0,plen,tlen);
+
+    /* Because of traceing back, sequences are reversed; fix that */
+    reverse(rp,c.rinx);
+    reverse(rt,c.rinx);
+    if (c.rinx < rlen) { /* Terminate sequences if shorter than rlen */
+        rp[c.rinx] = blank;
+        rt[c.rinx] = blank;
+    }
+    freemem(c.top);
+    freemem(c.left);
+    freemem(c.f[0]);
+    freemem(c.f[1]);
+    freemem(c.o[0]);
+    freemem(c.o[1]);
+    freemem(c.fmid);
+    freemem(c.bf);
+    freemem(c.bd);
+    return c.dist;
+}
@@ -3,6 +3,13 @@
 #ifndef ALIGNSEQ_H
 #define ALIGNSEQ_H
 
+/* Number of (plen + 1) * (tlen + 1) scoring cells above which alignseq()
+ * aligns in linear space, using alignseq_linear()
+ */
+#ifndef ALIGNSEQ_MAX_CELLS
+#define ALIGNSEQ_MAX_CELLS (1L << 22)
+#endif
+
 /* Aligns two sequences to have equal length and smallest edit distance.
  *
  * This function uses the Needleman Wunsch algorithm to find the optimal
@@ -22,14 +29,32 @@
  *   blank - The value to be used to fill gaps in the aligned sequences
  *
  * Returns:
- *   The edit distance between the aligned sequences.
+ *   The edit distance between the aligned sequences. Returns -1 if
+ *   size of rp, rt buffers, as indicated by rlen, is too small.
  *
  * Note:
  *   If the aligned sequences are shorter than rlen, they are terminated
  *   with a 'blank'.
+ *   Sequences with more than ALIGNSEQ_MAX_CELLS scoring cells are aligned
+ *   by alignseq_linear(), which gives the same results.
  */ 
 int alignseq(const int* p, int plen, 
              const int* t, int tlen,
              int* rp, int* rt, int rlen, int blank);
 
+/* Aligns two sequences like alignseq(), using memory proportional to
+ * plen + tlen rather than to plen * tlen.
+ *
+ * The scoring matrix is divided and conquered, as in Hirschberg's
+ * algorithm: a forward pass finds where the traceback path crosses the
+ * middle row, then the two parts of the path are aligned recursively.
+ * Ties are broken as alignseq() breaks them, so the aligned sequences
+ * and the edit distance are identical; it takes about three times as long.
+ *
+ * Parameters and return value are those of alignseq().
+ */
+int alignseq_linear(const int* p, int plen,
+                    const int* t, int tlen,
+                    int* rp, int* rt, int rlen, int blank);
+
 #endif
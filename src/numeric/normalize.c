@@ -1,9 +1,164 @@
 /* Copyright (c) 2023-2024 Gilad Odinak */
 /* Data normalization functions    */
+#include <string.h>
+#include <math.h>
+#include "mem.h"
 #include "float.h"
 #include "array.h"
+#include "tasksched.h"
 #include "normalize.h"
 
+/* Moments of a block of vectors: count, means and sums of squared
+ * differences from the means, [1 + 2 * Dx] doubles
+ */
+#define MOMENTS_SIZE(Dx)    (1 + 2 * (long) (Dx))
+#define MOMENTS_LEVELS      64 /* Enough for 2^64 blocks */
+
+/* Moments of the vectors added so far: the moments of up to one run of
+ * 2^k consecutive blocks at each level k, earlier runs at higher levels
+ */
+struct moments_s {
+    int Dx;                         /* Number of columns                */
+    double* level;                  /* [MOMENTS_LEVELS][MOMENTS_SIZE]   */
+};
+
+/* Creates moments of an empty set of vectors of Dx columns */
+MOMENTS* moments_create(int Dx)
+{
+    MOMENTS* s = allocmem(1,1,MOMENTS);
+    s->Dx = Dx;
+    s->level = allocmem(MOMENTS_LEVELS,MOMENTS_SIZE(Dx),double);
+    return s;
+}
+
+/* Frees moments created by moments_create() */
+void moments_free(MOMENTS* s)
+{
+    if (s == NULL)
+        return;
+    freemem(s->level);
+    freemem(s);
+}
+
+/* Replaces the moments b with the moments of the union of the vectors of
+ * a and b (Chan, Golub, LeVeque, 1979)
+ */
+static void moments_merge(const double* a, double* b, int Dx)
+{
+    double na = a[0];
+    double nb = b[0];
+    double n = na + nb;
+    if (na == 0)
+        return;
+    b[0] = n;
+    for (int j = 0; j < Dx; j++) {
+        double delta = b[1 + j] - a[1 + j];
+        b[1 + j] = a[1 + j] + delta * nb / n;
+        b[1 + Dx + j] += a[1 + Dx + j] + delta * delta * na * nb / n;
+    }
+}
+
+typedef struct {
+    const float* x;
+    long M;
+    int D;
+    int Dx;
+    double* blk;    /* [num blocks][MOMENTS_SIZE] */
+} BLOCKS;
+
+/* Calculates the moments of blocks lo to hi - 1, by Welford's algorithm */
+static void block_moments(void* arg, int lo, int hi)
+{
+    BLOCKS* a = (BLOCKS*) arg;
+    const int D = a->D;
+    const int Dx = a->Dx;
+    for (int b = lo; b < hi; b++) {
+        double* p = a->blk + b * MOMENTS_SIZE(Dx);
+        double* mean = p + 1;
+        double* m2 = p + 1 + Dx;
+        long first = (long) b * MOMENTS_BLOCK;
+        long last = (first + MOMENTS_BLOCK < a->M) 
+                  ? first + MOMENTS_BLOCK : a->M;
+        for (long i = first; i < last; i++) {
+            const float* x = a->x + i * D;
+            double inv = 1.0 / (i - first + 1);
+            for (int j = 0; j < Dx; j++) {
+                double delta = x[j] - mean[j];
+                mean[j] += delta * inv;
+                m2[j] += delta * (x[j] - mean[j]);
+            }
+        }
+        p[0] = last - first;
+    }
+}
+
+/* Adds vectors to moments.
+ *
+ * Parameters:
+ *   s - Moments, from moments_create()
+ *   x - Array of M vectors, each having D elements; only the first Dx
+ *       elements of each are added
+ *   M - Number of vectors in x
+ *   D - Number of elements in each vector
+ *
+ * The moments of each block of MOMENTS_BLOCK vectors are calculated in
+ * parallel by Welford's algorithm, then merged pairwise, in order, into
+ * the moments of all the vectors added so far (Chan et al.). So the
+ * results do not depend on the number of threads, nor on how the vectors
+ * are split among calls, as long as M is a multiple of MOMENTS_BLOCK in
+ * all the calls but the last.
+ */
+void moments_add(MOMENTS* s, const fArr2D x_/*[M][D]*/, long M, int D)
+{
+    const int Dx = s->Dx;
+    const long W = MOMENTS_SIZE(Dx);
+    int nb = (int) ((M + MOMENTS_BLOCK - 1) / MOMENTS_BLOCK);
+    if (nb == 0)
+        return;
+    BLOCKS a = { (const float*) x_, M, D, Dx, allocmem(nb,W,double) };
+    if (nb > 1)
+        parallel_for(NULL,0,nb,1,block_moments,&a);
+    else
+        block_moments(&a,0,1);
+    /* Like adding one to a binary counter: a run of blocks merges with
+     * the earlier run of the same size, and carries to the next level
+     */
+    for (int b = 0; b < nb; b++) {
+        double* p = a.blk + b * W;
+        int k = 0;
+        for (; s->level[k * W] != 0; k++) {
+            moments_merge(s->level + k * W,p,Dx);
+            s->level[k * W] = 0;
+        }
+        memcpy(s->level + k * W,p,W * sizeof(double));
+    }
+    freemem(a.blk);
+}
+
+/* Returns the mean and the standard deviation of each of the Dx columns
+ * of the vectors added to moments s.
+ */
+void moments_mean_sdev(const MOMENTS* s, fVec mean/*[Dx]*/,
+                       fVec sdev/*[Dx]*/)
+{
+    const int Dx = s->Dx;
+    const long W = MOMENTS_SIZE(Dx);
+    double* p = allocmem(2,W,double); /* All runs, then the next run */
+    double* q = p + W;
+    for (int k = MOMENTS_LEVELS - 1; k >= 0; k--) { /* Earlier runs first */
+        if (s->level[k * W] == 0)
+            continue;
+        memcpy(q,s->level + k * W,W * sizeof(double));
+        moments_merge(p,q,Dx);
+        memcpy(p,q,W * sizeof(double));
+    }
+    for (int j = 0; j < Dx; j++) {
+        mean[j] = (p[0] > 0) ? p[1 + j] : 0;
+        sdev[j] = (p[0] > 0) ? sqrt(p[1 + Dx + j] / p[0]) : 0;
+    }
+    freemem(p);
+}
+
 /* Calculates the mean and standard deviation of an array of feature vectors 
  * by feature (i.e., by column) and returns these values in mean and sdev 
  * vectors respectively.
@@ -24,6 +179,9 @@
  * feature vectors in the dataset passed in x[][], and returns those mean and 
  * standard deviation arrays. The calculation excludes the last column in x[][]
  * (the bias) if exc_last is not zero.
+ *
+ * The dataset is read once: the moments of blocks of MOMENTS_BLOCK vectors
+ * are calculated in parallel (see moments_add()), and merged.
  */
 void calculate_mean_sdev(const fArr2D x_/*[M][D]*/, 
                          int M, int D, 
@@ -31,30 +189,11 @@ void calculate_mean_sdev(const fArr2D x_/*[M][D]*/,
                          fVec sdev/*[D | D-1]*/, 
                          int exc_last)
 {
-    typedef float (*ArrMD)[D];
-    ArrMD x = (ArrMD) x_;
     int Dx = D - ((exc_last) ? 1 : 0);
-    typedef float (*VecDx);
-    VecDx sum = (VecDx) mean; /* Calculate sum, convert to mean in place */
-    VecDx var = (VecDx) sdev; /* Calculate var, convert to sdev in place */
-
-    fltclr(sum,Dx);
-    fltclr(var,Dx);
-    for (int i = 0; i < M; i++) {
-        for (int j = 0; j < Dx; j++)
-            sum[j] += x[i][j];
-    }
-    for (int j = 0; j < Dx; j++)
-        sum/*mean*/[j] = sum[j] / M;
-
-    for (int i = 0; i < M; i++) {
-        for (int j = 0; j < Dx; j++) {
-            float val = x[i][j] - mean[j];
-            var[j] += val * val;
-        }
-    }
-    for (int j = 0; j < Dx; j++)
-        var/*sdev*/[j] = sqrt(var[j] / M);
+    MOMENTS* s = moments_create(Dx);
+    moments_add(s,x_,M,D);
+    moments_mean_sdev(s,mean,sdev);
+    moments_free(s);
 }
 
 /* Normalizes an array of feature vectors by feature (column-wise) in place, by
@@ -3,6 +3,47 @@
 #ifndef NORMALIZE_H
 #define NORMALIZE_H
 #include "array.h"
+
+/* Number of vectors of the blocks whose moments are calculated in parallel */
+#define MOMENTS_BLOCK 1024
+
+/* Moments (count, mean and sum of squared differences from the mean) of
+ * the columns of a set of vectors, accumulated one block of vectors at a
+ * time. Used to calculate the mean and standard deviation of a dataset
+ * in one pass, see calculate_mean_sdev().
+ */
+typedef struct moments_s MOMENTS;
+
+/* Creates moments of an empty set of vectors of Dx columns */
+MOMENTS* moments_create(int Dx);
+
+/* Adds vectors to moments.
+ *
+ * Parameters:
+ *   s - Moments, from moments_create()
+ *   x - Array of M vectors, each having D elements; only the first Dx
+ *       elements of each are added
+ *   M - Number of vectors in x
+ *   D - Number of elements in each vector
+ *
+ * The moments of each block of MOMENTS_BLOCK vectors are calculated in
+ * parallel by Welford's algorithm, then merged pairwise, in order, into
+ * the moments of all the vectors added so far (Chan et al.). So the
+ * results do not depend on the number of threads, nor on how the vectors
+ * are split among calls, as long as M is a multiple of MOMENTS_BLOCK in
+ * all the calls but the last.
+ */
+void moments_add(MOMENTS* s, const fArr2D x_/*[M][D]*/, long M, int D);
+
+/* Returns the mean and the standard deviation of each of the Dx columns
+ * of the vectors added to moments s.
+ */
+void moments_mean_sdev(const MOMENTS* s, fVec mean/*[Dx]*/,
+                       fVec sdev/*[Dx]*/);
+
+/* Frees moments created by moments_create() */
+void moments_free(MOMENTS* s);
+
 /* Calculates the mean and standard deviation of an array of feature vectors 
  * by feature (i.e., by column) and returns these values in mean and sdev 
  * vectors respectively.
@@ -23,6 +64,9 @@
  * feature vectors in the dataset passed in x[][], and returns those mean and 
  * standard deviation arrays. The calculation excludes the last column in x[][]
  * (the bias) if exc_last is not zero.
+ *
+ * The dataset is read once: the moments of blocks of MOMENTS_BLOCK vectors
+ * are calculated in parallel (see moments_add()), and merged.
  */
 void calculate_mean_sdev(const fArr2D x_/*[M][D]*/, 
                          int M, int D, 
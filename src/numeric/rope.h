@@ -4,6 +4,7 @@
 #define ROPE_H
 #include <math.h>
 #include "array.h"
+#include "shapes.h"
 
 /* Precomputes the RoPE theta table for a given head dimension.
  *
@@ -21,6 +22,30 @@ static inline void rope_init(float* theta, int Dh)
         theta[i] = powf(10000.0f, -2.0f * i / (float) Dh);
 }
 
+/* rope_apply() of head dimension Dh, which may be a constant */
+SHAPE_INLINE void rope_kernel(fArr2D x_/*[T][Dh]*/,
+                              const float* theta,
+                              int inverse,
+                              int offset,
+                              int T, int Dh)
+{
+    typedef float (*ArrTDh)[Dh];
+    ArrTDh x = (ArrTDh) x_;
+    float sign = inverse ? -1.0f : 1.0f;
+    
+    for (int t = 0; t < T; t++) {
+        for (int i = 0; i < Dh / 2; i++) {
+            float angle = (offset + t) * theta[i];
+            float cos_a = cosf(angle);
+            float sin_a = sign * sinf(angle);
+            float x0 = x[t][2 * i];
+            float x1 = x[t][2 * i + 1];
+            x[t][2 * i]     = x0 * cos_a - x1 * sin_a;
+            x[t][2 * i + 1] = x0 * sin_a + x1 * cos_a;
+        }
+    }
+}
+
 /* Applies RoPE in-place to a single head slice of Q or K.
  *
  * Each token at position offset+t is rotated by angle
@@ -35,6 +60,8 @@ static inline void rope_init(float* theta, int Dh)
  *   T       : Sequence length (number of rows)
  *   Dh      : Head dimension (number of columns, must be even)
  *
+ * Head dimensions listed in HEAD_DIM_SHAPES (see shapes.h) run a variant
+ * compiled for that dimension.
  */
 static inline void rope_apply(fArr2D x_/*[T][Dh]*/,
                               const float* theta,
@@ -42,21 +69,8 @@ static inline void rope_apply(fArr2D x_/*[T][Dh]*/,
                               int offset,
                               int T, int Dh)
 {
-    typedef float (*ArrTDh)[Dh];
-    ArrTDh x = (ArrTDh) x_;
-    float sign = inverse ? -1.0f : 1.0f;
-    
-    for (int t = 0; t < T; t++) {
-        for (int i = 0; i < Dh / 2; i++) {
-            float angle = (offset + t) * theta[i];
-            float cos_a = cosf(angle);
-            float sin_a = sign * sinf(angle);
-            float x0 = x[t][2 * i];
-            float x1 = x[t][2 * i + 1];
-            x[t][2 * i]     = x0 * cos_a - x1 * sin_a;
-            x[t][2 * i + 1] = x0 * sin_a + x1 * cos_a;
-        }
-    }
+    SHAPE_SPECIALIZE(HEAD_DIM_SHAPES,Dh,
+                     rope_kernel(x_,theta,inverse,offset,T,Dh));
 }
 
 #endif
@@ -0,0 +1,74 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Kernel variants specialized for constant dimensions */
+#ifndef SHAPES_H
+#define SHAPES_H
+
+/* Kernels take their dimensions at run time, so the compiler cannot fully
+ * unroll their inner loops, or keep a row of a small matrix in registers.
+ * Many production models have fixed dimensions, such as the head dimension
+ * of attention, or the number of features of a feature file. For each
+ * dimension in a list of such shapes, SHAPE_SPECIALIZE() compiles a copy
+ * of a kernel call in which the dimension is a constant; at run time, the
+ * copy that matches the actual dimension runs, or the generic code if
+ * none does.
+ *
+ * The lists of shapes can be set at build time, for example
+ *   make CFLAGS+='-DHEAD_DIM_SHAPES(X,...)=X(48,__VA_ARGS__)'
+ * and -DNO_SHAPE_SPECIALIZE compiles only the generic code.
+ */
+
+/* Attention head dimension, Dh = D / H */
+#ifndef HEAD_DIM_SHAPES
+#define HEAD_DIM_SHAPES(X,...) \
+    X(32,__VA_ARGS__) X(64,__VA_ARGS__) X(128,__VA_ARGS__)
+#endif
+
+/* LSTM units */
+#ifndef LSTM_UNITS_SHAPES
+#define LSTM_UNITS_SHAPES(X,...) \
+    X(128,__VA_ARGS__) X(256,__VA_ARGS__) X(512,__VA_ARGS__)
+#endif
+
+/* Dense layer input dimension: FEAT_CNT and EXPENDED_FEAT_CNT of
+ * featfile.h, without and with bias
+ */
+#ifndef DENSE_INPUT_SHAPES
+#define DENSE_INPUT_SHAPES(X,...) \
+    X(14,__VA_ARGS__) X(15,__VA_ARGS__) X(70,__VA_ARGS__) X(71,__VA_ARGS__)
+#endif
+
+/* Runs the statement(s) given after dim with dim a constant, if its value
+ * is one of shapes, otherwise with dim a variable.
+ *
+ * Parameters:
+ *   shapes - A list of shapes, such as HEAD_DIM_SHAPES
+ *   dim    - Name of a variable (not an expression) that holds the
+ *            dimension; within the statement, it is a constant
+ *   ...    - The statement, typically a call of a kernel; kernels that are
+ *            called with a constant should be SHAPE_INLINE, so that they
+ *            are compiled for each constant
+ *
+ * Example:
+ *   SHAPE_SPECIALIZE(HEAD_DIM_SHAPES,Dh,rope_kernel(x,theta,T,Dh));
+ */
+#ifndef NO_SHAPE_SPECIALIZE
+#define SHAPE_SPECIALIZE(shapes,dim,...) \
+    do { \
+        switch (dim) { \
+            shapes(SHAPE_CASE_,dim,__VA_ARGS__) \
+            default: __VA_ARGS__; break; \
+        } \
+    } while (0)
+#define SHAPE_CASE_(n,dim,...) \
+    case n: { const int dim = n; __VA_ARGS__; } break;
+#else
+#define SHAPE_SPECIALIZE(shapes,dim,...) \
+    do { __VA_ARGS__; } while (0)
+#endif
+
+/* A kernel that is always inlined, and thus compiled for the constant
+ * dimensions of its callers
+ */
+#define SHAPE_INLINE static inline __attribute__((always_inline))
+
+#endif
@@ -0,0 +1,405 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Hardware performance counters of training and inference phases */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "mem.h"
+#include "perfctr.h"
+
+typedef struct {
+    const char* name;
+    int arg;
+    long calls;                         /* Number of times it ran         */
+    long long counts[PERF_MAX_COUNTERS];
+} PERFREGION;
+
+typedef struct {
+    const char* name;
+    int arg;
+    long long v[PERF_MAX_COUNTERS];     /* Counts when the region began   */
+} PERFSTART;
+
+/* Counters of one thread */
+typedef struct {
+    pid_t pid;                          /* Process that opened them       */
+    int leader;                         /* Group leader, -1 if none       */
+    int fd[PERF_MAX_COUNTERS];          /* -1 if not available            */
+    uint64_t id[PERF_MAX_COUNTERS];     /* Kernel's ids of the counters   */
+    int depth;                          /* Number of regions begun        */
+    PERFSTART stack[PERF_MAX_DEPTH];
+} PERFTHREAD;
+
+static const char* counter_name[PERF_MAX_COUNTERS] = {
+    "cycles", "instructions", "llc-misses", "branch-misses", "fp-ops",
+    "task-clock"
+};
+
+int perf_on = 0;
+
+static int available[PERF_MAX_COUNTERS];
+static PERFREGION regions[PERF_MAX_REGIONS];
+static int num_regions = 0;
+static pthread_mutex_t perf_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t thread_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+
+static void close_counters(PERFTHREAD* t)
+{
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++)
+        if (t->fd[i] >= 0)
+            close(t->fd[i]);
+}
+
+static void thread_exit(void* arg)
+{
+    PERFTHREAD* t = (PERFTHREAD*) arg;
+    close_counters(t);
+    freemem(t);
+}
+
+static void create_key(void)
+{
+    pthread_key_create(&thread_key,thread_exit);
+}
+
+/* Sets attr to count counter i; returns 0 if the counter is not defined */
+static int counter_attr(int i, struct perf_event_attr* attr)
+{
+    memset(attr,0,sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->type = PERF_TYPE_HARDWARE;
+    switch (i) {
+        case PERF_CYCLES:
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+        case PERF_INSTRUCTIONS:
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+        case PERF_LLC_MISSES:
+            attr->config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+        case PERF_BRANCH_MISSES:
+            attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+        case PERF_FP_OPS: {
+            const char* env = getenv("MLINC_PERF_FP");
+            if (env == NULL || env[0] == '\0')
+                return 0;
+            attr->type = PERF_TYPE_RAW;
+            attr->config = strtoull(env,NULL,16);
+        }
+        break;
+        case PERF_TASK_CLOCK:
+            attr->type = PERF_TYPE_SOFTWARE;
+            attr->config = PERF_COUNT_SW_TASK_CLOCK;
+        break;
+    }
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    attr->read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+                        PERF_FORMAT_TOTAL_TIME_ENABLED |
+                        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return 1;
+}
+
+/* Opens the counters of the calling thread, as one group, so that they
+ * are read together. Counters that fail to open are left out.
+ */
+static void open_counters(PERFTHREAD* t)
+{
+    t->pid = getpid();
+    t->leader = -1;
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++) {
+        t->fd[i] = -1;
+        struct perf_event_attr attr;
+        if (!counter_attr(i,&attr))
+            continue;
+        int group = (t->leader >= 0) ? t->fd[t->leader] : -1;
+        int fd = syscall(SYS_perf_event_open,&attr,0,-1,group,0);
+        if (fd < 0)
+            continue;
+        if (ioctl(fd,PERF_EVENT_IOC_ID,&t->id[i]) != 0) {
+            close(fd);
+            continue;
+        }
+        t->fd[i] = fd;
+        if (t->leader < 0)
+            t->leader = i;
+        available[i] = 1;
+    }
+}
+
+/* Returns the counters of the calling thread, opening them on first use,
+ * or again in a child process, since the counters that a child inherits
+ * count its parent.
+ */
+static PERFTHREAD* thread_counters(void)
+{
+    pthread_once(&key_once,create_key);
+    PERFTHREAD* t = (PERFTHREAD*) pthread_getspecific(thread_key);
+    if (t != NULL && t->pid == getpid())
+        return t;
+    if (t == NULL) {
+        t = allocmem(1,1,PERFTHREAD);
+        pthread_setspecific(thread_key,t);
+    }
+    else {
+        close_counters(t);
+        t->depth = 0;
+    }
+    pthread_mutex_lock(&perf_lock);
+    open_counters(t);
+    pthread_mutex_unlock(&perf_lock);
+    return t;
+}
+
+/* Reads the counters of thread t into v; counts of counters that did not
+ * run all the time they were enabled are scaled up. Returns 1 if
+ * successful, 0 otherwise.
+ */
+static int read_counters(PERFTHREAD* t, long long v[])
+{
+    uint64_t buf[3 + 2 * PERF_MAX_COUNTERS];
+    if (t->leader < 0)
+        return 0;
+    if (read(t->fd[t->leader],buf,sizeof(buf)) < (ssize_t) (3 * 8))
+        return 0;
+    uint64_t nr = buf[0];
+    double scale = (buf[2] > 0) ? (double) buf[1] / buf[2] : 0.0;
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++)
+        v[i] = -1;
+    for (uint64_t k = 0; k < nr && k < PERF_MAX_COUNTERS; k++) {
+        uint64_t value = buf[3 + 2 * k];
+        uint64_t id = buf[4 + 2 * k];
+        for (int i = 0; i < PERF_MAX_COUNTERS; i++)
+            if (t->fd[i] >= 0 && t->id[i] == id)
+                v[i] = (long long) (value * scale);
+    }
+    return 1;
+}
+
+static void perf_atexit(void)
+{
+    perf_on = 0;
+    perf_report(stderr);
+}
+
+/* Enables counting if the environment variable MLINC_PERF is set */
+__attribute__((constructor))
+static void perf_init(void)
+{
+    const char* env = getenv("MLINC_PERF");
+    if (env == NULL || env[0] == '\0' || !strcmp(env,"0"))
+        return;
+    if (perf_enable() == 0)
+        fprintf(stderr,"MLINC_PERF: no performance counters available\n");
+    else
+        atexit(perf_atexit);
+}
+
+/* Enables counting.
+ *
+ * Returns:
+ *   The number of counters available to the calling thread. If none is
+ *   available, counting is not enabled.
+ */
+int perf_enable(void)
+{
+    PERFTHREAD* t = thread_counters();
+    int n = 0;
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++)
+        if (t->fd[i] >= 0)
+            n++;
+    perf_on = (n > 0);
+    return n;
+}
+
+/* Disables counting; counts are kept */
+void perf_disable(void)
+{
+    perf_on = 0;
+}
+
+/* Clears the counts of all regions */
+void perf_reset(void)
+{
+    pthread_mutex_lock(&perf_lock);
+    num_regions = 0;
+    pthread_mutex_unlock(&perf_lock);
+}
+
+void perf_begin(const char* name, int arg)
+{
+    PERFTHREAD* t = thread_counters();
+    if (t->depth < PERF_MAX_DEPTH) {
+        PERFSTART* s = &t->stack[t->depth];
+        s->name = name;
+        s->arg = arg;
+        if (!read_counters(t,s->v))
+            s->name = NULL;
+    }
+    t->depth++;
+}
+
+/* Returns the index of a region in regions, adding it if it is new, or -1
+ * if the table is full. Called with perf_lock locked.
+ */
+static int find_region(const char* name, int arg)
+{
+    for (int i = 0; i < num_regions; i++)
+        if (regions[i].arg == arg && (regions[i].name == name ||
+                                      !strcmp(regions[i].name,name)))
+            return i;
+    if (num_regions == PERF_MAX_REGIONS)
+        return -1;
+    PERFREGION* r = &regions[num_regions];
+    memset(r,0,sizeof(*r));
+    r->name = name;
+    r->arg = arg;
+    return num_regions++;
+}
+
+void perf_end(void)
+{
+    PERFTHREAD* t = thread_counters();
+    if (t->depth == 0) /* Begun before counting was enabled */
+        return;
+    t->depth--;
+    if (t->depth >= PERF_MAX_DEPTH)
+        return;
+    long long v[PERF_MAX_COUNTERS];
+    PERFSTART* s = &t->stack[t->depth];
+    if (s->name == NULL || !read_counters(t,v))
+        return;
+    pthread_mutex_lock(&perf_lock);
+    int k = find_region(s->name,s->arg);
+    if (k >= 0) {
+        PERFREGION* r = &regions[k];
+        r->calls++;
+        for (int i = 0; i < PERF_MAX_COUNTERS; i++)
+            if (v[i] >= 0 && s->v[i] >= 0)
+                r->counts[i] += v[i] - s->v[i];
+    }
+    pthread_mutex_unlock(&perf_lock);
+}
+
+/* Returns the name of counter i, 0 to PERF_MAX_COUNTERS-1 */
+const char* perf_counter_name(int i)
+{
+    return (i >= 0 && i < PERF_MAX_COUNTERS) ? counter_name[i] : NULL;
+}
+
+/* Returns 1 if counter i was opened by any thread, 0 otherwise */
+int perf_counter_available(int i)
+{
+    return (i >= 0 && i < PERF_MAX_COUNTERS) ? available[i] : 0;
+}
+
+/* Gets the counts of a region.
+ *
+ * Parameters:
+ *   name   - Name of the region
+ *   arg    - Index of the region
+ *   counts - Returns the counts of the PERF_MAX_COUNTERS counters, summed
+ *            over all the times the region ran; -1 for counters that are
+ *            not available
+ *
+ * Returns:
+ *   The number of times the region ran, 0 if it did not run.
+ *
+ * Notes:
+ *   Counts are scaled up when the kernel counted only part of the time,
+ *   because more counters were open than the cpu provides.
+ */
+long perf_counts(const char* name, int arg, long long counts[])
+{
+    long calls = 0;
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++)
+        counts[i] = (available[i]) ? 0 : -1;
+    pthread_mutex_lock(&perf_lock);
+    for (int k = 0; k < num_regions; k++) {
+        const PERFREGION* r = &regions[k];
+        if (r->arg == arg && !strcmp(r->name,name)) {
+            calls = r->calls;
+            for (int i = 0; i < PERF_MAX_COUNTERS; i++)
+                if (available[i])
+                    counts[i] = r->counts[i];
+        }
+    }
+    pthread_mutex_unlock(&perf_lock);
+    return calls;
+}
+
+/* Returns a / b, or 0 if b is 0 */
+static inline double ratio(long long a, long long b)
+{
+    return (b > 0) ? (double) a / b : 0.0;
+}
+
+/* Prints the counts, and derived measures (instructions per cycle, cache
+ * and branch misses per thousand instructions), of each region to f.
+ * Counts of nested regions are included in the counts of the regions
+ * that contain them.
+ */
+void perf_report(FILE* f)
+{
+    /* Columns, and their units */
+    static const int order[PERF_MAX_COUNTERS] = {
+        PERF_TASK_CLOCK, PERF_CYCLES, PERF_INSTRUCTIONS,
+        PERF_LLC_MISSES, PERF_BRANCH_MISSES, PERF_FP_OPS
+    };
+    static const double unit[PERF_MAX_COUNTERS] = { 
+        1e6, 1e6, 1e3, 1e3, 1e6, 1e6 
+    };
+    int missing = 0;
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++)
+        if (!available[i])
+            fprintf(f,"%s %s",(missing++ == 0) ? 
+                    "Performance counters not available:" : "",
+                    counter_name[i]);
+    if (missing)
+        fprintf(f,"\n");
+    fprintf(f,"%-24s %8s %10s %10s %10s %10s %10s %10s %6s %8s %8s\n",
+            "region","calls","time(ms)","cycles(M)","instr(M)",
+            "llc-mis(K)","br-mis(K)","fp-ops(M)","ipc","llc/Ki","br/Ki");
+    pthread_mutex_lock(&perf_lock);
+    for (int k = 0; k < num_regions; k++) {
+        const PERFREGION* r = &regions[k];
+        const long long* c = r->counts;
+        char name[64];
+        if (r->arg >= 0)
+            snprintf(name,sizeof(name),"%s %d",r->name,r->arg);
+        else
+            snprintf(name,sizeof(name),"%s",r->name);
+        fprintf(f,"%-24s %8ld",name,r->calls);
+        for (int j = 0; j < PERF_MAX_COUNTERS; j++) {
+            int i = order[j];
+            if (available[i])
+                fprintf(f," %10.3f",c[i] / unit[i]);
+            else
+                fprintf(f," %10s","-");
+        }
+        long long ins = c[PERF_INSTRUCTIONS];
+        if (available[PERF_CYCLES] && available[PERF_INSTRUCTIONS])
+            fprintf(f," %6.2f",ratio(ins,c[PERF_CYCLES]));
+        else
+            fprintf(f," %6s","-");
+        if (available[PERF_INSTRUCTIONS] && available[PERF_LLC_MISSES])
+            fprintf(f," %8.3f",1000 * ratio(c[PERF_LLC_MISSES],ins));
+        else
+            fprintf(f," %8s","-");
+        if (available[PERF_INSTRUCTIONS] && available[PERF_BRANCH_MISSES])
+            fprintf(f," %8.3f",1000 * ratio(c[PERF_BRANCH_MISSES],ins));
+        else
+            fprintf(f," %8s","-");
+        fprintf(f,"\n");
+    }
+    pthread_mutex_unlock(&perf_lock);
+}
@@ -0,0 +1,101 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Hardware performance counters of training and inference phases */
+#ifndef PERFCTR_H
+#define PERFCTR_H
+#include <stdio.h>
+
+/* Counts hardware events, such as cycles and cache misses, of regions of
+ * code, such as the forward pass of a layer, using Linux perf_event_open.
+ * Counts are accumulated per region, identified by a name and an index
+ * (for example, "lstm forward" of layer 2), over all the times the region
+ * runs, and printed by perf_report().
+ *
+ * Counting is enabled by setting the environment variable MLINC_PERF (the
+ * report is printed to standard error when the program exits), or by
+ * calling perf_enable(). Each thread opens its own counters when it first
+ * begins a region, and counts only its own work.
+ *
+ * Counters that the kernel or the machine does not provide, as is common
+ * in containers and virtual machines, are reported as unavailable; the
+ * task clock, a software counter of the time the thread runs, is usually
+ * available. The floating point operations counter is model specific:
+ * set the environment variable MLINC_PERF_FP to its raw event code, in
+ * hexadecimal (for example 0x1fc7 is FP_ARITH_INST_RETIRED of all vector
+ * widths on recent Intel cpus), to count it.
+ *
+ * Region names must be string constants (they are kept by pointer). When
+ * counting is disabled, the PERF_ macros only test a global flag.
+ */
+#define PERF_MAX_COUNTERS  6    /* Number of counters                  */
+#define PERF_MAX_REGIONS 256    /* Number of regions counted           */
+#define PERF_MAX_DEPTH    64    /* Maximum nesting of regions          */
+
+/* Counters */
+#define PERF_CYCLES        0    /* Cpu cycles                          */
+#define PERF_INSTRUCTIONS  1    /* Instructions retired                */
+#define PERF_LLC_MISSES    2    /* Last level cache misses             */
+#define PERF_BRANCH_MISSES 3    /* Mispredicted branches               */
+#define PERF_FP_OPS        4    /* Floating point operations (raw)     */
+#define PERF_TASK_CLOCK    5    /* Nanoseconds the thread ran          */
+
+extern int perf_on;     /* If not zero, regions are counted */
+
+/* Begins a region named name, with index arg (-1 if none), on the calling
+ * thread.
+ */
+#define PERF_BEGIN(name,arg) \
+    do { if (perf_on) perf_begin(name,arg); } while (0)
+
+/* Ends the last region begun on the calling thread */
+#define PERF_END() \
+    do { if (perf_on) perf_end(); } while (0)
+
+/* Enables counting.
+ *
+ * Returns:
+ *   The number of counters available to the calling thread. If none is
+ *   available, counting is not enabled.
+ */
+int perf_enable(void);
+
+/* Disables counting; counts are kept */
+void perf_disable(void);
+
+/* Clears the counts of all regions */
+void perf_reset(void);
+
+void perf_begin(const char* name, int arg);
+void perf_end(void);
+
+/* Returns the name of counter i, 0 to PERF_MAX_COUNTERS-1 */
+const char* perf_counter_name(int i);
+
+/* Returns 1 if counter i was opened by any thread, 0 otherwise */
+int perf_counter_available(int i);
+
+/* Gets the counts of a region.
+ *
+ * Parameters:
+ *   name   - Name of the region
+ *   arg    - Index of the region
+ *   counts - Returns the counts of the PERF_MAX_COUNTERS counters, summed
+ *            over all the times the region ran; -1 for counters that are
+ *            not available
+ *
+ * Returns:
+ *   The number of times the region ran, 0 if it did not run.
+ *
+ * Notes:
+ *   Counts are scaled up when the kernel counted only part of the time,
+ *   because more counters were open than the cpu provides.
+ */
+long perf_counts(const char* name, int arg, long long counts[]);
+
+/* Prints the counts, and derived measures (instructions per cycle, cache
+ * and branch misses per thousand instructions), of each region to f.
+ * Counts of nested regions are included in the counts of the regions
+ * that contain them.
+ */
+void perf_report(FILE* f);
+
+#endif
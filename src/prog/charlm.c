@@ -42,6 +42,10 @@
  *     re-run each step; the next character is drawn from position T-1. RoPE
  *     makes this correct (positions are relative within the window). The LSTM
  *     uses the same windowed loop (stateful = 0), so one generate() serves both.
+ *   - With -S N, N samples of a transformer model are generated together, one
+ *     character per step, through a paged cache of attention keys and values
+ *     (see kvcache.h): each character is run once, not once per window, and
+ *     the samples share the cache blocks of the prompt.
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -75,6 +79,7 @@ typedef struct config_s {
     float wd;               /* weight decay                            */
     int   gen;              /* number of characters to generate        */
     float temp;             /* sampling temperature (<=0 => greedy)    */
+    int   samples;          /* samples generated with a cache, 0 = no  */
     int   max_seqs;         /* cap on #sequences per list, 0 = all     */
     float val_frac;         /* held-out fraction (single-file mode)    */
     unsigned int seed;      /* RNG seed (0 => time based)              */
@@ -98,6 +103,7 @@ static void config_defaults(CONFIG* c)
     c->wd         = 0.01f;
     c->gen        = 500;
     c->temp       = 0.8f;
+    c->samples    = 0;
     c->max_seqs   = 4000;
     c->val_frac   = 0.05f;
     c->seed       = 0;
@@ -129,12 +135,14 @@ static const char* USAGE =
  "    -g G           chars to generate after train (default 500)\n"
  "    -T X           temperature, <=0 greedy       (default 0.8)\n"
  "    -p S           seed text                     (default newline)\n"
+ "    -S N           generate N samples together with an attention cache,\n"
+ "                   at most T (transformer layers only; default 0 = windowed)\n"
  "  -h             print this message\n";
 
 static int parse_args(int argc, char** argv, CONFIG* c)
 {
     int opt;
-    while ((opt = getopt(argc,argv,"m:d:t:v:D:b:n:f:H:L:e:r:w:g:T:p:M:F:R:h")) != -1) {
+    while ((opt = getopt(argc,argv,"m:d:t:v:D:b:n:f:H:L:e:r:w:g:T:p:S:M:F:R:h")) != -1) {
         switch (opt) {
             case 'm': c->model      = optarg;                  break;
             case 'd': c->data       = optarg;                  break;
@@ -152,6 +160,7 @@ static int parse_args(int argc, char** argv, CONFIG* c)
             case 'g': c->gen        = atoi(optarg);            break;
             case 'T': c->temp       = atof(optarg);            break;
             case 'p': c->prompt     = optarg;                  break;
+            case 'S': c->samples    = atoi(optarg);            break;
             case 'M': c->max_seqs   = atoi(optarg);            break;
             case 'F': c->val_frac   = atof(optarg);            break;
             case 'R': c->seed       = (unsigned) atoi(optarg); break;
@@ -502,6 +511,88 @@ static void generate(MODEL* m, const VOCAB* v, const CONFIG* cfg)
     freemem(X); freemem(Y); freemem(window);
 }
 
+/* Generates cfg->samples samples together, one character of each per step.
+ * The prompt is run once, in chunks of up to T characters, then each sample
+ * forks its cache; characters before the last T are released from it.
+ */
+static void generate_paged(MODEL* m, const VOCAB* v, const CONFIG* cfg)
+{
+    const int T = cfg->block;
+    const int K = v->K;
+    const int S = (cfg->samples < T) ? cfg->samples : T;
+
+    int fill = (v->ch2idx['\n'] >= 0) ? v->ch2idx['\n']
+             : (v->ch2idx[' ']  >= 0) ? v->ch2idx[' '] : 0;
+
+    const char* pr = cfg->prompt;
+    int plen = (int) strlen(pr);
+    int* prompt = allocmem(plen + 1,1,int);
+    int n = 0;
+    for (int i = 0; i < plen; i++) {
+        int idx = v->ch2idx[(unsigned char) pr[i]];
+        if (idx >= 0)
+            prompt[n++] = idx;
+    }
+    if (n == 0)
+        prompt[n++] = fill;
+
+    /* Blocks of the last T characters of each sample, and of a prompt chunk */
+    KVPOOL* pool = model_kvpool(m,(S + 2) * (T / KV_BLOCK + 2));
+    KVSEQ** seqs = allocmem(1,S,KVSEQ*);
+    fArr2D X = allocmem(T,K,float);
+    fArr2D Y = allocmem(T,K,float);
+    typedef float (*ArrK)[K];
+    ArrK x = (ArrK) X;
+    ArrK y = (ArrK) Y;
+
+    /* The prompt, then the first character of each sample */
+    seqs[0] = kvseq_create();
+    int last = 0;
+    for (int t = 0; t < n; t += T) {
+        int cnt = (n - t < T) ? n - t : T;
+        fltclr(X,cnt * K);
+        for (int i = 0; i < cnt; i++) x[i][prompt[t + i]] = 1.0f;
+        model_predict_paged(m,pool,seqs,1,cnt,X,Y);
+        kvseq_drop(pool,seqs[0],seqs[0]->len - T + 1);
+        last = cnt - 1;
+    }
+    for (int i = 1; i < S; i++)
+        seqs[i] = kvseq_fork(pool,seqs[0]);
+    char* text = allocmem(S,cfg->gen + 1,char);
+    int* next = allocmem(S,1,int);
+    for (int i = 0; i < S; i++)
+        next[i] = sample_row(y[last],K,cfg->temp);
+
+    for (int step = 0; step < cfg->gen; step++) {
+        for (int i = 0; i < S; i++)
+            text[i * (cfg->gen + 1) + step] = v->idx2ch[next[i]];
+        if (step == cfg->gen - 1)
+            break;
+        fltclr(X,S * K);
+        for (int i = 0; i < S; i++) x[i][next[i]] = 1.0f;
+        if (model_predict_paged(m,pool,seqs,S,1,X,Y) < 0) {
+            fprintf(stderr,"generate_paged: attention cache is full\n");
+            break;
+        }
+        for (int i = 0; i < S; i++) {
+            kvseq_drop(pool,seqs[i],seqs[i]->len - T + 1);
+            next[i] = sample_row(y[i],K,cfg->temp);
+        }
+    }
+    for (int i = 0; i < S; i++) {
+        printf("---- sample %d of %d (%s, temp %.2f) ----\n",i + 1,S,
+               cfg->model,cfg->temp);
+        printf("%s%s\n",pr,text + i * (cfg->gen + 1));
+    }
+    printf("----------------------------------\n");
+
+    for (int i = 0; i < S; i++)
+        kvseq_free(pool,seqs[i]);
+    kvpool_free(pool);
+    freemem(seqs); freemem(text); freemem(next);
+    freemem(X); freemem(Y); freemem(prompt);
+}
+
 int main(int argc, char** argv)
 {
     CONFIG cfg;
@@ -611,7 +702,10 @@ int main(int argc, char** argv)
               "final=1 verbose=2");
     printf("\n");
 
-    generate(m,&voc,&cfg);
+    if (cfg.samples > 0 && strchr(pattern,'L') == NULL)
+        generate_paged(m,&voc,&cfg);
+    else
+        generate(m,&voc,&cfg);
 
     freemem(losses); freemem(accs); freemem(vloss); freemem(vaccs);
     free(pattern);
@@ -0,0 +1,199 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Converts datasets from their original text formats to binary dataset
+ * files (see dsfile.h) that can be memory mapped and used directly.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+#include "float.h"
+#include "array.h"
+#include "onehot.h"
+#include "datasrc.h"
+#include "dsfile.h"
+#include "irisfile.h"
+#include "harfile.h"
+#include "featfile.h"
+
+#define HAR_MAX_SEQUENCE_CNT    100
+#define HAR_MAX_SAMPLE_CNT  1100000
+#define TIMIT_MAX_SEQUENCE_CNT 10000
+
+const char* usage =
+"Usage: dsconvert <type> <input> ... <output>\n"
+"  dsconvert iris <iris data file> <output file>\n"
+"  dsconvert har <raw data directory> <output file> [subject ...]\n"
+"  dsconvert timit <features directory> <file list> <output file>\n"
+"  dsconvert embd <word2vec embeddings file> <output file>\n"
+"  dsconvert info <dataset file>\n";
+
+/* Iris: 150 samples, 4 features, 3 classes, single sequence */
+int convert_iris(const char* irisfile, const char* output)
+{
+    const int M = IRIS_SAMPLE_CNT;
+    float (*x)[IRIS_FEAT_CNT] = allocmem(M,IRIS_FEAT_CNT,float);
+    int* yc = allocmem(M,1,int);
+    int ok = read_iris_file(irisfile,M,x,yc);
+    if (ok)
+        ok = dsfile_write(output,x,IRIS_FEAT_CNT,yc,IRIS_CLASS_CNT,DS_INT,
+                          NULL,M);
+    freemem(x);
+    freemem(yc);
+    return ok;
+}
+
+/* HAR: one sequence per experiment of the selected subjects */
+int convert_har(const char* input_dir, const char* output,
+                const int* sid, int sid_len)
+{
+    int S = HAR_MAX_SEQUENCE_CNT;
+    int M = HAR_MAX_SAMPLE_CNT;
+    float (*x)[HAR_EXPENDED_FEAT_CNT] = allocmem(M,HAR_EXPENDED_FEAT_CNT,float);
+    int* yc = allocmem(M,1,int);
+    int* len = allocmem(S,1,int);
+    S = read_har_files(input_dir,S,len,M,x,yc,sid,sid_len);
+    int ok = S > 0;
+    if (ok)
+        ok = dsfile_write(output,x,HAR_EXPENDED_FEAT_CNT,
+                          yc,HAR_REDUCED_CLASS_CNT,DS_INT,len,S);
+    freemem(x);
+    freemem(yc);
+    freemem(len);
+    return ok;
+}
+
+/* TIMIT phoneme features: one sequence per feature file, streamed */
+int convert_timit(const char* input_dir, const char* file_list,
+                  const char* output)
+{
+    DATASRC* s = featfile_source(input_dir,file_list,TIMIT_MAX_SEQUENCE_CNT);
+    if (s == NULL)
+        return 0;
+    const int D = EXPENDED_FEAT_CNT;
+    const int N = REDUCED_PHONEME_CNT;
+    int num = datasrc_num_sequences(s);
+    int maxlen = datasrc_max_length(s);
+    int* len = allocmem(num,1,int);
+    for (int i = 0; i < num; i++)
+        len[i] = datasrc_sequence_length(s,i);
+    float (*x)[D] = allocmem(maxlen,D,float);
+    float (*y)[N] = allocmem(maxlen,N,float);
+    int* yc = allocmem(maxlen,1,int);
+    DSWRITER* w = dsfile_create(output,D,N,DS_INT,len,num);
+    int ok = w != NULL;
+    for (int i = 0; ok && i < num; i++) {
+        ok = datasrc_read(s,i,0,len[i],x,y) == len[i];
+        if (ok) {
+            onehot_decode(y,yc,len[i],N);
+            ok = dsfile_append(w,x,yc,len[i]);
+        }
+        printf("\r%d sequences out of %d",i + 1,num);
+        fflush(stdout);
+    }
+    printf("\n");
+    if (w != NULL && !dsfile_finish(w))
+        ok = 0;
+    freemem(x);
+    freemem(y);
+    freemem(yc);
+    freemem(len);
+    datasrc_free(s);
+    return ok;
+}
+
+/* word2vec embeddings: a single sequence of vocab_size vectors */
+int convert_embd(const char* embfile, const char* output)
+{
+    FILE* fp = fopen(embfile,"rb");
+    if (fp == NULL) {
+        fprintf(stderr,"Could not open file '%s' for read\n",embfile);
+        return 0;
+    }
+    int V, E, epochs;
+    float lr, lrd;
+    int cnt = fscanf(fp,
+                     "#,vocab_size,%d,embedding_dim,%d,"
+                     "learning_rate,%f,learning_rate_decay,%f,epochs,%d",
+                     &V,&E,&lr,&lrd,&epochs);
+    if (cnt != 5 || V <= 0 || E <= 0) {
+        fprintf(stderr,"'%s': Invalid file header format.\n",embfile);
+        fclose(fp);
+        return 0;
+    }
+    typedef float (*ArrVE)[E];
+    ArrVE x = allocmem(V,E,float);
+    int ok = 1;
+    for (int i = 0; ok && i < V; i++) {
+        int wrdinx;
+        char word[256];
+        ok = fscanf(fp,"%d,%255[^,],",&wrdinx,word) == 2 &&
+             wrdinx >= 0 && wrdinx < V;
+        for (int j = 0; ok && j < E; j++)
+            ok = fscanf(fp,"%f%*[,]",&x[wrdinx][j]) == 1;
+        if (!ok)
+            fprintf(stderr,"'%s': Invalid embedding at line %d\n",
+                                                              embfile,i + 2);
+    }
+    fclose(fp);
+    if (ok)
+        ok = dsfile_write(output,x,E,NULL,0,DS_NONE,NULL,V);
+    freemem(x);
+    return ok;
+}
+
+int print_info(const char* filename)
+{
+    DSFILE* ds = dsfile_open(filename);
+    if (ds == NULL)
+        return 0;
+    const char* y_types[] = { "none", "float vectors", "int classes" };
+    int maxlen = 0;
+    for (int i = 0; i < ds->num; i++)
+        if (maxlen < ds->len[i])
+            maxlen = ds->len[i];
+    printf("%s: %d sequences, %ld vectors, longest sequence %d\n",
+                                           filename,ds->num,ds->M,maxlen);
+    printf("Input dimension %d, labels %s",ds->D,y_types[ds->y_type]);
+    if (ds->y_type != DS_NONE)
+        printf(" (%d %s)",ds->N,(ds->y_type == DS_INT) ? "classes" : "dim");
+    printf("\n");
+    dsfile_close(ds);
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    int ok = 0;
+    const char* output = NULL;
+    if (argc == 4 && strcmp(argv[1],"iris") == 0)
+        ok = convert_iris(argv[2],output = argv[3]);
+    else
+    if (argc >= 4 && strcmp(argv[1],"har") == 0) {
+        int sid[HAR_SUBJECT_CNT];
+        int sid_len = 0;
+        for (int i = 4; i < argc && sid_len < HAR_SUBJECT_CNT; i++)
+            sid[sid_len++] = atoi(argv[i]);
+        if (sid_len == 0) /* All subjects */
+            for (sid_len = 0; sid_len < HAR_SUBJECT_CNT; sid_len++)
+                sid[sid_len] = sid_len + 1;
+        ok = convert_har(argv[2],output = argv[3],sid,sid_len);
+    }
+    else
+    if (argc == 5 && strcmp(argv[1],"timit") == 0)
+        ok = convert_timit(argv[2],argv[3],output = argv[4]);
+    else
+    if (argc == 4 && strcmp(argv[1],"embd") == 0)
+        ok = convert_embd(argv[2],output = argv[3]);
+    else
+    if (argc == 3 && strcmp(argv[1],"info") == 0)
+        return print_info(argv[2]) ? 0 : 1;
+    else {
+        fprintf(stderr,"%s",usage);
+        return 1;
+    }
+    if (ok)
+        print_info(output);
+    else
+        fprintf(stderr,"Conversion failed\n");
+    return (ok) ? 0 : 1;
+}
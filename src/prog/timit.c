@@ -23,6 +23,9 @@
 #include "editdist.h"
 #include "beamsrch.h"
 #include "alignseq.h"
+#include "tasksched.h"
+#include "datasrc.h"
+#include "dsfile.h"
 
 /* Directories of phoneme feature files (no trailing slash) */
 const char* timit_tr_data_dir = "data/timit/features/train";
@@ -72,6 +75,92 @@ int dedup_labels(iVec restrict labels, int len, int blank_inx)
 
 
 
+/* Results of evaluating one test sequence, see evaluate_sequences() */
+typedef struct {
+    int mcnt;   /* Number of matching raw labels                */
+    int dist1;  /* Raw label sequences edit distance            */
+    int len1;   /* Raw label sequences edit length              */
+    int dist2;  /* Phoneme sequences edit distance              */
+    int len2;   /* Phoneme sequences edit length                */
+    int dist3;  /* Beam search phoneme sequences edit distance  */
+    int len3;   /* Beam search phoneme sequences edit length    */
+} SEQEVAL;
+
+typedef struct {
+    const float* yp;    /* Predicted probabilities of all sequences    */
+    const int* yc;      /* True labels of all sequences                */
+    int* bsseqs;        /* Beam searched label sequences               */
+    const int* lens;    /* Sequence lengths                            */
+    const int* offs;    /* Offsets of the sequences' first samples     */
+    int N;              /* Number of classes                           */
+    int beamwidth;      /* Beam width of the beam searched sequences   */
+    SEQEVAL* ev;        /* [num] Results of each sequence (output)     */
+    int* cms;           /* [threads + 1][N][N] Confusion matrix of each */
+                        /* thread (output)                             */
+} EVALSEQS;
+
+/* Evaluates the predictions of test sequences lo to hi - 1: stores each
+ * sequence's counts in ev, and adds its aligned phonemes to the confusion
+ * matrix of the calling thread.
+ */
+static void evaluate_sequences(void* arg, int lo, int hi)
+{
+    const EVALSEQS* a = (const EVALSEQS*) arg;
+    const int N = a->N;
+    typedef int (*ArrNN)[N];
+    ArrNN cm = (ArrNN) (a->cms + (long) sched_thread_id() * N * N);
+    for (int i = lo; i < hi; i++) {
+        const int len = a->lens[i];
+        const int off = a->offs[i];
+        SEQEVAL* ev = a->ev + i;
+        SCRATCH_MARK mark = scratch_mark();
+        int* ypc = scratchmem(1,len,int);   /* Predicted labels */
+        int* ytc = scratchmem(1,len,int);   /* True labels      */
+        memcpy(ytc,a->yc + off,len * sizeof(int));
+        onehot_decode((fArr2D) (a->yp + (long) off * N),ypc,len,N);
+        /* Count raw matches */
+        for (int j = 0; j < len; j++)
+            if (ytc[j] == ypc[j])
+                ev->mcnt++;
+
+        /* Calculate edit distance of raw predictions */
+        ev->dist1 = edit_dist(ypc,len,ytc,len);
+        ev->len1 = len;
+
+        /* Convert labels to phonemes: 
+         * merge repeated labels, remove silence/blanks 
+         */
+        int ytc_len = dedup_labels(ytc,len,SIL);
+        int ypc_len = dedup_labels(ypc,len,SIL);
+
+        /* Calulate edit distance of phonemes */
+        ev->dist2 = edit_dist(ypc,ypc_len,ytc,ytc_len);
+        ev->len2 = (ytc_len > ypc_len) ? ytc_len : ypc_len;
+  
+        /* Best beam searched sequence of lables */
+        int* sequence = a->bsseqs + (long) (off + i) * a->beamwidth;
+        ypc_len = dedup_labels(sequence,len,SIL);
+        memcpy(ypc,sequence,ypc_len * sizeof(int));
+
+        /* Align beam searched phonemes with true phonems;
+         * calulate edit distance 
+         */
+        int rlen = ((ytc_len > ypc_len) ? ytc_len : ypc_len) * 2;
+        int* ypc2 = scratchmem(1,rlen + 1,int);
+        int* ytc2 = scratchmem(1,rlen + 1,int);
+        ev->dist3 = alignseq(ypc,ypc_len,ytc,ytc_len,ypc2,ytc2,rlen,SIL);
+        ev->len3 = (ytc_len > ypc_len) ? ytc_len : ypc_len;
+
+        /* Update the confusion matrix */
+        for (int j = 0; j < rlen; j++)
+            if (ytc2[j] != SIL || ypc2[j] != SIL)
+                cm[ytc2[j]][ypc2[j]]++;
+            else
+                break;
+        scratch_release(mark);
+    }
+}
+
 /* Trains a multi layer LSTM followed by Dense layer to recognize
  * speech phonemes from timit dataset.
  *
@@ -82,6 +171,11 @@ int dedup_labels(iVec restrict labels, int len, int blank_inx)
  * If storemodel is not NULL, it points to the name of a file, where the 
  * model (further) trained by this function will be stored.
  *
+ * If dsfiles is not NULL, it points to the names of the training,
+ * validation and test dataset files (see dsconvert), which are mapped into
+ * memory rather than loaded; otherwise, the data is read from the feature
+ * files.
+ *
  * layers array contains the size of each layer. One additional output layer
  * is implied.  So for example if layers contains two elements, 128 and 64, 
  * two LSTM layers will be created with size of 128 and 64, followed by 
@@ -98,6 +192,7 @@ int dedup_labels(iVec restrict labels, int len, int blank_inx)
  */
 int timit_lstm_dense_classification(
                         const char* loadmodel, const char* storemodel,
+                        char* const* dsfiles,
                         int layers[], int layers_cnt, int rng_seed, 
                         int ctc_mode, char* optimizer, int batch_size,
                         float learning_rate, 
@@ -189,74 +284,125 @@ int timit_lstm_dense_classification(
 
     int STr = TIMIT_TR_MAX_SEQUENCE_CNT;
     int MTr = TIMIT_TR_MAX_SAMPLE_CNT;
-    ArrMD xTr = allocmem(MTr,D,float);  /* TIMIT training dataset           */
-    VecS  sTr = allocmem(STr,1,int);    /* TIMIT training sequence lengths  */
-    VecM  yTrc = allocmem(MTr,1,int);   /* Training (true) labels           */
-    ArrMN yTrt = allocmem(MTr,N,float); /* Training label one-hot vectors   */
+    ArrMD xTr = NULL;                   /* TIMIT training dataset           */
+    VecS  sTr = NULL;                   /* TIMIT training sequence lengths  */
+    VecM  yTrc = NULL;                  /* Training (true) labels           */
+    ArrMN yTrt = NULL;                  /* Training label one-hot vectors   */
     int SVd = TIMIT_VD_MAX_SEQUENCE_CNT;
     int MVd = TIMIT_VD_MAX_SAMPLE_CNT;
-    ArrMD xVd = allocmem(MVd,D,float);  /* TIMIT validation dataset         */
-    VecS  sVd = allocmem(SVd,1,int);    /* TIMIT validation sequence lengths*/
-    VecM  yVdc = allocmem(MVd,1,int);   /* Validation (true) labels         */
-    ArrMN yVdt = allocmem(MVd,N,float); /* Validation label one-hot vectors */
+    ArrMD xVd = NULL;                   /* TIMIT validation dataset         */
+    VecS  sVd = NULL;                   /* TIMIT validation sequence lengths*/
+    VecM  yVdc = NULL;                  /* Validation (true) labels         */
+    ArrMN yVdt = NULL;                  /* Validation label one-hot vectors */
     int STe = TIMIT_TE_MAX_SEQUENCE_CNT;
     int MTe = TIMIT_TE_MAX_SAMPLE_CNT;
-    ArrMD xTe = allocmem(MTe,D,float);  /* TIMIT test dataset           */
-    VecS  sTe = allocmem(STe,1,int);    /* TIMIT test sequence lengths  */
-    VecM  yTec = allocmem(MTe,1,int);   /* Test (true) labels           */
-    ArrMN yTet = allocmem(MTe,N,float); /* Test label one-hot vectors   */
-
-    int cnt;
-
-    /* Read data */
-    printf("%s Loading data...\n",date_time(datetimebuf));
-    cnt = read_feature_files(timit_tr_data_dir,
-                             timit_tr_file_list,STr,sTr,MTr,xTr,yTrc);
-    if (cnt == 0)
-        return 0;
-    /* Update sTr, MTr with actual values */
-    STr = cnt;
-    cnt = 0;
-    for (int i = 0; i < STr; i++)
-        cnt += sTr[i];
-    MTr = cnt;
-    /* Each sequence contains multiple phonemes, find how many in total */
-    int PTr = count_phoneme(yTrc,MTr);
-
-    cnt = read_feature_files(timit_vd_data_dir,
-                             timit_vd_file_list,SVd,sVd,MVd,xVd,yVdc);
-    if (cnt == 0)
-        return 0;
-    /* Update sVd, MVd with actual values */
-    SVd = cnt;
-    cnt = 0;
-    for (int i = 0; i < SVd; i++)
-        cnt += sVd[i];
-    MVd = cnt;
-    /* Each sequence contains multiple phonemes, find how many in total */
-    int PVd = count_phoneme(yVdc,MVd);
-
-    cnt = read_feature_files(timit_te_data_dir,
-                             timit_te_file_list,STe,sTe,MTe,xTe,yTec);
-    if (cnt == 0)
-        return 0;
-    /* Update sTe, MTe with actual values */
-    STe = cnt;
-    cnt = 0;
-    for (int i = 0; i < STe; i++)
-        cnt += sTe[i];
-    MTe = cnt;
-    /* Each sequence contains multiple phonemes, find how many in total */
-    int PTe = count_phoneme(yTec,MTe);
-
-    printf("%d training sequences, %d phonemes, %d samples\n",STr,PTr,MTr);
-    printf("%d validation sequences, %d phonemes, %d samples\n\n",SVd,PVd,MVd);
-    printf("%d test sequences, %d phonemes, %d samples\n\n",STe,PTe,MTe);
-
-    /* Encode yc as one-hot vectors */
-    onehot_encode(yTrc,yTrt,MTr,N);
-    onehot_encode(yVdc,yVdt,MVd,N);
-    onehot_encode(yTec,yTet,MTe,N);
+    ArrMD xTe = NULL;                   /* TIMIT test dataset           */
+    VecS  sTe = NULL;                   /* TIMIT test sequence lengths  */
+    VecM  yTec = NULL;                  /* Test (true) labels           */
+    ArrMN yTet = NULL;                  /* Test label one-hot vectors   */
+
+    DATASRC* srcTr = NULL; /* Training dataset file, if specified      */
+    DATASRC* srcVd = NULL; /* Validation dataset file                   */
+    DSFILE* dsTe = NULL;   /* Test dataset file, mapped into memory     */
+    if (dsfiles != NULL) {
+        /* Map data; labels of dataset files have no end of phoneme markers */
+        printf("%s Mapping dataset files...\n",date_time(datetimebuf));
+        srcTr = datasrc_mmap(dsfiles[0]);
+        srcVd = datasrc_mmap(dsfiles[1]);
+        dsTe = dsfile_open(dsfiles[2]);
+        if (srcTr == NULL || srcVd == NULL || dsTe == NULL ||
+            srcTr->D != D || srcTr->N != N || srcVd->D != D || srcVd->N != N ||
+            dsTe->D != D || dsTe->N != N || dsTe->y_type != DS_INT) {
+            fprintf(stderr,"timit: '%s' '%s' and '%s' are not TIMIT dataset "
+                           "files\n",dsfiles[0],dsfiles[1],dsfiles[2]);
+            datasrc_free(srcTr);
+            datasrc_free(srcVd);
+            if (dsTe != NULL)
+                dsfile_close(dsTe);
+            return 0;
+        }
+        STr = datasrc_num_sequences(srcTr);
+        MTr = (int) datasrc_num_vectors(srcTr);
+        SVd = datasrc_num_sequences(srcVd);
+        MVd = (int) datasrc_num_vectors(srcVd);
+        STe = dsTe->num;
+        MTe = (int) dsTe->M;
+        xTe = (ArrMD) dsTe->x;
+        sTe = (VecS) dsTe->len;
+        yTec = (VecM) dsTe->y;
+        printf("%d training sequences, %d samples\n",STr,MTr);
+        printf("%d validation sequences, %d samples\n\n",SVd,MVd);
+        printf("%d test sequences, %d samples\n\n",STe,MTe);
+    }
+    else {
+        xTr = allocmem(MTr,D,float);
+        sTr = allocmem(STr,1,int);
+        yTrc = allocmem(MTr,1,int);
+        yTrt = allocmem(MTr,N,float);
+        xVd = allocmem(MVd,D,float);
+        sVd = allocmem(SVd,1,int);
+        yVdc = allocmem(MVd,1,int);
+        yVdt = allocmem(MVd,N,float);
+        xTe = allocmem(MTe,D,float);
+        sTe = allocmem(STe,1,int);
+        yTec = allocmem(MTe,1,int);
+        yTet = allocmem(MTe,N,float);
+
+        int cnt;
+
+        /* Read data */
+        printf("%s Loading data...\n",date_time(datetimebuf));
+        cnt = read_feature_files(timit_tr_data_dir,
+                                 timit_tr_file_list,STr,sTr,MTr,xTr,yTrc);
+        if (cnt == 0)
+            return 0;
+        /* Update sTr, MTr with actual values */
+        STr = cnt;
+        cnt = 0;
+        for (int i = 0; i < STr; i++)
+            cnt += sTr[i];
+        MTr = cnt;
+        /* Each sequence contains multiple phonemes, find how many in total */
+        int PTr = count_phoneme(yTrc,MTr);
+
+        cnt = read_feature_files(timit_vd_data_dir,
+                                 timit_vd_file_list,SVd,sVd,MVd,xVd,yVdc);
+        if (cnt == 0)
+            return 0;
+        /* Update sVd, MVd with actual values */
+        SVd = cnt;
+        cnt = 0;
+        for (int i = 0; i < SVd; i++)
+            cnt += sVd[i];
+        MVd = cnt;
+        /* Each sequence contains multiple phonemes, find how many in total */
+        int PVd = count_phoneme(yVdc,MVd);
+
+        cnt = read_feature_files(timit_te_data_dir,
+                                 timit_te_file_list,STe,sTe,MTe,xTe,yTec);
+        if (cnt == 0)
+            return 0;
+        /* Update sTe, MTe with actual values */
+        STe = cnt;
+        cnt = 0;
+        for (int i = 0; i < STe; i++)
+            cnt += sTe[i];
+        MTe = cnt;
+        /* Each sequence contains multiple phonemes, find how many in total */
+        int PTe = count_phoneme(yTec,MTe);
+
+        printf("%d training sequences, %d phonemes, %d samples\n",
+                                                              STr,PTr,MTr);
+        printf("%d validation sequences, %d phonemes, %d samples\n\n",
+                                                              SVd,PVd,MVd);
+        printf("%d test sequences, %d phonemes, %d samples\n\n",
+                                                              STe,PTe,MTe);
+
+        /* Encode yc as one-hot vectors */
+        onehot_encode(yTrc,yTrt,MTr,N);
+        onehot_encode(yVdc,yVdt,MVd,N);
+        onehot_encode(yTec,yTet,MTe,N);
+    }
 
     float losses[epochs];
     float accuracies[epochs];
@@ -270,10 +416,15 @@ int timit_lstm_dense_classification(
             snprintf(kwargs,sizeof(kwargs),"schedule=%s verbose=2",schedule);
         else
             snprintf(kwargs,sizeof(kwargs),"verbose=2");
-        model_fit(m,xTr,yTrt,sTr,STr,
-                    xVd,yVdt,sVd,SVd,
-                    epochs,learning_rate,weight_decay,
-                    losses,accuracies,v_losses,v_accuracies,kwargs);
+        if (srcTr != NULL)
+            model_fit_source(m,srcTr,srcVd,
+                        epochs,learning_rate,weight_decay,
+                        losses,accuracies,v_losses,v_accuracies,kwargs);
+        else
+            model_fit(m,xTr,yTrt,sTr,STr,
+                        xVd,yVdt,sVd,SVd,
+                        epochs,learning_rate,weight_decay,
+                        losses,accuracies,v_losses,v_accuracies,kwargs);
     }
 
     if (storemodel != NULL) 
@@ -281,7 +432,6 @@ int timit_lstm_dense_classification(
 
     printf("%s Testing...\n",date_time(datetimebuf));
     int nc = N;     /* Number of classes (inc. slience/blank)       */
-    int off;        /* Current sequence offset within test data     */
     float mcnt;     /* Number of matching raw labels                */
     /* variables for similarity calculations */
     int dist1;      /* Raw label sequences edit distance (numerator)*/
@@ -298,67 +448,55 @@ int timit_lstm_dense_classification(
     int cm[N][N]; /* Confusion matrix */
     memset(cm,0,N * N * sizeof(int));
 
-    int sTeMax = 0;
-    for (i = 0; i < STe; i++)
-        if (sTeMax < sTe[i])
-            sTeMax = sTe[i];
-
-    ArrMN yp = allocmem(sTeMax,N,float); /* Predicted probabilities */
-    VecS ypc = allocmem(sTeMax,1,int);   /* Predicted labels        */
-    VecS ytc = allocmem(sTeMax,1,int);   /* True labels             */
-
-    for (i = 0, off = 0; i < STe; off += sTe[i++]) {
-        printf("\r%3d sequences out of %d %3d%%",i,STe,off * 100 / MTe);
-        fflush(stdout);
-        memcpy(ytc,yTec + off,sTe[i] * sizeof(int));
-        model_predict(m,xTe + off,yp,sTe[i]);
-        onehot_decode(yp,ypc,sTe[i],N); 
-        /* Count raw matches */
-        for (j = 0; j < sTe[i]; j++)
-            if (ytc[j] == ypc[j])
-                mcnt++;
-
-        /* Calculate edit distance of raw predictions */
-        dist1 += edit_dist(ypc,sTe[i],ytc,sTe[i]);
-        len1 += sTe[i];
-
-        /* Convert labels to phonemes: 
-         * merge repeated labels, remove silence/blanks 
-         */
-        int ytc_len = dedup_labels(ytc,sTe[i],SIL);
-        int ypc_len = dedup_labels(ypc,sTe[i],SIL);
-
-        /* Calulate edit distance of phonemes */
-        dist2 += edit_dist(ypc,ypc_len,ytc,ytc_len);
-        len2 += (ytc_len > ypc_len) ? ytc_len : ypc_len;
-  
-        /* Performs beam search to find the most probable sequences of lables */
-        int beamwidth = 3;
-        int timesteps = sTe[i];
-        int sequences[beamwidth][timesteps + 1];
-        float scores[beamwidth];
+    ArrMN yp = allocmem(MTe,N,float);    /* Predicted probabilities */
+    VecS offs = allocmem(STe,1,int);     /* Sequence offsets        */
+    for (i = 1; i < STe; i++)
+        offs[i] = offs[i - 1] + sTe[i - 1];
 
-        beam_search(yp,timesteps,nc,beamwidth,sequences,scores);
-        ypc_len = dedup_labels(sequences[0],timesteps,SIL);
-        memcpy(ypc,sequences[0],ypc_len * sizeof(int));
+    model_predict_sequences(m,xTe,yp,sTe,STe);
 
-        /* Align beam searched phonemes with true phonems;
-         * calulate edit distance 
-         */
-        int rlen = ((ytc_len > ypc_len) ? ytc_len : ypc_len) * 2;
-        int ypc2[rlen];
-        int ytc2[rlen];
-        dist3 += alignseq(ypc,ypc_len,ytc,ytc_len,ypc2,ytc2,rlen,SIL);
-        len3 += (ytc_len > ypc_len) ? ytc_len : ypc_len;
+    /* Performs beam search to find the most probable sequences of lables,
+     * of all sequences at once
+     */
+    int beamwidth = 3;
+    int* bsseqs = allocmem(MTe + STe,beamwidth,int);
+    float* bsscores = allocmem(STe,beamwidth,float);
+    {
+        fArr2D probabilities[STe];
+        iArr2D sequences[STe];
+        fVec scores[STe];
+        for (i = 0; i < STe; i++) {
+            probabilities[i] = (fArr2D) (yp + offs[i]);
+            sequences[i] = (iArr2D) (bsseqs + (offs[i] + i) * beamwidth);
+            scores[i] = bsscores + i * beamwidth;
+        }
+        beam_search_batch(STe,probabilities,sTe,nc,beamwidth,
+                          sequences,scores,1);
+    }
 
-        /* Update the confusion matrix */
-        for (int i = 0; i < rlen; i++)
-            if (ytc2[i] != SIL || ypc2[i] != SIL)
-                cm[ytc2[i]][ypc2[i]]++;
-            else
-                break;
+    /* Sequences are evaluated in parallel; the counts of each sequence
+     * are then added in order, so the results match a sequential run
+     */
+    int threads = sched_num_threads(sched_default());
+    SEQEVAL* ev = allocmem(STe,1,SEQEVAL);
+    int* cms = allocmem(threads + 1,N * N,int);
+    EVALSEQS ea = { (float*) yp, yTec, bsseqs, sTe, offs, N, beamwidth,
+                    ev, cms };
+    parallel_for(NULL,0,STe,1,evaluate_sequences,&ea);
+    for (i = 0; i < STe; i++) {
+        mcnt += ev[i].mcnt;
+        dist1 += ev[i].dist1;
+        len1 += ev[i].len1;
+        dist2 += ev[i].dist2;
+        len2 += ev[i].len2;
+        dist3 += ev[i].dist3;
+        len3 += ev[i].len3;
     }
-    printf("\r%3d sequences out of %d %3d%%\n",i,STe,off * 100 / MTe);
+    for (int t = 0; t <= threads; t++)
+        for (i = 0; i < N; i++)
+            for (j = 0; j < N; j++)
+                cm[i][j] += cms[((long) t * N + i) * N + j];
+    printf("%3d sequences out of %d 100%%\n",STe,STe);
     printf("%s Testing completed \n",date_time(datetimebuf));
     printf("Accuracy (labels) %5.3f\n",mcnt / MTe);
     printf("Average similarity (label edit distance) %5.3f\n",
@@ -400,8 +538,11 @@ int timit_lstm_dense_classification(
     printf("\n");
 #endif
     freemem(yp);
-    freemem(ypc);
-    freemem(ytc);
+    freemem(offs);
+    freemem(bsseqs);
+    freemem(bsscores);
+    freemem(ev);
+    freemem(cms);
     freemem(xTr);
     freemem(sTr);
     freemem(yTrc);
@@ -410,10 +551,17 @@ int timit_lstm_dense_classification(
     freemem(sVd);
     freemem(yVdc);
     freemem(yVdt);
-    freemem(xTe);
-    freemem(sTe);
-    freemem(yTec);
-    freemem(yTet);
+    if (dsTe != NULL) { /* Test data is in the mapped file */
+        datasrc_free(srcTr);
+        datasrc_free(srcVd);
+        dsfile_close(dsTe);
+    }
+    else {
+        freemem(xTe);
+        freemem(sTe);
+        freemem(yTec);
+        freemem(yTet);
+    }
     model_free(m);
     return 1;
 }
@@ -426,6 +574,7 @@ int main(int argc, char** argv)
       "             [-L 's1 s2 ...'] [-S e:lr:wd,e:lr:wd,...]               \n"
       "             [-l <model file>] [-s <model file>]                     \n"
       "             [-R <rng seed>] [-ctc | -cross-entropy]                 \n"
+      "             [-d <training>:<validation>:<test dataset file>]        \n"
       "                                                                     \n"
       " -L: LSTM layer specification. One additional output layer           \n"
       "     is implied. So for example -L '128 64' specifies two            \n"
@@ -437,6 +586,8 @@ int main(int argc, char** argv)
       " -l: Load model from file and continue to train for number           \n"
       "     of epochs specified by -e; ignore -L option.                    \n"
       " -s: Store model in file at the end of training                      \n"
+      " -d: Read the data from dataset files created by 'dsconvert timit',  \n"
+      "     rather than from the feature files.                             \n"
       "\n";
 
     int epochs = 25;
@@ -444,13 +595,14 @@ int main(int argc, char** argv)
     float lr = 0 /*0.001*/, wd = 0/*0.01*/;  /* If set, Overriddes below sch */
     char *sch = "15:0.001:0.02,5:0.001:0.01,5:0.0001:0.01";
     char *loadfile = NULL, *storefile = NULL;
+    char *dsfiles[3] = { NULL };
     #define maxlyrcnt 9
     int lyrcnt = 3;
     int layers[maxlyrcnt+1] = {128,128,128};
     int ctc_mode = 1;
     int rng_seed = 42;
     int opt;
-    while ((opt = getopt(argc, argv, "e:l:s:b:r:w:L:S:R:c:h")) != -1) {
+    while ((opt = getopt(argc, argv, "e:l:s:b:r:w:L:S:R:c:d:h")) != -1) {
         switch (opt) {
             case 'h': printf(usage); exit(0);
             case 'e': epochs = atoi(optarg); break;
@@ -471,6 +623,17 @@ int main(int argc, char** argv)
             break;
             case 'S': sch = optarg; break;
             case 'R': rng_seed = atoi(optarg); break;
+            case 'd':
+                dsfiles[0] = optarg;
+                for (int i = 1; i < 3 && dsfiles[i - 1] != NULL; i++)
+                    if ((dsfiles[i] = index(dsfiles[i - 1],':')) != NULL)
+                        *dsfiles[i]++ = '\0';
+                if (dsfiles[2] == NULL) {
+                    fprintf(stderr,"timit: -d requires three dataset files\n");
+                    printf(usage);
+                    exit(-1);
+                }
+            break;
             case 'c': /* optarg contains the option string sans first character */
                 if (strcmp(optarg,"tc") == 0)
                     ctc_mode = 1;
@@ -490,7 +653,8 @@ int main(int argc, char** argv)
         }
     }
     int ok;
-    ok = timit_lstm_dense_classification(loadfile,storefile,layers,lyrcnt,
+    ok = timit_lstm_dense_classification(loadfile,storefile,
+                            (dsfiles[0] != NULL) ? dsfiles : NULL,layers,lyrcnt,
                             rng_seed,ctc_mode,"adamw",bsize,lr,wd,epochs,sch);
     return (ok) ? 0 : -1;
 }
@@ -10,6 +10,7 @@
 #include <strings.h>
 #include <math.h>
 #include <assert.h>
+#include "mem.h"
 #include "random.h"
 #include "sphere.h"
 #include "filter.h"
@@ -18,6 +19,7 @@
 #include "lpc.h"
 #include "lsp.h"
 #include "featfile.h"
+#include "fileload.h"
 
 /* Audio is divided into frames. For each frame compute LPC parameters,
  * and the residual error variance. Convert the LPC's to LSP's and the 
@@ -53,7 +55,8 @@ typedef struct phnfile_t {
     char mode;         // 'r'
 } PHNFILE;
 
-PHNFILE* openPhonemeFile(const char* filename, char *mode, PHNFILE* pf);
+PHNFILE* openPhonemeBuffer(const char* filename, const void* data, size_t size,
+                           PHNFILE* pf);
 PHNFILE* closePhonemeFile(PHNFILE* pf);
 size_t readPhonemeFile(PHNFILE* pf, size_t cnt, PHNINFO *phninfo);
 
@@ -80,6 +83,219 @@ static int isnumber(float f)
     return 1;
 }
 
+/* Extracts the features of a pair of audio and phoneme files, loaded by
+ * the file loader, and writes them to a feature file in featdir. fn is the
+ * path of the audio file, in a buffer large enough for any path. Returns 1
+ * if successful, 0 if the files are skipped, -1 if processing must stop.
+ */
+static int process_file_pair(char* fn, const LOADEDFILE* wav,
+                             const LOADEDFILE* phn, const char* featdir)
+{
+    const int maxpath = 512;
+    printf("Processing file %s, with %s\n",wav->name,phn->name);
+    fflush(stdout);
+
+    /* Audio file */
+    SPHFILE sfin, *sfp = NULL;
+    if (wav->data != NULL)
+        sfp = openSphereBuffer(fn,wav->data,wav->size,&sfin);
+    if (sfp == NULL) {
+        fprintf(stderr,"Failed to open '%s' for read - skipping\n",fn);
+        return 0;
+    }
+    int sample_rate = sfin.sampleRate;
+    int frame_sample_cnt = ((sample_rate * FRAMETIME) / 1000);
+    size_t winSize = 2 * frame_sample_cnt;
+    float window[winSize];
+    HANNWIN hannWin;
+    int rv = hannWindowInit(&hannWin,winSize);
+    if (rv == -1) {
+        fprintf(stderr,"Failed to initialize hann window for '%s' - skipping\n",fn);
+        closeSphereFile(sfp);    
+        return 0;
+    }
+    float rdBuf[winSize];
+    memset(rdBuf,0,winSize * sizeof(rdBuf[0]));
+    
+    FILTER filter1, filter2, filter3;
+    int rv3 = initFilter(&filter3,4,"h",sample_rate,180);
+    int rv2 = initFilter(&filter2,4,"l",sample_rate,3600);
+    int rv1 = initFilter(&filter1,1,"h",sample_rate,2000);
+    if (rv3 == -1 ||rv2 == -1 || rv1 == -1) {
+        fprintf(stderr,"Failed to initialize filter(s) for '%s' - skipping\n",fn);
+        closeSphereFile(sfp);    
+        return 0;
+    }
+    
+    char *ext = rindex(fn,'.'); /* fn ends with ".WAV" */
+    /* Phoneme file */
+    strcpy(ext,".PHN"); /* Replace previous file name suffix */
+    PHNFILE pfin, *pfp = NULL;
+    if (phn->data != NULL)
+        pfp = openPhonemeBuffer(fn,phn->data,phn->size,&pfin);
+    if (pfp == NULL) {
+        fprintf(stderr,"Failed to open '%s' for read - skipping\n",fn);
+        closeSphereFile(sfp);
+        return 0;
+    }
+
+    /* Load phonemes */
+    phncnt = readPhonemeFile(pfp,PHSIZE,phonemes);
+    if (phncnt < 1) {
+        fprintf(stderr,"Failed to read phonemes from '%s' - skipping\n",fn);
+        closeSphereFile(sfp);    
+        closePhonemeFile(pfp);
+        return 0;
+    }
+    closePhonemeFile(pfp);
+
+    if (phncnt < 3) {
+        fprintf(stderr,"Not enough phonemes in '%s' - skipping\n",fn);
+        closeSphereFile(sfp);
+        return 0;
+    }
+
+    /* Extract features from audio */
+    frmcnt = 0;
+    size_t fsize = winSize / 2;
+    for (;;) {
+        float fltBuf[fsize];
+        
+        size_t fcnt = readSphereAudio(sfp,fltBuf,fsize);
+        if (fcnt <= 0) /* EOF (or error) */
+            break; 
+        if (fcnt < fsize) /* Complete partial frame */
+            memset(fltBuf + fcnt,0,(fsize - fcnt) * sizeof(fltBuf[0]));
+
+        /* Add noise floor */
+        for (size_t i = 0; i < fsize; i++)
+            fltBuf[i] += nrand(0,1) * 0.001;
+
+        /* Shape spectrum */
+        runFiler(&filter3,fltBuf,fltBuf,fsize);
+        runFiler(&filter2,fltBuf,fltBuf,fsize);
+        runFiler(&filter1,fltBuf,fltBuf,fsize);
+
+        double zcr = zeroCrossings(fltBuf,fsize);
+
+        for (int i = 0; i < (int) fsize; i++)
+            rdBuf[fsize + i] = fltBuf[i];
+
+        hannWindow(&hannWin,rdBuf,window,winSize);
+
+        double lpcCoeffs[LPCORDER + 1];
+        double lspCoeffs[LPCORDER + 1];
+        double error = computeLPC(window,winSize,LPCORDER,lpcCoeffs);
+        lpc2lsp(lpcCoeffs,lspCoeffs,LPCORDER);
+        frame_features[frmcnt][0] = zcr;
+        frame_features[frmcnt][1] = sqrt(error);
+        for (int i = 2; i < FRAMEFEATCNT; i++)
+            frame_features[frmcnt][i] = lspCoeffs[i - 2];
+
+        for (int i = 0; i < FRAMEFEATCNT; i++) {
+            if (!isnumber(frame_features[frmcnt][i])) {
+                printf("in %s frame %d feature %d is not a number\n",
+                                                              fn,frmcnt,i);
+                frame_features[frmcnt][i] = 0;
+            }
+        }          
+         
+        frmcnt++;
+        
+        memmove(rdBuf,rdBuf + fsize,fsize * sizeof(rdBuf[0]));
+        memset(rdBuf + fsize,0,fsize * sizeof(rdBuf[0]));
+    }
+    closeSphereFile(sfp);
+
+    /* TIMIT file names start with either TEST or TRAIN.
+     * Skip file path prefix that precedes that, if one exists
+     */
+    char *tfn = strstr(fn,"TRAIN/");
+    if (tfn == NULL)
+        tfn = strstr(fn,"TEST/");
+    if (tfn != NULL)
+        fn = tfn;
+            
+    /* Create an output file path that is the path of the 
+     * input file in the output directory, with FEAT extension.
+     */
+    ext = rindex(fn,'.'); /* fn ends with ".PHN" */
+    *ext = '\0'; /* Remove previous file name suffix */
+    
+    char outfn[3 * maxpath];
+    snprintf(outfn,sizeof(outfn) - 1,"%s/%s.FEAT",featdir,fn);
+    for (int i = strlen(featdir) + 1; i < (int) strlen(outfn); i++)
+        if (outfn[i] == '/')
+            outfn[i] = '_';
+
+    FILE *fp1 = fopen(outfn,"wb");
+    if (fp1 == NULL) {
+        fprintf(stderr,"Failed to open '%s' for write - aborting\n",outfn);
+        return -1;
+    }
+    
+    static char commas[MAX_FEATURES + 1] = { [0 ... MAX_FEATURES-1] = ',', '\0' };
+    fprintf(fp1,"phoneme,label,start,end,file,fsize,nfrm,%s\n",commas);
+
+    for (int phninx = 0; phninx < phncnt; phninx++) {
+        char *phoneme = phonemes[phninx].phoneme;
+        int label = phonemes[phninx].label;
+        int seg_start_sample = (int) phonemes[phninx].startPos;
+        int seg_end_sample = (int) phonemes[phninx].endPos;
+        int seg_start_frame = seg_start_sample / frame_sample_cnt;
+        int seg_end_frame = seg_end_sample / frame_sample_cnt;
+        int fsize = FRAMEFEATCNT;
+        int nfrm = seg_end_frame - seg_start_frame;
+        double (*ff)[FRAMEFEATCNT] = &frame_features[0]; 
+        double one_frame_features[1][FRAMEFEATCNT];
+
+        if (nfrm > MAXSEGMENT) {
+            int midway = (seg_end_frame - seg_start_frame) / 2;
+            seg_start_frame = midway - MAXSEGMENT / 2;
+            seg_end_frame = midway + MAXSEGMENT / 2;
+            nfrm = seg_end_frame - seg_start_frame;
+        }
+        if (nfrm == 0) { /* Segment too short */
+            /* synthesize a frame that is 
+             * an average of previous and this frames
+             */
+            for (int i = 0; i < FRAMEFEATCNT; i++)
+                one_frame_features[0][i] = ff[seg_start_frame][i];
+            if (seg_start_frame > 0) {
+                for (int i = 0; i < FRAMEFEATCNT; i++)
+                    one_frame_features[0][i] += ff[seg_start_frame - 1][i];
+                for (int i = 0; i < FRAMEFEATCNT; i++)
+                    one_frame_features[0][i] /= 2;
+            }
+            ff = &one_frame_features[0];
+            seg_start_frame = 0;
+            seg_end_frame = 1;
+            nfrm = 1;
+        }
+
+        double stime = ((double)seg_start_sample) / ((double)sample_rate);
+        double etime = ((double)seg_end_sample) / ((double)sample_rate);
+        fprintf(fp1,"%s,%2d,%5.3lf,%5.3lf,%s,%2d,%4d,",
+                    phoneme,label,stime,etime,fn,fsize,nfrm);
+
+        for(int i = seg_start_frame; i < seg_end_frame; i++) {
+            fprintf(fp1,"%12.4le,",ff[i][0]); /* zcr */
+            /* normalize sigma */
+            frame_features[i][1] = -log(ff[i][1] + 1e-7) / 30;
+            fprintf(fp1,"%12.4le,",ff[i][1]);
+            for (int j = 2; j < fsize; j++)
+                fprintf(fp1,"%7.4lf,",ff[i][j]);
+            assert(i - seg_start_frame < nfrm);
+        }
+        int nc = MAX_FEATURES - 
+                    (seg_end_frame - seg_start_frame) * fsize;
+        fprintf(fp1,"%*.*s\n",nc,nc,commas);
+        fflush(fp1);
+    }
+    fclose(fp1);
+    return 1;
+}
+
 int main(int argc, char **argv)
 {
     if (argc < 4) {
@@ -107,9 +323,16 @@ int main(int argc, char **argv)
         fprintf(stderr,"Directory name too long: '%s'\n",featdir);
         return 0;
     }
-    init_lrng(42);
-    int fileno;
-    for (fileno = 0;; fileno++) { /* Process one audio, phoneme file pair */
+    /* Read the file list; each line names a pair of audio and phoneme
+     * files. Their paths are names[2 * k] and names[2 * k + 1].
+     */
+    int num_pairs = 0;
+    while (fgets(buffer,maxpath,fp) != NULL)
+        num_pairs++;
+    rewind(fp);
+    char** names = allocmem(2 * num_pairs,1,char*);
+    int pairno;
+    for (pairno = 0; pairno < num_pairs; pairno++) {
         /* Construct file path to the files */
         strcpy(buffer,timitdir);
         int pfxlen = strlen(buffer);
@@ -120,213 +343,50 @@ int main(int argc, char **argv)
         if (fn == NULL || strlen(fn) == 0)
             break;      /* End of file list */
         fn = buffer;    /* fn now points to file path */
-        fn[strlen(fn) - 1] = '\0'; /* Punch out end of line char */
+        fn[strcspn(fn,"\r\n")] = '\0'; /* Punch out end of line char */
         char *ext = rindex(fn,'.');
-        if (ext != NULL)
+        if (ext != NULL && rindex(fn,'/') < ext)
             *ext = '\0'; /* Remove extension if any */
-        printf("Processing file %s.WAV, with %s.PHN\n",fn,fn);
-        fflush(stdout);
-        
-        /* Audio file */
-        strcat(fn,".WAV");
-        SPHFILE sfin, *sfp;
-        sfp = openSphereFile(fn,"r",&sfin);
-        if (sfp == NULL) {
-            fprintf(stderr,"Failed to open '%s' for read - skipping\n",fn);
-            continue;
-        }
-        int sample_rate = sfin.sampleRate;
-        int frame_sample_cnt = ((sample_rate * FRAMETIME) / 1000);
-        size_t winSize = 2 * frame_sample_cnt;
-        float window[winSize];
-        HANNWIN hannWin;
-        int rv = hannWindowInit(&hannWin,winSize);
-        if (rv == -1) {
-            fprintf(stderr,"Failed to initialize hann window for '%s' - skipping\n",fn);
-            closeSphereFile(sfp);    
-            continue;
-        }
-        float rdBuf[winSize];
-        memset(rdBuf,0,winSize * sizeof(rdBuf[0]));
-        
-        FILTER filter1, filter2, filter3;
-        int rv3 = initFilter(&filter3,4,"h",sample_rate,180);
-        int rv2 = initFilter(&filter2,4,"l",sample_rate,3600);
-        int rv1 = initFilter(&filter1,1,"h",sample_rate,2000);
-        if (rv3 == -1 ||rv2 == -1 || rv1 == -1) {
-            fprintf(stderr,"Failed to initialize filter(s) for '%s' - skipping\n",fn);
-            closeSphereFile(sfp);    
-            continue;
-        }
-        
-        ext = rindex(fn,'.'); /* fn ends with ".WAV" */
-        /* Phoneme file */
-        strcpy(ext,".PHN"); /* Replace previous file name suffix */
-        PHNFILE pfin, *pfp;
-        pfp = openPhonemeFile(fn,"r",&pfin);
-        if (pfp == NULL) {
-            fprintf(stderr,"Failed to open '%s' for read - skipping\n",fn);
-            closeSphereFile(sfp);
-            continue;
-        }
-
-        /* Load phonemes */
-        phncnt = readPhonemeFile(pfp,PHSIZE,phonemes);
-        if (phncnt < 1) {
-            fprintf(stderr,"Failed to read phonemes from '%s' - skipping\n",fn);
-            closeSphereFile(sfp);    
-            closePhonemeFile(pfp);
-            continue;
-        }
-        closePhonemeFile(pfp);
-
-        if (phncnt < 3) {
-            fprintf(stderr,"Not enough phonemes in '%s' - skipping\n",fn);
-            continue;
-        }
-
-        /* Extract features from audio */
-        frmcnt = 0;
-        size_t fsize = winSize / 2;
-        for (;;) {
-            float fltBuf[fsize];
-            
-            size_t fcnt = readSphereAudio(sfp,fltBuf,fsize);
-            if (fcnt <= 0) /* EOF (or error) */
-                break; 
-            if (fcnt < fsize) /* Complete partial frame */
-                memset(fltBuf + fcnt,0,(fsize - fcnt) * sizeof(fltBuf[0]));
-
-            /* Add noise floor */
-            for (size_t i = 0; i < fsize; i++)
-                fltBuf[i] += nrand(0,1) * 0.001;
-
-            /* Shape spectrum */
-            runFiler(&filter3,fltBuf,fltBuf,fsize);
-            runFiler(&filter2,fltBuf,fltBuf,fsize);
-            runFiler(&filter1,fltBuf,fltBuf,fsize);
-
-            double zcr = zeroCrossings(fltBuf,fsize);
-
-            for (int i = 0; i < (int) fsize; i++)
-                rdBuf[fsize + i] = fltBuf[i];
-
-            hannWindow(&hannWin,rdBuf,window,winSize);
-
-            double lpcCoeffs[LPCORDER + 1];
-            double lspCoeffs[LPCORDER + 1];
-            double error = computeLPC(window,winSize,LPCORDER,lpcCoeffs);
-            lpc2lsp(lpcCoeffs,lspCoeffs,LPCORDER);
-            frame_features[frmcnt][0] = zcr;
-            frame_features[frmcnt][1] = sqrt(error);
-            for (int i = 2; i < FRAMEFEATCNT; i++)
-                frame_features[frmcnt][i] = lspCoeffs[i - 2];
-
-            for (int i = 0; i < FRAMEFEATCNT; i++) {
-                if (!isnumber(frame_features[frmcnt][i])) {
-                    printf("in %s frame %d feature %d is not a number\n",
-                                                                  fn,frmcnt,i);
-                    frame_features[frmcnt][i] = 0;
-                }
-            }          
-             
-            frmcnt++;
-            
-            memmove(rdBuf,rdBuf + fsize,fsize * sizeof(rdBuf[0]));
-            memset(rdBuf + fsize,0,fsize * sizeof(rdBuf[0]));
-        }
-        closeSphereFile(sfp);
+        int len = strlen(fn) + 5;
+        names[2 * pairno] = allocmem(len,1,char);
+        names[2 * pairno + 1] = allocmem(len,1,char);
+        snprintf(names[2 * pairno],len,"%s.WAV",fn);
+        snprintf(names[2 * pairno + 1],len,"%s.PHN",fn);
+    }
+    num_pairs = pairno;
+    fclose(fp);
 
-        /* TIMIT file names start with either TEST or TRAIN.
-         * Skip file path prefix that precedes that, if one exists
+    /* Files are loaded with many reads in flight, and each pair is
+     * processed as soon as both its files complete, in any order
+     */
+    FILELOAD* fl = fileload_create(NULL,names,2 * num_pairs,0);
+    printf("Loading %d file pairs (%s)\n",num_pairs,fileload_method(fl));
+    LOADEDFILE** loaded = allocmem(2 * num_pairs,1,LOADEDFILE*);
+    int fileno = 0;
+    for (LOADEDFILE* lf; (lf = fileload_next(fl)) != NULL;) {
+        loaded[lf->index] = lf;
+        int k = lf->index / 2;
+        LOADEDFILE* wav = loaded[2 * k];
+        LOADEDFILE* phn = loaded[2 * k + 1];
+        if (wav == NULL || phn == NULL)
+            continue; /* The other file of the pair is still loading */
+        /* Seed the noise per file, so features do not depend on the order
+         * the files complete
          */
-        char *tfn = strstr(fn,"TRAIN/");
-        if (tfn == NULL)
-            tfn = strstr(fn,"TEST/");
-        if (tfn != NULL)
-            fn = tfn;
-                
-        /* Create an output file path that is the path of the 
-         * input file in the output directory, with FEAT extension.
-         */
-        ext = rindex(fn,'.'); /* fn ends with ".PHN" */
-        *ext = '\0'; /* Remove previous file name suffix */
-        
-        char outfn[3 * maxpath];
-        snprintf(outfn,sizeof(outfn) - 1,"%s/%s.FEAT",featdir,fn);
-        for (int i = strlen(featdir) + 1; i < (int) strlen(outfn); i++)
-            if (outfn[i] == '/')
-                outfn[i] = '_';
-
-        FILE *fp1 = fopen(outfn,"wb");
-        if (fp1 == NULL) {
-            fclose(fp);
-            fprintf(stderr,"Failed to open '%s' for write - aborting\n",outfn);
-            return 0;
-        }
-        
-        static char commas[MAX_FEATURES + 1] = { [0 ... MAX_FEATURES-1] = ',', '\0' };
-        fprintf(fp1,"phoneme,label,start,end,file,fsize,nfrm,%s\n",commas);
-
-        for (int phninx = 0; phninx < phncnt; phninx++) {
-            char *phoneme = phonemes[phninx].phoneme;
-            int label = phonemes[phninx].label;
-            int seg_start_sample = (int) phonemes[phninx].startPos;
-            int seg_end_sample = (int) phonemes[phninx].endPos;
-            int seg_start_frame = seg_start_sample / frame_sample_cnt;
-            int seg_end_frame = seg_end_sample / frame_sample_cnt;
-            int fsize = FRAMEFEATCNT;
-            int nfrm = seg_end_frame - seg_start_frame;
-            double (*ff)[FRAMEFEATCNT] = &frame_features[0]; 
-            double one_frame_features[1][FRAMEFEATCNT];
-
-            if (nfrm > MAXSEGMENT) {
-                int midway = (seg_end_frame - seg_start_frame) / 2;
-                seg_start_frame = midway - MAXSEGMENT / 2;
-                seg_end_frame = midway + MAXSEGMENT / 2;
-                nfrm = seg_end_frame - seg_start_frame;
-            }
-            if (nfrm == 0) { /* Segment too short */
-                /* synthesize a frame that is 
-                 * an average of previous and this frames
-                 */
-                for (int i = 0; i < FRAMEFEATCNT; i++)
-                    one_frame_features[0][i] = ff[seg_start_frame][i];
-                if (seg_start_frame > 0) {
-                    for (int i = 0; i < FRAMEFEATCNT; i++)
-                        one_frame_features[0][i] += ff[seg_start_frame - 1][i];
-                    for (int i = 0; i < FRAMEFEATCNT; i++)
-                        one_frame_features[0][i] /= 2;
-                }
-                ff = &one_frame_features[0];
-                seg_start_frame = 0;
-                seg_end_frame = 1;
-                nfrm = 1;
-            }
-
-            double stime = ((double)seg_start_sample) / ((double)sample_rate);
-            double etime = ((double)seg_end_sample) / ((double)sample_rate);
-            fprintf(fp1,"%s,%2d,%5.3lf,%5.3lf,%s,%2d,%4d,",
-                        phoneme,label,stime,etime,fn,fsize,nfrm);
-
-            for(int i = seg_start_frame; i < seg_end_frame; i++) {
-                fprintf(fp1,"%12.4le,",ff[i][0]); /* zcr */
-                /* normalize sigma */
-                frame_features[i][1] = -log(ff[i][1] + 1e-7) / 30;
-                fprintf(fp1,"%12.4le,",ff[i][1]);
-                for (int j = 2; j < fsize; j++)
-                    fprintf(fp1,"%7.4lf,",ff[i][j]);
-                assert(i - seg_start_frame < nfrm);
-            }
-            int nc = MAX_FEATURES - 
-                        (seg_end_frame - seg_start_frame) * fsize;
-            fprintf(fp1,"%*.*s\n",nc,nc,commas);
-            fflush(fp1);
-        }
-        fclose(fp1);
+        init_lrng(42 + k);
+        strcpy(buffer,wav->name);
+        int rv = process_file_pair(buffer,wav,phn,featdir);
+        fileload_release(fl,wav);
+        fileload_release(fl,phn);
+        fileno++;
+        if (rv < 0)
+            break;
     }
-
-    fclose(fp);
+    fileload_free(fl);
+    for (int i = 0; i < 2 * num_pairs; i++)
+        freemem(names[i]);
+    freemem(names);
+    freemem(loaded);
     printf("Processed %d files\n",fileno);
     
     double sum[FRAMEFEATCNT] = {0.0};
@@ -353,22 +413,16 @@ int main(int argc, char **argv)
     printf("\n");
 }
 
-PHNFILE* openPhonemeFile(const char* filename, char *mode, PHNFILE* pf)
+PHNFILE* openPhonemeBuffer(const char* filename, const void* data, size_t size,
+                           PHNFILE* pf)
 {
-    FILE* fileHandle = NULL;   
-    if (*mode != 'r') {
-        fprintf(stderr,"In openPhonemeFile('%s'): invalid mode '%s'; only 'r' supported.\n",filename,mode);
-        return NULL;
-    }
-    //printf("Openning '%s' for read.\n",filename);
-
-    fileHandle = fopen(filename,"rb");
+    FILE* fileHandle = (size > 0) ? fmemopen((void*) data,size,"rb") : NULL;
     if (fileHandle == NULL) {
-        fprintf(stderr,"In openPhonemeFile('%s'): failed to open the file for read.\n",filename);
+        fprintf(stderr,"In openPhonemeBuffer('%s'): failed to open the file contents for read.\n",filename);
         return NULL;
     }
     pf->fileHandle = fileHandle;
-    pf->mode = *mode;   
+    pf->mode = 'r';
     return pf;
 }
 
@@ -0,0 +1,88 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Selects the kernels of a saved model's layers ahead of time, so that
+ * programs that load the model find their decisions in the tuning cache
+ * of this host (see autotune.h).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "autotune.h"
+#include "model.h"
+#include "modelio.h"
+
+const char* usage =
+"Usage: tune [-f] <model file> [batch size ...]\n"
+"  Selects the fastest kernel of each layer of the model, at its own batch\n"
+"  size and at each given batch size, and saves the decisions in the\n"
+"  tuning cache of this host.\n"
+"  -f  Run the kernels again, even of shapes already in the cache\n"
+"  tune -p  Prints the tuning cache of this host\n";
+
+/* Prints the kernel of each dense and attention layer of m */
+static void print_kernels(const MODEL* m)
+{
+    printf("Batch size %d\n",m->batch_size);
+    for (int i = 0; i < m->num_layers; i++) {
+        const LAYER* l = &m->layer[i];
+        switch (l->type) {
+            case 'd': {
+                const DENSE* d = l->dense;
+                printf("  layer %d dense %dx%dx%d: %s\n",i,d->B,d->D,d->S,
+                       autotune_kernel_name(d->kernel));
+            }
+            break;
+            case 't': {
+                const TRANSFORMER* tr = l->transformer;
+                const int rows = (tr->BT < tr->ffn_rows) ? tr->BT
+                                                         : tr->ffn_rows;
+                printf("  layer %d attention %dx%dx%d: %s\n",i,
+                       tr->BT,tr->D,tr->D,autotune_kernel_name(tr->mha->kernel));
+                printf("  layer %d ffn1 %dx%dx%d: %s\n",i,rows,tr->D,tr->Dff,
+                       autotune_kernel_name(tr->ffn1->kernel));
+                printf("  layer %d ffn2 %dx%dx%d: %s\n",i,rows,tr->Dff,tr->D,
+                       autotune_kernel_name(tr->ffn2->kernel));
+            }
+            break;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int force = 0;
+    int a = 1;
+    if (argc == 2 && strcmp(argv[1],"-p") == 0) {
+        autotune_print(stdout);
+        return 0;
+    }
+    if (a < argc && strcmp(argv[a],"-f") == 0) {
+        force = 1;
+        a++;
+    }
+    if (a >= argc) {
+        fprintf(stderr,"%s",usage);
+        return 1;
+    }
+    const char* filename = argv[a++];
+    MODEL* m = load_model(filename);
+    if (m == NULL)
+        return 1;
+    printf("Cpu: %s\nCache: %s\n",autotune_cpu_model(),autotune_cache_file());
+    if (force)
+        model_tune(m,1);
+    print_kernels(m);
+    for (; a < argc; a++) {
+        int batch_size = atoi(argv[a]);
+        if (batch_size < 1) {
+            fprintf(stderr,"Invalid batch size '%s'\n",argv[a]);
+            model_free(m);
+            return 1;
+        }
+        model_set_batch_size(m,batch_size);
+        if (force)
+            model_tune(m,1);
+        print_kernels(m);
+    }
+    model_free(m);
+    return 0;
+}
@@ -23,9 +23,11 @@
 #include "array.h"
 #include "hash.h"
 #include "newsfile.h"
+#include "fileload.h"
 #include "activation.h"
 #include "embedding.h"
 #include "negsample.h"
+#include "embdfile.h"
 
 const char* usage =
 "Usage: word2vec [options]\n"
@@ -43,6 +45,8 @@ const char* usage =
 "  --vocab-size=<n>   Limit vocabulary size\n"
 "  --vocab-coverage=<f> Limit vocabulary coverage (default 0.99)\n"
 "  --print-vocab      Print vocabulary and exit\n"
+"  --format=<fmt>     Output file format: text, bin, or fp16 (default text);\n"
+"                     bin and fp16 files are memory mapped by wordembd\n"
 "  --data-dir         Location of training data (default data/news)\n"
 ;
 
@@ -61,14 +65,14 @@ const char* usage =
  * contexts can include words just outside the current batch.
  */
 static void text2cxt(int* sw, int swc, int start, int B,
-                     fArr2D cxt_, fArr2D labels_, int cs)
+                     iArr2D cxt_, fArr2D labels_, int cs)
 {
-    typedef float (*ArrBC)[cs];
+    typedef int (*ArrBC)[cs];
     typedef float (*ArrB1)[1];
     ArrBC cxt = (ArrBC) cxt_;
     ArrB1 labels = (ArrB1) labels_;
 
-    fltclr(cxt,B * cs);
+    memset(cxt,0,B * cs * sizeof(int));
     fltclr(labels,B);
 
     int m = cs / 2;
@@ -148,6 +152,25 @@ void shuffle_list(char** list, int cnt)
     }
 }
 
+/* Processes file i of the file loader, see process_news_text(), and
+ * releases it. Returns the number of words, 0 if the file failed to load.
+ */
+static int process_loaded_file(FILELOAD* fl, int i,
+                               HASHMAP* hmap, int add_new,
+                               int max_vocab, WRDFRQ* word_freq,
+                               int *file_words, int max_words)
+{
+    LOADEDFILE* f = fileload_get(fl,i);
+    int cnt = 0;
+    if (f->data != NULL)
+        cnt = process_news_text(f->data,f->size,hmap,add_new,max_vocab,
+                                word_freq,file_words,max_words);
+    else
+        fprintf(stderr,"Failed to read '%s' - skipping\n",f->name);
+    fileload_release(fl,f);
+    return cnt;
+}
+
 int main(int argc, char** argv)
 {
     char* data_dir = "data/news/data"; /* Input */
@@ -162,6 +185,7 @@ int main(int argc, char** argv)
     float learning_rate = 0.005;
     float learning_rate_decay = 0.8;
     int print_vocab = 0;
+    int out_format = -1;       /* Text, or EMBD_FLOAT or EMBD_FP16 binary   */
     int max_vocab = 3000000;   /* Set to 3 x expected number of unique words */
     int hash_mem = 10000000;   /* hashmap will increase this value as needed */
     int max_file_words = 1000000; /* Maximum number of words per file        */
@@ -194,6 +218,15 @@ int main(int argc, char** argv)
                 else
                 if (strncmp(optarg,"data-dir=",9) == 0)
                     data_dir = optarg+9;
+                else
+                if (strcmp(optarg,"format=text") == 0)
+                    out_format = -1;
+                else
+                if (strcmp(optarg,"format=bin") == 0)
+                    out_format = EMBD_FLOAT;
+                else
+                if (strcmp(optarg,"format=fp16") == 0)
+                    out_format = EMBD_FP16;
                 else
                     goto opterr;
             break;
@@ -237,11 +270,16 @@ int main(int argc, char** argv)
         fprintf(stderr,"Failed to read data files list from '%s'\n",tr_file);
         return -1;
     }
+    /* Files are read ahead, and processed in order (the vocabulary indices
+     * follow the order words are encountered)
+     */
+    FILELOAD* fl = fileload_create(data_dir,file_list,num_files,0);
     for (int i = 0; i < num_files; i++) {
         tot_file_cnt++;
-        tot_word_cnt += process_news_file(file_list[i],data_dir,
+        tot_word_cnt += process_loaded_file(fl,i,
                                           hmap,1,max_vocab,word_freq,NULL,0);
     }
+    fileload_free(fl);
 
     printf("Dataset: %d files, %d words, ",tot_file_cnt,tot_word_cnt);
     printf("%d unique words\n",hmap->map_used);
@@ -382,9 +420,10 @@ int main(int argc, char** argv)
         float loss = 0;
         file_cnt = 0;
         shuffle_list(file_list,num_files);
+        FILELOAD* fl = fileload_create(data_dir,file_list,num_files,0);
         for (int i = 0; i < num_files; i++) {
             file_cnt++;
-            int fwcnt = process_news_file(file_list[i],data_dir,
+            int fwcnt = process_loaded_file(fl,i,
                               hmap,0,max_vocab,NULL,file_words,max_file_words);
 
             /* Sub sample frequent words by removing some */
@@ -410,7 +449,7 @@ int main(int argc, char** argv)
                 /* Create word contexts, which consist of cxt_size words
                  * that are adjacent to the current word.
                  */
-                float contexts[batch_size][cxt_size];
+                int contexts[batch_size][cxt_size];
                 float labels[batch_size][1];
                 int wcnt = batch_size;
                 if (i + wcnt >= cnt)
@@ -426,7 +465,7 @@ int main(int argc, char** argv)
 
                 if (wcnt < batch_size) {
                     for (int j = wcnt; j < batch_size; j++) {
-                        fltclr(contexts[j],cxt_size);
+                        memset(contexts[j],0,cxt_size * sizeof(int));
                         labels[j][0] = 0;
                     }
                 }
@@ -463,14 +502,22 @@ int main(int argc, char** argv)
                 fflush(stdout);
             }
         }
+        fileload_free(fl);
         printf("\n");
         learning_rate = learning_rate_decay * learning_rate;
     }
 
     printf("\n");
     printf("Saving word embeddings to %s\n",embedding_file);
-    FILE* fp = fopen(embedding_file,"wb");
-    if (fp != NULL) {
+    FILE* fp = NULL;
+    if (out_format >= 0) {
+        if (!embdfile_write(embedding_file,hmap,embedding->Wx,vocab_size,
+                            embedding_dim,out_format,initial_learning_rate,
+                            learning_rate_decay,num_epochs))
+            fprintf(stderr,"Failed to write file '%s'\n",embedding_file);
+    }
+    else
+    if ((fp = fopen(embedding_file,"wb")) != NULL) {
         fprintf(fp,
                 "#,vocab_size,%d,embedding_dim,%d,"
                 "learning_rate,%f,learning_rate_decay,%f,epochs,%d\n",
@@ -8,9 +8,12 @@
 #include "float.h"
 #include "array.h"
 #include "hash.h"
+#include "embdfile.h"
 #include "cossim.h"
 
-const char* usage ="Usage: wordembd -i <word embedding file>\n";
+const char* usage ="Usage: wordembd -i <word embedding file>\n"
+                   "  (a word2vec text file, or a binary file written by\n"
+                   "   word2vec --format=bin or --format=fp16)\n";
 
 /* Value type for evaluation */
 enum { VAL_VEC, VAL_SCALAR, VAL_OP };
@@ -200,10 +203,20 @@ void eval_embd_expr(
            hashmap_inx2str(hmap, best), best_sim);
 }
 
-int main(int argc, char** argv)
+/* Reads a word2vec text embeddings file. Exits if the file cannot be read.
+ *
+ * Parameters:
+ *   embfile       - Name of embeddings file
+ *   vocab_size    - Returns number of embeddings
+ *   embedding_dim - Returns embedding dimensionality
+ *   hmap          - Returns word <=> index hashmap
+ *   embeddings    - Returns vocab_size x embedding_dim array
+ */
+void read_text_embeddings(const char* embfile,
+    int* vocab_size_, int* embedding_dim_, 
+    HASHMAP** hmap_, float** embeddings)
 {
     FILE* fp;
-    char* embfile;
     int vocab_size;
     int embedding_dim;
     float learning_rate;
@@ -211,11 +224,6 @@ int main(int argc, char** argv)
     int epochs;
     int cnt;
 
-    if (argc < 3 || strcmp(argv[1],"-i") != 0 || strlen(argv[2]) == 0) {
-        fprintf(stderr,usage);
-        exit(1);
-    }
-    embfile = argv[2];
     fp = fopen(embfile,"rb");
     if (fp == NULL) {
         fprintf(stderr,"Could not open file '%s' for read\n",embfile);
@@ -280,6 +288,43 @@ int main(int argc, char** argv)
     if (wcnt < vocab_size)
         vocab_size = wcnt;
 
+    *vocab_size_ = vocab_size;
+    *embedding_dim_ = embedding_dim;
+    *hmap_ = hmap;
+    *embeddings = (float*) word_embeddings;
+}
+
+int main(int argc, char** argv)
+{
+    char* embfile;
+    int vocab_size;
+    int embedding_dim;
+
+    if (argc < 3 || strcmp(argv[1],"-i") != 0 || strlen(argv[2]) == 0) {
+        fprintf(stderr,usage);
+        exit(1);
+    }
+    embfile = argv[2];
+
+    /* A binary embedding file is mapped into memory and used as is */
+    EMBDFILE* ef = NULL;
+    HASHMAP* hmap = NULL;
+    float* embeddings = NULL;
+    if (embdfile_check(embfile)) {
+        ef = embdfile_open(embfile);
+        if (ef == NULL)
+            exit(1);
+        vocab_size = ef->V;
+        embedding_dim = ef->E;
+        hmap = &ef->vocab;
+        embeddings = (float*) ef->W;
+    }
+    else
+        read_text_embeddings(embfile,&vocab_size,&embedding_dim,
+                             &hmap,&embeddings);
+    typedef float (*ArrWE)[embedding_dim];
+    ArrWE word_embeddings = (ArrWE) embeddings;
+
     int maxtkn = 256;
     Val tokens[maxtkn];
     int tkninx = 0;
@@ -341,7 +386,11 @@ int main(int argc, char** argv)
         }
     }
 
-    hashmap_free(hmap);
-    freemem(word_embeddings);
+    if (ef != NULL)
+        embdfile_close(ef);
+    else {
+        hashmap_free(hmap);
+        freemem(word_embeddings);
+    }
     return 0;
 }
@@ -94,7 +94,8 @@ int annoy_most_similar(ANNOY* annoy, const fVec query, float search_q,
                                      int* similar, float* similarity, int topn)
 {
     int search_k = annoy->num_trees * topn;
-    COSSIM* sim = allocmem(1,search_k,COSSIM);
+    SCRATCH_MARK mark = scratch_mark();
+    COSSIM* sim = scratchmem(1,search_k,COSSIM);
     annoy->cos_sim_cnt = 0;
     int cnt = 0;
     for (int i = 0; i < annoy->num_trees; i++)
@@ -115,7 +116,7 @@ int annoy_most_similar(ANNOY* annoy, const fVec query, float search_q,
     if (similarity != NULL)
         for (i = 0; i < cnt && i < topn; i++)
             similarity[i] = sim[i].cossim;
-    freemem(sim);
+    scratch_release(mark);
     return i;
 }
 
@@ -313,12 +314,12 @@ static int search_tree(ANNOY* annoy, ANNOY_NODE_IX node_ix,
         }
         return cnt;
     }
-    fVec hpv = allocmem(1,D,float);
+    SCRATCH_MARK mark = scratch_mark();
+    fVec hpv = scratchmem(1,D,float);
     hyperplane(data[node->split[0]],data[node->split[1]],hpv,D);
-    fVec mpv = allocmem(1,D,float);
+    fVec mpv = scratchmem(1,D,float);
     midpoint(data[node->split[0]],data[node->split[1]],mpv,D);
     float query_dist = project(query,mpv,hpv,D);
-    freemem(mpv);
     ANNOY_NODE_IX nearer, farther;
     if (query_dist > 0) {
         nearer = node->right;
@@ -343,7 +344,7 @@ static int search_tree(ANNOY* annoy, ANNOY_NODE_IX node_ix,
         if (fabsf(query_dist) < maxdist * search_q)
             cnt = search_tree(annoy,farther,query,search_q,similar,size,cnt);
     }
-    freemem(hpv);
+    scratch_release(mark);
     return cnt;
 }
 
@@ -1,21 +1,53 @@
 /* Copyright (c) 2023-2024 Gilad Odinak */
 /* Beam search decoder             */
 #include <math.h>
+#include <string.h>
 #include "mem.h"
 #include "float.h"
 #include "array.h"
+#include "tasksched.h"
 #include "beamsrch.h"
 
-struct can_seq_s {
-    int* seq;
-    float score;
-};
+/* Number of candidate scores compared at once with the beam's worst score */
+#define BEAM_LANES 8
 
-static inline int can_seq_cmp(const void* a, const void* b)
+typedef float BEAMVEC __attribute__((vector_size(BEAM_LANES * sizeof(float))));
+typedef int BEAMMASK __attribute__((vector_size(BEAM_LANES * sizeof(int))));
+
+/* Inserts candidate k with score s into the beam, top[B] scores and
+ * inx[B] candidates sorted by increasing score, that holds *cnt candidates.
+ * Candidates are inserted in the order they are generated, so of candidates
+ * with equal scores the first generated is kept.
+ */
+static inline void beam_insert(float* top, int* inx, int B, int* cnt,
+                               float s, int k)
+{
+    int p;
+    if (*cnt < B)
+        p = (*cnt)++;
+    else
+    if (s < top[B - 1])
+        p = B - 1;
+    else
+        return;
+    for (; p > 0 && s < top[p - 1]; p--) {
+        top[p] = top[p - 1];
+        inx[p] = inx[p - 1];
+    }
+    top[p] = s;
+    inx[p] = k;
+}
+
+/* Returns 1 if any of the BEAM_LANES candidate scores in c is less than s */
+static inline int beam_any_less(const float* c, float s)
 {
-    float as = ((const struct can_seq_s*) a)->score;
-    float bs = ((const struct can_seq_s*) b)->score;
-    return (as > bs) - (as < bs);
+    BEAMVEC v;
+    memcpy(&v,c,sizeof(v));
+    BEAMMASK m = v < s;
+    int any = 0;
+    for (int q = 0; q < BEAM_LANES; q++)
+        any |= m[q];
+    return any;
 }
 
 /*  Performs beam search decoding on a set of probabilities over time steps.
@@ -33,7 +65,12 @@ static inline int can_seq_cmp(const void* a, const void* b)
  *                   resulting sequences.
  *
  * Note:
- *   This function allocates heap memoryif (B * C) * ( T + 1) > 65536 bytes.
+ *   Candidate scores, B * C floats, and the classes chosen at each time
+ *   step, T * B integers, are kept in the scratch arena of the calling
+ *   thread (see mem.h).
+ *   Of candidates with equal scores, the first generated is kept.
+ *   If there are fewer than B sequences (C to the power of T is less than
+ *   B), the remaining rows of sequences are zero and their scores infinite.
  *
  * Description:
  *   This function implements beam search decoding. It iteratively builds
@@ -44,12 +81,11 @@ static inline int can_seq_cmp(const void* a, const void* b)
  *   The function first initializes the sequences and scores. At each time
  *   step, it generates candidate sequences by extending the existing 
  *   sequences with each possible symbol.
- *   The candidates are then sorted by their scores, and the top "beam_width"
- *   sequences are selected for the next time step. The process repeats until
- *   all time steps are processed.
- *
- *   Memory is allocated dynamically for storing new sequences if the total
- *   size exceeds a certain threshold.
+ *   The top "beam_width" candidates are then selected for the next time
+ *   step, screening BEAM_LANES candidate scores at a time against the worst
+ *   score kept so far. The process repeats until all time steps are
+ *   processed. Only the candidate each kept sequence extends is recorded at
+ *   each time step, and the sequences are traced back from them at the end.
  */
 
 void beam_search(fArr2D probabilities_,
@@ -59,47 +95,110 @@ void beam_search(fArr2D probabilities_,
     const int B = beam_width;
     typedef float (*fArrTC)[C];
     typedef int (*iArrBT1)[T + 1];
+    typedef int (*iArrTB)[B];
     typedef float (*fVecB);
     fArrTC probabilities = (fArrTC) probabilities_;
     iArrBT1 sequences = (iArrBT1) sequences_;
     fVecB scores = (fVecB) scores_;
 
-    /* Use heap for really large sequences, stack otherwise */
-    int useheap = (B * C) * ( T + 1) > 65536;
-    float ns[(useheap) ? 1 : (B * C)][(useheap) ? 1 : (T + 1)];
-    iArrBT1 new_seqs = (iArrBT1) ((useheap) ? allocmem(B * C,T + 1,float) : ns);
-
-    struct can_seq_s can_seqs[B * C];
+    /* Candidate scores and chosen candidates are in the scratch arena */
+    SCRATCH_MARK mark = scratch_mark();
+    const int ncan = (B * C + BEAM_LANES - 1) / BEAM_LANES * BEAM_LANES;
+    double* nlp = scratchmem(1,C,double);
+    float* can = scratchmem(1,ncan,float);
+    float* top = scratchmem(1,B,float);
+    int* inx = scratchmem(1,B,int);
+    iArrTB chosen = (iArrTB) scratchmem(T,B,int);
 
-    for (int i = 0; i < B; i++)
+    for (int i = 0; i < B; i++) {
         for (int j = 0; j <= T; j++)
             sequences[i][j] = 0;
+        scores[i] = INFINITY;
+    }
     scores[0] = 0.0;
     int num_sequences = 1;
 
     for (int t = 0; t < T; ++t) {
-        int num_can = 0;
-        for (int i = 0; i < num_sequences; i++) {
-            for (int c = 0; c < C; c++) {
-                int* new_seq = new_seqs[num_can];
-                memcpy(new_seq,sequences[i],t * sizeof(int));
-                new_seq[t] = c;
-                float new_score = scores[i] - log(probabilities[t][c]);
+        for (int c = 0; c < C; c++)
+            nlp[c] = -log(probabilities[t][c]);
+        const int num_can = num_sequences * C;
+        for (int i = 0; i < num_sequences; i++)
+            for (int c = 0; c < C; c++)
+                can[i * C + c] = scores[i] + nlp[c];
+        for (int k = num_can; k < ncan; k++)
+            can[k] = INFINITY;
 
-                can_seqs[num_can].seq = new_seq;
-                can_seqs[num_can].score = new_score;
-                num_can++;
-            }
+        int cnt = 0;
+        for (int k = 0; k < num_can; k += BEAM_LANES) {
+            if (cnt == B && !beam_any_less(can + k,top[B - 1]))
+                continue;
+            for (int q = k; q < k + BEAM_LANES && q < num_can; q++)
+                beam_insert(top,inx,B,&cnt,can[q],q);
         }
-
-        qsort(can_seqs,num_can,sizeof(struct can_seq_s),can_seq_cmp);
-
-        for (int i = 0; i < beam_width; i++) {
-            memcpy(sequences[i],can_seqs[i].seq,(t + 1) * sizeof(int));
-            scores[i] = can_seqs[i].score;
+        for (int i = 0; i < cnt; i++) {
+            chosen[t][i] = inx[i];
+            scores[i] = top[i];
         }
-        num_sequences = beam_width;
+        num_sequences = cnt;
     }
-    if (useheap)
-        freemem(new_seqs);
+
+    /* Trace back the sequences from their last candidates */
+    if (T > 0)
+        for (int i = 0; i < num_sequences; i++)
+            for (int t = T - 1, k = chosen[T - 1][i]; t >= 0; t--) {
+                sequences[i][t] = k % C;
+                if (t > 0)
+                    k = chosen[t - 1][k / C];
+            }
+    scratch_release(mark);
+}
+
+typedef struct beam_batch_s {
+    const fArr2D* probabilities;
+    const int* T;
+    int C;
+    int beam_width;
+    const iArr2D* sequences;
+    const fVec* scores;
+} BEAM_BATCH;
+
+static void beam_search_range(void* arg, int lo, int hi)
+{
+    const BEAM_BATCH* a = arg;
+    for (int n = lo; n < hi; n++)
+        beam_search(a->probabilities[n],a->T[n],a->C,a->beam_width,
+                    a->sequences[n],a->scores[n]);
+}
+
+/*  Performs beam search decoding on the probabilities of N sequences.
+ *
+ * Parameters:
+ *   N             - The number of sequences.
+ *   probabilities - An array [N] of 2D arrays [T[n]][C] of probabilities.
+ *   T             - An array [N] of the numbers of time steps.
+ *   C             - The number of classes (symbols) at each time step.
+ *   beam_width    - The beam width, i.e., the number of sequences to keep
+ *                   at each step.
+ *   sequences     - An array [N] of 2D arrays [B][T[n]+1] to store the
+ *                   resulting sequences, where B is the beam width.
+ *   scores        - An array [N] of 1D arrays [B] to store the scores of
+ *                   the resulting sequences.
+ *   parallel      - If not zero, sequences are decoded in parallel by the
+ *                   default scheduler (see tasksched.h).
+ *
+ * Note:
+ *   The results are those of beam_search() called for each sequence.
+ *   Each thread decodes its sequences one after the other, in the same
+ *   candidate buffers of its scratch arena.
+ */
+void beam_search_batch(int N, const fArr2D* probabilities,
+                       const int* T, int C, int beam_width,
+                       const iArr2D* sequences, const fVec* scores,
+                       int parallel)
+{
+    BEAM_BATCH a = { probabilities, T, C, beam_width, sequences, scores };
+    if (parallel && N > 1)
+        parallel_for(sched_default(),0,N,1,beam_search_range,&a);
+    else
+        beam_search_range(&a,0,N);
 }
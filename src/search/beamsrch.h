@@ -2,6 +2,7 @@
 /* Beam search decoder             */
 #ifndef BEAMSRCH_H
 #define BEAMSRCH_H
+#include "array.h"
 
 /*  Performs beam search decoding on a set of probabilities over time steps.
  *
@@ -18,10 +19,39 @@
  *                   resulting sequences.
  *
  * Note:
- *   This function allocates heap memoryif (B * C) * ( T + 1) > 65536 bytes.
+ *   Candidate scores, B * C floats, and the classes chosen at each time
+ *   step, T * B integers, are kept in the scratch arena of the calling
+ *   thread (see mem.h).
+ *   Of candidates with equal scores, the first generated is kept.
+ *   If there are fewer than B sequences (C to the power of T is less than
+ *   B), the remaining rows of sequences are zero and their scores infinite.
  */
 void beam_search(fArr2D probabilities, 
                  int T, int C, int beam_width, 
                  iArr2D sequences, fVec scores);
 
+/*  Performs beam search decoding on the probabilities of N sequences.
+ *
+ * Parameters:
+ *   N             - The number of sequences.
+ *   probabilities - An array [N] of 2D arrays [T[n]][C] of probabilities.
+ *   T             - An array [N] of the numbers of time steps.
+ *   C             - The number of classes (symbols) at each time step.
+ *   beam_width    - The beam width, i.e., the number of sequences to keep
+ *                   at each step.
+ *   sequences     - An array [N] of 2D arrays [B][T[n]+1] to store the
+ *                   resulting sequences, where B is the beam width.
+ *   scores        - An array [N] of 1D arrays [B] to store the scores of
+ *                   the resulting sequences.
+ *   parallel      - If not zero, sequences are decoded in parallel by the
+ *                   default scheduler (see tasksched.h).
+ *
+ * Note:
+ *   The results are those of beam_search() called for each sequence.
+ */
+void beam_search_batch(int N, const fArr2D* probabilities,
+                       const int* T, int C, int beam_width,
+                       const iArr2D* sequences, const fVec* scores,
+                       int parallel);
+
 #endif
@@ -0,0 +1,765 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Work stealing task scheduler */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include "mem.h"
+#include "float.h"
+#include "numatopo.h"
+#include "trace.h"
+#include "tasksched.h"
+
+#define DEQUE_INITIAL_SIZE  256 /* Initial deque capacity (power of 2)    */
+#define SPLIT_THRESHOLD       2 /* Split ranges while deque holds fewer   */
+#define SPIN_COUNT           64 /* Failed steal rounds before sleeping    */
+
+typedef struct task_s TASK;
+struct task_s {
+    TASKGROUP* g;               /* Group of the task                      */
+    void (*fn)(void* arg);      /* Task function, or NULL for a range     */
+    void* arg;                  /* Argument of fn or body                 */
+    void (*body)(void* arg, int lo, int hi); /* Range function            */
+    int lo, hi;                 /* Range                                  */
+    int grain;                  /* Minimum range size                     */
+};
+
+/* Circular array of a deque; arrays replaced by a larger one are kept
+ * until the deque is freed, since thieves may still be reading them.
+ */
+typedef struct dqarray_s DQARRAY;
+struct dqarray_s {
+    long size;                  /* Capacity, a power of 2                 */
+    DQARRAY* prev;              /* Previous (smaller) array               */
+    _Atomic(TASK*) buf[];
+};
+
+/* Chase-Lev deque. See "Correct and Efficient Work-Stealing for Weak
+ * Memory Models", Le, Pop, Cohen and Zappa Nardelli, PPoPP 2013.
+ */
+typedef struct {
+    atomic_long top;            /* Next task to steal                     */
+    atomic_long bottom;         /* Next free slot of the owner            */
+    _Atomic(DQARRAY*) array;
+} DEQUE;
+
+typedef struct {
+    SCHED* s;
+    int id;                     /* 1 to num_threads                       */
+    int cpu;                    /* Cpu the thread is pinned to, or -1     */
+    int node;                   /* Node of the thread's topology slot     */
+    unsigned rng;               /* Victim selection random state          */
+    pthread_t thread;
+    _Atomic(TASK*) mail;        /* Task that only this worker may run     */
+    DEQUE dq;
+} WORKER;
+
+struct sched_s {
+    int num_workers;            /* Number of worker threads               */
+    int num_nodes;              /* Number of nodes of the topology        */
+    int simulated;              /* 1 if the topology is simulated         */
+    WORKER* workers;
+    pthread_mutex_t lock;       /* Protects the injection queue, sleep    */
+    pthread_cond_t wake;        /* Signaled when work is available        */
+    TASK** inj;                 /* Tasks spawned by non-worker threads    */
+    int inj_size;               /* Capacity of inj                        */
+    int inj_head;               /* Index of first task in inj             */
+    int inj_cnt;                /* Number of tasks in inj                 */
+    atomic_int inj_avail;       /* inj_cnt, read without the lock         */
+    atomic_int sleepers;        /* Number of workers waiting for work     */
+    atomic_uint epoch;          /* Incremented when work becomes ready    */
+    atomic_int stop;            /* Set to stop the workers                */
+};
+
+static __thread WORKER* current_worker = NULL;
+
+static DQARRAY* dqarray_create(long size)
+{
+    DQARRAY* a = allocmem(1,sizeof(DQARRAY) + size * sizeof(TASK*),char);
+    a->size = size;
+    return a;
+}
+
+static void deque_init(DEQUE* d)
+{
+    atomic_init(&d->top,0);
+    atomic_init(&d->bottom,0);
+    atomic_init(&d->array,dqarray_create(DEQUE_INITIAL_SIZE));
+}
+
+static void deque_free(DEQUE* d)
+{
+    DQARRAY* a = atomic_load(&d->array);
+    while (a != NULL) {
+        DQARRAY* prev = a->prev;
+        freemem(a);
+        a = prev;
+    }
+}
+
+/* Returns the (approximate) number of tasks in the deque */
+static inline long deque_size(DEQUE* d)
+{
+    long b = atomic_load_explicit(&d->bottom,memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top,memory_order_relaxed);
+    return (b > t) ? b - t : 0;
+}
+
+/* Pushes a task at the bottom; called by the owner only */
+static void deque_push(DEQUE* d, TASK* x)
+{
+    long b = atomic_load_explicit(&d->bottom,memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top,memory_order_acquire);
+    DQARRAY* a = atomic_load_explicit(&d->array,memory_order_relaxed);
+    if (b - t > a->size - 1) { /* Full, double the capacity */
+        DQARRAY* na = dqarray_create(a->size * 2);
+        for (long i = t; i < b; i++)
+            atomic_store_explicit(&na->buf[i & (na->size - 1)],
+                atomic_load_explicit(&a->buf[i & (a->size - 1)],
+                                     memory_order_relaxed),
+                memory_order_relaxed);
+        na->prev = a;
+        atomic_store_explicit(&d->array,na,memory_order_release);
+        a = na;
+    }
+    atomic_store_explicit(&a->buf[b & (a->size - 1)],x,memory_order_release);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom,b + 1,memory_order_relaxed);
+}
+
+/* Pops a task from the bottom; called by the owner only. Returns NULL if
+ * the deque is empty.
+ */
+static TASK* deque_pop(DEQUE* d)
+{
+    long b = atomic_load_explicit(&d->bottom,memory_order_relaxed) - 1;
+    DQARRAY* a = atomic_load_explicit(&d->array,memory_order_relaxed);
+    atomic_store_explicit(&d->bottom,b,memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top,memory_order_relaxed);
+    TASK* x = NULL;
+    if (t <= b) {
+        x = atomic_load_explicit(&a->buf[b & (a->size - 1)],
+                                 memory_order_relaxed);
+        if (t == b) { /* Last task, race against thieves */
+            if (!atomic_compare_exchange_strong_explicit(&d->top,&t,t + 1,
+                            memory_order_seq_cst,memory_order_relaxed))
+                x = NULL;
+            atomic_store_explicit(&d->bottom,b + 1,memory_order_relaxed);
+        }
+    }
+    else
+        atomic_store_explicit(&d->bottom,b + 1,memory_order_relaxed);
+    return x;
+}
+
+/* Steals a task from the top; called by any thread. Returns NULL if the
+ * deque is empty or another thread won the race.
+ */
+static TASK* deque_steal(DEQUE* d)
+{
+    long t = atomic_load_explicit(&d->top,memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom,memory_order_acquire);
+    if (t >= b)
+        return NULL;
+    DQARRAY* a = atomic_load_explicit(&d->array,memory_order_acquire);
+    TASK* x = atomic_load_explicit(&a->buf[t & (a->size - 1)],
+                                   memory_order_acquire);
+    if (!atomic_compare_exchange_strong_explicit(&d->top,&t,t + 1,
+                            memory_order_seq_cst,memory_order_relaxed))
+        return NULL;
+    return x;
+}
+
+/* Wakes sleeping workers after work was made available */
+static void sched_notify(SCHED* s)
+{
+    atomic_fetch_add(&s->epoch,1);
+    if (atomic_load(&s->sleepers) > 0) {
+        pthread_mutex_lock(&s->lock);
+        pthread_cond_broadcast(&s->wake);
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+/* Queues a task spawned by a thread that is not a worker of s */
+static void inject(SCHED* s, TASK* t)
+{
+    pthread_mutex_lock(&s->lock);
+    if (s->inj_cnt == s->inj_size) {
+        int size = (s->inj_size > 0) ? s->inj_size * 2 : 64;
+        TASK** inj = allocmem(1,size,TASK*);
+        for (int i = 0; i < s->inj_cnt; i++)
+            inj[i] = s->inj[(s->inj_head + i) % s->inj_size];
+        freemem(s->inj);
+        s->inj = inj;
+        s->inj_size = size;
+        s->inj_head = 0;
+    }
+    s->inj[(s->inj_head + s->inj_cnt) % s->inj_size] = t;
+    s->inj_cnt++;
+    atomic_store(&s->inj_avail,s->inj_cnt);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* Removes a task from the injection queue; returns NULL if empty */
+static TASK* take_injected(SCHED* s)
+{
+    if (atomic_load(&s->inj_avail) == 0)
+        return NULL;
+    TASK* t = NULL;
+    pthread_mutex_lock(&s->lock);
+    if (s->inj_cnt > 0) {
+        t = s->inj[s->inj_head];
+        s->inj_head = (s->inj_head + 1) % s->inj_size;
+        s->inj_cnt--;
+        atomic_store(&s->inj_avail,s->inj_cnt);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return t;
+}
+
+/* Makes a task available to run */
+static void submit(SCHED* s, TASK* t)
+{
+    WORKER* w = current_worker;
+    if (w != NULL && w->s == s)
+        deque_push(&w->dq,t);
+    else
+        inject(s,t);
+    sched_notify(s);
+}
+
+/* Finds a task to run: own deque first, then injected tasks, then other
+ * workers' deques, starting at a random victim.
+ */
+static TASK* find_task(SCHED* s, WORKER* w)
+{
+    TASK* t = NULL;
+    if (w != NULL && w->s == s) {
+        if (atomic_load_explicit(&w->mail,memory_order_relaxed) != NULL)
+            t = atomic_exchange(&w->mail,NULL);
+        if (t == NULL)
+            t = deque_pop(&w->dq);
+    }
+    if (t == NULL)
+        t = take_injected(s);
+    int n = s->num_workers;
+    if (t == NULL && n > 0) {
+        unsigned r;
+        if (w != NULL) {
+            w->rng ^= w->rng << 13; /* xorshift */
+            w->rng ^= w->rng >> 17;
+            w->rng ^= w->rng << 5;
+            r = w->rng;
+        }
+        else
+            r = (unsigned) (uintptr_t) &r >> 4;
+        for (int k = 0; k < n && t == NULL; k++) {
+            WORKER* v = &s->workers[(r + k) % n];
+            if (v != w)
+                t = deque_steal(&v->dq);
+        }
+    }
+    return t;
+}
+
+/* Runs the range of a parallel_for() task, splitting it while the
+ * thread's own deque is nearly empty.
+ */
+static void run_range(TASK* t)
+{
+    SCHED* s = t->g->s;
+    WORKER* w = current_worker;
+    int own = (w != NULL && w->s == s);
+    int lo = t->lo;
+    int hi = t->hi;
+    while (lo < hi) {
+        if (hi - lo >= 2 * t->grain && s->num_workers > 0 &&
+            (!own || deque_size(&w->dq) < SPLIT_THRESHOLD)) {
+            int mid = lo + (hi - lo) / 2;
+            TASK* r = allocmem(1,1,TASK);
+            *r = *t;
+            r->lo = mid;
+            r->hi = hi;
+            atomic_fetch_add(&t->g->pending,1);
+            submit(s,r);
+            hi = mid;
+            if (!own) /* Not a worker; split all the way down */
+                continue;
+        }
+        int n = (hi - lo < t->grain) ? hi - lo : t->grain;
+        t->body(t->arg,lo,lo + n);
+        lo += n;
+    }
+}
+
+/* Runs a task and frees it */
+static void run_task(TASK* t)
+{
+    TASKGROUP* g = t->g;
+    if (t->fn != NULL)
+        t->fn(t->arg);
+    else
+        run_range(t);
+    freemem(t);
+    atomic_fetch_sub_explicit(&g->pending,1,memory_order_release);
+}
+
+static void* worker_main(void* arg)
+{
+    WORKER* w = (WORKER*) arg;
+    SCHED* s = w->s;
+    current_worker = w;
+    if (trace_on) {
+        char name[32];
+        snprintf(name,sizeof(name),"worker %d",w->id);
+        trace_thread_name(name);
+    }
+    int idle = 0;
+    while (!atomic_load(&s->stop)) {
+        TASK* t = find_task(s,w);
+        if (t != NULL) {
+            run_task(t);
+            idle = 0;
+            continue;
+        }
+        if (++idle < SPIN_COUNT) {
+            sched_yield();
+            continue;
+        }
+        /* Sleep until work is made available */
+        pthread_mutex_lock(&s->lock);
+        atomic_fetch_add(&s->sleepers,1);
+        unsigned e = atomic_load(&s->epoch);
+        int avail = atomic_load(&s->inj_avail) > 0 ||
+                    atomic_load(&w->mail) != NULL;
+        for (int k = 0; k < s->num_workers && !avail; k++)
+            avail = deque_size(&s->workers[k].dq) > 0;
+        while (!avail && e == atomic_load(&s->epoch) && !atomic_load(&s->stop))
+            pthread_cond_wait(&s->wake,&s->lock);
+        atomic_fetch_sub(&s->sleepers,1);
+        pthread_mutex_unlock(&s->lock);
+        idle = 0;
+    }
+    current_worker = NULL;
+    return NULL;
+}
+
+/* Creates a scheduler with exactly num_threads worker threads. Worker i
+ * is placed on topology slot i; slot 0 is left for the calling thread.
+ * Workers are pinned to their slots' cpus unless there are more threads
+ * than cpus, or the environment variable MLINC_PIN is 0.
+ */
+static SCHED* sched_new(int num_threads)
+{
+    if (num_threads < 0)
+        num_threads = 0;
+    const NUMATOPO* topo = numatopo_get();
+    const char* env = getenv("MLINC_PIN");
+    int pin = (num_threads < topo->num_cpus) &&
+              (env == NULL || atoi(env) != 0);
+    SCHED* s = allocmem(1,1,SCHED);
+    s->num_workers = num_threads;
+    s->num_nodes = topo->num_nodes;
+    s->simulated = topo->simulated;
+    s->workers = allocmem(1,(num_threads > 0) ? num_threads : 1,WORKER);
+    pthread_mutex_init(&s->lock,NULL);
+    pthread_cond_init(&s->wake,NULL);
+    atomic_init(&s->inj_avail,0);
+    atomic_init(&s->sleepers,0);
+    atomic_init(&s->epoch,0);
+    atomic_init(&s->stop,0);
+    for (int i = 0; i < num_threads; i++) {
+        WORKER* w = &s->workers[i];
+        w->s = s;
+        w->id = i + 1;
+        w->rng = 2463534242u * (i + 1);
+        w->node = topo->node[(i + 1) % topo->num_cpus];
+        w->cpu = (pin) ? topo->cpu[i + 1] : -1;
+        atomic_init(&w->mail,NULL);
+        deque_init(&w->dq);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        WORKER* w = &s->workers[i];
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (w->cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(w->cpu,&set);
+            pthread_attr_setaffinity_np(&attr,sizeof(set),&set);
+        }
+        int err = pthread_create(&w->thread,&attr,worker_main,w);
+        if (err != 0 && w->cpu >= 0) { /* Cpu not allowed; do not pin */
+            w->cpu = -1;
+            err = pthread_create(&w->thread,NULL,worker_main,w);
+        }
+        pthread_attr_destroy(&attr);
+        if (err != 0) {
+            fflush(stdout);
+            fprintf(stderr,"sched_create: failed to create thread %d\n",i);
+            exit(-1);
+        }
+    }
+    return s;
+}
+
+/* Creates a scheduler.
+ *
+ * Parameters:
+ *   num_threads - Number of worker threads; if 0 or less, one less than
+ *                 the number of cpus of the topology (the thread that
+ *                 waits for a task group runs tasks too)
+ *
+ * Returns:
+ *   A pointer to the scheduler.
+ *
+ * Notes:
+ *   Worker threads are pinned to cpus in node order, see numatopo.h,
+ *   unless there are more threads than cpus or the environment variable
+ *   MLINC_PIN is 0.
+ */
+SCHED* sched_create(int num_threads)
+{
+    if (num_threads <= 0)
+        num_threads = numatopo_get()->num_cpus - 1;
+    return sched_new(num_threads);
+}
+
+/* Stops the worker threads and frees the memory allocated by
+ * sched_create(). There must be no pending tasks.
+ */
+void sched_free(SCHED* s)
+{
+    if (s == NULL)
+        return;
+    pthread_mutex_lock(&s->lock);
+    atomic_store(&s->stop,1);
+    pthread_cond_broadcast(&s->wake);
+    pthread_mutex_unlock(&s->lock);
+    for (int i = 0; i < s->num_workers; i++)
+        pthread_join(s->workers[i].thread,NULL);
+    for (int i = 0; i < s->num_workers; i++)
+        deque_free(&s->workers[i].dq);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->wake);
+    freemem(s->inj);
+    freemem(s->workers);
+    freemem(s);
+}
+
+static SCHED* default_sched = NULL;
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+
+static void create_default(void)
+{
+    const char* env = getenv("MLINC_THREADS");
+    if (env != NULL && atoi(env) > 0)
+        default_sched = sched_new(atoi(env) - 1);
+    else
+        default_sched = sched_create(0);
+}
+
+/* Returns the scheduler shared by the library. It is created on first use
+ * with the number of threads specified by the environment variable
+ * MLINC_THREADS, less one, or with sched_create(0) if it is not set.
+ */
+SCHED* sched_default(void)
+{
+    pthread_once(&default_once,create_default);
+    return default_sched;
+}
+
+/* Returns the number of threads that run tasks: the worker threads and
+ * the waiting thread.
+ */
+int sched_num_threads(const SCHED* s)
+{
+    return s->num_workers + 1;
+}
+
+/* Returns the index of the calling thread: 1 to num_threads for worker
+ * threads of a scheduler, 0 for any other thread.
+ */
+int sched_thread_id(void)
+{
+    return (current_worker != NULL) ? current_worker->id : 0;
+}
+
+/* Returns the node of the calling thread: the node of its topology slot
+ * for worker threads of a scheduler, 0 for any other thread.
+ */
+int sched_thread_node(void)
+{
+    return (current_worker != NULL) ? current_worker->node : 0;
+}
+
+/* Initializes a task group of scheduler s (sched_default() if NULL) */
+void taskgroup_init(TASKGROUP* g, SCHED* s)
+{
+    g->s = (s != NULL) ? s : sched_default();
+    atomic_init(&g->pending,0);
+}
+
+/* Spawns a task that calls fn(arg), in task group g. The task may run on
+ * any thread, before or after taskgroup_spawn() returns.
+ */
+void taskgroup_spawn(TASKGROUP* g, void (*fn)(void* arg), void* arg)
+{
+    TASK* t = allocmem(1,1,TASK);
+    t->g = g;
+    t->fn = fn;
+    t->arg = arg;
+    atomic_fetch_add(&g->pending,1);
+    submit(g->s,t);
+}
+
+/* Waits until all the tasks spawned in task group g are done, running
+ * tasks in the meantime.
+ */
+void taskgroup_wait(TASKGROUP* g)
+{
+    SCHED* s = g->s;
+    WORKER* w = current_worker;
+    int idle = 0;
+    while (atomic_load_explicit(&g->pending,memory_order_acquire) > 0) {
+        TASK* t = find_task(s,w);
+        if (t != NULL) {
+            run_task(t);
+            idle = 0;
+        }
+        else
+        if (++idle < SPIN_COUNT)
+            sched_yield();
+        else { /* The remaining tasks are running; back off */
+            struct timespec ts = { 0, 20000 };
+            nanosleep(&ts,NULL);
+        }
+    }
+}
+
+/* Calls body(arg,lo,hi) for consecutive ranges [lo,hi) that together
+ * cover [begin,end), in parallel, and waits until all calls return.
+ *
+ * Parameters:
+ *   s     - Scheduler; if NULL, sched_default()
+ *   begin - First index
+ *   end   - One past the last index
+ *   grain - Minimum range size; if 0 or less, chosen automatically
+ *   body  - Function that processes a range of indices
+ *   arg   - Argument passed to body
+ */
+void parallel_for(SCHED* s, int begin, int end, int grain,
+                  void (*body)(void* arg, int lo, int hi), void* arg)
+{
+    if (end <= begin)
+        return;
+    if (s == NULL)
+        s = sched_default();
+    int n = end - begin;
+    if (grain <= 0) /* Enough ranges to balance, few enough to be cheap */
+        grain = n / (64 * sched_num_threads(s));
+    if (grain < 1)
+        grain = 1;
+    if (s->num_workers == 0 || n < 2 * grain) {
+        body(arg,begin,end);
+        return;
+    }
+    TASKGROUP g;
+    taskgroup_init(&g,s);
+    TASK t = { .g = &g, .fn = NULL, .arg = arg, .body = body,
+               .lo = begin, .hi = end, .grain = grain };
+    /* Run the range here, leaving parts of it for other threads */
+    run_range(&t);
+    taskgroup_wait(&g);
+}
+
+typedef struct {
+    void (*fn)(void* arg, int id);
+    void* arg;
+} ONALL;
+
+static void on_all_task(void* arg)
+{
+    ONALL* oa = (ONALL*) arg;
+    oa->fn(oa->arg,sched_thread_id());
+}
+
+/* Calls fn(arg,id) once on each worker thread of scheduler s, with the
+ * worker's id, and on the calling thread with id 0 if it is not a worker
+ * of s, and waits until all calls return.
+ *
+ * Parameters:
+ *   s   - Scheduler; if NULL, sched_default()
+ *   fn  - Function to call
+ *   arg - Argument passed to fn
+ */
+void sched_run_on_all(SCHED* s, void (*fn)(void* arg, int id), void* arg)
+{
+    if (s == NULL)
+        s = sched_default();
+    ONALL oa = { fn, arg };
+    TASKGROUP g;
+    taskgroup_init(&g,s);
+    for (int i = 0; i < s->num_workers; i++) {
+        TASK* t = allocmem(1,1,TASK);
+        t->g = &g;
+        t->fn = on_all_task;
+        t->arg = &oa;
+        atomic_fetch_add(&g.pending,1);
+        TASK* none = NULL; /* Wait for a concurrent call's task to be taken */
+        while (!atomic_compare_exchange_weak(&s->workers[i].mail,&none,t)) {
+            none = NULL;
+            sched_yield();
+        }
+    }
+    sched_notify(s);
+    if (current_worker == NULL || current_worker->s != s)
+        fn(arg,0);
+    taskgroup_wait(&g);
+}
+
+typedef struct {
+    void** p;
+    long size;
+} LOCALARG;
+
+static void alloc_local_task(void* arg, int id)
+{
+    LOCALARG* a = (LOCALARG*) arg;
+    a->p[id] = allocmem(1,a->size,char);
+    /* Touch the pages here, so they are placed on this thread's node */
+    memset(a->p[id],0,a->size);
+}
+
+/* Allocates a zeroed memory block for each thread of scheduler s, placed
+ * on the thread's node.
+ *
+ * Parameters:
+ *   s    - Scheduler; if NULL, sched_default()
+ *   size - Size of each block, in bytes
+ *
+ * Returns:
+ *   An array of sched_num_threads(s) pointers, indexed by sched_thread_id().
+ *
+ * Notes:
+ *   Each block is allocated and first touched by the thread that owns it.
+ *   Use sched_free_local() to free the blocks.
+ */
+void** sched_alloc_local(SCHED* s, long size)
+{
+    if (s == NULL)
+        s = sched_default();
+    LOCALARG a = { allocmem(1,s->num_workers + 1,void*), size };
+    sched_run_on_all(s,alloc_local_task,&a);
+    if (a.p[0] == NULL) /* Called by a worker */
+        alloc_local_task(&a,0);
+    return a.p;
+}
+
+/* Frees the memory allocated by sched_alloc_local() */
+void sched_free_local(SCHED* s, void** p)
+{
+    if (p == NULL)
+        return;
+    if (s == NULL)
+        s = sched_default();
+    for (int i = 0; i <= s->num_workers; i++)
+        freemem(p[i]);
+    freemem(p);
+}
+
+typedef struct {
+    REPLICA* r;
+    long n;
+    atomic_int* claimed;
+} REPARG;
+
+static void replicate_task(void* arg, int id)
+{
+    (void) id;
+    REPARG* a = (REPARG*) arg;
+    int node = sched_thread_node();
+    if (!atomic_exchange(&a->claimed[node],1)) {
+        float* w = allocmem(1,a->n,float);
+        fltcpy(w,a->r->w,a->n);
+        a->r->node_w[node] = w;
+    }
+}
+
+/* Replicates read only data, such as the weights of a model used for
+ * inference, on each node that has threads of scheduler s.
+ *
+ * Parameters:
+ *   s - Scheduler; if NULL, sched_default()
+ *   w - Data to replicate
+ *   n - Number of elements of w
+ *
+ * Returns:
+ *   A pointer to the replicas. Use replica_local() to get the replica of
+ *   the calling thread's node.
+ *
+ * Notes:
+ *   Each replica is copied by a thread of its node, so its pages are
+ *   placed there. w must not be changed or freed while the replicas are
+ *   used; replica_local() returns w for a node without a replica.
+ */
+REPLICA* sched_replicate(SCHED* s, const float* w, long n)
+{
+    if (s == NULL)
+        s = sched_default();
+    REPLICA* r = allocmem(1,1,REPLICA);
+    r->num_nodes = s->num_nodes;
+    r->w = w;
+    r->node_w = allocmem(1,s->num_nodes,float*);
+    REPARG a = { r, n, allocmem(1,s->num_nodes,atomic_int) };
+    sched_run_on_all(s,replicate_task,&a);
+    freemem(a.claimed);
+    return r;
+}
+
+/* Returns the replica of the calling thread's node */
+const float* replica_local(const REPLICA* r)
+{
+    int node = sched_thread_node();
+    if (node < r->num_nodes && r->node_w[node] != NULL)
+        return r->node_w[node];
+    return r->w;
+}
+
+/* Frees the memory allocated by sched_replicate() */
+void replica_free(REPLICA* r)
+{
+    if (r == NULL)
+        return;
+    for (int i = 0; i < r->num_nodes; i++)
+        freemem(r->node_w[i]);
+    freemem(r->node_w);
+    freemem(r);
+}
+
+/* Prints the topology, and the placement of the threads of scheduler s,
+ * to f.
+ */
+void sched_report(const SCHED* s, FILE* f)
+{
+    numatopo_print(f);
+    fprintf(f,"Placement: %d thread%s\n",s->num_workers + 1,
+            (s->num_workers == 0) ? "" : "s");
+    fprintf(f,"  thread 0: calling thread, node 0\n");
+    for (int i = 0; i < s->num_workers; i++) {
+        const WORKER* w = &s->workers[i];
+        if (w->cpu >= 0)
+            fprintf(f,"  thread %d: cpu %d, node %d\n",w->id,w->cpu,w->node);
+        else
+            fprintf(f,"  thread %d: not pinned, node %d\n",w->id,w->node);
+    }
+}
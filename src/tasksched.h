@@ -0,0 +1,178 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Work stealing task scheduler */
+#ifndef TASKSCHED_H
+#define TASKSCHED_H
+#include <stdio.h>
+#include <stdatomic.h>
+#include "float.h"
+
+/* The scheduler runs tasks on a pool of worker threads. Each worker has
+ * its own double ended queue of tasks (Chase-Lev deque): it pushes and
+ * pops tasks at the bottom, and idle workers steal tasks from the top of
+ * other workers' queues. Tasks of uneven sizes are thus balanced without
+ * static partitioning.
+ *
+ * Tasks are spawned into a task group, and taskgroup_wait() waits until
+ * all the tasks of a group are done. A thread that waits for a group runs
+ * tasks while it waits, so tasks may spawn and wait for nested tasks, and
+ * threads that are not workers of the scheduler, such as the program's
+ * main thread, take part in running the tasks they wait for.
+ *
+ * Worker threads are pinned to cpus in NUMA node order (see numatopo.h),
+ * and memory that a thread uses often can be allocated on its node with
+ * sched_alloc_local(), and read only data replicated per node with
+ * sched_replicate().
+ */
+typedef struct sched_s SCHED;
+
+/* A group of tasks that can be waited for */
+typedef struct taskgroup_s {
+    SCHED* s;               /* Scheduler that runs the tasks            */
+    atomic_long pending;    /* Number of tasks not yet done             */
+} TASKGROUP;
+
+/* Replicas of read only data, one per node; see sched_replicate() */
+typedef struct replica_s {
+    int num_nodes;          /* Number of nodes                          */
+    const float* w;         /* Replicated data                          */
+    float** node_w;         /* [num_nodes] Replica of each node, or NULL*/
+} REPLICA;
+
+/* Creates a scheduler.
+ *
+ * Parameters:
+ *   num_threads - Number of worker threads; if 0 or less, one less than
+ *                 the number of cpus of the topology (the thread that
+ *                 waits for a task group runs tasks too)
+ *
+ * Returns:
+ *   A pointer to the scheduler.
+ *
+ * Notes:
+ *   Worker threads are pinned to cpus in node order, see numatopo.h,
+ *   unless there are more threads than cpus or the environment variable
+ *   MLINC_PIN is 0.
+ */
+SCHED* sched_create(int num_threads);
+
+/* Stops the worker threads and frees the memory allocated by
+ * sched_create(). There must be no pending tasks.
+ */
+void sched_free(SCHED* s);
+
+/* Returns the scheduler shared by the library. It is created on first use
+ * with the number of threads specified by the environment variable
+ * MLINC_THREADS, less one, or with sched_create(0) if it is not set.
+ */
+SCHED* sched_default(void);
+
+/* Returns the number of threads that run tasks: the worker threads and
+ * the waiting thread.
+ */
+int sched_num_threads(const SCHED* s);
+
+/* Returns the index of the calling thread: 1 to num_threads for worker
+ * threads of a scheduler, 0 for any other thread.
+ */
+int sched_thread_id(void);
+
+/* Returns the node of the calling thread: the node of its topology slot
+ * for worker threads of a scheduler, 0 for any other thread.
+ */
+int sched_thread_node(void);
+
+/* Initializes a task group of scheduler s (sched_default() if NULL) */
+void taskgroup_init(TASKGROUP* g, SCHED* s);
+
+/* Spawns a task that calls fn(arg), in task group g. The task may run on
+ * any thread, before or after taskgroup_spawn() returns.
+ */
+void taskgroup_spawn(TASKGROUP* g, void (*fn)(void* arg), void* arg);
+
+/* Waits until all the tasks spawned in task group g are done, running
+ * tasks in the meantime.
+ */
+void taskgroup_wait(TASKGROUP* g);
+
+/* Calls body(arg,lo,hi) for consecutive ranges [lo,hi) that together
+ * cover [begin,end), in parallel, and waits until all calls return.
+ *
+ * Parameters:
+ *   s     - Scheduler; if NULL, sched_default()
+ *   begin - First index
+ *   end   - One past the last index
+ *   grain - Minimum range size; if 0 or less, chosen automatically
+ *   body  - Function that processes a range of indices
+ *   arg   - Argument passed to body
+ *
+ * Notes:
+ *   Ranges are split lazily: a thread keeps splitting its range in half,
+ *   leaving the upper half for other threads to steal, only while its
+ *   own queue is nearly empty. So the number of ranges adapts to the
+ *   load: evenly loaded iterations are processed in few large ranges, and
+ *   skewed ones are split further where the work is.
+ */
+void parallel_for(SCHED* s, int begin, int end, int grain,
+                  void (*body)(void* arg, int lo, int hi), void* arg);
+
+/* Calls fn(arg,id) once on each worker thread of scheduler s, with the
+ * worker's id, and on the calling thread with id 0 if it is not a worker
+ * of s, and waits until all calls return.
+ *
+ * Parameters:
+ *   s   - Scheduler; if NULL, sched_default()
+ *   fn  - Function to call
+ *   arg - Argument passed to fn
+ */
+void sched_run_on_all(SCHED* s, void (*fn)(void* arg, int id), void* arg);
+
+/* Allocates a zeroed memory block for each thread of scheduler s, placed
+ * on the thread's node.
+ *
+ * Parameters:
+ *   s    - Scheduler; if NULL, sched_default()
+ *   size - Size of each block, in bytes
+ *
+ * Returns:
+ *   An array of sched_num_threads(s) pointers, indexed by sched_thread_id().
+ *
+ * Notes:
+ *   Each block is allocated and first touched by the thread that owns it.
+ *   Use sched_free_local() to free the blocks.
+ */
+void** sched_alloc_local(SCHED* s, long size);
+
+/* Frees the memory allocated by sched_alloc_local() */
+void sched_free_local(SCHED* s, void** p);
+
+/* Replicates read only data, such as the weights of a model used for
+ * inference, on each node that has threads of scheduler s.
+ *
+ * Parameters:
+ *   s - Scheduler; if NULL, sched_default()
+ *   w - Data to replicate
+ *   n - Number of elements of w
+ *
+ * Returns:
+ *   A pointer to the replicas. Use replica_local() to get the replica of
+ *   the calling thread's node.
+ *
+ * Notes:
+ *   Each replica is copied by a thread of its node, so its pages are
+ *   placed there. w must not be changed or freed while the replicas are
+ *   used; replica_local() returns w for a node without a replica.
+ */
+REPLICA* sched_replicate(SCHED* s, const float* w, long n);
+
+/* Returns the replica of the calling thread's node */
+const float* replica_local(const REPLICA* r);
+
+/* Frees the memory allocated by sched_replicate() */
+void replica_free(REPLICA* r);
+
+/* Prints the topology, and the placement of the threads of scheduler s,
+ * to f.
+ */
+void sched_report(const SCHED* s, FILE* f);
+
+#endif
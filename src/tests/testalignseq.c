@@ -0,0 +1,139 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for the sequence alignment functions */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+#include "alignseq.h"
+#include "etime.h"
+
+#define BLANK -1
+
+/* Fills x with n random tokens in [0, k); a small k makes many ties */
+static void fill(int* x, int n, int k)
+{
+    for (int i = 0; i < n; i++)
+        x[i] = rand() % k;
+}
+
+/* Copies x into y, with random substitutions, insertions and deletions.
+ * Returns the length of y, at most 2 * n.
+ */
+static int edit(const int* x, int n, int* y, int k)
+{
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        int r = rand() % 10;
+        if (r == 0)      /* deletion     */
+            continue;
+        if (r == 1)      /* insertion    */
+            y[m++] = rand() % k;
+        y[m++] = (r == 2) ? rand() % k : x[i]; /* substitution */
+    }
+    return m;
+}
+
+/* Aligns p and t with alignseq() and alignseq_linear(); returns 1 if
+ * the edit distances or the aligned sequences differ
+ */
+static int compare(const int* p, int plen, const int* t, int tlen, int rlen)
+{
+    int* rp = allocmem(1,rlen,int);
+    int* rt = allocmem(1,rlen,int);
+    int* lp = allocmem(1,rlen,int);
+    int* lt = allocmem(1,rlen,int);
+    int d = alignseq(p,plen,t,tlen,rp,rt,rlen,BLANK);
+    int dl = alignseq_linear(p,plen,t,tlen,lp,lt,rlen,BLANK);
+    int errors = (d != dl || memcmp(rp,lp,rlen * sizeof(int)) != 0 ||
+                  memcmp(rt,lt,rlen * sizeof(int)) != 0);
+    freemem(rp);
+    freemem(rt);
+    freemem(lp);
+    freemem(lt);
+    return errors;
+}
+
+/* Test 1: alignseq_linear() gives the same alignments as alignseq(),
+ * including when the output buffers are too small
+ */
+static int test_same(int n, int k, int cnt)
+{
+    int errors = 0;
+    int* p = allocmem(1,n + 1,int);
+    int* t = allocmem(1,2 * n + 1,int);
+    for (int c = 0; c < cnt; c++) {
+        int plen = rand() % (n + 1);
+        fill(p,plen,k);
+        int tlen = (c % 3 == 0) ? rand() % (n + 1) : edit(p,plen,t,k);
+        if (c % 3 == 0)
+            fill(t,tlen,k);
+        int rlen = 2 * ((plen > tlen) ? plen : tlen) + 1;
+        errors += compare(p,plen,t,tlen,rlen);
+        errors += compare(p,plen,t,tlen,rlen / 3 + 1);
+    }
+    printf("  %d pairs of up to %d tokens of %d: %s\n",
+           cnt,n,k,(errors) ? "alignments differ" : "same alignments");
+    freemem(p);
+    freemem(t);
+    return errors ? 1 : 0;
+}
+
+/* Test 2: sequences longer than ALIGNSEQ_MAX_CELLS allows are aligned in
+ * linear space; the aligned sequences are the ends of the input sequences,
+ * and the edit distance counts their differences
+ */
+static int test_long(int n, int k)
+{
+    int errors = 0;
+    int* p = allocmem(1,n,int);
+    int* t = allocmem(1,2 * n,int);
+    fill(p,n,k);
+    int tlen = edit(p,n,t,k);
+    int rlen = 2 * ((n > tlen) ? n : tlen);
+    int* rp = allocmem(1,rlen,int);
+    int* rt = allocmem(1,rlen,int);
+    long long t0 = current_time_ns();
+    int d = alignseq(p,n,t,tlen,rp,rt,rlen,BLANK);
+    double tl = (current_time_ns() - t0) / 1e9;
+    int len, np = 0, nt = 0, dist = 0;
+    for (len = 0; len < rlen && (rp[len] != BLANK || rt[len] != BLANK); len++) {
+        dist += (rp[len] != rt[len]);
+        if (rp[len] != BLANK)
+            rp[np++] = rp[len];
+        if (rt[len] != BLANK)
+            rt[nt++] = rt[len];
+    }
+    errors += (d != dist || np > n || nt > tlen);
+    if (!errors)
+        errors += (memcmp(rp,p + n - np,np * sizeof(int)) != 0 ||
+                   memcmp(rt,t + tlen - nt,nt * sizeof(int)) != 0);
+    printf("  %dx%d tokens: %s, distance %d, %.3f sec (table %.0f MB)\n",
+           n,tlen,(errors) ? "wrong alignment" : "aligned",d,tl,
+           (double) (n + 1) * (tlen + 1) * (sizeof(int) + 1) / 1e6);
+    freemem(p);
+    freemem(t);
+    freemem(rp);
+    freemem(rt);
+    return errors;
+}
+
+int main()
+{
+    srand(42);
+    int errors = 0;
+    int err;
+
+    printf("Test 1: linear space alignment\n");
+    err = test_same(8,2,2000) + test_same(100,3,300) + test_same(400,40,50) +
+          test_same(1500,4,4);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 2: long sequences\n");
+    err = test_long(12000,40);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
@@ -0,0 +1,175 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for the beam search decoder */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mem.h"
+#include "random.h"
+#include "array.h"
+#include "tasksched.h"
+#include "beamsrch.h"
+#include "etime.h"
+
+/* Fills p[T][C] with random probabilities; each row sums to 1. If levels
+ * is not zero, probabilities take few values, so scores tie often.
+ */
+static void fill(float* p, int T, int C, int levels)
+{
+    for (int t = 0; t < T; t++) {
+        float sum = 0;
+        for (int c = 0; c < C; c++) {
+            float* v = p + (long) t * C + c;
+            *v = (levels) ? 1 + rand() % levels : urand(0.01,1.0);
+            sum += *v;
+        }
+        for (int c = 0; c < C; c++)
+            p[(long) t * C + c] /= sum;
+    }
+}
+
+/* Reference decoder: the candidates of each time step are copied whole,
+ * and sorted by score, then by the order they were generated
+ */
+typedef struct { int* seq; float score; int k; } CANDIDATE;
+
+static int candidate_cmp(const void* a, const void* b)
+{
+    const CANDIDATE* x = a;
+    const CANDIDATE* y = b;
+    if (x->score != y->score)
+        return (x->score > y->score) - (x->score < y->score);
+    return x->k - y->k;
+}
+
+static void reference(const float* p, int T, int C, int B, int* seqs,
+                      float* scores)
+{
+    int* cseqs = allocmem(B * C,T + 1,int);
+    CANDIDATE* can = allocmem(1,B * C,CANDIDATE);
+    memset(seqs,0,B * (T + 1) * sizeof(int));
+    for (int i = 0; i < B; i++)
+        scores[i] = INFINITY;
+    scores[0] = 0;
+    int n = 1;
+    for (int t = 0; t < T; t++) {
+        int m = 0;
+        for (int i = 0; i < n; i++)
+            for (int c = 0; c < C; c++, m++) {
+                can[m].seq = cseqs + m * (T + 1);
+                memcpy(can[m].seq,seqs + i * (T + 1),t * sizeof(int));
+                can[m].seq[t] = c;
+                can[m].score = scores[i] - log(p[(long) t * C + c]);
+                can[m].k = m;
+            }
+        qsort(can,m,sizeof(CANDIDATE),candidate_cmp);
+        n = (m < B) ? m : B;
+        for (int i = 0; i < n; i++) {
+            memcpy(seqs + i * (T + 1),can[i].seq,(t + 1) * sizeof(int));
+            scores[i] = can[i].score;
+        }
+    }
+    freemem(cseqs);
+    freemem(can);
+}
+
+/* Test 1: beam_search() gives the results of the reference decoder */
+static int test_reference(int T, int C, int B, int levels, int cnt)
+{
+    int errors = 0;
+    float* p = allocmem(T,C,float);
+    int* s = allocmem(B,T + 1,int);
+    int* rs = allocmem(B,T + 1,int);
+    float* sc = allocmem(1,B,float);
+    float* rsc = allocmem(1,B,float);
+    for (int n = 0; n < cnt; n++) {
+        fill(p,T,C,levels);
+        beam_search((fArr2D) p,T,C,B,(iArr2D) s,sc);
+        reference(p,T,C,B,rs,rsc);
+        errors += (memcmp(s,rs,B * (T + 1) * sizeof(int)) != 0 ||
+                   memcmp(sc,rsc,B * sizeof(float)) != 0);
+    }
+    printf("  %d steps, %d classes, beam %d%s: %s\n",T,C,B,
+           (levels) ? ", tied scores" : "",
+           (errors) ? "results differ" : "same results");
+    freemem(p);
+    freemem(s);
+    freemem(rs);
+    freemem(sc);
+    freemem(rsc);
+    return errors ? 1 : 0;
+}
+
+/* Test 2: beam_search_batch() gives the results of beam_search() called
+ * for each sequence, decoding one sequence after the other and in parallel
+ */
+static int test_batch(int N, int C, int B)
+{
+    int errors = 0;
+    int T[N];
+    fArr2D p[N];
+    iArr2D s[N], bs[N];
+    fVec sc[N], bsc[N];
+    for (int n = 0; n < N; n++) {
+        T[n] = 100 + rand() % 400;
+        p[n] = allocmem(T[n],C,float);
+        s[n] = allocmem(B,T[n] + 1,int);
+        bs[n] = allocmem(B,T[n] + 1,int);
+        sc[n] = allocmem(1,B,float);
+        bsc[n] = allocmem(1,B,float);
+        fill((float*) p[n],T[n],C,0);
+    }
+    long long t0 = current_time_ns();
+    for (int n = 0; n < N; n++)
+        beam_search(p[n],T[n],C,B,s[n],sc[n]);
+    long long t1 = current_time_ns();
+    beam_search_batch(N,p,T,C,B,bs,bsc,0);
+    long long t2 = current_time_ns();
+    for (int n = 0; n < N; n++)
+        errors += (memcmp(s[n],bs[n],B * (T[n] + 1) * sizeof(int)) != 0 ||
+                   memcmp(sc[n],bsc[n],B * sizeof(float)) != 0);
+    for (int n = 0; n < N; n++)
+        memset(bs[n],0,B * (T[n] + 1) * sizeof(int));
+    long long t3 = current_time_ns();
+    beam_search_batch(N,p,T,C,B,bs,bsc,1);
+    long long t4 = current_time_ns();
+    for (int n = 0; n < N; n++)
+        errors += (memcmp(s[n],bs[n],B * (T[n] + 1) * sizeof(int)) != 0 ||
+                   memcmp(sc[n],bsc[n],B * sizeof(float)) != 0);
+    printf("  %d sequences, %d classes, beam %d: %s, "
+           "%.1f ms, batch %.1f ms, parallel %.1f ms (%d threads)\n",
+           N,C,B,(errors) ? "results differ" : "same results",
+           (t1 - t0) / 1e6,(t2 - t1) / 1e6,(t4 - t3) / 1e6,
+           sched_num_threads(sched_default()));
+    for (int n = 0; n < N; n++) {
+        freemem(p[n]);
+        freemem(s[n]);
+        freemem(bs[n]);
+        freemem(sc[n]);
+        freemem(bsc[n]);
+    }
+    return errors ? 1 : 0;
+}
+
+int main()
+{
+    init_lrng(42);
+    srand(42);
+    int errors = 0;
+    int err;
+
+    printf("Test 1: beam search\n");
+    err = test_reference(20,5,3,0,50) + test_reference(20,5,3,2,50) +
+          test_reference(50,40,10,0,5) + test_reference(30,4,8,1,5) +
+          test_reference(1,3,8,0,5) + test_reference(0,3,2,0,1);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 2: batched beam search\n");
+    err = test_batch(400,39,3) + test_batch(100,39,16);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
@@ -0,0 +1,262 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for data parallel training across processes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mem.h"
+#include "float.h"
+#include "random.h"
+#include "array.h"
+#include "comm.h"
+#include "dense.h"
+#include "lstm.h"
+#include "model.h"
+
+#define NUM_RANKS 4   /* Number of processes    */
+#define X_DIM     5   /* Input vectors dimension  */
+#define Y_DIM     3   /* Output vectors dimension */
+
+/* Returns the number of ranks that report errors, on all ranks */
+static int count_errors(COMM* c, int errors)
+{
+    float e = (errors > 0) ? 1 : 0;
+    comm_allreduce(c,&e,1);
+    return (int) e;
+}
+
+/* Test 1: all-reduce and broadcast of buffers of various sizes, including
+ * buffers smaller than the number of ranks and larger than the transport's
+ * buffers.
+ */
+static int test_collectives(COMM* c)
+{
+    int errors = 0;
+    const long sizes[] = { 0, 1, 3, 5, 1000, 700001 };
+    for (int k = 0; k < (int) (sizeof(sizes) / sizeof(sizes[0])); k++) {
+        long n = sizes[k];
+        float* x = allocmem(1,n + 1,float);
+        for (long i = 0; i < n; i++)
+            x[i] = (c->rank + 1) * 1000 + i % 97;
+        if (!comm_allreduce(c,x,n))
+            errors++;
+        /* Sums of small integers are exact */
+        float base = 1000.0 * c->size * (c->size + 1) / 2;
+        for (long i = 0; i < n; i++)
+            if (x[i] != base + c->size * (i % 97)) {
+                printf("Rank %d: all-reduce of %ld elements: x[%ld]=%g\n",
+                       c->rank,n,i,x[i]);
+                errors++;
+                break;
+            }
+        int root = k % c->size;
+        for (long i = 0; i < n; i++)
+            x[i] = (c->rank == root) ? i * 0.5f : -1;
+        if (!comm_broadcast(c,x,n,root))
+            errors++;
+        for (long i = 0; i < n; i++)
+            if (x[i] != i * 0.5f) {
+                printf("Rank %d: broadcast of %ld elements from %d: "
+                       "x[%ld]=%g\n",c->rank,n,root,i,x[i]);
+                errors++;
+                break;
+            }
+        freemem(x);
+    }
+    if (!comm_barrier(c))
+        errors++;
+    return errors;
+}
+
+/* Fills x with random values, and y with one-hot labels */
+static void make_data(float x[][X_DIM], float y[][Y_DIM], int M)
+{
+    for (int i = 0; i < M; i++) {
+        for (int j = 0; j < X_DIM; j++)
+            x[i][j] = urand(-2.0,3.0) * (j + 1);
+        int c = (x[i][0] + x[i][1] > 0) ? 1 : (x[i][2] > 0) ? 2 : 0;
+        for (int j = 0; j < Y_DIM; j++)
+            y[i][j] = (j == c) ? 1.0 : 0.0;
+    }
+}
+
+static MODEL* make_model(int B, int cfg)
+{
+    MODEL* m = model_create(2,B,X_DIM,1,cfg == 1);
+    if (cfg == 0) {
+        model_add(m,dense_create(6,"relu"),"dense");
+        model_add(m,dense_create(Y_DIM,"softmax"),"dense");
+        model_compile(m,"cross-entropy","linear");
+    }
+    else {
+        model_add(m,lstm_create(8,1),"lstm");
+        model_add(m,dense_create(Y_DIM,"softmax"),"dense");
+        model_compile(m,"cross-entropy","adamw");
+    }
+    return m;
+}
+
+/* Returns the maximum absolute difference of the weights of two models */
+static float max_weight_diff(MODEL* m1, MODEL* m2)
+{
+    float diff = 0;
+    for (int i = 0; i < m1->num_layers; i++) {
+        fArr2D w1[LAYER_MAX_WEIGHTS], w2[LAYER_MAX_WEIGHTS];
+        long n1[LAYER_MAX_WEIGHTS], n2[LAYER_MAX_WEIGHTS];
+        int k = layer_weights(&m1->layer[i],w1,n1);
+        layer_weights(&m2->layer[i],w2,n2);
+        for (int j = 0; j < k; j++)
+            for (long e = 0; e < n1[j]; e++) {
+                float d = fabs(((float*) w1[j])[e] - ((float*) w2[j])[e]);
+                if (d > diff)
+                    diff = d;
+            }
+    }
+    return diff;
+}
+
+/* Returns the number of weights of model m that differ from rank 0's */
+static int count_weight_mismatch(COMM* c, MODEL* m)
+{
+    int mismatch = 0;
+    for (int i = 0; i < m->num_layers; i++) {
+        fArr2D w[LAYER_MAX_WEIGHTS];
+        long n[LAYER_MAX_WEIGHTS];
+        int k = layer_weights(&m->layer[i],w,n);
+        for (int j = 0; j < k; j++) {
+            float* w0 = allocmem(1,n[j],float);
+            fltcpy(w0,w[j],n[j]);
+            comm_broadcast(c,w0,n[j],0);
+            if (memcmp(w0,w[j],n[j] * sizeof(float)) != 0)
+                mismatch++;
+            freemem(w0);
+        }
+    }
+    return mismatch;
+}
+
+/* Test 2: one data parallel update with batches of B samples on each rank
+ * equals one update with a batch of all the samples in one process.
+ */
+static int test_one_update(COMM* c)
+{
+    const int B = 8;
+    const int P = c->size;
+    int errors = 0;
+    float (*x)[X_DIM] = allocmem(B * P,X_DIM,float);
+    float (*y)[Y_DIM] = allocmem(B * P,Y_DIM,float);
+    init_lrng(11); /* Same data on all ranks, each uses its own shard */
+    make_data(x,y,B * P);
+
+    init_lrng(5 + c->rank); /* Different initial weights, until copied */
+    MODEL* m = make_model(B,0);
+    model_set_comm(m,c);
+    float loss;
+    model_fit(m,x + c->rank * B,y + c->rank * B,NULL,B,NULL,NULL,NULL,0,
+              1,0.1,0.0,&loss,NULL,NULL,NULL,"shuffle=0");
+
+    init_lrng(5); /* Rank 0's initial weights */
+    MODEL* m1 = make_model(B * P,0);
+    float loss1;
+    model_fit(m1,x,y,NULL,B * P,NULL,NULL,NULL,0,
+              1,0.1,0.0,&loss1,NULL,NULL,NULL,"shuffle=0");
+    float diff = max_weight_diff(m,m1);
+    if (diff > 1e-5 || fabs(loss - loss1) > 1e-4 * fabs(loss1)) {
+        printf("Rank %d: weights differ by %g, loss %g expected %g\n",
+               c->rank,diff,loss,loss1);
+        errors++;
+    }
+    model_free(m1);
+    model_free(m);
+    freemem(x);
+    freemem(y);
+    return errors;
+}
+
+/* Test 3: training on shards of different sizes keeps the models of all
+ * ranks identical, and reduces the loss.
+ */
+static int test_training(COMM* c, int cfg)
+{
+    static const int len[] = { 9, 1, 17, 4, 12, 6, 11, 3 };
+    const int epochs = 8;
+    int errors = 0;
+    /* Rank r gets sequences r, r+P, ...; the last rank has fewer */
+    int seq_len[8];
+    int num_seq = 0;
+    int M = 0;
+    for (int i = c->rank; i < 8 - (c->rank == c->size - 1); i += c->size) {
+        seq_len[num_seq++] = len[i];
+        M += len[i];
+    }
+    float (*x)[X_DIM] = allocmem(M,X_DIM,float);
+    float (*y)[Y_DIM] = allocmem(M,Y_DIM,float);
+    init_lrng(100 + c->rank);
+    make_data(x,y,M);
+
+    MODEL* m = make_model(4,cfg);
+    model_set_comm(m,c);
+    float losses[epochs];
+    model_fit(m,x,y,seq_len,num_seq,NULL,NULL,NULL,0,
+              epochs,0.05,0.0001,losses,NULL,NULL,NULL,NULL);
+    int mismatch = count_weight_mismatch(c,m);
+    if (mismatch > 0) {
+        printf("Rank %d: %d weight arrays differ from rank 0\n",
+               c->rank,mismatch);
+        errors++;
+    }
+    float loss0 = losses[epochs - 1];
+    comm_broadcast(c,&loss0,1,0);
+    if (losses[epochs - 1] != loss0 || !(losses[epochs - 1] < losses[0])) {
+        printf("Rank %d: loss %g to %g (rank 0 %g)\n",
+               c->rank,losses[0],losses[epochs - 1],loss0);
+        errors++;
+    }
+    model_free(m);
+    freemem(x);
+    freemem(y);
+    return errors;
+}
+
+int main()
+{
+    COMM* c = comm_fork(NUM_RANKS);
+    int errors = 0;
+    int err;
+    const char* result[] = { "Test passed", "Test failed" };
+
+    if (c->rank == 0)
+        printf("Test 1: all-reduce and broadcast, %d processes\n",c->size);
+    err = count_errors(c,test_collectives(c));
+    if (c->rank == 0)
+        printf("%s\n",result[err > 0]);
+    errors += err;
+
+    if (c->rank == 0)
+        printf("Test 2: data parallel update equals single process update\n");
+    err = count_errors(c,test_one_update(c));
+    if (c->rank == 0)
+        printf("%s\n",result[err > 0]);
+    errors += err;
+
+    for (int cfg = 0; cfg < 2; cfg++) {
+        if (c->rank == 0)
+            printf("Test %d: data parallel training, %s model\n",cfg + 3,
+                   (cfg == 0) ? "dense" : "lstm");
+        err = count_errors(c,test_training(c,cfg));
+        if (c->rank == 0)
+            printf("%s\n",result[err > 0]);
+        errors += err;
+    }
+
+    int rank = c->rank;
+    comm_free(c);
+    if (rank > 0)
+        exit((errors) ? 1 : 0);
+    if (comm_wait_children() > 0) {
+        printf("Some processes failed\n");
+        errors++;
+    }
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
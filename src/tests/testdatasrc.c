@@ -0,0 +1,625 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for data sources, dataset files and streaming training,
+ * and validation on another thread
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "mem.h"
+#include "float.h"
+#include "random.h"
+#include "array.h"
+#include "etime.h"
+#include "normalize.h"
+#include "onehot.h"
+#include "datasrc.h"
+#include "dsfile.h"
+#include "batch.h"
+#include "featfile.h"
+#include "dense.h"
+#include "lstm.h"
+#include "model.h"
+
+#define SEQ_CNT 7     /* Number of sequences      */
+#define X_DIM   5     /* Input vectors dimension  */
+#define Y_DIM   3     /* Output vectors dimension */
+
+static const int len[SEQ_CNT] = { 9, 1, 17, 4, 12, 6, 11 };
+
+/* Fills x with random values, and y with one-hot labels */
+static int make_data(float x[][X_DIM], float y[][Y_DIM])
+{
+    int M = 0;
+    for (int i = 0; i < SEQ_CNT; i++)
+        M += len[i];
+    for (int i = 0; i < M; i++) {
+        for (int j = 0; j < X_DIM; j++)
+            x[i][j] = urand(-2.0,3.0) * (j + 1);
+        int c = (x[i][0] + x[i][1] > 0) ? 1 : (x[i][2] > 0) ? 2 : 0;
+        for (int j = 0; j < Y_DIM; j++)
+            y[i][j] = (j == c) ? 1.0 : 0.0;
+    }
+    return M;
+}
+
+/* Iterates two batch iterators over the same data, with the same random
+ * state, and returns the number of mismatching batches.
+ */
+static int compare_batches(BATCH* b1, BATCH* b2, int B, int Db, int rng_seed)
+{
+    int errors = 0;
+    float x1[B][Db], y1[B][Y_DIM];
+    float x2[B][Db], y2[B][Y_DIM];
+    for (int epoch = 0; epoch < 2; epoch++) {
+        init_lrng(rng_seed + epoch);
+        batch_shuffle(b1);
+        init_lrng(rng_seed + epoch);
+        batch_shuffle(b2);
+        for (int k = 0; ; k++) {
+            int cnt1 = batch_copy(b1,x1,y1);
+            int cnt2 = batch_copy(b2,x2,y2);
+            if (cnt1 != cnt2 || batch_eos(b1) != batch_eos(b2)) {
+                printf("Batch %d: count %d %d eos %d %d mismatch\n",
+                               k,cnt1,cnt2,batch_eos(b1),batch_eos(b2));
+                errors++;
+                break;
+            }
+            if (cnt1 == 0)
+                break;
+            if (memcmp(x1,x2,cnt1 * Db * sizeof(float)) != 0 ||
+                memcmp(y1,y2,cnt1 * Y_DIM * sizeof(float)) != 0) {
+                printf("Batch %d: data mismatch\n",k);
+                errors++;
+            }
+        }
+    }
+    return errors;
+}
+
+/* Test 1: batches read through data sources match batches read directly
+ * from arrays, in multi-sequence and single sequence mode.
+ */
+int test_batches(const char* filename,
+                 float x[][X_DIM], float y[][Y_DIM], int M)
+{
+    printf("Test 1: batches from arrays, file, and data source\n");
+    int errors = 0;
+    DATASRC* s1 = datasrc_arrays(x,X_DIM,y,Y_DIM,len,SEQ_CNT);
+    if (!datasrc_store(s1,filename)) {
+        printf("Failed to store dataset file\n");
+        return 1;
+    }
+    DATASRC* s2 = datasrc_mmap(filename);
+    if (s2 == NULL) {
+        printf("Failed to map dataset file\n");
+        return 1;
+    }
+    if (datasrc_num_sequences(s2) != SEQ_CNT || 
+        datasrc_num_vectors(s2) != M ||
+        s2->D != X_DIM || s2->N != Y_DIM) {
+        printf("Dataset file dimensions mismatch\n");
+        errors++;
+    }
+    for (int add_bias = 0; add_bias <= 1; add_bias++) {
+        BATCH* b1 = batch_create(x,X_DIM,y,Y_DIM,4,len,SEQ_CNT,1,add_bias);
+        BATCH* b2 = batch_create_source(s2,4,1,add_bias);
+        errors += compare_batches(b1,b2,4,X_DIM + add_bias,11);
+        batch_free(b1);
+        batch_free(b2);
+        /* Single sequence, vectors shuffled */
+        b1 = batch_create(x,X_DIM,y,Y_DIM,5,NULL,M,1,add_bias);
+        DATASRC* s3 = datasrc_arrays(x,X_DIM,y,Y_DIM,NULL,M);
+        b2 = batch_create_source(s3,5,1,add_bias);
+        errors += compare_batches(b1,b2,5,X_DIM + add_bias,12);
+        batch_free(b1);
+        batch_free(b2);
+        datasrc_free(s3);
+    }
+    float mean1[X_DIM], sdev1[X_DIM], mean2[X_DIM], sdev2[X_DIM];
+    calculate_mean_sdev(x,M,X_DIM,mean1,sdev1,0);
+    datasrc_mean_sdev(s2,mean2,sdev2,0);
+    if (memcmp(mean1,mean2,sizeof(mean1)) != 0 ||
+        memcmp(sdev1,sdev2,sizeof(sdev1)) != 0) {
+        printf("Mean and standard deviation mismatch\n");
+        errors++;
+    }
+    datasrc_free(s1);
+    datasrc_free(s2);
+    printf("%s\n",(errors) ? "Test failed" : "Test passed");
+    return errors;
+}
+
+/* Test 2: training on a memory mapped dataset file gives the same results
+ * as training on arrays.
+ */
+int test_fit(const char* filename, float x[][X_DIM], float y[][Y_DIM])
+{
+    printf("Test 2: model_fit() and model_fit_source()\n");
+    const int epochs = 5;
+    float losses[3][epochs], accuracies[3][epochs];
+    float v_losses[3][epochs], v_accuracies[3][epochs];
+    float yp[3][len[0]][Y_DIM];
+    for (int k = 0; k < 3; k++) {
+        init_lrng(42);
+        MODEL* m = model_create(2,4,X_DIM,1,1);
+        model_add(m,lstm_create(8,1),"lstm");
+        model_add(m,dense_create(Y_DIM,"softmax"),"dense");
+        model_compile(m,"cross-entropy","adamw");
+        if (k == 0)
+            model_fit(m,x,y,len,SEQ_CNT,x,y,len,SEQ_CNT,epochs,0.01,0.001,
+                      losses[k],accuracies[k],v_losses[k],v_accuracies[k],
+                      "verbose=0");
+        else
+        if (k == 2) { /* Arrays in the mapped file, no copying */
+            DSFILE* ds = dsfile_open(filename);
+            if (ds == NULL) {
+                printf("Failed to open dataset file\n");
+                return 1;
+            }
+            model_fit(m,(fArr2D) ds->x,(fArr2D) ds->y,ds->len,ds->num,
+                      (fArr2D) ds->x,(fArr2D) ds->y,ds->len,ds->num,
+                      epochs,0.01,0.001,
+                      losses[k],accuracies[k],v_losses[k],v_accuracies[k],
+                      "verbose=0");
+            dsfile_close(ds);
+        }
+        else {
+            DATASRC* s = datasrc_mmap(filename);
+            if (s == NULL) {
+                printf("Failed to map dataset file\n");
+                return 1;
+            }
+            /* Not copied into memory, normalized each batch */
+            model_fit_source(m,s,s,epochs,0.01,0.001,
+                      losses[k],accuracies[k],v_losses[k],v_accuracies[k],
+                      "verbose=0 prenormalize=1");
+            datasrc_free(s);
+        }
+        model_predict(m,x,yp[k],len[0]);
+        model_free(m);
+    }
+    int errors = 0;
+    for (int k = 1; k < 3; k++) {
+        if (memcmp(losses[0],losses[k],sizeof(losses[0])) != 0 ||
+            memcmp(accuracies[0],accuracies[k],sizeof(accuracies[0])) != 0 ||
+            memcmp(v_losses[0],v_losses[k],sizeof(v_losses[0])) != 0 ||
+            memcmp(v_accuracies[0],v_accuracies[k],sizeof(v_accuracies[0])))
+            errors++;
+        if (memcmp(yp[0],yp[k],sizeof(yp[0])) != 0)
+            errors++;
+    }
+    for (int i = 0; i < epochs; i++)
+        printf("epoch %d loss %.6f %.6f %.6f accuracy %.4f %.4f %.4f\n",
+                i + 1,losses[0][i],losses[1][i],losses[2][i],
+                accuracies[0][i],accuracies[1][i],accuracies[2][i]);
+    printf("%s\n",(errors) ? "Test failed" : "Test passed");
+    return errors;
+}
+
+/* Test 3: dataset file with int class labels, read directly and through
+ * a data source that expands the labels to one-hot vectors.
+ */
+int test_dsfile(const char* filename, float x[][X_DIM], float y[][Y_DIM], 
+                int M)
+{
+    printf("Test 3: dataset file with class labels\n");
+    int errors = 0;
+    int* yc = allocmem(M,1,int);
+    onehot_decode(y,yc,M,Y_DIM);
+    if (!dsfile_write(filename,x,X_DIM,yc,Y_DIM,DS_INT,len,SEQ_CNT)) {
+        printf("Failed to write dataset file\n");
+        freemem(yc);
+        return 1;
+    }
+    DSFILE* ds = dsfile_open(filename);
+    if (ds == NULL) {
+        printf("Failed to open dataset file\n");
+        freemem(yc);
+        return 1;
+    }
+    if (ds->D != X_DIM || ds->N != Y_DIM || ds->y_type != DS_INT ||
+        ds->num != SEQ_CNT || ds->M != M ||
+        memcmp(ds->len,len,sizeof(len)) != 0 ||
+        memcmp(ds->x,x,M * X_DIM * sizeof(float)) != 0 ||
+        memcmp(ds->y,yc,M * sizeof(int)) != 0) {
+        printf("Dataset file contents mismatch\n");
+        errors++;
+    }
+    if ((long) ds->x % DS_ALIGN != 0 || (long) ds->y % DS_ALIGN != 0) {
+        printf("Dataset file sections are not aligned\n");
+        errors++;
+    }
+    DATASRC* s = dsfile_source(ds);
+    float xs[len[2]][X_DIM], ys[len[2]][Y_DIM];
+    int off = len[0] + len[1];
+    if (datasrc_read(s,2,0,len[2],xs,ys) != len[2] ||
+        dsfile_x(ds,2) != ds->x + off * X_DIM ||
+        dsfile_y(ds,2) != (const int*) ds->y + off ||
+        memcmp(xs,x[off],sizeof(xs)) != 0 ||
+        memcmp(ys,y[off],sizeof(ys)) != 0) {
+        printf("Dataset file source mismatch\n");
+        errors++;
+    }
+    datasrc_free(s);
+    dsfile_close(ds);
+    /* Lengths that add up to M, but are negative, are rejected */
+    int bad[SEQ_CNT];
+    memcpy(bad,len,sizeof(bad));
+    bad[0] = -5;
+    bad[1] = len[0] + len[1] + 5;
+    DSWRITER* w = dsfile_create(filename,X_DIM,Y_DIM,DS_INT,bad,SEQ_CNT);
+    dsfile_append(w,x,yc,M);
+    if (!dsfile_finish(w) || (ds = dsfile_open(filename)) != NULL) {
+        printf("Dataset file with negative lengths not rejected\n");
+        dsfile_close(ds);
+        errors++;
+    }
+    freemem(yc);
+    printf("%s\n",(errors) ? "Test failed" : "Test passed");
+    return errors;
+}
+
+/* Test 4: validation on another thread gives the same results as
+ * validation on the training thread.
+ */
+int test_async_validation(float x[][X_DIM], float y[][Y_DIM])
+{
+    printf("Test 4: asynchronous validation\n");
+    const int epochs = 6;
+    const int numTr = 4; /* First sequences train, the rest validate */
+    int off = 0;
+    for (int i = 0; i < numTr; i++)
+        off += len[i];
+    int errors = 0;
+    for (int cfg = 0; cfg < 2; cfg++) {
+        float losses[2][epochs], accuracies[2][epochs];
+        float v_losses[2][epochs], v_accuracies[2][epochs];
+        float yp[2][len[0]][Y_DIM];
+        for (int k = 0; k < 2; k++) {
+            init_lrng(17);
+            MODEL* m = model_create(2,4,X_DIM,1,cfg == 0);
+            if (cfg == 0) {
+                model_add(m,lstm_create(8,1),"lstm");
+                model_add(m,dense_create(Y_DIM,"softmax"),"dense");
+                model_compile(m,"cross-entropy","adamw");
+            }
+            else {
+                model_add(m,dense_create(6,"relu"),"dense");
+                model_add(m,dense_create(Y_DIM,"none"),"dense");
+                model_compile(m,"mean-square-error","linear");
+            }
+            model_fit(m,x,y,len,numTr,x + off,y + off,len + numTr,
+                      SEQ_CNT - numTr,epochs,0.01,0.001,
+                      losses[k],accuracies[k],v_losses[k],v_accuracies[k],
+                      (k == 0) ? "verbose=0" : "verbose=0 async_validation=1");
+            model_predict(m,x,yp[k],len[0]);
+            model_free(m);
+        }
+        if (memcmp(losses[0],losses[1],sizeof(losses[0])) != 0 ||
+            memcmp(accuracies[0],accuracies[1],sizeof(accuracies[0])) != 0 ||
+            memcmp(v_losses[0],v_losses[1],sizeof(v_losses[0])) != 0 ||
+            memcmp(v_accuracies[0],v_accuracies[1],sizeof(v_accuracies[0])) ||
+            memcmp(yp[0],yp[1],sizeof(yp[0])) != 0) {
+            printf("Results mismatch (model %d)\n",cfg + 1);
+            errors++;
+        }
+        for (int i = 0; i < epochs; i++)
+            printf("epoch %d validation loss %.6f %.6f accuracy %.4f %.4f\n",
+                    i + 1,v_losses[0][i],v_losses[1][i],
+                    v_accuracies[0][i],v_accuracies[1][i]);
+    }
+    printf("%s\n",(errors) ? "Test failed" : "Test passed");
+    return errors;
+}
+
+/* Test 5: normalizing the data once, into copies or in place, gives the
+ * same results as normalizing each batch.
+ */
+int test_prenormalize(float x[][X_DIM], float y[][Y_DIM], int M)
+{
+    printf("Test 5: data normalized once\n");
+    const int epochs = 4;
+    const int numTr = 4; /* First sequences train, the rest validate */
+    int off = 0;
+    for (int i = 0; i < numTr; i++)
+        off += len[i];
+    const char* kwargs[3] = { 
+        "verbose=0", 
+        "verbose=0 prenormalize=1 async_validation=1", 
+        "verbose=0 (normalized in place)" 
+    };
+    float losses[3][epochs], v_losses[3][epochs];
+    float yp[3][len[0]][Y_DIM];
+    float (*xc)[X_DIM] = allocmem(M,X_DIM,float);
+    float mean[X_DIM], sdev[X_DIM];
+    int errors = 0;
+    for (int k = 0; k < 3; k++) {
+        fltcpy(xc,x,M * X_DIM); /* Normalized in place by k == 2 */
+        init_lrng(23);
+        MODEL* m = model_create(2,4,X_DIM,1,1);
+        model_add(m,lstm_create(8,1),"lstm");
+        model_add(m,dense_create(Y_DIM,"softmax"),"dense");
+        model_compile(m,"cross-entropy","adamw");
+        DATASRC* sTr = NULL;
+        DATASRC* sVd = NULL;
+        if (k < 2)
+            model_fit(m,xc,y,len,numTr,xc + off,y + off,len + numTr,
+                      SEQ_CNT - numTr,epochs,0.01,0.001,
+                      losses[k],NULL,v_losses[k],NULL,kwargs[k]);
+        else { /* Validation data normalized with training mean and sdev */
+            const float *tmean, *tsdev;
+            sTr = datasrc_arrays_normalize(xc,X_DIM,y,Y_DIM,len,numTr,
+                                           NULL,NULL,0);
+            datasrc_norm_stats(sTr,&tmean,&tsdev);
+            sVd = datasrc_arrays_normalize(xc + off,X_DIM,y + off,Y_DIM,
+                                           len + numTr,SEQ_CNT - numTr,
+                                           tmean,tsdev,0);
+            model_fit_source(m,sTr,sVd,epochs,0.01,0.001,
+                             losses[k],NULL,v_losses[k],NULL,kwargs[k]);
+        }
+        model_predict(m,x,yp[k],len[0]);
+        fltcpy(mean,m->mean,X_DIM);
+        fltcpy(sdev,m->sdev,X_DIM);
+        if (k == 2) { 
+            /* Data normalized in place is not normalized again */
+            model_fit_source(m,sTr,sVd,1,0.01,0.001,NULL,NULL,NULL,NULL,
+                             kwargs[k]);
+            if (memcmp(mean,m->mean,sizeof(mean)) != 0 ||
+                memcmp(sdev,m->sdev,sizeof(sdev)) != 0) {
+                printf("Mean and sdev of data normalized in place changed\n");
+                errors++;
+            }
+            /* The training data is normalized in place with the mean and
+             * sdev of training data, and so is the validation data
+             */
+            float (*xn)[X_DIM] = allocmem(M,X_DIM,float);
+            fltcpy(xn,x,M * X_DIM);
+            normalize(xn,M,X_DIM,mean,sdev,0);
+            if (memcmp(xn,xc,M * X_DIM * sizeof(float)) != 0) {
+                printf("Data not normalized in place\n");
+                errors++;
+            }
+            freemem(xn);
+            datasrc_free(sTr);
+            datasrc_free(sVd);
+            /* Other data in the same arrays is normalized with its own
+             * mean and sdev
+             */
+            for (int i = 0; i < M * X_DIM; i++)
+                xc[0][i] = 2 * x[0][i];
+            model_fit(m,xc,y,len,numTr,xc + off,y + off,len + numTr,
+                      SEQ_CNT - numTr,1,0.01,0.001,NULL,NULL,NULL,NULL,
+                      "verbose=0 prenormalize=1");
+            for (int j = 0; j < X_DIM; j++)
+                if (fabsf(m->mean[j] - 2 * mean[j]) > 1e-5 ||
+                    fabsf(m->sdev[j] - 2 * sdev[j]) > 1e-5) {
+                    printf("Mean and sdev of other data in the same "
+                           "arrays not calculated\n");
+                    errors++;
+                    break;
+                }
+        }
+        model_free(m);
+    }
+    for (int k = 1; k < 3; k++)
+        if (memcmp(losses[0],losses[k],sizeof(losses[0])) != 0 ||
+            memcmp(v_losses[0],v_losses[k],sizeof(v_losses[0])) != 0 ||
+            memcmp(yp[0],yp[k],sizeof(yp[0])) != 0) {
+            printf("Results mismatch (%s)\n",kwargs[k]);
+            errors++;
+        }
+    for (int i = 0; i < epochs; i++)
+        printf("epoch %d loss %.6f %.6f %.6f validation loss %.6f %.6f %.6f\n",
+                i + 1,losses[0][i],losses[1][i],losses[2][i],
+                v_losses[0][i],v_losses[1][i],v_losses[2][i]);
+    freemem(xc);
+    printf("%s\n",(errors) ? "Test failed" : "Test passed");
+    return errors;
+}
+
+/* Test 6: the mean and standard deviation of a large dataset, calculated
+ * in parallel blocks in one pass, match those calculated in two passes in
+ * double precision, and those of a data source of sequences that do not
+ * fit the blocks.
+ */
+int test_mean_sdev(void)
+{
+    printf("Test 6: mean and standard deviation in one pass\n");
+    const int M = 50 * MOMENTS_BLOCK + 123;
+    const int num = 37;
+    float (*x)[X_DIM] = allocmem(M,X_DIM,float);
+    int lens[num];
+    for (int i = 0; i < num; i++)
+        lens[i] = M / num + ((i < M % num) ? 1 : 0);
+    for (int i = 0; i < M; i++)
+        for (int j = 0; j < X_DIM; j++) /* Large mean, small variance */
+            x[i][j] = 1000.0 * j + urand(-1.0,1.0) * (j + 1);
+    float mean[X_DIM], sdev[X_DIM], mean2[X_DIM], sdev2[X_DIM];
+    long long t0 = current_time_ns();
+    calculate_mean_sdev(x,M,X_DIM,mean,sdev,0);
+    long long t1 = current_time_ns();
+    DATASRC* s = datasrc_arrays(x,X_DIM,NULL,0,lens,num);
+    datasrc_mean_sdev(s,mean2,sdev2,0);
+    datasrc_free(s);
+    int errors = 0;
+    if (memcmp(mean,mean2,sizeof(mean)) != 0 ||
+        memcmp(sdev,sdev2,sizeof(sdev)) != 0) {
+        printf("Mean and standard deviation of data source mismatch\n");
+        errors++;
+    }
+    for (int j = 0; j < X_DIM; j++) {
+        double sum = 0;
+        for (int i = 0; i < M; i++)
+            sum += x[i][j];
+        double mu = sum / M;
+        double var = 0;
+        for (int i = 0; i < M; i++)
+            var += (x[i][j] - mu) * (x[i][j] - mu);
+        double sd = sqrt(var / M);
+        printf("  column %d mean %.6f %.6f sdev %.6f %.6f\n",
+               j,mean[j],mu,sdev[j],sd);
+        if (fabs(mean[j] - mu) > 1e-6 * (1 + fabs(mu)) ||
+            fabs(sdev[j] - sd) > 1e-6 * (1 + sd))
+            errors++;
+    }
+    printf("  %d vectors: %.3f ms\n",M,(t1 - t0) / 1e6);
+    freemem(x);
+    printf("%s\n",(errors) ? "Test failed" : "Test passed");
+    return errors;
+}
+
+/* Writes a speech feature file of phonemes of nfrm[] frames each */
+static int write_feature_file(const char* path, const int* nfrm, int cnt)
+{
+    FILE* fp = fopen(path,"w");
+    if (fp == NULL)
+        return 0;
+    fprintf(fp,"phoneme,label,stime,etime,file,fcnt,nfrm,features\n");
+    for (int k = 0; k < cnt; k++) {
+        int label = 1 + (k * 11) % (TIMIT_PHONEME_CNT - 1);
+        fprintf(fp,"%s,%d,%.3f,%.3f,f.wav,%d,%d",timit_phoneme_names[label],
+                label,k * 0.1,k * 0.1 + 0.1,FEAT_CNT,nfrm[k]);
+        for (int i = 0; i < nfrm[k] * FEAT_CNT; i++)
+            fprintf(fp,",%.4f",urand(-1.0,1.0));
+        fprintf(fp,"\n");
+    }
+    fclose(fp);
+    return 1;
+}
+
+/* Test 7: a data source over speech feature files reads the vectors and
+ * labels read_feature_files() reads, and a sequence that cannot be read
+ * fails batches, the mean and standard deviation, and normalizing.
+ */
+int test_featfile(const char* dir)
+{
+    printf("Test 7: data source over speech feature files\n");
+    const int num = 3;
+    const int nfrm[3][4] = { { 3, 5, 1, 4 }, { 7, 2, 6, 0 }, { 2, 9, 3, 5 } };
+    const int cnt[3] = { 4, 3, 4 };
+    char path[256], list[256];
+    snprintf(list,sizeof(list),"%s/list.txt",dir);
+    FILE* fp = fopen(list,"w");
+    for (int i = 0; fp != NULL && i <= num; i++) {
+        /* The list names files with a path and an extension; the last
+         * file is missing, and skipped */
+        fprintf(fp,"dr1/f%d.wav\n",i);
+        snprintf(path,sizeof(path),"%s/dr1_f%d.FEAT",dir,i);
+        if (i < num && !write_feature_file(path,nfrm[i],cnt[i])) {
+            fclose(fp);
+            fp = NULL;
+        }
+    }
+    if (fp == NULL) {
+        printf("Failed to write feature files\n");
+        return 1;
+    }
+    fclose(fp);
+    int errors = 0;
+    const int maxs = 100;
+    int lens[num + 1];
+    float (*x)[EXPENDED_FEAT_CNT] = allocmem(maxs,EXPENDED_FEAT_CNT,float);
+    int* yc = allocmem(maxs,1,int);
+    int n = read_feature_files(dir,list,num + 1,lens,maxs,x,yc);
+    DATASRC* s = featfile_source(dir,list,num + 1);
+    if (n != num || s == NULL || datasrc_num_sequences(s) != num ||
+        s->D != EXPENDED_FEAT_CNT || s->N != REDUCED_PHONEME_CNT) {
+        printf("Feature files data source mismatch\n");
+        datasrc_free(s);
+        freemem(x);
+        freemem(yc);
+        return 1;
+    }
+    /* Sequences out of order, in parts */
+    int off[num];
+    for (int i = 0; i < num; i++)
+        off[i] = (i == 0) ? 0 : off[i - 1] + lens[i - 1];
+    for (int k = 0; k < 2 * num; k++) {
+        int i = (k * 2) % num;
+        errors += (datasrc_sequence_length(s,i) != lens[i]);
+        for (int first = 0; first < lens[i]; first += 4) {
+            int c = (lens[i] - first < 4) ? lens[i] - first : 4;
+            float xs[4][EXPENDED_FEAT_CNT], ys[4][REDUCED_PHONEME_CNT];
+            if (datasrc_read(s,i,first,c,xs,ys) != c) {
+                errors++;
+                continue;
+            }
+            for (int j = 0; j < c; j++) {
+                int v = off[i] + first + j;
+                int label = (yc[v] >= EOP) ? yc[v] - EOP : yc[v];
+                errors += (memcmp(xs[j],x[v],sizeof(xs[j])) != 0);
+                for (int l = 0; l < REDUCED_PHONEME_CNT; l++)
+                    errors += (ys[j][l] != ((l == label) ? 1.0 : 0.0));
+            }
+        }
+    }
+    if (errors)
+        printf("Feature files data source vectors mismatch\n");
+    /* A file that changed since the source was created cannot be read */
+    const int nfrm0[1] = { 2 };
+    snprintf(path,sizeof(path),"%s/dr1_f0.FEAT",dir);
+    write_feature_file(path,nfrm0,1);
+    float xs[1][EXPENDED_FEAT_CNT];
+    float mean[EXPENDED_FEAT_CNT], sdev[EXPENDED_FEAT_CNT];
+    int failed = (datasrc_read(s,1,0,1,xs,NULL) == 1 &&
+                  datasrc_read(s,0,0,1,xs,NULL) == 0);
+    failed += (datasrc_mean_sdev(s,mean,sdev,0) == 0);
+    failed += (datasrc_normalized(s,mean,sdev,0) == NULL);
+    BATCH* b = batch_create_source(s,4,0,0);
+    float xb[4][EXPENDED_FEAT_CNT], yb[4][REDUCED_PHONEME_CNT];
+    int c;
+    while ((c = batch_copy(b,xb,yb)) > 0)
+        ;
+    failed += (c == -1);
+    batch_free(b);
+    if (failed != 4) {
+        printf("Failed reads not reported\n");
+        errors++;
+    }
+    datasrc_free(s);
+    for (int i = 0; i < num; i++) {
+        snprintf(path,sizeof(path),"%s/dr1_f%d.FEAT",dir,i);
+        unlink(path);
+    }
+    unlink(list);
+    freemem(x);
+    freemem(yc);
+    printf("%s\n",(errors) ? "Test failed" : "Test passed");
+    return errors;
+}
+
+int main()
+{
+    int M = 0;
+    for (int i = 0; i < SEQ_CNT; i++)
+        M += len[i];
+    float (*x)[X_DIM] = allocmem(M,X_DIM,float);
+    float (*y)[Y_DIM] = allocmem(M,Y_DIM,float);
+    init_lrng(7);
+    make_data(x,y);
+
+    char filename[64];
+    snprintf(filename,sizeof(filename),"/tmp/testdatasrc-%d.bin",getpid());
+    int errors = 0;
+    errors += test_batches(filename,x,y,M);
+    errors += test_fit(filename,x,y);
+    errors += test_dsfile(filename,x,y,M);
+    errors += test_async_validation(x,y);
+    errors += test_prenormalize(x,y,M);
+    errors += test_mean_sdev();
+    char dir[] = "/tmp/testdatasrc.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        printf("Failed to create directory '%s'\n",dir);
+        errors++;
+    }
+    else {
+        errors += test_featfile(dir);
+        rmdir(dir);
+    }
+    unlink(filename);
+    freemem(x);
+    freemem(y);
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
@@ -1,6 +1,7 @@
 /* Copyright (c) 2023-2024 Gilad Odinak */
 /* Simple test program for the Dense layer implementation */
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include "mem.h"
 #include "random.h"
@@ -133,13 +134,67 @@ static void dense_update_lin(fArr2D Wx_/*[D][S]*/,
             Wx[i][j] -= lr * gWx[i][j];
 }
 
+/* Runs a dense layer initialized for Bmax rows on fewer rows, after a
+ * pass on Bmax rows, and compares its outputs and gradients with those of
+ * a layer initialized for that number of rows, with the same weights.
+ * Returns 1 if they differ.
+ */
+int test_dense_shape(int D, int S, int Bmax, int rows)
+{
+    DENSE* a = dense_create(S,"relu");
+    DENSE* b = dense_create(S,"relu");
+    dense_init(a,D,Bmax);
+    dense_init(b,D,rows);
+    fltcpy(b->Wx,a->Wx,D * S);
+
+    float X[Bmax][D], dy[Bmax][S], dya[Bmax][S], dyb[rows][S];
+    float gWa[D][S], gWb[D][S], dxa[Bmax][D], dxb[rows][D];
+    for (int i = 0; i < Bmax; i++) {
+        for (int j = 0; j < D; j++)
+            X[i][j] = urand(-1.0,1.0);
+        for (int j = 0; j < S; j++)
+            dy[i][j] = urand(-1.0,1.0);
+    }
+    /* A pass on Bmax rows leaves values past the rows in the buffers */
+    fltcpy(dya,dy,Bmax * S);
+    fltclr(gWa,D * S);
+    dense_forward(a,X,0);
+    dense_backward(a,dya,X,gWa,dxa,0);
+
+    dense_set_shape(a,rows);
+    fltcpy(dya,dy,rows * S);
+    fltcpy(dyb,dy,rows * S);
+    fltclr(gWa,D * S);
+    fltclr(gWb,D * S);
+    fArr2D ya = dense_forward(a,X,0);
+    fArr2D yb = dense_forward(b,X,0);
+    int err = memcmp(ya,yb,rows * S * sizeof(float)) != 0;
+    dense_backward(a,dya,X,gWa,dxa,0);
+    dense_backward(b,dyb,X,gWb,dxb,0);
+    err += memcmp(gWa,gWb,sizeof(gWa)) != 0 ||
+           memcmp(dxa,dxb,sizeof(dxb)) != 0;
+    printf("%d of %d rows: %s\n",rows,Bmax,
+           (err) ? "outputs or gradients differ" : "same outputs and gradients");
+    dense_free(a);
+    dense_free(b);
+    return (err) ? 1 : 0;
+}
+
 int main()
 {
+    int errors = 0;
+    init_lrng(42);
+    printf("Dense layer run on fewer rows than it was initialized for\n");
+    errors += test_dense_shape(9,24,16,5);  /* Packed (gemv) kernels */
+    errors += test_dense_shape(9,24,16,11);
+    errors += test_dense_shape(9,24,16,1);
+    printf("%s\n\n",(errors) ? "Test failed" : "Test passed");
+
     init_lrng(42);
     const int layers[3] = {64,128,16};
     const float range[3] = {0.0,5.0,0.1};
     test_dense(range,layers,3,0.0001,200000);
 
-    return 0;
+    return (errors) ? 1 : 0;
 }
 
@@ -0,0 +1,153 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for binary word embedding files */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include "mem.h"
+#include "float.h"
+#include "random.h"
+#include "array.h"
+#include "hash.h"
+#include "findsim.h"
+#include "annoy.h"
+#include "embdfile.h"
+
+#define VOCAB_SIZE 2000   /* Number of words      */
+#define EMBD_DIM   24     /* Embedding dimension  */
+
+/* Creates a vocabulary of made up words; index 0 is padding */
+static HASHMAP* make_vocab(int V)
+{
+    HASHMAP* hmap = hashmap_create(V * 5,V * 8);
+    hashmap_str2inx(hmap,"",1);
+    for (int i = 1; i < V; i++) {
+        char word[16];
+        int n = 0;
+        for (int k = i; k > 0 || n == 0; k /= 26)
+            word[n++] = 'a' + k % 26;
+        word[n++] = 'a' + (i * 7) % 26;
+        word[n] = '\0';
+        hashmap_str2inx(hmap,word,1);
+    }
+    return hmap;
+}
+
+/* Checks the vocabulary and vectors of an embedding file */
+static int check_file(const char* filename, HASHMAP* hmap,
+                      float W[][EMBD_DIM], int vec_type)
+{
+    int errors = 0;
+    EMBDFILE* ef = embdfile_open(filename);
+    if (ef == NULL) {
+        printf("Failed to open embedding file\n");
+        return 1;
+    }
+    if (ef->V != VOCAB_SIZE || ef->E != EMBD_DIM || ef->vec_type != vec_type ||
+        ef->epochs != 3 || ef->learning_rate != 0.005f) {
+        printf("Embedding file header mismatch\n");
+        errors++;
+    }
+    if (strcmp(hashmap_inx2str(&ef->vocab,0),"<unk>") != 0 ||
+        hashmap_str2inx(&ef->vocab,"<unk>",0) != 0 ||
+        hashmap_str2inx(&ef->vocab,"nosuchword",0) != -1) {
+        printf("Padding or unknown word lookup mismatch\n");
+        errors++;
+    }
+    for (int i = 1; i < VOCAB_SIZE; i++) {
+        const char* word = hashmap_inx2str(hmap,i);
+        if (hashmap_str2inx(&ef->vocab,word,0) != i ||
+            strcmp(hashmap_inx2str(&ef->vocab,i),word) != 0) {
+            printf("Vocabulary lookup mismatch for '%s' (%d)\n",word,i);
+            errors++;
+            break;
+        }
+    }
+    typedef float (*ArrVE)[EMBD_DIM];
+    ArrVE We = (ArrVE) ef->W;
+    if (vec_type == EMBD_FLOAT) {
+        if (memcmp(We,W,sizeof(float) * VOCAB_SIZE * EMBD_DIM) != 0) {
+            printf("Embedding vectors mismatch\n");
+            errors++;
+        }
+        if ((long) ef->W % EMBD_ALIGN != 0 ||
+            (char*) ef->W < (char*) ef->base ||
+            (char*) ef->W >= (char*) ef->base + ef->size) {
+            printf("Embedding vectors are not aligned in the mapped file\n");
+            errors++;
+        }
+    }
+    else {
+        /* Half precision has an 11 bit significand */
+        int bad = 0;
+        for (int i = 0; i < VOCAB_SIZE; i++)
+            for (int j = 0; j < EMBD_DIM; j++)
+                if (fabsf(We[i][j] - W[i][j]) > fabsf(W[i][j]) / 2048)
+                    bad++;
+        if (bad > 0) {
+            printf("%d half precision values out of range\n",bad);
+            errors++;
+        }
+    }
+    /* Search the vectors in the file, as is */
+    int topn = 5;
+    int similar[2][topn];
+    float similarity[2][topn];
+    find_most_similar(W,VOCAB_SIZE,EMBD_DIM,W[17],similar[0],similarity[0],topn);
+    find_most_similar((fArr2D) ef->W,VOCAB_SIZE,EMBD_DIM,We[17],
+                      similar[1],similarity[1],topn);
+    if (similar[1][0] != 17 ||
+        (vec_type == EMBD_FLOAT &&
+         memcmp(similar[0],similar[1],sizeof(similar[0])) != 0)) {
+        printf("Most similar vectors mismatch\n");
+        errors++;
+    }
+    ANNOY* annoy = annoy_create((fArr2D) ef->W,VOCAB_SIZE,EMBD_DIM,2);
+    int a_similar[topn];
+    int cnt = annoy_most_similar(annoy,We[17],1.0,a_similar,NULL,topn);
+    if (cnt < 1 || a_similar[0] != 17) {
+        printf("Annoy search on mapped vectors failed\n");
+        errors++;
+    }
+    annoy_free(annoy);
+    embdfile_close(ef);
+    return errors;
+}
+
+int main()
+{
+    init_lrng(42);
+    HASHMAP* hmap = make_vocab(VOCAB_SIZE);
+    float (*W)[EMBD_DIM] = allocmem(VOCAB_SIZE,EMBD_DIM,float);
+    for (int i = 0; i < VOCAB_SIZE; i++)
+        for (int j = 0; j < EMBD_DIM; j++)
+            W[i][j] = urand(-1.0,1.0);
+
+    char filename[64];
+    snprintf(filename,sizeof(filename),"/tmp/testembdfile-%d.bin",getpid());
+    int errors = 0;
+    const char* names[] = { "float", "fp16" };
+    for (int vec_type = EMBD_FLOAT; vec_type <= EMBD_FP16; vec_type++) {
+        printf("Test %d: %s embedding file\n",vec_type + 1,names[vec_type]);
+        int err = 0;
+        if (!embdfile_write(filename,hmap,W,VOCAB_SIZE,EMBD_DIM,vec_type,
+                            0.005,0.8,3)) {
+            printf("Failed to write embedding file\n");
+            err++;
+        }
+        else
+        if (!embdfile_check(filename)) {
+            printf("Embedding file not recognized\n");
+            err++;
+        }
+        else
+            err += check_file(filename,hmap,W,vec_type);
+        printf("%s\n",(err) ? "Test failed" : "Test passed");
+        errors += err;
+    }
+    unlink(filename);
+    hashmap_free(hmap);
+    freemem(W);
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
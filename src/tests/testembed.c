@@ -11,7 +11,9 @@
 #include <ctype.h>
 #include <math.h>
 #include <time.h>
+#include <limits.h>
 #include "mem.h"
+#include "etime.h"
 #include "random.h"
 #include "array.h"
 #include "hash.h"
@@ -46,20 +48,20 @@ static EMBEDDING* make_embedding(void)
 /* Fills an [B][M] index array with random token indices in [0, D).
  * Includes the pad index, so pad handling is exercised.
  */
-static void fill_random_indices(fArr2D X_, int B, int M, int D)
+static void fill_random_indices(iArr2D X_, int B, int M, int D)
 {
-    typedef float (*ArrBM)[M];
+    typedef int (*ArrBM)[M];
     ArrBM X = (ArrBM) X_;
     for (int i = 0; i < B; i++)
         for (int j = 0; j < M; j++)
-            X[i][j] = (float)(int) urand(0.0, (double) D);
+            X[i][j] = (int) urand(0.0, (double) D);
 }
 
 /* Scalar loss L = sum_{i,k} dy[i][k] * h[i][k], where h is the forward output.
  * Using a random dy (rather than all ones) makes the gradient check sensitive
  * to per-row/column mistakes, not just to row sums.
  */
-static float embed_loss(EMBEDDING* l, fArr2D X, fArr2D dy_)
+static float embed_loss(EMBEDDING* l, iArr2D X, fArr2D dy_)
 {
     typedef float (*ArrBE)[l->E];
     ArrBE h  = (ArrBE) embedding_forward(l, X, 0);
@@ -76,12 +78,12 @@ static void test_embedding_zero_forward(EMBEDDING* l)
 {
     printf("Test: embedding zero forward\n");
 
-    float X[BATCH][CTX];
-    fill_random_indices((fArr2D) X, l->B, l->M, l->D);
+    int X[BATCH][CTX];
+    fill_random_indices((iArr2D) X, l->B, l->M, l->D);
     fltclr(l->Wx, l->D * l->E);
 
     typedef float (*ArrBE)[l->E];
-    ArrBE h = (ArrBE) embedding_forward(l, (fArr2D) X, 0);
+    ArrBE h = (ArrBE) embedding_forward(l, (iArr2D) X, 0);
 
     for (int i = 0; i < l->B; i++)
         for (int k = 0; k < l->E; k++)
@@ -102,7 +104,7 @@ static void test_embedding_forward_sum(EMBEDDING* l)
     printf("Test: embedding forward sum\n");
 
     typedef float (*ArrDE)[l->E];
-    typedef float (*ArrBM)[l->M];
+    typedef int (*ArrBM)[l->M];
     typedef float (*ArrBE)[l->E];
 
     ArrDE Wx = (ArrDE) l->Wx;
@@ -110,13 +112,13 @@ static void test_embedding_forward_sum(EMBEDDING* l)
         for (int k = 0; k < l->E; k++)
             Wx[w][k] = (float) w;
 
-    float X[BATCH][CTX];
+    int X[BATCH][CTX];
     ArrBM Xr = (ArrBM) X;
     for (int i = 0; i < l->B; i++)
         for (int j = 0; j < l->M; j++)
-            Xr[i][j] = (float)((i + j) % l->D);   /* deterministic indices */
+            Xr[i][j] = (i + j) % l->D;   /* deterministic indices */
 
-    ArrBE h = (ArrBE) embedding_forward(l, (fArr2D) X, 0);
+    ArrBE h = (ArrBE) embedding_forward(l, (iArr2D) X, 0);
 
     for (int i = 0; i < l->B; i++) {
         float expect = 0;
@@ -142,22 +144,22 @@ static void test_embedding_finite_diff(EMBEDDING* l)
 
     typedef float (*ArrDE)[l->E];
 
-    float X[BATCH][CTX];
+    int X[BATCH][CTX];
     float dy[BATCH][EMBD];
 
     ArrDE Wx   = (ArrDE) l->Wx;
     fArr2D gWx = allocmem(l->D, l->E, float);
     ArrDE g    = (ArrDE) gWx;
 
-    fill_random_indices((fArr2D) X, l->B, l->M, l->D);
+    fill_random_indices((iArr2D) X, l->B, l->M, l->D);
     for (int i = 0; i < l->B; i++)
         for (int k = 0; k < l->E; k++)
             dy[i][k] = urand(-1.0, 1.0);
 
     /* Analytic gradient (dense path). backward does not read Wx, so later
      * perturbing Wx for the finite difference leaves g untouched. */
-    embedding_forward(l, (fArr2D) X, 0);
-    embedding_backward(l, (fArr2D) dy, (fArr2D) X, gWx, NULL, NULL, 0);
+    embedding_forward(l, (iArr2D) X, 0);
+    embedding_backward(l, (fArr2D) dy, (iArr2D) X, gWx, NULL, NULL, 0);
 
     /* Pad row must have zero gradient. */
     for (int k = 0; k < l->E; k++)
@@ -174,9 +176,9 @@ static void test_embedding_finite_diff(EMBEDDING* l)
         for (int k = 0; k < l->E; k++) {
             float old = Wx[w][k];
             Wx[w][k] = old + EPS;
-            float Lp = embed_loss(l, (fArr2D) X, (fArr2D) dy);
+            float Lp = embed_loss(l, (iArr2D) X, (fArr2D) dy);
             Wx[w][k] = old - EPS;
-            float Ln = embed_loss(l, (fArr2D) X, (fArr2D) dy);
+            float Ln = embed_loss(l, (iArr2D) X, (fArr2D) dy);
             Wx[w][k] = old;
 
             float num = (Lp - Ln) / (2 * EPS);
@@ -201,12 +203,12 @@ static void test_embedding_sparse_dense_equiv(EMBEDDING* l)
     printf("Test: embedding sparse vs dense gradient\n");
 
     typedef float (*ArrDE)[l->E];
-    typedef float (*ArrBM)[l->M];
+    typedef int (*ArrBM)[l->M];
 
-    float X[BATCH][CTX];
+    int X[BATCH][CTX];
     float dy[BATCH][EMBD];
 
-    fill_random_indices((fArr2D) X, l->B, l->M, l->D);
+    fill_random_indices((iArr2D) X, l->B, l->M, l->D);
     for (int i = 0; i < l->B; i++)
         for (int k = 0; k < l->E; k++)
             dy[i][k] = urand(-1.0, 1.0);
@@ -216,12 +218,16 @@ static void test_embedding_sparse_dense_equiv(EMBEDDING* l)
     fltclr(gd, l->D * l->E);
     fltclr(gs, l->D * l->E);  /* sparse leaves untouched rows as-is: pre-zero */
 
-    embedding_forward(l, (fArr2D) X, 0);
-    embedding_backward(l, (fArr2D) dy, (fArr2D) X, gd, NULL, NULL, 0);
+    embedding_forward(l, (iArr2D) X, 0);
+    embedding_backward(l, (fArr2D) dy, (iArr2D) X, gd, NULL, NULL, 0);
 
+    /* Repeated sparse passes re-zero the rows they touch, so they give the
+     * same gWx; starting near the largest stamp also exercises wrap around */
     int grows[BATCH * CTX];
     int grcnt = 0;
-    embedding_backward(l, (fArr2D) dy, (fArr2D) X, gs, grows, &grcnt, 0);
+    l->stamp = INT_MAX - 1;
+    for (int n = 0; n < 3; n++)
+        embedding_backward(l, (fArr2D) dy, (iArr2D) X, gs, grows, &grcnt, 0);
 
     ArrDE A = (ArrDE) gd;
     ArrDE Bm = (ArrDE) gs;
@@ -242,7 +248,7 @@ static void test_embedding_sparse_dense_equiv(EMBEDDING* l)
     int expect = 0;
     for (int i = 0; i < l->B; i++)
         for (int j = 0; j < l->M; j++) {
-            int w = (int) Xr[i][j];
+            int w = Xr[i][j];
             if (w != l->padinx && !seen[w]) {
                 seen[w] = 1;
                 expect++;
@@ -269,6 +275,88 @@ static void test_embedding_sparse_dense_equiv(EMBEDDING* l)
     printf("PASS\n");
 }
 
+/* Times the forward pass and the sparse backward pass with a large
+ * vocabulary, and compares them with a scalar forward pass and with the
+ * dense backward pass, which clears the whole gradient matrix. Each context
+ * has a pad token, which the forward pass must skip.
+ */
+static void test_embedding_benchmark(void)
+{
+    const int D = 1000000;  /* vocabulary size     */
+    const int E = 64;       /* embedding dimension */
+    const int M = 8;        /* context length      */
+    const int B = 1024;     /* batch size          */
+    const int N = 20;       /* timed passes        */
+    printf("Test: embedding benchmark, vocab %d embd %d ctx %d batch %d\n",
+           D, E, M, B);
+
+    EMBEDDING* l = embedding_create(E, M, PAD);
+    embedding_init(l, D, B);
+    typedef int (*ArrBM)[M];
+    typedef float (*ArrBE)[E];
+    typedef float (*ArrDE)[E];
+    ArrBM X = (ArrBM) allocmem(B, M, int);
+    ArrBE dy = (ArrBE) allocmem(B, E, float);
+    ArrBE hr = (ArrBE) allocmem(B, E, float);
+    fArr2D gWx = allocmem(D, E, float);
+    int* grows = allocmem(B * M, 1, int);
+    int grcnt = 0;
+    fill_random_indices((iArr2D) X, B, M, D);
+    for (int i = 0; i < B; i++) {
+        X[i][M / 2] = PAD;
+        for (int k = 0; k < E; k++)
+            dy[i][k] = urand(-1.0, 1.0);
+    }
+
+    long long t0 = current_time_ns();
+    for (int n = 0; n < N; n++) {
+        ArrDE Wx = (ArrDE) l->Wx;
+        fltclr(hr, B * E);
+        for (int i = 0; i < B; i++)
+            for (int j = 0; j < M; j++)
+                for (int k = 0; k < E; k++)
+                    hr[i][k] += Wx[X[i][j]][k];
+    }
+    long long t1 = current_time_ns();
+    ArrBE h = NULL;
+    for (int n = 0; n < N; n++)
+        h = (ArrBE) embedding_forward(l, (iArr2D) X, 0);
+    long long t2 = current_time_ns();
+    for (int n = 0; n < N; n++)
+        embedding_backward(l, (fArr2D) dy, (iArr2D) X, gWx, NULL, NULL, 0);
+    long long t3 = current_time_ns();
+    for (int n = 0; n < N; n++)
+        embedding_backward(l, (fArr2D) dy, (iArr2D) X, gWx, grows, &grcnt, 0);
+    long long t4 = current_time_ns();
+
+    printf("  forward %.3f ms (scalar %.3f ms), "
+           "backward sparse %.3f ms (dense %.3f ms), %d rows\n",
+           (t2 - t1) / 1e6 / N, (t1 - t0) / 1e6 / N,
+           (t4 - t3) / 1e6 / N, (t3 - t2) / 1e6 / N, grcnt);
+
+    int ok = 1;
+    for (int i = 0; i < B && ok; i++)
+        for (int k = 0; k < E && ok; k++)
+            if (fabsf(h[i][k] - hr[i][k]) > 1e-5f) {
+                printf("FAIL: h[%d][%d]=%g, scalar %g\n", i, k, h[i][k], hr[i][k]);
+                ok = 0;
+            }
+    if (ok && (grcnt <= 0 || grcnt > B * (M - 1))) {
+        printf("FAIL: %d gradient rows\n", grcnt);
+        ok = 0;
+    }
+    if (ok)
+        printf("PASS\n");
+    else
+        failures++;
+    freemem(X);
+    freemem(dy);
+    freemem(hr);
+    freemem(gWx);
+    freemem(grows);
+    embedding_free(l);
+}
+
 int run_tests(void)
 {
     struct timespec ts;
@@ -287,6 +375,7 @@ int run_tests(void)
     l = make_embedding(); test_embedding_forward_sum(l);         embedding_free(l);
     l = make_embedding(); test_embedding_finite_diff(l);         embedding_free(l);
     l = make_embedding(); test_embedding_sparse_dense_equiv(l);  embedding_free(l);
+    test_embedding_benchmark();
 
     if (failures == 0)
         printf("\nALL TESTS PASSED\n");
@@ -357,12 +446,13 @@ static inline const char* first_nonletter(const char* s)
  * target word, followed by the indices of cs/2 words that come after it,
  * in order,
  */
-static void sent2cxt(int* sw, int swc, fArr2D cxt_, int cs)
+static void sent2cxt(int* sw, int swc, iArr2D cxt_, int cs)
 {
-    typedef float (*ArrCS)[cs];
+    typedef int (*ArrCS)[cs];
     ArrCS cxt = (ArrCS) cxt_;
 
-    fltclr(cxt,swc * cs); /* Set all elements to the pad (index 0) value */
+    /* Set all elements to the pad (index 0) value */
+    memset(cxt,0,swc * cs * sizeof(int));
 
     int m = cs / 2;
     for (int i = 0; i < swc; i++) {
@@ -388,13 +478,28 @@ static inline void swap_rows(fArr2D a_, int M, int N, int i, int j)
     }
 }
 
+/* Swaps row i with row j of index array a[M][N]
+ */
+static inline void swap_index_rows(iArr2D a_, int M, int N, int i, int j)
+{
+    typedef int (*ArrMN)[N];
+    ArrMN a = (ArrMN) a_;
+    (void) M;
+    int t;
+    for (int k = 0; k < N; k++) {
+        t = a[i][k];
+        a[i][k] = a[j][k];
+        a[j][k] = t;
+    }
+}
+
 /* Shuffles the rows of arrays a[M][N], and l[M][1]
  */
-static void shuffle_samples(fArr2D a, fArr2D l, int M, int N)
+static void shuffle_samples(iArr2D a, fArr2D l, int M, int N)
 {
     for (int i = M - 1; i > 0; i--) {
         int j = (int) urand(0.0,1.0 + i);
-        swap_rows(a,M,N,i,j);
+        swap_index_rows(a,M,N,i,j);
         swap_rows(l,M,1,i,j);
     }
 }
@@ -502,7 +607,7 @@ int run_demo(void)
     hashmap_str2inx(hmap,"",1); /* Reserve first entry (index 0) for pad */
 
     /* Create contexts */
-    float contexts[cxt_cnt][cxt_size];
+    int contexts[cxt_cnt][cxt_size];
     float labels[cxt_cnt][1];
     int cxt_inx = 0;
     for (int i = 0; i < sent_cnt && cxt_inx < cxt_cnt; i++) {
@@ -527,7 +632,7 @@ int run_demo(void)
             swc = cxt_cnt - cxt_inx;
 
         /* Create contexts from sentence word indices */
-        sent2cxt(sw,swc,(fArr2D) contexts[cxt_inx],cxt_size);
+        sent2cxt(sw,swc,(iArr2D) contexts[cxt_inx],cxt_size);
 
         /* Label the context */
         for (int r = 0; r < swc; r++)
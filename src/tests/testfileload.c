@@ -0,0 +1,236 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for loading many files with many reads in flight */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "mem.h"
+#include "etime.h"
+#include "fileload.h"
+#include "wav.h"
+#include "sphere.h"
+
+/* Contents of file i: size bytes that depend on i */
+static long file_size(int i) { return (i % 7 == 0) ? 0 : (i * 7919L) % 20000; }
+static char file_byte(int i, long k) { return 'a' + (i * 31 + k) % 26; }
+
+/* Creates num files in dir, named f<i>; returns their names */
+static char** create_files(const char* dir, int num)
+{
+    char** names = allocmem(num,1,char*);
+    for (int i = 0; i < num; i++) {
+        names[i] = allocmem(16,1,char);
+        snprintf(names[i],16,"f%d",i);
+        char path[512];
+        snprintf(path,sizeof(path),"%s/%s",dir,names[i]);
+        FILE* fp = fopen(path,"wb");
+        for (long k = 0; k < file_size(i); k++)
+            fputc(file_byte(i,k),fp);
+        fclose(fp);
+    }
+    return names;
+}
+
+/* Returns 1 if f does not have the contents of file i */
+static int check(const LOADEDFILE* f, int i)
+{
+    if (f->index != i || f->error != 0 || f->data == NULL ||
+        f->size != file_size(i) || f->data[f->size] != '\0')
+        return 1;
+    for (long k = 0; k < f->size; k++)
+        if (f->data[k] != file_byte(i,k))
+            return 1;
+    return 0;
+}
+
+/* Test 1: every file is returned once, with its contents, in the order
+ * files complete; a missing file is returned with an error
+ */
+static int test_next(const char* dir, char** names, int num, int depth)
+{
+    int errors = 0;
+    long long t0 = current_time_ns();
+    long bytes = 0;
+    for (int i = 0; i < num; i++) {
+        char path[512];
+        snprintf(path,sizeof(path),"%s/%s",dir,names[i]);
+        FILE* fp = fopen(path,"rb");
+        char buf[20000];
+        bytes += fread(buf,1,sizeof(buf),fp);
+        fclose(fp);
+    }
+    long long t1 = current_time_ns();
+    FILELOAD* q = fileload_create(dir,names,num + 1,depth);
+    const char* method = fileload_method(q);
+    int* seen = allocmem(num + 1,1,int);
+    int cnt = 0;
+    for (LOADEDFILE* f; (f = fileload_next(q)) != NULL; cnt++) {
+        seen[f->index]++;
+        if (f->index == num)
+            errors += (f->data != NULL || f->error != ENOENT);
+        else
+            errors += check(f,f->index);
+        fileload_release(q,f);
+    }
+    long long t2 = current_time_ns();
+    fileload_free(q);
+    for (int i = 0; i <= num; i++)
+        errors += (seen[i] != 1);
+    errors += (cnt != num + 1);
+    printf("  %d files (%ld bytes), depth %d, %s: %s, %.3f ms, "
+           "one at a time %.3f ms (files cached)\n",num,bytes,depth,method,
+           (errors) ? "wrong files" : "same contents",
+           (t2 - t1) / 1e6,(t1 - t0) / 1e6);
+    freemem(seen);
+    return errors ? 1 : 0;
+}
+
+/* Test 2: files taken in order have their contents; a loader freed with
+ * files in flight, and files not released, frees them
+ */
+static int test_get(const char* dir, char** names, int num, int depth)
+{
+    int errors = 0;
+    FILELOAD* q = fileload_create(dir,names,num,depth);
+    const char* method = fileload_method(q);
+    for (int i = 0; i < num; i++) {
+        LOADEDFILE* f = fileload_get(q,i);
+        errors += (f == NULL || check(f,i));
+        if (f != NULL)
+            fileload_release(q,f);
+    }
+    errors += (fileload_get(q,0) != NULL);
+    fileload_free(q);
+    q = fileload_create(dir,names,num,depth);
+    LOADEDFILE* f = fileload_get(q,0);
+    errors += (f == NULL || check(f,0));
+    fileload_free(q);
+    printf("  %d files, depth %d, %s: %s\n",num,depth,method,
+           (errors) ? "wrong files" : "same contents");
+    return errors ? 1 : 0;
+}
+
+/* Test 3: audio read from loaded contents is the audio read from the file */
+static int test_audio(const char* dir)
+{
+    const int n = 5000;
+    int errors = 0;
+    char* names[2] = { "a.wav", "a.sph" };
+    char path[512];
+    int16_t pcm[n];
+    for (int i = 0; i < n; i++)
+        pcm[i] = (int16_t) ((i * 7919) % 65536 - 32768);
+
+    snprintf(path,sizeof(path),"%s/%s",dir,names[0]);
+    WAVFILE wf = { .audioFormat = 1, .numChannels = 1, .sampleRate = 16000,
+                   .bitDepth = 16 };
+    errors += (openWavFile(path,"w",&wf) == NULL);
+    errors += (writeWavFile(&wf,pcm,n) != (size_t) n);
+    closeWavFile(&wf);
+
+    snprintf(path,sizeof(path),"%s/%s",dir,names[1]);
+    FILE* fp = fopen(path,"wb");
+    char hdr[1024];
+    memset(hdr,' ',sizeof(hdr));
+    int len = snprintf(hdr,sizeof(hdr),
+                       "NIST_1A\n   1024\nsample_coding -s3 pcm\n"
+                       "channel_count -i 1\nsample_rate -i 16000\n"
+                       "sample_n_bytes -i 2\nsample_count -i %d\n"
+                       "sample_byte_format -s2 01\nend_head\n",n + 512);
+    hdr[len] = ' ';
+    fwrite(hdr,1,sizeof(hdr),fp);
+    fwrite(pcm,sizeof(pcm[0]),n,fp);
+    fclose(fp);
+
+    FILELOAD* q = fileload_create(dir,names,2,0);
+    LOADEDFILE* f = fileload_get(q,0);
+    int16_t buf[n];
+    WAVFILE wb;
+    if (f->data == NULL || openWavBuffer(f->name,f->data,f->size,&wb) == NULL)
+        errors++;
+    else {
+        errors += (readWavFile(&wb,buf,n + 1) != (size_t) n ||
+                   memcmp(buf,pcm,sizeof(pcm)) != 0);
+        closeWavFile(&wb);
+    }
+    fileload_release(q,f);
+
+    f = fileload_get(q,1);
+    snprintf(path,sizeof(path),"%s/%s",dir,names[1]);
+    SPHFILE sf, sb;
+    float x[n], xb[n];
+    if (f->data == NULL || openSphereFile(path,"r",&sf) == NULL ||
+        openSphereBuffer(f->name,f->data,f->size,&sb) == NULL)
+        errors++;
+    else {
+        size_t cnt = readSphereAudio(&sf,x,n);
+        size_t cb = readSphereAudio(&sb,xb,n);
+        errors += (cnt != (size_t) n || cb != cnt ||
+                   memcmp(x,xb,sizeof(x)) != 0);
+        closeSphereFile(&sf);
+        closeSphereFile(&sb);
+    }
+    fileload_release(q,f);
+    fileload_free(q);
+    for (int i = 0; i < 2; i++) {
+        snprintf(path,sizeof(path),"%s/%s",dir,names[i]);
+        remove(path);
+    }
+    printf("  wav and sphere audio: %s\n",
+           (errors) ? "audio differs" : "same audio");
+    return errors;
+}
+
+int main()
+{
+    const int num = 2000;
+    int errors = 0;
+    int err;
+
+    char dir[] = "/tmp/testfileload.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr,"Failed to create directory '%s'\n",dir);
+        return 1;
+    }
+    char** names = allocmem(num + 1,1,char*);
+    char** created = create_files(dir,num);
+    memcpy(names,created,num * sizeof(char*));
+    names[num] = "missing";
+
+    printf("Test 1: files in completion order\n");
+    err = test_next(dir,names,num,0) + test_next(dir,names,num,1) +
+          test_next(dir,names,num,256);
+    setenv("MLINC_IO_URING","0",1);
+    err += test_next(dir,names,num,0) + test_next(dir,names,num,3);
+    unsetenv("MLINC_IO_URING");
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 2: files in order\n");
+    err = test_get(dir,names,num,2) + test_get(dir,names,num,0);
+    setenv("MLINC_IO_URING","0",1);
+    err += test_get(dir,names,num,2) + test_get(dir,names,num,0);
+    unsetenv("MLINC_IO_URING");
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 3: audio files in memory\n");
+    err = test_audio(dir);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    for (int i = 0; i < num; i++) {
+        char path[512];
+        snprintf(path,sizeof(path),"%s/%s",dir,created[i]);
+        remove(path);
+        freemem(created[i]);
+    }
+    rmdir(dir);
+    freemem(created);
+    freemem(names);
+
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
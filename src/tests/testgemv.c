@@ -0,0 +1,151 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for the small batch kernels of packed weights */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mem.h"
+#include "random.h"
+#include "array.h"
+#include "gemv.h"
+#include "dense.h"
+#include "lstm.h"
+#include "testutil.h"
+
+#define REPS 20
+
+/* Test 1: gemv() and addGemv() compute the same product as matmul() */
+static int test_gemv(int N, int d, int M)
+{
+    float* x = allocmem(N,d,float);
+    float* y = allocmem(d,M,float);
+    float* r0 = allocmem(N,M,float);
+    float* r = allocmem(N,M,float);
+    float* p = allocmem(1,gemv_packed_size(d,M),float);
+    fill(x,N * d);
+    fill(y,d * M);
+    gemv_pack(p,(fArr2D) y,d,M);
+    matmul((fArr2D) r0,(fArr2D) x,(fArr2D) y,N,d,M);
+    fill(r,N * M); /* gemv() must overwrite r */
+    gemv((fArr2D) r,(fArr2D) x,p,N,d,M);
+    int errors = differ(r0,r,N * M,1e-5);
+    /* r0 + x @ y */
+    fltcpy(r,r0,N * M);
+    addGemv((fArr2D) r,(fArr2D) x,p,N,d,M);
+    for (long i = 0; i < (long) N * M; i++)
+        r0[i] *= 2;
+    errors += differ(r0,r,N * M,1e-5);
+    printf("  %dx%dx%d: %s\n",N,d,M,(errors) ? "results differ" : "same results");
+    freemem(x);
+    freemem(y);
+    freemem(r0);
+    freemem(r);
+    freemem(p);
+    return errors;
+}
+
+/* Test 2: dense_forward() of small batches gives the same results as the
+ * matrix product, also after the weights change; and is faster
+ */
+static int test_dense(int D, int S)
+{
+    const int B = GEMV_MAX_ROWS;
+    DENSE* l = dense_create(S,"none");
+    dense_init(l,D,B);
+    float* X = allocmem(B,D,float);
+    float* h = allocmem(B,S,float);
+    fill(X,B * D);
+    int errors = 0;
+    for (int b = 1; b < B; b++) {
+        dense_set_shape(l,b);
+        dense_forward(l,(fArr2D) X,0);
+        matmul((fArr2D) h,(fArr2D) X,l->Wx,b,D,S);
+        errors += differ(h,(float*) l->h,b * S,1e-5);
+    }
+    /* Changed weights are packed again */
+    fill((float*) l->Wx,(long) D * S);
+    l->packed = 0;
+    dense_set_shape(l,1);
+    dense_forward(l,(fArr2D) X,0);
+    matmul((fArr2D) h,(fArr2D) X,l->Wx,1,D,S);
+    errors += differ(h,(float*) l->h,S,1e-5);
+    printf("  dense %dx%d: %s\n",D,S,
+           (errors) ? "results differ" : "same results");
+    for (int b = 1; b < B; b *= 2) {
+        double tp, tm;
+        dense_set_shape(l,b);
+        MIN_TIME(tp,REPS,dense_forward(l,(fArr2D) X,0));
+        MIN_TIME(tm,REPS,dense_matmul(l,(fArr2D) X,D));
+        printf("    batch %d: %.3f ms packed, %.3f ms matmul\n",b,
+               tp * 1000,tm * 1000);
+    }
+    dense_free(l);
+    freemem(X);
+    freemem(h);
+    return errors;
+}
+
+/* Test 3: a stateful LSTM run one time step at a time (packed weights)
+ * gives the same results as run on the whole sequence at once
+ */
+static int test_lstm(int D, int S)
+{
+    const int T = 32;
+    LSTM* l = lstm_create(S,1);
+    lstm_init(l,D,T);
+    float* X = allocmem(T,D,float);
+    float* h = allocmem(T,S,float);
+    fill(X,T * D);
+    lstm_forward(l,(fArr2D) X,0);
+    fltcpy(h,(float*) l->h + S,T * S);
+    lstm_reset(l);
+    lstm_set_shape(l,1);
+    int errors = 0;
+    for (int t = 0; t < T; t++) {
+        fArr2D ht = lstm_forward(l,(fArr2D) (X + t * D),0);
+        errors += differ(h + t * S,(float*) ht,S,1e-5);
+    }
+    double tp, tm;
+    MIN_TIME(tp,REPS / 4,
+        for (int t = 0; t < T; t++)
+            lstm_forward(l,(fArr2D) (X + t * D),0));
+    lstm_set_shape(l,T);
+    MIN_TIME(tm,REPS / 4,lstm_forward(l,(fArr2D) X,0));
+    tp /= T;
+    tm /= T;
+    printf("  lstm %dx%d per step: %s, %.3f ms packed, %.3f ms sequence\n",
+           D,S,(errors) ? "results differ" : "same results",
+           tp * 1000,tm * 1000);
+    lstm_free(l);
+    freemem(X);
+    freemem(h);
+    return errors;
+}
+
+int main()
+{
+    init_lrng(42);
+    int errors = 0;
+    int err;
+
+    printf("Test 1: packed products\n");
+    err = 0;
+    for (int N = 1; N <= 2 * GEMV_ROWS + 1; N++)
+        err += test_gemv(N,71,100) + test_gemv(N,15,48);
+    err += test_gemv(1,1,1) + test_gemv(3,300,17) + test_gemv(1,1024,1024);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 2: dense small batches\n");
+    err = test_dense(71,64) + test_dense(513,1024) + test_dense(1024,4096);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 3: lstm time steps\n");
+    err = test_lstm(15,100) + test_lstm(129,256) + test_lstm(513,512);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
@@ -0,0 +1,224 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for the GRU layer implementation */
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "mem.h"
+#include "random.h"
+#include "array.h"
+#include "gru.h"
+#include "lstm.h"
+#include "dense.h"
+#include "model.h"
+#include "modelio.h"
+#include "testutil.h"
+
+/* Returns the sum of the outputs weighted by w, whose gradient, with
+ * respect to the outputs, is w
+ */
+static double weighted_sum(GRU* l, const float* X, const float* w)
+{
+    l->packed = 0;
+    const float* h = (const float*) gru_forward(l,(fArr2D) X,0);
+    double sum = 0;
+    for (int i = 0; i < l->B * l->S; i++)
+        sum += h[i] * w[i];
+    return sum;
+}
+
+/* Test 1: the gradients computed by gru_backward() match the gradients
+ * computed by finite differences
+ */
+static int test_gradients(int D, int S, int B)
+{
+    const float eps = 1e-2;
+    GRU* l = gru_create(S,0);
+    gru_init(l,D,B);
+    float* X = allocmem(B,D,float);
+    float* w = allocmem(B,S,float);
+    float* dX = allocmem(B,D,float);
+    fill(X,B * D);
+    fill(w,B * S);
+    fArr2D g[6];
+    for (int k = 0; k < 6; k++)
+        g[k] = allocmem((k < 3) ? D : S,S,float);
+    gru_forward(l,(fArr2D) X,0);
+    gru_backward(l,(fArr2D) w,(fArr2D) X,g,(fArr2D) dX,0);
+
+    fArr2D W[7] = { l->Wz, l->Wr, l->Wh, l->Uz, l->Ur, l->Uh, (fArr2D) X };
+    const float* G[7] = { (float*) g[0], (float*) g[1], (float*) g[2],
+                          (float*) g[3], (float*) g[4], (float*) g[5], dX };
+    const long n[7] = { D * S, D * S, D * S, S * S, S * S, S * S, B * D };
+    double max_err = 0;
+    for (int k = 0; k < 7; k++)
+        for (long i = 0; i < n[k]; i++) {
+            float* v = (float*) W[k] + i;
+            float v0 = *v;
+            *v = v0 + eps;
+            double lp = weighted_sum(l,X,w);
+            *v = v0 - eps;
+            double lm = weighted_sum(l,X,w);
+            *v = v0;
+            double err = fabs((lp - lm) / (2 * eps) - G[k][i]);
+            if (err > max_err)
+                max_err = err;
+        }
+    int errors = (max_err > 1e-3);
+    printf("  %dx%d, %d time steps: largest difference %.6f\n",D,S,B,max_err);
+    for (int k = 0; k < 6; k++)
+        freemem(g[k]);
+    gru_free(l);
+    freemem(X);
+    freemem(w);
+    freemem(dX);
+    return errors;
+}
+
+/* Test 2: a stateful GRU run one time step at a time (packed weights)
+ * gives the same results as run on the whole sequence at once
+ */
+static int test_steps(int D, int S)
+{
+    const int T = 32;
+    GRU* l = gru_create(S,1);
+    gru_init(l,D,T);
+    float* X = allocmem(T,D,float);
+    float* h = allocmem(T,S,float);
+    fill(X,T * D);
+    gru_forward(l,(fArr2D) X,0);
+    fltcpy(h,(float*) l->h + S,T * S);
+    gru_reset(l);
+    gru_set_shape(l,1);
+    int errors = 0;
+    for (int t = 0; t < T; t++) {
+        fArr2D ht = gru_forward(l,(fArr2D) (X + t * D),0);
+        errors += differ(h + t * S,(float*) ht,S,1e-5);
+    }
+    /* Changed weights are packed again */
+    fill((float*) l->Uh,(long) S * S);
+    l->packed = 0;
+    gru_reset(l);
+    gru_set_shape(l,T);
+    gru_forward(l,(fArr2D) X,0);
+    fltcpy(h,(float*) l->h + S,T * S);
+    gru_reset(l);
+    gru_set_shape(l,1);
+    for (int t = 0; t < T; t++) {
+        fArr2D ht = gru_forward(l,(fArr2D) (X + t * D),0);
+        errors += differ(h + t * S,(float*) ht,S,1e-5);
+    }
+    printf("  %dx%d: %s\n",D,S,(errors) ? "results differ" : "same results");
+    gru_free(l);
+    freemem(X);
+    freemem(h);
+    return errors;
+}
+
+/* Test 3: a model of GRU layers learns f(x) = sin(x) + 0.4 * sin(1.6 + 1.5 * x),
+ * and predicts the same values after it is stored and loaded; the time of
+ * an epoch is compared to that of a model of LSTM layers of the same size
+ */
+static inline float f(float x) { return sin(x) + 0.4 * sin(1.6 + 1.5 * x); }
+static MODEL* create(const char* type, int L, int M, int D, int S,
+                     const char* optimizer)
+{
+    MODEL* m = model_create(L,M,D,0,0); /* don't add bias, don't normalize */
+    for (int i = 0; i < L - 1; i++)
+        if (type[0] == 'g')
+            model_add(m,gru_create(S,1),"gru");
+        else
+            model_add(m,lstm_create(S,1),"lstm");
+    model_add(m,dense_create(1,"none"),"dense");
+    model_compile(m,"mean-square-error",optimizer);
+    return m;
+}
+
+static int test_model(const char* optimizer, float learning_rate,
+                      int epochs)
+{
+    const int L = 3;  /* Layers, including output layer            */
+    const int S = 32; /* Units of each recurrent layer             */
+    const int D = 2;  /* Input vector dimension (including bias)   */
+    const int M = 200;
+    float (*X)[D] = allocmem(M,D,float);
+    float (*yt)[1] = allocmem(M,1,float);
+    float (*y)[1] = allocmem(M,1,float);
+    float (*yl)[1] = allocmem(M,1,float);
+    for (int i = 0; i < M ; i++) {
+        X[i][0] = -10.0 + 0.1 * i;
+        X[i][1] = 1.0;
+        yt[i][0] = f(X[i][0]);
+    }
+    float losses[epochs];
+    MODEL* m = create("gru",L,M,D,S,optimizer);
+    long long t0 = current_time_ns();
+    model_fit(m,(fArr2D) X,(fArr2D) yt,NULL,M,
+              NULL,NULL,NULL,0,
+              epochs,learning_rate,0.0,
+              losses,NULL,NULL,NULL,
+              "shuffle=0");
+    double tg = (current_time_ns() - t0) / 1e9 / epochs;
+    float loss = losses[epochs - 1];
+    int errors = (loss > 0.5 * losses[0]);
+    /* Store and load, with the gradients, and train some more */
+    model_predict(m,(fArr2D) X,(fArr2D) y,M);
+    const char* filename = "/tmp/testgru.model";
+    errors += !store_model(m,filename);
+    MODEL* ml = load_model(filename);
+    errors += (ml == NULL);
+    if (ml != NULL) {
+        model_predict(ml,(fArr2D) X,(fArr2D) yl,M);
+        errors += differ((float*) y,(float*) yl,M,1e-5);
+        model_fit(ml,(fArr2D) X,(fArr2D) yt,NULL,M,
+                  NULL,NULL,NULL,0,
+                  1,learning_rate,0.0,
+                  losses,NULL,NULL,NULL,
+                  "shuffle=0 final=1");
+        model_free(ml);
+    }
+    remove(filename);
+    model_free(m);
+
+    m = create("lstm",L,M,D,S,optimizer);
+    t0 = current_time_ns();
+    model_fit(m,(fArr2D) X,(fArr2D) yt,NULL,M,
+              NULL,NULL,NULL,0,
+              epochs / 10,learning_rate,0.0,
+              losses,NULL,NULL,NULL,
+              "shuffle=0 final=1");
+    double tl = (current_time_ns() - t0) / 1e9 / (epochs / 10);
+    model_free(m);
+    printf("  %s: loss %.6f, %s after load; %.3f ms per epoch, lstm %.3f ms\n",
+           optimizer,loss,(errors) ? "failed" : "same predictions",
+           tg * 1000,tl * 1000);
+    freemem(X);
+    freemem(yt);
+    freemem(y);
+    freemem(yl);
+    return errors;
+}
+
+int main()
+{
+    init_lrng(42);
+    int errors = 0;
+    int err;
+
+    printf("Test 1: gradients\n");
+    err = test_gradients(3,4,5) + test_gradients(7,16,9);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 2: gru time steps\n");
+    err = test_steps(15,100) + test_steps(129,256);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 3: gru model\n");
+    err = test_model("adamw",0.001,500) + test_model("linear",0.01,500);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
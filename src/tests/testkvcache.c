@@ -0,0 +1,220 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for the paged cache of attention keys and values */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mem.h"
+#include "random.h"
+#include "array.h"
+#include "kvcache.h"
+#include "mha.h"
+#include "dense.h"
+#include "transformer.h"
+#include "model.h"
+#include "testutil.h"
+
+/* Test 1: blocks are taken, shared, copied on write, and returned */
+static int test_pool(void)
+{
+    const int n = 8;
+    int errors = 0;
+    KVPOOL* p = kvpool_create(2,4,n);
+    KVSEQ* s = kvseq_create();
+    /* A prompt of one and a half blocks */
+    errors += (kvseq_reserve(p,s,KV_BLOCK + KV_BLOCK / 2) != 0);
+    s->len = KV_BLOCK + KV_BLOCK / 2;
+    *kv_key(p,s,1,s->len - 1) = 1.0;
+    errors += (p->num_free != n - 2);
+    /* Forks share both blocks */
+    KVSEQ* f1 = kvseq_fork(p,s);
+    KVSEQ* f2 = kvseq_fork(p,s);
+    errors += (p->num_free != n - 2 || p->refs[s->table[1]] != 3);
+    /* Writing to the shared last block copies it */
+    errors += (kvseq_reserve(p,f1,1) != 0);
+    errors += (p->num_free != n - 3 || f1->table[0] != s->table[0] ||
+               f1->table[1] == s->table[1] || *kv_key(p,f1,1,s->len - 1) != 1.0);
+    /* The pool is too small for five more blocks and a copy */
+    errors += (kvseq_reserve(p,f2,5 * KV_BLOCK) != -1 ||
+               p->num_free != n - 3 || f2->num_blocks != 2);
+    /* Dropped blocks are released once no session uses them */
+    kvseq_drop(p,s,KV_BLOCK);
+    errors += (p->num_free != n - 3 || s->table[0] != -1);
+    kvseq_drop(p,f1,KV_BLOCK);
+    kvseq_drop(p,f2,KV_BLOCK);
+    errors += (p->num_free != n - 2);
+    kvseq_free(p,s);
+    kvseq_free(p,f1);
+    kvseq_free(p,f2);
+    errors += (p->num_free != n);
+    printf("  %d blocks: %s\n",n,(errors) ? "wrong counts" : "counts match");
+    kvpool_free(p);
+    return errors;
+}
+
+/* Test 2: an attention layer run on chunks of a sequence, and on sessions
+ * forked from a prompt, through the cache, gives the same outputs as run
+ * on each whole sequence
+ */
+static int test_mha(int H, int T, int D)
+{
+    const int S = 3;          /* Sessions forked from the prompt */
+    const int P = T / 2 + 1;  /* Prompt length                   */
+    int errors = 0;
+    MHA* l = mha_create(H,T,0,"softmax");
+    mha_init(l,D,S,0,0.0);
+    KVPOOL* p = kvpool_create(1,D,S * (T / KV_BLOCK + 2));
+    float* X = allocmem(S * T,D,float);
+    float* Y = allocmem(S * T,D,float);
+    float* Yc = allocmem(S * T,D,float);
+    float* xb = allocmem(S,D,float);
+    float* yb = allocmem(S,D,float);
+    fill(X,(long) S * T * D);
+    /* Sessions share the prompt; the rest of each is its own */
+    for (int s = 1; s < S; s++)
+        fltcpy(X + s * T * D,X,P * D);
+    mha_set_shape(l,S,T);
+    mha_forward(l,(fArr2D) X,NULL,(fArr2D) Y,0,0);
+
+    /* The prompt in chunks, then S sessions one token at a time */
+    KVSEQ* seqs[S];
+    seqs[0] = kvseq_create();
+    for (int t = 0; t < P; ) {
+        int n = (P - t < 5) ? P - t : 5;
+        mha_set_shape(l,1,n);
+        errors += (kvseq_reserve(p,seqs[0],n) != 0);
+        mha_forward_paged(l,p,seqs,(fArr2D) (X + t * D),(fArr2D) (Yc + t * D),0,0);
+        seqs[0]->len += n;
+        t += n;
+    }
+    for (int s = 1; s < S; s++) {
+        seqs[s] = kvseq_fork(p,seqs[0]);
+        fltcpy(Yc + s * T * D,Yc,P * D);
+    }
+    mha_set_shape(l,S,1);
+    for (int t = P; t < T; t++) {
+        for (int s = 0; s < S; s++) {
+            errors += (kvseq_reserve(p,seqs[s],1) != 0);
+            fltcpy(xb + s * D,X + (s * T + t) * D,D);
+        }
+        mha_forward_paged(l,p,seqs,(fArr2D) xb,(fArr2D) yb,0,0);
+        for (int s = 0; s < S; s++) {
+            seqs[s]->len++;
+            fltcpy(Yc + (s * T + t) * D,yb + s * D,D);
+        }
+    }
+    errors += differ(Y,Yc,(long) S * T * D,1e-4);
+    int used = p->num_blocks - p->num_free;
+    printf("  %d heads %dx%d, %d sessions: %s, %d blocks (%d unshared)\n",
+           H,T,D,S,(errors) ? "results differ" : "same results",used,
+           S * ((T + KV_BLOCK - 1) / KV_BLOCK));
+    for (int s = 0; s < S; s++)
+        kvseq_free(p,seqs[s]);
+    if (p->num_free != p->num_blocks)
+        errors++;
+    kvpool_free(p);
+    mha_free(l);
+    freemem(X);
+    freemem(Y);
+    freemem(Yc);
+    freemem(xb);
+    freemem(yb);
+    return errors;
+}
+
+/* Test 3: a model generating one token at a time through the cache gives
+ * the same outputs as predicting the whole sequence; sessions longer than
+ * the model's sequence length keep only the blocks they attend to; and
+ * generation is faster than predicting the window of each token
+ */
+static int test_model(int T, int D, int K)
+{
+    const int S = 4;  /* Sessions */
+    int errors = 0;
+    init_lrng(42);
+    MODEL* m = model_create(4,T,K,0,0);
+    model_add(m,dense_create(D,"none"),"dense");
+    model_add(m,transformer_create(4,T,D,4 * D,0),"transformer");
+    model_add(m,transformer_create(4,T,D,4 * D,0),"transformer");
+    model_add(m,dense_create(K,"softmax"),"dense");
+    model_compile(m,"cross-entropy","adamw");
+    float (*x)[K] = allocmem(T,K,float);
+    float (*y)[K] = allocmem(T,K,float);
+    float (*yc)[K] = allocmem(T,K,float);
+    float (*xs)[K] = allocmem(S,K,float);
+    for (int t = 0; t < T; t++)
+        x[t][rand() % K] = 1.0;
+    model_predict(m,(fArr2D) x,(fArr2D) y,T);
+
+    KVPOOL* p = model_kvpool(m,S * (T / KV_BLOCK + 2));
+    KVSEQ* seqs[S];
+    seqs[0] = kvseq_create();
+    for (int t = 0; t < T; t++)
+        errors += (model_predict_paged(m,p,seqs,1,1,(fArr2D) x[t],(fArr2D) yc[t]) != 0);
+    errors += differ((float*) y,(float*) yc,T * K,1e-4);
+    printf("  model %dx%d: %s\n",T,D,(errors) ? "results differ" : "same results");
+
+    /* S sessions forked after one token generate 3 * T tokens */
+    kvseq_drop(p,seqs[0],seqs[0]->len - T + 1);
+    for (int s = 1; s < S; s++)
+        seqs[s] = kvseq_fork(p,seqs[0]);
+    int max_used = 0;
+    long long t0 = current_time_ns();
+    for (int t = 0; t < 3 * T; t++) {
+        fltclr(xs,S * K);
+        for (int s = 0; s < S; s++)
+            xs[s][rand() % K] = 1.0;
+        errors += (model_predict_paged(m,p,seqs,S,1,(fArr2D) xs,(fArr2D) yc) != 0);
+        for (int s = 0; s < S; s++)
+            kvseq_drop(p,seqs[s],seqs[s]->len - T + 1);
+        int used = p->num_blocks - p->num_free;
+        if (used > max_used)
+            max_used = used;
+    }
+    double tp = (current_time_ns() - t0) / 1e9 / (3 * T);
+    if (max_used > S * (T / KV_BLOCK + 2))
+        errors++;
+    t0 = current_time_ns();
+    for (int t = 0; t < 3 * T; t++)
+        for (int s = 0; s < S; s++)
+            model_predict(m,(fArr2D) x,(fArr2D) y,T);
+    double tw = (current_time_ns() - t0) / 1e9 / (3 * T);
+    printf("  %d sessions of %d tokens: at most %d blocks of %d tokens, "
+           "%.3f ms per step, %.3f ms predicting windows\n",
+           S,seqs[0]->len,max_used,KV_BLOCK,tp * 1000,tw * 1000);
+    for (int s = 0; s < S; s++)
+        kvseq_free(p,seqs[s]);
+    kvpool_free(p);
+    model_free(m);
+    freemem(x);
+    freemem(y);
+    freemem(yc);
+    freemem(xs);
+    return errors;
+}
+
+int main()
+{
+    init_lrng(42);
+    srand(42);
+    int errors = 0;
+    int err;
+
+    printf("Test 1: block pool\n");
+    err = test_pool();
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 2: paged attention\n");
+    err = test_mha(2,40,16) + test_mha(4,64,64) + test_mha(1,7,6);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 3: model generation\n");
+    err = test_model(64,64,32);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
@@ -1,6 +1,7 @@
 /* Copyright (c) 2023-2024 Gilad Odinak */
 /* Simple test program for the LSTM layer implementation */
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include "mem.h"
 #include "random.h"
@@ -149,12 +150,78 @@ int test_lstm(const float range[3], const int layers[], int layers_cnt,
     return 0;
 }
 
+/* Runs an LSTM layer initialized for Bmax time steps on fewer steps,
+ * after a pass on Bmax steps, and compares its outputs and gradients with
+ * those of a layer initialized for that number of steps, with the same
+ * weights. Returns 1 if they differ.
+ */
+int test_lstm_shape(int D, int S, int Bmax, int rows)
+{
+    LSTM* a = lstm_create(S,1);
+    LSTM* b = lstm_create(S,1);
+    lstm_init(a,D,Bmax);
+    lstm_init(b,D,rows);
+    fArr2D Wa[8] = { a->Wf, a->Wi, a->Wc, a->Wo, a->Uf, a->Ui, a->Uc, a->Uo };
+    fArr2D Wb[8] = { b->Wf, b->Wi, b->Wc, b->Wo, b->Uf, b->Ui, b->Uc, b->Uo };
+    fArr2D ga[8], gb[8];
+    for (int k = 0; k < 8; k++) {
+        int R = (k < 4) ? D : S;
+        fltcpy(Wb[k],Wa[k],R * S);
+        ga[k] = allocmem(R,S,float);
+        gb[k] = allocmem(R,S,float);
+    }
+    float X[Bmax][D], dy[Bmax][S], dxa[Bmax][D], dxb[rows][D];
+    for (int i = 0; i < Bmax; i++) {
+        for (int j = 0; j < D; j++)
+            X[i][j] = urand(-1.0,1.0);
+        for (int j = 0; j < S; j++)
+            dy[i][j] = urand(-1.0,1.0);
+    }
+    /* A pass on Bmax steps leaves values past the steps in the buffers */
+    lstm_forward(a,X,0);
+    lstm_backward(a,dy,X,ga,dxa,0);
+
+    lstm_set_shape(a,rows);
+    lstm_reset(a);
+    lstm_reset(b);
+    for (int k = 0; k < 8; k++) {
+        int R = (k < 4) ? D : S;
+        fltclr(ga[k],R * S);
+        fltclr(gb[k],R * S);
+    }
+    fArr2D ya = lstm_forward(a,X,0);
+    fArr2D yb = lstm_forward(b,X,0);
+    int err = memcmp(ya,yb,rows * S * sizeof(float)) != 0;
+    lstm_backward(a,dy,X,ga,dxa,0);
+    lstm_backward(b,dy,X,gb,dxb,0);
+    err += memcmp(dxa,dxb,sizeof(dxb)) != 0;
+    for (int k = 0; k < 8; k++) {
+        int R = (k < 4) ? D : S;
+        err += memcmp(ga[k],gb[k],R * S * sizeof(float)) != 0;
+        freemem(ga[k]);
+        freemem(gb[k]);
+    }
+    printf("%d of %d steps: %s\n",rows,Bmax,
+           (err) ? "outputs or gradients differ" : "same outputs and gradients");
+    lstm_free(a);
+    lstm_free(b);
+    return (err) ? 1 : 0;
+}
+
 int main()
 {
+    int errors = 0;
+    init_lrng(42);
+    printf("LSTM layer run on fewer steps than it was initialized for\n");
+    errors += test_lstm_shape(7,12,16,5);  /* Packed (gemv) kernels */
+    errors += test_lstm_shape(7,12,16,11);
+    errors += test_lstm_shape(7,12,16,1);
+    printf("%s\n\n",(errors) ? "Test failed" : "Test passed");
+
     init_lrng(42);
     const int layers[3] = {32,16,32};
     const float range[3] = {-10.0,10.0,0.1};
     test_lstm(range,layers,3,0.00001,0.001,20000);
-    return 0;
+    return (errors) ? 1 : 0;
 }
 
@@ -1,7 +1,39 @@
 /* Copyright (c) 2023-2024 Gilad Odinak */
 #include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
 #include "mem.h"
 
+/* Takes scratch memory of increasing size, nested n deep */
+static int scratch_nested(int n, size_t size)
+{
+    int errors = 0;
+    SCRATCH_MARK mark = scratch_mark();
+    char* p = scratchmem(1,size,char);
+    if ((uintptr_t) p % 64 != 0)
+        errors++;
+    for (size_t i = 0; i < size; i++)
+        p[i] = (char) n;
+    if (n > 0)
+        errors += scratch_nested(n - 1,size * 3);
+    for (size_t i = 0; i < size; i++) /* Not overwritten by nested calls */
+        if (p[i] != (char) n) {
+            errors++;
+            break;
+        }
+    scratch_release(mark);
+    return errors;
+}
+
+static void* scratch_thread(void* arg)
+{
+    (void) arg;
+    int errors = scratch_nested(5,1000);
+    if (scratch_heap_bytes() == 0)
+        errors++;
+    return (void*) (intptr_t) errors;
+}
+
 int main() {
     int m, n;
     printf("\n");
@@ -17,6 +49,21 @@ int main() {
     float (*b)[n] = (float (*)[n]) allocmem(m,n,float);
     printf("freeing allocated memory\n\n");
     freemem(b);
+    printf("taking nested scratch memory ... ");
+    int errors = scratch_nested(8,100);
+    size_t heap = scratch_heap_bytes();
+    for (int i = 0; i < 100; i++)
+        errors += scratch_nested(8,100);
+    printf("%s, %lu bytes from heap\n",(errors) ? "failed" : "passed",heap);
+    printf("taking the same scratch memory again ... ");
+    printf("%s\n",(scratch_heap_bytes() != heap) ? "failed" : "passed");
+    printf("taking scratch memory in another thread ... ");
+    pthread_t t;
+    void* ret;
+    pthread_create(&t,NULL,scratch_thread,NULL);
+    pthread_join(t,&ret);
+    printf("%s\n\n",(ret != NULL || scratch_heap_bytes() != heap) ?
+                    "failed" : "passed");
     printf("allocating and freeing memory of increased size until failure\n\n");
     m = 1000000; n = 1000;
     for (;;) {
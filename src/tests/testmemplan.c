@@ -0,0 +1,158 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for the memory planner of model buffers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+#include "random.h"
+#include "memplan.h"
+#include "dense.h"
+#include "lstm.h"
+#include "transformer.h"
+#include "model.h"
+
+#define NUM_BUFS 200
+
+/* Returns the number of pairs of buffers used in the same steps, whose
+ * memory overlaps
+ */
+static int overlaps(const MEMPLAN* p)
+{
+    int cnt = 0;
+    for (int i = 0; i < p->num; i++)
+        for (int j = i + 1; j < p->num; j++) {
+            const MEMBUF* a = &p->bufs[i];
+            const MEMBUF* b = &p->bufs[j];
+            if (a->first <= b->last && b->first <= a->last &&
+                a->offset < b->offset + b->size &&
+                b->offset < a->offset + a->size)
+                cnt++;
+        }
+    return cnt;
+}
+
+/* Test 1: buffers of overlapping steps do not share memory */
+static int test_planner(int share)
+{
+    int errors = 0;
+    MEMPLAN* p = memplan_create();
+    fArr2D* bufs = allocmem(1,NUM_BUFS,fArr2D);
+    for (int i = 0; i < NUM_BUFS; i++) {
+        int first = rand() % 50;
+        int last = first + rand() % 5;
+        memplan_add(p,"buf",&bufs[i],1 + rand() % 10000,first,last);
+    }
+    long size = memplan_assign(p,share);
+    int cnt = overlaps(p);
+    printf("  %s: workspace %ld floats, separate buffers %ld floats, "
+           "%d overlaps\n",(share) ? "shared" : "separate",size,p->naive,cnt);
+    if (cnt > 0 || size > p->naive || (share && size == p->naive) ||
+        (!share && size != p->naive))
+        errors++;
+    for (int i = 0; i < NUM_BUFS; i++)
+        if ((float*) bufs[i] != p->workspace + p->bufs[i].offset ||
+            (long) p->bufs[i].offset % 16 != 0)
+            errors++;
+    memplan_free(p);
+    freemem(bufs);
+    return errors;
+}
+
+/* Trains a model of LSTM and transformer layers for a few epochs, and
+ * returns its losses and predictions
+ */
+static MODEL* train(float* losses, int epochs, float* yp, int verbose)
+{
+    const int T = 16;  /* Sequence length                     */
+    const int D = 8;   /* Input dimension                     */
+    const int Dm = 32; /* Model dimension                     */
+    const int N = 4;   /* Output dimension                    */
+    const int num = 16;/* Number of sequences                 */
+    init_lrng(42);
+    float (*x)[D] = allocmem(num * T,D,float);
+    float (*y)[N] = allocmem(num * T,N,float);
+    int* len = allocmem(1,num,int);
+    for (int i = 0; i < num * T; i++) {
+        for (int j = 0; j < D; j++)
+            x[i][j] = urand(-1.0,1.0);
+        y[i][(x[i][0] > 0) + 2 * (x[i][1] > 0)] = 1.0;
+    }
+    for (int i = 0; i < num; i++)
+        len[i] = T;
+    MODEL* m = model_create(6,T,D,0,0);
+    model_add(m,dense_create(Dm,"none"),"dense");
+    model_add(m,lstm_create(Dm,0),"lstm");
+    model_add(m,lstm_create(Dm,0),"lstm");
+    model_add(m,transformer_create(4,T,Dm,2 * Dm,0),"transformer");
+    model_add(m,transformer_create(4,T,Dm,2 * Dm,0),"transformer");
+    model_add(m,dense_create(N,"softmax"),"dense");
+    model_compile(m,"cross-entropy","adamw");
+    if (verbose)
+        model_print_plan(m,stdout);
+    model_fit(m,x,y,len,num - 4,x + (num - 4) * T,y + (num - 4) * T,len,4,
+              epochs,0.001,0.0,losses,NULL,NULL,NULL,NULL);
+    model_predict(m,x,(fArr2D) yp,num * T);
+    freemem(x);
+    freemem(y);
+    freemem(len);
+    return m;
+}
+
+/* Test 2: training with shared buffers gives the same results as with
+ * separate buffers, in less memory
+ */
+static int test_model(void)
+{
+    const int epochs = 3;
+    const int M = 16 * 16 * 4;
+    float losses1[epochs], losses2[epochs];
+    float* yp1 = allocmem(1,M,float);
+    float* yp2 = allocmem(1,M,float);
+    setenv("MLINC_MEMPLAN","0",1);
+    MODEL* m1 = train(losses1,epochs,yp1,0);
+    unsetenv("MLINC_MEMPLAN");
+    MODEL* m2 = train(losses2,epochs,yp2,1);
+    int errors = 0;
+    for (int i = 0; i < epochs; i++) {
+        printf("  epoch %d loss %.6f %.6f\n",i,losses1[i],losses2[i]);
+        if (losses1[i] != losses2[i])
+            errors++;
+    }
+    if (memcmp(yp1,yp2,M * sizeof(float)) != 0) {
+        printf("Predictions differ\n");
+        errors++;
+    }
+    printf("  workspace %ld floats, separate buffers %ld floats\n",
+           m2->plan->size,m1->plan->size);
+    if (m2->plan->size >= m1->plan->size || overlaps(m2->plan) > 0)
+        errors++;
+    /* A new batch size plans again */
+    model_set_batch_size(m2,8);
+    if (overlaps(m2->plan) > 0)
+        errors++;
+    model_free(m1);
+    model_free(m2);
+    freemem(yp1);
+    freemem(yp2);
+    return errors;
+}
+
+int main()
+{
+    srand(42);
+    int errors = 0;
+    int err;
+
+    printf("Test 1: planner\n");
+    err = test_planner(1) + test_planner(0);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 2: model training\n");
+    err = test_model();
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
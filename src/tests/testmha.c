@@ -7,6 +7,7 @@
 #include "random.h"
 #include "array.h"
 #include "mha.h"
+#include "etime.h"
 
 #define EPS 1e-3
 #define TOL 1e-2
@@ -496,6 +497,242 @@ void test_rope_relative_invariance(MHA* m)
     printf("  OK\n");
 }
 
+/* Changing tokens that a layer of linear attention may not attend to,
+ * future tokens and padding, does not change the outputs of other tokens
+ */
+void test_linear_mask(MHA* m)
+{
+    printf("Test: MHA linear attention causal and padding mask\n");
+
+    int B = m->B;
+    int T = m->T;
+    int D = m->D;
+    int BT = m->BT;
+    int L = m->lookahead;
+
+    float X[BT][D];
+    float Y1[BT][D];
+    float Y2[BT][D];
+
+    for (int i = 0; i < BT; i++)
+        for (int j = 0; j < D; j++)
+            X[i][j] = urand(-1.0, 1.0);
+
+    /* The last token of the first sequence is padding */
+    int pad_mask[BT];
+    for (int i = 0; i < BT; i++)
+        pad_mask[i] = 1;
+    pad_mask[T - 1] = 0;
+
+    mha_forward(m, X, pad_mask, Y1, 0, 0);
+    for (int j = 0; j < D; j++) {
+        X[T - 1][j] = urand(-1.0, 1.0);       /* padding           */
+        X[BT - 1][j] = urand(-1.0, 1.0);      /* last token, future */
+    }
+    mha_forward(m, X, pad_mask, Y2, 0, 0);
+
+    float diff = 0;
+    float last_diff = 0;
+    for (int b = 0; b < B; b++)
+        for (int t = 0; t < T; t++) {
+            int r = b * T + t;
+            float d = 0;
+            for (int j = 0; j < D; j++)
+                d += fabsf(Y1[r][j] - Y2[r][j]);
+            if (b == 0 && t < T - 1)
+                diff += d;
+            else
+            if (b == B - 1 && L >= 0 && t + L < T - 1)
+                diff += d;
+            else
+            if (r == BT - 1)
+                last_diff += d;
+        }
+
+    if (diff > 1e-5) {
+        printf("FAIL linear mask: outputs of other tokens differ by %g\n", diff);
+        exit(1);
+    }
+    if (last_diff == 0) {
+        printf("FAIL linear mask: output of changed token is the same\n");
+        exit(1);
+    }
+    printf("  OK\n");
+}
+
+/* A causal layer of linear attention run recurrently, one token and then
+ * two tokens at a time, gives the same outputs as run on whole sequences
+ */
+void test_linear_recurrent(MHA* m)
+{
+    printf("Test: MHA linear attention recurrent form\n");
+
+    int B = m->B;
+    int T = m->T;
+    int D = m->D;
+    int BT = m->BT;
+
+    float X[BT][D];
+    float Y[BT][D];
+    float Yr[BT][D];
+    float xb[B * 2][D];
+    float yb[B * 2][D];
+
+    for (int i = 0; i < BT; i++)
+        for (int j = 0; j < D; j++)
+            X[i][j] = urand(-1.0, 1.0);
+    mha_forward(m, X, NULL, Y, 0, 0);
+
+    MHASTATE* states[B];
+    for (int b = 0; b < B; b++)
+        states[b] = mha_state_create(m);
+    for (int t = 0; t < T; ) {
+        int n = (t == 0 || T - t < 2) ? 1 : 2;
+        mha_set_shape(m, B, n);
+        for (int b = 0; b < B; b++)
+            fltcpy(xb[b * n], X[b * T + t], n * D);
+        mha_forward_recurrent(m, states, xb, yb, 0);
+        for (int b = 0; b < B; b++)
+            fltcpy(Yr[b * T + t], yb[b * n], n * D);
+        t += n;
+    }
+    mha_set_shape(m, B, T);
+
+    float diff = 0;
+    for (int i = 0; i < BT; i++)
+        for (int j = 0; j < D; j++)
+            diff += fabsf(Y[i][j] - Yr[i][j]);
+    for (int b = 0; b < B; b++) {
+        if (states[b]->len != T) {
+            printf("FAIL linear recurrent: session length %d, expected %d\n",
+                   states[b]->len, T);
+            exit(1);
+        }
+        mha_state_free(states[b]);
+    }
+    if (diff > 1e-4) {
+        printf("FAIL linear recurrent: outputs differ by %g\n", diff);
+        exit(1);
+    }
+    printf("  OK\n");
+}
+
+/* A layer initialized for more sequences, or longer ones, and run on
+ * fewer or shorter sequences after a pass on its full shape, gives the
+ * same outputs and gradients as a layer initialized for that shape, with
+ * the same weights
+ */
+void test_mha_shape(int H, int lookahead, const char* attention,
+                    int D, int Bmax, int Tmax, int B, int T)
+{
+    printf("Test: MHA %s attention lookahead %d, %d x %d of %d x %d\n",
+           attention, lookahead, B, T, Bmax, Tmax);
+
+    MHA* a = mha_create(H, Tmax, lookahead, attention);
+    MHA* b = mha_create(H, T, lookahead, attention);
+    mha_init(a, D, Bmax, 1, 0);
+    mha_init(b, D, B, 1, 0);
+    b->kernel = a->kernel;
+    fArr2D Wa[4] = { a->Wq, a->Wk, a->Wv, a->Wo };
+    fArr2D Wb[4] = { b->Wq, b->Wk, b->Wv, b->Wo };
+    fArr2D ga[4] = { a->gWq, a->gWk, a->gWv, a->gWo };
+    fArr2D gb[4] = { b->gWq, b->gWk, b->gWv, b->gWo };
+    for (int k = 0; k < 4; k++)
+        fltcpy(Wb[k], Wa[k], D * D);
+
+    int BT = Bmax * Tmax;
+    float X[BT][D];
+    float dY[BT][D];
+    float Ya[BT][D];
+    float Yb[BT][D];
+    float dXa[BT][D];
+    float dXb[BT][D];
+    for (int i = 0; i < BT; i++) {
+        for (int j = 0; j < D; j++) {
+            X[i][j]  = urand(-1.0, 1.0);
+            dY[i][j] = urand(-1.0, 1.0);
+        }
+    }
+    /* A pass on the full shape leaves values past B x T in the buffers */
+    fltclr(Ya, BT * D);
+    fltclr(dXa, BT * D);
+    mha_forward(a, X, NULL, Ya, 0, 0);
+    mha_backward(a, dY, X, dXa, 0);
+
+    mha_set_shape(a, B, T);
+    BT = B * T;
+    fltclr(Ya, BT * D);
+    fltclr(Yb, BT * D);
+    fltclr(dXa, BT * D);
+    fltclr(dXb, BT * D);
+    for (int k = 0; k < 4; k++) {
+        fltclr(ga[k], D * D);
+        fltclr(gb[k], D * D);
+    }
+    mha_forward(a, X, NULL, Ya, 0, 0);
+    mha_forward(b, X, NULL, Yb, 0, 0);
+    mha_backward(a, dY, X, dXa, 0);
+    mha_backward(b, dY, X, dXb, 0);
+
+    float ydiff = 0, xdiff = 0, gdiff = 0;
+    for (int i = 0; i < BT; i++) {
+        for (int j = 0; j < D; j++) {
+            ydiff += fabsf(Ya[i][j] - Yb[i][j]);
+            xdiff += fabsf(dXa[i][j] - dXb[i][j]);
+        }
+    }
+    for (int k = 0; k < 4; k++)
+        for (int i = 0; i < D * D; i++)
+            gdiff += fabsf(((float*) ga[k])[i] - ((float*) gb[k])[i]);
+    mha_free(a);
+    mha_free(b);
+    if (ydiff > 1e-5 || xdiff > 1e-5 || gdiff > 1e-5) {
+        printf("FAIL shape: Y differs by %g, dX by %g, gW by %g\n",
+               ydiff, xdiff, gdiff);
+        exit(1);
+    }
+    printf("  OK\n");
+}
+
+/* Times the forward pass of softmax and linear attention over sequences
+ * of T = 256 to 16384 tokens; softmax attention is not run on sequences
+ * whose [T][T] attention weights would take too much memory
+ */
+void test_linear_benchmark(void)
+{
+    printf("Test: MHA linear attention benchmark\n");
+
+    const int H = 4;
+    const int D = 128;
+    const int Tsoftmax = 2048;
+
+    for (int T = 256; T <= 16384; T *= 2) {
+        float* X = allocmem(T, D, float);
+        float* Y = allocmem(T, D, float);
+        for (long i = 0; i < (long) T * D; i++)
+            X[i] = urand(-1.0, 1.0);
+        double ms[2] = { 0, 0 };
+        const char* attention[2] = { "softmax", "linear" };
+        for (int a = 0; a < 2; a++) {
+            if (a == 0 && T > Tsoftmax)
+                continue;
+            MHA* m = mha_create(H, T, 0, attention[a]);
+            mha_init(m, D, 1, 0, 0);
+            long long t0 = current_time_ns();
+            mha_forward(m, (fArr2D) X, NULL, (fArr2D) Y, 0, 0);
+            ms[a] = (current_time_ns() - t0) / 1e6;
+            mha_free(m);
+        }
+        if (ms[0] > 0)
+            printf("  T %5d: softmax %9.2f ms, linear %9.2f ms\n", T, ms[0], ms[1]);
+        else
+            printf("  T %5d: softmax         - ms, linear %9.2f ms\n", T, ms[1]);
+        freemem(X);
+        freemem(Y);
+    }
+    printf("  OK\n");
+}
+
 int main(void)
 {
 //  unsigned int seed = 42;
@@ -520,36 +757,76 @@ int main(void)
     
     test_d_softmax();
 
-    m = mha_create(num_heads,seq_len,/*lookahead=*/-1);
+    m = mha_create(num_heads,seq_len,/*lookahead=*/-1,"softmax");
     mha_init(m,input_dim,batch_size,1,0);
     test_mha_zero_forward(m);
     mha_free(m);
 
-    m = mha_create(num_heads,seq_len,/*lookahead=*/-1);
+    m = mha_create(num_heads,seq_len,/*lookahead=*/-1,"softmax");
     mha_init(m,input_dim,batch_size,1,0);
     test_mha_attention_active(m);
     mha_free(m);
 
-    m = mha_create(num_heads,seq_len,/*lookahead=*/-1);
+    m = mha_create(num_heads,seq_len,/*lookahead=*/-1,"softmax");
     mha_init(m,input_dim,batch_size,1,0);
     test_mha_finite_diff(m);
     mha_free(m);
 
-    m = mha_create(num_heads,seq_len,/*lookahead=*/0); /* causal for mask test */
+    m = mha_create(num_heads,seq_len,/*lookahead=*/0,"softmax"); /* causal for mask test */
     mha_init(m,input_dim,batch_size,1,0);
     test_mask(m);
     mha_free(m);
 
-    m = mha_create(num_heads,seq_len,/*lookahead=*/-1);
+    m = mha_create(num_heads,seq_len,/*lookahead=*/-1,"softmax");
     mha_init(m,input_dim,batch_size,1,0);
     test_padding_mask(m);
     mha_free(m);
 
-    m = mha_create(num_heads,seq_len,/*lookahead=*/-1);
+    m = mha_create(num_heads,seq_len,/*lookahead=*/-1,"softmax");
     mha_init(m,input_dim,batch_size,1,0);
     test_rope_relative_invariance(m);
     mha_free(m);
 
+    /* Linear attention, bidirectional, causal, and with lookahead */
+    for (int lookahead = -1; lookahead <= 1; lookahead++) {
+        printf("linear attention lookahead %d\n",lookahead);
+
+        m = mha_create(num_heads,seq_len,lookahead,"linear");
+        mha_init(m,input_dim,batch_size,1,0);
+        test_mha_zero_forward(m);
+        mha_free(m);
+
+        m = mha_create(num_heads,seq_len,lookahead,"linear");
+        mha_init(m,input_dim,batch_size,1,0);
+        test_mha_finite_diff(m);
+        mha_free(m);
+
+        m = mha_create(num_heads,seq_len,lookahead,"linear");
+        mha_init(m,input_dim,batch_size,1,0);
+        test_linear_mask(m);
+        mha_free(m);
+    }
+
+    m = mha_create(num_heads,seq_len,/*lookahead=*/0,"linear");
+    mha_init(m,input_dim,batch_size,0,0);
+    test_linear_recurrent(m);
+    mha_free(m);
+
+    /* Fewer and shorter sequences than the layer was initialized for */
+    for (int a = 0; a < 2; a++) {
+        const char* attention = (a == 0) ? "softmax" : "linear";
+        for (int lookahead = -1; lookahead <= 0; lookahead++) {
+            test_mha_shape(num_heads,lookahead,attention,input_dim,
+                           batch_size,seq_len,1,seq_len);
+            test_mha_shape(num_heads,lookahead,attention,input_dim,
+                           batch_size,seq_len,batch_size,seq_len - 1);
+            test_mha_shape(num_heads,lookahead,attention,input_dim,
+                           batch_size,seq_len,1,1);
+        }
+    }
+
+    test_linear_benchmark();
+
     printf("\nALL TESTS PASSED\n");
     return 0;
 }
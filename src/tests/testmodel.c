@@ -11,6 +11,9 @@
 #include "model.h"
 #include "irisfile.h"
 #include "modelio.h"
+#include "autotune.h"
+#include "gemv.h"
+#include "tasksched.h"
 
 /* Trains a Multi Layer Perceptron to predict
  * the values of f(x) = (x**2 + 10* sin(x))
@@ -121,6 +124,7 @@ int test_lstm_regression(const float range[3],
     printf("\n\nTrains a Multi Layer LSTM to predict "
            "the values of the function \n    %s\n\n",title);
     
+    int errors = 0;
     const int L = layers_cnt + 1;
     const int M = (int) ((range[1] - range[0]) / range[2] + 0.5);
     printf("%d layers (including output layer), %d input samples\n",L,M);
@@ -158,6 +162,24 @@ int test_lstm_regression(const float range[3],
 
     model_predict(m,X,y,M);
 
+    /* Sequences predicted in parallel have the same predictions */
+    {
+        int S = 0;
+        int lens[M];
+        for (int off = 0; off < M; off += lens[S++])
+            lens[S] = (M - off < 10 + 7 * S) ? M - off : 10 + 7 * S;
+        float ys[M][N];
+        float yps[M][N];
+        fltclr(ys,M * N);
+        fltclr(yps,M * N);
+        for (int i = 0, off = 0; i < S; off += lens[i++])
+            model_predict(m,X + off,ys + off,lens[i]);
+        model_predict_sequences(m,X,yps,lens,S);
+        errors += (memcmp(ys,yps,sizeof(ys)) != 0);
+        printf("\n%d sequences: parallel predictions %s",S,
+               (errors) ? "differ" : "match");
+    }
+
     printf("\n");
 
 #ifdef HAS_PLOT
@@ -185,7 +207,7 @@ int test_lstm_regression(const float range[3],
     printf("\n");
 #endif
     model_free(m);
-    return 0;
+    return errors;
 }
 
 /* Trains a multi layer LSTM followed by Dense layer to predict 
@@ -792,14 +814,120 @@ int test_transformer_retrieval(int heads, int model_dim, int ffn_dim,
     return 0;
 }
 
+/* Predicts sequences of random inputs with a dense model, one sequence at
+ * a time and in parallel, and returns 1 if the predictions differ.
+ *
+ * layers array contains the size of each layer, the last is the output
+ * layer. If kernel is not negative, the dense layers use it rather than
+ * the tuned kernel. Sequences are of 1 to 3 * batch_size - 1 samples, so
+ * each ends with a partial batch.
+ */
+int test_parallel_predictions(int D, const int layers[], int layers_cnt,
+                              int batch_size, int kernel, int num)
+{
+    int errors = 0;
+    int lens[num];
+    int M = 0;
+    for (int i = 0; i < num; i++) {
+        lens[i] = 1 + (i * 7) % (3 * batch_size - 1);
+        M += lens[i];
+    }
+    const int N = layers[layers_cnt - 1];
+    float* X = allocmem(M,D,float);
+    float* ys = allocmem(M,N,float);
+    float* yps = allocmem(M,N,float);
+    for (int i = 0; i < M * D; i++)
+        X[i] = urand(-1.0,1.0);
+
+    MODEL* m = model_create(layers_cnt,batch_size,D,0,0);
+    for (int i = 0; i < layers_cnt - 1; i++)
+        model_add(m,dense_create(layers[i],"relu"),"dense");
+    model_add(m,dense_create(N,"none"),"dense");
+    model_compile(m,"mean-square-error","adamw");
+    if (kernel >= 0)
+        for (int i = 0; i < m->num_layers; i++)
+            m->layer[i].dense->kernel = kernel;
+
+    for (int i = 0, off = 0; i < num; off += lens[i++])
+        model_predict(m,(fArr2D) (X + off * D),(fArr2D) (ys + off * N),
+                      lens[i]);
+    model_predict_sequences(m,(fArr2D) X,(fArr2D) yps,lens,num);
+    float maxerr = 0;
+    int wrong = 0;
+    for (int i = 0; i < M * N; i++)
+        if (ys[i] != yps[i]) {
+            wrong++;
+            if (fabsf(ys[i] - yps[i]) > maxerr)
+                maxerr = fabsf(ys[i] - yps[i]);
+        }
+    errors += (wrong > 0);
+    printf("%d sequences, %d samples, batch size %d, %s kernel, %d threads: "
+           "parallel predictions %s",num,M,batch_size,
+           (kernel >= 0) ? autotune_kernel_name(kernel) : "tuned",
+           sched_num_threads(sched_default()),(errors) ? "differ" : "match");
+    if (errors)
+        printf(" (%d of %d outputs, max error %g)",wrong,M * N,maxerr);
+    printf("\n");
+    model_free(m);
+    freemem(X);
+    freemem(ys);
+    freemem(yps);
+    return errors;
+}
+
+/* Predicts samples whose last batch is partial with a dense and LSTM
+ * model, and returns 1 if the predictions differ from those of the same
+ * samples padded with zeros to whole batches. The LSTM is stateful, so
+ * padding after the last sample does not change the predictions.
+ */
+int test_partial_batch(int D, int S, int N, int batch_size)
+{
+    int errors = 0;
+    MODEL* m = model_create(3,batch_size,D,0,0);
+    model_add(m,dense_create(S,"relu"),"dense");
+    model_add(m,lstm_create(S,1),"lstm");
+    model_add(m,dense_create(N,"none"),"dense");
+    model_compile(m,"mean-square-error","adamw");
+
+    const int lens[3] = { 1, batch_size - 3, 2 * batch_size + 5 };
+    for (int k = 0; k < 3; k++) {
+        int M = lens[k];
+        int P = (M + batch_size - 1) / batch_size * batch_size;
+        float* X = allocmem(P,D,float);
+        float* y = allocmem(M,N,float);
+        float* yp = allocmem(P,N,float);
+        for (int i = 0; i < M * D; i++)
+            X[i] = urand(-1.0,1.0);
+        /* Whole batches first, the partial batch runs on their buffers */
+        model_predict(m,(fArr2D) X,(fArr2D) yp,P);
+        model_predict(m,(fArr2D) X,(fArr2D) y,M);
+        float maxerr = 0;
+        for (int i = 0; i < M * N; i++)
+            if (fabsf(y[i] - yp[i]) > maxerr)
+                maxerr = fabsf(y[i] - yp[i]);
+        /* Partial batches of fewer than GEMV_MAX_ROWS rows use packed
+           weights, whose products may round differently */
+        int err = (maxerr > 1e-5);
+        printf("%d samples, batch size %d: predictions %s (max error %g)\n",
+               M,batch_size,(err) ? "differ" : "match",maxerr);
+        errors += err;
+        freemem(X);
+        freemem(y);
+        freemem(yp);
+    }
+    model_free(m);
+    return (errors) ? 1 : 0;
+}
+
 int main(int argc, char** argv)
 {
     const char* usage = 
         "Usage: testmodel [-h | <test number>...]           \n"
         "for example 'testmodel 1 3' will runs tests 1 and 3\n"
-        "test numbers are 1..6 and are seperated by spaces  \n"
+        "test numbers are 1..8 and are seperated by spaces  \n"
         "runs all tests if none specified                   \n";
-    int tests[6] = {0};
+    int tests[8] = {0};
+    int errors = 0;
     
     if (argc > 1) {
         for (int i = 1; i < argc; i++) {
@@ -817,6 +945,10 @@ int main(int argc, char** argv)
         printf("Running all tests\n");
         printf("Run 'testmodel -h' to list program options\n\n");
     }
+    /* Parallel predictions need more than one thread, even on a host with
+       a single core; the default scheduler is created on first use */
+    if (tests[6])
+        setenv("MLINC_THREADS","4",0);
 
 
     if (tests[0]) {
@@ -829,7 +961,8 @@ int main(int argc, char** argv)
         init_lrng(42);
         const int layers[4] = {32,16,32,16};
         const float range[3] = {-10.0,10.0,0.1};
-        test_lstm_regression(range,layers,4,"adamw",0.0002,0.02,1000);
+        errors += test_lstm_regression(range,layers,4,"adamw",
+                                       0.0002,0.02,1000);
     }
     if (tests[2]) {
         init_lrng(42);
@@ -861,6 +994,26 @@ int main(int argc, char** argv)
         test_transformer_retrieval(heads,model_dim,ffn_dim,
                                    n_layers,optimizer,lr,wd,epochs);
     }
-    printf("\nAll tests completed\n\n");
-    return 0;
+    if (tests[6]) {
+        init_lrng(42);
+        printf("\n\nPredicts sequences in parallel, with layers that run "
+               "nested parallel kernels\n\n");
+        /* Batches of 16 rows, products split across threads */
+        const int layers[3] = {512,512,64};
+        errors += test_parallel_predictions(256,layers,3,16,
+                                            KERNEL_THREADED,48);
+        /* Batches of fewer than GEMV_MAX_ROWS rows, of products large
+           enough to be split across threads */
+        const int wide[2] = {GEMV_THREAD_MIN / 256,16};
+        errors += test_parallel_predictions(256,wide,2,GEMV_MAX_ROWS - 1,
+                                            -1,48);
+    }
+    if (tests[7]) {
+        init_lrng(42);
+        printf("\n\nPredicts samples whose last batch is partial\n\n");
+        errors += test_partial_batch(6,24,3,16);
+        errors += test_partial_batch(6,24,3,GEMV_MAX_ROWS);
+    }
+    printf("\n%s\n\n",(errors) ? "Some tests failed" : "All tests completed");
+    return (errors) ? 1 : 0;
 }
@@ -0,0 +1,212 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for performance counters of training phases */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "mem.h"
+#include "random.h"
+#include "perfctr.h"
+#include "dense.h"
+#include "model.h"
+
+#define X_DIM 4   /* Input vectors dimension  */
+#define Y_DIM 3   /* Output vectors dimension */
+
+static volatile double sink;
+
+/* Runs about n floating point multiply-adds */
+static void busy(long n)
+{
+    double s = 0;
+    for (long i = 0; i < n; i++)
+        s = s * 0.999 + i;
+    sink = s;
+}
+
+static void print_counts(const char* name, int arg)
+{
+    long long c[PERF_MAX_COUNTERS];
+    long calls = perf_counts(name,arg,c);
+    printf("  %s %d: %ld calls",name,arg,calls);
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++)
+        if (c[i] >= 0)
+            printf(", %s %lld",perf_counter_name(i),c[i]);
+    printf("\n");
+}
+
+/* Test 1: counts of nested regions */
+static int test_regions(void)
+{
+    int errors = 0;
+    for (int k = 0; k < 3; k++) {
+        PERF_BEGIN("outer",-1);
+        busy(1000000);
+        PERF_BEGIN("inner",k % 2);
+        busy(2000000);
+        PERF_END();
+        PERF_END();
+    }
+    long long outer[PERF_MAX_COUNTERS], in0[PERF_MAX_COUNTERS],
+              in1[PERF_MAX_COUNTERS];
+    long n = perf_counts("outer",-1,outer);
+    long n0 = perf_counts("inner",0,in0);
+    long n1 = perf_counts("inner",1,in1);
+    print_counts("outer",-1);
+    print_counts("inner",0);
+    print_counts("inner",1);
+    if (n != 3 || n0 != 2 || n1 != 1) {
+        printf("Regions ran %ld %ld %ld times, expected 3 2 1\n",n,n0,n1);
+        errors++;
+    }
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++) {
+        if (outer[i] < 0) /* Not available */
+            continue;
+        if (i == PERF_LLC_MISSES || i == PERF_BRANCH_MISSES)
+            continue; /* May be about 0 */
+        if (in0[i] <= 0 || in1[i] <= 0 || outer[i] < in0[i] + in1[i]) {
+            printf("Counter %s: outer %lld inner %lld %lld\n",
+                   perf_counter_name(i),outer[i],in0[i],in1[i]);
+            errors++;
+        }
+    }
+    if (outer[PERF_INSTRUCTIONS] >= 0 && outer[PERF_INSTRUCTIONS] < 9000000) {
+        printf("Too few instructions: %lld\n",outer[PERF_INSTRUCTIONS]);
+        errors++;
+    }
+    return errors;
+}
+
+/* Test 2: regions of other threads are counted by their own counters */
+
+static void* thread_region(void* arg)
+{
+    (void) arg;
+    PERF_BEGIN("thread",-1);
+    busy(1000000);
+    PERF_END();
+    return NULL;
+}
+
+static int test_threads(void)
+{
+    pthread_t t[2];
+    for (int i = 0; i < 2; i++)
+        pthread_create(&t[i],NULL,thread_region,NULL);
+    for (int i = 0; i < 2; i++)
+        pthread_join(t[i],NULL);
+    long long c[PERF_MAX_COUNTERS];
+    long n = perf_counts("thread",-1,c);
+    print_counts("thread",-1);
+    if (n != 2 || (c[PERF_TASK_CLOCK] >= 0 && c[PERF_TASK_CLOCK] == 0)) {
+        printf("Threads' regions not counted\n");
+        return 1;
+    }
+    return 0;
+}
+
+/* Test 3: training counts the phases of each layer */
+static int test_model(void)
+{
+    const int M = 64;
+    const int epochs = 2;
+    int errors = 0;
+    float (*x)[X_DIM] = allocmem(M,X_DIM,float);
+    float (*y)[Y_DIM] = allocmem(M,Y_DIM,float);
+    for (int i = 0; i < M; i++) {
+        for (int j = 0; j < X_DIM; j++)
+            x[i][j] = urand(-1.0,1.0);
+        int c = (x[i][0] > 0) + (x[i][1] > 0);
+        for (int j = 0; j < Y_DIM; j++)
+            y[i][j] = (j == c) ? 1.0 : 0.0;
+    }
+    MODEL* m = model_create(2,16,X_DIM,1,1);
+    model_add(m,dense_create(8,"relu"),"dense");
+    model_add(m,dense_create(Y_DIM,"softmax"),"dense");
+    model_compile(m,"cross-entropy","adamw");
+    float losses[epochs];
+    model_fit(m,x,y,NULL,48,x + 48,y + 48,NULL,16,
+              epochs,0.01,0.0,losses,NULL,NULL,NULL,NULL);
+    float (*yp)[Y_DIM] = allocmem(M,Y_DIM,float);
+    model_predict(m,x,yp,M);
+    model_free(m);
+    freemem(x);
+    freemem(y);
+    freemem(yp);
+
+    /* 3 training and 1 validation batches per epoch, 4 prediction batches */
+    long long c[PERF_MAX_COUNTERS];
+    struct { const char* name; int arg; long calls; } expect[] = {
+        { "epoch", -1, epochs },
+        { "validation", -1, epochs },
+        { "predict", -1, 1 },
+        { "dense forward", 0, 4 * epochs + 4 },
+        { "dense forward", 1, 4 * epochs + 4 },
+        { "dense backward", 0, 3 * epochs },
+        { "dense backward", 1, 3 * epochs },
+        { "update", -1, 3 * epochs },
+        { "loss", -1, 3 * epochs }
+    };
+    for (int i = 0; i < (int) (sizeof(expect) / sizeof(expect[0])); i++) {
+        long n = perf_counts(expect[i].name,expect[i].arg,c);
+        if (n != expect[i].calls) {
+            printf("Region %s %d ran %ld times, expected %ld\n",
+                   expect[i].name,expect[i].arg,n,expect[i].calls);
+            errors++;
+        }
+    }
+    return errors;
+}
+
+/* Test 4: nothing is counted while disabled */
+static int test_disabled(void)
+{
+    perf_disable();
+    PERF_BEGIN("disabled",-1);
+    busy(1000);
+    PERF_END();
+    long long c[PERF_MAX_COUNTERS];
+    return perf_counts("disabled",-1,c) != 0;
+}
+
+int main()
+{
+    init_lrng(42);
+    int errors = 0;
+    int err;
+
+    int n = perf_enable();
+    printf("Performance counters available:");
+    for (int i = 0; i < PERF_MAX_COUNTERS; i++)
+        if (perf_counter_available(i))
+            printf(" %s",perf_counter_name(i));
+    printf("%s\n",(n == 0) ? " none" : "");
+    if (n == 0) { /* Nothing to test, e.g. in a restricted container */
+        printf("\nAll tests passed\n");
+        return 0;
+    }
+
+    printf("Test 1: counts of nested regions\n");
+    err = test_regions();
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 2: regions of several threads\n");
+    err = test_threads();
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 3: phases of model training and prediction\n");
+    err = test_model();
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+    perf_report(stdout);
+
+    printf("Test 4: disabled counting\n");
+    err = test_disabled();
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
@@ -0,0 +1,340 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for the work stealing task scheduler */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "mem.h"
+#include "random.h"
+#include "numatopo.h"
+#include "tasksched.h"
+#include "etime.h"
+
+#define NUM_ITEMS  20000  /* Number of items of the parallel_for tests   */
+#define NUM_SEQS   4000   /* Number of sequences of the benchmark        */
+#define MAX_THREADS 64    /* Maximum number of threads counted           */
+
+/* Test 1: every index is visited exactly once */
+
+typedef struct {
+    atomic_int* visits;
+    atomic_long sum;
+} SUMARG;
+
+static void sum_body(void* arg, int lo, int hi)
+{
+    SUMARG* a = (SUMARG*) arg;
+    long sum = 0;
+    for (int i = lo; i < hi; i++) {
+        atomic_fetch_add(&a->visits[i],1);
+        sum += i;
+    }
+    atomic_fetch_add(&a->sum,sum);
+}
+
+static int test_parallel_for(SCHED* s, int grain)
+{
+    int errors = 0;
+    SUMARG a;
+    a.visits = allocmem(1,NUM_ITEMS,atomic_int);
+    atomic_init(&a.sum,0);
+    parallel_for(s,0,NUM_ITEMS,grain,sum_body,&a);
+    for (int i = 0; i < NUM_ITEMS; i++)
+        if (atomic_load(&a.visits[i]) != 1) {
+            printf("Index %d visited %d times\n",i,atomic_load(&a.visits[i]));
+            errors++;
+            break;
+        }
+    if (atomic_load(&a.sum) != (long) NUM_ITEMS * (NUM_ITEMS - 1) / 2) {
+        printf("Sum mismatch: %ld\n",atomic_load(&a.sum));
+        errors++;
+    }
+    freemem(a.visits);
+    return errors;
+}
+
+/* Test 2: tasks that spawn and wait for nested tasks, and nested
+ * parallel_for() calls
+ */
+
+typedef struct {
+    SCHED* s;
+    int depth;
+    atomic_long* count;
+} TREEARG;
+
+static void tree_task(void* arg)
+{
+    TREEARG* a = (TREEARG*) arg;
+    atomic_fetch_add(a->count,1);
+    if (a->depth == 0)
+        return;
+    TREEARG child[3];
+    TASKGROUP g;
+    taskgroup_init(&g,a->s);
+    for (int i = 0; i < 3; i++) {
+        child[i] = *a;
+        child[i].depth = a->depth - 1;
+        taskgroup_spawn(&g,tree_task,&child[i]);
+    }
+    taskgroup_wait(&g);
+}
+
+static void count_body(void* arg, int lo, int hi)
+{
+    atomic_fetch_add((atomic_long*) arg,hi - lo);
+}
+
+static void outer_body(void* arg, int lo, int hi)
+{
+    TREEARG* a = (TREEARG*) arg;
+    for (int i = lo; i < hi; i++)
+        parallel_for(a->s,0,100,0,count_body,a->count);
+}
+
+static int test_nested(SCHED* s)
+{
+    int errors = 0;
+    atomic_long count;
+    atomic_init(&count,0);
+    TREEARG a = { s, 7, &count };
+    tree_task(&a);
+    long expected = (2187 * 3 - 1) / 2; /* 1 + 3 + ... + 3^7 */
+    if (atomic_load(&count) != expected) {
+        printf("Task tree count %ld, expected %ld\n",
+               atomic_load(&count),expected);
+        errors++;
+    }
+    atomic_store(&count,0);
+    parallel_for(s,0,300,1,outer_body,&a);
+    if (atomic_load(&count) != 300 * 100) {
+        printf("Nested parallel_for count %ld, expected %d\n",
+               atomic_load(&count),300 * 100);
+        errors++;
+    }
+    return errors;
+}
+
+/* Test 3: load balance of a skewed workload, such as processing utterances
+ * of very different lengths. The sequences are sorted by length, as data
+ * often is, so static partitioning gives some threads much more work.
+ */
+
+typedef struct {
+    const int* len;             /* Length of each sequence                */
+    volatile float* out;        /* Result of each sequence                */
+    long work[MAX_THREADS + 1]; /* Work done by each thread               */
+} SEQARG;
+
+static float process_seq(int len)
+{
+    float v = 0.0;
+    for (int t = 0; t < len; t++)
+        for (int k = 0; k < 200; k++)
+            v = v * 0.999f + (t ^ k) * 1e-6f;
+    return v;
+}
+
+static void seq_body(void* arg, int lo, int hi)
+{
+    SEQARG* a = (SEQARG*) arg;
+    int id = sched_thread_id();
+    for (int i = lo; i < hi; i++) {
+        a->out[i] = process_seq(a->len[i]);
+        a->work[id] += a->len[i];
+    }
+}
+
+typedef struct {
+    SEQARG* a;
+    int id, lo, hi;
+} STATICARG;
+
+static void* static_thread(void* arg)
+{
+    STATICARG* sa = (STATICARG*) arg;
+    for (int i = sa->lo; i < sa->hi; i++) {
+        sa->a->out[i] = process_seq(sa->a->len[i]);
+        sa->a->work[sa->id] += sa->a->len[i];
+    }
+    return NULL;
+}
+
+/* Returns the ratio of the most loaded thread's work to the average */
+static double imbalance(const long* work, int P)
+{
+    long max = 0, sum = 0;
+    for (int i = 0; i < P; i++) {
+        sum += work[i];
+        if (work[i] > max)
+            max = work[i];
+    }
+    return (sum > 0) ? (double) max * P / sum : 0.0;
+}
+
+static int test_skewed(SCHED* s)
+{
+    int P = sched_num_threads(s);
+    if (P > MAX_THREADS)
+        P = MAX_THREADS;
+    int* len = allocmem(1,NUM_SEQS,int);
+    float* out = allocmem(1,NUM_SEQS,float);
+    for (int i = 0; i < NUM_SEQS; i++) /* 10 to 100, ascending */
+        len[i] = 10 + (int) (90.0 * i * i / ((double) NUM_SEQS * NUM_SEQS));
+    SEQARG* a = allocmem(1,1,SEQARG);
+    a->len = len;
+    a->out = out;
+
+    /* Static partitioning: one equal share of sequences per thread */
+    pthread_t thread[MAX_THREADS];
+    STATICARG sa[MAX_THREADS];
+    long long t0 = current_time_ns();
+    for (int i = 0; i < P; i++) {
+        sa[i] = (STATICARG) { a, i, NUM_SEQS * i / P, NUM_SEQS * (i + 1) / P };
+        pthread_create(&thread[i],NULL,static_thread,&sa[i]);
+    }
+    for (int i = 0; i < P; i++)
+        pthread_join(thread[i],NULL);
+    double t_static = (current_time_ns() - t0) / 1e9;
+    double imb_static = imbalance(a->work,P);
+
+    /* Work stealing */
+    memset(a->work,0,sizeof(a->work));
+    t0 = current_time_ns();
+    parallel_for(s,0,NUM_SEQS,0,seq_body,a);
+    double t_steal = (current_time_ns() - t0) / 1e9;
+    double imb_steal = imbalance(a->work,P);
+
+    printf("  %d threads, %d sequences of length 10 to 100\n",P,NUM_SEQS);
+    printf("  static partitioning: %.3f sec, max/avg work %.2f\n",
+           t_static,imb_static);
+    printf("  work stealing:       %.3f sec, max/avg work %.2f\n",
+           t_steal,imb_steal);
+    int errors = 0;
+    if (P > 1 && imb_steal > imb_static) {
+        printf("Work stealing did not improve load balance\n");
+        errors++;
+    }
+    freemem(a);
+    freemem(out);
+    freemem(len);
+    return errors;
+}
+
+/* Test 4: thread placement and memory placement on a simulated topology
+ * of 2 nodes
+ */
+
+#define LOCAL_SIZE (256 * 1024)   /* Per thread block size (bytes)     */
+#define REPL_SIZE  10000          /* Replicated data size (elements)   */
+
+typedef struct {
+    atomic_int calls[MAX_THREADS + 1];
+    atomic_int errors;
+    void** local;
+    REPLICA* r;
+    const float* w;
+} PLACEARG;
+
+static void place_task(void* arg, int id)
+{
+    PLACEARG* a = (PLACEARG*) arg;
+    atomic_fetch_add(&a->calls[id],1);
+    /* Each thread sees its own node's replica, with the same data */
+    const float* w = replica_local(a->r);
+    int node = sched_thread_node();
+    if ((a->r->node_w[node] != NULL && w != a->r->node_w[node]) ||
+        memcmp(w,a->w,REPL_SIZE * sizeof(float)) != 0)
+        atomic_fetch_add(&a->errors,1);
+    /* Real node of the thread's local block, first touched by it */
+    int page_node = numatopo_page_node(a->local[id]);
+    if (page_node >= 0 && page_node != numatopo_page_node(&page_node))
+        atomic_fetch_add(&a->errors,1);
+}
+
+static int test_placement()
+{
+    int errors = 0;
+    numatopo_simulate(2,4);
+    SCHED* s = sched_create(0);
+    sched_report(s,stdout);
+    int P = sched_num_threads(s);
+    if (P != 8) {
+        printf("Expected 8 threads, got %d\n",P);
+        errors++;
+    }
+    float* w = allocmem(1,REPL_SIZE,float);
+    for (int i = 0; i < REPL_SIZE; i++)
+        w[i] = urand(-1.0,1.0);
+    PLACEARG* a = allocmem(1,1,PLACEARG);
+    a->local = sched_alloc_local(s,LOCAL_SIZE);
+    a->r = sched_replicate(s,w,REPL_SIZE);
+    a->w = w;
+    for (int i = 0; i < a->r->num_nodes; i++)
+        if (a->r->node_w[i] == NULL || a->r->node_w[i] == w) {
+            printf("Node %d has no replica\n",i);
+            errors++;
+        }
+    sched_run_on_all(s,place_task,a);
+    for (int i = 0; i < P; i++)
+        if (atomic_load(&a->calls[i]) != 1) {
+            printf("Thread %d called %d times\n",i,atomic_load(&a->calls[i]));
+            errors++;
+        }
+    if (atomic_load(&a->errors) > 0) {
+        printf("%d replica or local memory errors\n",atomic_load(&a->errors));
+        errors++;
+    }
+    replica_free(a->r);
+    sched_free_local(s,a->local);
+    freemem(a);
+    freemem(w);
+    sched_free(s);
+    numatopo_simulate(0,0);
+    return errors;
+}
+
+int main()
+{
+    init_lrng(42);
+    int errors = 0;
+    int err;
+    SCHED* s = sched_create(0);
+    SCHED* s4 = sched_create(3);
+    SCHED* s1 = sched_create(1);
+    SCHED* sched[3] = { s, s4, s1 };
+
+    printf("Test 1: parallel_for visits every index once\n");
+    err = 0;
+    for (int k = 0; k < 3; k++) {
+        err += test_parallel_for(sched[k],0);
+        err += test_parallel_for(sched[k],1);
+        err += test_parallel_for(sched[k],777);
+    }
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 2: nested task groups and parallel_for\n");
+    err = 0;
+    for (int k = 0; k < 3; k++)
+        err += test_nested(sched[k]);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 3: load balance of a skewed workload\n");
+    err = test_skewed(s4);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 4: thread and memory placement on a simulated topology\n");
+    err = test_placement();
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    sched_free(s1);
+    sched_free(s4);
+    sched_free(s);
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for kernel variants specialized for constant dimensions */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mem.h"
+#include "random.h"
+#include "array.h"
+#include "rope.h"
+#include "mha.h"
+#include "lstm.h"
+#include "dense.h"
+#include "testutil.h"
+
+/* Dimensions passed through a volatile variable are not constants, so
+ * kernels called with them run their generic code.
+ */
+static volatile int dim_zero = 0;
+#define GENERIC(dim) ((dim) + dim_zero)
+
+#define REPS 20
+
+/* Compares the results of the specialized and generic variants. Results
+ * may differ in rounding, since the compiler may contract multiply-adds
+ * differently in each variant.
+ */
+static int compare(const char* name, int dim, const float* x, const float* y,
+                   long n, double t_spec, double t_gen)
+{
+    int err = differ(x,y,n,1e-5);
+    printf("  %-10s %4d: %s, %.3f ms specialized, %.3f ms generic\n",
+           name,dim,(err) ? "results differ" : "same results",
+           t_spec * 1000,t_gen * 1000);
+    return err;
+}
+
+/* Test 1: rope_apply() */
+static int test_rope(int Dh)
+{
+    const int T = 64;
+    float* theta = allocmem(1,Dh / 2,float);
+    float* x = allocmem(T,Dh,float);
+    float* y = allocmem(T,Dh,float);
+    rope_init(theta,Dh);
+    fill(x,T * Dh);
+    fltcpy(y,x,T * Dh);
+    double ts, tg;
+    MIN_TIME(ts,REPS,rope_apply((fArr2D) x,theta,0,3,T,Dh));
+    MIN_TIME(tg,REPS,rope_kernel((fArr2D) y,theta,0,3,T,GENERIC(Dh)));
+    int err = compare("rope",Dh,x,y,T * Dh,ts,tg);
+    freemem(theta);
+    freemem(x);
+    freemem(y);
+    return err;
+}
+
+/* Test 2: attention of mha_forward() */
+static int test_attention(int Dh)
+{
+    const int H = 2;
+    const int T = 32;
+    const int B = 2;
+    const int D = H * Dh;
+    MHA* l = mha_create(H,T,0,"softmax");
+    mha_init(l,D,B,0,0);
+    float* X = allocmem(B * T,D,float);
+    float* out = allocmem(B * T,D,float);
+    fill(X,B * T * D);
+    mha_forward(l,(fArr2D) X,NULL,NULL,0,0);
+    fltcpy(out,l->Out,B * T * D);
+    /* The heads of mha_forward(), with constant and generic dimensions */
+    int dh = Dh;
+    double ts, tg;
+    MIN_TIME(ts,REPS,
+        for (int b = 0; b < B; b++)
+            for (int h = 0; h < H; h++)
+                SHAPE_SPECIALIZE(HEAD_DIM_SHAPES,dh,
+                                 mha_head_forward(l,NULL,b,h,0,dh)));
+    MIN_TIME(tg,REPS,
+        for (int b = 0; b < B; b++)
+            for (int h = 0; h < H; h++)
+                mha_head_forward(l,NULL,b,h,0,GENERIC(Dh)));
+    int err = compare("attention",Dh,out,(float*) l->Out,B * T * D,ts,tg);
+    mha_free(l);
+    freemem(X);
+    freemem(out);
+    return err;
+}
+
+/* Test 3: lstm_forward() */
+static int test_lstm(int S)
+{
+    const int B = 16;
+    const int D = 15;
+    LSTM* l = lstm_create(S,0);
+    lstm_init(l,D,B);
+    float* X = allocmem(B,D,float);
+    float* h = allocmem(B,S,float);
+    fill(X,B * D);
+    double ts, tg;
+    MIN_TIME(ts,REPS,lstm_forward(l,(fArr2D) X,0));
+    fltcpy(h,(float*) l->h + S,B * S);
+    /* The steps of lstm_forward(), with generic dimensions */
+    typedef float (*ArrBS)[S];
+    typedef float (*ArrBD)[D];
+    ArrBD x = (ArrBD) X;
+    ArrBS f = (ArrBS) l->f, i = (ArrBS) l->i, o = (ArrBS) l->o;
+    ArrBS cc = ((ArrBS) l->cc) + 1;
+    ArrBS c = ((ArrBS) l->c) + 1;
+    ArrBS hh = ((ArrBS) l->h) + 1;
+    MIN_TIME(tg,REPS,
+        fltclr(l->f,B * S);
+        fltclr(l->i,B * S);
+        fltclr(l->o,B * S);
+        fltclr(l->cc,(B + 1) * S);
+        fltclr(l->c,(B + 1) * S);
+        fltclr(l->h,(B + 1) * S);
+        for (int t = 0; t < B; t++)
+            lstm_step(l,x[t],f[t],i[t],o[t],cc[t],c[t],hh[t],c[t - 1],
+                      hh[t - 1],GENERIC(D),GENERIC(S)));
+    int err = compare("lstm",S,h,(float*) hh,B * S,ts,tg);
+    lstm_free(l);
+    freemem(X);
+    freemem(h);
+    return err;
+}
+
+/* Test 4: dense_forward() */
+static int test_dense(int D)
+{
+    const int B = 256;
+    const int S = 64;
+    DENSE* l = dense_create(S,"none");
+    dense_init(l,D,B);
+    float* X = allocmem(B,D,float);
+    float* h = allocmem(B,S,float);
+    fill(X,B * D);
+    double ts, tg;
+    MIN_TIME(ts,REPS,dense_forward(l,(fArr2D) X,0));
+    fltcpy(h,l->h,B * S);
+    MIN_TIME(tg,REPS,dense_matmul(l,(fArr2D) X,GENERIC(D)));
+    int err = compare("dense",D,h,(float*) l->h,B * S,ts,tg);
+    dense_free(l);
+    freemem(X);
+    freemem(h);
+    return err;
+}
+
+int main()
+{
+    init_lrng(42);
+    int errors = 0;
+    int err;
+
+    /* Dimensions of the default shape lists, and some that are not */
+    printf("Test 1: rope_apply\n");
+    err = test_rope(32) + test_rope(64) + test_rope(128) + test_rope(48);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 2: attention\n");
+    err = test_attention(32) + test_attention(64) + test_attention(128) +
+          test_attention(40);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 3: lstm step\n");
+    err = test_lstm(128) + test_lstm(256) + test_lstm(512) + test_lstm(100);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 4: dense\n");
+    err = test_dense(15) + test_dense(71) + test_dense(14) + test_dense(70) +
+          test_dense(33);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
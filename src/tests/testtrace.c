@@ -0,0 +1,272 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for timeline recording */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "mem.h"
+#include "random.h"
+#include "etime.h"
+#include "trace.h"
+#include "tasksched.h"
+#include "dense.h"
+#include "model.h"
+
+#define X_DIM 4   /* Input vectors dimension  */
+#define Y_DIM 3   /* Output vectors dimension */
+
+static char* trace_text = NULL;
+
+/* Writes the recorded events to a file, and reads it into trace_text */
+static int write_and_read(void)
+{
+    char path[64];
+    snprintf(path,sizeof(path),"/tmp/testtrace-%d.json",(int) getpid());
+    freemem(trace_text);
+    trace_text = NULL;
+    if (!trace_write("/tmp/testtrace-%p.json"))
+        return 0;
+    FILE* f = fopen(path,"r");
+    if (f == NULL) {
+        printf("Failed to open %s\n",path);
+        return 0;
+    }
+    fseek(f,0,SEEK_END);
+    long size = ftell(f);
+    fseek(f,0,SEEK_SET);
+    trace_text = allocmem(1,size + 1,char);
+    long n = fread(trace_text,1,size,f);
+    trace_text[n] = '\0';
+    fclose(f);
+    remove(path);
+    return n == size;
+}
+
+/* Returns the number of lines of trace_text that contain all of the given
+ * strings (up to two; either may be NULL).
+ */
+static int count_lines(const char* s1, const char* s2)
+{
+    int count = 0;
+    for (char* line = trace_text; line != NULL && *line != '\0'; ) {
+        char* end = strchr(line,'\n');
+        if (end != NULL)
+            *end = '\0';
+        if ((s1 == NULL || strstr(line,s1) != NULL) &&
+            (s2 == NULL || strstr(line,s2) != NULL))
+            count++;
+        if (end == NULL)
+            break;
+        *end = '\n';
+        line = end + 1;
+    }
+    return count;
+}
+
+/* Reads the start time and duration of the first event named name */
+static int event_times(const char* name, double* ts, double* dur)
+{
+    char key[64];
+    snprintf(key,sizeof(key),"{\"name\":\"%s\",",name);
+    const char* p = strstr(trace_text,key);
+    if (p == NULL)
+        return 0;
+    const char* t = strstr(p,"\"ts\":");
+    const char* d = strstr(p,"\"dur\":");
+    if (t == NULL || d == NULL || strchr(p,'\n') < d)
+        return 0;
+    *ts = atof(t + 5);
+    *dur = atof(d + 6);
+    return 1;
+}
+
+/* Test 1: nested events on the main thread and on worker threads */
+
+static void record_task(void* arg, int lo, int hi)
+{
+    (void) arg;
+    for (int i = lo; i < hi; i++) {
+        TRACE_BEGIN("task","test",i);
+        usleep(100);
+        TRACE_END();
+    }
+}
+
+static int test_events(void)
+{
+    int errors = 0;
+    SCHED* s = sched_create(2);
+    trace_thread_name("main");
+    TRACE_BEGIN("outer","test",-1);
+    usleep(1000);
+    TRACE_BEGIN("inner","test",7);
+    TRACE_INSTANT("mark","test",-1);
+    usleep(1000);
+    TRACE_END();
+    parallel_for(s,0,40,1,record_task,NULL);
+    TRACE_END();
+    sched_free(s);
+    if (!write_and_read())
+        return 1;
+    if (strncmp(trace_text,"{\"displayTimeUnit\"",18) != 0 ||
+        strstr(trace_text,"\n]}\n") == NULL) {
+        printf("Invalid trace file structure\n");
+        errors++;
+    }
+    if (count_lines("\"outer\"","\"ph\":\"X\"") != 1 ||
+        count_lines("\"inner\"","\"args\":{\"arg\":7}") != 1 ||
+        count_lines("\"mark\"","\"ph\":\"i\"") != 1 ||
+        count_lines("\"task\"","\"ph\":\"X\"") != 40) {
+        printf("Missing events\n");
+        errors++;
+    }
+    if (count_lines("\"thread_name\"","\"name\":\"main\"") != 1 ||
+        count_lines("\"thread_name\"","\"name\":\"worker ") != 2) {
+        printf("Missing thread names\n");
+        errors++;
+    }
+    double ots, odur, its, idur;
+    if (!event_times("outer",&ots,&odur) || !event_times("inner",&its,&idur) ||
+        its < ots || its + idur > ots + odur || idur < 1000 || odur < 2000) {
+        printf("Inner event is not nested in outer event\n");
+        errors++;
+    }
+    return errors;
+}
+
+/* Test 2: a full buffer keeps the most recent events */
+
+static void* record_ring(void* arg)
+{
+    (void) arg;
+    trace_thread_name("ring");
+    for (int i = 0; i < TRACE_BUFFER_EVENTS + 100; i++)
+        TRACE_INSTANT("ring","test",i);
+    return NULL;
+}
+
+static int test_ring(void)
+{
+    pthread_t t;
+    pthread_create(&t,NULL,record_ring,NULL);
+    pthread_join(t,NULL);
+    if (!write_and_read())
+        return 1;
+    int n = count_lines("{\"name\":\"ring\",",NULL);
+    int first = count_lines("{\"name\":\"ring\",","\"arg\":100}");
+    int dropped = count_lines("{\"name\":\"ring\",","\"arg\":99}");
+    if (n != TRACE_BUFFER_EVENTS || first != 1 || dropped != 0) {
+        printf("Ring buffer has %d events, expected %d\n",
+               n,TRACE_BUFFER_EVENTS);
+        return 1;
+    }
+    return 0;
+}
+
+/* Test 3: training records the events of its phases */
+
+static int test_model(void)
+{
+    const int M = 64;
+    const int epochs = 3;
+    int errors = 0;
+    float (*x)[X_DIM] = allocmem(M,X_DIM,float);
+    float (*y)[Y_DIM] = allocmem(M,Y_DIM,float);
+    for (int i = 0; i < M; i++) {
+        for (int j = 0; j < X_DIM; j++)
+            x[i][j] = urand(-1.0,1.0);
+        int c = (x[i][0] > 0) + (x[i][1] > 0);
+        for (int j = 0; j < Y_DIM; j++)
+            y[i][j] = (j == c) ? 1.0 : 0.0;
+    }
+    MODEL* m = model_create(2,16,X_DIM,1,1);
+    model_add(m,dense_create(8,"relu"),"dense");
+    model_add(m,dense_create(Y_DIM,"softmax"),"dense");
+    model_compile(m,"cross-entropy","adamw");
+    float losses[epochs];
+    model_fit(m,x,y,NULL,48,x + 48,y + 48,NULL,16,
+              epochs,0.01,0.0,losses,NULL,NULL,NULL,NULL);
+    model_free(m);
+    freemem(x);
+    freemem(y);
+    if (!write_and_read())
+        return 1;
+    static const char* names[] = {
+        "\"epoch\"", "\"prepare batch\"", "\"dense forward\"",
+        "\"dense backward\"", "\"loss\"", "\"update\"", "\"validation\""
+    };
+    for (int i = 0; i < (int) (sizeof(names) / sizeof(names[0])); i++)
+        if (count_lines(names[i],NULL) == 0) {
+            printf("No %s events\n",names[i]);
+            errors++;
+        }
+    /* 3 batches of training per epoch, 2 layers each */
+    if (count_lines("\"epoch\"",NULL) != epochs ||
+        count_lines("\"update\"",NULL) != 3 * epochs ||
+        count_lines("\"dense forward\"","\"arg\":1}") != 4 * epochs ||
+        count_lines("\"dense backward\"","\"arg\":0}") != 3 * epochs) {
+        printf("Unexpected number of events\n");
+        errors++;
+    }
+    return errors;
+}
+
+/* Test 4: nothing is recorded while disabled, at little cost */
+
+static int test_disabled(void)
+{
+    const int N = 10000000;
+    trace_disable();
+    long long start = current_time_ns();
+    for (int i = 0; i < N; i++) {
+        TRACE_BEGIN("disabled","test",i);
+        __asm__ __volatile__("" ::: "memory");
+        TRACE_END();
+    }
+    long long disabled = current_time_ns() - start;
+    trace_enable(NULL);
+    start = current_time_ns();
+    for (int i = 0; i < N / 10; i++) {
+        TRACE_BEGIN("enabled","test",i);
+        TRACE_END();
+    }
+    long long enabled = current_time_ns() - start;
+    printf("Cost of an event: %.2f ns disabled, %.2f ns enabled\n",
+           (double) disabled / N,(double) enabled / (N / 10));
+    if (!write_and_read())
+        return 1;
+    return count_lines("\"disabled\"",NULL) != 0;
+}
+
+int main()
+{
+    init_lrng(42);
+    int errors = 0;
+    int err;
+    trace_enable(NULL);
+
+    printf("Test 1: nested events on several threads\n");
+    err = test_events();
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 2: ring buffer overflow\n");
+    err = test_ring();
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 3: events of model training\n");
+    err = test_model();
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 4: disabled recording\n");
+    err = test_disabled();
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    freemem(trace_text);
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Test program for the kernel autotuner and its tuning cache */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "mem.h"
+#include "random.h"
+#include "array.h"
+#include "autotune.h"
+#include "dense.h"
+#include "model.h"
+#include "testutil.h"
+
+#define X_DIM 70  /* Input vectors dimension  */
+#define Y_DIM 5   /* Output vectors dimension */
+
+static char cache_file[256];
+
+/* Test 1: all kernels compute the same product */
+static int test_kernels(int N, int d, int M)
+{
+    float* x = allocmem(N,d,float);
+    float* y = allocmem(d,M,float);
+    float* r0 = allocmem(N,M,float);
+    float* r = allocmem(N,M,float);
+    fill(x,N * d);
+    fill(y,d * M);
+    matmul((fArr2D) r0,(fArr2D) x,(fArr2D) y,N,d,M);
+    int errors = 0;
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        fill(r,N * M); /* Kernels must overwrite r */
+        matmul_kernel(k,(fArr2D) r,(fArr2D) x,(fArr2D) y,N,d,M);
+        int err = differ(r0,r,N * M,1e-5);
+        printf("  %4dx%4dx%4d %-9s %s\n",N,d,M,autotune_kernel_name(k),
+               (err) ? "results differ" : "same results");
+        errors += err;
+    }
+    freemem(x);
+    freemem(y);
+    freemem(r0);
+    freemem(r);
+    return errors;
+}
+
+/* Test 2: decisions are saved in the cache file, and read from it */
+static int test_cache(void)
+{
+    /* A child process tunes a shape and saves it */
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+        exit(autotune_matmul(64,71,128));
+    int status;
+    waitpid(pid,&status,0);
+    int kernel = WEXITSTATUS(status);
+    printf("  64x71x128: %s\n",autotune_kernel_name(kernel));
+    if (!WIFEXITED(status) || kernel >= NUM_KERNELS) {
+        printf("Tuning failed\n");
+        return 1;
+    }
+    FILE* f = fopen(cache_file,"r");
+    if (f == NULL) {
+        printf("Cache file '%s' not written\n",cache_file);
+        return 1;
+    }
+    char line[256];
+    char text[4096] = "";
+    while (fgets(line,sizeof(line),f) != NULL)
+        if (strlen(text) + strlen(line) < sizeof(text))
+            strcat(text,line);
+    fclose(f);
+    printf("%s",text);
+    char expect[64];
+    sprintf(expect,"matmul 64 71 128 %s ",autotune_kernel_name(kernel));
+    if (strstr(text,expect) == NULL) {
+        printf("Cache file does not have '%s'\n",expect);
+        return 1;
+    }
+    /* Replace the decision by another, so that reading it, rather than
+     * tuning again, returns the other kernel
+     */
+    int other = (kernel + 1) % NUM_KERNELS;
+    char* p = strstr(text,expect) + strlen("matmul 64 71 128 ");
+    char rest[4096];
+    strcpy(rest,p + strlen(autotune_kernel_name(kernel)));
+    strcpy(p,autotune_kernel_name(other));
+    strcat(p,rest);
+    f = fopen(cache_file,"w");
+    fputs(text,f);
+    fclose(f);
+    int k = autotune_matmul(64,71,128);
+    if (k != other) {
+        printf("Cache returned %s, expected %s\n",
+               autotune_kernel_name(k),autotune_kernel_name(other));
+        return 1;
+    }
+    /* Tuning again replaces the decision */
+    k = autotune_matmul_force(64,71,128);
+    if (autotune_matmul(64,71,128) != k) {
+        printf("Forced tuning not kept\n");
+        return 1;
+    }
+    return 0;
+}
+
+/* Test 3: a compiled model predicts the same with any kernels */
+static int test_model(void)
+{
+    const int M = 100;
+    const int B = 32;
+    float (*x)[X_DIM] = allocmem(M,X_DIM,float);
+    float (*y1)[Y_DIM] = allocmem(M,Y_DIM,float);
+    float (*y2)[Y_DIM] = allocmem(M,Y_DIM,float);
+    fill((float*) x,M * X_DIM);
+    MODEL* m = model_create(3,B,X_DIM,1,0);
+    model_add(m,dense_create(300,"relu"),"dense");
+    model_add(m,dense_create(64,"relu"),"dense");
+    model_add(m,dense_create(Y_DIM,"softmax"),"dense");
+    model_compile(m,"cross-entropy","adamw");
+    int errors = 0;
+    for (int i = 0; i < m->num_layers; i++) {
+        DENSE* l = m->layer[i].dense;
+        int k = autotune_matmul(B,l->D,l->S);
+        printf("  layer %d %dx%dx%d: %s\n",i,B,l->D,l->S,
+               autotune_kernel_name(l->kernel));
+        if (l->kernel != k) {
+            printf("Layer %d kernel %s, expected %s\n",i,
+                   autotune_kernel_name(l->kernel),autotune_kernel_name(k));
+            errors++;
+        }
+    }
+    model_predict(m,x,y1,M);
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        for (int i = 0; i < m->num_layers; i++)
+            m->layer[i].dense->kernel = k;
+        model_predict(m,x,y2,M);
+        if (differ((float*) y1,(float*) y2,M * Y_DIM,1e-5)) {
+            printf("Prediction with %s kernels differs\n",
+                   autotune_kernel_name(k));
+            errors++;
+        }
+    }
+    model_free(m);
+    freemem(x);
+    freemem(y1);
+    freemem(y2);
+    return errors;
+}
+
+int main()
+{
+    init_lrng(42);
+    int errors = 0;
+    int err;
+
+    sprintf(cache_file,"/tmp/testtune-%d.txt",(int) getpid());
+    setenv("MLINC_TUNE_CACHE",cache_file,1);
+    unsetenv("MLINC_TUNE");
+
+    printf("Test 1: kernels\n");
+    err = test_kernels(1,7,3) + test_kernels(33,71,300) +
+          test_kernels(128,64,64) + test_kernels(5,300,1000);
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 2: tuning cache\n");
+    err = test_cache();
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    printf("Test 3: model kernels\n");
+    err = test_model();
+    printf("%s\n",(err) ? "Test failed" : "Test passed");
+    errors += err;
+
+    autotune_print(stdout);
+    remove(cache_file);
+
+    printf("\n%s\n",(errors) ? "Some tests failed" : "All tests passed");
+    return (errors) ? 1 : 0;
+}
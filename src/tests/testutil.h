@@ -0,0 +1,40 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Helpers shared by test programs that compare and time kernels */
+#ifndef TESTUTIL_H
+#define TESTUTIL_H
+#include <math.h>
+#include "random.h"
+#include "etime.h"
+
+/* Fills x with n random values in [-1, 1) */
+static inline void fill(float* x, long n)
+{
+    for (long i = 0; i < n; i++)
+        x[i] = urand(-1.0,1.0);
+}
+
+/* Returns 1 if x and y differ by more than rounding: by more than tol
+ * relative to x
+ */
+static inline int differ(const float* x, const float* y, long n, float tol)
+{
+    for (long i = 0; i < n; i++)
+        if (fabsf(x[i] - y[i]) > tol * (1 + fabsf(x[i])))
+            return 1;
+    return 0;
+}
+
+/* Sets t to the shortest time, in seconds, of reps runs of the statement */
+#define MIN_TIME(t,reps,...) \
+    do { \
+        t = 1e9; \
+        for (int r_ = 0; r_ < (reps); r_++) { \
+            long long t0_ = current_time_ns(); \
+            __VA_ARGS__; \
+            double t1_ = (current_time_ns() - t0_) / 1e9; \
+            if (t1_ < t) \
+                t = t1_; \
+        } \
+    } while (0)
+
+#endif
@@ -313,6 +313,120 @@ void test_transformer_dropout(TRANSFORMER* l_train,TRANSFORMER* l_infer)
     printf("PASS\n");
 }
 
+/* Test 5: variable shape
+ * A causal layer processing fewer or shorter sequences, using a prefix of
+ * its buffers, must produce the same outputs as the full size pass.
+ */
+void test_transformer_shape(TRANSFORMER* l)
+{
+    printf("Test: transformer variable shape\n");
+
+    const int B  = l->B;
+    const int T  = l->T;
+    const int BT = l->BT;
+    const int D  = l->D;
+
+    float X[BT][D];
+    float Y1[BT][D];
+    float Y2[BT][D];
+
+    for (int i = 0; i < BT; i++)
+        for (int j = 0; j < D; j++)
+            X[i][j] = urand(-1.0f,1.0f);
+
+    fltclr(Y1,BT * D);
+    transformer_forward(l,(fArr2D) X,NULL,(fArr2D) Y1,0);
+
+    int shapes[2][2] = { { B / 2, T }, { 1, T - 1 } };
+    for (int k = 0; k < 2; k++) {
+        int b = shapes[k][0];
+        int t = shapes[k][1];
+        if (b < 1 || t < 1)
+            continue;
+        transformer_set_shape(l,b,t);
+        fltclr(Y2,BT * D);
+        transformer_forward(l,(fArr2D) X,NULL,(fArr2D) Y2,0);
+        for (int i = 0; i < b * t; i++) {
+            for (int j = 0; j < D; j++) {
+                if (fabsf(Y1[i][j] - Y2[i][j]) > 1e-5f) {
+                    printf("FAIL shape %d x %d: Y[%d][%d] = %g, expected %g\n",
+                           b,t,i,j,Y2[i][j],Y1[i][j]);
+                    failures++;
+                    transformer_set_shape(l,B,T);
+                    return;
+                }
+            }
+        }
+    }
+    transformer_set_shape(l,B,T);
+    printf("PASS\n");
+}
+
+/* Test 6: chunked FFN
+ * The FFN of a layer whose FFN dimension is large runs in chunks of rows.
+ * Training and inference layers with the same weights must produce the
+ * same outputs as the FFN run on all the rows at once; the training layer
+ * must also keep all the rows of ffn1's output for the backward pass.
+ */
+void test_transformer_ffn_chunks(TRANSFORMER* l_train, TRANSFORMER* l_infer)
+{
+    printf("Test: transformer chunked FFN\n");
+
+    const int BT  = l_train->BT;
+    const int D   = l_train->D;
+    const int Dff = l_train->Dff;
+
+    if (l_train->ffn_rows >= BT || l_infer->ffn1->Bmax != l_infer->ffn_rows) {
+        printf("FAIL FFN is not chunked: %d rows of %d, ffn1 buffers of %d rows\n",
+               l_train->ffn_rows,BT,l_infer->ffn1->Bmax);
+        failures++;
+        return;
+    }
+
+    float* X  = allocmem(BT,D,float);
+    float* Y1 = allocmem(BT,D,float);
+    float* Y2 = allocmem(BT,D,float);
+    float* Y3 = allocmem(BT,D,float);
+    float* h  = allocmem(BT,Dff,float);
+    for (int i = 0; i < BT * D; i++)
+        X[i] = urand(-1.0f,1.0f);
+
+    /* Chunked training and inference passes */
+    transformer_forward(l_train,(fArr2D) X,NULL,(fArr2D) Y1,0);
+    fltcpy(h,(float*) l_train->ffn1->h,BT * Dff);
+    transformer_forward(l_infer,(fArr2D) X,NULL,(fArr2D) Y2,0);
+    /* All the rows at once */
+    const int rows = l_train->ffn_rows;
+    l_train->ffn_rows = BT;
+    transformer_forward(l_train,(fArr2D) X,NULL,(fArr2D) Y3,0);
+    l_train->ffn_rows = rows;
+
+    int errors = 0;
+    for (int i = 0; i < BT * D && errors == 0; i++)
+        if (fabsf(Y1[i] - Y3[i]) > 1e-5f || fabsf(Y2[i] - Y3[i]) > 1e-5f) {
+            printf("FAIL Y[%d] = %g (training) %g (inference), expected %g\n",
+                   i,Y1[i],Y2[i],Y3[i]);
+            errors++;
+        }
+    const float* h3 = (const float*) l_train->ffn1->h;
+    for (int i = 0; i < BT * Dff && errors == 0; i++)
+        if (fabsf(h[i] - h3[i]) > 1e-5f) {
+            printf("FAIL ffn1 output [%d] = %g, expected %g\n",i,h[i],h3[i]);
+            errors++;
+        }
+    freemem(X);
+    freemem(Y1);
+    freemem(Y2);
+    freemem(Y3);
+    freemem(h);
+    if (errors > 0) {
+        failures++;
+        return;
+    }
+    printf("PASS %d rows in chunks of %d, inference ffn1 buffer %.1f%% of full\n",
+           BT,rows,100.0 * l_infer->ffn1->Bmax / BT);
+}
+
 void smoke_test(void)
 {
     const int batch_size = 8;
@@ -365,6 +479,28 @@ void smoke_test(void)
     test_transformer_dropout(l_train,l_infer);
     transformer_free(l_train);
     transformer_free(l_infer);
+
+    /* Test 5: variable shape */
+    l = transformer_create(num_heads,seq_len,model_dim,ffn_dim,0);
+    transformer_init(l,batch_size,0,0.0);
+    test_transformer_shape(l);
+    transformer_free(l);
+
+    /* Test 6: chunked FFN, of FFN dimension large enough to be chunked */
+    const int chunk_dim = 4 * FFN_CHUNK_FLOATS / (batch_size * seq_len);
+    l_train = transformer_create(num_heads,seq_len,model_dim,chunk_dim,0);
+    transformer_init(l_train,batch_size,1,0.0);
+    l_infer = transformer_create(num_heads,seq_len,model_dim,chunk_dim,0);
+    transformer_init(l_infer,batch_size,0,0.0);
+    memcpy(l_infer->mha->Wq,  l_train->mha->Wq,  model_dim * model_dim * sizeof(float));
+    memcpy(l_infer->mha->Wk,  l_train->mha->Wk,  model_dim * model_dim * sizeof(float));
+    memcpy(l_infer->mha->Wv,  l_train->mha->Wv,  model_dim * model_dim * sizeof(float));
+    memcpy(l_infer->mha->Wo,  l_train->mha->Wo,  model_dim * model_dim * sizeof(float));
+    memcpy(l_infer->ffn1->Wx, l_train->ffn1->Wx, model_dim * chunk_dim * sizeof(float));
+    memcpy(l_infer->ffn2->Wx, l_train->ffn2->Wx, chunk_dim * model_dim * sizeof(float));
+    test_transformer_ffn_chunks(l_train,l_infer);
+    transformer_free(l_train);
+    transformer_free(l_infer);
 }
 
 /* Linear weight update: W -= lr * gW */
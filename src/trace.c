@@ -0,0 +1,208 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Timeline recording of training and inference events */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "mem.h"
+#include "etime.h"
+#include "trace.h"
+
+typedef struct {
+    const char* name;
+    const char* cat;
+    long long start;            /* Nanoseconds since trace start          */
+    long long dur;              /* Duration, -1 for an instant event      */
+    int arg;
+} TRACEEVENT;
+
+typedef struct tracebuf_s TRACEBUF;
+struct tracebuf_s {
+    TRACEBUF* next;             /* Next thread's buffer                   */
+    int tid;                    /* Thread index, in order of first event  */
+    char name[32];              /* Thread name                            */
+    long count;                 /* Number of events recorded              */
+    int depth;                  /* Number of events begun, not ended      */
+    TRACEEVENT stack[TRACE_MAX_DEPTH];
+    TRACEEVENT ev[TRACE_BUFFER_EVENTS];
+};
+
+int trace_on = 0;
+
+static long long trace_start = 0;
+static char* trace_file = NULL;
+static TRACEBUF* buffers = NULL;
+static int num_buffers = 0;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread TRACEBUF* tbuf = NULL;
+
+static void trace_atexit(void)
+{
+    if (trace_file != NULL) {
+        trace_on = 0;
+        trace_write(trace_file);
+    }
+}
+
+/* Enables recording if the environment variable MLINC_TRACE is set */
+__attribute__((constructor))
+static void trace_init(void)
+{
+    const char* env = getenv("MLINC_TRACE");
+    if (env != NULL && env[0] != '\0')
+        trace_enable(env);
+}
+
+/* Enables recording, and sets the file written at exit (may be NULL) */
+void trace_enable(const char* filename)
+{
+    pthread_mutex_lock(&trace_lock);
+    if (trace_start == 0) {
+        trace_start = current_time_ns();
+        atexit(trace_atexit);
+    }
+    freemem(trace_file);
+    trace_file = NULL;
+    if (filename != NULL) {
+        trace_file = allocmem(1,strlen(filename) + 1,char);
+        strcpy(trace_file,filename);
+    }
+    trace_on = 1;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+/* Disables recording; recorded events are kept */
+void trace_disable(void)
+{
+    trace_on = 0;
+}
+
+/* Returns the calling thread's buffer, creating it on first use */
+static TRACEBUF* thread_buffer(void)
+{
+    if (tbuf == NULL) {
+        TRACEBUF* b = allocmem(1,1,TRACEBUF);
+        pthread_mutex_lock(&trace_lock);
+        b->tid = num_buffers++;
+        snprintf(b->name,sizeof(b->name),"thread %d",b->tid);
+        b->next = buffers;
+        buffers = b;
+        pthread_mutex_unlock(&trace_lock);
+        tbuf = b;
+    }
+    return tbuf;
+}
+
+/* Names the calling thread in the timeline. name is copied. */
+void trace_thread_name(const char* name)
+{
+    if (!trace_on)
+        return;
+    TRACEBUF* b = thread_buffer();
+    snprintf(b->name,sizeof(b->name),"%s",name);
+}
+
+void trace_begin(const char* name, const char* cat, int arg)
+{
+    TRACEBUF* b = thread_buffer();
+    if (b->depth < TRACE_MAX_DEPTH) {
+        TRACEEVENT* e = &b->stack[b->depth];
+        e->name = name;
+        e->cat = cat;
+        e->arg = arg;
+        e->start = current_time_ns() - trace_start;
+    }
+    b->depth++;
+}
+
+void trace_end(void)
+{
+    TRACEBUF* b = thread_buffer();
+    if (b->depth == 0) /* Begun before recording was enabled */
+        return;
+    b->depth--;
+    if (b->depth < TRACE_MAX_DEPTH) {
+        TRACEEVENT* e = &b->ev[b->count % TRACE_BUFFER_EVENTS];
+        *e = b->stack[b->depth];
+        e->dur = current_time_ns() - trace_start - e->start;
+        b->count++;
+    }
+}
+
+void trace_instant(const char* name, const char* cat, int arg)
+{
+    TRACEBUF* b = thread_buffer();
+    TRACEEVENT* e = &b->ev[b->count % TRACE_BUFFER_EVENTS];
+    e->name = name;
+    e->cat = cat;
+    e->arg = arg;
+    e->start = current_time_ns() - trace_start;
+    e->dur = -1;
+    b->count++;
+}
+
+/* Writes the events recorded by all threads to a file, in Chrome trace
+ * event format.
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ *
+ * Notes:
+ *   Events that threads record while the file is written may be missing
+ *   or incomplete; call it when other threads are idle.
+ */
+int trace_write(const char* filename)
+{
+    /* Replace %p by the process id */
+    char path[1024];
+    int n = 0;
+    for (const char* p = filename; *p != '\0' && n < (int) sizeof(path) - 16;
+         p++) {
+        if (p[0] == '%' && p[1] == 'p') {
+            n += sprintf(path + n,"%d",(int) getpid());
+            p++;
+        }
+        else
+            path[n++] = *p;
+    }
+    path[n] = '\0';
+    FILE* f = fopen(path,"w");
+    if (f == NULL) {
+        fprintf(stderr,"In trace_write: failed to open file '%s' for write\n",
+                path);
+        return 0;
+    }
+    int pid = (int) getpid();
+    fprintf(f,"{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(f,"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+              "\"args\":{\"name\":\"mlinc %d\"}}",pid,pid);
+    pthread_mutex_lock(&trace_lock);
+    for (TRACEBUF* b = buffers; b != NULL; b = b->next) {
+        fprintf(f,",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                  "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",pid,b->tid,b->name);
+        long count = b->count;
+        long first = (count > TRACE_BUFFER_EVENTS) ?
+                     count - TRACE_BUFFER_EVENTS : 0;
+        for (long i = first; i < count; i++) {
+            const TRACEEVENT* e = &b->ev[i % TRACE_BUFFER_EVENTS];
+            /* Times are in microseconds */
+            fprintf(f,",\n{\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%d,"
+                      "\"tid\":%d,\"ts\":%.3f,",
+                    e->name,e->cat,pid,b->tid,e->start / 1000.0);
+            if (e->dur >= 0)
+                fprintf(f,"\"ph\":\"X\",\"dur\":%.3f",e->dur / 1000.0);
+            else
+                fprintf(f,"\"ph\":\"i\",\"s\":\"t\"");
+            if (e->arg >= 0)
+                fprintf(f,",\"args\":{\"arg\":%d}",e->arg);
+            fprintf(f,"}");
+        }
+    }
+    pthread_mutex_unlock(&trace_lock);
+    fprintf(f,"\n]}\n");
+    int ok = !ferror(f);
+    if (fclose(f) != 0)
+        ok = 0;
+    return ok;
+}
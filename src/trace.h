@@ -0,0 +1,69 @@
+/* Copyright (c) 2026 Gilad Odinak */
+/* Timeline recording of training and inference events */
+#ifndef TRACE_H
+#define TRACE_H
+
+/* Events, such as the forward pass of a layer, are recorded with their
+ * start time and duration, per thread, and written in the Chrome trace
+ * event format (JSON), which chrome://tracing and Perfetto display as a
+ * timeline of each thread.
+ *
+ * Recording is enabled by setting the environment variable MLINC_TRACE to
+ * the name of the file to write when the program exits, or by calling
+ * trace_enable(). "%p" in the file name is replaced by the process id, so
+ * each process of data parallel training writes its own file.
+ *
+ * Each thread records into its own ring buffer of TRACE_BUFFER_EVENTS
+ * events, without locking; when it is full, the oldest events are
+ * overwritten. When recording is disabled, the TRACE_ macros only test a
+ * global flag.
+ *
+ * Event names and categories must be string constants (they are kept by
+ * pointer, not copied).
+ */
+#define TRACE_BUFFER_EVENTS 65536   /* Events kept per thread          */
+#define TRACE_MAX_DEPTH        64   /* Maximum nesting of events       */
+
+extern int trace_on;    /* If not zero, events are recorded */
+
+/* Begins an event named name, of category cat, on the calling thread.
+ * arg is shown with the event, for example the index of a layer; set it
+ * to -1 to exclude it.
+ */
+#define TRACE_BEGIN(name,cat,arg) \
+    do { if (trace_on) trace_begin(name,cat,arg); } while (0)
+
+/* Ends the last event begun on the calling thread */
+#define TRACE_END() \
+    do { if (trace_on) trace_end(); } while (0)
+
+/* Records an event with no duration */
+#define TRACE_INSTANT(name,cat,arg) \
+    do { if (trace_on) trace_instant(name,cat,arg); } while (0)
+
+/* Enables recording, and sets the file written at exit (may be NULL) */
+void trace_enable(const char* filename);
+
+/* Disables recording; recorded events are kept */
+void trace_disable(void);
+
+/* Names the calling thread in the timeline. name is copied. */
+void trace_thread_name(const char* name);
+
+void trace_begin(const char* name, const char* cat, int arg);
+void trace_end(void);
+void trace_instant(const char* name, const char* cat, int arg);
+
+/* Writes the events recorded by all threads to a file, in Chrome trace
+ * event format.
+ *
+ * Returns:
+ *   1 if successful, 0 otherwise.
+ *
+ * Notes:
+ *   Events that threads record while the file is written may be missing
+ *   or incomplete; call it when other threads are idle.
+ */
+int trace_write(const char* filename);
+
+#endif